@@ -0,0 +1,56 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Pipelined calls of the agm dbus client.
+ *
+ * With async on, agm_session_set_params, agm_session_aif_set_params,
+ * agm_set_params_with_tag, agm_session_set_metadata,
+ * agm_session_aif_set_metadata, agm_aif_set_metadata and
+ * agm_session_register_for_events send their call and return 0 without
+ * waiting for the reply, so a setup sequence costs about one round trip
+ * instead of one per call. Every other call still waits for its reply,
+ * and the service sees all calls in the order they were made.
+ *
+ * A pipelined call that fails is reported three ways: to cb, if one is
+ * set, as soon as the reply comes in; by agm_session_prepare and
+ * agm_session_start of its session, which return the error once the
+ * session's pipelined calls are done; and by agm_client_sync. Calls on an
+ * aif, which have no session, use AGM_CLIENT_NO_SESSION.
+ *
+ * Setting AGM_CLIENT_ASYNC=1 in the environment turns async on at load,
+ * without cb, for clients that cannot be changed.
+ */
+
+#ifndef __AGM_CLIENT_WRAPPER_DBUS_H__
+#define __AGM_CLIENT_WRAPPER_DBUS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AGM_CLIENT_NO_SESSION UINT32_MAX
+
+/*
+ * Called on the dbus connection's thread, which must not be blocked:
+ * the callback must not make agm calls.
+ */
+typedef void (*agm_client_async_cb)(uint32_t session_id, const char *method,
+                                    int error, void *cookie);
+
+/* turning async off waits for pending calls, and returns as agm_client_sync */
+int agm_client_set_async(bool enable, agm_client_async_cb cb, void *cookie);
+
+/* waits for all pipelined calls, returns the first failure not yet reported */
+int agm_client_sync(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AGM_CLIENT_WRAPPER_DBUS_H__ */
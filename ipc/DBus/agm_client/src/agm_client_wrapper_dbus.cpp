@@ -32,6 +32,11 @@
 #include <errno.h>
 #include <agm/agm_api.h>
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+#include <qti-agm-service/agm-dbus-blob.h>
+#include <qti-agm-service/agm-dbus-gen.h>
+#include <qti-agm-service/agm-dbus-ring.h>
+#include "agm_client_wrapper_dbus.h"
 #include "utils.h"
 
 #define AGM_OBJECT_PATH "/org/qti/agm"
@@ -40,11 +45,50 @@
 #define AGM_DBUS_CONNECTION "org.Qti.AgmService"
 #define AGM_MAX_G_OBJ_PATH 128
 
+/* periods the shared ring holds, sized from the first read or write */
+#define AGM_CLIENT_RING_PERIODS 4
+#define AGM_CLIENT_RING_TIMEOUT_MS 5000
+
+#define AGM_CLIENT_ASYNC_ENV "AGM_CLIENT_ASYNC"
+#define AGM_CLIENT_ASYNC_ALL (-1)
+
+enum {
+    AGM_CLIENT_RING_NONE,
+    AGM_CLIENT_RING_ACTIVE,
+    AGM_CLIENT_RING_UNSUPPORTED,
+};
+
 typedef struct {
     GDBusConnection *conn;
     GDBusProxy *proxy;
     char g_obj_path[AGM_MAX_G_OBJ_PATH];
     GHashTable *ses_hash_table;
+    /* payloads in memfds, see agm-dbus-blob.h */
+    bool blob_unsupported;
+    bool blob_checked;          /* a *Fd call went through */
+    GMutex blob_lock;
+    int tag_info_fd;            /* fetched by a size query, not yet read */
+    size_t tag_info_size;
+    uint32_t tag_info_session_id;
+    uint32_t tag_info_aif_id;
+    bool run_ops_unsupported;
+    /* results cached per service generation, see agm-dbus-gen.h */
+    GMutex cache_lock;
+    bool gen_unsupported;
+    struct agm_dbus_gen_page *gen_page;
+    int gen_pidfd;
+    struct aif_info *aif_cache;
+    size_t num_aif_cache;
+    GList *tag_info_cache;      /* most recently used first */
+    /* pipelined calls, see agm_client_wrapper_dbus.h */
+    GMutex async_lock;
+    GCond async_cond;
+    bool async;
+    agm_client_async_cb async_cb;
+    void *async_cookie;
+    guint async_filter_id;
+    GHashTable *async_calls;    /* reply serial to agm_client_async_call */
+    GHashTable *async_errors;   /* key to first failure not reported */
 } agm_client_module_data;
 
 typedef struct {
@@ -55,6 +99,11 @@ typedef struct {
     GThread *thread_loop;
     GMainLoop *loop;
     GList *callbacks;
+    /* Shared memory data path, see agm-dbus-ring.h */
+    int ring_state;
+    struct agm_dbus_ring ring;
+    int kick_fd;
+    int notify_fd;
 } agm_client_session_data;
 
 typedef struct {
@@ -65,6 +114,11 @@ typedef struct {
     guint sub_id_callback_event;
 } agm_callback_data;
 
+typedef struct {
+    uint32_t key;               /* session id or AGM_CLIENT_NO_SESSION */
+    const char *method;
+} agm_client_async_call;
+
 static agm_client_module_data *mdata = NULL;
 
 static GDBusConnection *get_dbus_connection() {
@@ -106,6 +160,283 @@ static GDBusProxy *get_proxy_object(GDBusConnection *connection,
     return proxy;
 }
 
+/*
+ * Pipelined calls go out with g_dbus_connection_send_message and their
+ * replies are taken off the connection by async_filter, on the GDBus worker
+ * thread, so they complete whether or not the caller runs a main loop. The
+ * service runs the calls of one session in the order they came in, and aif
+ * calls in order on a queue of their own (see ipc_agm_route in the server).
+ * A synchronous call therefore only waits for the pipelined calls of other
+ * keys, which it could overtake; those of its own key are ahead of it.
+ */
+
+/* the service queue a call runs on, as the server routes it */
+static uint32_t call_key(GDBusProxy *proxy, const gchar *method,
+                         GVariant *argument) {
+    const gchar *path = g_dbus_proxy_get_object_path(proxy);
+    uint32_t key = AGM_CLIENT_NO_SESSION;
+    GVariant *first;
+
+    if (path != NULL &&
+        sscanf(path, AGM_OBJECT_PATH "/session_%u", &key) == 1)
+        return key;
+
+    if (g_str_has_prefix(method, "AgmAif") ||
+        g_str_has_prefix(method, "AgmGetAif") ||
+        argument == NULL || g_variant_n_children(argument) == 0)
+        return AGM_CLIENT_NO_SESSION;
+
+    first = g_variant_get_child_value(argument, 0);
+    if (g_variant_is_of_type(first, G_VARIANT_TYPE_UINT32))
+        key = g_variant_get_uint32(first);
+    g_variant_unref(first);
+    return key;
+}
+
+static bool async_match(agm_client_async_call *call, int64_t key,
+                        bool others) {
+    if (key == AGM_CLIENT_ASYNC_ALL)
+        return true;
+    return others ? call->key != key : call->key == key;
+}
+
+static bool async_pending_locked(int64_t key, bool others) {
+    GHashTableIter iter;
+    gpointer value;
+
+    g_hash_table_iter_init(&iter, mdata->async_calls);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        if (async_match((agm_client_async_call *)value, key, others))
+            return true;
+    }
+    return false;
+}
+
+static void async_fail_locked(uint32_t key, int err) {
+    if (!g_hash_table_contains(mdata->async_errors, GUINT_TO_POINTER(key)))
+        g_hash_table_insert(mdata->async_errors, GUINT_TO_POINTER(key),
+                            GINT_TO_POINTER(err));
+}
+
+/*
+ * Wait for the pipelined calls of key, or with others for those of every
+ * other key. As with a synchronous call there is no timeout of our own: a
+ * call is pending until its reply or error is in, which the bus sends for
+ * us if the service goes away. Only a closed connection ends them early.
+ */
+static void async_wait_locked(int64_t key, bool others) {
+    while (async_pending_locked(key, others))
+        g_cond_wait(&mdata->async_cond, &mdata->async_lock);
+}
+
+/* no replies come on a closed connection, fail what is still pending */
+static void async_closed(GDBusConnection *conn, gboolean remote_peer_vanished,
+                         GError *error, gpointer data) {
+    agm_client_async_call *call;
+    agm_client_async_cb cb;
+    GHashTableIter iter;
+    GList *failed = NULL, *l;
+    gpointer value;
+    void *cookie;
+
+    g_mutex_lock(&mdata->async_lock);
+    g_hash_table_iter_init(&iter, mdata->async_calls);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        call = (agm_client_async_call *)value;
+        AGM_LOGE("%s: connection closed before %s returned\n", __func__,
+                  call->method);
+        async_fail_locked(call->key, -ECONNRESET);
+        failed = g_list_prepend(failed, call);
+        g_hash_table_iter_remove(&iter);
+    }
+    cb = mdata->async_cb;
+    cookie = mdata->async_cookie;
+    g_cond_broadcast(&mdata->async_cond);
+    g_mutex_unlock(&mdata->async_lock);
+
+    for (l = failed; l != NULL; l = l->next) {
+        call = (agm_client_async_call *)l->data;
+        if (cb)
+            cb(call->key, call->method, -ECONNRESET, cookie);
+    }
+    g_list_free_full(failed, g_free);
+}
+
+static GDBusMessage *async_filter(GDBusConnection *conn,
+                                  GDBusMessage *msg,
+                                  gboolean incoming,
+                                  gpointer data) {
+    agm_client_async_call *call;
+    agm_client_async_cb cb;
+    GDBusMessageType type;
+    const gchar *name;
+    gpointer serial;
+    void *cookie;
+    int err = 0;
+
+    if (!incoming)
+        return msg;
+
+    type = g_dbus_message_get_message_type(msg);
+    if (type != G_DBUS_MESSAGE_TYPE_METHOD_RETURN &&
+        type != G_DBUS_MESSAGE_TYPE_ERROR)
+        return msg;
+
+    serial = GUINT_TO_POINTER(g_dbus_message_get_reply_serial(msg));
+    g_mutex_lock(&mdata->async_lock);
+    call = (agm_client_async_call *)g_hash_table_lookup(mdata->async_calls,
+                                                        serial);
+    if (call == NULL) {
+        g_mutex_unlock(&mdata->async_lock);
+        return msg;
+    }
+    g_hash_table_remove(mdata->async_calls, serial);
+
+    if (type == G_DBUS_MESSAGE_TYPE_ERROR) {
+        name = g_dbus_message_get_error_name(msg);
+        err = g_strcmp0(name, "org.freedesktop.DBus.Error.UnknownMethod") ?
+              -EINVAL : -ENOSYS;
+        AGM_LOGE("%s: pipelined %s failed: %s\n", __func__, call->method,
+                  name);
+        async_fail_locked(call->key, err);
+    }
+    cb = mdata->async_cb;
+    cookie = mdata->async_cookie;
+    g_cond_broadcast(&mdata->async_cond);
+    g_mutex_unlock(&mdata->async_lock);
+
+    if (err && cb)
+        cb(call->key, call->method, err, cookie);
+
+    g_free(call);
+    g_object_unref(msg);
+    return NULL;
+}
+
+/* send a call without waiting for it; fd, if any, goes as handle 0 */
+static int async_call(GDBusProxy *proxy, const char *method,
+                      GVariant *argument, int fd) {
+    agm_client_async_call *call;
+    GUnixFDList *fd_list = NULL;
+    GDBusMessage *msg;
+    GError *error = NULL;
+    guint32 serial;
+    int rc = 0;
+
+    msg = g_dbus_message_new_method_call(AGM_DBUS_CONNECTION,
+                                    g_dbus_proxy_get_object_path(proxy),
+                                    g_dbus_proxy_get_interface_name(proxy),
+                                    method);
+    g_dbus_message_set_body(msg, argument);
+
+    if (fd >= 0) {
+        fd_list = g_unix_fd_list_new();
+        if (g_unix_fd_list_append(fd_list, fd, &error) < 0) {
+            AGM_LOGE("%s: Error passing blob fd: %s\n", __func__,
+                      error->message);
+            g_error_free(error);
+            rc = -EINVAL;
+            goto exit;
+        }
+        g_dbus_message_set_unix_fd_list(msg, fd_list);
+    }
+
+    call = g_new0(agm_client_async_call, 1);
+    call->key = call_key(proxy, method, argument);
+    call->method = method;
+
+    /* held across the send, the reply cannot be looked up before it is in */
+    g_mutex_lock(&mdata->async_lock);
+    if (!g_dbus_connection_send_message(mdata->conn, msg,
+                                        G_DBUS_SEND_MESSAGE_FLAGS_NONE,
+                                        &serial, &error)) {
+        g_mutex_unlock(&mdata->async_lock);
+        AGM_LOGE("%s: Error sending %s: %s\n", __func__, method,
+                  error->message);
+        g_error_free(error);
+        g_free(call);
+        rc = -EINVAL;
+        goto exit;
+    }
+    g_hash_table_insert(mdata->async_calls, GUINT_TO_POINTER(serial), call);
+    g_mutex_unlock(&mdata->async_lock);
+
+exit:
+    if (fd_list)
+        g_object_unref(fd_list);
+    g_object_unref(msg);
+    return rc;
+}
+
+static bool async_enabled(void) {
+    bool async;
+
+    g_mutex_lock(&mdata->async_lock);
+    async = mdata->async;
+    g_mutex_unlock(&mdata->async_lock);
+    return async;
+}
+
+/* the first failure of key's pipelined calls not reported yet, 0 if none */
+static int async_take_error(int64_t key) {
+    GHashTableIter iter;
+    gpointer value;
+    int err = 0;
+
+    g_mutex_lock(&mdata->async_lock);
+    async_wait_locked(key, false);
+    if (key == AGM_CLIENT_ASYNC_ALL) {
+        g_hash_table_iter_init(&iter, mdata->async_errors);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            if (err == 0)
+                err = GPOINTER_TO_INT(value);
+            g_hash_table_iter_remove(&iter);
+        }
+    } else {
+        err = GPOINTER_TO_INT(g_hash_table_lookup(mdata->async_errors,
+                                                  GUINT_TO_POINTER(key)));
+        g_hash_table_remove(mdata->async_errors, GUINT_TO_POINTER(key));
+    }
+    g_mutex_unlock(&mdata->async_lock);
+    return err;
+}
+
+/* every synchronous call goes through these */
+static GVariant *client_proxy_call_sync(GDBusProxy *proxy,
+                                        const gchar *method,
+                                        GVariant *argument,
+                                        GDBusCallFlags flags,
+                                        gint timeout_msec,
+                                        GCancellable *cancellable,
+                                        GError **error) {
+    g_mutex_lock(&mdata->async_lock);
+    if (g_hash_table_size(mdata->async_calls))
+        async_wait_locked(call_key(proxy, method, argument), true);
+    g_mutex_unlock(&mdata->async_lock);
+
+    return g_dbus_proxy_call_sync(proxy, method, argument, flags,
+                                  timeout_msec, cancellable, error);
+}
+
+static GVariant *client_proxy_call_with_unix_fd_list_sync(GDBusProxy *proxy,
+                                    const gchar *method,
+                                    GVariant *argument,
+                                    GDBusCallFlags flags,
+                                    gint timeout_msec,
+                                    GUnixFDList *fd_list,
+                                    GUnixFDList **out_fd_list,
+                                    GCancellable *cancellable,
+                                    GError **error) {
+    g_mutex_lock(&mdata->async_lock);
+    if (g_hash_table_size(mdata->async_calls))
+        async_wait_locked(call_key(proxy, method, argument), true);
+    g_mutex_unlock(&mdata->async_lock);
+
+    return g_dbus_proxy_call_with_unix_fd_list_sync(proxy, method, argument,
+                                    flags, timeout_msec, fd_list,
+                                    out_fd_list, cancellable, error);
+}
+
 static int initialize_module_data() {
     int rc = 0;
 
@@ -138,9 +469,24 @@ static int initialize_module_data() {
                "%s", AGM_OBJECT_PATH);
 
     mdata->ses_hash_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_mutex_init(&mdata->blob_lock);
+    mdata->tag_info_fd = -1;
+    g_mutex_init(&mdata->cache_lock);
+    mdata->gen_pidfd = -1;
+    g_mutex_init(&mdata->async_lock);
+    g_cond_init(&mdata->async_cond);
+    mdata->async_calls = g_hash_table_new(g_direct_hash, g_direct_equal);
+    mdata->async_errors = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    if (g_strcmp0(getenv(AGM_CLIENT_ASYNC_ENV), "1") == 0)
+        agm_client_set_async(true, NULL, NULL);
     return rc;
 }
 
+/*
+ * The service sends each registration's events only to the client that made
+ * it, batched: cookie, event type, events it had to drop, then the events.
+ */
 static void on_emit_signal_callback(GDBusConnection *conn,
                                     const gchar *sender_name,
                                     const gchar *object_path,
@@ -149,33 +495,57 @@ static void on_emit_signal_callback(GDBusConnection *conn,
                                     GVariant *parameters,
                                     gpointer data) {
     agm_callback_data *cb_data = (agm_callback_data *)data;
-    GVariant *array_v;
-    GVariantIter arg_i;
-    struct agm_event_cb_params event_params;
-    struct agm_event_cb_params *event_params_l;
+    GVariantIter *events_i = NULL;
+    GVariant *payload_v = NULL;
+    struct agm_event_cb_params *event_params = NULL;
+    guint64 cookie;
+    guint32 evt_type, dropped, module_id, event_id;
     gsize element_size = sizeof(guchar);
-    gsize n_elements = 0;
+    gsize n_elements = 0, buf_size = 0;
     gconstpointer value;
 
     AGM_LOGD("%s\n", __func__);
 
-    g_variant_iter_init(&arg_i, parameters);
-    g_variant_iter_next(&arg_i, "u", &event_params.source_module_id);
-    g_variant_iter_next(&arg_i, "u", &event_params.event_id);
-    g_variant_iter_next(&arg_i, "u", &event_params.event_payload_size);
-    event_params_l = (struct agm_event_cb_params*) calloc(1,
-                     (sizeof(struct agm_event_cb_params) +
-                     event_params.event_payload_size));
-    array_v = g_variant_iter_next_value(&arg_i);
-    value = g_variant_get_fixed_array(array_v, &n_elements, element_size);
-    memcpy(&event_params_l->event_payload[0], value, n_elements);
-    g_variant_unref(array_v);
+    if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(tuua(uuay))")))
+        return;
+
+    g_variant_get(parameters, "(tuua(uuay))", &cookie, &evt_type, &dropped,
+                  &events_i);
+    if (cookie != (guint64)cb_data->client_data ||
+        evt_type != cb_data->evt_type)
+        goto done;
+
+    if (dropped)
+        AGM_LOGE("%s: service dropped %u events for session %d\n", __func__,
+                 dropped, cb_data->session_id);
+
+    while (g_variant_iter_loop(events_i, "(uu@ay)", &module_id, &event_id,
+                               &payload_v)) {
+        value = g_variant_get_fixed_array(payload_v, &n_elements,
+                                          element_size);
+        if (event_params == NULL || n_elements > buf_size) {
+            free(event_params);
+            event_params = (struct agm_event_cb_params *)calloc(1,
+                            sizeof(struct agm_event_cb_params) + n_elements);
+            if (event_params == NULL) {
+                AGM_LOGE("%s: no memory for event\n", __func__);
+                g_variant_unref(payload_v);
+                break;
+            }
+            buf_size = n_elements;
+        }
 
-    event_params_l->source_module_id = event_params.source_module_id;
-    event_params_l->event_id = event_params.event_id;
-    event_params_l->event_payload_size = event_params.event_payload_size;
+        event_params->source_module_id = module_id;
+        event_params->event_id = event_id;
+        event_params->event_payload_size = n_elements;
+        memcpy(&event_params->event_payload[0], value, n_elements);
+
+        cb_data->cb(cb_data->session_id, event_params, cb_data->client_data);
+    }
 
-    cb_data->cb(cb_data->session_id, event_params_l, cb_data->client_data);
+done:
+    free(event_params);
+    g_variant_iter_free(events_i);
 }
 
 static void free_callbacks(agm_client_session_data *ses_data) {
@@ -216,7 +586,7 @@ static int subscribe_callback_event(agm_client_session_data *ses_data,
                                           mdata->conn,
                                           NULL,
                                           AGM_SESSION_IFACE,
-                                          "AgmEventCb",
+                                          "AgmEventBatch",
                                           ses_data->obj_path,
                                           NULL,
                                           G_DBUS_SIGNAL_FLAGS_NONE,
@@ -231,10 +601,9 @@ static int subscribe_callback_event(agm_client_session_data *ses_data,
             if (node_data != NULL) {
                 if (node_data->session_id == cb_data->session_id &&
                     node_data->evt_type == cb_data->evt_type &&
-                    node_data->sub_id_callback_event ==
-                                             cb_data->sub_id_callback_event) {
+                    node_data->client_data == cb_data->client_data) {
                         g_dbus_connection_signal_unsubscribe(mdata->conn,
-                                               cb_data->sub_id_callback_event);
+                                             node_data->sub_id_callback_event);
                         ses_data->callbacks = g_list_remove(
                                                            ses_data->callbacks,
                                                            node_data);
@@ -249,229 +618,768 @@ static int subscribe_callback_event(agm_client_session_data *ses_data,
     return 0;
 }
 
-static void *signal_threadloop(void *cookie) {
-    agm_client_session_data *ses_data = (agm_client_session_data *)cookie;
-
-    AGM_LOGD("Enter %s %p\n", __func__, ses_data);
-    if (!ses_data) {
-        AGM_LOGE("Invalid thread params");
-        goto exit;
-    }
-
-    ses_data->loop = g_main_loop_new(NULL, FALSE);
-    AGM_LOGD("initiate main loop run for callbacks");
-    g_main_loop_run(ses_data->loop);
-
-    AGM_LOGD("out of main loop\n");
-    g_main_loop_unref(ses_data->loop);
+static void ring_release(agm_client_session_data *ses_data) {
+    if (ses_data->ring_state != AGM_CLIENT_RING_ACTIVE)
+        return;
 
-exit:
-    return NULL;
+    agm_dbus_ring_release(&ses_data->ring);
+    close(ses_data->kick_fd);
+    close(ses_data->notify_fd);
+    ses_data->ring_state = AGM_CLIENT_RING_NONE;
 }
 
-static int agm_session_deregister_cb(uint32_t session_id,
-                                     enum event_type evt_type,
-                                     void *client_data) {
-    GVariant *value_1, *value_2, *value_3, *argument;
+static int ring_setup(agm_client_session_data *ses_data, uint32_t dir,
+                      size_t period) {
+    GUnixFDList *fd_list = NULL;
     GVariant *result = NULL;
     GError *error = NULL;
-    int rc = 0;
-    agm_client_session_data *ses_data = NULL;
-    char *obj_path = NULL;
-    agm_callback_data *cb_data;
-    GList *node = NULL;
-    uint64_t data;
-
-    AGM_LOGD("%s\n", __func__);
-
-    data = (uint64_t)client_data;
+    int ring_fd, rc = 0;
 
-    value_1 = g_variant_new_uint32(session_id);
-    value_2 = g_variant_new_uint32(evt_type);
-    value_3 = g_variant_new_uint64(data);
+    ring_fd = agm_dbus_ring_create(&ses_data->ring,
+                                   period * AGM_CLIENT_RING_PERIODS, dir);
+    if (ring_fd < 0)
+        return ring_fd;
 
-    argument = g_variant_new("(@u@u@t)", value_1, value_2, value_3);
+    ses_data->kick_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ses_data->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ses_data->kick_fd < 0 || ses_data->notify_fd < 0) {
+        rc = -errno;
+        goto exit;
+    }
 
-    if (mdata == NULL) {
-        if ((rc = initialize_module_data()) != 0)
-            return rc;
+    /* the fds travel as indices into the list */
+    fd_list = g_unix_fd_list_new();
+    if (g_unix_fd_list_append(fd_list, ring_fd, &error) < 0 ||
+        g_unix_fd_list_append(fd_list, ses_data->kick_fd, &error) < 0 ||
+        g_unix_fd_list_append(fd_list, ses_data->notify_fd, &error) < 0) {
+        AGM_LOGE("%s: Error passing ring fds: %s\n", __func__,
+                  error->message);
+        g_error_free(error);
+        rc = -EINVAL;
+        goto exit;
     }
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmSessionDeRegisterCb",
-                                    argument,
+    result = client_proxy_call_with_unix_fd_list_sync(ses_data->proxy,
+                                    "AgmSessionMapRing",
+                                    g_variant_new("(uhhh)", dir, 0, 1, 2),
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
+                                    fd_list,
+                                    NULL,
                                     NULL,
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmSessionDeRegisterCb: %s\n", __func__,
+        AGM_LOGE("%s: Error invoking AgmSessionMapRing: %s\n", __func__,
                   error->message);
         g_error_free(error);
         rc = -EINVAL;
-        return rc;
+        goto exit;
     }
 
-    if ((ses_data = (agm_client_session_data *)
-                        g_hash_table_lookup(mdata->ses_hash_table,
-                                       GINT_TO_POINTER(session_id))) == NULL) {
-        ses_data = (agm_client_session_data *)
-                                    g_malloc0(sizeof(agm_client_session_data));
+    g_variant_unref(result);
+    ses_data->ring_state = AGM_CLIENT_RING_ACTIVE;
 
-        g_variant_get(result, "(o)", &ses_data->obj_path);
-        ses_data->conn = mdata->conn;
+exit:
+    if (fd_list)
+        g_object_unref(fd_list);
+    close(ring_fd);
+    if (rc) {
+        agm_dbus_ring_release(&ses_data->ring);
+        if (ses_data->kick_fd >= 0)
+            close(ses_data->kick_fd);
+        if (ses_data->notify_fd >= 0)
+            close(ses_data->notify_fd);
+    }
+    return rc;
+}
 
-        ses_data->proxy = g_dbus_proxy_new_sync(ses_data->conn,
-                                G_DBUS_PROXY_FLAGS_NONE,
-                                NULL,
-                                AGM_DBUS_CONNECTION,
-                                ses_data->obj_path,
-                                AGM_SESSION_IFACE,
-                                NULL,
-                                &error);
+/*
+ * Data moves through the shared ring once the server has mapped it; a
+ * server without AgmSessionMapRing keeps getting the data over the bus.
+ */
+static bool ring_ready(agm_client_session_data *ses_data, uint32_t dir,
+                       size_t period) {
+    if (ses_data->ring_state == AGM_CLIENT_RING_NONE &&
+        ring_setup(ses_data, dir, period)) {
+        AGM_LOGI("%s: shared ring unavailable, using dbus for data\n",
+                 __func__);
+        ses_data->ring_state = AGM_CLIENT_RING_UNSUPPORTED;
+    }
+
+    return ses_data->ring_state == AGM_CLIENT_RING_ACTIVE &&
+           ses_data->ring.hdr->dir == dir;
+}
 
-        if (ses_data->proxy == NULL) {
-            AGM_LOGE("%s: Error in getting dbus proxy: %s", __func__,
-                      error->message);
-            rc = -EINVAL;
-            free(ses_data);
-            ses_data = NULL;
-            g_error_free(error);
-            goto exit;
+/* report an agm error the server left in the ring, once */
+static int ring_take_error(agm_client_session_data *ses_data) {
+    int rc = agm_dbus_ring_error(&ses_data->ring);
+
+    if (rc)
+        agm_dbus_ring_set_error(&ses_data->ring, 0);
+    return rc;
+}
+
+static int ring_write(agm_client_session_data *ses_data, void *buf,
+                      size_t byte_count) {
+    struct agm_dbus_ring *ring = &ses_data->ring;
+    size_t done = 0;
+    int n, rc;
+
+    while (done < byte_count) {
+        if ((rc = ring_take_error(ses_data)) != 0)
+            return rc;
+
+        n = agm_dbus_ring_write(ring, (uint8_t *)buf + done,
+                                byte_count - done);
+        if (n < 0)
+            return n;
+        if (n > 0) {
+            done += n;
+            agm_dbus_ring_signal(ses_data->kick_fd);
+            continue;
         }
 
-        ses_data->session_id = session_id;
-        /* add session to sessions hash table */
-        g_hash_table_insert(mdata->ses_hash_table,
-                            GINT_TO_POINTER
-                            (ses_data->session_id),
-                            ses_data);
+        rc = agm_dbus_ring_wait(ses_data->notify_fd,
+                                AGM_CLIENT_RING_TIMEOUT_MS);
+        if (rc)
+            return rc;
     }
 
-    cb_data = (agm_callback_data *)malloc(sizeof(agm_callback_data));
-    cb_data->client_data = client_data;
-    cb_data->session_id = session_id;
-    cb_data->cb = NULL;
+    return 0;
+}
 
-    if (subscribe_callback_event(ses_data, false, cb_data)) {
-        AGM_LOGE("Unable to subscribe for callback event\n");
-        g_error_free(error);
-        g_free(ses_data);
-        g_free(cb_data);
-        rc = -EINVAL;
+static int ring_read(agm_client_session_data *ses_data, void *buf,
+                     size_t byte_count) {
+    struct agm_dbus_ring *ring = &ses_data->ring;
+    uint64_t want = ring->hdr->tail + byte_count;
+    size_t done = 0;
+    int n, rc;
+
+    if ((int64_t)(want - ring->hdr->want) > 0)
+        agm_dbus_ring_store(&ring->hdr->want, want);
+
+    for (;;) {
+        n = agm_dbus_ring_read(ring, (uint8_t *)buf + done,
+                               byte_count - done);
+        if (n < 0)
+            return n;
+        done += n;
+        if (done == byte_count)
+            break;
+
+        if ((rc = ring_take_error(ses_data)) != 0)
+            return rc;
+
+        /* the server stops when the ring is full, so ask again */
+        agm_dbus_ring_signal(ses_data->kick_fd);
+        rc = agm_dbus_ring_wait(ses_data->notify_fd,
+                                AGM_CLIENT_RING_TIMEOUT_MS);
+        if (rc)
+            return rc;
     }
 
-    g_free(cb_data);
-    cb_data = NULL;
-    g_variant_unref(result);
+    return 0;
+}
 
-exit:
-    return rc;
+/*
+ * Session control calls go over the bus and could overtake data still in
+ * the ring, so wait for the server to drain it first, the way a blocking
+ * write used to guarantee.
+ */
+static void ring_sync(agm_client_session_data *ses_data) {
+    struct agm_dbus_ring *ring = &ses_data->ring;
+
+    if (ses_data->ring_state != AGM_CLIENT_RING_ACTIVE ||
+        ring->hdr->dir != AGM_DBUS_RING_PLAYBACK)
+        return;
+
+    while (agm_dbus_ring_load(&ring->hdr->tail) != ring->hdr->head) {
+        if (agm_dbus_ring_error(ring) ||
+            agm_dbus_ring_wait(ses_data->notify_fd,
+                               AGM_CLIENT_RING_TIMEOUT_MS)) {
+            AGM_LOGE("%s: ring not drained for session %d\n", __func__,
+                     ses_data->session_id);
+            return;
+        }
+    }
 }
 
-int agm_session_register_cb(uint32_t session_id,
-                            agm_event_cb cb,
-                            enum event_type evt_type,
-                            void *client_data) {
-    GVariant *value_1, *value_2, *value_3, *argument;
+/*
+ * Call one of the *Fd methods, see agm-dbus-blob.h. fd, if any, is sent as
+ * handle 0. Returns -ENOSYS once the service turned out not to have them,
+ * the caller then sends the payload as a byte array.
+ */
+static int blob_call(const char *method, GVariant *argument, int fd,
+                     GVariant **reply, GUnixFDList **out_fd_list) {
+    GUnixFDList *fd_list = NULL;
     GVariant *result = NULL;
     GError *error = NULL;
-    int rc = 0;
-    agm_client_session_data *ses_data = NULL;
-    char *obj_path = NULL;
-    agm_callback_data *cb_data;
-    gchar thread_name[16] = "";
-    uint64_t data;
-
-    AGM_LOGD("%s\n", __func__);
-
-    if (cb == NULL)
-        return agm_session_deregister_cb(session_id, evt_type, client_data);
 
-    data = (uint64_t)client_data;
-
-    value_1 = g_variant_new_uint32(session_id);
-    value_2 = g_variant_new_uint32(evt_type);
-    value_3 = g_variant_new_uint64(data);
-
-    argument = g_variant_new("(@u@u@t)", value_1, value_2, value_3);
-
-    if (mdata == NULL) {
-        if ((rc = initialize_module_data()) != 0)
-            return rc;
+    if (fd >= 0) {
+        fd_list = g_unix_fd_list_new();
+        if (g_unix_fd_list_append(fd_list, fd, &error) < 0) {
+            AGM_LOGE("%s: Error passing blob fd: %s\n", __func__,
+                      error->message);
+            g_error_free(error);
+            g_object_unref(fd_list);
+            g_variant_unref(g_variant_ref_sink(argument));
+            return -EINVAL;
+        }
     }
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmSessionRegisterCb",
+    result = client_proxy_call_with_unix_fd_list_sync(mdata->proxy,
+                                    method,
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
+                                    fd_list,
+                                    out_fd_list,
                                     NULL,
                                     &error);
+    if (fd_list)
+        g_object_unref(fd_list);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmSessionRegisterCb: %s\n", __func__,
+        if (g_error_matches(error, G_DBUS_ERROR,
+                            G_DBUS_ERROR_UNKNOWN_METHOD)) {
+            AGM_LOGI("%s: no %s in service, using byte arrays\n", __func__,
+                     method);
+            mdata->blob_unsupported = true;
+            g_error_free(error);
+            return -ENOSYS;
+        }
+        AGM_LOGE("%s: Error invoking %s: %s\n", __func__, method,
                   error->message);
         g_error_free(error);
-        rc = -EINVAL;
-        return rc;
+        return -EINVAL;
     }
 
-    if ((ses_data = (agm_client_session_data *)
-                     g_hash_table_lookup(mdata->ses_hash_table,
-                                     GINT_TO_POINTER(session_id))) == NULL) {
-        ses_data = (agm_client_session_data *)
-                                     g_malloc0(sizeof(agm_client_session_data));
+    mdata->blob_checked = true;
+    if (reply)
+        *reply = result;
+    else
+        g_variant_unref(result);
+    return 0;
+}
 
-        g_variant_get(result, "(o)", &ses_data->obj_path);
-        ses_data->conn = mdata->conn;
+/* args are the leading ids of the call, size and the fd handle follow */
+static int blob_set(const char *method, const uint32_t *args, int num_args,
+                    const void *payload, size_t size) {
+    GVariantBuilder builder;
+    int fd, i, rc = 0;
 
-        ses_data->proxy = g_dbus_proxy_new_sync(ses_data->conn,
-                                G_DBUS_PROXY_FLAGS_NONE,
-                                NULL,
-                                AGM_DBUS_CONNECTION,
-                                ses_data->obj_path,
-                                AGM_SESSION_IFACE,
-                                NULL,
-                                &error);
+    if (mdata == NULL) {
+        if ((rc = initialize_module_data()) != 0)
+            return rc;
+    }
 
-        if (ses_data->proxy == NULL) {
-            AGM_LOGE("%s: Error in getting dbus proxy: %s", __func__,
-                      error->message);
-            rc = -EINVAL;
-            free(ses_data);
-            ses_data = NULL;
+    if (mdata->blob_unsupported)
+        return -ENOSYS;
+
+    fd = agm_dbus_blob_create(payload, size, false);
+    if (fd < 0) {
+        AGM_LOGE("%s: blob of %zu bytes failed %d\n", __func__, size, fd);
+        return fd;
+    }
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_TUPLE);
+    for (i = 0; i < num_args; i++)
+        g_variant_builder_add(&builder, "u", args[i]);
+    g_variant_builder_add(&builder, "u", (uint32_t)size);
+    g_variant_builder_add(&builder, "h", 0);
+
+    /* pipelined once the service is known to take blobs */
+    if (mdata->blob_checked && async_enabled())
+        rc = async_call(mdata->proxy, method, g_variant_builder_end(&builder),
+                        fd);
+    else
+        rc = blob_call(method, g_variant_builder_end(&builder), fd, NULL,
+                       NULL);
+    close(fd);
+    return rc;
+}
+
+/* get_params reads its query from the payload and is answered in place */
+static int blob_get_params(uint32_t session_id, void *payload, size_t size) {
+    void *addr = NULL;
+    int fd, rc = 0;
+
+    if (mdata == NULL) {
+        if ((rc = initialize_module_data()) != 0)
+            return rc;
+    }
+
+    if (mdata->blob_unsupported)
+        return -ENOSYS;
+
+    fd = agm_dbus_blob_alloc(size, &addr);
+    if (fd < 0) {
+        AGM_LOGE("%s: blob of %zu bytes failed %d\n", __func__, size, fd);
+        return fd;
+    }
+
+    memcpy(addr, payload, size);
+    rc = agm_dbus_blob_seal(fd, true);
+    if (rc)
+        goto exit;
+
+    rc = blob_call("AgmSessionGetParamsFd",
+                   g_variant_new("(uuh)", session_id, (uint32_t)size, 0),
+                   fd, NULL, NULL);
+    if (rc == 0)
+        memcpy(payload, addr, size);
+
+exit:
+    munmap(addr, size);
+    close(fd);
+    return rc;
+}
+
+/*
+ * Tag module info comes back in one call as a sealed memfd. The size query
+ * agm callers make first already fetches it; the blob is kept for the fill
+ * call that follows, so that one needs no round trip.
+ */
+#define AGM_CLIENT_TAG_INFO_CACHE_MAX 16
+
+typedef struct {
+    uint32_t session_id;
+    uint32_t aif_id;
+    uint64_t generation;
+    size_t size;
+    void *data;
+} agm_tag_info_entry;
+
+static void tag_info_entry_free(gpointer data) {
+    agm_tag_info_entry *entry = (agm_tag_info_entry *)data;
+
+    g_free(entry->data);
+    g_free(entry);
+}
+
+static void cache_drop_locked(void) {
+    agm_dbus_gen_detach(mdata->gen_page);
+    mdata->gen_page = NULL;
+
+    if (mdata->gen_pidfd >= 0)
+        close(mdata->gen_pidfd);
+    mdata->gen_pidfd = -1;
+
+    g_free(mdata->aif_cache);
+    mdata->aif_cache = NULL;
+    mdata->num_aif_cache = 0;
+
+    g_list_free_full(mdata->tag_info_cache, tag_info_entry_free);
+    mdata->tag_info_cache = NULL;
+}
+
+/* map the generation page of the service, -ENOSYS if it cannot be used */
+static int cache_attach_locked(void) {
+    GUnixFDList *fd_list = NULL;
+    GVariant *result = NULL;
+    GError *error = NULL;
+    gint32 handle;
+    int fd, pidfd;
+
+    result = client_proxy_call_with_unix_fd_list_sync(mdata->proxy,
+                                    "AgmGetGenerationFd",
+                                    NULL,
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &fd_list,
+                                    NULL,
+                                    &error);
+
+    if (result == NULL) {
+        if (g_error_matches(error, G_DBUS_ERROR,
+                            G_DBUS_ERROR_UNKNOWN_METHOD) ||
+            g_error_matches(error, G_DBUS_ERROR,
+                            G_DBUS_ERROR_NOT_SUPPORTED)) {
+            AGM_LOGI("%s: no generation page in service, not caching\n",
+                     __func__);
+            mdata->gen_unsupported = true;
             g_error_free(error);
-            goto exit;
+            return -ENOSYS;
         }
+        AGM_LOGE("%s: Error invoking AgmGetGenerationFd: %s\n", __func__,
+                  error->message);
+        g_error_free(error);
+        return -EINVAL;
+    }
 
-        ses_data->session_id = session_id;
-        snprintf(thread_name, sizeof(thread_name), "agm_loop_%d", session_id);
-        AGM_LOGE("create thread %s\n", thread_name);
-        ses_data->thread_loop = g_thread_try_new(thread_name, signal_threadloop,
-                                ses_data, &error);
-        if (!ses_data->thread_loop) {
-            rc = -EINVAL;
-            AGM_LOGE("Could not create thread %s, error %s\n", thread_name,
+    g_variant_get(result, "(h)", &handle);
+    fd = fd_list ? g_unix_fd_list_get(fd_list, handle, NULL) : -1;
+    if (fd_list)
+        g_object_unref(fd_list);
+    g_variant_unref(result);
+    if (fd < 0)
+        return -EINVAL;
+
+    mdata->gen_page = agm_dbus_gen_attach(fd);
+    close(fd);
+    if (mdata->gen_page == NULL)
+        return -EINVAL;
+
+    pidfd = agm_dbus_gen_watch(mdata->gen_page);
+    if (pidfd < 0) {
+        /* a restarted service could not be told apart, so do not cache */
+        AGM_LOGI("%s: cannot watch service pid %u: %d, not caching\n",
+                 __func__, mdata->gen_page->pid, pidfd);
+        agm_dbus_gen_detach(mdata->gen_page);
+        mdata->gen_page = NULL;
+        mdata->gen_unsupported = true;
+        return -ENOSYS;
+    }
+    mdata->gen_pidfd = pidfd;
+
+    return 0;
+}
+
+/*
+ * Current generation of the service data. Everything cached is dropped
+ * once the service that published it has exited. Returns -ENOSYS if this
+ * service cannot be cached for.
+ */
+static int cache_generation_locked(uint64_t *gen) {
+    int rc;
+
+    if (mdata->gen_page != NULL && !agm_dbus_gen_alive(mdata->gen_pidfd)) {
+        AGM_LOGI("%s: service restarted, dropping cached data\n", __func__);
+        cache_drop_locked();
+    }
+
+    if (mdata->gen_page == NULL) {
+        if (mdata->gen_unsupported)
+            return -ENOSYS;
+        rc = cache_attach_locked();
+        if (rc)
+            return rc;
+    }
+
+    *gen = agm_dbus_gen_load(mdata->gen_page);
+    return 0;
+}
+
+/*
+ * Serve tag module info from the cache. On -ENOENT nothing is cached for
+ * the current generation, which is left in *gen for tag_info_cache_put().
+ */
+static int tag_info_cache_get(uint32_t session_id, uint32_t aif_id,
+                              void *payload, size_t *size, uint64_t *gen) {
+    agm_tag_info_entry *entry;
+    GList *node;
+    int rc;
+
+    g_mutex_lock(&mdata->cache_lock);
+    rc = cache_generation_locked(gen);
+    if (rc) {
+        rc = rc == -ENOSYS ? -ENOSYS : -EAGAIN;
+        goto done;
+    }
+
+    rc = -ENOENT;
+    for (node = mdata->tag_info_cache; node != NULL; node = node->next) {
+        entry = (agm_tag_info_entry *)node->data;
+        if (entry->session_id != session_id || entry->aif_id != aif_id)
+            continue;
+        if (entry->generation != *gen)
+            break;
+
+        mdata->tag_info_cache = g_list_remove_link(mdata->tag_info_cache,
+                                                   node);
+        mdata->tag_info_cache = g_list_concat(node, mdata->tag_info_cache);
+
+        if (payload == NULL) {
+            *size = entry->size;
+            rc = 0;
+        } else if (*size < entry->size) {
+            AGM_LOGE("%s: %zu bytes for %zu bytes of tag module info\n",
+                     __func__, *size, entry->size);
+            rc = -ENOMEM;
+        } else {
+            memcpy(payload, entry->data, entry->size);
+            *size = entry->size;
+            rc = 0;
+        }
+        break;
+    }
+
+done:
+    g_mutex_unlock(&mdata->cache_lock);
+    return rc;
+}
+
+static void tag_info_cache_put(uint32_t session_id, uint32_t aif_id,
+                               uint64_t gen, int fd, size_t blob_size) {
+    agm_tag_info_entry *entry;
+    GList *node, *next;
+    void *addr;
+
+    addr = agm_dbus_blob_map(fd, blob_size, false);
+    if (addr == NULL)
+        return;
+
+    entry = (agm_tag_info_entry *)g_malloc0(sizeof(agm_tag_info_entry));
+    entry->session_id = session_id;
+    entry->aif_id = aif_id;
+    entry->generation = gen;
+    entry->size = blob_size;
+    entry->data = g_malloc(blob_size);
+    memcpy(entry->data, addr, blob_size);
+    agm_dbus_blob_unmap(addr, blob_size);
+
+    g_mutex_lock(&mdata->cache_lock);
+    /* the service went away since gen was read */
+    if (mdata->gen_page == NULL) {
+        g_mutex_unlock(&mdata->cache_lock);
+        tag_info_entry_free(entry);
+        return;
+    }
+
+    for (node = mdata->tag_info_cache; node != NULL; node = next) {
+        agm_tag_info_entry *old = (agm_tag_info_entry *)node->data;
+
+        next = node->next;
+        if (old->session_id == session_id && old->aif_id == aif_id) {
+            tag_info_entry_free(old);
+            mdata->tag_info_cache = g_list_delete_link(mdata->tag_info_cache,
+                                                       node);
+        }
+    }
+
+    mdata->tag_info_cache = g_list_prepend(mdata->tag_info_cache, entry);
+    if (g_list_length(mdata->tag_info_cache) >
+        AGM_CLIENT_TAG_INFO_CACHE_MAX) {
+        node = g_list_last(mdata->tag_info_cache);
+        tag_info_entry_free(node->data);
+        mdata->tag_info_cache = g_list_delete_link(mdata->tag_info_cache,
+                                                   node);
+    }
+    g_mutex_unlock(&mdata->cache_lock);
+}
+
+static int tag_info_fetch(uint32_t session_id, uint32_t aif_id,
+                          int *fd, size_t *size) {
+    GUnixFDList *fd_list = NULL;
+    GVariant *result = NULL;
+    gint32 handle;
+    uint32_t r_size;
+    int rc = 0;
+
+    rc = blob_call("AgmSessionAifGetTagModuleInfoFd",
+                   g_variant_new("(uu)", session_id, aif_id),
+                   -1, &result, &fd_list);
+    if (rc)
+        return rc;
+
+    g_variant_get(result, "(uh)", &r_size, &handle);
+    *fd = fd_list ? g_unix_fd_list_get(fd_list, handle, NULL) : -1;
+    *size = r_size;
+    if (fd_list)
+        g_object_unref(fd_list);
+    g_variant_unref(result);
+
+    return *fd < 0 ? -EINVAL : 0;
+}
+
+static void tag_info_drop_locked(void) {
+    if (mdata->tag_info_fd >= 0)
+        close(mdata->tag_info_fd);
+    mdata->tag_info_fd = -1;
+}
+
+static int tag_info_copy(int fd, size_t blob_size, void *payload,
+                         size_t *size) {
+    void *addr;
+
+    if (*size < blob_size) {
+        AGM_LOGE("%s: %zu bytes for %zu bytes of tag module info\n",
+                 __func__, *size, blob_size);
+        return -ENOMEM;
+    }
+
+    addr = agm_dbus_blob_map(fd, blob_size, false);
+    if (addr == NULL)
+        return -EINVAL;
+
+    memcpy(payload, addr, blob_size);
+    agm_dbus_blob_unmap(addr, blob_size);
+    *size = blob_size;
+    return 0;
+}
+
+static int tag_info_fetch_or_take(uint32_t session_id, uint32_t aif_id,
+                                  void *payload, size_t *size) {
+    size_t blob_size = 0;
+    uint64_t gen = 0;
+    bool cache;
+    int fd = -1, rc = 0;
+
+    if (mdata == NULL) {
+        if ((rc = initialize_module_data()) != 0)
+            return rc;
+    }
+
+    if (mdata->blob_unsupported)
+        return -ENOSYS;
+
+    rc = tag_info_cache_get(session_id, aif_id, payload, size, &gen);
+    if (rc == 0 || rc == -ENOMEM)
+        return rc;
+    cache = rc == -ENOENT;
+    rc = 0;
+
+    g_mutex_lock(&mdata->blob_lock);
+    if (mdata->tag_info_fd >= 0 &&
+        mdata->tag_info_session_id == session_id &&
+        mdata->tag_info_aif_id == aif_id) {
+        fd = mdata->tag_info_fd;
+        blob_size = mdata->tag_info_size;
+        mdata->tag_info_fd = -1;
+    }
+    tag_info_drop_locked();
+    g_mutex_unlock(&mdata->blob_lock);
+
+    if (fd < 0) {
+        rc = tag_info_fetch(session_id, aif_id, &fd, &blob_size);
+        if (rc)
+            return rc;
+    }
+
+    if (cache)
+        tag_info_cache_put(session_id, aif_id, gen, fd, blob_size);
+
+    if (payload == NULL) {
+        *size = blob_size;
+        /* the call for the data is served from the cache */
+        if (cache) {
+            close(fd);
+            return 0;
+        }
+        g_mutex_lock(&mdata->blob_lock);
+        tag_info_drop_locked();
+        mdata->tag_info_fd = fd;
+        mdata->tag_info_size = blob_size;
+        mdata->tag_info_session_id = session_id;
+        mdata->tag_info_aif_id = aif_id;
+        g_mutex_unlock(&mdata->blob_lock);
+        return 0;
+    }
+
+    rc = tag_info_copy(fd, blob_size, payload, size);
+    close(fd);
+    return rc;
+}
+
+static void *signal_threadloop(void *cookie) {
+    agm_client_session_data *ses_data = (agm_client_session_data *)cookie;
+
+    AGM_LOGD("Enter %s %p\n", __func__, ses_data);
+    if (!ses_data) {
+        AGM_LOGE("Invalid thread params");
+        goto exit;
+    }
+
+    ses_data->loop = g_main_loop_new(NULL, FALSE);
+    AGM_LOGD("initiate main loop run for callbacks");
+    g_main_loop_run(ses_data->loop);
+
+    AGM_LOGD("out of main loop\n");
+    g_main_loop_unref(ses_data->loop);
+
+exit:
+    return NULL;
+}
+
+static int agm_session_deregister_cb(uint32_t session_id,
+                                     enum event_type evt_type,
+                                     void *client_data) {
+    GVariant *value_1, *value_2, *value_3, *argument;
+    GVariant *result = NULL;
+    GError *error = NULL;
+    int rc = 0;
+    agm_client_session_data *ses_data = NULL;
+    char *obj_path = NULL;
+    agm_callback_data *cb_data;
+    GList *node = NULL;
+    uint64_t data;
+
+    AGM_LOGD("%s\n", __func__);
+
+    data = (uint64_t)client_data;
+
+    value_1 = g_variant_new_uint32(session_id);
+    value_2 = g_variant_new_uint32(evt_type);
+    value_3 = g_variant_new_uint64(data);
+
+    argument = g_variant_new("(@u@u@t)", value_1, value_2, value_3);
+
+    if (mdata == NULL) {
+        if ((rc = initialize_module_data()) != 0)
+            return rc;
+    }
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionDeRegisterCb",
+                                    argument,
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &error);
+
+    if (result == NULL) {
+        AGM_LOGE("%s: Error invoking AgmSessionDeRegisterCb: %s\n", __func__,
+                  error->message);
+        g_error_free(error);
+        rc = -EINVAL;
+        return rc;
+    }
+
+    if ((ses_data = (agm_client_session_data *)
+                        g_hash_table_lookup(mdata->ses_hash_table,
+                                       GINT_TO_POINTER(session_id))) == NULL) {
+        ses_data = (agm_client_session_data *)
+                                    g_malloc0(sizeof(agm_client_session_data));
+
+        g_variant_get(result, "(o)", &ses_data->obj_path);
+        ses_data->conn = mdata->conn;
+
+        ses_data->proxy = g_dbus_proxy_new_sync(ses_data->conn,
+                                G_DBUS_PROXY_FLAGS_NONE,
+                                NULL,
+                                AGM_DBUS_CONNECTION,
+                                ses_data->obj_path,
+                                AGM_SESSION_IFACE,
+                                NULL,
+                                &error);
+
+        if (ses_data->proxy == NULL) {
+            AGM_LOGE("%s: Error in getting dbus proxy: %s", __func__,
                       error->message);
+            rc = -EINVAL;
+            free(ses_data);
+            ses_data = NULL;
             g_error_free(error);
-            g_free(ses_data);
             goto exit;
         }
+
+        ses_data->session_id = session_id;
         /* add session to sessions hash table */
         g_hash_table_insert(mdata->ses_hash_table,
-                            GINT_TO_POINTER(ses_data->session_id),
+                            GINT_TO_POINTER
+                            (ses_data->session_id),
                             ses_data);
     }
 
     cb_data = (agm_callback_data *)malloc(sizeof(agm_callback_data));
     cb_data->client_data = client_data;
     cb_data->session_id = session_id;
-    cb_data->cb = cb;
+    cb_data->cb = NULL;
     cb_data->evt_type = evt_type;
 
-    if (subscribe_callback_event(ses_data, true, cb_data)) {
+    if (subscribe_callback_event(ses_data, false, cb_data)) {
         AGM_LOGE("Unable to subscribe for callback event\n");
         g_error_free(error);
         g_free(ses_data);
@@ -479,52 +1387,524 @@ int agm_session_register_cb(uint32_t session_id,
         rc = -EINVAL;
     }
 
+    g_free(cb_data);
+    cb_data = NULL;
     g_variant_unref(result);
 
 exit:
     return rc;
 }
 
-int agm_session_register_for_events(uint32_t session_id,
-                                    struct agm_event_reg_cfg *evt_reg_cfg) {
-    GVariant *value_1, *value_2, *value_arr, *argument;
-    GVariantBuilder builder_1;
+int agm_session_register_cb(uint32_t session_id,
+                            agm_event_cb cb,
+                            enum event_type evt_type,
+                            void *client_data) {
+    GVariant *value_1, *value_2, *value_3, *argument;
+    GVariant *result = NULL;
+    GError *error = NULL;
+    int rc = 0;
+    agm_client_session_data *ses_data = NULL;
+    char *obj_path = NULL;
+    agm_callback_data *cb_data;
+    gchar thread_name[16] = "";
+    uint64_t data;
+
+    AGM_LOGD("%s\n", __func__);
+
+    if (cb == NULL)
+        return agm_session_deregister_cb(session_id, evt_type, client_data);
+
+    data = (uint64_t)client_data;
+
+    value_1 = g_variant_new_uint32(session_id);
+    value_2 = g_variant_new_uint32(evt_type);
+    value_3 = g_variant_new_uint64(data);
+
+    argument = g_variant_new("(@u@u@t)", value_1, value_2, value_3);
+
+    if (mdata == NULL) {
+        if ((rc = initialize_module_data()) != 0)
+            return rc;
+    }
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionRegisterCb",
+                                    argument,
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &error);
+
+    if (result == NULL) {
+        AGM_LOGE("%s: Error invoking AgmSessionRegisterCb: %s\n", __func__,
+                  error->message);
+        g_error_free(error);
+        rc = -EINVAL;
+        return rc;
+    }
+
+    if ((ses_data = (agm_client_session_data *)
+                     g_hash_table_lookup(mdata->ses_hash_table,
+                                     GINT_TO_POINTER(session_id))) == NULL) {
+        ses_data = (agm_client_session_data *)
+                                     g_malloc0(sizeof(agm_client_session_data));
+
+        g_variant_get(result, "(o)", &ses_data->obj_path);
+        ses_data->conn = mdata->conn;
+
+        ses_data->proxy = g_dbus_proxy_new_sync(ses_data->conn,
+                                G_DBUS_PROXY_FLAGS_NONE,
+                                NULL,
+                                AGM_DBUS_CONNECTION,
+                                ses_data->obj_path,
+                                AGM_SESSION_IFACE,
+                                NULL,
+                                &error);
+
+        if (ses_data->proxy == NULL) {
+            AGM_LOGE("%s: Error in getting dbus proxy: %s", __func__,
+                      error->message);
+            rc = -EINVAL;
+            free(ses_data);
+            ses_data = NULL;
+            g_error_free(error);
+            goto exit;
+        }
+
+        ses_data->session_id = session_id;
+        snprintf(thread_name, sizeof(thread_name), "agm_loop_%d", session_id);
+        AGM_LOGE("create thread %s\n", thread_name);
+        ses_data->thread_loop = g_thread_try_new(thread_name, signal_threadloop,
+                                ses_data, &error);
+        if (!ses_data->thread_loop) {
+            rc = -EINVAL;
+            AGM_LOGE("Could not create thread %s, error %s\n", thread_name,
+                      error->message);
+            g_error_free(error);
+            g_free(ses_data);
+            goto exit;
+        }
+        /* add session to sessions hash table */
+        g_hash_table_insert(mdata->ses_hash_table,
+                            GINT_TO_POINTER(ses_data->session_id),
+                            ses_data);
+    }
+
+    cb_data = (agm_callback_data *)malloc(sizeof(agm_callback_data));
+    cb_data->client_data = client_data;
+    cb_data->session_id = session_id;
+    cb_data->cb = cb;
+    cb_data->evt_type = evt_type;
+
+    if (subscribe_callback_event(ses_data, true, cb_data)) {
+        AGM_LOGE("Unable to subscribe for callback event\n");
+        g_error_free(error);
+        g_free(ses_data);
+        g_free(cb_data);
+        rc = -EINVAL;
+    }
+
+    g_variant_unref(result);
+
+exit:
+    return rc;
+}
+
+int agm_session_register_for_events(uint32_t session_id,
+                                    struct agm_event_reg_cfg *evt_reg_cfg) {
+    GVariant *value_1, *value_2, *value_arr, *argument;
+    GVariantBuilder builder_1;
+    GVariant *result = NULL;
+    GError *error = NULL;
+    int rc = 0;
+
+    g_assert(evt_reg_cfg != NULL);
+    AGM_LOGD("%s\n", __func__);
+
+    value_1 = g_variant_new_uint32(session_id);
+    g_variant_builder_init(&builder_1, G_VARIANT_TYPE("(uuuyay)"));
+    g_variant_builder_add(&builder_1,
+                          "u",
+                          (guint32)evt_reg_cfg->module_instance_id);
+    g_variant_builder_add(&builder_1,
+                          "u",
+                          (guint32)evt_reg_cfg->event_id);
+    g_variant_builder_add(&builder_1,
+                          "u",
+                          (guint32)evt_reg_cfg->event_config_payload_size);
+    g_variant_builder_add(&builder_1, "y", (guint32)evt_reg_cfg->is_register);
+
+    value_arr = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+                        (gconstpointer)&evt_reg_cfg->event_config_payload[0],
+                        evt_reg_cfg->event_config_payload_size,
+                        sizeof(guchar));
+    g_variant_builder_add_value(&builder_1, value_arr);
+    value_2 = g_variant_builder_end(&builder_1);
+
+    argument = g_variant_new("(@u@(uuuyay))", value_1, value_2);
+
+    if (mdata == NULL) {
+        if ((rc = initialize_module_data()) != 0)
+            return rc;
+    }
+
+    if (async_enabled())
+        return async_call(mdata->proxy, "AgmSessionRegisterForEvents", argument, -1);
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionRegisterForEvents",
+                                    argument,
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &error);
+
+    if (result == NULL) {
+        AGM_LOGE("%s: Error invoking AgmSessionRegisterForEvents: %s\n",
+                  __func__, error->message);
+        g_error_free(error);
+        rc = -EINVAL;
+        return rc;
+    }
+
+    g_variant_unref(result);
+    return rc;
+}
+
+int agm_session_aif_set_cal(uint32_t session_id,
+                            uint32_t aif_id,
+                            struct agm_cal_config *cal_config) {
+    GVariant *value_1, *value_2, *value_3, *value_4;
+    GVariant *argument, *argument_2;
+    GVariantBuilder builder_1;
+    GVariant *result = NULL;
+    GError *error = NULL;
+    size_t size;
+    int rc = 0;
+    gint i = 0;
+
+    AGM_LOGD("%s :", __func__);
+    g_assert(cal_config != NULL);
+
+    size = sizeof(struct agm_cal_config) +
+           cal_config->num_ckvs * sizeof(struct agm_key_value);
+    if (size >= AGM_DBUS_BLOB_FD_MIN) {
+        const uint32_t args[] = {session_id, aif_id};
+
+        rc = blob_set("AgmSessionAifSetCalFd", args, 2, cal_config, size);
+        if (rc != -ENOSYS)
+            return rc;
+        rc = 0;
+    }
+
+    value_1 = g_variant_new_uint32(session_id);
+    value_2 = g_variant_new_uint32(aif_id);
+    value_3 = g_variant_new_uint32(cal_config->num_ckvs);
+    value_4 = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+                                        (gconstpointer)cal_config->kv,
+                                        cal_config->num_ckvs*
+                                                   sizeof(struct agm_key_value),
+                                        sizeof(gchar));
+
+    argument = g_variant_new("(@u@u@u@ay)", value_1, value_2, value_3, value_4);
+
+    if (mdata == NULL) {
+        if ((rc = initialize_module_data()) != 0)
+            return rc;
+    }
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionAifSetCal",
+                                    argument,
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &error);
+
+    if (result == NULL) {
+        AGM_LOGE("%s: Error invoking AgmSessionAifSetCal: %s\n", __func__,
+                  error->message);
+        g_error_free(error);
+        rc = -EINVAL;
+        return rc;
+    }
+
+    g_variant_unref(result);
+    return rc;
+}
+
+int agm_session_aif_set_params(uint32_t session_id,
+                               uint32_t aif_id,
+                               void* payload,
+                               size_t size) {
+    GVariant *value_1, *value_2, *value_3, *value_4, *argument;
+    GVariant *result = NULL;
+    GError *error = NULL;
+    int rc = 0;
+
+    g_assert(payload != NULL);
+    AGM_LOGD("%s\n", __func__);
+
+    if (size >= AGM_DBUS_BLOB_FD_MIN) {
+        const uint32_t args[] = {session_id, aif_id};
+
+        rc = blob_set("AgmSessionAifSetParamsFd", args, 2, payload, size);
+        if (rc != -ENOSYS)
+            return rc;
+        rc = 0;
+    }
+
+    value_1 = g_variant_new_uint32(session_id);
+    value_2 = g_variant_new_uint32(aif_id);
+    value_3 = g_variant_new_uint32(size);
+    value_4 = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+                                        (gconstpointer)payload,
+                                        size,
+                                        sizeof(gchar));
+
+    argument = g_variant_new("(@u@u@u@ay)", value_1, value_2, value_3, value_4);
+
+    if (mdata == NULL) {
+        if ((rc = initialize_module_data()) != 0)
+            return rc;
+    }
+
+    if (async_enabled())
+        return async_call(mdata->proxy, "AgmSessionAifSetParams", argument, -1);
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionAifSetParams",
+                                    argument,
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &error);
+
+    if (result == NULL) {
+        AGM_LOGE("%s: Error invoking AgmSessionAifSetParams: %s\n", __func__,
+                  error->message);
+        g_error_free(error);
+        rc = -EINVAL;
+        return rc;
+    }
+
+    g_variant_unref(result);
+    return rc;
+}
+
+int agm_aif_set_params(uint32_t aif_id,
+                       void* payload,
+                       size_t size) {
+    GVariant *value_1, *value_2, *value_3, *argument;
+    GVariant *result = NULL;
+    GError *error = NULL;
+    int rc = 0;
+
+    g_assert(payload != NULL);
+    AGM_LOGD("%s\n", __func__);
+
+    if (size >= AGM_DBUS_BLOB_FD_MIN) {
+        const uint32_t args[] = {aif_id};
+
+        rc = blob_set("AgmAifSetParamsFd", args, 1, payload, size);
+        if (rc != -ENOSYS)
+            return rc;
+        rc = 0;
+    }
+
+    value_1 = g_variant_new_uint32(aif_id);
+    value_2 = g_variant_new_uint32(size);
+    value_3 = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+                                        (gconstpointer)payload,
+                                        size,
+                                        sizeof(gchar));
+
+    argument = g_variant_new("(@u@u@ay)", value_1, value_2, value_3);
+
+    if (mdata == NULL) {
+        if ((rc = initialize_module_data()) != 0)
+            return rc;
+    }
+
+    if (async_enabled())
+        return async_call(mdata->proxy, "AgmAifSetParams", argument, -1);
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmAifSetParams",
+                                    argument,
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &error);
+
+    if (result == NULL) {
+        AGM_LOGE("%s: Error invoking AgmAifSetParams: %s\n", __func__,
+                  error->message);
+        g_error_free(error);
+        rc = -EINVAL;
+        return rc;
+    }
+
+    g_variant_unref(result);
+    return rc;
+}
+
+/* the payload is copied into the message either way */
+int agm_aif_set_params_take(uint32_t aif_id,
+                            void* payload,
+                            size_t size) {
+    int rc = agm_aif_set_params(aif_id, payload, size);
+
+    free(payload);
+    return rc;
+}
+
+/* the payload is copied into the message either way */
+int agm_session_aif_set_params_take(uint32_t session_id,
+                                    uint32_t aif_id,
+                                    void* payload,
+                                    size_t size) {
+    int rc = agm_session_aif_set_params(session_id, aif_id, payload, size);
+
+    free(payload);
+    return rc;
+}
+
+int agm_session_aif_get_tag_module_info_size(uint32_t session_id,
+                                             uint32_t aif_id,
+                                             size_t *size) {
+    GVariant *value_1, *value_2, *value_3, *argument;
+    GVariant *result = NULL;
+    GError *error = NULL;
+    int rc = 0;
+
+    AGM_LOGD("%s\n", __func__);
+
+    g_assert(size != NULL);
+
+    value_1 = g_variant_new_uint32(session_id);
+    value_2 = g_variant_new_uint32(aif_id);
+    value_3 = g_variant_new_uint32(*size);
+
+    argument = g_variant_new("(@u@u@u)", value_1, value_2, value_3);
+
+    if (mdata == NULL) {
+        if ((rc = initialize_module_data()) != 0)
+            return rc;
+    }
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionAifGetTagModuleInfoSize",
+                                    argument,
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &error);
+
+    if (result == NULL) {
+        AGM_LOGE("%s: Error invoking AgmSessionAifGetTagModuleInfo: %s\n",
+                  __func__, error->message);
+        g_error_free(error);
+        rc = -EINVAL;
+        return rc;
+    }
+
+    g_variant_get(result, "(u)", size);
+    g_variant_unref(result);
+    return rc;
+}
+
+int agm_session_aif_get_tag_module_info(uint32_t session_id,
+                                        uint32_t aif_id,
+                                        void *payload,
+                                        size_t *size) {
+    GVariant *value_1, *value_2, *value_3, *argument;
+    GVariant *result = NULL;
+    GVariant *val_arr = NULL;
+    GError *error = NULL;
+    gsize n_elements = 0;
+    gsize element_size = sizeof(guchar);
+    GVariant *array_v;
+    GVariantIter arg_i;
+    gconstpointer value;
+    int rc = 0;
+
+    AGM_LOGD("%s\n", __func__);
+
+    g_assert(size != NULL);
+
+    rc = tag_info_fetch_or_take(session_id, aif_id, payload, size);
+    if (rc != -ENOSYS)
+        return rc;
+    rc = 0;
+
+    if (payload == NULL)
+        return agm_session_aif_get_tag_module_info_size(session_id,
+                                                        aif_id,
+                                                        size);
+
+    g_assert(payload != NULL);
+
+    value_1 = g_variant_new_uint32(session_id);
+    value_2 = g_variant_new_uint32(aif_id);
+    value_3 = g_variant_new_uint32(*size);
+
+    argument = g_variant_new("(@u@u@u)", value_1, value_2, value_3);
+
+    if (mdata == NULL) {
+        if ((rc = initialize_module_data()) != 0)
+            return rc;
+    }
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionAifGetTagModuleInfo",
+                                    argument,
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &error);
+
+    if (result == NULL) {
+        AGM_LOGE("%s: Error invoking AgmSessionAifGetTagModuleInfo: %s\n",
+                  __func__, error->message);
+        g_error_free(error);
+        rc = -EINVAL;
+        return rc;
+    }
+
+    g_variant_iter_init(&arg_i, result);
+    g_variant_iter_next(&arg_i, "u", size);
+    array_v = g_variant_iter_next_value(&arg_i);
+    value = g_variant_get_fixed_array(array_v, &n_elements, element_size);
+    memcpy(payload, value, n_elements);
+    g_variant_unref(array_v);
+    g_variant_unref(result);
+    return rc;
+}
+
+int agm_session_aif_connect(uint32_t session_id,
+                            uint32_t aif_id,
+                            bool state) {
+    GVariant *value_1, *value_2, *value_3, *argument;
     GVariant *result = NULL;
     GError *error = NULL;
     int rc = 0;
 
-    g_assert(evt_reg_cfg != NULL);
     AGM_LOGD("%s\n", __func__);
 
     value_1 = g_variant_new_uint32(session_id);
-    g_variant_builder_init(&builder_1, G_VARIANT_TYPE("(uuuyay)"));
-    g_variant_builder_add(&builder_1,
-                          "u",
-                          (guint32)evt_reg_cfg->module_instance_id);
-    g_variant_builder_add(&builder_1,
-                          "u",
-                          (guint32)evt_reg_cfg->event_id);
-    g_variant_builder_add(&builder_1,
-                          "u",
-                          (guint32)evt_reg_cfg->event_config_payload_size);
-    g_variant_builder_add(&builder_1, "y", (guint32)evt_reg_cfg->is_register);
-
-    value_arr = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
-                        (gconstpointer)&evt_reg_cfg->event_config_payload[0],
-                        evt_reg_cfg->event_config_payload_size,
-                        sizeof(guchar));
-    g_variant_builder_add_value(&builder_1, value_arr);
-    value_2 = g_variant_builder_end(&builder_1);
+    value_2 = g_variant_new_uint32(aif_id);
+    value_3 = g_variant_new_boolean(state);
 
-    argument = g_variant_new("(@u@(uuuyay))", value_1, value_2);
+    argument = g_variant_new("(@u@u@b)", value_1, value_2, value_3);
 
     if (mdata == NULL) {
         if ((rc = initialize_module_data()) != 0)
             return rc;
     }
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmSessionRegisterForEvents",
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionAifConnect",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
@@ -532,8 +1912,8 @@ int agm_session_register_for_events(uint32_t session_id,
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmSessionRegisterForEvents: %s\n",
-                  __func__, error->message);
+        AGM_LOGE("%s: Error invoking AgmSessionAifConnect: %s\n", __func__,
+                  error->message);
         g_error_free(error);
         rc = -EINVAL;
         return rc;
@@ -543,38 +1923,29 @@ int agm_session_register_for_events(uint32_t session_id,
     return rc;
 }
 
-int agm_session_aif_set_cal(uint32_t session_id,
-                            uint32_t aif_id,
-                            struct agm_cal_config *cal_config) {
-    GVariant *value_1, *value_2, *value_3, *value_4;
-    GVariant *argument, *argument_2;
-    GVariantBuilder builder_1;
+int agm_session_set_ec_ref(uint32_t capture_session_id,
+                           uint32_t aif_id,
+                           bool state) {
+    GVariant *value_1, *value_2, *value_3, *argument;
     GVariant *result = NULL;
     GError *error = NULL;
     int rc = 0;
-    gint i = 0;
 
-    AGM_LOGD("%s :", __func__);
-    g_assert(cal_config != NULL);
+    AGM_LOGD("%s\n", __func__);
 
-    value_1 = g_variant_new_uint32(session_id);
+    value_1 = g_variant_new_uint32(capture_session_id);
     value_2 = g_variant_new_uint32(aif_id);
-    value_3 = g_variant_new_uint32(cal_config->num_ckvs);
-    value_4 = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
-                                        (gconstpointer)cal_config->kv,
-                                        cal_config->num_ckvs*
-                                                   sizeof(struct agm_key_value),
-                                        sizeof(gchar));
+    value_3 = g_variant_new_boolean(state);
 
-    argument = g_variant_new("(@u@u@u@ay)", value_1, value_2, value_3, value_4);
+    argument = g_variant_new("(@u@u@b)", value_1, value_2, value_3);
 
     if (mdata == NULL) {
         if ((rc = initialize_module_data()) != 0)
             return rc;
     }
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmSessionAifSetCal",
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionSetEcRef",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
@@ -582,7 +1953,7 @@ int agm_session_aif_set_cal(uint32_t session_id,
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmSessionAifSetCal: %s\n", __func__,
+        AGM_LOGE("%s: Error invoking AgmSessionSetEcRef: %s\n", __func__,
                   error->message);
         g_error_free(error);
         rc = -EINVAL;
@@ -593,35 +1964,41 @@ int agm_session_aif_set_cal(uint32_t session_id,
     return rc;
 }
 
-int agm_session_aif_set_params(uint32_t session_id,
-                               uint32_t aif_id,
-                               void* payload,
-                               size_t size) {
-    GVariant *value_1, *value_2, *value_3, *value_4, *argument;
-    GVariant *result = NULL;
+int agm_session_get_params(uint32_t session_id, void* payload, size_t size) {
+    GVariant *value_1, *value_2, *value_3, *argument;
+    GVariant *val_arr = NULL, *result = NULL;
     GError *error = NULL;
+    gconstpointer value;
+    gsize n_elements;
+    gsize element_size = sizeof(guchar);
     int rc = 0;
 
     g_assert(payload != NULL);
     AGM_LOGD("%s\n", __func__);
 
+    if (size >= AGM_DBUS_BLOB_FD_MIN) {
+        rc = blob_get_params(session_id, payload, size);
+        if (rc != -ENOSYS)
+            return rc;
+        rc = 0;
+    }
+
     value_1 = g_variant_new_uint32(session_id);
-    value_2 = g_variant_new_uint32(aif_id);
-    value_3 = g_variant_new_uint32(size);
-    value_4 = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+    value_2 = g_variant_new_uint32(size);
+    value_3 = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
                                         (gconstpointer)payload,
                                         size,
                                         sizeof(gchar));
 
-    argument = g_variant_new("(@u@u@u@ay)", value_1, value_2, value_3, value_4);
+    argument = g_variant_new("(@u@u@ay)", value_1, value_2, value_3);
 
     if (mdata == NULL) {
         if ((rc = initialize_module_data()) != 0)
             return rc;
     }
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmSessionAifSetParams",
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionGetParams",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
@@ -629,42 +2006,64 @@ int agm_session_aif_set_params(uint32_t session_id,
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmSessionAifSetParams: %s\n", __func__,
+        AGM_LOGE("%s: Error invoking AgmSessionGetParams: %s\n", __func__,
                   error->message);
         g_error_free(error);
         rc = -EINVAL;
         return rc;
     }
 
+    val_arr = g_variant_get_child_value(result, 0);
+    value = g_variant_get_fixed_array(val_arr, &n_elements, element_size);
+    if (n_elements <= size) {
+        memcpy(payload, value, n_elements);
+    } else  {
+        AGM_LOGE("Insufficient bytes size to copy bytes read\n");
+        return -ENOMEM;
+    }
+
+    g_variant_unref(val_arr);
     g_variant_unref(result);
     return rc;
 }
 
-int agm_session_aif_get_tag_module_info_size(uint32_t session_id,
-                                             uint32_t aif_id,
-                                             size_t *size) {
+int agm_session_set_params(uint32_t session_id, void* payload, size_t size) {
     GVariant *value_1, *value_2, *value_3, *argument;
     GVariant *result = NULL;
     GError *error = NULL;
     int rc = 0;
 
+    g_assert(payload != NULL);
     AGM_LOGD("%s\n", __func__);
 
-    g_assert(size != NULL);
+    if (size >= AGM_DBUS_BLOB_FD_MIN) {
+        const uint32_t args[] = {session_id};
+
+        rc = blob_set("AgmSessionSetParamsFd", args, 1, payload, size);
+        if (rc != -ENOSYS)
+            return rc;
+        rc = 0;
+    }
 
     value_1 = g_variant_new_uint32(session_id);
-    value_2 = g_variant_new_uint32(aif_id);
-    value_3 = g_variant_new_uint32(*size);
+    value_2 = g_variant_new_uint32(size);
+    value_3 = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+                                        (gconstpointer)payload,
+                                        size,
+                                        sizeof(gchar));
 
-    argument = g_variant_new("(@u@u@u)", value_1, value_2, value_3);
+    argument = g_variant_new("(@u@u@ay)", value_1, value_2, value_3);
 
     if (mdata == NULL) {
         if ((rc = initialize_module_data()) != 0)
             return rc;
     }
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmSessionAifGetTagModuleInfoSize",
+    if (async_enabled())
+        return async_call(mdata->proxy, "AgmSessionSetParams", argument, -1);
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionSetParams",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
@@ -672,56 +2071,63 @@ int agm_session_aif_get_tag_module_info_size(uint32_t session_id,
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmSessionAifGetTagModuleInfo: %s\n",
-                  __func__, error->message);
+        AGM_LOGE("%s: Error invoking AgmSessionSetParams: %s\n", __func__,
+                  error->message);
         g_error_free(error);
         rc = -EINVAL;
         return rc;
     }
 
-    g_variant_get(result, "(u)", size);
     g_variant_unref(result);
     return rc;
 }
 
-int agm_session_aif_get_tag_module_info(uint32_t session_id,
-                                        uint32_t aif_id,
-                                        void *payload,
-                                        size_t *size) {
-    GVariant *value_1, *value_2, *value_3, *argument;
+static int agm_get_aif_info_list_size(size_t *num_aif_info) {
     GVariant *result = NULL;
-    GVariant *val_arr = NULL;
     GError *error = NULL;
-    gsize n_elements = 0;
-    gsize element_size = sizeof(guchar);
-    GVariant *array_v;
-    GVariantIter arg_i;
-    gconstpointer value;
     int rc = 0;
 
     AGM_LOGD("%s\n", __func__);
 
-    if (payload == NULL)
-        return agm_session_aif_get_tag_module_info_size(session_id,
-                                                        aif_id,
-                                                        size);
-
-    g_assert(size != NULL);
-    g_assert(payload != NULL);
-
-    value_1 = g_variant_new_uint32(session_id);
-    value_2 = g_variant_new_uint32(aif_id);
-    value_3 = g_variant_new_uint32(*size);
-
-    argument = g_variant_new("(@u@u@u)", value_1, value_2, value_3);
-
     if (mdata == NULL) {
         if ((rc = initialize_module_data()) != 0)
             return rc;
     }
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmSessionAifGetTagModuleInfo",
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmGetAifInfoListSize",
+                                    NULL,
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    G_MAXINT,
+                                    NULL,
+                                    &error);
+
+    if (result == NULL) {
+        AGM_LOGE("%s: Error invoking AgmGetAifInfoListSize: %s\n", __func__,
+                  error->message);
+        g_error_free(error);
+        rc = -EINVAL;
+        return rc;
+    }
+
+    g_variant_get(result, "(u)", num_aif_info);
+    g_variant_unref(result);
+    return rc;
+}
+
+static int aif_info_list_fetch(struct aif_info *aif_list,
+                               size_t *num_aif_info) {
+    GVariant *argument = NULL;
+    GVariant *result = NULL, *array_v, *struct_v;
+    GError *error = NULL;
+    GVariantIter arg_i, struct_i, array_i;
+    int rc = 0, i = 0;
+    const char *name = NULL;
+
+    argument = g_variant_new("(@u)", g_variant_new_uint32(*num_aif_info));
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmGetAifInfoList",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
@@ -729,46 +2135,159 @@ int agm_session_aif_get_tag_module_info(uint32_t session_id,
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmSessionAifGetTagModuleInfo: %s\n",
-                  __func__, error->message);
+        AGM_LOGE("%s: Error invoking AgmGetAifInfoList: %s\n", __func__,
+                  error->message);
         g_error_free(error);
         rc = -EINVAL;
         return rc;
     }
 
     g_variant_iter_init(&arg_i, result);
-    g_variant_iter_next(&arg_i, "u", size);
     array_v = g_variant_iter_next_value(&arg_i);
-    value = g_variant_get_fixed_array(array_v, &n_elements, element_size);
-    memcpy(payload, value, n_elements);
+    g_variant_iter_init(&array_i, array_v);
+    for (i = 0; i < *num_aif_info; i++) {
+        struct_v = g_variant_iter_next_value(&array_i);
+        g_variant_iter_init(&struct_i, struct_v);
+        g_variant_iter_next(&struct_i, "u", &aif_list[i].dir);
+        g_variant_iter_next(&struct_i, "s", &name);
+        strlcpy(aif_list[i].aif_name, name, (strlen(name) +1));
+        g_variant_unref(struct_v);
+    }
     g_variant_unref(array_v);
     g_variant_unref(result);
+
     return rc;
 }
 
-int agm_session_aif_connect(uint32_t session_id,
+/*
+ * The aif list is fixed for the life of the service, serve it from the
+ * cache; -ENOENT if it is not cached yet, -ENOSYS if it cannot be.
+ */
+static int aif_info_cache_get(struct aif_info *aif_list,
+                              size_t *num_aif_info) {
+    uint64_t gen;
+    int rc;
+
+    g_mutex_lock(&mdata->cache_lock);
+    rc = cache_generation_locked(&gen);
+    if (rc) {
+        rc = rc == -ENOSYS ? -ENOSYS : -EAGAIN;
+        goto done;
+    }
+
+    if (mdata->aif_cache == NULL) {
+        rc = -ENOENT;
+        goto done;
+    }
+
+    if (*num_aif_info > mdata->num_aif_cache || *num_aif_info == 0)
+        *num_aif_info = mdata->num_aif_cache;
+    if (aif_list != NULL)
+        memcpy(aif_list, mdata->aif_cache,
+               *num_aif_info * sizeof(struct aif_info));
+
+done:
+    g_mutex_unlock(&mdata->cache_lock);
+    return rc;
+}
+
+static void aif_info_cache_fill(void) {
+    struct aif_info *aif_list;
+    size_t num_aif_info = 0;
+
+    if (agm_get_aif_info_list_size(&num_aif_info) || num_aif_info == 0)
+        return;
+
+    aif_list = (struct aif_info *)g_malloc0(num_aif_info *
+                                            sizeof(struct aif_info));
+    if (aif_info_list_fetch(aif_list, &num_aif_info)) {
+        g_free(aif_list);
+        return;
+    }
+
+    g_mutex_lock(&mdata->cache_lock);
+    if (mdata->gen_page != NULL && mdata->aif_cache == NULL) {
+        mdata->aif_cache = aif_list;
+        mdata->num_aif_cache = num_aif_info;
+        aif_list = NULL;
+    }
+    g_mutex_unlock(&mdata->cache_lock);
+    g_free(aif_list);
+}
+
+int agm_get_aif_info_list(struct aif_info *aif_list, size_t *num_aif_info) {
+    int rc = 0;
+
+    g_assert(num_aif_info != NULL);
+    AGM_LOGD("%s\n", __func__);
+
+    if (mdata == NULL) {
+        if ((rc = initialize_module_data()) != 0)
+            return rc;
+    }
+
+    if (*num_aif_info != 0)
+        g_assert(aif_list != NULL);
+
+    rc = aif_info_cache_get(*num_aif_info ? aif_list : NULL, num_aif_info);
+    if (rc == -ENOENT) {
+        aif_info_cache_fill();
+        rc = aif_info_cache_get(*num_aif_info ? aif_list : NULL,
+                                num_aif_info);
+    }
+    if (rc == 0)
+        return rc;
+
+    if (*num_aif_info == 0)
+        return agm_get_aif_info_list_size(num_aif_info);
+
+    return aif_info_list_fetch(aif_list, num_aif_info);
+}
+
+int agm_set_params_with_tag(uint32_t session_id,
                             uint32_t aif_id,
-                            bool state) {
-    GVariant *value_1, *value_2, *value_3, *argument;
+                            struct agm_tag_config *tag_config) {
+    GVariant *value_1, *value_2, *value_3, *value_4, *value_5;
+    GVariant *argument, *argument_2;
+    GVariantBuilder builder_1;
     GVariant *result = NULL;
     GError *error = NULL;
     int rc = 0;
+    gint i = 0;
 
+    g_assert(tag_config != NULL);
     AGM_LOGD("%s\n", __func__);
 
     value_1 = g_variant_new_uint32(session_id);
     value_2 = g_variant_new_uint32(aif_id);
-    value_3 = g_variant_new_boolean(state);
+    value_3 = g_variant_new_uint32(tag_config->tag);
+    value_4 = g_variant_new_uint32(tag_config->num_tkvs);
 
-    argument = g_variant_new("(@u@u@b)", value_1, value_2, value_3);
+    g_variant_builder_init(&builder_1, G_VARIANT_TYPE("a(uu)"));
+    for (i = 0; i < tag_config->num_tkvs; i++) {
+        g_variant_builder_open(&builder_1, G_VARIANT_TYPE("(uu)"));
+        g_variant_builder_add(&builder_1, "u", (guint32)tag_config->kv[i].key);
+        g_variant_builder_add(&builder_1, "u",
+                                            (guint32)tag_config->kv[i].value);
+        g_variant_builder_close(&builder_1);
+    }
+
+    value_5 = g_variant_builder_end(&builder_1);
+
+    argument_2 = g_variant_new("(@u@u@a(uu))", value_3, value_4, value_5);
+
+    argument = g_variant_new("(@u@u@(uua(uu)))", value_1, value_2, argument_2);
 
     if (mdata == NULL) {
         if ((rc = initialize_module_data()) != 0)
             return rc;
     }
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmSessionAifConnect",
+    if (async_enabled())
+        return async_call(mdata->proxy, "AgmSetParamsWithTag", argument, -1);
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSetParamsWithTag",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
@@ -776,7 +2295,7 @@ int agm_session_aif_connect(uint32_t session_id,
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmSessionAifConnect: %s\n", __func__,
+        AGM_LOGE("%s: Error invoking AgmSetParamsWithTag: %s\n", __func__,
                   error->message);
         g_error_free(error);
         rc = -EINVAL;
@@ -787,9 +2306,9 @@ int agm_session_aif_connect(uint32_t session_id,
     return rc;
 }
 
-int agm_session_set_ec_ref(uint32_t capture_session_id,
-                           uint32_t aif_id,
-                           bool state) {
+int agm_session_set_loopback(uint32_t capture_session_id,
+                             uint32_t playback_session_id,
+                             bool state) {
     GVariant *value_1, *value_2, *value_3, *argument;
     GVariant *result = NULL;
     GError *error = NULL;
@@ -798,7 +2317,7 @@ int agm_session_set_ec_ref(uint32_t capture_session_id,
     AGM_LOGD("%s\n", __func__);
 
     value_1 = g_variant_new_uint32(capture_session_id);
-    value_2 = g_variant_new_uint32(aif_id);
+    value_2 = g_variant_new_uint32(playback_session_id);
     value_3 = g_variant_new_boolean(state);
 
     argument = g_variant_new("(@u@u@b)", value_1, value_2, value_3);
@@ -808,8 +2327,8 @@ int agm_session_set_ec_ref(uint32_t capture_session_id,
             return rc;
     }
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmSessionSetEcRef",
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionSetLoopback",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
@@ -817,7 +2336,7 @@ int agm_session_set_ec_ref(uint32_t capture_session_id,
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmSessionSetEcRef: %s\n", __func__,
+        AGM_LOGE("%s: Error invoking AgmSessionSetLoopback: %s\n", __func__,
                   error->message);
         g_error_free(error);
         rc = -EINVAL;
@@ -828,22 +2347,29 @@ int agm_session_set_ec_ref(uint32_t capture_session_id,
     return rc;
 }
 
-int agm_session_get_params(uint32_t session_id, void* payload, size_t size) {
+int agm_session_set_metadata(uint32_t session_id,
+                             uint32_t size, uint8_t *metadata) {
     GVariant *value_1, *value_2, *value_3, *argument;
-    GVariant *val_arr = NULL, *result = NULL;
+    GVariant *result = NULL;
     GError *error = NULL;
-    gconstpointer value;
-    gsize n_elements;
-    gsize element_size = sizeof(guchar);
     int rc = 0;
 
-    g_assert(payload != NULL);
+    g_assert(metadata != NULL);
     AGM_LOGD("%s\n", __func__);
 
+    if (size >= AGM_DBUS_BLOB_FD_MIN) {
+        const uint32_t args[] = {session_id};
+
+        rc = blob_set("AgmSessionSetMetadataFd", args, 1, metadata, size);
+        if (rc != -ENOSYS)
+            return rc;
+        rc = 0;
+    }
+
     value_1 = g_variant_new_uint32(session_id);
     value_2 = g_variant_new_uint32(size);
     value_3 = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
-                                        (gconstpointer)payload,
+                                        (gconstpointer)metadata,
                                         size,
                                         sizeof(gchar));
 
@@ -854,8 +2380,11 @@ int agm_session_get_params(uint32_t session_id, void* payload, size_t size) {
             return rc;
     }
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmSessionGetParams",
+    if (async_enabled())
+        return async_call(mdata->proxy, "AgmSessionSetMetadata", argument, -1);
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionSetMetadata",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
@@ -863,52 +2392,57 @@ int agm_session_get_params(uint32_t session_id, void* payload, size_t size) {
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmSessionGetParams: %s\n", __func__,
+        AGM_LOGE("%s: Error invoking AgmSessionSetMetadata: %s\n", __func__,
                   error->message);
         g_error_free(error);
         rc = -EINVAL;
         return rc;
     }
 
-    val_arr = g_variant_get_child_value(result, 0);
-    value = g_variant_get_fixed_array(val_arr, &n_elements, element_size);
-    if (n_elements <= size) {
-        memcpy(payload, value, n_elements);
-    } else  {
-        AGM_LOGE("Insufficient bytes size to copy bytes read\n");
-        return -ENOMEM;
-    }
-
-    g_variant_unref(val_arr);
     g_variant_unref(result);
     return rc;
 }
 
-int agm_session_set_params(uint32_t session_id, void* payload, size_t size) {
-    GVariant *value_1, *value_2, *value_3, *argument;
+int agm_session_aif_set_metadata(uint32_t session_id,
+                                 uint32_t aif_id,
+                                 uint32_t size, uint8_t *metadata) {
+    GVariant *value_1, *value_2, *value_3, *value_4, *argument;
     GVariant *result = NULL;
     GError *error = NULL;
     int rc = 0;
 
-    g_assert(payload != NULL);
+    g_assert(metadata != NULL);
     AGM_LOGD("%s\n", __func__);
 
+    if (size >= AGM_DBUS_BLOB_FD_MIN) {
+        const uint32_t args[] = {session_id, aif_id};
+
+        rc = blob_set("AgmSessionAifSetMetadataFd", args, 2, metadata, size);
+        if (rc != -ENOSYS)
+            return rc;
+        rc = 0;
+    }
+
     value_1 = g_variant_new_uint32(session_id);
-    value_2 = g_variant_new_uint32(size);
-    value_3 = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
-                                        (gconstpointer)payload,
+    value_2 = g_variant_new_uint32(aif_id);
+    value_3 = g_variant_new_uint32(size);
+    value_4 = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+                                        (gconstpointer)metadata,
                                         size,
                                         sizeof(gchar));
 
-    argument = g_variant_new("(@u@u@ay)", value_1, value_2, value_3);
+    argument = g_variant_new("(@u@u@u@ay)", value_1, value_2, value_3, value_4);
 
     if (mdata == NULL) {
         if ((rc = initialize_module_data()) != 0)
             return rc;
     }
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmSessionSetParams",
+    if (async_enabled())
+        return async_call(mdata->proxy, "AgmSessionAifSetMetadata", argument, -1);
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionAifSetMetadata",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
@@ -916,7 +2450,7 @@ int agm_session_set_params(uint32_t session_id, void* payload, size_t size) {
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmSessionSetParams: %s\n", __func__,
+        AGM_LOGE("%s: Error invoking AgmSessionAifSetMetadata: %s\n", __func__,
                   error->message);
         g_error_free(error);
         rc = -EINVAL;
@@ -927,136 +2461,90 @@ int agm_session_set_params(uint32_t session_id, void* payload, size_t size) {
     return rc;
 }
 
-static int agm_get_aif_info_list_size(size_t *num_aif_info) {
+int agm_aif_set_metadata(uint32_t aif_id,
+                         uint32_t size, uint8_t *metadata) {
+    GVariant *value_1, *value_2, *value_3, *argument;
     GVariant *result = NULL;
     GError *error = NULL;
     int rc = 0;
 
+    g_assert(metadata != NULL);
     AGM_LOGD("%s\n", __func__);
 
+    if (size >= AGM_DBUS_BLOB_FD_MIN) {
+        const uint32_t args[] = {aif_id};
+
+        rc = blob_set("AgmAifSetMetadataFd", args, 1, metadata, size);
+        if (rc != -ENOSYS)
+            return rc;
+        rc = 0;
+    }
+
+    value_1 = g_variant_new_uint32(aif_id);
+    value_2 = g_variant_new_uint32(size);
+    value_3 = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+                                        (gconstpointer)metadata,
+                                        size,
+                                        sizeof(gchar));
+
+    argument = g_variant_new("(@u@u@ay)", value_1, value_2, value_3);
+
     if (mdata == NULL) {
         if ((rc = initialize_module_data()) != 0)
             return rc;
     }
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmGetAifInfoListSize",
-                                    NULL,
+    if (async_enabled())
+        return async_call(mdata->proxy, "AgmAifSetMetadata", argument, -1);
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmAifSetMetadata",
+                                    argument,
                                     G_DBUS_CALL_FLAGS_NONE,
-                                    G_MAXINT,
+                                    -1,
                                     NULL,
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmGetAifInfoListSize: %s\n", __func__,
+        AGM_LOGE("%s: Error invoking AgmAifSetMetadata: %s\n", __func__,
                   error->message);
         g_error_free(error);
         rc = -EINVAL;
         return rc;
     }
 
-    g_variant_get(result, "(u)", num_aif_info);
-    g_variant_unref(result);
-    return rc;
-}
-
-int agm_get_aif_info_list(struct aif_info *aif_list, size_t *num_aif_info) {
-    GVariant *argument = NULL;
-    GVariant *result = NULL, *array_v, *struct_v;
-    GError *error = NULL;
-    GVariantIter arg_i, struct_i, array_i;
-    int rc = 0, i = 0;
-    const char *name = NULL;
-
-    g_assert(num_aif_info != NULL);
-    AGM_LOGD("%s\n", __func__);
-
-    if (*num_aif_info == 0)
-        return agm_get_aif_info_list_size(num_aif_info);
-    else {
-        g_assert(aif_list != NULL);
-        argument = g_variant_new("(@u)", g_variant_new_uint32(*num_aif_info));
-
-        if (mdata == NULL) {
-            if ((rc = initialize_module_data()) != 0)
-                return rc;
-        }
-
-        result = g_dbus_proxy_call_sync(mdata->proxy,
-                                        "AgmGetAifInfoList",
-                                        argument,
-                                        G_DBUS_CALL_FLAGS_NONE,
-                                        -1,
-                                        NULL,
-                                        &error);
-
-        if (result == NULL) {
-            AGM_LOGE("%s: Error invoking AgmGetAifInfoList: %s\n", __func__,
-                      error->message);
-            g_error_free(error);
-            rc = -EINVAL;
-            return rc;
-        }
-    }
-
-    g_variant_iter_init(&arg_i, result);
-    array_v = g_variant_iter_next_value(&arg_i);
-    g_variant_iter_init(&array_i, array_v);
-    for (i = 0; i < *num_aif_info; i++) {
-        struct_v = g_variant_iter_next_value(&array_i);
-        g_variant_iter_init(&struct_i, struct_v);
-        g_variant_iter_next(&struct_i, "u", &aif_list[i].dir);
-        g_variant_iter_next(&struct_i, "s", &name);
-        strlcpy(aif_list[i].aif_name, name, (strlen(name) +1));
-        g_variant_unref(struct_v);
-    }
-    g_variant_unref(array_v);
     g_variant_unref(result);
-
     return rc;
 }
 
-int agm_set_params_with_tag(uint32_t session_id,
-                            uint32_t aif_id,
-                            struct agm_tag_config *tag_config) {
-    GVariant *value_1, *value_2, *value_3, *value_4, *value_5;
-    GVariant *argument, *argument_2;
+int agm_aif_set_media_config(uint32_t aif_id,
+                             struct agm_media_config *media_config) {
+    GVariant *value_1, *value_2, *argument;
     GVariantBuilder builder_1;
     GVariant *result = NULL;
     GError *error = NULL;
     int rc = 0;
-    gint i = 0;
 
-    g_assert(tag_config != NULL);
+    g_assert(media_config != NULL);
     AGM_LOGD("%s\n", __func__);
 
-    value_1 = g_variant_new_uint32(session_id);
-    value_2 = g_variant_new_uint32(aif_id);
-    value_3 = g_variant_new_uint32(tag_config->tag);
-    value_4 = g_variant_new_uint32(tag_config->num_tkvs);
-
-    g_variant_builder_init(&builder_1, G_VARIANT_TYPE("a(uu)"));
-    for (i = 0; i < tag_config->num_tkvs; i++) {
-        g_variant_builder_open(&builder_1, G_VARIANT_TYPE("(uu)"));
-        g_variant_builder_add(&builder_1, "u", (guint32)tag_config->kv[i].key);
-        g_variant_builder_add(&builder_1, "u",
-                                            (guint32)tag_config->kv[i].value);
-        g_variant_builder_close(&builder_1);
-    }
-
-    value_5 = g_variant_builder_end(&builder_1);
+    value_1 = g_variant_new_uint32(aif_id);
 
-    argument_2 = g_variant_new("(@u@u@a(uu))", value_3, value_4, value_5);
+    g_variant_builder_init(&builder_1, G_VARIANT_TYPE("(uui)"));
+    g_variant_builder_add(&builder_1, "u", (guint32)media_config->rate);
+    g_variant_builder_add(&builder_1, "u", (guint32)media_config->channels);
+    g_variant_builder_add(&builder_1, "i", (gint32)media_config->format);
+    value_2 = g_variant_builder_end(&builder_1);
 
-    argument = g_variant_new("(@u@u@(uua(uu)))", value_1, value_2, argument_2);
+    argument = g_variant_new("(@u@(uui))", value_1, value_2);
 
     if (mdata == NULL) {
         if ((rc = initialize_module_data()) != 0)
             return rc;
     }
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmSetParamsWithTag",
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmAifSetMediaConfig",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
@@ -1064,7 +2552,7 @@ int agm_set_params_with_tag(uint32_t session_id,
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmSetParamsWithTag: %s\n", __func__,
+        AGM_LOGE("%s: Error invoking AgmAifSetMediaConfig: %s\n", __func__,
                   error->message);
         g_error_free(error);
         rc = -EINVAL;
@@ -1075,29 +2563,23 @@ int agm_set_params_with_tag(uint32_t session_id,
     return rc;
 }
 
-int agm_session_set_loopback(uint32_t capture_session_id,
-                             uint32_t playback_session_id,
-                             bool state) {
-    GVariant *value_1, *value_2, *value_3, *argument;
+int agm_get_buffer_timestamp(uint32_t session_id, uint64_t *timestamp) {
+    GVariant *argument = NULL;
     GVariant *result = NULL;
     GError *error = NULL;
     int rc = 0;
 
-    AGM_LOGD("%s\n", __func__);
-
-    value_1 = g_variant_new_uint32(capture_session_id);
-    value_2 = g_variant_new_uint32(playback_session_id);
-    value_3 = g_variant_new_boolean(state);
-
-    argument = g_variant_new("(@u@u@b)", value_1, value_2, value_3);
-
     if (mdata == NULL) {
         if ((rc = initialize_module_data()) != 0)
             return rc;
     }
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmSessionSetLoopback",
+    AGM_LOGD("%s\n", __func__);
+
+    argument = g_variant_new("(@u)", g_variant_new_uint32(session_id));
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmGetBufferTimestamp",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
@@ -1105,43 +2587,35 @@ int agm_session_set_loopback(uint32_t capture_session_id,
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmSessionSetLoopback: %s\n", __func__,
+        AGM_LOGE("%s: Error invoking AgmGetBufferTimestamp: %s\n", __func__,
                   error->message);
         g_error_free(error);
         rc = -EINVAL;
         return rc;
     }
 
+    g_variant_get(result, "(t)", timestamp);
     g_variant_unref(result);
     return rc;
 }
 
-int agm_session_set_metadata(uint32_t session_id,
-                             uint32_t size, uint8_t *metadata) {
-    GVariant *value_1, *value_2, *value_3, *argument;
+size_t agm_get_hw_processed_buff_cnt(uint64_t handle, enum direction dir) {
+    GVariant *argument = NULL;
     GVariant *result = NULL;
     GError *error = NULL;
+    agm_client_session_data *ses_data = (agm_client_session_data *) handle;
+    size_t bufCount;
     int rc = 0;
 
-    g_assert(metadata != NULL);
-    AGM_LOGD("%s\n", __func__);
-
-    value_1 = g_variant_new_uint32(session_id);
-    value_2 = g_variant_new_uint32(size);
-    value_3 = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
-                                        (gconstpointer)metadata,
-                                        size,
-                                        sizeof(gchar));
+    g_assert(ses_data != NULL);
+    g_assert(ses_data->proxy != NULL);
 
-    argument = g_variant_new("(@u@u@ay)", value_1, value_2, value_3);
+    AGM_LOGD("%s\n", __func__);
 
-    if (mdata == NULL) {
-        if ((rc = initialize_module_data()) != 0)
-            return rc;
-    }
+    argument = g_variant_new("(@u)", g_variant_new_uint32(dir));
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmSessionSetMetadata",
+    result = client_proxy_call_sync(ses_data->proxy,
+                                    "AgmGetHwProcessedBufCount",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
@@ -1149,45 +2623,35 @@ int agm_session_set_metadata(uint32_t session_id,
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmSessionSetMetadata: %s\n", __func__,
+        AGM_LOGE("%s: Error invoking AgmGetHwProcessedBufCount: %s\n", __func__,
                   error->message);
         g_error_free(error);
-        rc = -EINVAL;
-        return rc;
+        return -EINVAL;
     }
 
+    g_variant_get(result, "(i)", &bufCount);
     g_variant_unref(result);
-    return rc;
+    return bufCount;
 }
 
-int agm_session_aif_set_metadata(uint32_t session_id,
-                                 uint32_t aif_id,
-                                 uint32_t size, uint8_t *metadata) {
-    GVariant *value_1, *value_2, *value_3, *value_4, *argument;
+int agm_session_get_stats(uint32_t session_id, struct agm_session_stats *stats) {
+    GVariant *argument = NULL;
     GVariant *result = NULL;
     GError *error = NULL;
+    guint64 num_writes, num_reads, bytes_written, bytes_read;
     int rc = 0;
 
-    g_assert(metadata != NULL);
-    AGM_LOGD("%s\n", __func__);
-
-    value_1 = g_variant_new_uint32(session_id);
-    value_2 = g_variant_new_uint32(aif_id);
-    value_3 = g_variant_new_uint32(size);
-    value_4 = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
-                                        (gconstpointer)metadata,
-                                        size,
-                                        sizeof(gchar));
-
-    argument = g_variant_new("(@u@u@u@ay)", value_1, value_2, value_3, value_4);
-
     if (mdata == NULL) {
         if ((rc = initialize_module_data()) != 0)
             return rc;
     }
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmSessionAifSetMetadata",
+    AGM_LOGD("%s\n", __func__);
+
+    argument = g_variant_new("(@u)", g_variant_new_uint32(session_id));
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionGetStats",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
@@ -1195,43 +2659,45 @@ int agm_session_aif_set_metadata(uint32_t session_id,
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmSessionAifSetMetadata: %s\n", __func__,
+        AGM_LOGE("%s: Error invoking AgmSessionGetStats: %s\n", __func__,
                   error->message);
         g_error_free(error);
-        rc = -EINVAL;
-        return rc;
+        return -EINVAL;
     }
 
+    memset(stats, 0, sizeof(*stats));
+    g_variant_get(result, "(ttttuuuuu)", &num_writes, &num_reads,
+                  &bytes_written, &bytes_read, &stats->num_underruns,
+                  &stats->num_overruns, &stats->num_poll_timeouts,
+                  &stats->max_pos_interval_us, &stats->latency_us);
+    stats->num_writes = num_writes;
+    stats->num_reads = num_reads;
+    stats->bytes_written = bytes_written;
+    stats->bytes_read = bytes_read;
     g_variant_unref(result);
     return rc;
 }
 
-int agm_aif_set_metadata(uint32_t aif_id,
-                         uint32_t size, uint8_t *metadata) {
-    GVariant *value_1, *value_2, *value_3, *argument;
+int agm_session_update_stats(uint64_t handle,
+                             const struct agm_session_stats *delta) {
+    agm_client_session_data *ses_data = (agm_client_session_data *) handle;
+    GVariant *argument = NULL;
     GVariant *result = NULL;
     GError *error = NULL;
-    int rc = 0;
-
-    g_assert(metadata != NULL);
-    AGM_LOGD("%s\n", __func__);
 
-    value_1 = g_variant_new_uint32(aif_id);
-    value_2 = g_variant_new_uint32(size);
-    value_3 = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
-                                        (gconstpointer)metadata,
-                                        size,
-                                        sizeof(gchar));
+    g_assert(ses_data != NULL);
+    g_assert(ses_data->proxy != NULL);
+    g_assert(delta != NULL);
 
-    argument = g_variant_new("(@u@u@ay)", value_1, value_2, value_3);
+    AGM_LOGD("%s\n", __func__);
 
-    if (mdata == NULL) {
-        if ((rc = initialize_module_data()) != 0)
-            return rc;
-    }
+    /* transfer counts are kept by agm, only send what the client saw */
+    argument = g_variant_new("(uuuuu)", delta->num_underruns,
+                             delta->num_overruns, delta->num_poll_timeouts,
+                             delta->max_pos_interval_us, delta->latency_us);
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmAifSetMetadata",
+    result = client_proxy_call_sync(ses_data->proxy,
+                                    "AgmSessionUpdateStats",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
@@ -1239,45 +2705,56 @@ int agm_aif_set_metadata(uint32_t aif_id,
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmAifSetMetadata: %s\n", __func__,
+        AGM_LOGE("%s: Error invoking AgmSessionUpdateStats: %s\n", __func__,
                   error->message);
         g_error_free(error);
-        rc = -EINVAL;
-        return rc;
+        return -EINVAL;
     }
 
     g_variant_unref(result);
-    return rc;
+    return 0;
 }
 
-int agm_aif_set_media_config(uint32_t aif_id,
-                             struct agm_media_config *media_config) {
-    GVariant *value_1, *value_2, *argument;
-    GVariantBuilder builder_1;
-    GVariant *result = NULL;
-    GError *error = NULL;
-    int rc = 0;
+static GVariant *group_session_ids(uint64_t *handles, uint32_t num_handles) {
+    agm_client_session_data *ses_data;
+    GVariantBuilder builder;
+    uint32_t i;
 
-    g_assert(media_config != NULL);
-    AGM_LOGD("%s\n", __func__);
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("au"));
+    for (i = 0; i < num_handles; i++) {
+        ses_data = (agm_client_session_data *)handles[i];
+        g_assert(ses_data != NULL);
+        ring_sync(ses_data);
+        g_variant_builder_add(&builder, "u", ses_data->session_id);
+    }
 
-    value_1 = g_variant_new_uint32(aif_id);
+    return g_variant_builder_end(&builder);
+}
 
-    g_variant_builder_init(&builder_1, G_VARIANT_TYPE("(uui)"));
-    g_variant_builder_add(&builder_1, "u", (guint32)media_config->rate);
-    g_variant_builder_add(&builder_1, "u", (guint32)media_config->channels);
-    g_variant_builder_add(&builder_1, "i", (gint32)media_config->format);
-    value_2 = g_variant_builder_end(&builder_1);
+int agm_session_group_start(uint64_t *handles, uint32_t num_handles,
+                            uint64_t *start_skew_us) {
+    GVariant *argument = NULL;
+    GVariant *result = NULL;
+    GError *error = NULL;
+    guint64 skew = 0;
+    int rc = 0;
 
-    argument = g_variant_new("(@u@(uui))", value_1, value_2);
+    if (handles == NULL || num_handles == 0)
+        return -EINVAL;
 
     if (mdata == NULL) {
         if ((rc = initialize_module_data()) != 0)
             return rc;
     }
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmAifSetMediaConfig",
+    AGM_LOGD("%s\n", __func__);
+
+    argument = g_variant_new("(@aub)",
+                             group_session_ids(handles, num_handles),
+                             start_skew_us != NULL);
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionGroupStart",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
@@ -1285,23 +2762,28 @@ int agm_aif_set_media_config(uint32_t aif_id,
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmAifSetMediaConfig: %s\n", __func__,
+        AGM_LOGE("%s: Error invoking AgmSessionGroupStart: %s\n", __func__,
                   error->message);
         g_error_free(error);
-        rc = -EINVAL;
-        return rc;
+        return -EINVAL;
     }
 
+    g_variant_get(result, "(t)", &skew);
+    if (start_skew_us)
+        *start_skew_us = skew;
     g_variant_unref(result);
     return rc;
 }
 
-int agm_get_buffer_timestamp(uint32_t session_id, uint64_t *timestamp) {
+int agm_session_group_stop(uint64_t *handles, uint32_t num_handles) {
     GVariant *argument = NULL;
     GVariant *result = NULL;
     GError *error = NULL;
     int rc = 0;
 
+    if (handles == NULL || num_handles == 0)
+        return -EINVAL;
+
     if (mdata == NULL) {
         if ((rc = initialize_module_data()) != 0)
             return rc;
@@ -1309,10 +2791,10 @@ int agm_get_buffer_timestamp(uint32_t session_id, uint64_t *timestamp) {
 
     AGM_LOGD("%s\n", __func__);
 
-    argument = g_variant_new("(@u)", g_variant_new_uint32(session_id));
+    argument = g_variant_new("(@au)", group_session_ids(handles, num_handles));
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
-                                    "AgmGetBufferTimestamp",
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionGroupStop",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
@@ -1320,35 +2802,42 @@ int agm_get_buffer_timestamp(uint32_t session_id, uint64_t *timestamp) {
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmGetBufferTimestamp: %s\n", __func__,
+        AGM_LOGE("%s: Error invoking AgmSessionGroupStop: %s\n", __func__,
                   error->message);
         g_error_free(error);
-        rc = -EINVAL;
-        return rc;
+        return -EINVAL;
     }
 
-    g_variant_get(result, "(t)", timestamp);
     g_variant_unref(result);
     return rc;
 }
 
-size_t agm_get_hw_processed_buff_cnt(uint64_t handle, enum direction dir) {
+int agm_recover_all(struct agm_session_recovery_info *info,
+                    size_t *num_sessions) {
     GVariant *argument = NULL;
-    GVariant *result = NULL;
+    GVariant *result = NULL, *array_v;
     GError *error = NULL;
-    agm_client_session_data *ses_data = (agm_client_session_data *) handle;
-    size_t bufCount;
+    GVariantIter array_i;
+    gint32 ret = 0, status;
+    guint32 num = 0, session_id;
+    guint64 time_us;
+    size_t i = 0;
     int rc = 0;
 
-    g_assert(ses_data != NULL);
-    g_assert(ses_data->proxy != NULL);
+    if (num_sessions == NULL || (*num_sessions != 0 && info == NULL))
+        return -EINVAL;
+
+    if (mdata == NULL) {
+        if ((rc = initialize_module_data()) != 0)
+            return rc;
+    }
 
     AGM_LOGD("%s\n", __func__);
 
-    argument = g_variant_new("(@u)", g_variant_new_uint32(dir));
+    argument = g_variant_new("(@u)", g_variant_new_uint32(*num_sessions));
 
-    result = g_dbus_proxy_call_sync(ses_data->proxy,
-                                    "AgmGetHwProcessedBufCount",
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmRecoverAll",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
                                     -1,
@@ -1356,15 +2845,26 @@ size_t agm_get_hw_processed_buff_cnt(uint64_t handle, enum direction dir) {
                                     &error);
 
     if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmGetHwProcessedBufCount: %s\n", __func__,
+        AGM_LOGE("%s: Error invoking AgmRecoverAll: %s\n", __func__,
                   error->message);
         g_error_free(error);
         return -EINVAL;
     }
 
-    g_variant_get(result, "(i)", &bufCount);
+    g_variant_get(result, "(iu@a(uit))", &ret, &num, &array_v);
+    g_variant_iter_init(&array_i, array_v);
+    while (i < *num_sessions &&
+           g_variant_iter_next(&array_i, "(uit)", &session_id, &status,
+                               &time_us)) {
+        info[i].session_id = session_id;
+        info[i].status = status;
+        info[i].recovery_time_us = time_us;
+        i++;
+    }
+    *num_sessions = num;
+    g_variant_unref(array_v);
     g_variant_unref(result);
-    return bufCount;
+    return ret;
 }
 
 int agm_get_session_time(uint64_t handle, uint64_t *timestamp) {
@@ -1378,7 +2878,9 @@ int agm_get_session_time(uint64_t handle, uint64_t *timestamp) {
 
     AGM_LOGD("%s\n", __func__);
 
-    result = g_dbus_proxy_call_sync(ses_data->proxy,
+    ring_sync(ses_data);
+
+    result = client_proxy_call_sync(ses_data->proxy,
                                     "AgmSessionGetTime",
                                     NULL,
                                     G_DBUS_CALL_FLAGS_NONE,
@@ -1408,7 +2910,9 @@ int agm_session_eos(uint64_t handle) {
 
     AGM_LOGD("%s\n", __func__);
 
-    result = g_dbus_proxy_call_sync(ses_data->proxy,
+    ring_sync(ses_data);
+
+    result = client_proxy_call_sync(ses_data->proxy,
                                     "AgmSessionEos",
                                     NULL,
                                     G_DBUS_CALL_FLAGS_NONE,
@@ -1466,7 +2970,9 @@ int agm_session_set_config(uint64_t handle,
                    arr);
 
 
-    result = g_dbus_proxy_call_sync(ses_data->proxy,
+    ring_sync(ses_data);
+
+    result = client_proxy_call_sync(ses_data->proxy,
                                     "AgmSessionSetConfig",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
@@ -1494,13 +3000,16 @@ int agm_session_write(uint64_t handle, void *buf, size_t *byte_count) {
     g_assert(ses_data->proxy != NULL);
     AGM_LOGD("%s\n", __func__);
 
+    if (ring_ready(ses_data, AGM_DBUS_RING_PLAYBACK, *byte_count))
+        return ring_write(ses_data, buf, *byte_count);
+
     arr = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
                                     (gconstpointer)buf,
                                     *byte_count,
                                     sizeof(guchar));
     argument = g_variant_new("(@u@ay)", g_variant_new_uint32(*byte_count), arr);
 
-    result = g_dbus_proxy_call_sync(ses_data->proxy,
+    result = client_proxy_call_sync(ses_data->proxy,
                                     "AgmSessionWrite",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
@@ -1534,9 +3043,12 @@ int agm_session_read(uint64_t handle, void *buf, size_t *byte_count) {
     g_assert(ses_data->proxy != NULL);
     AGM_LOGD("%s\n", __func__);
 
+    if (ring_ready(ses_data, AGM_DBUS_RING_CAPTURE, *byte_count))
+        return ring_read(ses_data, buf, *byte_count);
+
     argument = g_variant_new("(@u)", g_variant_new_uint32(*byte_count));
 
-    result = g_dbus_proxy_call_sync(ses_data->proxy,
+    result = client_proxy_call_sync(ses_data->proxy,
                                     "AgmSessionRead",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
@@ -1575,7 +3087,9 @@ int agm_session_resume(uint64_t handle) {
     g_assert(ses_data->proxy != NULL);
     AGM_LOGD("%s\n", __func__);
 
-    result = g_dbus_proxy_call_sync(ses_data->proxy,
+    ring_sync(ses_data);
+
+    result = client_proxy_call_sync(ses_data->proxy,
                                     "AgmSessionResume",
                                     NULL,
                                     G_DBUS_CALL_FLAGS_NONE,
@@ -1603,7 +3117,9 @@ int agm_session_pause(uint64_t handle) {
     g_assert(ses_data->proxy != NULL);
     AGM_LOGD("%s\n", __func__);
 
-    result = g_dbus_proxy_call_sync(ses_data->proxy,
+    ring_sync(ses_data);
+
+    result = client_proxy_call_sync(ses_data->proxy,
                                     "AgmSessionPause",
                                     NULL,
                                     G_DBUS_CALL_FLAGS_NONE,
@@ -1631,7 +3147,9 @@ int agm_session_stop(uint64_t handle) {
     g_assert(ses_data->proxy != NULL);
     AGM_LOGD("%s\n", __func__);
 
-    result = g_dbus_proxy_call_sync(ses_data->proxy,
+    ring_sync(ses_data);
+
+    result = client_proxy_call_sync(ses_data->proxy,
                                     "AgmSessionStop",
                                     NULL,
                                     G_DBUS_CALL_FLAGS_NONE,
@@ -1659,7 +3177,9 @@ int agm_session_start(uint64_t handle) {
     g_assert(ses_data->proxy != NULL);
     AGM_LOGD("%s\n", __func__);
 
-    result = g_dbus_proxy_call_sync(ses_data->proxy,
+    ring_sync(ses_data);
+
+    result = client_proxy_call_sync(ses_data->proxy,
                                     "AgmSessionStart",
                                     NULL,
                                     G_DBUS_CALL_FLAGS_NONE,
@@ -1675,7 +3195,8 @@ int agm_session_start(uint64_t handle) {
     }
 
     g_variant_unref(result);
-    return 0;
+    /* what the session was set up with may have failed on the way */
+    return async_take_error(ses_data->session_id);
 }
 
 int agm_session_prepare(uint64_t handle) {
@@ -1687,7 +3208,9 @@ int agm_session_prepare(uint64_t handle) {
     g_assert(ses_data->proxy != NULL);
     AGM_LOGD("%s\n", __func__);
 
-    result = g_dbus_proxy_call_sync(ses_data->proxy,
+    ring_sync(ses_data);
+
+    result = client_proxy_call_sync(ses_data->proxy,
                                     "AgmSessionPrepare",
                                     NULL,
                                     G_DBUS_CALL_FLAGS_NONE,
@@ -1703,34 +3226,54 @@ int agm_session_prepare(uint64_t handle) {
     }
 
     g_variant_unref(result);
-    return 0;
+    /* what the session was set up with may have failed on the way */
+    return async_take_error(ses_data->session_id);
 }
 
-int agm_session_close(uint64_t handle) {
-    agm_client_session_data *ses_data = (agm_client_session_data *) handle;
-    GVariant *result = NULL;
+/* session data for a session the service opened at obj_path */
+static agm_client_session_data *session_data_get(uint32_t session_id,
+                                                 const char *obj_path) {
+    agm_client_session_data *ses_data = NULL;
     GError *error = NULL;
-    int rc = 0;
-
-    g_assert(ses_data != NULL);
-    g_assert(ses_data->proxy != NULL);
-    AGM_LOGD("%s\n", __func__);
-
-    result = g_dbus_proxy_call_sync(ses_data->proxy,
-                                    "AgmSessionClose",
-                                    NULL,
-                                    G_DBUS_CALL_FLAGS_NONE,
-                                    -1,
-                                    NULL,
-                                    &error);
 
-    if (result == NULL) {
-        AGM_LOGE("%s: Error invoking AgmSessionClose: %s\n", __func__,
+    if ((ses_data = (agm_client_session_data *)g_hash_table_lookup(
+                                        mdata->ses_hash_table,
+                                        GINT_TO_POINTER(session_id))) != NULL)
+        return ses_data;
+
+    ses_data = (agm_client_session_data *)
+                                g_malloc0(sizeof(agm_client_session_data));
+
+    ses_data->obj_path = g_strdup(obj_path);
+    ses_data->conn = mdata->conn;
+    ses_data->proxy = g_dbus_proxy_new_sync(ses_data->conn,
+                            G_DBUS_PROXY_FLAGS_NONE,
+                            NULL,
+                            AGM_DBUS_CONNECTION,
+                            ses_data->obj_path,
+                            AGM_SESSION_IFACE,
+                            NULL,
+                            &error);
+
+    if (ses_data->proxy == NULL) {
+        AGM_LOGE("%s: Error in getting dbus proxy: %s", __func__,
                   error->message);
         g_error_free(error);
-        return -EINVAL;
+        g_free(ses_data->obj_path);
+        g_free(ses_data);
+        return NULL;
     }
 
+    ses_data->session_id = session_id;
+    /* add session to sessions hash table */
+    g_hash_table_insert(mdata->ses_hash_table,
+                        GINT_TO_POINTER(ses_data->session_id),
+                        ses_data);
+    return ses_data;
+}
+
+/* the service closed the session, drop what the client kept for it */
+static void session_data_free(agm_client_session_data *ses_data) {
     free_callbacks(ses_data);
 
     if (ses_data->thread_loop) {
@@ -1740,24 +3283,68 @@ int agm_session_close(uint64_t handle) {
         ses_data->thread_loop = NULL;
     }
 
+    ring_release(ses_data);
     g_hash_table_remove(mdata->ses_hash_table,
                         GINT_TO_POINTER(ses_data->session_id));
+    g_object_unref(ses_data->proxy);
+    ses_data->proxy = NULL;
     g_free(ses_data->obj_path);
     g_free(ses_data);
+}
 
+/* AgmSessionClose or AgmSessionCloseAsync, both drop the session here */
+static int session_close_call(uint64_t handle, const char *method) {
+    agm_client_session_data *ses_data = (agm_client_session_data *) handle;
+    GVariant *result = NULL;
+    GError *error = NULL;
+    int rc = 0;
 
-    g_object_unref(ses_data->proxy);
-    ses_data->proxy = NULL;
+    g_assert(ses_data != NULL);
+    g_assert(ses_data->proxy != NULL);
+    AGM_LOGD("%s: %s\n", __func__, method);
+
+    ring_sync(ses_data);
+
+    result = client_proxy_call_sync(ses_data->proxy,
+                                    method,
+                                    NULL,
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &error);
+
+    if (result == NULL) {
+        AGM_LOGE("%s: Error invoking %s: %s\n", __func__, method,
+                  error->message);
+        g_error_free(error);
+        return -EINVAL;
+    }
+
+    rc = async_take_error(ses_data->session_id);
+    if (rc)
+        AGM_LOGI("%s: session %u closed with a failed pipelined call %d\n",
+                 __func__, ses_data->session_id, rc);
+
+    session_data_free(ses_data);
     g_variant_unref(result);
     return 0;
 }
 
+int agm_session_close(uint64_t handle) {
+    return session_close_call(handle, "AgmSessionClose");
+}
+
+int agm_session_close_async(uint64_t handle) {
+    return session_close_call(handle, "AgmSessionCloseAsync");
+}
+
 int agm_session_open(uint32_t session_id, uint64_t *handle) {
     GVariant *argument = NULL;
     GVariant *result = NULL;
     GError *error = NULL;
     int rc = 0;
     agm_client_session_data *ses_data = NULL;
+    const char *obj_path = NULL;
 
     g_assert(handle != NULL);
     AGM_LOGD("%s\n", __func__);
@@ -1769,7 +3356,7 @@ int agm_session_open(uint32_t session_id, uint64_t *handle) {
 
     argument = g_variant_new("(@u)", g_variant_new_uint32(session_id));
 
-    result = g_dbus_proxy_call_sync(mdata->proxy,
+    result = client_proxy_call_sync(mdata->proxy,
                                     "AgmSessionOpen",
                                     argument,
                                     G_DBUS_CALL_FLAGS_NONE,
@@ -1785,48 +3372,238 @@ int agm_session_open(uint32_t session_id, uint64_t *handle) {
         goto exit;
     }
 
-    if ((ses_data = (agm_client_session_data *)g_hash_table_lookup(
-                                        mdata->ses_hash_table,
-                                        GINT_TO_POINTER(session_id))) == NULL) {
-        ses_data = (agm_client_session_data *)
-                                    g_malloc0(sizeof(agm_client_session_data));
+    g_variant_get(result, "(&o)", &obj_path);
+    ses_data = session_data_get(session_id, obj_path);
+    g_variant_unref(result);
+    if (ses_data == NULL)
+        return -EINVAL;
 
-        g_variant_get(result, "(o)", &ses_data->obj_path);
-        ses_data->conn = mdata->conn;
-        *handle = (uint64_t)ses_data;
+    *handle = (uint64_t)ses_data;
 
-        ses_data->proxy = g_dbus_proxy_new_sync(ses_data->conn,
-                                G_DBUS_PROXY_FLAGS_NONE,
-                                NULL,
-                                AGM_DBUS_CONNECTION,
-                                ses_data->obj_path,
-                                AGM_SESSION_IFACE,
-                                NULL,
-                                &error);
+exit:
+    return rc;
+}
 
-        if (ses_data->proxy == NULL) {
-            AGM_LOGE("%s: Error in getting dbus proxy: %s", __func__,
-                      error->message);
-            rc = -EINVAL;
-            g_error_free(error);
-            goto exit;
+/* reverts a step of session_run_ops_each the way agm_session_run_ops does */
+static void session_op_undo(uint32_t session_id, uint64_t *hndl,
+                            struct agm_session_op *op) {
+    static uint8_t empty;
+    int ret = 0;
+
+    switch (op->type) {
+    case AGM_SESSION_OP_OPEN:
+        if (*hndl) {
+            ret = agm_session_close(*hndl);
+            if (!ret)
+                *hndl = 0;
         }
+        break;
+    case AGM_SESSION_OP_SET_METADATA:
+        ret = agm_session_set_metadata(session_id, 0, &empty);
+        break;
+    case AGM_SESSION_OP_AIF_SET_METADATA:
+        ret = agm_session_aif_set_metadata(session_id, op->aif_id, 0, &empty);
+        break;
+    case AGM_SESSION_OP_AIF_CONNECT:
+        ret = agm_session_aif_connect(session_id, op->aif_id, !op->state);
+        break;
+    case AGM_SESSION_OP_SET_PARAMS:
+        ret = agm_session_set_params(session_id, &empty, 0);
+        break;
+    case AGM_SESSION_OP_START:
+        if (*hndl)
+            ret = agm_session_stop(*hndl);
+        break;
+    default:
+        break;
+    }
+
+    if (ret)
+        AGM_LOGE("%s: Error %d undoing op %d of session %d\n", __func__,
+                 ret, op->type, session_id);
+}
 
-        ses_data->session_id = session_id;
-        /* add session to sessions hash table */
-        g_hash_table_insert(mdata->ses_hash_table,
-                            GINT_TO_POINTER(ses_data->session_id),
-                            ses_data);
-        g_variant_unref(result);
-        return rc;
-    } else {
-        *handle = (uint64_t)ses_data;
-        return rc;
+/* one step at a time, for a service without AgmSessionRunOps */
+static int session_run_ops_each(uint32_t session_id, uint64_t *hndl,
+                                struct agm_session_op *ops, uint32_t num_ops) {
+    struct agm_session_op *op = NULL;
+    uint32_t i;
+    int ret = 0;
+
+    for (i = 0; i < num_ops && !ret; i++) {
+        op = &ops[i];
+
+        switch (op->type) {
+        case AGM_SESSION_OP_OPEN:
+            ret = agm_session_open(session_id, hndl);
+            break;
+        case AGM_SESSION_OP_SET_METADATA:
+            ret = agm_session_set_metadata(session_id, op->size,
+                                           (uint8_t *)op->payload);
+            break;
+        case AGM_SESSION_OP_AIF_SET_METADATA:
+            ret = agm_session_aif_set_metadata(session_id, op->aif_id,
+                                               op->size,
+                                               (uint8_t *)op->payload);
+            break;
+        case AGM_SESSION_OP_AIF_CONNECT:
+            ret = agm_session_aif_connect(session_id, op->aif_id, op->state);
+            break;
+        case AGM_SESSION_OP_SET_PARAMS:
+            ret = agm_session_set_params(session_id, op->payload, op->size);
+            break;
+        case AGM_SESSION_OP_SET_CONFIG:
+            ret = agm_session_set_config(*hndl, op->session_config,
+                                         op->media_config,
+                                         op->buffer_config);
+            break;
+        case AGM_SESSION_OP_PREPARE:
+            ret = agm_session_prepare(*hndl);
+            break;
+        case AGM_SESSION_OP_START:
+            ret = agm_session_start(*hndl);
+            break;
+        case AGM_SESSION_OP_STOP:
+            ret = agm_session_stop(*hndl);
+            break;
+        case AGM_SESSION_OP_CLOSE:
+            ret = agm_session_close(*hndl);
+            if (!ret)
+                *hndl = 0;
+            break;
+        default:
+            ret = -EINVAL;
+            break;
+        }
+        op->status = ret;
     }
 
-exit:
+    /* i is one past the failed step, undo the ones before it */
+    if (ret) {
+        for (i = i - 1; i > 0; i--)
+            session_op_undo(session_id, hndl, &ops[i - 1]);
+    }
+
+    return ret;
+}
+
+int agm_session_run_ops(uint32_t session_id, uint64_t *hndl,
+                        struct agm_session_op *ops, uint32_t num_ops) {
+    agm_client_session_data *ses_data = NULL;
+    GVariantBuilder builder;
+    GVariantIter *status_iter = NULL;
+    GVariant *result = NULL, *argument = NULL, *payload = NULL;
+    GError *error = NULL;
+    struct agm_session_op *op;
+    const char *obj_path = NULL;
+    gboolean is_open = FALSE;
+    gint32 status;
+    uint8_t *cfg = NULL;
+    size_t cfg_size = sizeof(struct agm_media_config) +
+                      sizeof(struct agm_buffer_config) +
+                      sizeof(struct agm_session_config);
+    uint32_t i;
+    int rc = 0;
+
+    g_assert(hndl != NULL);
+    g_assert(ops != NULL || num_ops == 0);
+    AGM_LOGD("%s\n", __func__);
+
+    if (mdata == NULL) {
+        if ((rc = initialize_module_data()) != 0)
+            return rc;
+    }
+
+    for (i = 0; i < num_ops; i++)
+        ops[i].status = -ECANCELED;
+
+    if (mdata->run_ops_unsupported)
+        return session_run_ops_each(session_id, hndl, ops, num_ops);
+
+    ses_data = (agm_client_session_data *)*hndl;
     if (ses_data != NULL)
-        g_free(ses_data);
+        ring_sync(ses_data);
+
+    cfg = (uint8_t *)g_malloc0(cfg_size);
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(uuubay)"));
+    for (i = 0; i < num_ops; i++) {
+        op = &ops[i];
+        if (op->type == AGM_SESSION_OP_SET_CONFIG) {
+            g_assert(op->media_config != NULL);
+            g_assert(op->buffer_config != NULL);
+            g_assert(op->session_config != NULL);
+            memcpy(cfg, op->media_config, sizeof(struct agm_media_config));
+            memcpy(cfg + sizeof(struct agm_media_config), op->buffer_config,
+                   sizeof(struct agm_buffer_config));
+            memcpy(cfg + sizeof(struct agm_media_config) +
+                   sizeof(struct agm_buffer_config), op->session_config,
+                   sizeof(struct agm_session_config));
+            payload = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+                                                (gconstpointer)cfg,
+                                                cfg_size,
+                                                sizeof(guchar));
+        } else {
+            payload = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+                                                (gconstpointer)op->payload,
+                                                op->payload ? op->size : 0,
+                                                sizeof(guchar));
+        }
+        g_variant_builder_add(&builder, "(uuub@ay)",
+                              (guint32)op->type,
+                              (guint32)op->sess_mode,
+                              (guint32)op->aif_id,
+                              (gboolean)op->state,
+                              payload);
+    }
+    argument = g_variant_new("(ua(uuubay))", session_id, &builder);
+    g_free(cfg);
+
+    result = client_proxy_call_sync(mdata->proxy,
+                                    "AgmSessionRunOps",
+                                    argument,
+                                    G_DBUS_CALL_FLAGS_NONE,
+                                    -1,
+                                    NULL,
+                                    &error);
+
+    if (result == NULL) {
+        if (g_error_matches(error, G_DBUS_ERROR,
+                            G_DBUS_ERROR_UNKNOWN_METHOD)) {
+            AGM_LOGI("%s: no AgmSessionRunOps in service\n", __func__);
+            mdata->run_ops_unsupported = true;
+            g_error_free(error);
+            return session_run_ops_each(session_id, hndl, ops, num_ops);
+        }
+        AGM_LOGE("%s: Error invoking AgmSessionRunOps: %s\n", __func__,
+                  error->message);
+        g_error_free(error);
+        return -EINVAL;
+    }
+
+    g_variant_get(result, "(&obai)", &obj_path, &is_open, &status_iter);
+    for (i = 0; i < num_ops && g_variant_iter_next(status_iter, "i", &status);
+         i++) {
+        ops[i].status = status;
+        if (status && !rc)
+            rc = status;
+    }
+    g_variant_iter_free(status_iter);
+
+    if (is_open && ses_data == NULL) {
+        ses_data = session_data_get(session_id, obj_path);
+        if (ses_data == NULL) {
+            AGM_LOGE("%s: session %d open in service without proxy\n",
+                     __func__, session_id);
+            if (!rc)
+                rc = -EINVAL;
+        }
+    } else if (!is_open && ses_data != NULL) {
+        session_data_free(ses_data);
+        ses_data = NULL;
+    }
+
+    *hndl = (uint64_t)ses_data;
+    g_variant_unref(result);
     return rc;
 }
 
@@ -1849,5 +3626,39 @@ exit:
     return rc;
 }
 
+int agm_client_set_async(bool enable, agm_client_async_cb cb,
+                         void *cookie) {
+    int rc = 0;
+
+    if (mdata == NULL) {
+        if ((rc = initialize_module_data()) != 0)
+            return rc;
+    }
+
+    if (enable && mdata->async_filter_id == 0) {
+        mdata->async_filter_id = g_dbus_connection_add_filter(mdata->conn,
+                                                    async_filter, NULL, NULL);
+        g_signal_connect(mdata->conn, "closed", G_CALLBACK(async_closed),
+                         NULL);
+    }
+
+    g_mutex_lock(&mdata->async_lock);
+    mdata->async = enable;
+    mdata->async_cb = cb;
+    mdata->async_cookie = cookie;
+    g_mutex_unlock(&mdata->async_lock);
+
+    if (!enable)
+        rc = agm_client_sync();
+    return rc;
+}
+
+int agm_client_sync(void) {
+    if (mdata == NULL)
+        return 0;
+
+    return async_take_error(AGM_CLIENT_ASYNC_ALL);
+}
+
 int agm_deinit() {
 }
@@ -0,0 +1,134 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Large control payloads passed as memfds instead of "ay" arguments.
+ *
+ * Payloads of AGM_DBUS_BLOB_FD_MIN bytes or more (calibration, params,
+ * metadata) and all tag module info results travel as a memfd next to a
+ * size argument. The sender seals the memfd before handing it over:
+ *   in      write, shrink and grow sealed; the receiver maps it private,
+ *           so nothing it parses can change underneath it
+ *   in_out  shrink and grow sealed; the receiver maps it shared, works on
+ *           a private copy since the sender can still write to it, and
+ *           copies its result back (get_params)
+ * A receiver refuses an fd without the seals it relies on.
+ */
+
+#ifndef __AGM_DBUS_BLOB_H__
+#define __AGM_DBUS_BLOB_H__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define AGM_DBUS_BLOB_FD_MIN    (16 * 1024)
+#define AGM_DBUS_BLOB_MAX       (64 * 1024 * 1024)
+
+#define AGM_DBUS_BLOB_SEALS_IN_OUT  (F_SEAL_SHRINK | F_SEAL_GROW)
+#define AGM_DBUS_BLOB_SEALS_IN      (AGM_DBUS_BLOB_SEALS_IN_OUT | F_SEAL_WRITE)
+
+/* returns a memfd of size bytes mapped shared at *addr, or -errno */
+static inline int agm_dbus_blob_alloc(size_t size, void **addr)
+{
+    int fd, ret;
+
+    if (size == 0 || size > AGM_DBUS_BLOB_MAX)
+        return -EINVAL;
+
+    fd = memfd_create("agm_dbus_blob", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+        return -errno;
+
+    if (ftruncate(fd, size)) {
+        ret = -errno;
+        close(fd);
+        return ret;
+    }
+
+    *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (*addr == MAP_FAILED) {
+        ret = -errno;
+        close(fd);
+        return ret;
+    }
+
+    return fd;
+}
+
+/*
+ * Seal a filled blob for handing over. An in blob must not be mapped
+ * writable any more, F_SEAL_WRITE fails while it is.
+ */
+static inline int agm_dbus_blob_seal(int fd, bool in_out)
+{
+    if (fcntl(fd, F_ADD_SEALS, (in_out ? AGM_DBUS_BLOB_SEALS_IN_OUT :
+                                         AGM_DBUS_BLOB_SEALS_IN) |
+                               F_SEAL_SEAL))
+        return -errno;
+
+    return 0;
+}
+
+static inline int agm_dbus_blob_create(const void *data, size_t size,
+                                       bool in_out)
+{
+    void *addr;
+    int fd, ret;
+
+    fd = agm_dbus_blob_alloc(size, &addr);
+    if (fd < 0)
+        return fd;
+
+    memcpy(addr, data, size);
+    munmap(addr, size);
+    ret = agm_dbus_blob_seal(fd, in_out);
+    if (ret) {
+        close(fd);
+        return ret;
+    }
+
+    return fd;
+}
+
+/*
+ * Map size bytes of a blob received from the peer; NULL if the fd is too
+ * small or lacks the seals.
+ */
+static inline void *agm_dbus_blob_map(int fd, size_t size, bool in_out)
+{
+    int want = in_out ? AGM_DBUS_BLOB_SEALS_IN_OUT : AGM_DBUS_BLOB_SEALS_IN;
+    struct stat st;
+    void *addr;
+    int seals;
+
+    if (size == 0 || size > AGM_DBUS_BLOB_MAX)
+        return NULL;
+
+    seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || (seals & want) != want)
+        return NULL;
+
+    if (fstat(fd, &st) || (size_t)st.st_size < size)
+        return NULL;
+
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                in_out ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+
+    return addr == MAP_FAILED ? NULL : addr;
+}
+
+static inline void agm_dbus_blob_unmap(void *addr, size_t size)
+{
+    if (addr)
+        munmap(addr, size);
+}
+
+#endif /* __AGM_DBUS_BLOB_H__ */
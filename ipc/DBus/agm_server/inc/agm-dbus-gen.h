@@ -0,0 +1,152 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Generation page published by the agm dbus server.
+ *
+ * The client caches what the service hands out that does not change per
+ * call: the aif list, which is fixed for the life of the service, and tag
+ * module info, which only changes when ACDB data or metadata is written.
+ * The server keeps agm_get_data_generation() in a memfd page and gives
+ * clients a read-only fd to it with AgmGetGenerationFd. A cached result is
+ * good while the generation it was fetched under is still the current one
+ * and the service process that published the page is still alive, which
+ * the client watches with a pidfd. Neither check goes over the bus.
+ */
+
+#ifndef __AGM_DBUS_GEN_H__
+#define __AGM_DBUS_GEN_H__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define AGM_DBUS_GEN_MAGIC      0x4e454741 /* "AGEN" */
+#define AGM_DBUS_GEN_PAGE_SIZE  4096
+
+struct agm_dbus_gen_page {
+    uint32_t magic;
+    uint32_t pid;           /* of the service */
+    uint64_t generation;
+};
+
+/* server: returns the memfd, the page stays mapped writable at *page */
+static inline int agm_dbus_gen_create(struct agm_dbus_gen_page **page)
+{
+    void *addr;
+    int fd, ret;
+
+    fd = memfd_create("agm_dbus_gen", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+        return -errno;
+
+    if (ftruncate(fd, AGM_DBUS_GEN_PAGE_SIZE)) {
+        ret = -errno;
+        goto err;
+    }
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+    addr = mmap(NULL, AGM_DBUS_GEN_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        ret = -errno;
+        goto err;
+    }
+
+    *page = (struct agm_dbus_gen_page *)addr;
+    (*page)->pid = getpid();
+    (*page)->magic = AGM_DBUS_GEN_MAGIC;
+    return fd;
+
+err:
+    close(fd);
+    return ret;
+}
+
+/* server: a read-only fd to the page, so no client can write to it */
+static inline int agm_dbus_gen_ro_fd(int fd)
+{
+    char path[64];
+    int ro_fd;
+
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    ro_fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    return ro_fd < 0 ? -errno : ro_fd;
+}
+
+static inline void agm_dbus_gen_publish(struct agm_dbus_gen_page *page,
+                                        uint64_t generation)
+{
+    __atomic_store_n(&page->generation, generation, __ATOMIC_RELEASE);
+}
+
+/* client: map the page the server sent, the fd can be closed afterwards */
+static inline struct agm_dbus_gen_page *agm_dbus_gen_attach(int fd)
+{
+    struct agm_dbus_gen_page *page;
+    struct stat st;
+    void *addr;
+
+    if (fstat(fd, &st) || st.st_size < AGM_DBUS_GEN_PAGE_SIZE)
+        return NULL;
+
+    addr = mmap(NULL, AGM_DBUS_GEN_PAGE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+        return NULL;
+
+    page = (struct agm_dbus_gen_page *)addr;
+    if (page->magic != AGM_DBUS_GEN_MAGIC || page->pid == 0) {
+        munmap(addr, AGM_DBUS_GEN_PAGE_SIZE);
+        return NULL;
+    }
+
+    return page;
+}
+
+static inline void agm_dbus_gen_detach(struct agm_dbus_gen_page *page)
+{
+    if (page)
+        munmap(page, AGM_DBUS_GEN_PAGE_SIZE);
+}
+
+static inline uint64_t agm_dbus_gen_load(const struct agm_dbus_gen_page *page)
+{
+    return __atomic_load_n(&page->generation, __ATOMIC_ACQUIRE);
+}
+
+/* client: pidfd of the service that published page, or -errno */
+static inline int agm_dbus_gen_watch(const struct agm_dbus_gen_page *page)
+{
+#ifdef SYS_pidfd_open
+    int fd = syscall(SYS_pidfd_open, page->pid, 0);
+
+    return fd < 0 ? -errno : fd;
+#else
+    return -ENOSYS;
+#endif
+}
+
+/* a pidfd turns readable once the process has exited */
+static inline bool agm_dbus_gen_alive(int pidfd)
+{
+    struct pollfd pfd;
+
+    pfd.fd = pidfd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    return poll(&pfd, 1, 0) == 0;
+}
+
+#endif /* __AGM_DBUS_GEN_H__ */
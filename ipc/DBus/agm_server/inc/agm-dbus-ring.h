@@ -0,0 +1,321 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Shared memory data path between the agm dbus client and server.
+ *
+ * A session that reads or writes sets up one single producer, single
+ * consumer byte ring in a sealed memfd and hands it to the server with
+ * AgmSessionMapRing together with two eventfds: "kick" is signalled by the
+ * client when there is work for the server, "notify" by the server when it
+ * moved data. PCM then never goes over the bus.
+ *
+ * Playback: the client produces, the server consumes straight from the
+ * ring into agm_session_write().
+ * Capture: the client raises "want" by the bytes it is short of, the
+ * server agm_session_read()s into the ring until head reaches it.
+ *
+ * head and tail are free running byte counts, each written by one side
+ * only. An error from agm on the server side is left in "error" and
+ * returned by the client's next call. Both sides treat the other's
+ * indices as untrusted and only ever look at the size they mapped.
+ */
+
+#ifndef __AGM_DBUS_RING_H__
+#define __AGM_DBUS_RING_H__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define AGM_DBUS_RING_MAGIC     0x474e4952 /* "RING" */
+#define AGM_DBUS_RING_HDR_SIZE  256
+#define AGM_DBUS_RING_MIN_SIZE  (16 * 1024)
+#define AGM_DBUS_RING_MAX_SIZE  (4 * 1024 * 1024)
+
+enum agm_dbus_ring_dir {
+    AGM_DBUS_RING_PLAYBACK,
+    AGM_DBUS_RING_CAPTURE,
+};
+
+struct agm_dbus_ring_hdr {
+    uint32_t magic;
+    uint32_t size;          /* data bytes, power of two */
+    int32_t error;          /* sticky, set by the server */
+    uint32_t dir;
+    /* producer and consumer on their own cache lines */
+    uint64_t head __attribute__((aligned(64)));
+    uint64_t want __attribute__((aligned(64)));
+    uint64_t tail __attribute__((aligned(64)));
+};
+
+struct agm_dbus_ring {
+    struct agm_dbus_ring_hdr *hdr;
+    uint8_t *data;
+    uint32_t size;          /* as validated at map time */
+    size_t map_size;
+};
+
+static inline uint64_t agm_dbus_ring_load(const uint64_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void agm_dbus_ring_store(uint64_t *p, uint64_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static inline int agm_dbus_ring_mmap(struct agm_dbus_ring *r, int fd,
+                                     size_t map_size)
+{
+    void *addr;
+
+    addr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+        return -errno;
+
+    r->hdr = (struct agm_dbus_ring_hdr *)addr;
+    r->data = (uint8_t *)addr + AGM_DBUS_RING_HDR_SIZE;
+    r->map_size = map_size;
+    return 0;
+}
+
+/* size is rounded up to a power of two; returns the memfd or -errno */
+static inline int agm_dbus_ring_create(struct agm_dbus_ring *r, uint32_t size,
+                                       uint32_t dir)
+{
+    uint32_t ring_size = AGM_DBUS_RING_MIN_SIZE;
+    int fd, ret;
+
+    while (ring_size < size && ring_size < AGM_DBUS_RING_MAX_SIZE)
+        ring_size <<= 1;
+
+    fd = memfd_create("agm_dbus_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+        return -errno;
+
+    if (ftruncate(fd, AGM_DBUS_RING_HDR_SIZE + ring_size)) {
+        ret = -errno;
+        goto err;
+    }
+    /* the server may rely on the size it saw, attach insists on it */
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) {
+        ret = -errno;
+        goto err;
+    }
+
+    ret = agm_dbus_ring_mmap(r, fd, AGM_DBUS_RING_HDR_SIZE + ring_size);
+    if (ret)
+        goto err;
+
+    memset(r->hdr, 0, sizeof(*r->hdr));
+    r->hdr->size = ring_size;
+    r->hdr->dir = dir;
+    r->hdr->magic = AGM_DBUS_RING_MAGIC;
+    r->size = ring_size;
+    return fd;
+
+err:
+    close(fd);
+    return ret;
+}
+
+/*
+ * Map a ring created by the peer, the fd can be closed afterwards. The size
+ * must be sealed, or the peer could shrink the file under the mapping and
+ * fault us on the next access.
+ */
+static inline int agm_dbus_ring_attach(struct agm_dbus_ring *r, int fd)
+{
+    const int want = F_SEAL_SHRINK | F_SEAL_GROW;
+    struct stat st;
+    uint32_t size;
+    int seals, ret;
+
+    seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || (seals & want) != want)
+        return -EPERM;
+
+    if (fstat(fd, &st))
+        return -errno;
+    if (st.st_size <= AGM_DBUS_RING_HDR_SIZE ||
+        st.st_size > AGM_DBUS_RING_HDR_SIZE + AGM_DBUS_RING_MAX_SIZE)
+        return -EINVAL;
+
+    ret = agm_dbus_ring_mmap(r, fd, st.st_size);
+    if (ret)
+        return ret;
+
+    size = r->hdr->size;
+    if (r->hdr->magic != AGM_DBUS_RING_MAGIC || !size ||
+        (size & (size - 1)) ||
+        AGM_DBUS_RING_HDR_SIZE + (size_t)size > r->map_size) {
+        munmap(r->hdr, r->map_size);
+        r->hdr = NULL;
+        return -EINVAL;
+    }
+    r->size = size;
+
+    return 0;
+}
+
+static inline void agm_dbus_ring_release(struct agm_dbus_ring *r)
+{
+    if (r->hdr)
+        munmap(r->hdr, r->map_size);
+    r->hdr = NULL;
+    r->data = NULL;
+}
+
+/*
+ * Contiguous span the producer can fill / the consumer can drain. Returns
+ * -EIO if the peer left the indices in a state no ring can be in.
+ */
+static inline int agm_dbus_ring_write_span(struct agm_dbus_ring *r,
+                                           uint8_t **ptr, uint32_t *len)
+{
+    uint64_t head = r->hdr->head;
+    uint64_t used = head - agm_dbus_ring_load(&r->hdr->tail);
+    uint32_t off = head & (r->size - 1);
+
+    if (used > r->size)
+        return -EIO;
+
+    *ptr = r->data + off;
+    *len = r->size - used;
+    if (*len > r->size - off)
+        *len = r->size - off;
+    return 0;
+}
+
+static inline int agm_dbus_ring_read_span(struct agm_dbus_ring *r,
+                                          uint8_t **ptr, uint32_t *len)
+{
+    uint64_t tail = r->hdr->tail;
+    uint64_t used = agm_dbus_ring_load(&r->hdr->head) - tail;
+    uint32_t off = tail & (r->size - 1);
+
+    if (used > r->size)
+        return -EIO;
+
+    *ptr = r->data + off;
+    *len = used;
+    if (*len > r->size - off)
+        *len = r->size - off;
+    return 0;
+}
+
+static inline void agm_dbus_ring_produce(struct agm_dbus_ring *r, uint32_t n)
+{
+    agm_dbus_ring_store(&r->hdr->head, r->hdr->head + n);
+}
+
+static inline void agm_dbus_ring_consume(struct agm_dbus_ring *r, uint32_t n)
+{
+    agm_dbus_ring_store(&r->hdr->tail, r->hdr->tail + n);
+}
+
+/* copy in or out as much as fits, returns bytes moved or -EIO */
+static inline int agm_dbus_ring_write(struct agm_dbus_ring *r,
+                                      const void *buf, uint32_t len)
+{
+    uint32_t done = 0, n;
+    uint8_t *ptr;
+    int ret;
+
+    while (done < len) {
+        ret = agm_dbus_ring_write_span(r, &ptr, &n);
+        if (ret)
+            return ret;
+        if (!n)
+            break;
+        if (n > len - done)
+            n = len - done;
+        memcpy(ptr, (const uint8_t *)buf + done, n);
+        agm_dbus_ring_produce(r, n);
+        done += n;
+    }
+
+    return done;
+}
+
+static inline int agm_dbus_ring_read(struct agm_dbus_ring *r,
+                                     void *buf, uint32_t len)
+{
+    uint32_t done = 0, n;
+    uint8_t *ptr;
+    int ret;
+
+    while (done < len) {
+        ret = agm_dbus_ring_read_span(r, &ptr, &n);
+        if (ret)
+            return ret;
+        if (!n)
+            break;
+        if (n > len - done)
+            n = len - done;
+        memcpy((uint8_t *)buf + done, ptr, n);
+        agm_dbus_ring_consume(r, n);
+        done += n;
+    }
+
+    return done;
+}
+
+static inline int agm_dbus_ring_error(struct agm_dbus_ring *r)
+{
+    return __atomic_load_n(&r->hdr->error, __ATOMIC_ACQUIRE);
+}
+
+static inline void agm_dbus_ring_set_error(struct agm_dbus_ring *r, int error)
+{
+    __atomic_store_n(&r->hdr->error, error, __ATOMIC_RELEASE);
+}
+
+static inline void agm_dbus_ring_signal(int efd)
+{
+    uint64_t val = 1;
+
+    if (write(efd, &val, sizeof(val)) < 0 && errno != EAGAIN)
+        return;
+}
+
+/*
+ * Wait up to timeout_ms for the peer to signal efd and clear it; returns 0
+ * when signalled, -ETIMEDOUT or another negative errno otherwise.
+ */
+static inline int agm_dbus_ring_wait(int efd, int timeout_ms)
+{
+    struct pollfd pfd;
+    uint64_t val;
+    int ret;
+
+    pfd.fd = efd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    do {
+        ret = poll(&pfd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0)
+        return -errno;
+    if (ret == 0)
+        return -ETIMEDOUT;
+
+    if (read(efd, &val, sizeof(val)) < 0 && errno != EAGAIN)
+        return -errno;
+
+    return 0;
+}
+
+#endif /* __AGM_DBUS_RING_H__ */
@@ -30,6 +30,10 @@
 #include <dbus/dbus.h>
 #include <glib.h>
 #include <gio/gio.h>
+#include <stdint.h>
+
+/* Queue key of calls that belong to no session */
+#define AGM_DBUS_QUEUE_MODULE (-1)
 
 typedef void (*agm_dbus_receive_cb_t)(DBusConnection *conn,
                                       DBusMessage *msg,
@@ -67,9 +71,25 @@ typedef struct {
     DBusTimeout *timeout;
 } agm_dbus_timeout_data;
 
+/* Returns the queue key a method call runs on */
+typedef int64_t (*agm_dbus_route_cb_t)(DBusMessage *msg);
+
+typedef void (*agm_dbus_work_cb_t)(void *data);
+
 typedef struct {
     DBusConnection *conn;
     GHashTable *objects;
+    /* guards objects, method calls are looked up from the workers too */
+    GMutex objects_lock;
+    /* Worker threads, NULL while calls run on the main loop */
+    GThreadPool *pool;
+    /* the module queue's own worker */
+    GThreadPool *module_pool;
+    agm_dbus_route_cb_t route;
+    /* Key -> queue key Value -> agm_dbus_queue, guarded by queue_lock */
+    GHashTable *queues;
+    GMutex queue_lock;
+    gint dispatch_pending;
 } agm_dbus_connection;
 
 /* Creates a new agm_dbus_connection object and returns it */
@@ -101,3 +121,18 @@ void agm_dbus_send_signal(agm_dbus_connection *conn, DBusMessage *msg);
 /* Sets the watch and timeout functions of a DBusConnection to integrate the
    connection. Returns 0 on success */
 int agm_setup_dbus_with_main_loop(agm_dbus_connection *conn);
+
+/* Moves method calls off the main loop onto worker threads. Calls with the
+   same queue key, as returned by route, run one at a time in the order they
+   came in; calls with different keys run in parallel. The module queue has
+   a worker of its own. Replies are sent from the workers. Returns 0 on
+   success */
+int agm_dbus_start_workers(agm_dbus_connection *conn,
+                           agm_dbus_route_cb_t route);
+
+/* Runs func(data) on the queue for key, after the calls queued before it.
+   Without workers it runs right away */
+void agm_dbus_queue_work(agm_dbus_connection *conn,
+                         int64_t key,
+                         agm_dbus_work_cb_t func,
+                         void *data);
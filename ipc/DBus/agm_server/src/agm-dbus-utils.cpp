@@ -50,43 +50,147 @@ typedef struct {
     GHashTable *interfaces; /* Key -> interface name Value -> agm_dbus_interface */
 } agm_dbus_object;
 
+/* One serial queue of work per queue key, see agm_dbus_start_workers() */
+typedef struct {
+    gint64 key;
+    GQueue work;
+    /* the pool this queue runs on */
+    GThreadPool *pool;
+    /* in the pool, or being run by a worker */
+    bool scheduled;
+} agm_dbus_queue;
+
+typedef struct {
+    /* a method call, or func(data) if msg is NULL */
+    DBusMessage *msg;
+    agm_dbus_work_cb_t func;
+    void *data;
+} agm_dbus_work;
+
+/* Finds the handler of a method call, NULL if there is none */
+static bool find_method(agm_dbus_connection *conn,
+                        DBusMessage *message,
+                        agm_dbus_receive_cb_t *cb_func,
+                        void **userdata) {
+    agm_dbus_object *object = NULL;
+    agm_dbus_interface *interface = NULL;
+    agm_dbus_method *method = NULL;
+    const char *dbus_method = dbus_message_get_member(message);
+
+    g_mutex_lock(&conn->objects_lock);
+    if ((object = (agm_dbus_object *)g_hash_table_lookup(conn->objects,
+                                    dbus_message_get_path(message))) != NULL &&
+        (interface = (agm_dbus_interface *)g_hash_table_lookup(
+                 object->interfaces, dbus_message_get_interface(message))) &&
+        interface->methods != NULL && dbus_method != NULL &&
+        (method = (agm_dbus_method *)g_hash_table_lookup(interface->methods,
+                                                         dbus_method))) {
+        *cb_func = method->cb_func;
+        *userdata = interface->userdata;
+    }
+    g_mutex_unlock(&conn->objects_lock);
+
+    return method != NULL;
+}
+
+static void run_work(agm_dbus_connection *conn, agm_dbus_work *work) {
+    agm_dbus_receive_cb_t cb_func;
+    void *userdata;
+
+    if (work->msg == NULL) {
+        work->func(work->data);
+        return;
+    }
+
+    /* Looked up again, the object may have gone while the call was queued */
+    if (find_method(conn, work->msg, &cb_func, &userdata))
+        cb_func(conn->conn, work->msg, userdata);
+    else
+        agm_dbus_send_error(conn, work->msg, DBUS_ERROR_UNKNOWN_OBJECT,
+                            (char *)"Object went away");
+
+    dbus_message_unref(work->msg);
+}
+
+static void agm_dbus_worker(gpointer data, gpointer userdata) {
+    agm_dbus_queue *queue = (agm_dbus_queue *)data;
+    agm_dbus_connection *conn = (agm_dbus_connection *)userdata;
+    agm_dbus_work *work;
+
+    g_mutex_lock(&conn->queue_lock);
+    work = (agm_dbus_work *)g_queue_pop_head(&queue->work);
+    g_mutex_unlock(&conn->queue_lock);
+
+    if (work != NULL) {
+        run_work(conn, work);
+        free(work);
+    }
+
+    /* One item per turn, a busy queue goes to the back of the pool */
+    g_mutex_lock(&conn->queue_lock);
+    if (g_queue_is_empty(&queue->work))
+        queue->scheduled = false;
+    else
+        g_thread_pool_push(queue->pool, queue, NULL);
+    g_mutex_unlock(&conn->queue_lock);
+}
+
+static void queue_work(agm_dbus_connection *conn, gint64 key,
+                       agm_dbus_work *work) {
+    agm_dbus_queue *queue;
+
+    g_mutex_lock(&conn->queue_lock);
+    /* Queues stay around, there is one per session id at most */
+    if ((queue = (agm_dbus_queue *)g_hash_table_lookup(conn->queues,
+                                                       &key)) == NULL) {
+        queue = (agm_dbus_queue *)calloc(1, sizeof(agm_dbus_queue));
+        if (queue == NULL) {
+            g_mutex_unlock(&conn->queue_lock);
+            AGM_LOGE("%s: Couldn't allocate queue\n", __func__);
+            run_work(conn, work);
+            free(work);
+            return;
+        }
+        queue->key = key;
+        queue->pool = key == AGM_DBUS_QUEUE_MODULE ? conn->module_pool :
+                                                     conn->pool;
+        g_queue_init(&queue->work);
+        g_hash_table_insert(conn->queues, &queue->key, queue);
+    }
+
+    g_queue_push_tail(&queue->work, work);
+    if (!queue->scheduled) {
+        queue->scheduled = true;
+        g_thread_pool_push(queue->pool, queue, NULL);
+    }
+    g_mutex_unlock(&conn->queue_lock);
+}
+
 static DBusHandlerResult server_message_handler(DBusConnection *connection,
                                                 DBusMessage *message,
                                                 void *userdata) {
-    DBusHandlerResult result;
-    DBusMessage *reply = NULL;
-    DBusError err;
     agm_dbus_connection *conn = (agm_dbus_connection *)userdata;
-    const char *dbus_obj_path = NULL;
-    const char *dbus_interface = NULL;
-    const char *dbus_method = NULL;
-    agm_dbus_object *object = NULL;
-    agm_dbus_interface *interface = NULL;
-    agm_dbus_method *method = NULL;
+    agm_dbus_receive_cb_t cb_func;
+    agm_dbus_work *work = NULL;
+    void *cb_data;
 
     if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_METHOD_CALL)
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-    dbus_interface = dbus_message_get_interface(message);
-    dbus_method = dbus_message_get_member(message);
-    dbus_obj_path = dbus_message_get_path(message);
-
-    if ((object = (agm_dbus_object *)g_hash_table_lookup
-                                     (conn->objects, dbus_obj_path)) == NULL) {
+    if (!find_method(conn, message, &cb_func, &cb_data))
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-    } else {
-        if ((interface = (agm_dbus_interface *)
-             g_hash_table_lookup(object->interfaces, dbus_interface)) == NULL) {
-            return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-        } else {
-            if ((method = (agm_dbus_method *)
-                g_hash_table_lookup(interface->methods, dbus_method)) == NULL) {
-                return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-            } else {
-                method->cb_func(connection, message, interface->userdata);
-            }
-        }
+
+    if (conn->pool == NULL ||
+        (work = (agm_dbus_work *)calloc(1, sizeof(agm_dbus_work))) == NULL) {
+        cb_func(connection, message, cb_data);
+        return DBUS_HANDLER_RESULT_HANDLED;
     }
+
+    work->msg = dbus_message_ref(message);
+    queue_work(conn,
+               conn->route ? conn->route(message) : AGM_DBUS_QUEUE_MODULE,
+               work);
+    return DBUS_HANDLER_RESULT_HANDLED;
 }
 
 static DBusObjectPathVTable vtable = {
@@ -429,9 +533,9 @@ void agm_free_object(gpointer data) {
     object = NULL;
 }
 
-int agm_dbus_remove_interface(agm_dbus_connection *conn,
-                              const char *dbus_obj_path,
-                              const char *interface_path) {
+static int remove_interface_locked(agm_dbus_connection *conn,
+                                   const char *dbus_obj_path,
+                                   const char *interface_path) {
     agm_dbus_object *object = NULL;
     agm_dbus_interface *interface = NULL;
 
@@ -465,10 +569,10 @@ int agm_dbus_remove_interface(agm_dbus_connection *conn,
     return 0;
 }
 
-int agm_dbus_add_interface(agm_dbus_connection *conn,
-                           const char *dbus_obj_path,
-                           agm_dbus_interface_info *interface_info,
-                           void *userdata) {
+static int add_interface_locked(agm_dbus_connection *conn,
+                                const char *dbus_obj_path,
+                                agm_dbus_interface_info *interface_info,
+                                void *userdata) {
     DBusError err;
     int i = 0;
     agm_dbus_object *object = NULL;
@@ -648,14 +752,144 @@ object_malloc_failed:
     return -EINVAL;
 }
 
+int agm_dbus_remove_interface(agm_dbus_connection *conn,
+                              const char *dbus_obj_path,
+                              const char *interface_path) {
+    int ret;
+
+    if (conn == NULL)
+        return -1;
+
+    g_mutex_lock(&conn->objects_lock);
+    ret = remove_interface_locked(conn, dbus_obj_path, interface_path);
+    g_mutex_unlock(&conn->objects_lock);
+    return ret;
+}
+
+int agm_dbus_add_interface(agm_dbus_connection *conn,
+                           const char *dbus_obj_path,
+                           agm_dbus_interface_info *interface_info,
+                           void *userdata) {
+    int ret;
+
+    if (conn == NULL) {
+        AGM_LOGE("Connection not initialized\n");
+        return -EINVAL;
+    }
+
+    g_mutex_lock(&conn->objects_lock);
+    ret = add_interface_locked(conn, dbus_obj_path, interface_info, userdata);
+    g_mutex_unlock(&conn->objects_lock);
+    return ret;
+}
+
+static void agm_wakeup_main(void *userdata) {
+    g_main_context_wakeup(NULL);
+}
+
+static gboolean agm_dispatch_idle_cb(gpointer userdata) {
+    agm_dbus_connection *conn = (agm_dbus_connection *)userdata;
+
+    g_atomic_int_set(&conn->dispatch_pending, 0);
+    agm_handle_dispatch_status(conn->conn,
+                               dbus_connection_get_dispatch_status(conn->conn),
+                               conn);
+    return FALSE;
+}
+
+/* With workers this can be called on any thread, dispatch on the main loop */
+static void agm_queue_dispatch_status(DBusConnection *dbus_conn,
+                                      DBusDispatchStatus status,
+                                      void *userdata) {
+    agm_dbus_connection *conn = (agm_dbus_connection *)userdata;
+
+    if (status == DBUS_DISPATCH_DATA_REMAINS &&
+        g_atomic_int_compare_and_exchange(&conn->dispatch_pending, 0, 1))
+        g_idle_add(agm_dispatch_idle_cb, conn);
+}
+
+/*
+ * Session queues block in agm_session_read/write and on their rings, so they
+ * get a thread each when busy rather than a share of a fixed pool: each
+ * queue runs one item at a time, which bounds the threads by the sessions.
+ * The module queue is serial too and keeps a thread of its own, so control
+ * calls never wait behind a session's data path.
+ */
+int agm_dbus_start_workers(agm_dbus_connection *conn,
+                           agm_dbus_route_cb_t route) {
+    GError *error = NULL;
+
+    if (conn == NULL || conn->conn == NULL) {
+        AGM_LOGE("%s: Connection not initialized\n", __func__);
+        return -EINVAL;
+    }
+
+    conn->queues = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                         NULL, free);
+    conn->route = route;
+    conn->module_pool = g_thread_pool_new(agm_dbus_worker, conn, 1,
+                                          TRUE, &error);
+    if (conn->module_pool == NULL)
+        goto err;
+
+    conn->pool = g_thread_pool_new(agm_dbus_worker, conn, -1, FALSE, &error);
+    if (conn->pool == NULL) {
+        g_thread_pool_free(conn->module_pool, TRUE, TRUE);
+        conn->module_pool = NULL;
+        goto err;
+    }
+
+    dbus_connection_set_wakeup_main_function(conn->conn, agm_wakeup_main,
+                                             NULL, NULL);
+    dbus_connection_set_dispatch_status_function(conn->conn,
+                                                 agm_queue_dispatch_status,
+                                                 conn,
+                                                 NULL);
+    return 0;
+
+err:
+    AGM_LOGE("%s: Couldn't create workers: %s\n", __func__, error->message);
+    g_error_free(error);
+    g_hash_table_unref(conn->queues);
+    conn->queues = NULL;
+    return -EINVAL;
+}
+
+void agm_dbus_queue_work(agm_dbus_connection *conn,
+                         int64_t key,
+                         agm_dbus_work_cb_t func,
+                         void *data) {
+    agm_dbus_work *work;
+
+    if (conn->pool == NULL ||
+        (work = (agm_dbus_work *)calloc(1, sizeof(agm_dbus_work))) == NULL) {
+        func(data);
+        return;
+    }
+
+    work->func = func;
+    work->data = data;
+    queue_work(conn, key, work);
+}
+
 void agm_dbus_connection_free(agm_dbus_connection *conn) {
     if (conn == NULL) {
         AGM_LOGE("Connection is NULL\n");
         return;
     }
 
+    /* lets queued calls finish */
+    if (conn->pool != NULL)
+        g_thread_pool_free(conn->pool, FALSE, TRUE);
+    if (conn->module_pool != NULL)
+        g_thread_pool_free(conn->module_pool, FALSE, TRUE);
+    if (conn->queues != NULL)
+        g_hash_table_unref(conn->queues);
+
     g_hash_table_remove_all(conn->objects);
     g_hash_table_unref(conn->objects);
+    g_mutex_clear(&conn->objects_lock);
+    g_mutex_clear(&conn->queue_lock);
 
     free(conn);
     conn = NULL;
@@ -672,7 +906,16 @@ agm_dbus_connection *agm_dbus_new_connection() {
         return NULL;
     }
     conn->objects = NULL;
-
+    conn->pool = NULL;
+    conn->module_pool = NULL;
+    conn->route = NULL;
+    conn->queues = NULL;
+    conn->dispatch_pending = 0;
+    g_mutex_init(&conn->objects_lock);
+    g_mutex_init(&conn->queue_lock);
+
+    /* replies are sent from the worker threads */
+    dbus_threads_init_default();
     dbus_error_init(&err);
     conn->conn = dbus_bus_get(DBUS_BUS_SYSTEM, &err);
 
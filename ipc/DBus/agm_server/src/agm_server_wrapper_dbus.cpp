@@ -30,12 +30,16 @@
 #define LOG_TAG "agm_server_wrapper_dbus"
 
 #include <dbus/dbus.h>
+#include <glib-unix.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <sstream>
 #include <agm/agm_api.h>
 #include "agm-dbus-utils.h"
+#include "agm-dbus-blob.h"
+#include "agm-dbus-gen.h"
+#include "agm-dbus-ring.h"
 #include "agm_server_wrapper_dbus.h"
 
 #include "utils.h"
@@ -55,6 +59,9 @@ typedef struct {
     agm_dbus_connection *conn;
     /* Hashmap containing all sessions info */
     GHashTable *sessions;
+    /* Data generation for client caches, see agm-dbus-gen.h */
+    struct agm_dbus_gen_page *gen_page;
+    int gen_fd;
 } agm_module_dbus_data;
 
 /* Session specific data */
@@ -68,15 +75,52 @@ typedef struct {
     /* List which maintains all the callbacks associated with a session id.
        Used to de-register callbacks when client dies abruptly */
     GList *callbacks;
+    /* Shared memory data path, set up by AgmSessionMapRing */
+    struct agm_dbus_ring ring;
+    int kick_fd;
+    int notify_fd;
+    /* one shot kick watch, armed again by ses_ring_kick_work() */
+    GSource *ring_source;
+    /* data path event rate window and drop counts, under events_lock */
+    gint64 event_window_start;
+    uint32_t event_window_count;
+    uint32_t events_rate_dropped;
+    uint32_t events_overflow_dropped;
 } agm_session_data;
 
 typedef struct {
     uint32_t session_id;
     uint32_t event_type;
     uint64_t client_data;
+    /* unique bus name of the registering client, events go only there */
+    char *sender;
+    agm_session_data *ses_data;
+    /* events not sent yet, packed by agmevent_cb(), under events_lock */
+    GByteArray *pending;
+    uint32_t num_pending;
+    uint32_t dropped;
+    bool dirty;
 } agm_callback_data;
 
 static agm_module_dbus_data *mdata = NULL;
+/* mdata->sessions is used from every session's queue */
+static GMutex sessions_lock;
+
+/*
+ * Events are not sent from agm's thread. agmevent_cb() appends them to the
+ * callback's pending buffer and the main loop sends each callback one
+ * AgmEventBatch per cycle, addressed to the client that registered it.
+ */
+#define AGM_EVENT_MAX_PENDING       256
+#define AGM_EVENT_MAX_PENDING_BYTES (64 * 1024)
+#define AGM_EVENT_RATE_ENV          "AGM_DBUS_EVENT_RATE"
+
+static GMutex events_lock;
+/* callbacks with pending events, under events_lock */
+static GPtrArray *events_dirty;
+static guint events_flush_id;
+/* READ_DONE/WRITE_DONE per second and session, 0 for no cap */
+static uint32_t event_rate_cap;
 
 enum AgmModuleMethods {
     AgmAifSetMediaConfig,
@@ -100,6 +144,22 @@ enum AgmModuleMethods {
     AgmSessionGetParams,
     AgmGetBufferTimestamp,
     AgmSessionOpen,
+    AgmSessionSetParamsFd,
+    AgmSessionAifSetParamsFd,
+    AgmSessionAifSetCalFd,
+    AgmSessionGetParamsFd,
+    AgmSessionAifGetTagModuleInfoFd,
+    AgmSessionSetMetadataFd,
+    AgmSessionAifSetMetadataFd,
+    AgmAifSetMetadataFd,
+    AgmSessionRunOps,
+    AgmGetGenerationFd,
+    AgmSessionGetStats,
+    AgmSessionGroupStart,
+    AgmSessionGroupStop,
+    AgmRecoverAll,
+    AgmAifSetParams,
+    AgmAifSetParamsFd,
     AgmDbusModuleMethodMax
 };
 
@@ -116,11 +176,14 @@ enum AgmSessionMethods {
     AgmSessionEos,
     AgmSessionGetTime,
     AgmGetHwProcessedBufCount,
+    AgmSessionMapRing,
+    AgmSessionUpdateStats,
+    AgmSessionCloseAsync,
     AgmDbusSessionMethodMax
 };
 
 enum AgmEventSignals {
-    AgmEventCb,
+    AgmEventBatch,
     AgmSignalMax
 };
 
@@ -181,6 +244,9 @@ static void ipc_agm_session_open(DBusConnection *conn,
 static void ipc_agm_session_close(DBusConnection *conn,
                                   DBusMessage *msg,
                                   void *userdata);
+static void ipc_agm_session_close_async(DBusConnection *conn,
+                                        DBusMessage *msg,
+                                        void *userdata);
 static void ipc_agm_session_prepare(DBusConnection *conn,
                                     DBusMessage *msg,
                                     void *userdata);
@@ -223,6 +289,60 @@ static void ipc_agm_session_register_cb(DBusConnection *conn,
 static void ipc_agm_session_deregister_cb(DBusConnection *conn,
                                           DBusMessage *msg,
                                           void *userdata);
+static void ipc_agm_session_map_ring(DBusConnection *conn,
+                                     DBusMessage *msg,
+                                     void *userdata);
+static void ipc_agm_session_set_params_fd(DBusConnection *conn,
+                                          DBusMessage *msg,
+                                          void *userdata);
+static void ipc_agm_session_aif_set_params_fd(DBusConnection *conn,
+                                              DBusMessage *msg,
+                                              void *userdata);
+static void ipc_agm_session_aif_set_cal_fd(DBusConnection *conn,
+                                           DBusMessage *msg,
+                                           void *userdata);
+static void ipc_agm_session_get_params_fd(DBusConnection *conn,
+                                          DBusMessage *msg,
+                                          void *userdata);
+static void ipc_agm_session_aif_get_tag_module_info_fd(DBusConnection *conn,
+                                                       DBusMessage *msg,
+                                                       void *userdata);
+static void ipc_agm_session_set_metadata_fd(DBusConnection *conn,
+                                            DBusMessage *msg,
+                                            void *userdata);
+static void ipc_agm_session_audio_inf_set_metadata_fd(DBusConnection *conn,
+                                                      DBusMessage *msg,
+                                                      void *userdata);
+static void ipc_agm_audio_intf_set_metadata_fd(DBusConnection *conn,
+                                               DBusMessage *msg,
+                                               void *userdata);
+static void ipc_agm_session_run_ops(DBusConnection *conn,
+                                    DBusMessage *msg,
+                                    void *userdata);
+static void ipc_agm_get_generation_fd(DBusConnection *conn,
+                                      DBusMessage *msg,
+                                      void *userdata);
+static void ipc_agm_session_get_stats(DBusConnection *conn,
+                                      DBusMessage *msg,
+                                      void *userdata);
+static void ipc_agm_session_update_stats(DBusConnection *conn,
+                                         DBusMessage *msg,
+                                         void *userdata);
+static void ipc_agm_session_group_start(DBusConnection *conn,
+                                        DBusMessage *msg,
+                                        void *userdata);
+static void ipc_agm_session_group_stop(DBusConnection *conn,
+                                       DBusMessage *msg,
+                                       void *userdata);
+static void ipc_agm_recover_all(DBusConnection *conn,
+                                DBusMessage *msg,
+                                void *userdata);
+static void ipc_agm_aif_set_params(DBusConnection *conn,
+                                   DBusMessage *msg,
+                                   void *userdata);
+static void ipc_agm_aif_set_params_fd(DBusConnection *conn,
+                                      DBusMessage *msg,
+                                      void *userdata);
 
 static agm_dbus_method agm_dbus_module_methods[AgmDbusModuleMethodMax] = {
     {"AgmAifSetMediaConfig", "u(uui)", ipc_agm_audio_intf_set_media_config},
@@ -249,7 +369,28 @@ static agm_dbus_method agm_dbus_module_methods[AgmDbusModuleMethodMax] = {
     {"AgmSessionAifSetCal", "uuuay", ipc_agm_session_aif_set_cal},
     {"AgmSessionGetParams", "uuay", ipc_agm_session_get_params},
     {"AgmGetBufferTimestamp", "u", ipc_agm_get_buffer_timestamp},
-    {"AgmSessionOpen", "u", ipc_agm_session_open}
+    {"AgmSessionOpen", "u", ipc_agm_session_open},
+    /* same calls with the payload in a sealed memfd, see agm-dbus-blob.h */
+    {"AgmSessionSetParamsFd", "uuh", ipc_agm_session_set_params_fd},
+    {"AgmSessionAifSetParamsFd", "uuuh", ipc_agm_session_aif_set_params_fd},
+    {"AgmSessionAifSetCalFd", "uuuh", ipc_agm_session_aif_set_cal_fd},
+    {"AgmSessionGetParamsFd", "uuh", ipc_agm_session_get_params_fd},
+    {"AgmSessionAifGetTagModuleInfoFd", "uu",
+                                  ipc_agm_session_aif_get_tag_module_info_fd},
+    {"AgmSessionSetMetadataFd", "uuh", ipc_agm_session_set_metadata_fd},
+    {"AgmSessionAifSetMetadataFd", "uuuh",
+                                   ipc_agm_session_audio_inf_set_metadata_fd},
+    {"AgmAifSetMetadataFd", "uuh", ipc_agm_audio_intf_set_metadata_fd},
+    {"AgmSessionRunOps", "ua(uuubay)", ipc_agm_session_run_ops},
+    {"AgmGetGenerationFd", "", ipc_agm_get_generation_fd},
+    {"AgmSessionGetStats", "u", ipc_agm_session_get_stats},
+    /* session ids of the group, whether to measure the start skew */
+    {"AgmSessionGroupStart", "aub", ipc_agm_session_group_start},
+    {"AgmSessionGroupStop", "au", ipc_agm_session_group_stop},
+    /* entries wanted; replies ret, sessions recovered, a(session, status, us) */
+    {"AgmRecoverAll", "u", ipc_agm_recover_all},
+    {"AgmAifSetParams", "uuay", ipc_agm_aif_set_params},
+    {"AgmAifSetParamsFd", "uuh", ipc_agm_aif_set_params_fd}
 };
 
 static agm_dbus_method agm_dbus_session_methods[AgmDbusSessionMethodMax] = {
@@ -264,11 +405,16 @@ static agm_dbus_method agm_dbus_session_methods[AgmDbusSessionMethodMax] = {
     {"AgmSessionSetConfig", "(uuu)(uu)ay", ipc_agm_session_set_config},
     {"AgmSessionEos", "", ipc_agm_session_eos},
     {"AgmSessionGetTime", "", ipc_agm_get_session_time},
-    {"AgmGetHwProcessedBufCount", "u", ipc_agm_get_hw_processed_buff_cnt}
+    {"AgmGetHwProcessedBufCount", "u", ipc_agm_get_hw_processed_buff_cnt},
+    {"AgmSessionMapRing", "uhhh", ipc_agm_session_map_ring},
+    /* underruns, overruns, poll timeouts, max position gap, latency */
+    {"AgmSessionUpdateStats", "uuuuu", ipc_agm_session_update_stats},
+    {"AgmSessionCloseAsync", "", ipc_agm_session_close_async}
 };
 
+/* cookie, event type, events dropped since the last batch, events */
 static agm_dbus_signal event_callback[AgmSignalMax] = {
-    {"AgmEventCb", "uuuay"}
+    {"AgmEventBatch", "tuua(uuay)"}
 };
 
 agm_dbus_interface_info module_interface_info = {
@@ -287,71 +433,243 @@ agm_dbus_interface_info session_interface_info = {
     .signal_count=AgmSignalMax
 };
 
-static DBusHandlerResult disconnection_filter_cb(DBusConnection *conn,
-                                                 DBusMessage *msg,
-                                                 void *userdata) {
-    agm_session_data *ses_data = (agm_session_data *) userdata;
-    GList *node = NULL;
-    agm_callback_data *cb_data = NULL;
+static void publish_generation(void) {
+    if (mdata->gen_page != NULL)
+        agm_dbus_gen_publish(mdata->gen_page, agm_get_data_generation());
+}
 
-    if (conn == NULL) {
-        AGM_LOGE("Connection is NULL");
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+/*
+ * The bytes of the ay argument at arg_i, where they lie in msg. The worker
+ * running the handler holds a reference on msg until the handler returns,
+ * so agm is handed this pointer for the call rather than a copy. The bytes
+ * follow the array's 4 byte length and so are aligned for the uint32_t
+ * fields of agm payloads. Fails when there are fewer than size of them.
+ */
+static int msg_payload(DBusMessageIter *arg_i, uint32_t size,
+                       void **payload) {
+    DBusMessageIter array_i;
+    char *value = NULL;
+    int n_elements = 0;
+
+    dbus_message_iter_recurse(arg_i, &array_i);
+    dbus_message_iter_get_fixed_array(&array_i, &value, &n_elements);
+    if ((uint32_t)n_elements < size) {
+        AGM_LOGE("%s: %d bytes for a payload of %u", __func__, n_elements,
+                 size);
+        return -EINVAL;
     }
 
-    if (msg == NULL) {
-        AGM_LOGE("msg is NULL");
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    *payload = value;
+    return 0;
+}
+
+static agm_session_data *lookup_session_data(uint32_t session_id) {
+    agm_session_data *ses_data;
+
+    g_mutex_lock(&sessions_lock);
+    ses_data = (agm_session_data *)g_hash_table_lookup(mdata->sessions,
+                                                  GUINT_TO_POINTER(session_id));
+    g_mutex_unlock(&sessions_lock);
+    return ses_data;
+}
+
+static void remove_session_data(uint32_t session_id) {
+    g_mutex_lock(&sessions_lock);
+    g_hash_table_remove(mdata->sessions, GUINT_TO_POINTER(session_id));
+    g_mutex_unlock(&sessions_lock);
+}
+
+static void ses_ring_disarm(agm_session_data *ses_data) {
+    if (ses_data->ring_source) {
+        g_source_destroy(ses_data->ring_source);
+        g_source_unref(ses_data->ring_source);
+        ses_data->ring_source = NULL;
     }
+}
 
-    if (userdata == NULL) {
-        AGM_LOGE("Userdata is NULL ");
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+static void ses_ring_release(agm_session_data *ses_data) {
+    ses_ring_disarm(ses_data);
+
+    agm_dbus_ring_release(&ses_data->ring);
+
+    if (ses_data->kick_fd >= 0) {
+        close(ses_data->kick_fd);
+        ses_data->kick_fd = -1;
     }
 
-    if (dbus_message_is_signal(msg,
-                               "org.freedesktop.DBus.Local",
-                               "Disconnected")) {
-        /* connection died close the session for which callback got triggered */
-        AGM_LOGE("connection died for session %d", ses_data->session_id);
-
-        for (node = ses_data->callbacks; node != NULL; node = node->next) {
-            cb_data = (agm_callback_data *)node->data;
-            if (agm_session_register_cb(cb_data->session_id,
-                                        NULL,
-                                        (enum event_type)cb_data->event_type,
-                                        (void *)ses_data) != 0)
-                AGM_LOGE("Deregistering callback failed.");
-            free(node->data);
-            node->data = NULL;
+    if (ses_data->notify_fd >= 0) {
+        close(ses_data->notify_fd);
+        ses_data->notify_fd = -1;
+    }
+}
+
+/* Hand everything the client produced to agm, straight from the ring */
+static void ses_ring_playback(agm_session_data *ses_data) {
+    struct agm_dbus_ring *ring = &ses_data->ring;
+    uint8_t *ptr;
+    uint32_t len;
+    size_t count;
+    int ret;
+
+    for (;;) {
+        ret = agm_dbus_ring_read_span(ring, &ptr, &len);
+        if (ret || len == 0)
+            break;
+
+        count = len;
+        ret = agm_session_write(ses_data->handle, ptr, &count);
+        if (ret || count == 0 || count > len) {
+            AGM_LOGE("agm_session_write failed %d", ret);
+            ret = ret ? ret : -EIO;
+            break;
         }
 
-        g_list_free(ses_data->callbacks);
+        agm_dbus_ring_consume(ring, count);
+        agm_dbus_ring_signal(ses_data->notify_fd);
+    }
 
-        dbus_connection_remove_filter(conn, disconnection_filter_cb, ses_data);
+    if (ret) {
+        agm_dbus_ring_set_error(ring, ret);
+        agm_dbus_ring_signal(ses_data->notify_fd);
+    }
+}
 
-        if (agm_session_close(ses_data->handle) != 0) {
-            AGM_LOGE("agm_session_close failed.");
-            agm_dbus_send_error(mdata->conn,
-                                msg,
-                                DBUS_ERROR_FAILED,
-                                "agm_session_close failed.");
+/* Read from agm into the ring until the client has what it asked for */
+static void ses_ring_capture(agm_session_data *ses_data) {
+    struct agm_dbus_ring *ring = &ses_data->ring;
+    uint64_t want, head;
+    uint8_t *ptr;
+    uint32_t len;
+    size_t count;
+    int ret = 0;
+
+    for (;;) {
+        want = agm_dbus_ring_load(&ring->hdr->want);
+        head = ring->hdr->head;
+        if ((int64_t)(want - head) <= 0)
+            break;
+
+        ret = agm_dbus_ring_write_span(ring, &ptr, &len);
+        if (ret || len == 0)
+            break;
+        if (len > want - head)
+            len = want - head;
+
+        count = len;
+        ret = agm_session_read(ses_data->handle, ptr, &count);
+        if (ret || count == 0 || count > len) {
+            AGM_LOGE("agm_session_read failed %d", ret);
+            ret = ret ? ret : -EIO;
+            break;
         }
 
-        if (agm_dbus_remove_interface(mdata->conn,
-                                      ses_data->dbus_obj_path,
-                                      session_interface_info.name) != 0) {
-            AGM_LOGE("Unable to remove interface");
-            agm_dbus_send_error(mdata->conn,
-                                msg,
-                                DBUS_ERROR_FAILED,
-                                "agm_session_close failed.");
-        }
+        agm_dbus_ring_produce(ring, count);
+        agm_dbus_ring_signal(ses_data->notify_fd);
+    }
+
+    if (ret) {
+        agm_dbus_ring_set_error(ring, ret);
+        agm_dbus_ring_signal(ses_data->notify_fd);
+    }
+}
+
+static void ses_ring_arm(agm_session_data *ses_data);
+
+/*
+ * Serves the ring on the session's queue, in order with the session's calls,
+ * so close or a new ring cannot pull it away underneath.
+ */
+static void ses_ring_kick_work(void *data) {
+    agm_session_data *ses_data = lookup_session_data(GPOINTER_TO_UINT(data));
+    uint64_t val;
+
+    if (ses_data == NULL || ses_data->ring.hdr == NULL)
+        return;
+
+    if (read(ses_data->kick_fd, &val, sizeof(val)) < 0 && errno != EAGAIN)
+        AGM_LOGE("Failed to clear kick for session %d", ses_data->session_id);
+
+    if (ses_data->ring.hdr->dir == AGM_DBUS_RING_CAPTURE)
+        ses_ring_capture(ses_data);
+    else
+        ses_ring_playback(ses_data);
+
+    ses_ring_arm(ses_data);
+}
+
+/* main loop: pass the kick to the session's queue, unwatched until it ran */
+static gboolean ses_ring_kick_cb(gint fd, GIOCondition condition,
+                                 gpointer userdata) {
+    if (condition & (G_IO_HUP | G_IO_ERR))
+        return FALSE;
+
+    agm_dbus_queue_work(mdata->conn, GPOINTER_TO_UINT(userdata),
+                        ses_ring_kick_work, userdata);
+    return FALSE;
+}
+
+static void ses_ring_arm(agm_session_data *ses_data) {
+    ses_ring_disarm(ses_data);
+
+    ses_data->ring_source = g_unix_fd_source_new(ses_data->kick_fd,
+                                 (GIOCondition)(G_IO_IN | G_IO_HUP | G_IO_ERR));
+    g_source_set_callback(ses_data->ring_source, (GSourceFunc)ses_ring_kick_cb,
+                          GUINT_TO_POINTER(ses_data->session_id), NULL);
+    g_source_attach(ses_data->ring_source, NULL);
+}
+
+static DBusHandlerResult disconnection_filter_cb(DBusConnection *conn,
+                                                 DBusMessage *msg,
+                                                 void *userdata);
+static void ses_callbacks_release(agm_session_data *ses_data);
+
+/* connection died, close the session on its own queue */
+static void ses_disconnect_work(void *data) {
+    uint32_t session_id = GPOINTER_TO_UINT(data);
+    agm_session_data *ses_data = lookup_session_data(session_id);
 
-        g_hash_table_remove(mdata->sessions,
-                            GUINT_TO_POINTER(ses_data->session_id));
+    if (ses_data == NULL)
+        return;
+
+    AGM_LOGE("connection died for session %d", session_id);
+
+    ses_callbacks_release(ses_data);
+
+    dbus_connection_remove_filter(mdata->conn->conn, disconnection_filter_cb,
+                                  data);
+    ses_ring_release(ses_data);
+
+    if (agm_session_close(ses_data->handle) != 0)
+        AGM_LOGE("agm_session_close failed.");
+
+    if (agm_dbus_remove_interface(mdata->conn,
+                                  ses_data->dbus_obj_path,
+                                  session_interface_info.name) != 0)
+        AGM_LOGE("Unable to remove interface");
+
+    remove_session_data(session_id);
+}
+
+/* userdata is the session id, the session data belongs to its queue */
+static DBusHandlerResult disconnection_filter_cb(DBusConnection *conn,
+                                                 DBusMessage *msg,
+                                                 void *userdata) {
+    if (conn == NULL) {
+        AGM_LOGE("Connection is NULL");
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
+
+    if (msg == NULL) {
+        AGM_LOGE("msg is NULL");
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     }
 
+    if (dbus_message_is_signal(msg,
+                               "org.freedesktop.DBus.Local",
+                               "Disconnected"))
+        agm_dbus_queue_work(mdata->conn, GPOINTER_TO_UINT(userdata),
+                            ses_disconnect_work, userdata);
+
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
@@ -383,12 +701,14 @@ static agm_session_data * get_session_data(agm_module_dbus_data *mdata,
     if (mdata == NULL)
         return NULL;
 
+    g_mutex_lock(&sessions_lock);
       if ((ses_data = (agm_session_data *)
                         g_hash_table_lookup(mdata->sessions,
                                        GUINT_TO_POINTER(session_id))) == NULL) {
         ses_data = (agm_session_data *)malloc(sizeof(agm_session_data));
         if (ses_data == NULL) {
             AGM_LOGE("ses_data is NULL\n");
+            g_mutex_unlock(&sessions_lock);
             return NULL;
         }
         ses_data->session_id = session_id;
@@ -401,6 +721,7 @@ static agm_session_data * get_session_data(agm_module_dbus_data *mdata,
             AGM_LOGE("dbus_obj_path is NULL\n");
             free(ses_data);
             ses_data = NULL;
+            g_mutex_unlock(&sessions_lock);
             return NULL;
         }
         snprintf(ses_data->dbus_obj_path,
@@ -409,7 +730,16 @@ static agm_session_data * get_session_data(agm_module_dbus_data *mdata,
                  AGM_OBJECT_PATH,
                  "/session_",
                  session_id);
+        ses_data->handle = 0;
         ses_data->callbacks = NULL;
+        memset(&ses_data->ring, 0, sizeof(ses_data->ring));
+        ses_data->kick_fd = -1;
+        ses_data->notify_fd = -1;
+        ses_data->ring_source = NULL;
+        ses_data->event_window_start = 0;
+        ses_data->event_window_count = 0;
+        ses_data->events_rate_dropped = 0;
+        ses_data->events_overflow_dropped = 0;
 
         if (agm_dbus_add_interface(mdata->conn,
                                    ses_data->dbus_obj_path,
@@ -419,6 +749,7 @@ static agm_session_data * get_session_data(agm_module_dbus_data *mdata,
             ses_data->dbus_obj_path = NULL;
             free(ses_data);
             ses_data = NULL;
+            g_mutex_unlock(&sessions_lock);
             return NULL;
         }
 
@@ -426,55 +757,208 @@ static agm_session_data * get_session_data(agm_module_dbus_data *mdata,
                             GUINT_TO_POINTER(session_id),
                             ses_data);
     }
+    g_mutex_unlock(&sessions_lock);
 
     return ses_data;
 }
 
-static void agmevent_cb(uint32_t session_id,
-                        struct agm_event_cb_params *event_params,
-                        void *client_data) {
-    DBusMessage *message = NULL;
-    DBusMessageIter arg_i, array_i;
-    dbus_uint32_t i, j;
-    void *buf = NULL;
-    agm_session_data *ses_data = (agm_session_data *)client_data;
-
-    AGM_LOGE("%s: Received event for session %d", __func__, session_id);
+/* one callback's events, taken off it by events_flush() */
+typedef struct {
+    char *sender;
+    uint32_t session_id;
+    uint32_t event_type;
+    uint64_t client_data;
+    uint32_t dropped;
+    GByteArray *events;
+} agm_event_batch;
 
-    buf = malloc(event_params->event_payload_size);
-    if (buf == NULL) {
-        AGM_LOGE("buf is NULL");
+static void event_batch_send(agm_event_batch *batch) {
+    DBusMessage *message = NULL;
+    DBusMessageIter arg_i, array_i, struct_i, payload_i;
+    char obj_path[64];
+    const uint8_t *payload;
+    uint32_t hdr[3];
+    guint offset = 0;
+
+    snprintf(obj_path, sizeof(obj_path), "%s/session_%d", AGM_OBJECT_PATH,
+             batch->session_id);
+    message = dbus_message_new_signal(obj_path,
+                                      session_interface_info.name,
+                                      event_callback[AgmEventBatch].method_name);
+    if (message == NULL) {
+        AGM_LOGE("Unable to create event batch for session %d",
+                 batch->session_id);
         return;
     }
-    memcpy(buf, event_params->event_payload, event_params->event_payload_size);
 
-    message = dbus_message_new_signal(ses_data->dbus_obj_path,
-                                      session_interface_info.name,
-                                      event_callback[AgmEventCb].method_name);
+    if (batch->sender != NULL)
+        dbus_message_set_destination(message, batch->sender);
 
     dbus_message_iter_init_append(message, &arg_i);
-    dbus_message_iter_append_basic(&arg_i,
-                                   DBUS_TYPE_UINT32,
-                                   &event_params->source_module_id);
-    dbus_message_iter_append_basic(&arg_i,
-                                   DBUS_TYPE_UINT32,
-                                   &event_params->event_id);
-    dbus_message_iter_append_basic(&arg_i,
-                                   DBUS_TYPE_UINT32,
-                                   &event_params->event_payload_size);
-    dbus_message_iter_open_container(&arg_i,
-                                     DBUS_TYPE_ARRAY,
-                                     "y",
+    dbus_message_iter_append_basic(&arg_i, DBUS_TYPE_UINT64,
+                                   &batch->client_data);
+    dbus_message_iter_append_basic(&arg_i, DBUS_TYPE_UINT32,
+                                   &batch->event_type);
+    dbus_message_iter_append_basic(&arg_i, DBUS_TYPE_UINT32, &batch->dropped);
+    dbus_message_iter_open_container(&arg_i, DBUS_TYPE_ARRAY, "(uuay)",
                                      &array_i);
-    dbus_message_iter_append_fixed_array(&array_i,
-                                         DBUS_TYPE_BYTE,
-                                         &buf,
-                                         event_params->event_payload_size);
+    while (batch->events != NULL && offset < batch->events->len) {
+        memcpy(hdr, batch->events->data + offset, sizeof(hdr));
+        payload = batch->events->data + offset + sizeof(hdr);
+        offset += sizeof(hdr) + hdr[2];
+
+        dbus_message_iter_open_container(&array_i, DBUS_TYPE_STRUCT, NULL,
+                                         &struct_i);
+        dbus_message_iter_append_basic(&struct_i, DBUS_TYPE_UINT32, &hdr[0]);
+        dbus_message_iter_append_basic(&struct_i, DBUS_TYPE_UINT32, &hdr[1]);
+        dbus_message_iter_open_container(&struct_i, DBUS_TYPE_ARRAY, "y",
+                                         &payload_i);
+        dbus_message_iter_append_fixed_array(&payload_i, DBUS_TYPE_BYTE,
+                                             &payload, hdr[2]);
+        dbus_message_iter_close_container(&struct_i, &payload_i);
+        dbus_message_iter_close_container(&array_i, &struct_i);
+    }
     dbus_message_iter_close_container(&arg_i, &array_i);
-    agm_dbus_send_signal(mdata->conn, message);
+
+    dbus_connection_send(mdata->conn->conn, message, NULL);
     dbus_message_unref(message);
-    free(buf);
-    buf = NULL;
+}
+
+/* main loop: send what every callback collected since the last cycle */
+static gboolean events_flush(gpointer userdata) {
+    GPtrArray *batches = g_ptr_array_new();
+    agm_callback_data *cb_data = NULL;
+    agm_event_batch *batch = NULL;
+    guint i;
+
+    g_mutex_lock(&events_lock);
+    events_flush_id = 0;
+    for (i = 0; i < events_dirty->len; i++) {
+        cb_data = (agm_callback_data *)g_ptr_array_index(events_dirty, i);
+        batch = g_new0(agm_event_batch, 1);
+        batch->sender = g_strdup(cb_data->sender);
+        batch->session_id = cb_data->session_id;
+        batch->event_type = cb_data->event_type;
+        batch->client_data = cb_data->client_data;
+        batch->dropped = cb_data->dropped;
+        batch->events = cb_data->pending;
+        cb_data->pending = NULL;
+        cb_data->num_pending = 0;
+        cb_data->dropped = 0;
+        cb_data->dirty = false;
+        g_ptr_array_add(batches, batch);
+    }
+    g_ptr_array_set_size(events_dirty, 0);
+    g_mutex_unlock(&events_lock);
+
+    for (i = 0; i < batches->len; i++) {
+        batch = (agm_event_batch *)g_ptr_array_index(batches, i);
+        event_batch_send(batch);
+        if (batch->events != NULL)
+            g_byte_array_unref(batch->events);
+        g_free(batch->sender);
+        g_free(batch);
+    }
+    g_ptr_array_free(batches, TRUE);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* agm's thread: queue the event for the next events_flush() */
+static void agmevent_cb(uint32_t session_id,
+                        struct agm_event_cb_params *event_params,
+                        void *client_data) {
+    agm_callback_data *cb_data = (agm_callback_data *)client_data;
+    agm_session_data *ses_data = cb_data->ses_data;
+    uint32_t size = event_params->event_payload_size;
+    uint32_t hdr[3];
+    gint64 now;
+
+    AGM_LOGV("%s: event %x for session %d", __func__,
+             event_params->event_id, session_id);
+
+    hdr[0] = event_params->source_module_id;
+    hdr[1] = event_params->event_id;
+    hdr[2] = size;
+
+    g_mutex_lock(&events_lock);
+    if (event_rate_cap != 0 && cb_data->event_type == AGM_EVENT_DATA_PATH &&
+        (event_params->event_id == AGM_EVENT_READ_DONE ||
+         event_params->event_id == AGM_EVENT_WRITE_DONE)) {
+        now = g_get_monotonic_time();
+        if (now - ses_data->event_window_start >= G_USEC_PER_SEC) {
+            ses_data->event_window_start = now;
+            ses_data->event_window_count = 0;
+        }
+        if (ses_data->event_window_count >= event_rate_cap) {
+            ses_data->events_rate_dropped++;
+            cb_data->dropped++;
+            goto done;
+        }
+        ses_data->event_window_count++;
+    }
+
+    if (cb_data->num_pending >= AGM_EVENT_MAX_PENDING ||
+        (cb_data->num_pending > 0 &&
+         cb_data->pending->len + sizeof(hdr) + size >
+                                            AGM_EVENT_MAX_PENDING_BYTES)) {
+        ses_data->events_overflow_dropped++;
+        cb_data->dropped++;
+        goto done;
+    }
+
+    if (cb_data->pending == NULL)
+        cb_data->pending = g_byte_array_sized_new(sizeof(hdr) + size);
+    g_byte_array_append(cb_data->pending, (const guint8 *)hdr, sizeof(hdr));
+    g_byte_array_append(cb_data->pending, event_params->event_payload, size);
+    cb_data->num_pending++;
+
+    if (!cb_data->dirty) {
+        cb_data->dirty = true;
+        g_ptr_array_add(events_dirty, cb_data);
+    }
+    if (events_flush_id == 0)
+        events_flush_id = g_idle_add_full(G_PRIORITY_DEFAULT, events_flush,
+                                          NULL, NULL);
+
+done:
+    g_mutex_unlock(&events_lock);
+}
+
+/* Deregisters cb_data from agm and drops whatever it did not send yet */
+static void ses_callback_release(agm_callback_data *cb_data) {
+    if (agm_session_register_cb(cb_data->session_id,
+                                NULL,
+                                (enum event_type)cb_data->event_type,
+                                (void *)cb_data) != 0)
+        AGM_LOGE("Deregistering callback failed.");
+
+    g_mutex_lock(&events_lock);
+    if (cb_data->dirty)
+        g_ptr_array_remove_fast(events_dirty, cb_data);
+    g_mutex_unlock(&events_lock);
+
+    if (cb_data->pending != NULL)
+        g_byte_array_unref(cb_data->pending);
+    g_free(cb_data->sender);
+    free(cb_data);
+}
+
+static void ses_callbacks_release(agm_session_data *ses_data) {
+    GList *node = NULL;
+
+    for (node = ses_data->callbacks; node != NULL; node = node->next) {
+        ses_callback_release((agm_callback_data *)node->data);
+        node->data = NULL;
+    }
+
+    g_list_free(ses_data->callbacks);
+    ses_data->callbacks = NULL;
+
+    if (ses_data->events_rate_dropped || ses_data->events_overflow_dropped)
+        AGM_LOGI("session %d dropped %u events over the rate cap, %u on overflow",
+                 ses_data->session_id, ses_data->events_rate_dropped,
+                 ses_data->events_overflow_dropped);
 }
 
 static void ipc_agm_session_deregister_cb(DBusConnection *conn,
@@ -487,6 +971,7 @@ static void ipc_agm_session_deregister_cb(DBusConnection *conn,
     agm_session_data *ses_data = NULL;
     agm_module_dbus_data *mdata = (agm_module_dbus_data *)userdata;
     uint64_t client_data;
+    const char *sender = dbus_message_get_sender(msg);
     GList *node = NULL;
     agm_callback_data *cb_data = NULL;
 
@@ -518,36 +1003,26 @@ static void ipc_agm_session_deregister_cb(DBusConnection *conn,
     dbus_message_iter_get_basic(&arg_i, &client_data);
 
     ses_data = get_session_data(mdata, session_id);
-
-    if (agm_session_register_cb(session_id, NULL,
-                                (enum event_type)evt_type,
-                                (void *)ses_data) != 0) {
-        AGM_LOGE("agm_session_register_cb failed.");
+    if (ses_data == NULL) {
+        AGM_LOGE("ses_data is NULL");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-            "Failed to de-register callback. agm_session_register_cb failed.");
-        agm_free_session(ses_data);
+                            "ses_data is NULL");
         return;
     }
 
-    cb_data = (agm_callback_data *)malloc(sizeof(agm_callback_data));
-    if (cb_data == NULL) {
-        AGM_LOGE("cb_data is NULL");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                             "cb_data is NULL");
-        agm_free_session(ses_data);
-        return;
+    /* only the client that registered a callback can take it away */
+    for (node = ses_data->callbacks; node != NULL; node = node->next) {
+        cb_data = (agm_callback_data *)node->data;
+        if (cb_data->event_type == evt_type &&
+            cb_data->client_data == client_data &&
+            g_strcmp0(cb_data->sender, sender) == 0)
+            break;
     }
-    cb_data->session_id = session_id;
-    cb_data->event_type = evt_type;
-    cb_data->client_data = client_data;
-    node = g_list_find(ses_data->callbacks, cb_data);
+
     if (node != NULL) {
-        ses_data->callbacks = g_list_remove(ses_data->callbacks, cb_data);
-        free(node->data);
-        node->data = NULL;
+        ses_data->callbacks = g_list_delete_link(ses_data->callbacks, node);
+        ses_callback_release(cb_data);
     }
-    free(cb_data);
-    cb_data = NULL;
 
     reply = dbus_message_new_method_return(msg);
     dbus_message_iter_init_append(reply, &arg_i);
@@ -598,29 +1073,38 @@ static void ipc_agm_session_register_cb(DBusConnection *conn,
     dbus_message_iter_get_basic(&arg_i, &client_data);
 
     ses_data = get_session_data(mdata, session_id);
-
-    if (agm_session_register_cb(session_id,
-                                agmevent_cb,
-                                (enum event_type)evt_type,
-                                (void *)ses_data) != 0) {
-        AGM_LOGE("agm_session_register_cb failed.");
+    if (ses_data == NULL) {
+        AGM_LOGE("ses_data is NULL");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                            "agm_session_register_cb failed.");
-        agm_free_session(ses_data);
+                            "ses_data is NULL");
         return;
     }
 
-    cb_data = (agm_callback_data *)malloc(sizeof(agm_callback_data));
+    cb_data = (agm_callback_data *)calloc(1, sizeof(agm_callback_data));
     if (cb_data == NULL) {
         AGM_LOGE("cb_data is NULL");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
                              "cb_data is NULL");
-        agm_free_session(ses_data);
         return;
     }
     cb_data->session_id = session_id;
     cb_data->event_type = evt_type;
     cb_data->client_data = client_data;
+    cb_data->sender = g_strdup(dbus_message_get_sender(msg));
+    cb_data->ses_data = ses_data;
+
+    if (agm_session_register_cb(session_id,
+                                agmevent_cb,
+                                (enum event_type)evt_type,
+                                (void *)cb_data) != 0) {
+        AGM_LOGE("agm_session_register_cb failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_session_register_cb failed.");
+        g_free(cb_data->sender);
+        free(cb_data);
+        return;
+    }
+
     ses_data->callbacks = g_list_prepend(ses_data->callbacks, cb_data);
 
     reply = dbus_message_new_method_return(msg);
@@ -861,12 +1345,10 @@ static void ipc_agm_session_aif_set_params(DBusConnection *conn,
                                           DBusMessage *msg,
                                           void *userdata) {
     DBusMessage *reply = NULL;
-    DBusMessageIter arg_i, array_i, r_arg;
+    DBusMessageIter arg_i, r_arg;
     uint32_t session_id, aif_id, size;
+    void *payload = NULL;
     void *buf = NULL;
-    char *value = NULL;
-    char **addr_value = &value;
-    int n_elements = 0;
 
     if (userdata == NULL) {
         AGM_LOGE("Invalid userdata");
@@ -897,38 +1379,44 @@ static void ipc_agm_session_aif_set_params(DBusConnection *conn,
     dbus_message_iter_next(&arg_i);
     dbus_message_iter_get_basic(&arg_i, &size);
     dbus_message_iter_next(&arg_i);
-    dbus_message_iter_recurse(&arg_i, &array_i);
-    dbus_message_iter_get_fixed_array(&array_i, addr_value, &n_elements);
-    buf = (void *)malloc(n_elements*sizeof(char));
-    if (buf == NULL) {
-        AGM_LOGE("buf is NULL");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED, "buf is NULL");
+    if (msg_payload(&arg_i, size, &payload)) {
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "payload shorter than size");
         return;
     }
-    memcpy(buf, value, n_elements);
 
-    if (agm_session_aif_set_params(session_id, aif_id, buf, size) != 0) {
+    /* agm keeps these past the call, it is handed the one copy made */
+    if (size) {
+        buf = (void *)malloc(size);
+        if (buf == NULL) {
+            AGM_LOGE("buf is NULL");
+            agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                                "buf is NULL");
+            return;
+        }
+        memcpy(buf, payload, size);
+    }
+
+    if (agm_session_aif_set_params_take(session_id, aif_id, buf, size) != 0) {
         AGM_LOGE("agm_session_aif_set_params failed.");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
                             "agm_session_aif_set_params failed.");
-        free(buf);
-        buf = NULL;
         return;
     }
 
     reply = dbus_message_new_method_return(msg);
     dbus_connection_send(conn, reply, NULL);
-    free(buf);
-    buf = NULL;
     dbus_message_unref(reply);
 }
 
-static void ipc_agm_session_aif_get_tag_module_info_size(DBusConnection *conn,
-                                                         DBusMessage *msg,
-                                                         void *userdata) {
+static void ipc_agm_aif_set_params(DBusConnection *conn,
+                                   DBusMessage *msg,
+                                   void *userdata) {
     DBusMessage *reply = NULL;
-    DBusMessageIter arg_i, array_i, r_arg;
-    uint32_t session_id, aif_id, size;
+    DBusMessageIter arg_i;
+    uint32_t aif_id, size;
+    void *payload = NULL;
+    void *buf = NULL;
 
     if (userdata == NULL) {
         AGM_LOGE("Invalid userdata");
@@ -938,38 +1426,102 @@ static void ipc_agm_session_aif_get_tag_module_info_size(DBusConnection *conn,
     }
 
     if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_aif_set_params has no arguments");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-               "ipc_agm_session_aif_get_tag_module_info_size has no arguments");
+                            "ipc_agm_aif_set_params has no arguments");
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uuu")) {
+    if (strcmp(dbus_message_get_signature(msg), "uuay")) {
+        AGM_LOGE("Invalid signature for ipc_agm_aif_set_params.");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-         "Invalid signature for ipc_agm_session_aif_get_tag_module_info_size.");
+                            "Invalid signature for ipc_agm_aif_set_params.");
         return;
     }
 
     AGM_LOGV("%s : ", __func__);
 
-    reply = dbus_message_new_method_return(msg);
-    dbus_message_iter_get_basic(&arg_i, &session_id);
-    dbus_message_iter_next(&arg_i);
     dbus_message_iter_get_basic(&arg_i, &aif_id);
     dbus_message_iter_next(&arg_i);
     dbus_message_iter_get_basic(&arg_i, &size);
-
-    if (agm_session_aif_get_tag_module_info(session_id,
-                                            aif_id,
-                                            NULL,
-                                            &size) != 0) {
-        AGM_LOGE("agm_session_aif_get_tag_module_info failed.");
+    dbus_message_iter_next(&arg_i);
+    if (msg_payload(&arg_i, size, &payload)) {
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                            "agm_session_aif_get_tag_module_info failed.");
+                            "payload shorter than size");
         return;
     }
 
-    dbus_message_iter_init_append(reply, &r_arg);
-    dbus_message_iter_append_basic(&r_arg, DBUS_TYPE_UINT32, &size);
+    /* agm keeps these past the call, it is handed the one copy made */
+    if (size) {
+        buf = (void *)malloc(size);
+        if (buf == NULL) {
+            AGM_LOGE("buf is NULL");
+            agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                                "buf is NULL");
+            return;
+        }
+        memcpy(buf, payload, size);
+    }
+
+    if (agm_aif_set_params_take(aif_id, buf, size) != 0) {
+        AGM_LOGE("agm_aif_set_params failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_aif_set_params failed.");
+        return;
+    }
+
+    reply = dbus_message_new_method_return(msg);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+}
+
+static void ipc_agm_session_aif_get_tag_module_info_size(DBusConnection *conn,
+                                                         DBusMessage *msg,
+                                                         void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i, array_i, r_arg;
+    uint32_t session_id, aif_id, size;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+               "ipc_agm_session_aif_get_tag_module_info_size has no arguments");
+        return;
+    }
+
+    if (strcmp(dbus_message_get_signature(msg), "uuu")) {
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+         "Invalid signature for ipc_agm_session_aif_get_tag_module_info_size.");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    reply = dbus_message_new_method_return(msg);
+    dbus_message_iter_get_basic(&arg_i, &session_id);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &aif_id);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &size);
+
+    if (agm_session_aif_get_tag_module_info(session_id,
+                                            aif_id,
+                                            NULL,
+                                            &size) != 0) {
+        AGM_LOGE("agm_session_aif_get_tag_module_info failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_session_aif_get_tag_module_info failed.");
+        return;
+    }
+
+    dbus_message_iter_init_append(reply, &r_arg);
+    dbus_message_iter_append_basic(&r_arg, DBUS_TYPE_UINT32, &size);
     dbus_connection_send(conn, reply, NULL);
     dbus_message_unref(reply);
 }
@@ -1035,8 +1587,606 @@ static void ipc_agm_session_aif_get_tag_module_info(DBusConnection *conn,
                                          size);
     dbus_message_iter_close_container(&r_arg, &r_array_i);
     dbus_connection_send(conn, reply, NULL);
-    free(buf);
-    buf = NULL;
+    free(buf);
+    buf = NULL;
+    dbus_message_unref(reply);
+}
+
+/*
+ * Map the memfd argument of an *Fd method. The fd taken out of the message
+ * is our own duplicate and is closed here, the mapping stays valid.
+ */
+static void *ipc_blob_map(DBusMessageIter *arg_i, uint32_t size, bool in_out)
+{
+    void *blob;
+    int fd = -1;
+
+    dbus_message_iter_get_basic(arg_i, &fd);
+    if (fd < 0)
+        return NULL;
+
+    blob = agm_dbus_blob_map(fd, size, in_out);
+    close(fd);
+    return blob;
+}
+
+static void ipc_agm_session_set_params_fd(DBusConnection *conn,
+                                          DBusMessage *msg,
+                                          void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i;
+    uint32_t session_id, size;
+    void *payload = NULL;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_session_set_params_fd has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "ipc_agm_session_set_params_fd has no arguments");
+        return;
+    }
+
+    if (strcmp(dbus_message_get_signature(msg), "uuh")) {
+        AGM_LOGE("Invalid signature for ipc_agm_session_set_params_fd.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                        "Invalid signature for ipc_agm_session_set_params_fd.");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    dbus_message_iter_get_basic(&arg_i, &session_id);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &size);
+    dbus_message_iter_next(&arg_i);
+    payload = ipc_blob_map(&arg_i, size, false);
+    if (payload == NULL) {
+        AGM_LOGE("Invalid payload blob for session %d", session_id);
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "Invalid payload blob.");
+        return;
+    }
+
+    if (agm_session_set_params(session_id, payload, size) != 0) {
+        AGM_LOGE("agm_session_set_params failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_session_set_params failed.");
+        agm_dbus_blob_unmap(payload, size);
+        return;
+    }
+
+    agm_dbus_blob_unmap(payload, size);
+    reply = dbus_message_new_method_return(msg);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+}
+
+static void ipc_agm_session_aif_set_params_fd(DBusConnection *conn,
+                                              DBusMessage *msg,
+                                              void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i;
+    uint32_t session_id, aif_id, size;
+    void *payload = NULL;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_session_aif_set_params_fd has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                          "ipc_agm_session_aif_set_params_fd has no arguments");
+        return;
+    }
+
+    if (strcmp(dbus_message_get_signature(msg), "uuuh")) {
+        AGM_LOGE("Invalid signature for ipc_agm_session_aif_set_params_fd.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                    "Invalid signature for ipc_agm_session_aif_set_params_fd.");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    dbus_message_iter_get_basic(&arg_i, &session_id);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &aif_id);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &size);
+    dbus_message_iter_next(&arg_i);
+    payload = ipc_blob_map(&arg_i, size, false);
+    if (payload == NULL) {
+        AGM_LOGE("Invalid payload blob for session %d", session_id);
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "Invalid payload blob.");
+        return;
+    }
+
+    if (agm_session_aif_set_params(session_id, aif_id, payload, size) != 0) {
+        AGM_LOGE("agm_session_aif_set_params failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_session_aif_set_params failed.");
+        agm_dbus_blob_unmap(payload, size);
+        return;
+    }
+
+    agm_dbus_blob_unmap(payload, size);
+    reply = dbus_message_new_method_return(msg);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+}
+
+static void ipc_agm_aif_set_params_fd(DBusConnection *conn,
+                                      DBusMessage *msg,
+                                      void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i;
+    uint32_t aif_id, size;
+    void *payload = NULL;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_aif_set_params_fd has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "ipc_agm_aif_set_params_fd has no arguments");
+        return;
+    }
+
+    if (strcmp(dbus_message_get_signature(msg), "uuh")) {
+        AGM_LOGE("Invalid signature for ipc_agm_aif_set_params_fd.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "Invalid signature for ipc_agm_aif_set_params_fd.");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    dbus_message_iter_get_basic(&arg_i, &aif_id);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &size);
+    dbus_message_iter_next(&arg_i);
+    payload = ipc_blob_map(&arg_i, size, false);
+    if (payload == NULL) {
+        AGM_LOGE("Invalid payload blob for aif %d", aif_id);
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "Invalid payload blob.");
+        return;
+    }
+
+    if (agm_aif_set_params(aif_id, payload, size) != 0) {
+        AGM_LOGE("agm_aif_set_params failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_aif_set_params failed.");
+        agm_dbus_blob_unmap(payload, size);
+        return;
+    }
+
+    agm_dbus_blob_unmap(payload, size);
+    reply = dbus_message_new_method_return(msg);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+}
+
+/* the blob holds a whole struct agm_cal_config, it is passed on as is */
+static void ipc_agm_session_aif_set_cal_fd(DBusConnection *conn,
+                                           DBusMessage *msg,
+                                           void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i;
+    struct agm_cal_config *cal_config = NULL;
+    uint32_t session_id, aif_id, size;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_session_aif_set_cal_fd has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "ipc_agm_session_aif_set_cal_fd has no arguments");
+        return;
+    }
+
+    if (strcmp(dbus_message_get_signature(msg), "uuuh")) {
+        AGM_LOGE("Invalid signature for ipc_agm_session_aif_set_cal_fd.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                       "Invalid signature for ipc_agm_session_aif_set_cal_fd.");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    dbus_message_iter_get_basic(&arg_i, &session_id);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &aif_id);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &size);
+    dbus_message_iter_next(&arg_i);
+    if (size < sizeof(struct agm_cal_config)) {
+        AGM_LOGE("Invalid cal config size %d", size);
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "Invalid cal config size.");
+        return;
+    }
+
+    cal_config = (struct agm_cal_config *)ipc_blob_map(&arg_i, size, false);
+    if (cal_config == NULL ||
+        cal_config->num_ckvs > (size - sizeof(struct agm_cal_config)) /
+                               sizeof(struct agm_key_value)) {
+        AGM_LOGE("Invalid cal config blob for session %d", session_id);
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "Invalid cal config blob.");
+        agm_dbus_blob_unmap(cal_config, size);
+        return;
+    }
+
+    if (agm_session_aif_set_cal(session_id, aif_id, cal_config)) {
+        AGM_LOGE("agm_session_aif_set_cal failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_session_aif_set_cal failed.");
+        agm_dbus_blob_unmap(cal_config, size);
+        return;
+    }
+
+    agm_dbus_blob_unmap(cal_config, size);
+    reply = dbus_message_new_method_return(msg);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+}
+
+/*
+ * get_params reads its arguments from the payload and writes the result
+ * back over it, so the client hands in a shared blob for the result. The
+ * client can still write to that blob, so agm only ever sees a copy.
+ */
+static void ipc_agm_session_get_params_fd(DBusConnection *conn,
+                                          DBusMessage *msg,
+                                          void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i;
+    uint32_t session_id, size;
+    void *payload = NULL;
+    void *query = NULL;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_session_get_params_fd has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "ipc_agm_session_get_params_fd has no arguments");
+        return;
+    }
+
+    if (strcmp(dbus_message_get_signature(msg), "uuh")) {
+        AGM_LOGE("Invalid signature for ipc_agm_session_get_params_fd.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                        "Invalid signature for ipc_agm_session_get_params_fd.");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    dbus_message_iter_get_basic(&arg_i, &session_id);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &size);
+    dbus_message_iter_next(&arg_i);
+    payload = ipc_blob_map(&arg_i, size, true);
+    if (payload == NULL) {
+        AGM_LOGE("Invalid payload blob for session %d", session_id);
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "Invalid payload blob.");
+        return;
+    }
+
+    query = malloc(size);
+    if (query == NULL) {
+        AGM_LOGE("No memory for a %u byte get_params payload", size);
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_NO_MEMORY,
+                            "No memory for the payload.");
+        agm_dbus_blob_unmap(payload, size);
+        return;
+    }
+    memcpy(query, payload, size);
+
+    if (agm_session_get_params(session_id, query, size) != 0) {
+        AGM_LOGE("agm_session_get_params failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_session_get_params failed.");
+        free(query);
+        agm_dbus_blob_unmap(payload, size);
+        return;
+    }
+
+    memcpy(payload, query, size);
+    free(query);
+    agm_dbus_blob_unmap(payload, size);
+    reply = dbus_message_new_method_return(msg);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+}
+
+/*
+ * Size query and fetch in one call: the result comes back in a sealed memfd
+ * allocated here, next to its size.
+ */
+static void ipc_agm_session_aif_get_tag_module_info_fd(DBusConnection *conn,
+                                                       DBusMessage *msg,
+                                                       void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i, r_arg;
+    uint32_t session_id, aif_id, r_size;
+    size_t size = 0, blob_size;
+    void *buf = NULL;
+    int fd = -1;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                 "ipc_agm_session_aif_get_tag_module_info_fd has no arguments");
+        return;
+    }
+
+    if (strcmp(dbus_message_get_signature(msg), "uu")) {
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+           "Invalid signature for ipc_agm_session_aif_get_tag_module_info_fd.");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    dbus_message_iter_get_basic(&arg_i, &session_id);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &aif_id);
+
+    if (agm_session_aif_get_tag_module_info(session_id, aif_id,
+                                            NULL, &size) != 0 ||
+        size == 0) {
+        AGM_LOGE("agm_session_aif_get_tag_module_info size failed.");
+        goto err;
+    }
+
+    fd = agm_dbus_blob_alloc(size, &buf);
+    if (fd < 0) {
+        AGM_LOGE("tag module info blob of %zu bytes failed %d", size, fd);
+        goto err;
+    }
+    blob_size = size;
+
+    if (agm_session_aif_get_tag_module_info(session_id, aif_id,
+                                            buf, &size) != 0 ||
+        size > blob_size) {
+        AGM_LOGE("agm_session_aif_get_tag_module_info failed.");
+        munmap(buf, blob_size);
+        goto err;
+    }
+
+    munmap(buf, blob_size);
+    if (agm_dbus_blob_seal(fd, false))
+        goto err;
+
+    r_size = size;
+    reply = dbus_message_new_method_return(msg);
+    dbus_message_iter_init_append(reply, &r_arg);
+    dbus_message_iter_append_basic(&r_arg, DBUS_TYPE_UINT32, &r_size);
+    /* the message takes its own duplicate of the fd */
+    dbus_message_iter_append_basic(&r_arg, DBUS_TYPE_UNIX_FD, &fd);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+    close(fd);
+    return;
+
+err:
+    if (fd >= 0)
+        close(fd);
+    agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                        "agm_session_aif_get_tag_module_info failed.");
+}
+
+static void ipc_agm_session_set_metadata_fd(DBusConnection *conn,
+                                            DBusMessage *msg,
+                                            void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i;
+    uint32_t session_id, size;
+    void *metadata = NULL;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_session_set_metadata_fd has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "ipc_agm_session_set_metadata_fd has no arguments");
+        return;
+    }
+
+    if (strcmp(dbus_message_get_signature(msg), "uuh")) {
+        AGM_LOGE("Invalid signature for ipc_agm_session_set_metadata_fd.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                      "Invalid signature for ipc_agm_session_set_metadata_fd.");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    dbus_message_iter_get_basic(&arg_i, &session_id);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &size);
+    dbus_message_iter_next(&arg_i);
+    metadata = ipc_blob_map(&arg_i, size, false);
+    if (metadata == NULL) {
+        AGM_LOGE("Invalid metadata blob");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "Invalid metadata blob.");
+        return;
+    }
+
+    if (agm_session_set_metadata(session_id, size, (uint8_t *)metadata) != 0) {
+        AGM_LOGE("agm_session_set_metadata failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_session_set_metadata failed.");
+        agm_dbus_blob_unmap(metadata, size);
+        return;
+    }
+
+    agm_dbus_blob_unmap(metadata, size);
+    publish_generation();
+    reply = dbus_message_new_method_return(msg);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+}
+
+static void ipc_agm_session_audio_inf_set_metadata_fd(DBusConnection *conn,
+                                                      DBusMessage *msg,
+                                                      void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i;
+    uint32_t session_id, aif_id, size;
+    void *metadata = NULL;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_session_audio_inf_set_metadata_fd has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                  "ipc_agm_session_audio_inf_set_metadata_fd has no arguments");
+        return;
+    }
+
+    if (strcmp(dbus_message_get_signature(msg), "uuuh")) {
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+            "Invalid signature for ipc_agm_session_audio_inf_set_metadata_fd.");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    dbus_message_iter_get_basic(&arg_i, &session_id);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &aif_id);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &size);
+    dbus_message_iter_next(&arg_i);
+    metadata = ipc_blob_map(&arg_i, size, false);
+    if (metadata == NULL) {
+        AGM_LOGE("Invalid metadata blob");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "Invalid metadata blob.");
+        return;
+    }
+
+    if (agm_session_aif_set_metadata(session_id,
+                                     aif_id,
+                                     size,
+                                     (uint8_t *)metadata) != 0) {
+        AGM_LOGE("agm_session_aif_set_metadata failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_session_aif_set_metadata failed.");
+        agm_dbus_blob_unmap(metadata, size);
+        return;
+    }
+
+    agm_dbus_blob_unmap(metadata, size);
+    publish_generation();
+    reply = dbus_message_new_method_return(msg);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+}
+
+static void ipc_agm_audio_intf_set_metadata_fd(DBusConnection *conn,
+                                               DBusMessage *msg,
+                                               void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i;
+    uint32_t aif_id, size;
+    void *metadata = NULL;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_audio_intf_set_metadata_fd has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                         "ipc_agm_audio_intf_set_metadata_fd has no arguments");
+        return;
+    }
+
+    if (strcmp(dbus_message_get_signature(msg), "uuh")) {
+        AGM_LOGE("Invalid signature for ipc_agm_audio_intf_set_metadata_fd.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                   "Invalid signature for ipc_agm_audio_intf_set_metadata_fd.");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    dbus_message_iter_get_basic(&arg_i, &aif_id);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &size);
+    dbus_message_iter_next(&arg_i);
+    metadata = ipc_blob_map(&arg_i, size, false);
+    if (metadata == NULL) {
+        AGM_LOGE("Invalid metadata blob");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "Invalid metadata blob.");
+        return;
+    }
+
+    if (agm_aif_set_metadata(aif_id, size, (uint8_t *)metadata) != 0) {
+        AGM_LOGE("agm_aif_set_metadata failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_aif_set_metadata failed.");
+        agm_dbus_blob_unmap(metadata, size);
+        return;
+    }
+
+    agm_dbus_blob_unmap(metadata, size);
+    publish_generation();
+    reply = dbus_message_new_method_return(msg);
+    dbus_connection_send(conn, reply, NULL);
     dbus_message_unref(reply);
 }
 
@@ -1142,12 +2292,9 @@ static void ipc_agm_session_set_params(DBusConnection *conn,
                                        DBusMessage *msg,
                                        void *userdata) {
     DBusMessage *reply = NULL;
-    DBusMessageIter arg_i, array_i;
+    DBusMessageIter arg_i;
     uint32_t session_id, size;
     void *payload = NULL;
-    char *value = NULL;
-    char **addr_value = &value;
-    int n_elements = 0;
 
     if (userdata == NULL) {
         AGM_LOGE("Invalid userdata");
@@ -1176,24 +2323,21 @@ static void ipc_agm_session_set_params(DBusConnection *conn,
     dbus_message_iter_next(&arg_i);
     dbus_message_iter_get_basic(&arg_i, &size);
     dbus_message_iter_next(&arg_i);
-    dbus_message_iter_recurse(&arg_i, &array_i);
-    dbus_message_iter_get_fixed_array(&array_i, addr_value, &n_elements);
-    payload = (void *)malloc(n_elements*sizeof(char));
-    memcpy(payload, value, n_elements);
+    if (msg_payload(&arg_i, size, &payload)) {
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "payload shorter than size");
+        return;
+    }
 
-    if (agm_session_set_params(session_id, (void *)payload, size) != 0) {
+    if (agm_session_set_params(session_id, payload, size) != 0) {
         AGM_LOGE("agm_session_set_params failed.");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
                             "agm_session_set_params failed.");
-        free(payload);
-        payload = NULL;
         return;
     }
 
     reply = dbus_message_new_method_return(msg);
     dbus_connection_send(conn, reply, NULL);
-    free(payload);
-    payload = NULL;
     dbus_message_unref(reply);
 }
 
@@ -1427,12 +2571,9 @@ static void ipc_agm_session_set_metadata(DBusConnection *conn,
                                          DBusMessage *msg,
                                          void *userdata) {
     DBusMessage *reply = NULL;
-    DBusMessageIter arg_i, array_i;
+    DBusMessageIter arg_i;
     uint32_t session_id, size;
     void *metadata;
-    char *value = NULL;
-    char **addr_value = &value;
-    int n_elements = 0;
 
     if (userdata == NULL) {
         AGM_LOGE("Invalid userdata");
@@ -1461,29 +2602,22 @@ static void ipc_agm_session_set_metadata(DBusConnection *conn,
     dbus_message_iter_next(&arg_i);
     dbus_message_iter_get_basic(&arg_i, &size);
     dbus_message_iter_next(&arg_i);
-    dbus_message_iter_recurse(&arg_i, &array_i);
-    dbus_message_iter_get_fixed_array(&array_i, addr_value, &n_elements);
-    metadata = (void *)malloc(n_elements*sizeof(char));
-    if (metadata == NULL) {
-        AGM_LOGE("metadata is NULL");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED, "metadata is NULL");
+    if (msg_payload(&arg_i, size, &metadata)) {
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "metadata shorter than size");
         return;
     }
-    memcpy(metadata, value, n_elements);
 
     if (agm_session_set_metadata(session_id, size, (uint8_t *)metadata) != 0) {
         AGM_LOGE("agm_session_set_metadata failed.");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
                             "agm_session_set_metadata failed.");
-        free(metadata);
-        metadata = NULL;
         return;
     }
 
+    publish_generation();
     reply = dbus_message_new_method_return(msg);
     dbus_connection_send(conn, reply, NULL);
-    free(metadata);
-    metadata = NULL;
     dbus_message_unref(reply);
 }
 
@@ -1491,12 +2625,9 @@ static void ipc_agm_session_audio_inf_set_metadata(DBusConnection *conn,
                                                    DBusMessage *msg,
                                                    void *userdata) {
     DBusMessage *reply = NULL;
-    DBusMessageIter arg_i, array_i;
+    DBusMessageIter arg_i;
     uint32_t session_id, aif_id, size;
     void *metadata;
-    char *value = NULL;
-    char **addr_value = &value;
-    int n_elements = 0;
 
     if (userdata == NULL) {
         AGM_LOGE("Invalid userdata");
@@ -1526,15 +2657,11 @@ static void ipc_agm_session_audio_inf_set_metadata(DBusConnection *conn,
     dbus_message_iter_next(&arg_i);
     dbus_message_iter_get_basic(&arg_i, &size);
     dbus_message_iter_next(&arg_i);
-    dbus_message_iter_recurse(&arg_i, &array_i);
-    dbus_message_iter_get_fixed_array(&array_i, addr_value, &n_elements);
-    metadata = (void *)malloc(n_elements*sizeof(char));
-    if (metadata == NULL) {
-        AGM_LOGE("metadata is NULL");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED, "metadata is NULL");
+    if (msg_payload(&arg_i, size, &metadata)) {
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "metadata shorter than size");
         return;
     }
-    memcpy(metadata, value, n_elements);
 
     if (agm_session_aif_set_metadata(session_id,
                                      aif_id,
@@ -1543,15 +2670,12 @@ static void ipc_agm_session_audio_inf_set_metadata(DBusConnection *conn,
         AGM_LOGE("agm_session_aif_set_metadata failed.");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
                             "agm_session_aif_set_metadata failed.");
-        free(metadata);
-        metadata = NULL;
         return;
     }
 
+    publish_generation();
     reply = dbus_message_new_method_return(msg);
     dbus_connection_send(conn, reply, NULL);
-    free(metadata);
-    metadata = NULL;
     dbus_message_unref(reply);
 }
 
@@ -1559,12 +2683,9 @@ static void ipc_agm_audio_intf_set_metadata(DBusConnection *conn,
                                             DBusMessage *msg,
                                             void *userdata) {
     DBusMessage *reply = NULL;
-    DBusMessageIter arg_i, array_i;
+    DBusMessageIter arg_i;
     uint32_t aif_id, size;
     void *metadata;
-    char *value = NULL;
-    char **addr_value = &value;
-    int n_elements = 0;
 
     if (userdata == NULL) {
         AGM_LOGE("Invalid userdata");
@@ -1574,58 +2695,343 @@ static void ipc_agm_audio_intf_set_metadata(DBusConnection *conn,
     }
 
     if (!dbus_message_iter_init(msg, &arg_i)) {
-        AGM_LOGE("ipc_agm_audio_intf_set_metadata has no arguments");
+        AGM_LOGE("ipc_agm_audio_intf_set_metadata has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "ipc_agm_audio_intf_set_metadata has no arguments");
+        return;
+    }
+
+    if (strcmp(dbus_message_get_signature(msg), "uuay")) {
+        AGM_LOGE("Invalid signature for ipc_agm_audio_intf_set_metadata.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                      "Invalid signature for ipc_agm_audio_intf_set_metadata.");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    dbus_message_iter_get_basic(&arg_i, &aif_id);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &size);
+    dbus_message_iter_next(&arg_i);
+    if (msg_payload(&arg_i, size, &metadata)) {
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "metadata shorter than size");
+        return;
+    }
+
+    if (agm_aif_set_metadata(aif_id, size, (uint8_t *)metadata) != 0) {
+        AGM_LOGE("agm_aif_set_metadata failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_aif_set_metadata failed.");
+        return;
+    }
+
+    publish_generation();
+    reply = dbus_message_new_method_return(msg);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+}
+
+static void ipc_agm_audio_intf_set_media_config(DBusConnection *conn,
+                                                DBusMessage *msg,
+                                                void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i, struct_i;
+    struct agm_media_config media_config;
+    uint32_t aif_id;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_audio_intf_set_media_config has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                        "ipc_agm_audio_intf_set_media_config has no arguments");
+        return;
+    }
+
+    if (strcmp(dbus_message_get_signature(msg), "u(uui)")) {
+        AGM_LOGE("Invalid signature for ipc_agm_audio_intf_set_media_config.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                  "Invalid signature for ipc_agm_audio_intf_set_media_config.");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    dbus_message_iter_get_basic(&arg_i, &aif_id);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_recurse(&arg_i, &struct_i);
+    dbus_message_iter_get_basic(&struct_i, &media_config.rate);
+    dbus_message_iter_next(&struct_i);
+    dbus_message_iter_get_basic(&struct_i, &media_config.channels);
+    dbus_message_iter_next(&struct_i);
+    dbus_message_iter_get_basic(&struct_i, &media_config.format);
+
+    if (agm_aif_set_media_config(aif_id, &media_config)) {
+        AGM_LOGE("agm_aif_set_media_config failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_aif_set_media_config failed.");
+        return;
+    }
+
+    reply = dbus_message_new_method_return(msg);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+}
+
+static void ipc_agm_get_buffer_timestamp(DBusConnection *conn,
+                                         DBusMessage *msg,
+                                         void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i;
+    DBusMessageIter r_arg, r_array_i;
+    uint64_t timestamp = 0;
+    uint32_t session_id;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_get_buffer_timestamp has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "ipc_agm_get_buffer_timestamp has no arguments");
+        return;
+    }
+
+    if (strcmp(dbus_message_get_signature(msg), "u")) {
+        AGM_LOGE("Invalid signature for ipc_agm_get_buffer_timestamp.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                         "Invalid signature for ipc_agm_get_buffer_timestamp.");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    dbus_message_iter_get_basic(&arg_i, &session_id);
+
+    if (agm_get_buffer_timestamp(session_id, &timestamp)) {
+        AGM_LOGE("agm_get_buffer_timestamp failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_get_buffer_timestamp failed.");
+        return;
+    }
+
+    reply = dbus_message_new_method_return(msg);
+    dbus_message_iter_init_append(reply, &r_arg);
+    dbus_message_iter_append_basic(&r_arg, DBUS_TYPE_UINT64, &timestamp);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+}
+
+static void ipc_agm_session_get_stats(DBusConnection *conn,
+                                      DBusMessage *msg,
+                                      void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i;
+    struct agm_session_stats stats;
+    uint32_t session_id;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_session_get_stats has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "ipc_agm_session_get_stats has no arguments");
+        return;
+    }
+
+    if (strcmp(dbus_message_get_signature(msg), "u")) {
+        AGM_LOGE("Invalid signature for ipc_agm_session_get_stats.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "Invalid signature for ipc_agm_session_get_stats.");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    dbus_message_iter_get_basic(&arg_i, &session_id);
+
+    if (agm_session_get_stats(session_id, &stats)) {
+        AGM_LOGE("agm_session_get_stats failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_session_get_stats failed.");
+        return;
+    }
+
+    reply = dbus_message_new_method_return(msg);
+    dbus_message_append_args(reply,
+                             DBUS_TYPE_UINT64, &stats.num_writes,
+                             DBUS_TYPE_UINT64, &stats.num_reads,
+                             DBUS_TYPE_UINT64, &stats.bytes_written,
+                             DBUS_TYPE_UINT64, &stats.bytes_read,
+                             DBUS_TYPE_UINT32, &stats.num_underruns,
+                             DBUS_TYPE_UINT32, &stats.num_overruns,
+                             DBUS_TYPE_UINT32, &stats.num_poll_timeouts,
+                             DBUS_TYPE_UINT32, &stats.max_pos_interval_us,
+                             DBUS_TYPE_UINT32, &stats.latency_us,
+                             DBUS_TYPE_INVALID);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+}
+
+static void ipc_agm_session_update_stats(DBusConnection *conn,
+                                         DBusMessage *msg,
+                                         void *userdata) {
+    DBusMessage *reply = NULL;
+    agm_session_data *ses_data = (agm_session_data *)userdata;
+    struct agm_session_stats delta;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    memset(&delta, 0, sizeof(delta));
+    if (!dbus_message_get_args(msg, NULL,
+                               DBUS_TYPE_UINT32, &delta.num_underruns,
+                               DBUS_TYPE_UINT32, &delta.num_overruns,
+                               DBUS_TYPE_UINT32, &delta.num_poll_timeouts,
+                               DBUS_TYPE_UINT32, &delta.max_pos_interval_us,
+                               DBUS_TYPE_UINT32, &delta.latency_us,
+                               DBUS_TYPE_INVALID)) {
+        AGM_LOGE("Invalid signature for ipc_agm_session_update_stats.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_INVALID_ARGS,
+                         "Invalid signature for ipc_agm_session_update_stats.");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    if (agm_session_update_stats(ses_data->handle, &delta)) {
+        AGM_LOGE("agm_session_update_stats failed.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "agm_session_update_stats failed.");
+        return;
+    }
+
+    reply = dbus_message_new_method_return(msg);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+}
+
+/* handles of the open sessions a group call names by session id */
+static int group_handles(DBusMessage *msg, DBusMessageIter *arg_i,
+                         uint64_t **handles, uint32_t *num) {
+    DBusMessageIter array_i;
+    agm_session_data *ses_data;
+    uint32_t *ids = NULL;
+    int n_elements = 0, i;
+
+    dbus_message_iter_recurse(arg_i, &array_i);
+    dbus_message_iter_get_fixed_array(&array_i, &ids, &n_elements);
+    if (n_elements == 0)
+        return -EINVAL;
+
+    *handles = (uint64_t *)calloc(n_elements, sizeof(uint64_t));
+    if (*handles == NULL)
+        return -ENOMEM;
+
+    for (i = 0; i < n_elements; i++) {
+        ses_data = lookup_session_data(ids[i]);
+        if (ses_data == NULL || ses_data->handle == 0) {
+            AGM_LOGE("session %d of group is not open", ids[i]);
+            free(*handles);
+            *handles = NULL;
+            return -EINVAL;
+        }
+        (*handles)[i] = ses_data->handle;
+    }
+    *num = n_elements;
+
+    return 0;
+}
+
+static void ipc_agm_session_group_start(DBusConnection *conn,
+                                        DBusMessage *msg,
+                                        void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i;
+    dbus_bool_t get_skew;
+    uint64_t *handles = NULL;
+    uint64_t start_skew_us = 0;
+    uint32_t num = 0;
+    int ret;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_session_group_start has no arguments");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                            "ipc_agm_audio_intf_set_metadata has no arguments");
+                            "ipc_agm_session_group_start has no arguments");
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "uuay")) {
-        AGM_LOGE("Invalid signature for ipc_agm_audio_intf_set_metadata.");
+    if (strcmp(dbus_message_get_signature(msg), "aub")) {
+        AGM_LOGE("Invalid signature for ipc_agm_session_group_start.");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                      "Invalid signature for ipc_agm_audio_intf_set_metadata.");
+                         "Invalid signature for ipc_agm_session_group_start.");
         return;
     }
 
     AGM_LOGV("%s : ", __func__);
 
-    dbus_message_iter_get_basic(&arg_i, &aif_id);
-    dbus_message_iter_next(&arg_i);
-    dbus_message_iter_get_basic(&arg_i, &size);
-    dbus_message_iter_next(&arg_i);
-    dbus_message_iter_recurse(&arg_i, &array_i);
-    dbus_message_iter_get_fixed_array(&array_i, addr_value, &n_elements);
-    metadata = (void *)malloc(n_elements*sizeof(char));
-    if (metadata == NULL) {
-        AGM_LOGE("metadata is NULL");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED, "metadata is NULL");
+    ret = group_handles(msg, &arg_i, &handles, &num);
+    if (ret) {
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_INVALID_ARGS,
+                            "Invalid session group");
         return;
     }
-    memcpy(metadata, value, n_elements);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &get_skew);
 
-    if (agm_aif_set_metadata(aif_id, size, (uint8_t *)metadata) != 0) {
-        AGM_LOGE("agm_aif_set_metadata failed.");
+    ret = agm_session_group_start(handles, num,
+                                  get_skew ? &start_skew_us : NULL);
+    free(handles);
+    if (ret) {
+        AGM_LOGE("agm_session_group_start failed.");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                            "agm_aif_set_metadata failed.");
-        free(metadata);
-        metadata = NULL;
+                            "agm_session_group_start failed.");
         return;
     }
 
     reply = dbus_message_new_method_return(msg);
+    dbus_message_append_args(reply,
+                             DBUS_TYPE_UINT64, &start_skew_us,
+                             DBUS_TYPE_INVALID);
     dbus_connection_send(conn, reply, NULL);
-    free(metadata);
-    metadata = NULL;
     dbus_message_unref(reply);
 }
 
-static void ipc_agm_audio_intf_set_media_config(DBusConnection *conn,
-                                                DBusMessage *msg,
-                                                void *userdata) {
+static void ipc_agm_session_group_stop(DBusConnection *conn,
+                                       DBusMessage *msg,
+                                       void *userdata) {
     DBusMessage *reply = NULL;
-    DBusMessageIter arg_i, struct_i;
-    struct agm_media_config media_config;
-    uint32_t aif_id;
+    DBusMessageIter arg_i;
+    uint64_t *handles = NULL;
+    uint32_t num = 0;
+    int ret;
 
     if (userdata == NULL) {
         AGM_LOGE("Invalid userdata");
@@ -1635,34 +3041,34 @@ static void ipc_agm_audio_intf_set_media_config(DBusConnection *conn,
     }
 
     if (!dbus_message_iter_init(msg, &arg_i)) {
-        AGM_LOGE("ipc_agm_audio_intf_set_media_config has no arguments");
+        AGM_LOGE("ipc_agm_session_group_stop has no arguments");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                        "ipc_agm_audio_intf_set_media_config has no arguments");
+                            "ipc_agm_session_group_stop has no arguments");
         return;
     }
 
-    if (strcmp(dbus_message_get_signature(msg), "u(uui)")) {
-        AGM_LOGE("Invalid signature for ipc_agm_audio_intf_set_media_config.");
+    if (strcmp(dbus_message_get_signature(msg), "au")) {
+        AGM_LOGE("Invalid signature for ipc_agm_session_group_stop.");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                  "Invalid signature for ipc_agm_audio_intf_set_media_config.");
+                         "Invalid signature for ipc_agm_session_group_stop.");
         return;
     }
 
     AGM_LOGV("%s : ", __func__);
 
-    dbus_message_iter_get_basic(&arg_i, &aif_id);
-    dbus_message_iter_next(&arg_i);
-    dbus_message_iter_recurse(&arg_i, &struct_i);
-    dbus_message_iter_get_basic(&struct_i, &media_config.rate);
-    dbus_message_iter_next(&struct_i);
-    dbus_message_iter_get_basic(&struct_i, &media_config.channels);
-    dbus_message_iter_next(&struct_i);
-    dbus_message_iter_get_basic(&struct_i, &media_config.format);
+    ret = group_handles(msg, &arg_i, &handles, &num);
+    if (ret) {
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_INVALID_ARGS,
+                            "Invalid session group");
+        return;
+    }
 
-    if (agm_aif_set_media_config(aif_id, &media_config)) {
-        AGM_LOGE("agm_aif_set_media_config failed.");
+    ret = agm_session_group_stop(handles, num);
+    free(handles);
+    if (ret) {
+        AGM_LOGE("agm_session_group_stop failed.");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                            "agm_aif_set_media_config failed.");
+                            "agm_session_group_stop failed.");
         return;
     }
 
@@ -1671,14 +3077,15 @@ static void ipc_agm_audio_intf_set_media_config(DBusConnection *conn,
     dbus_message_unref(reply);
 }
 
-static void ipc_agm_get_buffer_timestamp(DBusConnection *conn,
-                                         DBusMessage *msg,
-                                         void *userdata) {
+static void ipc_agm_recover_all(DBusConnection *conn,
+                                DBusMessage *msg,
+                                void *userdata) {
     DBusMessage *reply = NULL;
-    DBusMessageIter arg_i;
-    DBusMessageIter r_arg, r_array_i;
-    uint64_t timestamp = 0;
-    uint32_t session_id;
+    DBusMessageIter arg_i, array_i, struct_i;
+    struct agm_session_recovery_info *info = NULL;
+    size_t num_sessions = 0;
+    uint32_t num = 0, num_ret, i;
+    int32_t ret;
 
     if (userdata == NULL) {
         AGM_LOGE("Invalid userdata");
@@ -1688,35 +3095,58 @@ static void ipc_agm_get_buffer_timestamp(DBusConnection *conn,
     }
 
     if (!dbus_message_iter_init(msg, &arg_i)) {
-        AGM_LOGE("ipc_agm_get_buffer_timestamp has no arguments");
+        AGM_LOGE("ipc_agm_recover_all has no arguments");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                            "ipc_agm_get_buffer_timestamp has no arguments");
+                            "ipc_agm_recover_all has no arguments");
         return;
     }
 
     if (strcmp(dbus_message_get_signature(msg), "u")) {
-        AGM_LOGE("Invalid signature for ipc_agm_get_buffer_timestamp.");
+        AGM_LOGE("Invalid signature for ipc_agm_recover_all.");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                         "Invalid signature for ipc_agm_get_buffer_timestamp.");
+                            "Invalid signature for ipc_agm_recover_all.");
         return;
     }
 
-    AGM_LOGV("%s : ", __func__);
-
-    dbus_message_iter_get_basic(&arg_i, &session_id);
+    dbus_message_iter_get_basic(&arg_i, &num);
+    AGM_LOGV("%s : num = %u", __func__, num);
 
-    if (agm_get_buffer_timestamp(session_id, &timestamp)) {
-        AGM_LOGE("agm_get_buffer_timestamp failed.");
-        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
-                            "agm_get_buffer_timestamp failed.");
-        return;
+    if (num != 0) {
+        info = (struct agm_session_recovery_info *)
+                        calloc(num, sizeof(struct agm_session_recovery_info));
+        if (info == NULL) {
+            agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_NO_MEMORY,
+                                "Unable to allocate memory");
+            return;
+        }
     }
 
+    num_sessions = num;
+    ret = agm_recover_all(info, &num_sessions);
+    num_ret = (uint32_t) num_sessions;
+
+    /* per session results matter most when some of them failed */
     reply = dbus_message_new_method_return(msg);
-    dbus_message_iter_init_append(reply, &r_arg);
-    dbus_message_iter_append_basic(&r_arg, DBUS_TYPE_UINT64, &timestamp);
+    dbus_message_iter_init_append(reply, &arg_i);
+    dbus_message_iter_append_basic(&arg_i, DBUS_TYPE_INT32, &ret);
+    dbus_message_iter_append_basic(&arg_i, DBUS_TYPE_UINT32, &num_ret);
+    dbus_message_iter_open_container(&arg_i, DBUS_TYPE_ARRAY, "(uit)",
+                                     &array_i);
+    for (i = 0; i < num_ret && i < num; i++) {
+        dbus_message_iter_open_container(&array_i, DBUS_TYPE_STRUCT, NULL,
+                                         &struct_i);
+        dbus_message_iter_append_basic(&struct_i, DBUS_TYPE_UINT32,
+                                       &info[i].session_id);
+        dbus_message_iter_append_basic(&struct_i, DBUS_TYPE_INT32,
+                                       &info[i].status);
+        dbus_message_iter_append_basic(&struct_i, DBUS_TYPE_UINT64,
+                                       &info[i].recovery_time_us);
+        dbus_message_iter_close_container(&array_i, &struct_i);
+    }
+    dbus_message_iter_close_container(&arg_i, &array_i);
     dbus_connection_send(conn, reply, NULL);
     dbus_message_unref(reply);
+    free(info);
 }
 
 static void ipc_agm_get_hw_processed_buff_cnt(DBusConnection *conn,
@@ -1893,13 +3323,10 @@ static void ipc_agm_session_write(DBusConnection *conn,
                                   DBusMessage *msg,
                                   void *userdata) {
     DBusMessage *reply = NULL;
-    DBusMessageIter arg_i, array_i, r_arg;
+    DBusMessageIter arg_i, r_arg;
     agm_session_data *ses_data = (agm_session_data *)userdata;
     uint32_t buf_size;
     void *buf;
-    char *value = NULL;
-    char **addr_value = &value;
-    int n_elements = 0;
 
     if (userdata == NULL) {
         AGM_LOGE("Invalid userdata");
@@ -1926,17 +3353,16 @@ static void ipc_agm_session_write(DBusConnection *conn,
 
     dbus_message_iter_get_basic(&arg_i, &buf_size);
     dbus_message_iter_next(&arg_i);
-    dbus_message_iter_recurse(&arg_i, &array_i);
-    dbus_message_iter_get_fixed_array(&array_i, addr_value, &n_elements);
-    buf = (void *)malloc(n_elements*sizeof(char));
-    memcpy(buf, value, n_elements);
+    if (msg_payload(&arg_i, buf_size, &buf)) {
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "buffer shorter than size");
+        return;
+    }
 
     if (agm_session_write(ses_data->handle, buf, (size_t *) &buf_size)) {
         AGM_LOGE("agm_session_write failed.");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
                             "agm_session_write failed.");
-        free(buf);
-        buf = NULL;
         return;
     }
 
@@ -1944,11 +3370,77 @@ static void ipc_agm_session_write(DBusConnection *conn,
     dbus_message_iter_init_append(reply, &r_arg);
     dbus_message_iter_append_basic(&r_arg, DBUS_TYPE_UINT32, &buf_size);
     dbus_connection_send(conn, reply, NULL);
-    free(buf);
-    buf = NULL;
     dbus_message_unref(reply);
 }
 
+static void ipc_agm_session_map_ring(DBusConnection *conn,
+                                     DBusMessage *msg,
+                                     void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i;
+    agm_session_data *ses_data = (agm_session_data *)userdata;
+    uint32_t dir;
+    int ring_fd = -1;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_session_map_ring has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "ipc_agm_session_map_ring has no arguments");
+        return;
+    }
+
+    if (strcmp(dbus_message_get_signature(msg), "uhhh")) {
+        AGM_LOGE("Invalid signature for ipc_agm_session_map_ring.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "Invalid signature for ipc_agm_session_map_ring.");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    /* a client mapping again replaces its old ring */
+    ses_ring_release(ses_data);
+
+    /* unix fds come out of the message as our own duplicates */
+    dbus_message_iter_get_basic(&arg_i, &dir);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &ring_fd);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &ses_data->kick_fd);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_get_basic(&arg_i, &ses_data->notify_fd);
+
+    if (agm_dbus_ring_attach(&ses_data->ring, ring_fd) ||
+        ses_data->ring.hdr->dir != dir ||
+        dir > AGM_DBUS_RING_CAPTURE) {
+        AGM_LOGE("Invalid ring for session %d", ses_data->session_id);
+        goto err;
+    }
+    close(ring_fd);
+    ring_fd = -1;
+
+    ses_ring_arm(ses_data);
+
+    reply = dbus_message_new_method_return(msg);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+    return;
+
+err:
+    if (ring_fd >= 0)
+        close(ring_fd);
+    ses_ring_release(ses_data);
+    agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                        "ipc_agm_session_map_ring failed.");
+}
+
 static void ipc_agm_session_read(DBusConnection *conn,
                                  DBusMessage *msg,
                                  void *userdata) {
@@ -2142,12 +3634,25 @@ static void ipc_agm_session_prepare(DBusConnection *conn,
     dbus_message_unref(reply);
 }
 
-static void ipc_agm_session_close(DBusConnection *conn,
-                                  DBusMessage *msg,
-                                  void *userdata) {
+/* forget a session that is closed in agm */
+static int ses_data_drop(agm_session_data *ses_data) {
+    /* agm keeps callbacks past close, they must not outlive cb_data */
+    ses_callbacks_release(ses_data);
+
+    if (agm_dbus_remove_interface(mdata->conn,
+                                  ses_data->dbus_obj_path,
+                                  session_interface_info.name))
+        return -EINVAL;
+
+    remove_session_data(ses_data->session_id);
+    return 0;
+}
+
+static void ses_close(DBusConnection *conn, DBusMessage *msg,
+                      void *userdata, bool async) {
     DBusMessage *reply = NULL;
     agm_session_data *ses_data = (agm_session_data *)userdata;
-    GList *node = NULL;
+    int ret;
 
     if (userdata == NULL) {
         AGM_LOGE("Invalid userdata");
@@ -2156,42 +3661,48 @@ static void ipc_agm_session_close(DBusConnection *conn,
         return;
     }
 
-    AGM_LOGV("%s : ", __func__);
+    AGM_LOGV("%s : async %d", __func__, async);
 
-    dbus_connection_remove_filter(conn, disconnection_filter_cb, ses_data);
+    dbus_connection_remove_filter(conn, disconnection_filter_cb,
+                                  GUINT_TO_POINTER(ses_data->session_id));
+    ses_ring_release(ses_data);
 
-    if (agm_session_close(ses_data->handle)) {
+    if (async)
+        ret = agm_session_close_async(ses_data->handle);
+    else
+        ret = agm_session_close(ses_data->handle);
+    if (ret) {
         AGM_LOGE("agm_session_close failed.");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
                             "agm_session_close failed.");
         return;
     }
 
-    for (node = ses_data->callbacks; node != NULL; node = node->next) {
-        if (node->data != NULL) {
-            free(node->data);
-            node->data = NULL;
-        }
-    }
-
-    g_list_free(ses_data->callbacks);
-
-    if (agm_dbus_remove_interface(mdata->conn,
-                                  ses_data->dbus_obj_path,
-                                  session_interface_info.name)) {
+    if (ses_data_drop(ses_data)) {
         AGM_LOGE("Unable to remove interface");
         agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
                        "agm_session_close failed. Failed to remove interface.");
         return;
     }
 
-    g_hash_table_remove(mdata->sessions,
-                        GUINT_TO_POINTER(ses_data->session_id));
     reply = dbus_message_new_method_return(msg);
     dbus_connection_send(conn, reply, NULL);
     dbus_message_unref(reply);
 }
 
+static void ipc_agm_session_close(DBusConnection *conn,
+                                  DBusMessage *msg,
+                                  void *userdata) {
+    ses_close(conn, msg, userdata, false);
+}
+
+/* the teardown goes on in agm after the reply, see agm_session_close_async */
+static void ipc_agm_session_close_async(DBusConnection *conn,
+                                        DBusMessage *msg,
+                                        void *userdata) {
+    ses_close(conn, msg, userdata, true);
+}
+
 static void ipc_agm_session_open(DBusConnection *conn,
                                  DBusMessage *msg,
                                  void *userdata) {
@@ -2238,7 +3749,7 @@ static void ipc_agm_session_open(DBusConnection *conn,
 
     if (!dbus_connection_add_filter(conn,
                                     disconnection_filter_cb,
-                                    ses_data,
+                                    GUINT_TO_POINTER(session_id),
                                     NULL))
         AGM_LOGE("Unable to add death notification filter");
 
@@ -2251,10 +3762,280 @@ static void ipc_agm_session_open(DBusConnection *conn,
     dbus_message_unref(reply);
 }
 
+/*
+ * Unpack the steps of AgmSessionRunOps. Payloads point into msg; a
+ * SET_CONFIG payload carries media, buffer and session config back to back
+ * and is copied out into cfgs.
+ */
+static int ses_ops_parse(DBusMessageIter *array_i, struct agm_session_op *ops,
+                         uint8_t *cfgs, uint32_t num_ops) {
+    const size_t cfg_size = sizeof(struct agm_media_config) +
+                            sizeof(struct agm_buffer_config) +
+                            sizeof(struct agm_session_config);
+    DBusMessageIter struct_i, payload_i;
+    struct agm_session_op *op;
+    dbus_bool_t state;
+    uint32_t type, mode, i;
+    char *value = NULL;
+    int n_elements = 0;
+    uint8_t *cfg;
+
+    for (i = 0; i < num_ops; i++, dbus_message_iter_next(array_i)) {
+        op = &ops[i];
+        cfg = cfgs + i * cfg_size;
+
+        dbus_message_iter_recurse(array_i, &struct_i);
+        dbus_message_iter_get_basic(&struct_i, &type);
+        dbus_message_iter_next(&struct_i);
+        dbus_message_iter_get_basic(&struct_i, &mode);
+        dbus_message_iter_next(&struct_i);
+        dbus_message_iter_get_basic(&struct_i, &op->aif_id);
+        dbus_message_iter_next(&struct_i);
+        dbus_message_iter_get_basic(&struct_i, &state);
+        dbus_message_iter_next(&struct_i);
+        dbus_message_iter_recurse(&struct_i, &payload_i);
+        dbus_message_iter_get_fixed_array(&payload_i, &value, &n_elements);
+
+        if (type > AGM_SESSION_OP_CLOSE)
+            return -EINVAL;
+
+        op->type = (enum agm_session_op_type)type;
+        op->sess_mode = (enum agm_session_mode)mode;
+        op->state = state;
+        op->size = n_elements;
+        op->payload = n_elements ? value : NULL;
+
+        if (op->type != AGM_SESSION_OP_SET_CONFIG)
+            continue;
+
+        if ((size_t)n_elements != cfg_size)
+            return -EINVAL;
+
+        memcpy(cfg, value, cfg_size);
+        op->media_config = (struct agm_media_config *)cfg;
+        op->buffer_config = (struct agm_buffer_config *)
+                            (cfg + sizeof(struct agm_media_config));
+        op->session_config = (struct agm_session_config *)
+                             (cfg + sizeof(struct agm_media_config) +
+                              sizeof(struct agm_buffer_config));
+    }
+
+    return 0;
+}
+
+/*
+ * Runs on the session's queue like every other call for it, so the steps
+ * are not interleaved with calls of other clients for the same session.
+ */
+static void ipc_agm_session_run_ops(DBusConnection *conn,
+                                    DBusMessage *msg,
+                                    void *userdata) {
+    agm_module_dbus_data *mdata = (agm_module_dbus_data *)userdata;
+    const size_t cfg_size = sizeof(struct agm_media_config) +
+                            sizeof(struct agm_buffer_config) +
+                            sizeof(struct agm_session_config);
+    DBusMessage *reply = NULL;
+    DBusMessageIter arg_i, array_i, status_i;
+    struct agm_session_op *ops = NULL;
+    agm_session_data *ses_data = NULL;
+    const char *obj_path = AGM_OBJECT_PATH;
+    uint8_t *cfgs = NULL;
+    uint32_t session_id, num_ops = 0, i;
+    uint64_t handle = 0;
+    bool was_open, has_open = false, has_close = false;
+    dbus_bool_t is_open;
+    int ret;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    if (!dbus_message_iter_init(msg, &arg_i)) {
+        AGM_LOGE("ipc_agm_session_run_ops has no arguments");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "ipc_agm_session_run_ops has no arguments");
+        return;
+    }
+
+    if (strcmp(dbus_message_get_signature(msg), "ua(uuubay)")) {
+        AGM_LOGE("Invalid signature for ipc_agm_session_run_ops.");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "Invalid signature for ipc_agm_session_run_ops.");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    dbus_message_iter_get_basic(&arg_i, &session_id);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_recurse(&arg_i, &array_i);
+    for (status_i = array_i;
+         dbus_message_iter_get_arg_type(&status_i) == DBUS_TYPE_STRUCT;
+         dbus_message_iter_next(&status_i))
+        num_ops++;
+
+    if (num_ops) {
+        ops = (struct agm_session_op *)calloc(num_ops, sizeof(*ops));
+        cfgs = (uint8_t *)calloc(num_ops, cfg_size);
+        if (ops == NULL || cfgs == NULL) {
+            AGM_LOGE("Memory allocation failed");
+            agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_NO_MEMORY,
+                                "Memory allocation failed");
+            goto done;
+        }
+    }
+
+    if (ses_ops_parse(&array_i, ops, cfgs, num_ops)) {
+        AGM_LOGE("Invalid session op");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_INVALID_ARGS,
+                            "Invalid session op");
+        goto done;
+    }
+
+    for (i = 0; i < num_ops; i++) {
+        has_open |= ops[i].type == AGM_SESSION_OP_OPEN;
+        has_close |= ops[i].type == AGM_SESSION_OP_CLOSE;
+    }
+
+    ses_data = lookup_session_data(session_id);
+    if (ses_data == NULL && has_open) {
+        ses_data = get_session_data(mdata, session_id);
+        if (ses_data == NULL) {
+            agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                                "Unable to create session data");
+            goto done;
+        }
+    }
+    was_open = ses_data != NULL && ses_data->handle != 0;
+    if (was_open) {
+        handle = ses_data->handle;
+        /* the ring must not feed a session that is going away */
+        if (has_close)
+            ses_ring_release(ses_data);
+    }
+
+    ret = agm_session_run_ops(session_id, &handle, ops, num_ops);
+    if (ret)
+        AGM_LOGE("agm_session_run_ops failed %d", ret);
+    publish_generation();
+
+    if (ses_data != NULL) {
+        ses_data->handle = handle;
+        if (handle != 0 && !was_open) {
+            if (!dbus_connection_add_filter(conn,
+                                            disconnection_filter_cb,
+                                            GUINT_TO_POINTER(session_id),
+                                            NULL))
+                AGM_LOGE("Unable to add death notification filter");
+        } else if (handle == 0) {
+            if (was_open) {
+                dbus_connection_remove_filter(conn, disconnection_filter_cb,
+                                              GUINT_TO_POINTER(session_id));
+                ses_ring_release(ses_data);
+            }
+            if (ses_data_drop(ses_data))
+                AGM_LOGE("Unable to remove interface");
+            ses_data = NULL;
+        }
+    }
+
+    if (ses_data != NULL)
+        obj_path = ses_data->dbus_obj_path;
+    is_open = handle != 0;
+
+    reply = dbus_message_new_method_return(msg);
+    dbus_message_iter_init_append(reply, &arg_i);
+    dbus_message_iter_append_basic(&arg_i, DBUS_TYPE_OBJECT_PATH, &obj_path);
+    dbus_message_iter_append_basic(&arg_i, DBUS_TYPE_BOOLEAN, &is_open);
+    dbus_message_iter_open_container(&arg_i, DBUS_TYPE_ARRAY, "i", &status_i);
+    for (i = 0; i < num_ops; i++)
+        dbus_message_iter_append_basic(&status_i, DBUS_TYPE_INT32,
+                                       &ops[i].status);
+    dbus_message_iter_close_container(&arg_i, &status_i);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+
+done:
+    free(ops);
+    free(cfgs);
+}
+
+/* read-only fd to the generation page, see agm-dbus-gen.h */
+static void ipc_agm_get_generation_fd(DBusConnection *conn,
+                                      DBusMessage *msg,
+                                      void *userdata) {
+    DBusMessage *reply = NULL;
+    DBusMessageIter r_arg;
+    int fd;
+
+    if (userdata == NULL) {
+        AGM_LOGE("Invalid userdata");
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "userdata is NULL");
+        return;
+    }
+
+    AGM_LOGV("%s : ", __func__);
+
+    if (mdata->gen_page == NULL) {
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_NOT_SUPPORTED,
+                            "No generation page");
+        return;
+    }
+
+    fd = agm_dbus_gen_ro_fd(mdata->gen_fd);
+    if (fd < 0) {
+        AGM_LOGE("Unable to open generation page %d", fd);
+        agm_dbus_send_error(mdata->conn, msg, DBUS_ERROR_FAILED,
+                            "Unable to open generation page");
+        return;
+    }
+
+    reply = dbus_message_new_method_return(msg);
+    dbus_message_iter_init_append(reply, &r_arg);
+    /* the message takes its own duplicate of the fd */
+    dbus_message_iter_append_basic(&r_arg, DBUS_TYPE_UNIX_FD, &fd);
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+    close(fd);
+}
+
+/*
+ * Calls for a session run in order on that session's queue, whether they come
+ * in on its object or on the module interface with the session id first.
+ * Aif calls, which take an aif id first, share the module queue.
+ */
+static int64_t ipc_agm_route(DBusMessage *msg) {
+    const char *path = dbus_message_get_path(msg);
+    const char *member = dbus_message_get_member(msg);
+    DBusMessageIter arg_i;
+    uint32_t session_id;
+
+    if (path != NULL &&
+        sscanf(path, AGM_OBJECT_PATH "/session_%u", &session_id) == 1)
+        return session_id;
+
+    if (member == NULL || g_str_has_prefix(member, "AgmAif") ||
+        g_str_has_prefix(member, "AgmGetAif"))
+        return AGM_DBUS_QUEUE_MODULE;
+
+    if (dbus_message_iter_init(msg, &arg_i) &&
+        dbus_message_iter_get_arg_type(&arg_i) == DBUS_TYPE_UINT32) {
+        dbus_message_iter_get_basic(&arg_i, &session_id);
+        return session_id;
+    }
+
+    return AGM_DBUS_QUEUE_MODULE;
+}
+
 /* Initialize module data. Get dbus connection and register module interface
     with the connection */
 int ipc_agm_init() {
     DBusError err;
+    const char *rate;
     int rc = 0;
 
     AGM_LOGV("%s : ", __func__);
@@ -2321,14 +4102,35 @@ int ipc_agm_init() {
         return rc;
     }
 
+    events_dirty = g_ptr_array_new();
+    rate = getenv(AGM_EVENT_RATE_ENV);
+    if (rate != NULL) {
+        event_rate_cap = strtoul(rate, NULL, 0);
+        AGM_LOGI("data path events capped at %u/s per session",
+                 event_rate_cap);
+    }
+
     mdata->sessions = g_hash_table_new_full(g_direct_hash,
                                             g_direct_equal,
                                             NULL,
                                             agm_free_session);
 
+    mdata->gen_page = NULL;
+    mdata->gen_fd = agm_dbus_gen_create(&mdata->gen_page);
+    if (mdata->gen_fd < 0)
+        AGM_LOGE("No generation page %d, clients will not cache",
+                 mdata->gen_fd);
+
+    if (agm_dbus_start_workers(mdata->conn, ipc_agm_route))
+        AGM_LOGE("No worker threads, calls run on the main loop");
+
     if ((rc = agm_init()) != 0) {
         AGM_LOGE("agm initialization failed");
         agm_dbus_connection_free(mdata->conn);
+        if (mdata->gen_fd >= 0) {
+            munmap(mdata->gen_page, AGM_DBUS_GEN_PAGE_SIZE);
+            close(mdata->gen_fd);
+        }
         free(mdata->dbus_obj_path);
         mdata->dbus_obj_path = NULL;
         free(mdata);
@@ -2336,6 +4138,7 @@ int ipc_agm_init() {
         return rc;
     }
 
+    publish_generation();
     dbus_error_free(&err);
     return rc;
 }
@@ -2359,6 +4162,10 @@ void ipc_agm_deinit() {
     }
 
     agm_dbus_connection_free(mdata->conn);
+    if (mdata->gen_fd >= 0) {
+        munmap(mdata->gen_page, AGM_DBUS_GEN_PAGE_SIZE);
+        close(mdata->gen_fd);
+    }
     free(mdata);
     mdata = NULL;
 
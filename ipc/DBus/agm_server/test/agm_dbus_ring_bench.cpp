@@ -0,0 +1,607 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * PCM transport cost of the agm dbus IPC, per period.
+ *
+ * A forked server stands in for agm_server: it owns a name on a private
+ * dbus-daemon and hands every period it receives to a memcpy standing in
+ * for agm_session_write(). The client pushes periods through:
+ *   dbus       AgmSessionWrite as today, the period marshalled as "ay"
+ *              and copied again by the server, one blocking call each
+ *   ring       the memfd ring of agm-dbus-ring.h, eventfd doorbells
+ *   ring-sync  the ring, waiting for every period to be consumed, for the
+ *              latency of a single period
+ * and, to compare with agm_us_bench, makes argument-less AgmSessionStart
+ * calls for the round trip of a control call:
+ *   ctl        one blocking call after the other
+ * CPU time is reported for the client, the server and the bus daemon.
+ * Only libdbus is needed; pass -a to use an already running bus instead
+ * of starting one.
+ */
+
+#include <dbus/dbus.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "agm-dbus-ring.h"
+
+#define BENCH_NAME   "org.Qti.AgmRingBench"
+#define BENCH_PATH   "/org/qti/agm/session_1"
+#define BENCH_IFACE  "org.Qti.Agm.Session"
+
+struct server {
+    DBusConnection *conn;
+    struct agm_dbus_ring ring;
+    int kick_fd;
+    int notify_fd;
+    uint8_t *sink;
+    size_t sink_size;
+    int quit;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* utime + stime of a process, in us */
+static uint64_t proc_cpu_us(pid_t pid)
+{
+    char path[64], buf[1024], *p;
+    unsigned long utime, stime;
+    FILE *f;
+    int i;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    f = fopen(path, "r");
+    if (!f)
+        return 0;
+    if (!fgets(buf, sizeof(buf), f)) {
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+
+    /* fields 14 and 15, counted after the ")" closing the name */
+    p = strrchr(buf, ')');
+    for (i = 0; p && i < 12; i++)
+        p = strchr(p + 1, ' ');
+    if (!p || sscanf(p, " %lu %lu", &utime, &stime) != 2)
+        return 0;
+
+    return (uint64_t)(utime + stime) * 1000000 / sysconf(_SC_CLK_TCK);
+}
+
+/* stands in for agm_session_write() */
+static void server_consume(struct server *srv, const void *buf, size_t len)
+{
+    if (len > srv->sink_size)
+        len = srv->sink_size;
+    memcpy(srv->sink, buf, len);
+}
+
+static void server_drain_ring(struct server *srv)
+{
+    uint8_t *ptr;
+    uint32_t len;
+
+    while (!agm_dbus_ring_read_span(&srv->ring, &ptr, &len) && len) {
+        server_consume(srv, ptr, len);
+        agm_dbus_ring_consume(&srv->ring, len);
+        agm_dbus_ring_signal(srv->notify_fd);
+    }
+}
+
+static void server_write(struct server *srv, DBusMessage *msg,
+                         DBusMessage *reply)
+{
+    DBusMessageIter arg_i, array_i, r_arg;
+    uint32_t buf_size;
+    char *value = NULL;
+    int n_elements = 0;
+    void *buf;
+
+    /* the same unmarshal and copy as ipc_agm_session_write() */
+    dbus_message_iter_init(msg, &arg_i);
+    dbus_message_iter_get_basic(&arg_i, &buf_size);
+    dbus_message_iter_next(&arg_i);
+    dbus_message_iter_recurse(&arg_i, &array_i);
+    dbus_message_iter_get_fixed_array(&array_i, &value, &n_elements);
+    buf = malloc(n_elements);
+    memcpy(buf, value, n_elements);
+    server_consume(srv, buf, n_elements);
+    free(buf);
+
+    dbus_message_iter_init_append(reply, &r_arg);
+    dbus_message_iter_append_basic(&r_arg, DBUS_TYPE_UINT32, &buf_size);
+}
+
+static int server_map_ring(struct server *srv, DBusMessage *msg)
+{
+    int ring_fd = -1;
+    uint32_t dir;
+    int ret;
+
+    agm_dbus_ring_release(&srv->ring);
+    if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_UINT32, &dir,
+                               DBUS_TYPE_UNIX_FD, &ring_fd,
+                               DBUS_TYPE_UNIX_FD, &srv->kick_fd,
+                               DBUS_TYPE_UNIX_FD, &srv->notify_fd,
+                               DBUS_TYPE_INVALID))
+        return -EINVAL;
+
+    ret = agm_dbus_ring_attach(&srv->ring, ring_fd);
+    close(ring_fd);
+    return ret;
+}
+
+static DBusHandlerResult server_handler(DBusConnection *conn,
+                                        DBusMessage *msg, void *userdata)
+{
+    struct server *srv = (struct server *)userdata;
+    DBusMessage *reply;
+
+    if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_METHOD_CALL)
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+    reply = dbus_message_new_method_return(msg);
+    if (dbus_message_is_method_call(msg, BENCH_IFACE, "AgmSessionWrite")) {
+        server_write(srv, msg, reply);
+    } else if (dbus_message_is_method_call(msg, BENCH_IFACE,
+                                           "AgmSessionStart")) {
+        /* nothing to do, the reply is all that is timed */
+    } else if (dbus_message_is_method_call(msg, BENCH_IFACE,
+                                           "AgmSessionMapRing")) {
+        if (server_map_ring(srv, msg)) {
+            dbus_message_unref(reply);
+            reply = dbus_message_new_error(msg, DBUS_ERROR_FAILED,
+                                           "map failed");
+        }
+    } else if (dbus_message_is_method_call(msg, BENCH_IFACE, "Quit")) {
+        srv->quit = 1;
+    } else {
+        dbus_message_unref(reply);
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
+
+    dbus_connection_send(conn, reply, NULL);
+    dbus_connection_flush(conn);
+    dbus_message_unref(reply);
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static int server_run(const char *address, int ready_fd, size_t period)
+{
+    DBusObjectPathVTable vtable;
+    struct server srv;
+    struct pollfd pfd[2];
+    DBusError err;
+    int dbus_fd;
+    char c = 1;
+
+    memset(&srv, 0, sizeof(srv));
+    memset(&vtable, 0, sizeof(vtable));
+    srv.kick_fd = -1;
+    srv.sink_size = period;
+    srv.sink = (uint8_t *)malloc(period);
+
+    dbus_error_init(&err);
+    srv.conn = dbus_connection_open_private(address, &err);
+    if (!srv.conn || !dbus_bus_register(srv.conn, &err) ||
+        dbus_bus_request_name(srv.conn, BENCH_NAME, 0, &err) !=
+                              DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+        fprintf(stderr, "server: %s\n", err.message ? err.message : "");
+        return 1;
+    }
+
+    vtable.message_function = server_handler;
+    dbus_connection_register_object_path(srv.conn, BENCH_PATH, &vtable,
+                                         &srv);
+    dbus_connection_get_unix_fd(srv.conn, &dbus_fd);
+    if (write(ready_fd, &c, 1) != 1)
+        return 1;
+    close(ready_fd);
+
+    while (!srv.quit) {
+        while (dbus_connection_dispatch(srv.conn) ==
+               DBUS_DISPATCH_DATA_REMAINS)
+            ;
+        if (srv.quit)
+            break;
+
+        pfd[0].fd = dbus_fd;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = srv.kick_fd;
+        pfd[1].events = POLLIN;
+        if (poll(pfd, srv.kick_fd >= 0 ? 2 : 1, -1) < 0 && errno != EINTR)
+            break;
+
+        if (pfd[0].revents)
+            dbus_connection_read_write(srv.conn, 0);
+        if (srv.kick_fd >= 0 && pfd[1].revents) {
+            agm_dbus_ring_wait(srv.kick_fd, 0);
+            server_drain_ring(&srv);
+        }
+    }
+
+    dbus_connection_close(srv.conn);
+    dbus_connection_unref(srv.conn);
+    return 0;
+}
+
+static DBusMessage *call(DBusConnection *conn, DBusMessage *msg)
+{
+    DBusMessage *reply;
+    DBusError err;
+
+    dbus_error_init(&err);
+    reply = dbus_connection_send_with_reply_and_block(conn, msg, -1, &err);
+    dbus_message_unref(msg);
+    if (!reply) {
+        fprintf(stderr, "call failed: %s\n", err.message);
+        dbus_error_free(&err);
+    }
+
+    return reply;
+}
+
+static DBusMessage *new_call(const char *method)
+{
+    return dbus_message_new_method_call(BENCH_NAME, BENCH_PATH, BENCH_IFACE,
+                                        method);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+struct run {
+    const char *name;
+    uint64_t wall_ns;
+    uint64_t client_us, server_us, daemon_us;
+    uint64_t *lat_ns;
+};
+
+/* period 0 for control calls, which move no data */
+static void report(struct run *r, uint32_t n, size_t period)
+{
+    double secs = r->wall_ns / 1e9;
+
+    if (period)
+        printf("%-10s %8.0f periods/s %8.1f MB/s", r->name, n / secs,
+               n * (double)period / secs / 1e6);
+    else
+        printf("%-10s %8.0f calls/s   %13s", r->name, n / secs, "");
+    if (r->lat_ns) {
+        qsort(r->lat_ns, n, sizeof(*r->lat_ns), cmp_u64);
+        printf("  lat p50 %6.1f us p99 %6.1f us",
+               r->lat_ns[n / 2] / 1e3, r->lat_ns[n * 99 / 100] / 1e3);
+    }
+    printf("  cpu/%s client %5.1f server %5.1f bus %5.1f us\n",
+           period ? "period" : "call  ", (double)r->client_us / n,
+           (double)r->server_us / n, (double)r->daemon_us / n);
+}
+
+static uint64_t self_cpu_us(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 +
+           ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static int run_dbus(DBusConnection *conn, uint8_t *buf, size_t period,
+                    uint32_t n, uint64_t *lat)
+{
+    DBusMessageIter arg_i, array_i;
+    DBusMessage *msg, *reply;
+    uint32_t size = period;
+    uint64_t t;
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        t = now_ns();
+        msg = new_call("AgmSessionWrite");
+        dbus_message_iter_init_append(msg, &arg_i);
+        dbus_message_iter_append_basic(&arg_i, DBUS_TYPE_UINT32, &size);
+        dbus_message_iter_open_container(&arg_i, DBUS_TYPE_ARRAY, "y",
+                                         &array_i);
+        dbus_message_iter_append_fixed_array(&array_i, DBUS_TYPE_BYTE, &buf,
+                                             period);
+        dbus_message_iter_close_container(&arg_i, &array_i);
+        reply = call(conn, msg);
+        if (!reply)
+            return -1;
+        dbus_message_unref(reply);
+        lat[i] = now_ns() - t;
+    }
+
+    return 0;
+}
+
+static int run_ctl(DBusConnection *conn, uint32_t n, uint64_t *lat)
+{
+    DBusMessage *reply;
+    uint64_t t;
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        t = now_ns();
+        reply = call(conn, new_call("AgmSessionStart"));
+        if (!reply)
+            return -1;
+        dbus_message_unref(reply);
+        lat[i] = now_ns() - t;
+    }
+
+    return 0;
+}
+
+static int ring_map(DBusConnection *conn, struct agm_dbus_ring *ring,
+                    int *kick_fd, int *notify_fd, size_t period)
+{
+    uint32_t dir = AGM_DBUS_RING_PLAYBACK;
+    DBusMessage *msg, *reply;
+    int ring_fd;
+
+    ring_fd = agm_dbus_ring_create(ring, period * 4, dir);
+    *kick_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    *notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ring_fd < 0 || *kick_fd < 0 || *notify_fd < 0)
+        return -1;
+
+    msg = new_call("AgmSessionMapRing");
+    dbus_message_append_args(msg, DBUS_TYPE_UINT32, &dir,
+                             DBUS_TYPE_UNIX_FD, &ring_fd,
+                             DBUS_TYPE_UNIX_FD, kick_fd,
+                             DBUS_TYPE_UNIX_FD, notify_fd,
+                             DBUS_TYPE_INVALID);
+    reply = call(conn, msg);
+    close(ring_fd);
+    if (!reply)
+        return -1;
+    dbus_message_unref(reply);
+
+    return 0;
+}
+
+/* the client side of agm_session_write() over the ring */
+static int ring_write(struct agm_dbus_ring *ring, int kick_fd, int notify_fd,
+                      const uint8_t *buf, size_t len)
+{
+    size_t done = 0;
+    int n;
+
+    while (done < len) {
+        n = agm_dbus_ring_write(ring, buf + done, len - done);
+        if (n < 0)
+            return n;
+        if (n > 0) {
+            done += n;
+            agm_dbus_ring_signal(kick_fd);
+            continue;
+        }
+        if (agm_dbus_ring_wait(notify_fd, 5000))
+            return -ETIMEDOUT;
+    }
+
+    return 0;
+}
+
+static int run_ring(struct agm_dbus_ring *ring, int kick_fd, int notify_fd,
+                    uint8_t *buf, size_t period, uint32_t n, uint64_t *lat)
+{
+    uint64_t t;
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        t = now_ns();
+        if (ring_write(ring, kick_fd, notify_fd, buf, period))
+            return -1;
+        if (lat) {
+            while (agm_dbus_ring_load(&ring->hdr->tail) != ring->hdr->head)
+                if (agm_dbus_ring_wait(notify_fd, 5000))
+                    return -1;
+            lat[i] = now_ns() - t;
+        }
+    }
+
+    /* everything consumed before the clock stops */
+    while (agm_dbus_ring_load(&ring->hdr->tail) != ring->hdr->head)
+        if (agm_dbus_ring_wait(notify_fd, 5000))
+            return -1;
+
+    return 0;
+}
+
+static pid_t start_daemon(const char *daemon, char *address, size_t len)
+{
+    static const char conf[] =
+        "<!DOCTYPE busconfig PUBLIC \"-//freedesktop//DTD D-BUS Bus "
+        "Configuration 1.0//EN\" "
+        "\"http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd\">\n"
+        "<busconfig><type>session</type>"
+        "<listen>unix:tmpdir=/tmp</listen><auth>EXTERNAL</auth>"
+        "<policy context=\"default\"><allow send_destination=\"*\"/>"
+        "<allow receive_sender=\"*\"/>"
+        "<allow own=\"*\"/></policy></busconfig>\n";
+    char conf_path[] = "/tmp/agm_ring_bench_XXXXXX";
+    char arg_conf[128], arg_fd[32];
+    int pfd[2], fd;
+    ssize_t n;
+    pid_t pid;
+
+    fd = mkstemp(conf_path);
+    if (fd < 0 || write(fd, conf, sizeof(conf) - 1) < 0 || pipe(pfd))
+        return -1;
+    close(fd);
+
+    pid = fork();
+    if (pid == 0) {
+        close(pfd[0]);
+        snprintf(arg_conf, sizeof(arg_conf), "--config-file=%s", conf_path);
+        snprintf(arg_fd, sizeof(arg_fd), "--print-address=%d", pfd[1]);
+        execlp(daemon, daemon, arg_conf, "--nofork", arg_fd, (char *)NULL);
+        _exit(127);
+    }
+    close(pfd[1]);
+
+    n = read(pfd[0], address, len - 1);
+    close(pfd[0]);
+    unlink(conf_path);
+    if (n <= 0)
+        return -1;
+    address[n] = '\0';
+    address[strcspn(address, "\n")] = '\0';
+
+    return pid;
+}
+
+static void usage(void)
+{
+    printf(" Usage: agm_dbus_ring_bench [-p period_bytes] [-n periods]"
+           " [-a bus_address] [-d dbus-daemon]\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *daemon = "dbus-daemon";
+    char address[512] = "";
+    size_t period = 48 * 8 * 4 * 10;    /* 10 ms of 48 kHz, 8 ch, 32 bit */
+    uint32_t n = 2000;
+    pid_t daemon_pid = -1, server_pid;
+    struct agm_dbus_ring ring;
+    int kick_fd, notify_fd, ready[2], opt, i, rc = 1;
+    uint64_t *lat, c0, s0, d0, t0;
+    DBusConnection *conn;
+    struct run runs[4];
+    DBusMessage *msg;
+    DBusError err;
+    uint8_t *buf;
+    char c;
+
+    while ((opt = getopt(argc, argv, "p:n:a:d:h")) != -1) {
+        switch (opt) {
+        case 'p':
+            period = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            n = strtoul(optarg, NULL, 0);
+            break;
+        case 'a':
+            snprintf(address, sizeof(address), "%s", optarg);
+            break;
+        case 'd':
+            daemon = optarg;
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (!period || n < 100) {
+        usage();
+        return 1;
+    }
+
+    if (!address[0]) {
+        daemon_pid = start_daemon(daemon, address, sizeof(address));
+        if (daemon_pid < 0) {
+            fprintf(stderr, "cannot start %s\n", daemon);
+            return 1;
+        }
+    }
+
+    if (pipe(ready))
+        goto done;
+    server_pid = fork();
+    if (server_pid == 0) {
+        close(ready[0]);
+        _exit(server_run(address, ready[1], period));
+    }
+    close(ready[1]);
+    if (read(ready[0], &c, 1) != 1) {
+        fprintf(stderr, "server did not start\n");
+        goto done;
+    }
+
+    dbus_error_init(&err);
+    conn = dbus_connection_open_private(address, &err);
+    if (!conn || !dbus_bus_register(conn, &err)) {
+        fprintf(stderr, "client: %s\n", err.message);
+        goto done;
+    }
+
+    buf = (uint8_t *)malloc(period);
+    memset(buf, 0x5a, period);
+    memset(runs, 0, sizeof(runs));
+    memset(&ring, 0, sizeof(ring));
+    runs[0].name = "dbus";
+    runs[1].name = "ring";
+    runs[2].name = "ring-sync";
+    runs[3].name = "ctl";
+    runs[0].lat_ns = (uint64_t *)calloc(n, sizeof(uint64_t));
+    runs[2].lat_ns = (uint64_t *)calloc(n, sizeof(uint64_t));
+    runs[3].lat_ns = (uint64_t *)calloc(n, sizeof(uint64_t));
+
+    if (ring_map(conn, &ring, &kick_fd, &notify_fd, period)) {
+        fprintf(stderr, "ring setup failed\n");
+        goto done;
+    }
+
+    printf("%zu byte periods, %u per run, bus %s\n", period, n, address);
+    for (i = 0; i < 4; i++) {
+        lat = runs[i].lat_ns;
+        c0 = self_cpu_us();
+        s0 = proc_cpu_us(server_pid);
+        d0 = daemon_pid > 0 ? proc_cpu_us(daemon_pid) : 0;
+        t0 = now_ns();
+        if (i == 0)
+            rc = run_dbus(conn, buf, period, n, lat);
+        else if (i == 3)
+            rc = run_ctl(conn, n, lat);
+        else
+            rc = run_ring(&ring, kick_fd, notify_fd, buf, period, n, lat);
+        runs[i].wall_ns = now_ns() - t0;
+        runs[i].client_us = self_cpu_us() - c0;
+        runs[i].server_us = proc_cpu_us(server_pid) - s0;
+        runs[i].daemon_us = daemon_pid > 0 ? proc_cpu_us(daemon_pid) - d0 : 0;
+        if (rc)
+            goto done;
+        report(&runs[i], n, i == 3 ? 0 : period);
+    }
+
+    msg = new_call("Quit");
+    dbus_connection_send(conn, msg, NULL);
+    dbus_message_unref(msg);
+    dbus_connection_flush(conn);
+    waitpid(server_pid, NULL, 0);
+    rc = 0;
+
+done:
+    if (daemon_pid > 0) {
+        kill(daemon_pid, SIGTERM);
+        waitpid(daemon_pid, NULL, 0);
+    }
+    return rc;
+}
@@ -51,6 +51,9 @@ using vendor::qti::hardware::AGMIPC::V1_0::IAGMCallback;
 using vendor::qti::hardware::AGMIPC::V1_0::implementation::AGMCallback;
 using vendor::qti::hardware::AGMIPC::V1_0::MmapBufInfo;
 using vendor::qti::hardware::AGMIPC::V1_0::AgmDumpInfo;
+using vendor::qti::hardware::AGMIPC::V1_0::AgmSessionStats;
+using vendor::qti::hardware::AGMIPC::V1_0::AgmSessionRecoveryInfo;
+using vendor::qti::hardware::AGMIPC::V1_0::AgmSessionOp;
 using android::hardware::defaultPassthroughServiceImplementation;
 using android::hardware::configureRpcThreadpool;
 using android::hardware::joinRpcThreadpool;
@@ -242,6 +245,15 @@ int agm_session_close(uint64_t handle){
     return -EINVAL;
 }
 
+int agm_session_close_async(uint64_t handle){
+    ALOGV("%s called with handle = %llx \n", __func__, (unsigned long long) handle);
+    if (!agm_server_died) {
+        android::sp<IAGM> agm_client = get_agm_server();
+        return agm_client->ipc_agm_session_close_async(handle);
+    }
+    return -EINVAL;
+}
+
 int agm_session_prepare(uint64_t handle){
     ALOGV("%s called with handle = %llx \n", __func__, (unsigned long long) handle);
     if (!agm_server_died) {
@@ -531,6 +543,14 @@ int agm_aif_set_params(uint32_t aif_id, void *payload, size_t size)
     return -EINVAL;
 }
 
+int agm_aif_set_params_take(uint32_t aif_id, void *payload, size_t size)
+{
+    int ret = agm_aif_set_params(aif_id, payload, size);
+
+    free(payload);
+    return ret;
+}
+
 int agm_session_aif_set_params(uint32_t session_id, uint32_t aif_id,
                                                     void *payload, size_t size)
 {
@@ -551,6 +571,15 @@ int agm_session_aif_set_params(uint32_t session_id, uint32_t aif_id,
     return -EINVAL;
 }
 
+int agm_session_aif_set_params_take(uint32_t session_id, uint32_t aif_id,
+                                    void *payload, size_t size)
+{
+    int ret = agm_session_aif_set_params(session_id, aif_id, payload, size);
+
+    free(payload);
+    return ret;
+}
+
 int agm_session_set_params(uint32_t session_id, void *payload, size_t size)
 {
     ALOGV("%s : sess_id = %d, size = %zu\n", __func__, session_id, size);
@@ -1120,6 +1149,203 @@ int agm_session_write_datapath_params(uint32_t session_id, struct agm_buff *buf)
     return -EINVAL;
 }
 
+int agm_session_get_stats(uint32_t session_id, struct agm_session_stats *stats)
+{
+    ALOGV("%s : session_id = %u\n", __func__, session_id);
+    int ret = -EINVAL;
+    if (!agm_server_died) {
+        android::sp<IAGM> agm_client = get_agm_server();
+        auto status = agm_client->ipc_agm_session_get_stats(session_id,
+                                  [&](int32_t _ret, const AgmSessionStats& s)
+                                  { ret = _ret;
+                                    if (ret)
+                                        return;
+                                    memset(stats, 0, sizeof(*stats));
+                                    stats->num_writes = s.num_writes;
+                                    stats->num_reads = s.num_reads;
+                                    stats->bytes_written = s.bytes_written;
+                                    stats->bytes_read = s.bytes_read;
+                                    stats->num_underruns = s.num_underruns;
+                                    stats->num_overruns = s.num_overruns;
+                                    stats->num_poll_timeouts = s.num_poll_timeouts;
+                                    stats->max_pos_interval_us = s.max_pos_interval_us;
+                                    stats->latency_us = s.latency_us;
+                                  });
+        if (!status.isOk()) {
+            ALOGE("%s: HIDL call failed. ret=%d\n", __func__, ret);
+            ret = -EINVAL;
+        }
+    }
+    return ret;
+}
+
+int agm_session_update_stats(uint64_t hndl,
+                             const struct agm_session_stats *delta)
+{
+    ALOGV("%s : handle = %llx \n", __func__, (unsigned long long) hndl);
+    if (!agm_server_died) {
+        android::sp<IAGM> agm_client = get_agm_server();
+        AgmSessionStats delta_hidl = {};
+
+        /* transfer counts are kept by agm, only send what the client saw */
+        delta_hidl.num_underruns = delta->num_underruns;
+        delta_hidl.num_overruns = delta->num_overruns;
+        delta_hidl.num_poll_timeouts = delta->num_poll_timeouts;
+        delta_hidl.max_pos_interval_us = delta->max_pos_interval_us;
+        delta_hidl.latency_us = delta->latency_us;
+        return agm_client->ipc_agm_session_update_stats(hndl, delta_hidl);
+    }
+    return -EINVAL;
+}
+
+int agm_session_group_start(uint64_t *handles, uint32_t num_handles,
+                            uint64_t *start_skew_us)
+{
+    ALOGV("%s : num_handles = %u\n", __func__, num_handles);
+    int ret = -EINVAL;
+    if (!agm_server_died) {
+        android::sp<IAGM> agm_client = get_agm_server();
+        hidl_vec<uint64_t> handles_hidl;
+
+        if (handles == NULL || num_handles == 0)
+            return -EINVAL;
+
+        handles_hidl.resize(num_handles);
+        memcpy(handles_hidl.data(), handles, num_handles * sizeof(uint64_t));
+        auto status = agm_client->ipc_agm_session_group_start(handles_hidl,
+                                  start_skew_us != NULL,
+                                  [&](int32_t _ret, uint64_t skew)
+                                  { ret = _ret;
+                                    if (start_skew_us)
+                                        *start_skew_us = ret ? 0 : skew;
+                                  });
+        if (!status.isOk()) {
+            ALOGE("%s: HIDL call failed. ret=%d\n", __func__, ret);
+            ret = -EINVAL;
+        }
+    }
+    return ret;
+}
+
+int agm_session_group_stop(uint64_t *handles, uint32_t num_handles)
+{
+    ALOGV("%s : num_handles = %u\n", __func__, num_handles);
+    if (!agm_server_died) {
+        android::sp<IAGM> agm_client = get_agm_server();
+        hidl_vec<uint64_t> handles_hidl;
+
+        if (handles == NULL || num_handles == 0)
+            return -EINVAL;
+
+        handles_hidl.resize(num_handles);
+        memcpy(handles_hidl.data(), handles, num_handles * sizeof(uint64_t));
+        return agm_client->ipc_agm_session_group_stop(handles_hidl);
+    }
+    return -EINVAL;
+}
+
+int agm_recover_all(struct agm_session_recovery_info *info,
+                    size_t *num_sessions)
+{
+    ALOGV("%s called\n", __func__);
+    if (!agm_server_died) {
+        android::sp<IAGM> agm_client = get_agm_server();
+        int ret = -EINVAL;
+
+        if (num_sessions == NULL)
+            return -EINVAL;
+
+        auto status = agm_client->ipc_agm_recover_all((uint32_t) *num_sessions,
+                                  [&](int32_t _ret,
+                                      hidl_vec<AgmSessionRecoveryInfo> info_ret,
+                                      uint32_t num_sessions_ret)
+        { ret = _ret;
+          if (ret != -ENOMEM) {
+              if (info != NULL) {
+                  for (size_t i = 0; i < info_ret.size(); i++) {
+                      info[i].session_id = info_ret.data()[i].session_id;
+                      info[i].status = info_ret.data()[i].status;
+                      info[i].recovery_time_us =
+                                      info_ret.data()[i].recovery_time_us;
+                  }
+              }
+              *num_sessions = (size_t) num_sessions_ret;
+          }
+        });
+        if (!status.isOk()) {
+            ALOGE("%s: HIDL call failed. ret=%d\n", __func__, ret);
+        }
+        return ret;
+    }
+    return -EINVAL;
+}
+
+int agm_session_run_ops(uint32_t session_id, uint64_t *hndl,
+                        struct agm_session_op *ops, uint32_t num_ops)
+{
+    ALOGV("%s : session_id = %u, num_ops = %u\n", __func__, session_id, num_ops);
+    if (!agm_server_died) {
+        android::sp<IAGM> agm_client = get_agm_server();
+        hidl_vec<AgmSessionOp> ops_hidl;
+        int32_t ret = -EINVAL;
+        uint32_t i;
+
+        if (hndl == NULL || ops == NULL || num_ops == 0)
+            return -EINVAL;
+
+        ops_hidl.resize(num_ops);
+        for (i = 0; i < num_ops; i++) {
+            ops_hidl[i].type = ops[i].type;
+            ops_hidl[i].sess_mode = (AgmSessionMode) ops[i].sess_mode;
+            ops_hidl[i].aif_id = ops[i].aif_id;
+            ops_hidl[i].state = ops[i].state;
+            if (ops[i].size && ops[i].payload) {
+                ops_hidl[i].payload.resize(ops[i].size);
+                memcpy(ops_hidl[i].payload.data(), ops[i].payload,
+                       ops[i].size);
+            }
+            ops[i].status = -ECANCELED;
+            if (ops[i].type != AGM_SESSION_OP_SET_CONFIG)
+                continue;
+
+            if (!ops[i].session_config || !ops[i].media_config ||
+                !ops[i].buffer_config)
+                return -EINVAL;
+            ops_hidl[i].session_config.resize(1);
+            memcpy(ops_hidl[i].session_config.data(), ops[i].session_config,
+                   sizeof(struct agm_session_config));
+            ops_hidl[i].media_config.resize(1);
+            ops_hidl[i].media_config[0].rate = ops[i].media_config->rate;
+            ops_hidl[i].media_config[0].channels = ops[i].media_config->channels;
+            ops_hidl[i].media_config[0].format =
+                (::vendor::qti::hardware::AGMIPC::V1_0::AgmMediaFormat)
+                        ops[i].media_config->format;
+            ops_hidl[i].media_config[0].data_format =
+                        ops[i].media_config->data_format;
+            ops_hidl[i].buffer_config.resize(1);
+            ops_hidl[i].buffer_config[0].count = ops[i].buffer_config->count;
+            ops_hidl[i].buffer_config[0].size = ops[i].buffer_config->size;
+            ops_hidl[i].buffer_config[0].max_metadata_size =
+                        ops[i].buffer_config->max_metadata_size;
+        }
+
+        auto status = agm_client->ipc_agm_session_run_ops(session_id, *hndl,
+                                  ops_hidl,
+                                  [&](int32_t _ret, uint64_t hndl_ret,
+                                      hidl_vec<int32_t> status_ret)
+        { ret = _ret;
+          *hndl = hndl_ret;
+          for (i = 0; i < num_ops && i < status_ret.size(); i++)
+              ops[i].status = status_ret[i];
+        });
+        if (!status.isOk()) {
+            ALOGE("%s: HIDL call failed. ret=%d\n", __func__, ret);
+        }
+        return ret;
+    }
+    return -EINVAL;
+}
+
 int agm_dump(struct agm_dump_info *dump_info) {
     if (agm_server_died) {
         ALOGE("%s: Cannot perform dump, AGM service has died", __func__);
@@ -195,6 +195,12 @@ struct AGM : public IAGM {
                        const hidl_vec<AgmMediaConfig>& media_config,
                        const hidl_vec<AgmBufferConfig>& buffer_config) override;
     Return<int32_t> ipc_agm_session_close(uint64_t hndl) override;
+    Return<int32_t> ipc_agm_session_close_async(uint64_t hndl) override;
+    Return<void> ipc_agm_recover_all(uint32_t num_sessions,
+                               ipc_agm_recover_all_cb _hidl_cb) override;
+    Return<void> ipc_agm_session_run_ops(uint32_t session_id, uint64_t hndl,
+                               const hidl_vec<AgmSessionOp>& ops,
+                               ipc_agm_session_run_ops_cb _hidl_cb) override;
     Return<int32_t> ipc_agm_session_prepare(uint64_t hndl) override;
     Return<int32_t> ipc_agm_session_start(uint64_t hndl) override;
     Return<int32_t> ipc_agm_session_stop(uint64_t hndl) override;
@@ -251,6 +257,15 @@ struct AGM : public IAGM {
                                ipc_agm_get_aif_info_list_cb _hidl_cb) override;
     Return<int32_t> ipc_agm_session_write_datapath_params(uint32_t session_id,
                                const hidl_vec<AgmBuff>& buff) override;
+    Return<void> ipc_agm_session_get_stats(uint32_t session_id,
+                               ipc_agm_session_get_stats_cb _hidl_cb) override;
+    Return<int32_t> ipc_agm_session_update_stats(uint64_t hndl,
+                               const AgmSessionStats& delta) override;
+    Return<void> ipc_agm_session_group_start(const hidl_vec<uint64_t>& hndls,
+                               bool get_skew,
+                               ipc_agm_session_group_start_cb _hidl_cb) override;
+    Return<int32_t> ipc_agm_session_group_stop(
+                               const hidl_vec<uint64_t>& hndls) override;
 
     int is_agm_initialized() { return agm_initialized;}
 
@@ -1006,8 +1006,9 @@ Return<int32_t> AGM::ipc_agm_session_set_config(uint64_t hndl,
     return ret;
 }
 
-Return<int32_t> AGM::ipc_agm_session_close(uint64_t hndl) {
-    ALOGV("%s called with handle = %llx \n", __func__, (unsigned long long) hndl);
+/* forget a handle of the calling client that is being closed */
+static void remove_session_handle_from_list(uint64_t hndl)
+{
     struct listnode *node = NULL;
     struct listnode *tempnode = NULL;
     agm_client_session_handle *session_handle = NULL;
@@ -1043,9 +1044,22 @@ Return<int32_t> AGM::ipc_agm_session_close(uint64_t hndl) {
     }
 done:
     pthread_mutex_unlock(&client_list_lock);
+}
+
+Return<int32_t> AGM::ipc_agm_session_close(uint64_t hndl) {
+    ALOGV("%s called with handle = %llx \n", __func__, (unsigned long long) hndl);
+
+    remove_session_handle_from_list(hndl);
     return agm_session_close(hndl);
 }
 
+Return<int32_t> AGM::ipc_agm_session_close_async(uint64_t hndl) {
+    ALOGV("%s called with handle = %llx \n", __func__, (unsigned long long) hndl);
+
+    remove_session_handle_from_list(hndl);
+    return agm_session_close_async(hndl);
+}
+
 Return<int32_t> AGM::ipc_agm_session_prepare(uint64_t hndl) {
     ALOGV("%s called with handle = %llx \n", __func__, (unsigned long long) hndl);
 
@@ -1651,6 +1665,210 @@ exit:
     return ret;
 }
 
+Return<void> AGM::ipc_agm_session_get_stats(uint32_t session_id,
+                                          ipc_agm_session_get_stats_cb _hidl_cb)
+{
+    struct agm_session_stats stats;
+    AgmSessionStats stats_ret = {};
+    int32_t ret;
+
+    ALOGV("%s : session_id = %u\n", __func__, session_id);
+    ret = agm_session_get_stats(session_id, &stats);
+    if (!ret) {
+        stats_ret.num_writes = stats.num_writes;
+        stats_ret.num_reads = stats.num_reads;
+        stats_ret.bytes_written = stats.bytes_written;
+        stats_ret.bytes_read = stats.bytes_read;
+        stats_ret.num_underruns = stats.num_underruns;
+        stats_ret.num_overruns = stats.num_overruns;
+        stats_ret.num_poll_timeouts = stats.num_poll_timeouts;
+        stats_ret.max_pos_interval_us = stats.max_pos_interval_us;
+        stats_ret.latency_us = stats.latency_us;
+    }
+    _hidl_cb(ret, stats_ret);
+    return Void();
+}
+
+Return<int32_t> AGM::ipc_agm_session_update_stats(uint64_t hndl,
+                                                  const AgmSessionStats& delta)
+{
+    struct agm_session_stats stats = {};
+
+    ALOGV("%s : handle = %llx \n", __func__, (unsigned long long) hndl);
+    stats.num_underruns = delta.num_underruns;
+    stats.num_overruns = delta.num_overruns;
+    stats.num_poll_timeouts = delta.num_poll_timeouts;
+    stats.max_pos_interval_us = delta.max_pos_interval_us;
+    stats.latency_us = delta.latency_us;
+    return agm_session_update_stats(hndl, &stats);
+}
+
+Return<void> AGM::ipc_agm_session_group_start(const hidl_vec<uint64_t>& hndls,
+                                          bool get_skew,
+                                          ipc_agm_session_group_start_cb _hidl_cb)
+{
+    uint64_t start_skew_us = 0;
+    int32_t ret;
+
+    ALOGV("%s : num_hndls = %zu\n", __func__, hndls.size());
+    ret = agm_session_group_start((uint64_t *)hndls.data(), hndls.size(),
+                                  get_skew ? &start_skew_us : NULL);
+    _hidl_cb(ret, start_skew_us);
+    return Void();
+}
+
+Return<int32_t> AGM::ipc_agm_session_group_stop(const hidl_vec<uint64_t>& hndls)
+{
+    ALOGV("%s : num_hndls = %zu\n", __func__, hndls.size());
+    return agm_session_group_stop((uint64_t *)hndls.data(), hndls.size());
+}
+
+Return<void> AGM::ipc_agm_recover_all(uint32_t num_sessions,
+                                      ipc_agm_recover_all_cb _hidl_cb)
+{
+    hidl_vec<AgmSessionRecoveryInfo> info_ret;
+    struct agm_session_recovery_info *info = NULL;
+    size_t num_sessions_ret = (size_t) num_sessions;
+    int32_t ret;
+
+    ALOGV("%s : num_sessions = %u\n", __func__, num_sessions);
+    if (num_sessions != 0) {
+        info = (struct agm_session_recovery_info *)
+                    calloc(num_sessions, sizeof(struct agm_session_recovery_info));
+        if (info == NULL) {
+            ALOGE("%s: Cannot allocate memory for info\n", __func__);
+            _hidl_cb(-ENOMEM, info_ret, 0);
+            return Void();
+        }
+    }
+
+    ret = agm_recover_all(info, &num_sessions_ret);
+    info_ret.resize(num_sessions_ret < num_sessions ?
+                    num_sessions_ret : num_sessions);
+    for (size_t i = 0; i < info_ret.size(); i++) {
+        info_ret.data()[i].session_id = info[i].session_id;
+        info_ret.data()[i].status = info[i].status;
+        info_ret.data()[i].recovery_time_us = info[i].recovery_time_us;
+    }
+    _hidl_cb(ret, info_ret, (uint32_t) num_sessions_ret);
+    free(info);
+    return Void();
+}
+
+Return<void> AGM::ipc_agm_session_run_ops(uint32_t session_id, uint64_t hndl,
+                                          const hidl_vec<AgmSessionOp>& ops,
+                                          ipc_agm_session_run_ops_cb _hidl_cb)
+{
+    hidl_vec<int32_t> status_ret;
+    struct agm_session_op *ops_local = NULL;
+    struct agm_session_config *session_configs = NULL;
+    struct agm_media_config *media_configs = NULL;
+    struct agm_buffer_config *buffer_configs = NULL;
+    agm_client_session_handle *session_handle = NULL;
+    uint64_t handle = hndl;
+    size_t i, num_ops = ops.size();
+    int32_t ret = -EINVAL;
+
+    ALOGV("%s : session_id = %u, handle = %llx, num_ops = %zu\n", __func__,
+          session_id, (unsigned long long) hndl, num_ops);
+    if (num_ops == 0)
+        goto exit;
+
+    ops_local = (struct agm_session_op *)
+                    calloc(num_ops, sizeof(struct agm_session_op));
+    session_configs = (struct agm_session_config *)
+                    calloc(num_ops, sizeof(struct agm_session_config));
+    media_configs = (struct agm_media_config *)
+                    calloc(num_ops, sizeof(struct agm_media_config));
+    buffer_configs = (struct agm_buffer_config *)
+                    calloc(num_ops, sizeof(struct agm_buffer_config));
+    if (!ops_local || !session_configs || !media_configs || !buffer_configs) {
+        ALOGE("%s: Cannot allocate memory for %zu ops\n", __func__, num_ops);
+        ret = -ENOMEM;
+        goto exit;
+    }
+
+    for (i = 0; i < num_ops; i++) {
+        if (ops[i].type > AGM_SESSION_OP_CLOSE)
+            goto exit;
+
+        ops_local[i].type = (enum agm_session_op_type) ops[i].type;
+        ops_local[i].sess_mode = (enum agm_session_mode) ops[i].sess_mode;
+        ops_local[i].aif_id = ops[i].aif_id;
+        ops_local[i].state = ops[i].state;
+        ops_local[i].size = ops[i].payload.size();
+        ops_local[i].payload = ops[i].payload.size() ?
+                               (void *) ops[i].payload.data() : NULL;
+        if (ops_local[i].type != AGM_SESSION_OP_SET_CONFIG)
+            continue;
+
+        if (ops[i].session_config.size() != 1 ||
+            ops[i].media_config.size() != 1 ||
+            ops[i].buffer_config.size() != 1)
+            goto exit;
+        memcpy(&session_configs[i], ops[i].session_config.data(),
+               sizeof(struct agm_session_config));
+        media_configs[i].rate = ops[i].media_config[0].rate;
+        media_configs[i].channels = ops[i].media_config[0].channels;
+        media_configs[i].format =
+                    (enum agm_media_format) ops[i].media_config[0].format;
+        media_configs[i].data_format = ops[i].media_config[0].data_format;
+        buffer_configs[i].count = ops[i].buffer_config[0].count;
+        buffer_configs[i].size = ops[i].buffer_config[0].size;
+        buffer_configs[i].max_metadata_size =
+                    ops[i].buffer_config[0].max_metadata_size;
+        ops_local[i].session_config = &session_configs[i];
+        ops_local[i].media_config = &media_configs[i];
+        ops_local[i].buffer_config = &buffer_configs[i];
+    }
+
+    /* a list that opens the session is tracked like ipc_agm_session_open */
+    if (hndl == 0) {
+        pthread_mutex_lock(&client_list_lock);
+        session_handle = get_session_handle_l(session_id);
+        pthread_mutex_unlock(&client_list_lock);
+        if (!session_handle)
+            goto exit;
+        pthread_mutex_lock(&session_handle->handle_lock);
+    }
+
+    ret = agm_session_run_ops(session_id, &handle, ops_local, num_ops);
+
+    if (session_handle) {
+        if (handle)
+            add_session_handle_to_list_l(session_id, handle);
+        pthread_mutex_unlock(&session_handle->handle_lock);
+    } else if (handle == 0) {
+        remove_session_handle_from_list(hndl);
+    }
+
+    /* a failed list has undone its aif connects */
+    if (!ret) {
+        pthread_mutex_lock(&client_list_lock);
+        for (i = 0; i < num_ops; i++) {
+            if (ops_local[i].type != AGM_SESSION_OP_AIF_CONNECT)
+                continue;
+            if (ops_local[i].state)
+                add_session_aif_to_list_l(session_id, ops_local[i].aif_id);
+            else
+                remove_session_aif_from_list_l(session_id, ops_local[i].aif_id);
+        }
+        pthread_mutex_unlock(&client_list_lock);
+    }
+
+    status_ret.resize(num_ops);
+    for (i = 0; i < num_ops; i++)
+        status_ret[i] = ops_local[i].status;
+
+exit:
+    _hidl_cb(ret, handle, status_ret);
+    free(buffer_configs);
+    free(media_configs);
+    free(session_configs);
+    free(ops_local);
+    return Void();
+}
+
 Return<int32_t> AGM::ipc_agm_dump(const hidl_vec<AgmDumpInfo>& dump_info) {
     struct agm_dump_info *d_info =
             (struct agm_dump_info *)dump_info.data();
@@ -211,6 +211,16 @@ int agm_session_close(uint64_t handle)
     return -EAGAIN;
 }
 
+int agm_session_close_async(uint64_t handle)
+{
+    if (!agm_server_died) {
+        android::sp<IAgmService> agm_client = get_agm_server();
+        return agm_client->ipc_agm_session_close_async(handle);
+    }
+    AGM_LOGE("%s: agm service is not running\n", __func__);
+    return -EAGAIN;
+}
+
 int agm_session_prepare(uint64_t handle)
 {
     if (!agm_server_died) {
@@ -369,6 +379,15 @@ int agm_aif_set_params(uint32_t aif_id,void *payload, size_t size)
     return -EAGAIN;
 }
 
+/* the payload is copied into the parcel either way */
+int agm_aif_set_params_take(uint32_t aif_id, void *payload, size_t size)
+{
+    int ret = agm_aif_set_params(aif_id, payload, size);
+
+    free(payload);
+    return ret;
+}
+
 int agm_session_aif_set_params(uint32_t session_id, uint32_t aif_id,
                                          void *payload, size_t size)
 {
@@ -381,6 +400,15 @@ int agm_session_aif_set_params(uint32_t session_id, uint32_t aif_id,
     return -EAGAIN;
 }
 
+int agm_session_aif_set_params_take(uint32_t session_id, uint32_t aif_id,
+                                    void *payload, size_t size)
+{
+    int ret = agm_session_aif_set_params(session_id, aif_id, payload, size);
+
+    free(payload);
+    return ret;
+}
+
 int agm_session_set_params(uint32_t session_id, void *payload, size_t size)
 {
     if (!agm_server_died) {
@@ -516,3 +544,70 @@ int agm_session_get_buf_info(uint32_t session_id, struct agm_buf_info *buf_info,
     ALOGE("%s: agm service is not running\n", __func__);
     return -EAGAIN;
 }
+
+int agm_recover_all(struct agm_session_recovery_info *info,
+                    size_t *num_sessions)
+{
+    if (!num_sessions || (*num_sessions && !info))
+        return -EINVAL;
+
+    if(!agm_server_died) {
+        android::sp<IAgmService> agm_client = get_agm_server();
+        return agm_client->ipc_agm_recover_all(info, num_sessions);
+    }
+    ALOGE("%s: agm service is not running\n", __func__);
+    return -EAGAIN;
+}
+
+int agm_session_group_start(uint64_t *handles, uint32_t num_handles,
+                            uint64_t *start_skew_us)
+{
+    if (!handles || num_handles == 0)
+        return -EINVAL;
+
+    if(!agm_server_died) {
+        android::sp<IAgmService> agm_client = get_agm_server();
+        return agm_client->ipc_agm_session_group_start(handles, num_handles,
+                                                       start_skew_us);
+    }
+    ALOGE("%s: agm service is not running\n", __func__);
+    return -EAGAIN;
+}
+
+int agm_session_group_stop(uint64_t *handles, uint32_t num_handles)
+{
+    if (!handles || num_handles == 0)
+        return -EINVAL;
+
+    if(!agm_server_died) {
+        android::sp<IAgmService> agm_client = get_agm_server();
+        return agm_client->ipc_agm_session_group_stop(handles, num_handles);
+    }
+    ALOGE("%s: agm service is not running\n", __func__);
+    return -EAGAIN;
+}
+
+int agm_session_run_ops(uint32_t session_id, uint64_t *hndl,
+                        struct agm_session_op *ops, uint32_t num_ops)
+{
+    uint32_t i;
+
+    if (!hndl || !ops || num_ops == 0)
+        return -EINVAL;
+
+    for (i = 0; i < num_ops; i++) {
+        if (ops[i].type == AGM_SESSION_OP_SET_CONFIG &&
+            (!ops[i].session_config || !ops[i].media_config ||
+             !ops[i].buffer_config))
+            return -EINVAL;
+        ops[i].status = -ECANCELED;
+    }
+
+    if(!agm_server_died) {
+        android::sp<IAgmService> agm_client = get_agm_server();
+        return agm_client->ipc_agm_session_run_ops(session_id, hndl, ops,
+                                                   num_ops);
+    }
+    ALOGE("%s: agm service is not running\n", __func__);
+    return -EAGAIN;
+}
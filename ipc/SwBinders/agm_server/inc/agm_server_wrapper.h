@@ -86,6 +86,7 @@ class AgmService : public BnAgmService
                                      uint32_t audio_intf, uint32_t size,
                                      uint8_t *metadata);
         virtual int ipc_agm_session_close(uint64_t handle);
+        virtual int ipc_agm_session_close_async(uint64_t handle);
         virtual int ipc_agm_audio_intf_set_media_config(uint32_t audio_intf,
                                      struct agm_media_config *media_config);
         virtual int ipc_agm_session_prepare(uint64_t handle);
@@ -148,6 +149,16 @@ class AgmService : public BnAgmService
                          enum agm_gapless_silence_type type, uint32_t silence);
         virtual int ipc_agm_session_get_buf_info(uint32_t session_id,
                            struct agm_buf_info *buf_info, uint32_t flag);
+        virtual int ipc_agm_recover_all(struct agm_session_recovery_info *info,
+                                     size_t *num_sessions);
+        virtual int ipc_agm_session_group_start(uint64_t *handles,
+                                     uint32_t num_handles,
+                                     uint64_t *start_skew_us);
+        virtual int ipc_agm_session_group_stop(uint64_t *handles,
+                                     uint32_t num_handles);
+        virtual int ipc_agm_session_run_ops(uint32_t session_id,
+                                     uint64_t *hndl, struct agm_session_op *ops,
+                                     uint32_t num_ops);
         ~AgmService()
         {
             AGM_LOGV("AGMService destructor");
@@ -87,6 +87,7 @@ class IAgmService: public ::android::IInterface
                                     uint32_t audio_intf, uint32_t size,
                                     uint8_t *metadata)= 0;
         virtual int ipc_agm_session_close(uint64_t handle)= 0;
+        virtual int ipc_agm_session_close_async(uint64_t handle)= 0;
         virtual int ipc_agm_audio_intf_set_media_config(uint32_t audio_intf,
                                     struct agm_media_config *media_config)= 0;
         virtual int ipc_agm_session_prepare(uint64_t handle)= 0;
@@ -153,6 +154,16 @@ class IAgmService: public ::android::IInterface
                                     uint32_t silence) = 0;
         virtual int ipc_agm_session_get_buf_info(uint32_t session_id,
                            struct agm_buf_info *buf_info, uint32_t flag) = 0;
+        virtual int ipc_agm_recover_all(struct agm_session_recovery_info *info,
+                                    size_t *num_sessions) = 0;
+        virtual int ipc_agm_session_group_start(uint64_t *handles,
+                                    uint32_t num_handles,
+                                    uint64_t *start_skew_us) = 0;
+        virtual int ipc_agm_session_group_stop(uint64_t *handles,
+                                    uint32_t num_handles) = 0;
+        virtual int ipc_agm_session_run_ops(uint32_t session_id,
+                                    uint64_t *hndl, struct agm_session_op *ops,
+                                    uint32_t num_ops) = 0;
 };
 
 class BnAgmService : public ::android::BnInterface<IAgmService> {
@@ -111,6 +111,11 @@ int AgmService::ipc_agm_session_close(uint64_t handle){
     return agm_session_close(handle);
 };
 
+int AgmService::ipc_agm_session_close_async(uint64_t handle){
+    ALOGV("%s called\n", __func__);
+    return agm_session_close_async(handle);
+};
+
 int AgmService::ipc_agm_session_prepare(uint64_t handle){
     ALOGV("%s called\n", __func__);
     return agm_session_prepare(handle);
@@ -285,3 +290,29 @@ int AgmService::ipc_agm_session_get_buf_info(uint32_t session_id,
     ALOGV("%s called\n", __func__);
     return agm_session_get_buf_info(session_id, buf_info, flag);
 };
+
+int AgmService::ipc_agm_recover_all(struct agm_session_recovery_info *info,
+                                    size_t *num_sessions) {
+    ALOGV("%s called\n", __func__);
+    return agm_recover_all(info, num_sessions);
+};
+
+int AgmService::ipc_agm_session_group_start(uint64_t *handles,
+                                            uint32_t num_handles,
+                                            uint64_t *start_skew_us) {
+    ALOGV("%s called\n", __func__);
+    return agm_session_group_start(handles, num_handles, start_skew_us);
+};
+
+int AgmService::ipc_agm_session_group_stop(uint64_t *handles,
+                                           uint32_t num_handles) {
+    ALOGV("%s called\n", __func__);
+    return agm_session_group_stop(handles, num_handles);
+};
+
+int AgmService::ipc_agm_session_run_ops(uint32_t session_id, uint64_t *hndl,
+                                        struct agm_session_op *ops,
+                                        uint32_t num_ops) {
+    ALOGV("%s called\n", __func__);
+    return agm_session_run_ops(session_id, hndl, ops, num_ops);
+};
@@ -149,6 +149,11 @@ enum {
     AIF_SET_PARAMS,
     SET_GAPLESS_SESSION_METADATA,
     GET_BUF_INFO,
+    RECOVER_ALL,
+    GROUP_START,
+    GROUP_STOP,
+    CLOSE_ASYNC,
+    RUN_OPS,
 };
 
 class BpAgmService : public ::android::BpInterface<IAgmService>
@@ -762,6 +767,126 @@ class BpAgmService : public ::android::BpInterface<IAgmService>
         }
         return reply.readInt32();
     }
+
+    virtual int ipc_agm_recover_all(struct agm_session_recovery_info *info,
+                                    size_t *num_sessions)
+    {
+        android::Parcel data, reply;
+        android::Parcel::ReadableBlob info_blob;
+        uint32_t count = info ? *num_sessions : 0;
+        uint32_t num_ret, copied;
+
+        ALOGV("%s:%d\n", __func__, __LINE__);
+        data.writeInterfaceToken(IAgmService::getInterfaceDescriptor());
+        data.writeUint32(count);
+        remote()->transact(RECOVER_ALL, data, &reply);
+        num_ret = reply.readUint32();
+        copied = num_ret < count ? num_ret : count;
+        if (copied) {
+            reply.readBlob(copied * sizeof(*info), &info_blob);
+            memcpy(info, info_blob.data(), copied * sizeof(*info));
+            info_blob.release();
+        }
+        *num_sessions = num_ret;
+        return reply.readInt32();
+    }
+
+    virtual int ipc_agm_session_group_start(uint64_t *handles,
+                                            uint32_t num_handles,
+                                            uint64_t *start_skew_us)
+    {
+        android::Parcel data, reply;
+        uint32_t i;
+        int rc;
+
+        ALOGV("%s:%d\n", __func__, __LINE__);
+        data.writeInterfaceToken(IAgmService::getInterfaceDescriptor());
+        data.writeUint32(num_handles);
+        for (i = 0; i < num_handles; i++)
+            data.writeInt64((long)handles[i]);
+        data.writeUint32(start_skew_us != NULL);
+        remote()->transact(GROUP_START, data, &reply);
+        rc = reply.readInt32();
+        if (start_skew_us)
+            *start_skew_us = reply.readUint64();
+        return rc;
+    }
+
+    virtual int ipc_agm_session_group_stop(uint64_t *handles,
+                                           uint32_t num_handles)
+    {
+        android::Parcel data, reply;
+        uint32_t i;
+
+        ALOGV("%s:%d\n", __func__, __LINE__);
+        data.writeInterfaceToken(IAgmService::getInterfaceDescriptor());
+        data.writeUint32(num_handles);
+        for (i = 0; i < num_handles; i++)
+            data.writeInt64((long)handles[i]);
+        remote()->transact(GROUP_STOP, data, &reply);
+        return reply.readInt32();
+    }
+
+    virtual int ipc_agm_session_close_async(uint64_t handle)
+    {
+        android::Parcel data, reply;
+
+        ALOGV("%s:%d\n", __func__, __LINE__);
+        data.writeInterfaceToken(IAgmService::getInterfaceDescriptor());
+        data.writeInt64((long)handle);
+        remote()->transact(CLOSE_ASYNC, data, &reply);
+        return reply.readInt32();
+    }
+
+    virtual int ipc_agm_session_run_ops(uint32_t session_id, uint64_t *hndl,
+                                        struct agm_session_op *ops,
+                                        uint32_t num_ops)
+    {
+        android::Parcel data, reply;
+        android::Parcel::WritableBlob blob;
+        uint32_t i, num_status;
+        int rc;
+
+        ALOGV("%s:%d\n", __func__, __LINE__);
+        data.writeInterfaceToken(IAgmService::getInterfaceDescriptor());
+        data.writeUint32(session_id);
+        data.writeInt64((long)*hndl);
+        data.writeUint32(num_ops);
+        for (i = 0; i < num_ops; i++) {
+            data.writeUint32(ops[i].type);
+            data.writeUint32(ops[i].sess_mode);
+            data.writeUint32(ops[i].aif_id);
+            data.writeUint32(ops[i].state);
+            if (ops[i].type == AGM_SESSION_OP_SET_CONFIG) {
+                data.writeBlob(sizeof(struct agm_session_config), false, &blob);
+                memcpy(blob.data(), ops[i].session_config,
+                       sizeof(struct agm_session_config));
+                blob.release();
+                data.writeBlob(sizeof(struct agm_media_config), false, &blob);
+                memcpy(blob.data(), ops[i].media_config,
+                       sizeof(struct agm_media_config));
+                blob.release();
+                data.writeBlob(sizeof(struct agm_buffer_config), false, &blob);
+                memcpy(blob.data(), ops[i].buffer_config,
+                       sizeof(struct agm_buffer_config));
+                blob.release();
+                continue;
+            }
+            data.writeUint32(ops[i].payload ? ops[i].size : 0);
+            if (ops[i].payload && ops[i].size) {
+                data.writeBlob(ops[i].size, false, &blob);
+                memcpy(blob.data(), ops[i].payload, ops[i].size);
+                blob.release();
+            }
+        }
+        remote()->transact(RUN_OPS, data, &reply);
+        rc = reply.readInt32();
+        *hndl = (uint64_t)reply.readInt64();
+        num_status = reply.readUint32();
+        for (i = 0; i < num_status && i < num_ops; i++)
+            ops[i].status = reply.readInt32();
+        return rc;
+    }
 };
 
 void ipc_cb (uint32_t session_id, struct agm_event_cb_params *event_params,
@@ -943,6 +1068,13 @@ android::status_t BnAgmService::onTransact(uint32_t code,
         reply->writeInt32(rc);
         break; }
 
+    case CLOSE_ASYNC : {
+        uint64_t handle = (uint64_t )data.readInt64();
+        rc = ipc_agm_session_close_async(handle);
+        agm_remove_session_obj_handle(handle);
+        reply->writeInt32(rc);
+        break; }
+
     case PREPARE : {
         uint64_t handle = (uint64_t )data.readInt64();
         rc = ipc_agm_session_prepare(handle);
@@ -1449,6 +1581,175 @@ android::status_t BnAgmService::onTransact(uint32_t code,
         reply->writeInt32(rc);
         break; }
 
+    case RECOVER_ALL : {
+        size_t count = (size_t) data.readUint32(), num_ret, copied;
+        struct agm_session_recovery_info *info = NULL;
+        android::Parcel::WritableBlob info_blob;
+
+        if (count) {
+            info = (struct agm_session_recovery_info *)
+                        calloc(count, sizeof(struct agm_session_recovery_info));
+            if (info == NULL) {
+                AGM_LOGE("calloc failed\n");
+                reply->writeUint32(0);
+                reply->writeInt32(-ENOMEM);
+                break;
+            }
+        }
+        num_ret = count;
+        rc = ipc_agm_recover_all(info, &num_ret);
+        copied = num_ret < count ? num_ret : count;
+        reply->writeUint32(num_ret);
+        if (copied) {
+            reply->writeBlob(copied * sizeof(*info), false, &info_blob);
+            memcpy(info_blob.data(), info, copied * sizeof(*info));
+            info_blob.release();
+        }
+        reply->writeInt32(rc);
+        free(info);
+        break; }
+
+    case GROUP_START :
+    case GROUP_STOP : {
+        uint32_t num_handles = data.readUint32(), i;
+        uint64_t *handles = NULL, skew = 0;
+        bool get_skew;
+
+        if (num_handles == 0 ||
+            num_handles > data.dataAvail() / sizeof(int64_t)) {
+            reply->writeInt32(-EINVAL);
+            reply->writeUint64(0);
+            break;
+        }
+        handles = (uint64_t *) calloc(num_handles, sizeof(uint64_t));
+        if (handles == NULL) {
+            AGM_LOGE("calloc failed\n");
+            reply->writeInt32(-ENOMEM);
+            reply->writeUint64(0);
+            break;
+        }
+        for (i = 0; i < num_handles; i++)
+            handles[i] = (uint64_t) data.readInt64();
+        if (code == GROUP_START) {
+            get_skew = data.readUint32();
+            rc = ipc_agm_session_group_start(handles, num_handles,
+                                             get_skew ? &skew : NULL);
+        } else {
+            rc = ipc_agm_session_group_stop(handles, num_handles);
+        }
+        reply->writeInt32(rc);
+        reply->writeUint64(skew);
+        free(handles);
+        break; }
+
+    case RUN_OPS : {
+        uint32_t session_id = data.readUint32(), num_ops, i;
+        uint64_t hndl = (uint64_t )data.readInt64(), handle;
+        struct agm_session_op *ops = NULL;
+        struct agm_session_config *session_configs = NULL;
+        struct agm_media_config *media_configs = NULL;
+        struct agm_buffer_config *buffer_configs = NULL;
+        android::Parcel::ReadableBlob blob;
+        bool ran = false;
+
+        /* every op takes at least its four fixed words */
+        num_ops = data.readUint32();
+        if (num_ops == 0 ||
+            num_ops > data.dataAvail() / (4 * sizeof(uint32_t))) {
+            rc = -EINVAL;
+            goto run_ops_fail;
+        }
+        ops = (struct agm_session_op *)
+                    calloc(num_ops, sizeof(struct agm_session_op));
+        session_configs = (struct agm_session_config *)
+                    calloc(num_ops, sizeof(struct agm_session_config));
+        media_configs = (struct agm_media_config *)
+                    calloc(num_ops, sizeof(struct agm_media_config));
+        buffer_configs = (struct agm_buffer_config *)
+                    calloc(num_ops, sizeof(struct agm_buffer_config));
+        if (!ops || !session_configs || !media_configs || !buffer_configs) {
+            AGM_LOGE("calloc failed\n");
+            rc = -ENOMEM;
+            goto run_ops_fail;
+        }
+
+        for (i = 0; i < num_ops; i++) {
+            ops[i].type = (enum agm_session_op_type)data.readUint32();
+            ops[i].sess_mode = (enum agm_session_mode)data.readUint32();
+            ops[i].aif_id = data.readUint32();
+            ops[i].state = data.readUint32();
+            if (ops[i].type > AGM_SESSION_OP_CLOSE) {
+                rc = -EINVAL;
+                goto run_ops_fail;
+            }
+            if (ops[i].type == AGM_SESSION_OP_SET_CONFIG) {
+                if (data.readBlob(sizeof(struct agm_session_config), &blob)) {
+                    rc = -EINVAL;
+                    goto run_ops_fail;
+                }
+                memcpy(&session_configs[i], blob.data(),
+                       sizeof(struct agm_session_config));
+                blob.release();
+                if (data.readBlob(sizeof(struct agm_media_config), &blob)) {
+                    rc = -EINVAL;
+                    goto run_ops_fail;
+                }
+                memcpy(&media_configs[i], blob.data(),
+                       sizeof(struct agm_media_config));
+                blob.release();
+                if (data.readBlob(sizeof(struct agm_buffer_config), &blob)) {
+                    rc = -EINVAL;
+                    goto run_ops_fail;
+                }
+                memcpy(&buffer_configs[i], blob.data(),
+                       sizeof(struct agm_buffer_config));
+                blob.release();
+                ops[i].session_config = &session_configs[i];
+                ops[i].media_config = &media_configs[i];
+                ops[i].buffer_config = &buffer_configs[i];
+                continue;
+            }
+            ops[i].size = data.readUint32();
+            if (ops[i].size == 0)
+                continue;
+            if (ops[i].size > data.dataAvail() ||
+                data.readBlob(ops[i].size, &blob)) {
+                rc = -EINVAL;
+                goto run_ops_fail;
+            }
+            ops[i].payload = malloc(ops[i].size);
+            if (ops[i].payload == NULL) {
+                blob.release();
+                rc = -ENOMEM;
+                goto run_ops_fail;
+            }
+            memcpy(ops[i].payload, blob.data(), ops[i].size);
+            blob.release();
+        }
+
+        handle = hndl;
+        rc = ipc_agm_session_run_ops(session_id, &handle, ops, num_ops);
+        ran = true;
+        if (hndl == 0 && handle != 0)
+            agm_add_session_obj_handle(handle);
+        else if (hndl != 0 && handle == 0)
+            agm_remove_session_obj_handle(hndl);
+        hndl = handle;
+
+    run_ops_fail:
+        reply->writeInt32(rc);
+        reply->writeInt64((long)hndl);
+        reply->writeUint32(ran ? num_ops : 0);
+        for (i = 0; ran && i < num_ops; i++)
+            reply->writeInt32(ops[i].status);
+        for (i = 0; ops && i < num_ops; i++)
+            free(ops[i].payload);
+        free(buffer_configs);
+        free(media_configs);
+        free(session_configs);
+        free(ops);
+        break; }
+
     default:
         return BBinder::onTransact(code, data, reply, flags);
     }
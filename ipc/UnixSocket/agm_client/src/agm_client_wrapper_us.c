@@ -0,0 +1,1453 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+#define LOG_TAG "agm_client_wrapper_us"
+#define _GNU_SOURCE
+
+#include <agm/agm_api.h>
+#include <agm/agm_list.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <qti-agm-service/agm-us-proto.h>
+#include "utils.h"
+
+/* PCM buffer shared with the server, grown to the largest period seen */
+#define AGM_CLIENT_BUF_MIN  (16 * 1024)
+
+/* a caller waiting for the reply to its request */
+struct us_call {
+    struct listnode node;
+    uint32_t id;
+    bool done;
+    pthread_cond_t cond;
+    struct agm_us_msg reply;
+    void *data;
+};
+
+struct us_event_cb {
+    struct listnode node;
+    uint32_t session_id;
+    uint32_t evt_type;
+    agm_event_cb cb;
+    void *client_data;
+    uint64_t cookie;
+};
+
+struct us_crash_cb {
+    struct listnode node;
+    agm_service_crash_cb cb;
+    uint64_t cookie;
+};
+
+/* what agm_session_open() hands out as the handle */
+struct us_session {
+    uint32_t session_id;
+    uint64_t handle;            /* of the server */
+    uint32_t conn_gen;          /* connection it was opened on */
+    pthread_mutex_t buf_lock;
+    int buf_fd;
+    void *buf;
+    size_t buf_size;
+    bool buf_unsupported;
+};
+
+static struct {
+    pthread_mutex_t lock;       /* everything but the sockets */
+    pthread_mutex_t send_lock;  /* sock */
+    int sock;
+    bool connected;
+    bool closing;
+    uint32_t conn_gen;
+    uint32_t next_id;
+    uint64_t next_cookie;
+    struct listnode calls;
+    struct listnode event_cbs;
+    struct listnode crash_cbs;
+    /* the callback being run, deregistration waits for it */
+    struct us_event_cb *evt_busy;
+    pthread_t evt_thread;
+    pthread_cond_t evt_cond;
+} us_client = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .send_lock = PTHREAD_MUTEX_INITIALIZER,
+    .sock = -1,
+    .evt_cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void us_lists_init(void)
+{
+    if (us_client.calls.next == NULL) {
+        list_init(&us_client.calls);
+        list_init(&us_client.event_cbs);
+        list_init(&us_client.crash_cbs);
+    }
+}
+
+static void us_msg_init(struct agm_us_msg *msg, uint32_t op, uint32_t key)
+{
+    memset(msg, 0, sizeof(*msg));
+    msg->op = op;
+    msg->key = key;
+}
+
+static int us_socket_connect(void)
+{
+    struct sockaddr_un addr;
+    int sock, ret;
+
+    ret = agm_us_sockaddr(&addr);
+    if (ret)
+        return ret;
+
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return -errno;
+
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+        ret = -errno;
+        close(sock);
+        return ret;
+    }
+
+    return sock;
+}
+
+/* a request on a connection no reader thread listens to yet */
+static int us_handshake(int sock, struct agm_us_msg *msg)
+{
+    int fds[AGM_US_MAX_FDS];
+    void *data;
+    int ret;
+
+    ret = agm_us_send(sock, msg, NULL, NULL);
+    if (ret)
+        return ret;
+
+    ret = agm_us_recv(sock, msg, &data, fds);
+    if (ret)
+        return ret;
+
+    for (ret = 0; ret < (int)msg->num_fds; ret++)
+        close(fds[ret]);
+    free(data);
+
+    return msg->status;
+}
+
+/*
+ * The server closed the connection: fail whatever is still waiting and
+ * tell the crash callbacks, unless it was us hanging up.
+ */
+static void us_disconnected(int sock)
+{
+    struct us_crash_cb *crash, *crashes = NULL;
+    struct listnode *node;
+    struct us_call *call;
+    bool closing;
+    int i, num = 0;
+
+    pthread_mutex_lock(&us_client.send_lock);
+    if (us_client.sock == sock)
+        us_client.sock = -1;
+    pthread_mutex_unlock(&us_client.send_lock);
+    close(sock);
+
+    pthread_mutex_lock(&us_client.lock);
+    us_client.connected = false;
+    closing = us_client.closing;
+    list_for_each(node, &us_client.calls) {
+        call = node_to_item(node, struct us_call, node);
+        call->reply.status = -ECONNRESET;
+        call->done = true;
+        pthread_cond_signal(&call->cond);
+    }
+    if (!closing) {
+        list_for_each(node, &us_client.crash_cbs)
+            num++;
+        crashes = calloc(num ? num : 1, sizeof(*crashes));
+        num = 0;
+        list_for_each(node, &us_client.crash_cbs) {
+            crash = node_to_item(node, struct us_crash_cb, node);
+            if (crashes)
+                crashes[num++] = *crash;
+        }
+    }
+    pthread_mutex_unlock(&us_client.lock);
+
+    if (!closing)
+        AGM_LOGE("agm service went away");
+
+    for (i = 0; i < num; i++)
+        crashes[i].cb(crashes[i].cookie);
+    free(crashes);
+}
+
+static void *us_reader_loop(void *arg)
+{
+    int sock = (int)(intptr_t)arg;
+    int fds[AGM_US_MAX_FDS];
+    struct listnode *node;
+    struct agm_us_msg msg;
+    struct us_call *call;
+    void *data;
+    int i;
+
+    while (!agm_us_recv(sock, &msg, &data, fds)) {
+        for (i = 0; i < (int)msg.num_fds; i++)
+            close(fds[i]);
+
+        pthread_mutex_lock(&us_client.lock);
+        list_for_each(node, &us_client.calls) {
+            call = node_to_item(node, struct us_call, node);
+            if (call->id == msg.id && !call->done) {
+                call->reply = msg;
+                call->data = data;
+                call->done = true;
+                data = NULL;
+                pthread_cond_signal(&call->cond);
+                break;
+            }
+        }
+        pthread_mutex_unlock(&us_client.lock);
+        free(data);
+    }
+
+    us_disconnected(sock);
+    return NULL;
+}
+
+static void *us_event_loop(void *arg)
+{
+    int sock = (int)(intptr_t)arg;
+    struct agm_event_cb_params *params;
+    int fds[AGM_US_MAX_FDS];
+    struct us_event_cb *entry;
+    struct listnode *node;
+    struct agm_us_msg msg;
+    agm_event_cb cb;
+    void *data, *client_data;
+    int i;
+
+    while (!agm_us_recv(sock, &msg, &data, fds)) {
+        for (i = 0; i < (int)msg.num_fds; i++)
+            close(fds[i]);
+
+        params = data;
+        if (msg.op != AGM_US_EVENT || msg.len < sizeof(*params) ||
+            params->event_payload_size > msg.len - sizeof(*params)) {
+            free(data);
+            continue;
+        }
+
+        cb = NULL;
+        pthread_mutex_lock(&us_client.lock);
+        list_for_each(node, &us_client.event_cbs) {
+            entry = node_to_item(node, struct us_event_cb, node);
+            if (entry->cookie == msg.val) {
+                cb = entry->cb;
+                client_data = entry->client_data;
+                us_client.evt_busy = entry;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&us_client.lock);
+
+        if (cb) {
+            cb(msg.arg[0], params, client_data);
+            pthread_mutex_lock(&us_client.lock);
+            us_client.evt_busy = NULL;
+            pthread_cond_broadcast(&us_client.evt_cond);
+            pthread_mutex_unlock(&us_client.lock);
+        }
+        free(data);
+    }
+
+    close(sock);
+    return NULL;
+}
+
+static int us_thread_start(void *(*fn)(void *), int sock, pthread_t *thread)
+{
+    pthread_attr_t attr;
+    pthread_t t;
+    int ret;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ret = pthread_create(&t, &attr, fn, (void *)(intptr_t)sock);
+    pthread_attr_destroy(&attr);
+    if (ret)
+        return -ret;
+
+    if (thread)
+        *thread = t;
+    return 0;
+}
+
+
+/*
+ * Connects on first use and again after the service went away. Event
+ * callbacks registered on the old connection died with it.
+ */
+static int us_connect_locked(void)
+{
+    struct listnode *node, *temp;
+    struct agm_us_msg msg;
+    int sock, evt_sock = -1, ret;
+    uint64_t token;
+
+    if (us_client.connected)
+        return 0;
+
+    list_for_each_safe(node, temp, &us_client.event_cbs) {
+        list_remove(node);
+        free(node_to_item(node, struct us_event_cb, node));
+    }
+
+    sock = us_socket_connect();
+    if (sock < 0) {
+        AGM_LOGE("cannot reach %s: %d", agm_us_socket_path(), sock);
+        return sock;
+    }
+
+    us_msg_init(&msg, AGM_US_HELLO, AGM_US_KEY_MODULE);
+    msg.arg[0] = AGM_US_VERSION;
+    ret = us_handshake(sock, &msg);
+    if (ret)
+        goto err;
+    token = msg.val;
+
+    evt_sock = us_socket_connect();
+    if (evt_sock < 0) {
+        ret = evt_sock;
+        goto err;
+    }
+    us_msg_init(&msg, AGM_US_EVENTS, AGM_US_KEY_MODULE);
+    msg.val = token;
+    ret = us_handshake(evt_sock, &msg);
+    if (ret)
+        goto err;
+
+    ret = us_thread_start(us_event_loop, evt_sock, &us_client.evt_thread);
+    if (ret)
+        goto err;
+    /* the event thread closes it when the server does */
+    evt_sock = -1;
+
+    pthread_mutex_lock(&us_client.send_lock);
+    us_client.sock = sock;
+    pthread_mutex_unlock(&us_client.send_lock);
+    us_client.connected = true;
+    us_client.closing = false;
+    us_client.conn_gen++;
+
+    ret = us_thread_start(us_reader_loop, sock, NULL);
+    if (ret) {
+        pthread_mutex_lock(&us_client.send_lock);
+        us_client.sock = -1;
+        pthread_mutex_unlock(&us_client.send_lock);
+        us_client.connected = false;
+        goto err;
+    }
+
+    return 0;
+
+err:
+    AGM_LOGE("connection setup failed %d", ret);
+    if (evt_sock >= 0)
+        close(evt_sock);
+    close(sock);
+    return ret;
+}
+
+/*
+ * Sends a request and waits for its reply. Any number of threads can
+ * have calls in flight, replies are matched by id. If rdata is given it
+ * receives the data of the reply, malloc()ed, or NULL; reply.op is only
+ * set if a reply came.
+ */
+static int us_call_fds(struct agm_us_msg *msg, const void *data,
+                       const int *fds, struct agm_us_msg *reply, void **rdata)
+{
+    struct us_call call;
+    uint32_t gen;
+    int ret;
+
+    memset(&call, 0, sizeof(call));
+    pthread_cond_init(&call.cond, NULL);
+
+    pthread_mutex_lock(&us_client.lock);
+    us_lists_init();
+    ret = us_connect_locked();
+    if (ret) {
+        pthread_mutex_unlock(&us_client.lock);
+        goto done;
+    }
+    call.id = msg->id = ++us_client.next_id;
+    gen = us_client.conn_gen;
+    list_add_tail(&us_client.calls, &call.node);
+    pthread_mutex_unlock(&us_client.lock);
+
+    pthread_mutex_lock(&us_client.send_lock);
+    if (us_client.sock < 0)
+        ret = -ECONNRESET;
+    else
+        ret = agm_us_send(us_client.sock, msg, data, fds);
+    pthread_mutex_unlock(&us_client.send_lock);
+
+    pthread_mutex_lock(&us_client.lock);
+    while (!ret && !call.done)
+        pthread_cond_wait(&call.cond, &us_client.lock);
+    list_remove(&call.node);
+    pthread_mutex_unlock(&us_client.lock);
+
+    if (ret) {
+        AGM_LOGE("op %u on connection %u not sent %d", msg->op, gen, ret);
+        goto done;
+    }
+
+    ret = call.reply.status;
+    if (rdata) {
+        *rdata = call.data;
+        call.data = NULL;
+    }
+
+done:
+    if (reply)
+        *reply = call.reply;
+    free(call.data);
+    pthread_cond_destroy(&call.cond);
+    return ret;
+}
+
+static int us_call(struct agm_us_msg *msg, const void *data,
+                   struct agm_us_msg *reply, void **rdata)
+{
+    return us_call_fds(msg, data, NULL, reply, rdata);
+}
+
+/* a session of a connection that is gone can only be closed */
+static int us_session_check(struct us_session *ses)
+{
+    bool current;
+
+    if (ses == NULL)
+        return -EINVAL;
+
+    pthread_mutex_lock(&us_client.lock);
+    current = us_client.connected && ses->conn_gen == us_client.conn_gen;
+    pthread_mutex_unlock(&us_client.lock);
+
+    return current ? 0 : -ENOTCONN;
+}
+
+static void us_session_msg_init(struct agm_us_msg *msg, uint32_t op,
+                                struct us_session *ses)
+{
+    us_msg_init(msg, op, ses->session_id);
+    msg->handle = ses->handle;
+}
+
+static int us_session_call(uint64_t hndl, uint32_t op)
+{
+    struct us_session *ses = (struct us_session *)hndl;
+    struct agm_us_msg msg;
+    int ret;
+
+    ret = us_session_check(ses);
+    if (ret)
+        return ret;
+
+    us_session_msg_init(&msg, op, ses);
+    return us_call(&msg, NULL, NULL, NULL);
+}
+
+static struct us_session *us_session_new(uint32_t session_id, uint64_t handle,
+                                         uint32_t gen)
+{
+    struct us_session *ses;
+
+    ses = calloc(1, sizeof(*ses));
+    if (ses == NULL)
+        return NULL;
+
+    ses->session_id = session_id;
+    ses->handle = handle;
+    ses->conn_gen = gen;
+    ses->buf_fd = -1;
+    pthread_mutex_init(&ses->buf_lock, NULL);
+    return ses;
+}
+
+static void us_session_buf_free(struct us_session *ses)
+{
+    if (ses->buf)
+        munmap(ses->buf, ses->buf_size);
+    if (ses->buf_fd >= 0)
+        close(ses->buf_fd);
+    ses->buf = NULL;
+    ses->buf_fd = -1;
+    ses->buf_size = 0;
+}
+
+static void us_session_free(struct us_session *ses)
+{
+    us_session_buf_free(ses);
+    pthread_mutex_destroy(&ses->buf_lock);
+    free(ses);
+}
+
+/*
+ * Makes sure the buffer shared with the server holds count bytes, the
+ * caller holds buf_lock. false means the data has to go inline.
+ */
+static bool us_session_buf_ready(struct us_session *ses, size_t count)
+{
+    struct agm_us_msg msg;
+    size_t size = AGM_CLIENT_BUF_MIN;
+    void *addr;
+    int fd, ret;
+
+    if (ses->buf_unsupported || count > AGM_US_MAX_BUF)
+        return false;
+    if (ses->buf && count <= ses->buf_size)
+        return true;
+
+    while (size < count)
+        size <<= 1;
+
+    fd = memfd_create("agm_us_buf", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+        goto unsupported;
+    if (ftruncate(fd, size) ||
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) {
+        close(fd);
+        goto unsupported;
+    }
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        close(fd);
+        goto unsupported;
+    }
+
+    us_session_msg_init(&msg, AGM_US_SESSION_MAP_BUF, ses);
+    msg.val = size;
+    msg.num_fds = 1;
+    ret = us_call_fds(&msg, NULL, &fd, NULL, NULL);
+    if (ret) {
+        munmap(addr, size);
+        close(fd);
+        if (ret == -ECONNRESET)
+            return false;
+        goto unsupported;
+    }
+
+    us_session_buf_free(ses);
+    ses->buf = addr;
+    ses->buf_fd = fd;
+    ses->buf_size = size;
+    return true;
+
+unsupported:
+    AGM_LOGE("no shared buffer for session %u, data goes inline",
+             ses->session_id);
+    ses->buf_unsupported = true;
+    return false;
+}
+
+int agm_register_service_crash_callback(agm_service_crash_cb cb,
+                                        uint64_t cookie)
+{
+    struct us_crash_cb *crash;
+
+    if (cb == NULL)
+        return -EINVAL;
+
+    crash = calloc(1, sizeof(*crash));
+    if (crash == NULL)
+        return -ENOMEM;
+
+    crash->cb = cb;
+    crash->cookie = cookie;
+    pthread_mutex_lock(&us_client.lock);
+    us_lists_init();
+    list_add_tail(&us_client.crash_cbs, &crash->node);
+    pthread_mutex_unlock(&us_client.lock);
+    return 0;
+}
+
+int agm_aif_set_media_config(uint32_t aif_id,
+                             struct agm_media_config *media_config)
+{
+    struct agm_us_msg msg;
+
+    us_msg_init(&msg, AGM_US_AIF_SET_MEDIA_CONFIG, AGM_US_KEY_MODULE);
+    msg.arg[0] = aif_id;
+    msg.len = sizeof(*media_config);
+    return us_call(&msg, media_config, NULL, NULL);
+}
+
+int agm_aif_group_set_media_config(uint32_t aif_group_id,
+                                   struct agm_group_media_config *media_config)
+{
+    struct agm_us_msg msg;
+
+    us_msg_init(&msg, AGM_US_AIF_GROUP_SET_MEDIA_CONFIG, AGM_US_KEY_MODULE);
+    msg.arg[0] = aif_group_id;
+    msg.len = sizeof(*media_config);
+    return us_call(&msg, media_config, NULL, NULL);
+}
+
+int agm_aif_set_metadata(uint32_t aif_id, uint32_t size, uint8_t *metadata)
+{
+    struct agm_us_msg msg;
+
+    us_msg_init(&msg, AGM_US_AIF_SET_METADATA, AGM_US_KEY_MODULE);
+    msg.arg[0] = aif_id;
+    msg.len = size;
+    return us_call(&msg, metadata, NULL, NULL);
+}
+
+int agm_aif_set_params(uint32_t aif_id, void *payload, size_t size)
+{
+    struct agm_us_msg msg;
+
+    us_msg_init(&msg, AGM_US_AIF_SET_PARAMS, AGM_US_KEY_MODULE);
+    msg.arg[0] = aif_id;
+    msg.len = size;
+    return us_call(&msg, payload, NULL, NULL);
+}
+
+/* the payload is copied into the socket either way */
+int agm_aif_set_params_take(uint32_t aif_id, void *payload, size_t size)
+{
+    int ret = agm_aif_set_params(aif_id, payload, size);
+
+    free(payload);
+    return ret;
+}
+
+static int us_aif_info_list(uint32_t op, struct aif_info *aif_list,
+                            size_t *num)
+{
+    struct agm_us_msg msg, reply;
+    void *data = NULL;
+    int ret;
+
+    if (num == NULL)
+        return -EINVAL;
+
+    us_msg_init(&msg, op, AGM_US_KEY_MODULE);
+    msg.val = aif_list ? *num : 0;
+    ret = us_call(&msg, NULL, &reply, &data);
+    if (ret)
+        goto done;
+
+    if (aif_list && reply.len > *num * sizeof(*aif_list))
+        ret = -EPROTO;
+    else if (aif_list)
+        memcpy(aif_list, data, reply.len);
+    if (!ret)
+        *num = aif_list ? reply.len / sizeof(*aif_list) : reply.val;
+
+done:
+    free(data);
+    return ret;
+}
+
+int agm_get_aif_info_list(struct aif_info *aif_list, size_t *num_aif_info)
+{
+    return us_aif_info_list(AGM_US_GET_AIF_INFO_LIST, aif_list, num_aif_info);
+}
+
+int agm_get_group_aif_info_list(struct aif_info *aif_list, size_t *num_groups)
+{
+    return us_aif_info_list(AGM_US_GET_GROUP_AIF_INFO_LIST, aif_list,
+                            num_groups);
+}
+
+int agm_session_set_metadata(uint32_t session_id, uint32_t size,
+                             uint8_t *metadata)
+{
+    struct agm_us_msg msg;
+
+    us_msg_init(&msg, AGM_US_SESSION_SET_METADATA, session_id);
+    msg.arg[0] = session_id;
+    msg.len = size;
+    return us_call(&msg, metadata, NULL, NULL);
+}
+
+int agm_session_aif_set_metadata(uint32_t session_id, uint32_t aif_id,
+                                 uint32_t size, uint8_t *metadata)
+{
+    struct agm_us_msg msg;
+
+    us_msg_init(&msg, AGM_US_SESSION_AIF_SET_METADATA, session_id);
+    msg.arg[0] = session_id;
+    msg.arg[1] = aif_id;
+    msg.len = size;
+    return us_call(&msg, metadata, NULL, NULL);
+}
+
+int agm_session_aif_connect(uint32_t session_id, uint32_t aif_id, bool state)
+{
+    struct agm_us_msg msg;
+
+    us_msg_init(&msg, AGM_US_SESSION_AIF_CONNECT, session_id);
+    msg.arg[0] = session_id;
+    msg.arg[1] = aif_id;
+    msg.arg[2] = state;
+    return us_call(&msg, NULL, NULL, NULL);
+}
+
+int agm_session_aif_get_tag_module_info(uint32_t session_id, uint32_t aif_id,
+                                        void *payload, size_t *size)
+{
+    struct agm_us_msg msg, reply;
+    void *data = NULL;
+    int ret;
+
+    if (size == NULL)
+        return -EINVAL;
+
+    us_msg_init(&msg, AGM_US_SESSION_AIF_GET_TAG_MODULE_INFO, session_id);
+    msg.arg[0] = session_id;
+    msg.arg[1] = aif_id;
+    msg.val = payload ? *size : 0;
+    ret = us_call(&msg, NULL, &reply, &data);
+    if (ret)
+        goto done;
+
+    if (payload && reply.len > *size)
+        ret = -EPROTO;
+    else if (payload)
+        memcpy(payload, data, reply.len);
+    if (!ret)
+        *size = reply.val;
+
+done:
+    free(data);
+    return ret;
+}
+
+int agm_session_aif_set_params(uint32_t session_id, uint32_t aif_id,
+                               void *payload, size_t size)
+{
+    struct agm_us_msg msg;
+
+    us_msg_init(&msg, AGM_US_SESSION_AIF_SET_PARAMS, session_id);
+    msg.arg[0] = session_id;
+    msg.arg[1] = aif_id;
+    msg.len = size;
+    return us_call(&msg, payload, NULL, NULL);
+}
+
+int agm_session_aif_set_params_take(uint32_t session_id, uint32_t aif_id,
+                                    void *payload, size_t size)
+{
+    int ret = agm_session_aif_set_params(session_id, aif_id, payload, size);
+
+    free(payload);
+    return ret;
+}
+
+int agm_session_aif_set_cal(uint32_t session_id, uint32_t aif_id,
+                            struct agm_cal_config *cal_config)
+{
+    struct agm_us_msg msg;
+
+    us_msg_init(&msg, AGM_US_SESSION_AIF_SET_CAL, session_id);
+    msg.arg[0] = session_id;
+    msg.arg[1] = aif_id;
+    msg.len = sizeof(*cal_config) +
+              cal_config->num_ckvs * sizeof(struct agm_key_value);
+    return us_call(&msg, cal_config, NULL, NULL);
+}
+
+int agm_session_set_params(uint32_t session_id, void *payload, size_t size)
+{
+    struct agm_us_msg msg;
+
+    us_msg_init(&msg, AGM_US_SESSION_SET_PARAMS, session_id);
+    msg.arg[0] = session_id;
+    msg.len = size;
+    return us_call(&msg, payload, NULL, NULL);
+}
+
+int agm_session_get_params(uint32_t session_id, void *payload, size_t size)
+{
+    struct agm_us_msg msg, reply;
+    void *data = NULL;
+    int ret;
+
+    us_msg_init(&msg, AGM_US_SESSION_GET_PARAMS, session_id);
+    msg.arg[0] = session_id;
+    msg.len = size;
+    ret = us_call(&msg, payload, &reply, &data);
+    if (ret)
+        goto done;
+
+    if (reply.len != size)
+        ret = -EPROTO;
+    else
+        memcpy(payload, data, size);
+
+done:
+    free(data);
+    return ret;
+}
+
+int agm_set_params_with_tag(uint32_t session_id, uint32_t aif_id,
+                            struct agm_tag_config *tag_config)
+{
+    struct agm_us_msg msg;
+
+    us_msg_init(&msg, AGM_US_SET_PARAMS_WITH_TAG, session_id);
+    msg.arg[0] = session_id;
+    msg.arg[1] = aif_id;
+    msg.len = sizeof(*tag_config) +
+              tag_config->num_tkvs * sizeof(struct agm_key_value);
+    return us_call(&msg, tag_config, NULL, NULL);
+}
+
+static int us_deregister_cb(uint32_t session_id, enum event_type evt_type,
+                            void *client_data)
+{
+    struct us_event_cb *entry = NULL;
+    struct listnode *node;
+    struct agm_us_msg msg;
+    int ret;
+
+    pthread_mutex_lock(&us_client.lock);
+    us_lists_init();
+    list_for_each(node, &us_client.event_cbs) {
+        entry = node_to_item(node, struct us_event_cb, node);
+        if (entry->session_id == session_id &&
+            entry->evt_type == (uint32_t)evt_type &&
+            entry->client_data == client_data)
+            break;
+        entry = NULL;
+    }
+    if (entry)
+        list_remove(&entry->node);
+    /* as with agm, the callback is not running once this returns */
+    while (entry && us_client.evt_busy == entry &&
+           !pthread_equal(pthread_self(), us_client.evt_thread))
+        pthread_cond_wait(&us_client.evt_cond, &us_client.lock);
+    pthread_mutex_unlock(&us_client.lock);
+
+    if (entry == NULL)
+        return -EINVAL;
+
+    us_msg_init(&msg, AGM_US_SESSION_REGISTER_CB, session_id);
+    msg.arg[0] = session_id;
+    msg.arg[1] = evt_type;
+    msg.arg[2] = 0;
+    msg.val = entry->cookie;
+    ret = us_call(&msg, NULL, NULL, NULL);
+    free(entry);
+    return ret;
+}
+
+int agm_session_register_cb(uint32_t session_id, agm_event_cb cb,
+                            enum event_type evt_type, void *client_data)
+{
+    struct us_event_cb *entry;
+    struct agm_us_msg msg;
+    uint32_t gen;
+    int ret;
+
+    if (cb == NULL)
+        return us_deregister_cb(session_id, evt_type, client_data);
+
+    entry = calloc(1, sizeof(*entry));
+    if (entry == NULL)
+        return -ENOMEM;
+
+    entry->session_id = session_id;
+    entry->evt_type = evt_type;
+    entry->cb = cb;
+    entry->client_data = client_data;
+
+    /* listed first so an event right after the reply finds it */
+    pthread_mutex_lock(&us_client.lock);
+    us_lists_init();
+    ret = us_connect_locked();
+    if (ret) {
+        pthread_mutex_unlock(&us_client.lock);
+        free(entry);
+        return ret;
+    }
+    entry->cookie = ++us_client.next_cookie;
+    gen = us_client.conn_gen;
+    list_add_tail(&us_client.event_cbs, &entry->node);
+    pthread_mutex_unlock(&us_client.lock);
+
+    us_msg_init(&msg, AGM_US_SESSION_REGISTER_CB, session_id);
+    msg.arg[0] = session_id;
+    msg.arg[1] = evt_type;
+    msg.arg[2] = 1;
+    msg.val = entry->cookie;
+    ret = us_call(&msg, NULL, NULL, NULL);
+    if (ret) {
+        pthread_mutex_lock(&us_client.lock);
+        /* a reconnect has already dropped it */
+        if (gen == us_client.conn_gen) {
+            list_remove(&entry->node);
+            free(entry);
+        }
+        pthread_mutex_unlock(&us_client.lock);
+    }
+
+    return ret;
+}
+
+int agm_session_register_for_events(uint32_t session_id,
+                                    struct agm_event_reg_cfg *evt_reg_cfg)
+{
+    struct agm_us_msg msg;
+
+    us_msg_init(&msg, AGM_US_SESSION_REGISTER_FOR_EVENTS, session_id);
+    msg.arg[0] = session_id;
+    msg.len = sizeof(*evt_reg_cfg) + evt_reg_cfg->event_config_payload_size;
+    return us_call(&msg, evt_reg_cfg, NULL, NULL);
+}
+
+int agm_session_set_loopback(uint32_t capture_session_id,
+                             uint32_t playback_session_id, bool state)
+{
+    struct agm_us_msg msg;
+
+    us_msg_init(&msg, AGM_US_SESSION_SET_LOOPBACK, capture_session_id);
+    msg.arg[0] = capture_session_id;
+    msg.arg[1] = playback_session_id;
+    msg.arg[2] = state;
+    return us_call(&msg, NULL, NULL, NULL);
+}
+
+int agm_session_set_ec_ref(uint32_t capture_session_id, uint32_t aif_id,
+                           bool state)
+{
+    struct agm_us_msg msg;
+
+    us_msg_init(&msg, AGM_US_SESSION_SET_EC_REF, capture_session_id);
+    msg.arg[0] = capture_session_id;
+    msg.arg[1] = aif_id;
+    msg.arg[2] = state;
+    return us_call(&msg, NULL, NULL, NULL);
+}
+
+int agm_get_buffer_timestamp(uint32_t session_id, uint64_t *timestamp)
+{
+    struct agm_us_msg msg, reply;
+    int ret;
+
+    us_msg_init(&msg, AGM_US_GET_BUFFER_TIMESTAMP, session_id);
+    msg.arg[0] = session_id;
+    ret = us_call(&msg, NULL, &reply, NULL);
+    if (!ret)
+        *timestamp = reply.val;
+    return ret;
+}
+
+int agm_recover_all(struct agm_session_recovery_info *info,
+                    size_t *num_sessions)
+{
+    struct agm_us_msg msg, reply;
+    void *data = NULL;
+    int ret;
+
+    if (num_sessions == NULL || (*num_sessions && info == NULL))
+        return -EINVAL;
+
+    us_msg_init(&msg, AGM_US_RECOVER_ALL, AGM_US_KEY_MODULE);
+    msg.val = info ? *num_sessions : 0;
+    ret = us_call(&msg, NULL, &reply, &data);
+    if (ret && reply.op != AGM_US_RECOVER_ALL)
+        goto done;
+
+    if (info && reply.len > *num_sessions * sizeof(*info)) {
+        ret = -EPROTO;
+        goto done;
+    }
+    if (info)
+        memcpy(info, data, reply.len);
+    *num_sessions = reply.val;
+
+done:
+    free(data);
+    return ret;
+}
+
+int agm_session_get_stats(uint32_t session_id, struct agm_session_stats *stats)
+{
+    struct agm_us_msg msg, reply;
+    void *data = NULL;
+    int ret;
+
+    us_msg_init(&msg, AGM_US_SESSION_GET_STATS, session_id);
+    msg.arg[0] = session_id;
+    ret = us_call(&msg, NULL, &reply, &data);
+    if (ret)
+        goto done;
+
+    if (reply.len != sizeof(*stats))
+        ret = -EPROTO;
+    else
+        memcpy(stats, data, sizeof(*stats));
+
+done:
+    free(data);
+    return ret;
+}
+
+uint64_t agm_get_data_generation(void)
+{
+    struct agm_us_msg msg, reply;
+
+    us_msg_init(&msg, AGM_US_GET_DATA_GENERATION, AGM_US_KEY_MODULE);
+    if (us_call(&msg, NULL, &reply, NULL))
+        return 0;
+    return reply.val;
+}
+
+int agm_session_open(uint32_t session_id, enum agm_session_mode sess_mode,
+                     uint64_t *handle)
+{
+    struct agm_us_msg msg, reply;
+    struct us_session *ses;
+    uint32_t gen;
+    int ret;
+
+    if (handle == NULL)
+        return -EINVAL;
+
+    us_msg_init(&msg, AGM_US_SESSION_OPEN, session_id);
+    msg.arg[0] = session_id;
+    msg.arg[1] = sess_mode;
+    ret = us_call(&msg, NULL, &reply, NULL);
+    if (ret)
+        return ret;
+
+    pthread_mutex_lock(&us_client.lock);
+    gen = us_client.conn_gen;
+    pthread_mutex_unlock(&us_client.lock);
+
+    ses = us_session_new(session_id, reply.handle, gen);
+    if (ses == NULL) {
+        us_msg_init(&msg, AGM_US_SESSION_CLOSE, session_id);
+        msg.handle = reply.handle;
+        us_call(&msg, NULL, NULL, NULL);
+        return -ENOMEM;
+    }
+
+    *handle = (uint64_t)ses;
+    return 0;
+}
+
+int agm_session_set_config(uint64_t hndl,
+                           struct agm_session_config *session_config,
+                           struct agm_media_config *media_config,
+                           struct agm_buffer_config *buffer_config)
+{
+    struct us_session *ses = (struct us_session *)hndl;
+    uint8_t cfg[sizeof(struct agm_media_config) +
+                sizeof(struct agm_buffer_config) +
+                sizeof(struct agm_session_config)];
+    struct agm_us_msg msg;
+    int ret;
+
+    ret = us_session_check(ses);
+    if (ret)
+        return ret;
+
+    memcpy(cfg, media_config, sizeof(*media_config));
+    memcpy(cfg + sizeof(*media_config), buffer_config,
+           sizeof(*buffer_config));
+    memcpy(cfg + sizeof(*media_config) + sizeof(*buffer_config),
+           session_config, sizeof(*session_config));
+
+    us_session_msg_init(&msg, AGM_US_SESSION_SET_CONFIG, ses);
+    msg.len = sizeof(cfg);
+    return us_call(&msg, cfg, NULL, NULL);
+}
+
+static int us_session_close(uint64_t hndl, uint32_t op)
+{
+    struct us_session *ses = (struct us_session *)hndl;
+    int ret;
+
+    if (ses == NULL)
+        return -EINVAL;
+
+    /* the server closed it already when the connection went */
+    ret = us_session_call(hndl, op);
+    if (ret == -ENOTCONN || ret == -ECONNRESET)
+        ret = 0;
+    if (!ret)
+        us_session_free(ses);
+    return ret;
+}
+
+int agm_session_close(uint64_t hndl)
+{
+    return us_session_close(hndl, AGM_US_SESSION_CLOSE);
+}
+
+int agm_session_close_async(uint64_t hndl)
+{
+    return us_session_close(hndl, AGM_US_SESSION_CLOSE_ASYNC);
+}
+
+int agm_session_prepare(uint64_t hndl)
+{
+    return us_session_call(hndl, AGM_US_SESSION_PREPARE);
+}
+
+int agm_session_start(uint64_t hndl)
+{
+    return us_session_call(hndl, AGM_US_SESSION_START);
+}
+
+int agm_session_stop(uint64_t hndl)
+{
+    return us_session_call(hndl, AGM_US_SESSION_STOP);
+}
+
+int agm_session_pause(uint64_t hndl)
+{
+    return us_session_call(hndl, AGM_US_SESSION_PAUSE);
+}
+
+int agm_session_resume(uint64_t hndl)
+{
+    return us_session_call(hndl, AGM_US_SESSION_RESUME);
+}
+
+int agm_session_flush(uint64_t hndl)
+{
+    return us_session_call(hndl, AGM_US_SESSION_FLUSH);
+}
+
+int agm_session_suspend(uint64_t hndl)
+{
+    return us_session_call(hndl, AGM_US_SESSION_SUSPEND);
+}
+
+int agm_session_eos(uint64_t handle)
+{
+    return us_session_call(handle, AGM_US_SESSION_EOS);
+}
+
+int agm_session_write(uint64_t hndl, void *buff, size_t *count)
+{
+    struct us_session *ses = (struct us_session *)hndl;
+    struct agm_us_msg msg, reply;
+    int ret;
+
+    ret = us_session_check(ses);
+    if (ret)
+        return ret;
+
+    us_session_msg_init(&msg, AGM_US_SESSION_WRITE, ses);
+    pthread_mutex_lock(&ses->buf_lock);
+    if (us_session_buf_ready(ses, *count)) {
+        memcpy(ses->buf, buff, *count);
+        msg.arg[0] = 1;
+        msg.val = *count;
+        ret = us_call(&msg, NULL, &reply, NULL);
+    } else {
+        msg.len = *count;
+        ret = us_call(&msg, buff, &reply, NULL);
+    }
+    pthread_mutex_unlock(&ses->buf_lock);
+
+    if (!ret)
+        *count = reply.val;
+    return ret;
+}
+
+int agm_session_read(uint64_t handle, void *buff, size_t *count)
+{
+    struct us_session *ses = (struct us_session *)handle;
+    struct agm_us_msg msg, reply;
+    void *data = NULL;
+    int ret;
+
+    ret = us_session_check(ses);
+    if (ret)
+        return ret;
+
+    us_session_msg_init(&msg, AGM_US_SESSION_READ, ses);
+    msg.val = *count;
+    pthread_mutex_lock(&ses->buf_lock);
+    if (us_session_buf_ready(ses, *count)) {
+        msg.arg[0] = 1;
+        ret = us_call(&msg, NULL, &reply, NULL);
+        if (!ret && reply.val > *count)
+            ret = -EPROTO;
+        if (!ret)
+            memcpy(buff, ses->buf, reply.val);
+    } else {
+        ret = us_call(&msg, NULL, &reply, &data);
+        if (!ret && reply.len > *count)
+            ret = -EPROTO;
+        if (!ret)
+            memcpy(buff, data, reply.len);
+        reply.val = reply.len;
+    }
+    pthread_mutex_unlock(&ses->buf_lock);
+
+    free(data);
+    if (!ret)
+        *count = reply.val;
+    return ret;
+}
+
+int agm_get_session_time(uint64_t handle, uint64_t *timestamp)
+{
+    struct us_session *ses = (struct us_session *)handle;
+    struct agm_us_msg msg, reply;
+    int ret;
+
+    ret = us_session_check(ses);
+    if (ret)
+        return ret;
+
+    us_session_msg_init(&msg, AGM_US_GET_SESSION_TIME, ses);
+    ret = us_call(&msg, NULL, &reply, NULL);
+    if (!ret)
+        *timestamp = reply.val;
+    return ret;
+}
+
+size_t agm_get_hw_processed_buff_cnt(uint64_t hndl, enum direction dir)
+{
+    struct us_session *ses = (struct us_session *)hndl;
+    struct agm_us_msg msg, reply;
+
+    if (us_session_check(ses))
+        return 0;
+
+    us_session_msg_init(&msg, AGM_US_GET_HW_PROCESSED_BUFF_CNT, ses);
+    msg.arg[0] = dir;
+    if (us_call(&msg, NULL, &reply, NULL))
+        return 0;
+    return reply.val;
+}
+
+int agm_session_update_stats(uint64_t hndl,
+                             const struct agm_session_stats *delta)
+{
+    struct us_session *ses = (struct us_session *)hndl;
+    struct agm_us_msg msg;
+    int ret;
+
+    ret = us_session_check(ses);
+    if (ret)
+        return ret;
+
+    us_session_msg_init(&msg, AGM_US_SESSION_UPDATE_STATS, ses);
+    msg.len = sizeof(*delta);
+    return us_call(&msg, delta, NULL, NULL);
+}
+
+int agm_set_gapless_session_metadata(uint64_t handle,
+                                     enum agm_gapless_silence_type type,
+                                     uint32_t silence)
+{
+    struct us_session *ses = (struct us_session *)handle;
+    struct agm_us_msg msg;
+    int ret;
+
+    ret = us_session_check(ses);
+    if (ret)
+        return ret;
+
+    us_session_msg_init(&msg, AGM_US_SET_GAPLESS_SESSION_METADATA, ses);
+    msg.arg[0] = type;
+    msg.arg[1] = silence;
+    return us_call(&msg, NULL, NULL, NULL);
+}
+
+static int us_group_call(uint32_t op, uint64_t *handles, uint32_t num_handles,
+                         uint64_t *start_skew_us)
+{
+    struct agm_us_msg msg, reply;
+    uint64_t *server_handles;
+    uint32_t i;
+    int ret = 0;
+
+    if (handles == NULL || num_handles == 0 ||
+        num_handles > AGM_US_MAX_DATA / sizeof(uint64_t))
+        return -EINVAL;
+
+    server_handles = calloc(num_handles, sizeof(uint64_t));
+    if (server_handles == NULL)
+        return -ENOMEM;
+
+    for (i = 0; i < num_handles && !ret; i++) {
+        ret = us_session_check((struct us_session *)handles[i]);
+        if (!ret)
+            server_handles[i] = ((struct us_session *)handles[i])->handle;
+    }
+
+    if (!ret) {
+        us_msg_init(&msg, op, AGM_US_KEY_MODULE);
+        msg.arg[0] = start_skew_us != NULL;
+        msg.len = num_handles * sizeof(uint64_t);
+        ret = us_call(&msg, server_handles, &reply, NULL);
+        if (start_skew_us)
+            *start_skew_us = ret ? 0 : reply.val;
+    }
+
+    free(server_handles);
+    return ret;
+}
+
+int agm_session_group_start(uint64_t *handles, uint32_t num_handles,
+                            uint64_t *start_skew_us)
+{
+    return us_group_call(AGM_US_SESSION_GROUP_START, handles, num_handles,
+                         start_skew_us);
+}
+
+int agm_session_group_stop(uint64_t *handles, uint32_t num_handles)
+{
+    return us_group_call(AGM_US_SESSION_GROUP_STOP, handles, num_handles,
+                         NULL);
+}
+
+int agm_session_run_ops(uint32_t session_id, uint64_t *hndl,
+                        struct agm_session_op *ops, uint32_t num_ops)
+{
+    const size_t cfg_size = sizeof(struct agm_media_config) +
+                            sizeof(struct agm_buffer_config) +
+                            sizeof(struct agm_session_config);
+    struct us_session *ses = NULL, *new_ses;
+    struct agm_us_msg msg, reply;
+    struct agm_us_run_op *rop;
+    int32_t *status = NULL;
+    uint8_t *data = NULL;
+    size_t len = 0, off = 0, size;
+    uint32_t i, gen;
+    int ret;
+
+    if (hndl == NULL || ops == NULL || num_ops == 0)
+        return -EINVAL;
+
+    if (*hndl) {
+        ses = (struct us_session *)*hndl;
+        ret = us_session_check(ses);
+        if (ret)
+            return ret;
+    }
+
+    for (i = 0; i < num_ops; i++) {
+        ops[i].status = -ECANCELED;
+        size = ops[i].type == AGM_SESSION_OP_SET_CONFIG ? cfg_size :
+               ops[i].size;
+        len = AGM_US_ALIGN8(len + sizeof(*rop) + size);
+    }
+    if (len > AGM_US_MAX_DATA)
+        return -E2BIG;
+
+    data = calloc(1, len);
+    if (data == NULL)
+        return -ENOMEM;
+
+    for (i = 0; i < num_ops; i++) {
+        rop = (struct agm_us_run_op *)(data + off);
+        rop->type = ops[i].type;
+        rop->sess_mode = ops[i].sess_mode;
+        rop->aif_id = ops[i].aif_id;
+        rop->state = ops[i].state;
+        off += sizeof(*rop);
+        if (ops[i].type == AGM_SESSION_OP_SET_CONFIG) {
+            rop->size = cfg_size;
+            memcpy(data + off, ops[i].media_config,
+                   sizeof(struct agm_media_config));
+            memcpy(data + off + sizeof(struct agm_media_config),
+                   ops[i].buffer_config, sizeof(struct agm_buffer_config));
+            memcpy(data + off + sizeof(struct agm_media_config) +
+                   sizeof(struct agm_buffer_config),
+                   ops[i].session_config, sizeof(struct agm_session_config));
+        } else if (ops[i].size) {
+            rop->size = ops[i].size;
+            memcpy(data + off, ops[i].payload, ops[i].size);
+        }
+        off = AGM_US_ALIGN8(off + rop->size);
+    }
+
+    us_msg_init(&msg, AGM_US_SESSION_RUN_OPS, session_id);
+    msg.arg[0] = session_id;
+    msg.arg[1] = num_ops;
+    msg.handle = ses ? ses->handle : 0;
+    msg.len = len;
+
+    /* a session that is closed by the list must not be written to */
+    if (ses)
+        pthread_mutex_lock(&ses->buf_lock);
+    ret = us_call(&msg, data, &reply, (void **)&status);
+    if (ses)
+        pthread_mutex_unlock(&ses->buf_lock);
+    free(data);
+
+    /* statuses come back whether or not all steps went through */
+    if (status && reply.len == num_ops * sizeof(*status)) {
+        for (i = 0; i < num_ops; i++)
+            ops[i].status = status[i];
+    }
+    free(status);
+
+    /* no reply, the session is where it was or gone with the service */
+    if (reply.op != AGM_US_SESSION_RUN_OPS)
+        return ret;
+
+    if (ses && reply.handle == 0) {
+        us_session_free(ses);
+        *hndl = 0;
+    } else if (ses == NULL && reply.handle) {
+        pthread_mutex_lock(&us_client.lock);
+        gen = us_client.conn_gen;
+        pthread_mutex_unlock(&us_client.lock);
+        new_ses = us_session_new(session_id, reply.handle, gen);
+        if (new_ses == NULL) {
+            us_msg_init(&msg, AGM_US_SESSION_CLOSE, session_id);
+            msg.handle = reply.handle;
+            us_call(&msg, NULL, NULL, NULL);
+            return -ENOMEM;
+        }
+        *hndl = (uint64_t)new_ses;
+    }
+
+    return ret;
+}
+
+int agm_init()
+{
+    AGM_LOGD("agm client connects on first use\n");
+    return 0;
+}
+
+int agm_deinit()
+{
+    pthread_mutex_lock(&us_client.lock);
+    us_client.closing = true;
+    pthread_mutex_unlock(&us_client.lock);
+
+    pthread_mutex_lock(&us_client.send_lock);
+    if (us_client.sock >= 0)
+        shutdown(us_client.sock, SHUT_RDWR);
+    pthread_mutex_unlock(&us_client.send_lock);
+    return 0;
+}
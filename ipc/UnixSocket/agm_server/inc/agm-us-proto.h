@@ -0,0 +1,294 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Wire format of the agm unix domain socket IPC.
+ *
+ * Every frame is a struct agm_us_msg followed by len bytes of data, in
+ * native byte order; fds travel as SCM_RIGHTS with the header. A request
+ * carries an id that its reply echoes, so a client can have any number of
+ * calls in flight on one connection. The server runs the calls of one key
+ * (the session id a call is about, or AGM_US_KEY_MODULE) in order and
+ * calls of different keys in parallel, so replies can come back out of
+ * order.
+ *
+ * A client opens two connections. On the first it sends HELLO and gets a
+ * token; on the second it presents the token with EVENTS, and from then
+ * on that connection only carries EVENT frames from the server. A
+ * callback that makes agm calls thus never sits in front of its own
+ * reply. The server pairs the two by token and SO_PEERCRED pid, and once
+ * the first connection goes away closes whatever the client left open.
+ *
+ * PCM does not go through the socket: a session's client hands over a
+ * memfd with SESSION_MAP_BUF and read and write only pass byte counts.
+ */
+
+#ifndef __AGM_US_PROTO_H__
+#define __AGM_US_PROTO_H__
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define AGM_US_SOCKET_PATH  "/var/run/agm/agm_us.sock"
+#define AGM_US_SOCKET_ENV   "AGM_US_SOCKET"
+#define AGM_US_VERSION      1
+
+#define AGM_US_KEY_MODULE   UINT32_MAX
+#define AGM_US_MAX_DATA     (16 * 1024 * 1024)
+#define AGM_US_MAX_FDS      4
+#define AGM_US_MAX_BUF      (4 * 1024 * 1024)
+
+enum agm_us_op {
+    AGM_US_NOP = 1,             /* does nothing, to time the transport */
+    AGM_US_HELLO,
+    AGM_US_EVENTS,
+    AGM_US_EVENT,               /* server to client, val is the cookie */
+    AGM_US_AIF_SET_MEDIA_CONFIG,
+    AGM_US_AIF_SET_METADATA,
+    AGM_US_AIF_SET_PARAMS,
+    AGM_US_AIF_GROUP_SET_MEDIA_CONFIG,
+    AGM_US_GET_AIF_INFO_LIST,
+    AGM_US_GET_GROUP_AIF_INFO_LIST,
+    AGM_US_SESSION_SET_METADATA,
+    AGM_US_SESSION_AIF_SET_METADATA,
+    AGM_US_SESSION_AIF_CONNECT,
+    AGM_US_SESSION_AIF_GET_TAG_MODULE_INFO,
+    AGM_US_SESSION_AIF_SET_PARAMS,
+    AGM_US_SESSION_AIF_SET_CAL,
+    AGM_US_SESSION_SET_PARAMS,
+    AGM_US_SESSION_GET_PARAMS,
+    AGM_US_SET_PARAMS_WITH_TAG,
+    AGM_US_SESSION_REGISTER_CB,
+    AGM_US_SESSION_REGISTER_FOR_EVENTS,
+    AGM_US_SESSION_SET_LOOPBACK,
+    AGM_US_SESSION_SET_EC_REF,
+    AGM_US_GET_BUFFER_TIMESTAMP,
+    AGM_US_SESSION_GET_STATS,
+    AGM_US_GET_DATA_GENERATION,
+    AGM_US_SESSION_OPEN,
+    AGM_US_SESSION_SET_CONFIG,
+    AGM_US_SESSION_CLOSE,
+    AGM_US_SESSION_PREPARE,
+    AGM_US_SESSION_START,
+    AGM_US_SESSION_STOP,
+    AGM_US_SESSION_PAUSE,
+    AGM_US_SESSION_RESUME,
+    AGM_US_SESSION_FLUSH,
+    AGM_US_SESSION_SUSPEND,
+    AGM_US_SESSION_EOS,
+    AGM_US_SESSION_MAP_BUF,
+    AGM_US_SESSION_WRITE,
+    AGM_US_SESSION_READ,
+    AGM_US_GET_SESSION_TIME,
+    AGM_US_GET_HW_PROCESSED_BUFF_CNT,
+    AGM_US_SESSION_UPDATE_STATS,
+    AGM_US_SET_GAPLESS_SESSION_METADATA,
+    AGM_US_SESSION_GROUP_START,
+    AGM_US_SESSION_GROUP_STOP,
+    AGM_US_SESSION_RUN_OPS,
+    AGM_US_SESSION_CLOSE_ASYNC,
+    AGM_US_RECOVER_ALL,
+    AGM_US_OP_MAX,
+};
+
+struct agm_us_msg {
+    uint32_t op;
+    uint32_t id;            /* request id, echoed by the reply */
+    uint32_t key;           /* calls of one key run in order */
+    int32_t status;         /* reply: 0 or -errno */
+    uint64_t handle;        /* session handle of the server */
+    uint64_t val;           /* op specific */
+    uint32_t arg[4];        /* op specific */
+    uint32_t len;           /* data bytes following */
+    uint32_t num_fds;       /* fds sent with the header */
+};
+
+/* one step of SESSION_RUN_OPS, followed by size bytes padded to 8 */
+struct agm_us_run_op {
+    uint32_t type;
+    uint32_t sess_mode;
+    uint32_t aif_id;
+    uint32_t state;
+    uint32_t size;
+    uint32_t reserved;
+};
+
+#define AGM_US_ALIGN8(x)    (((x) + 7) & ~(size_t)7)
+
+static inline const char *agm_us_socket_path(void)
+{
+    const char *path = getenv(AGM_US_SOCKET_ENV);
+
+    return path && *path ? path : AGM_US_SOCKET_PATH;
+}
+
+static inline int agm_us_sockaddr(struct sockaddr_un *addr)
+{
+    const char *path = agm_us_socket_path();
+
+    if (strlen(path) >= sizeof(addr->sun_path))
+        return -ENAMETOOLONG;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/*
+ * Send one frame. fds, if any, are msg->num_fds descriptors; the caller
+ * keeps them. Callers sending on the same socket from several threads
+ * serialize around this.
+ */
+static inline int agm_us_send(int sock, const struct agm_us_msg *msg,
+                              const void *data, const int *fds)
+{
+    char cbuf[CMSG_SPACE(sizeof(int) * AGM_US_MAX_FDS)];
+    size_t total = sizeof(*msg) + msg->len, done = 0;
+    struct msghdr mh;
+    struct cmsghdr *cmsg;
+    struct iovec iov[2];
+    ssize_t n;
+    int niov;
+
+    if (msg->len > AGM_US_MAX_DATA || msg->num_fds > AGM_US_MAX_FDS ||
+        (msg->num_fds && fds == NULL) || (msg->len && data == NULL))
+        return -EINVAL;
+
+    while (done < total) {
+        memset(&mh, 0, sizeof(mh));
+        niov = 0;
+        if (done < sizeof(*msg)) {
+            iov[niov].iov_base = (uint8_t *)msg + done;
+            iov[niov++].iov_len = sizeof(*msg) - done;
+            if (msg->len) {
+                iov[niov].iov_base = (void *)data;
+                iov[niov++].iov_len = msg->len;
+            }
+        } else {
+            iov[niov].iov_base = (uint8_t *)data + done - sizeof(*msg);
+            iov[niov++].iov_len = total - done;
+        }
+        mh.msg_iov = iov;
+        mh.msg_iovlen = niov;
+
+        if (done == 0 && msg->num_fds && fds) {
+            mh.msg_control = cbuf;
+            mh.msg_controllen = CMSG_SPACE(sizeof(int) * msg->num_fds);
+            cmsg = CMSG_FIRSTHDR(&mh);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int) * msg->num_fds);
+            memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * msg->num_fds);
+        }
+
+        n = sendmsg(sock, &mh, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        done += n;
+    }
+
+    return 0;
+}
+
+static inline int agm_us_read_full(int sock, void *buf, size_t len)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < len) {
+        n = recv(sock, (uint8_t *)buf + done, len - done, 0);
+        if (n == 0)
+            return -ECONNRESET;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        done += n;
+    }
+
+    return 0;
+}
+
+/*
+ * Receive one frame. *data is malloc()ed when the frame has data, NULL
+ * otherwise; fds receives msg->num_fds descriptors the caller owns.
+ * Returns -ECONNRESET when the peer has gone away.
+ */
+static inline int agm_us_recv(int sock, struct agm_us_msg *msg, void **data,
+                              int *fds)
+{
+    char cbuf[CMSG_SPACE(sizeof(int) * AGM_US_MAX_FDS)];
+    struct cmsghdr *cmsg;
+    struct msghdr mh;
+    struct iovec iov;
+    uint32_t num_fds = 0, i;
+    ssize_t n;
+    int ret;
+
+    *data = NULL;
+    iov.iov_base = msg;
+    iov.iov_len = sizeof(*msg);
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = cbuf;
+    mh.msg_controllen = sizeof(cbuf);
+
+    do {
+        n = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n == 0)
+        return -ECONNRESET;
+    if (n < 0)
+        return -errno;
+
+    for (cmsg = CMSG_FIRSTHDR(&mh); cmsg; cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        if (num_fds > AGM_US_MAX_FDS)
+            num_fds = AGM_US_MAX_FDS;
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * num_fds);
+    }
+
+    ret = 0;
+    if ((size_t)n < sizeof(*msg))
+        ret = agm_us_read_full(sock, (uint8_t *)msg + n, sizeof(*msg) - n);
+    if (!ret && (mh.msg_flags & MSG_CTRUNC || num_fds != msg->num_fds ||
+                 msg->len > AGM_US_MAX_DATA))
+        ret = -EPROTO;
+
+    if (!ret && msg->len) {
+        *data = malloc(msg->len);
+        if (*data == NULL)
+            ret = -ENOMEM;
+        else
+            ret = agm_us_read_full(sock, *data, msg->len);
+    }
+
+    if (ret) {
+        for (i = 0; i < num_fds; i++)
+            close(fds[i]);
+        free(*data);
+        *data = NULL;
+        msg->num_fds = 0;
+    }
+
+    return ret;
+}
+
+#endif /* __AGM_US_PROTO_H__ */
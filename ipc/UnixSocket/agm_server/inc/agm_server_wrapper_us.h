@@ -0,0 +1,20 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+#ifndef __AGM_SERVER_WRAPPER_US_H__
+#define __AGM_SERVER_WRAPPER_US_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int ipc_agm_init();
+void ipc_agm_deinit();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AGM_SERVER_WRAPPER_US_H__ */
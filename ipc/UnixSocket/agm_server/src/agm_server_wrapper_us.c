@@ -0,0 +1,1177 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+#define LOG_TAG "agm_server_wrapper_us"
+#define _GNU_SOURCE
+
+#include <agm/agm_api.h>
+#include <agm/agm_list.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "agm-us-proto.h"
+#include "agm_server_wrapper_us.h"
+#include "utils.h"
+
+/* lanes a client can have, calls of further keys share the module lane */
+#define AGM_US_MAX_LANES    32
+#define AGM_US_BACKLOG      16
+
+struct us_client;
+
+/* one request waiting for its lane */
+struct us_work {
+    struct listnode node;
+    struct agm_us_msg msg;
+    void *data;
+    int fds[AGM_US_MAX_FDS];
+};
+
+/* runs the calls of one key of a client in the order they came in */
+struct us_lane {
+    struct listnode node;
+    struct us_client *client;
+    uint32_t key;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct listnode work;
+    bool quit;
+};
+
+/* a session the client opened and has not closed yet */
+struct us_session {
+    struct listnode node;
+    uint32_t session_id;
+    uint64_t handle;
+    void *buf;                  /* client memfd, SESSION_MAP_BUF */
+    size_t buf_size;
+};
+
+/* client_data of a callback registered with agm for the client */
+struct us_cb {
+    struct listnode node;
+    struct us_client *client;
+    uint32_t session_id;
+    uint32_t evt_type;
+    uint64_t cookie;
+};
+
+struct us_client {
+    struct listnode node;
+    int sock;
+    pid_t pid;
+    uid_t uid;
+    uint64_t token;             /* nonzero once HELLO was answered */
+    pthread_mutex_t lock;       /* lanes, sessions, cbs */
+    pthread_mutex_t send_lock;
+    pthread_mutex_t evt_lock;
+    int evt_sock;
+    struct listnode lanes;
+    uint32_t num_lanes;
+    struct listnode sessions;
+    struct listnode cbs;
+};
+
+static struct {
+    int sock;
+    pthread_t thread;
+    bool started;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct listnode clients;    /* every connection with a reader thread */
+    uint32_t num_conns;
+} us_server = {
+    .sock = -1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void us_close_fds(int *fds, uint32_t num_fds)
+{
+    uint32_t i;
+
+    for (i = 0; i < num_fds; i++)
+        close(fds[i]);
+}
+
+static int us_reply(struct us_client *client, struct agm_us_msg *reply,
+                    const void *data)
+{
+    int ret;
+
+    pthread_mutex_lock(&client->send_lock);
+    ret = agm_us_send(client->sock, reply, data, NULL);
+    pthread_mutex_unlock(&client->send_lock);
+
+    if (ret)
+        AGM_LOGE("reply to pid %d failed %d", client->pid, ret);
+    return ret;
+}
+
+/* looks up a session of the client, the caller holds client->lock */
+static struct us_session *us_session_find(struct us_client *client,
+                                          uint64_t handle)
+{
+    struct listnode *node;
+    struct us_session *ses;
+
+    list_for_each(node, &client->sessions) {
+        ses = node_to_item(node, struct us_session, node);
+        if (ses->handle == handle)
+            return ses;
+    }
+
+    return NULL;
+}
+
+static void us_session_unmap(struct us_session *ses)
+{
+    if (ses->buf)
+        munmap(ses->buf, ses->buf_size);
+    ses->buf = NULL;
+    ses->buf_size = 0;
+}
+
+static int us_session_add(struct us_client *client, uint32_t session_id,
+                          uint64_t handle)
+{
+    struct us_session *ses;
+
+    ses = calloc(1, sizeof(*ses));
+    if (ses == NULL)
+        return -ENOMEM;
+
+    ses->session_id = session_id;
+    ses->handle = handle;
+    pthread_mutex_lock(&client->lock);
+    list_add_tail(&client->sessions, &ses->node);
+    pthread_mutex_unlock(&client->lock);
+    return 0;
+}
+
+static void us_session_remove(struct us_client *client, struct us_session *ses)
+{
+    pthread_mutex_lock(&client->lock);
+    list_remove(&ses->node);
+    pthread_mutex_unlock(&client->lock);
+    us_session_unmap(ses);
+    free(ses);
+}
+
+static void us_event_cb(uint32_t session_id,
+                        struct agm_event_cb_params *event_params,
+                        void *client_data)
+{
+    struct us_cb *cb = client_data;
+    struct us_client *client = cb->client;
+    struct agm_us_msg msg;
+    int ret;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.op = AGM_US_EVENT;
+    msg.key = session_id;
+    msg.val = cb->cookie;
+    msg.arg[0] = session_id;
+    msg.arg[1] = cb->evt_type;
+    msg.len = sizeof(*event_params) + event_params->event_payload_size;
+
+    pthread_mutex_lock(&client->evt_lock);
+    if (client->evt_sock >= 0) {
+        ret = agm_us_send(client->evt_sock, &msg, event_params, NULL);
+        if (ret)
+            AGM_LOGE("event to pid %d failed %d", client->pid, ret);
+    }
+    pthread_mutex_unlock(&client->evt_lock);
+}
+
+static int us_register_cb(struct us_client *client, struct agm_us_msg *msg)
+{
+    uint32_t session_id = msg->arg[0], evt_type = msg->arg[1];
+    struct listnode *node, *temp;
+    struct us_cb *cb = NULL;
+    int ret;
+
+    if (msg->arg[2]) {
+        cb = calloc(1, sizeof(*cb));
+        if (cb == NULL)
+            return -ENOMEM;
+
+        cb->client = client;
+        cb->session_id = session_id;
+        cb->evt_type = evt_type;
+        cb->cookie = msg->val;
+        ret = agm_session_register_cb(session_id, us_event_cb,
+                                      (enum event_type)evt_type, cb);
+        if (ret) {
+            free(cb);
+            return ret;
+        }
+
+        pthread_mutex_lock(&client->lock);
+        list_add_tail(&client->cbs, &cb->node);
+        pthread_mutex_unlock(&client->lock);
+        return 0;
+    }
+
+    pthread_mutex_lock(&client->lock);
+    list_for_each_safe(node, temp, &client->cbs) {
+        cb = node_to_item(node, struct us_cb, node);
+        if (cb->session_id == session_id && cb->evt_type == evt_type &&
+            cb->cookie == msg->val) {
+            list_remove(&cb->node);
+            break;
+        }
+        cb = NULL;
+    }
+    pthread_mutex_unlock(&client->lock);
+
+    if (cb == NULL)
+        return -EINVAL;
+
+    /* once this returns agm does not run cb any more */
+    ret = agm_session_register_cb(session_id, NULL,
+                                  (enum event_type)evt_type, cb);
+    free(cb);
+    return ret;
+}
+
+static int us_map_buf(struct us_session *ses, struct agm_us_msg *msg,
+                      int *fds)
+{
+    struct stat st;
+    void *addr;
+    int seals;
+
+    if (msg->num_fds != 1 || msg->val == 0 || msg->val > AGM_US_MAX_BUF)
+        return -EINVAL;
+
+    /* a buffer the client could still shrink would fault in here */
+    seals = fcntl(fds[0], F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK))
+        return -EINVAL;
+
+    if (fstat(fds[0], &st) || (uint64_t)st.st_size < msg->val)
+        return -EINVAL;
+
+    addr = mmap(NULL, msg->val, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fds[0], 0);
+    if (addr == MAP_FAILED)
+        return -errno;
+
+    us_session_unmap(ses);
+    ses->buf = addr;
+    ses->buf_size = msg->val;
+    return 0;
+}
+
+/* handles of a group call, checked against the client's sessions */
+static int us_group_handles(struct us_client *client, struct agm_us_msg *msg,
+                            void *data)
+{
+    uint64_t *handles = data;
+    uint32_t i, num = msg->len / sizeof(uint64_t);
+    int ret = 0;
+
+    if (num == 0 || msg->len % sizeof(uint64_t))
+        return -EINVAL;
+
+    pthread_mutex_lock(&client->lock);
+    for (i = 0; i < num && !ret; i++) {
+        if (us_session_find(client, handles[i]) == NULL)
+            ret = -EINVAL;
+    }
+    pthread_mutex_unlock(&client->lock);
+
+    return ret ? ret : (int)num;
+}
+
+static int us_run_ops(struct us_client *client, struct agm_us_msg *msg,
+                      void *data, struct agm_us_msg *reply, void **rdata)
+{
+    const size_t cfg_size = sizeof(struct agm_media_config) +
+                            sizeof(struct agm_buffer_config) +
+                            sizeof(struct agm_session_config);
+    uint32_t session_id = msg->arg[0], num_ops = msg->arg[1], i;
+    struct agm_us_run_op *rop;
+    struct agm_session_op *ops = NULL;
+    struct us_session *ses = NULL;
+    uint64_t handle = msg->handle;
+    int32_t *status = NULL;
+    bool was_open = handle != 0, has_close = false;
+    size_t off = 0;
+    int ret;
+
+    /* unchanged unless the list opens or closes the session */
+    reply->handle = handle;
+
+    if (num_ops == 0 || num_ops > msg->len / sizeof(*rop))
+        return -EINVAL;
+
+    if (was_open) {
+        pthread_mutex_lock(&client->lock);
+        ses = us_session_find(client, handle);
+        pthread_mutex_unlock(&client->lock);
+        if (ses == NULL || ses->session_id != session_id)
+            return -EINVAL;
+    }
+
+    ops = calloc(num_ops, sizeof(*ops));
+    status = calloc(num_ops, sizeof(*status));
+    if (ops == NULL || status == NULL) {
+        ret = -ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < num_ops; i++) {
+        if (off > msg->len || msg->len - off < sizeof(*rop)) {
+            ret = -EINVAL;
+            goto done;
+        }
+        rop = (struct agm_us_run_op *)((uint8_t *)data + off);
+        off += sizeof(*rop);
+        if (rop->size > msg->len - off || rop->type > AGM_SESSION_OP_CLOSE) {
+            ret = -EINVAL;
+            goto done;
+        }
+
+        ops[i].type = (enum agm_session_op_type)rop->type;
+        ops[i].sess_mode = (enum agm_session_mode)rop->sess_mode;
+        ops[i].aif_id = rop->aif_id;
+        ops[i].state = rop->state;
+        ops[i].size = rop->size;
+        ops[i].payload = rop->size ? (uint8_t *)data + off : NULL;
+        off = AGM_US_ALIGN8(off + rop->size);
+        has_close |= ops[i].type == AGM_SESSION_OP_CLOSE;
+
+        if (ops[i].type != AGM_SESSION_OP_SET_CONFIG)
+            continue;
+        if (rop->size != cfg_size) {
+            ret = -EINVAL;
+            goto done;
+        }
+        ops[i].media_config = ops[i].payload;
+        ops[i].buffer_config = (struct agm_buffer_config *)
+                    ((uint8_t *)ops[i].payload +
+                     sizeof(struct agm_media_config));
+        ops[i].session_config = (struct agm_session_config *)
+                    ((uint8_t *)ops[i].payload +
+                     sizeof(struct agm_media_config) +
+                     sizeof(struct agm_buffer_config));
+    }
+
+    /* the buffer must not outlive the session */
+    if (ses && has_close)
+        us_session_unmap(ses);
+
+    ret = agm_session_run_ops(session_id, &handle, ops, num_ops);
+
+    for (i = 0; i < num_ops; i++)
+        status[i] = ops[i].status;
+
+    /* keep the client's sessions in step with what the list did */
+    if (!was_open && handle) {
+        if (us_session_add(client, session_id, handle)) {
+            agm_session_close(handle);
+            handle = 0;
+        }
+    } else if (was_open && handle == 0) {
+        us_session_remove(client, ses);
+    }
+
+    reply->handle = handle;
+    reply->len = num_ops * sizeof(*status);
+    *rdata = status;
+    status = NULL;
+
+done:
+    free(status);
+    free(ops);
+    return ret;
+}
+
+/* handle calls run on the lane of their session only */
+static struct us_session *us_handle_session(struct us_client *client,
+                                            struct agm_us_msg *msg)
+{
+    struct us_session *ses;
+
+    pthread_mutex_lock(&client->lock);
+    ses = us_session_find(client, msg->handle);
+    pthread_mutex_unlock(&client->lock);
+
+    if (ses && ses->session_id != msg->key)
+        ses = NULL;
+    return ses;
+}
+
+/*
+ * Runs one call of the client; fds of the request stay with the caller, and
+ * so does *datap unless a call hands it to agm and clears it. *rdata, if
+ * set, is freed by the caller after the reply went out.
+ */
+static int us_dispatch(struct us_client *client, struct agm_us_msg *msg,
+                       void **datap, int *fds, struct agm_us_msg *reply,
+                       void **rdata)
+{
+    void *data = *datap;
+    const size_t cfg_size = sizeof(struct agm_media_config) +
+                            sizeof(struct agm_buffer_config) +
+                            sizeof(struct agm_session_config);
+    struct agm_session_stats *stats;
+    struct agm_event_reg_cfg *evt_cfg;
+    struct agm_tag_config *tag_cfg;
+    struct agm_cal_config *cal_cfg;
+    struct us_session *ses;
+    size_t size, num;
+    uint64_t val;
+    int ret;
+
+    switch (msg->op) {
+    case AGM_US_NOP:
+        return 0;
+    case AGM_US_AIF_SET_MEDIA_CONFIG:
+        if (msg->len != sizeof(struct agm_media_config))
+            return -EINVAL;
+        return agm_aif_set_media_config(msg->arg[0], data);
+    case AGM_US_AIF_SET_METADATA:
+        return agm_aif_set_metadata(msg->arg[0], msg->len, data);
+    case AGM_US_AIF_SET_PARAMS:
+        /* agm keeps aif params, it gets the buffer they came in */
+        *datap = NULL;
+        return agm_aif_set_params_take(msg->arg[0], data, msg->len);
+    case AGM_US_AIF_GROUP_SET_MEDIA_CONFIG:
+        if (msg->len != sizeof(struct agm_group_media_config))
+            return -EINVAL;
+        return agm_aif_group_set_media_config(msg->arg[0], data);
+    case AGM_US_GET_AIF_INFO_LIST:
+    case AGM_US_GET_GROUP_AIF_INFO_LIST:
+        num = msg->val;
+        if (num > AGM_US_MAX_DATA / sizeof(struct aif_info))
+            return -EINVAL;
+        if (num) {
+            *rdata = calloc(num, sizeof(struct aif_info));
+            if (*rdata == NULL)
+                return -ENOMEM;
+        }
+        if (msg->op == AGM_US_GET_AIF_INFO_LIST)
+            ret = agm_get_aif_info_list(*rdata, &num);
+        else
+            ret = agm_get_group_aif_info_list(*rdata, &num);
+        if (ret)
+            return ret;
+        reply->val = num;
+        if (*rdata)
+            reply->len = (num < msg->val ? num : msg->val) *
+                         sizeof(struct aif_info);
+        return 0;
+    case AGM_US_SESSION_SET_METADATA:
+        return agm_session_set_metadata(msg->arg[0], msg->len, data);
+    case AGM_US_SESSION_AIF_SET_METADATA:
+        return agm_session_aif_set_metadata(msg->arg[0], msg->arg[1],
+                                            msg->len, data);
+    case AGM_US_SESSION_AIF_CONNECT:
+        return agm_session_aif_connect(msg->arg[0], msg->arg[1],
+                                       msg->arg[2]);
+    case AGM_US_SESSION_AIF_GET_TAG_MODULE_INFO:
+        size = msg->val;
+        if (size > AGM_US_MAX_DATA)
+            return -EINVAL;
+        if (size) {
+            *rdata = calloc(1, size);
+            if (*rdata == NULL)
+                return -ENOMEM;
+        }
+        ret = agm_session_aif_get_tag_module_info(msg->arg[0], msg->arg[1],
+                                                  *rdata, &size);
+        if (ret)
+            return ret;
+        reply->val = size;
+        if (*rdata)
+            reply->len = size < msg->val ? size : msg->val;
+        return 0;
+    case AGM_US_SESSION_AIF_SET_PARAMS:
+        *datap = NULL;
+        return agm_session_aif_set_params_take(msg->arg[0], msg->arg[1], data,
+                                               msg->len);
+    case AGM_US_SESSION_AIF_SET_CAL:
+        cal_cfg = data;
+        if (msg->len < sizeof(*cal_cfg) ||
+            cal_cfg->num_ckvs > (msg->len - sizeof(*cal_cfg)) /
+                                sizeof(struct agm_key_value))
+            return -EINVAL;
+        return agm_session_aif_set_cal(msg->arg[0], msg->arg[1], cal_cfg);
+    case AGM_US_SESSION_SET_PARAMS:
+        return agm_session_set_params(msg->arg[0], data, msg->len);
+    case AGM_US_SESSION_GET_PARAMS:
+        if (msg->len == 0)
+            return -EINVAL;
+        ret = agm_session_get_params(msg->arg[0], data, msg->len);
+        if (ret)
+            return ret;
+        /* the request buffer goes back with the result in it */
+        *rdata = data;
+        reply->len = msg->len;
+        return 0;
+    case AGM_US_SET_PARAMS_WITH_TAG:
+        tag_cfg = data;
+        if (msg->len < sizeof(*tag_cfg) ||
+            tag_cfg->num_tkvs > (msg->len - sizeof(*tag_cfg)) /
+                                sizeof(struct agm_key_value))
+            return -EINVAL;
+        return agm_set_params_with_tag(msg->arg[0], msg->arg[1], tag_cfg);
+    case AGM_US_SESSION_REGISTER_CB:
+        return us_register_cb(client, msg);
+    case AGM_US_SESSION_REGISTER_FOR_EVENTS:
+        evt_cfg = data;
+        if (msg->len < sizeof(*evt_cfg) ||
+            evt_cfg->event_config_payload_size > msg->len - sizeof(*evt_cfg))
+            return -EINVAL;
+        return agm_session_register_for_events(msg->arg[0], evt_cfg);
+    case AGM_US_SESSION_SET_LOOPBACK:
+        return agm_session_set_loopback(msg->arg[0], msg->arg[1],
+                                        msg->arg[2]);
+    case AGM_US_SESSION_SET_EC_REF:
+        return agm_session_set_ec_ref(msg->arg[0], msg->arg[1], msg->arg[2]);
+    case AGM_US_GET_BUFFER_TIMESTAMP:
+        ret = agm_get_buffer_timestamp(msg->arg[0], &val);
+        reply->val = val;
+        return ret;
+    case AGM_US_SESSION_GET_STATS:
+        stats = calloc(1, sizeof(*stats));
+        if (stats == NULL)
+            return -ENOMEM;
+        *rdata = stats;
+        ret = agm_session_get_stats(msg->arg[0], stats);
+        if (!ret)
+            reply->len = sizeof(*stats);
+        return ret;
+    case AGM_US_GET_DATA_GENERATION:
+        reply->val = agm_get_data_generation();
+        return 0;
+    case AGM_US_RECOVER_ALL:
+        num = msg->val;
+        if (num > AGM_US_MAX_DATA / sizeof(struct agm_session_recovery_info))
+            return -EINVAL;
+        if (num) {
+            *rdata = calloc(num, sizeof(struct agm_session_recovery_info));
+            if (*rdata == NULL)
+                return -ENOMEM;
+        }
+        /* the per session results go back on failure too */
+        ret = agm_recover_all(*rdata, &num);
+        reply->val = num;
+        if (*rdata)
+            reply->len = (num < msg->val ? num : msg->val) *
+                         sizeof(struct agm_session_recovery_info);
+        return ret;
+    case AGM_US_SESSION_OPEN:
+        ret = agm_session_open(msg->arg[0], (enum agm_session_mode)msg->arg[1],
+                               &val);
+        if (ret)
+            return ret;
+        ret = us_session_add(client, msg->arg[0], val);
+        if (ret) {
+            agm_session_close(val);
+            return ret;
+        }
+        reply->handle = val;
+        return 0;
+    case AGM_US_SESSION_GROUP_START:
+    case AGM_US_SESSION_GROUP_STOP:
+        ret = us_group_handles(client, msg, data);
+        if (ret < 0)
+            return ret;
+        if (msg->op == AGM_US_SESSION_GROUP_STOP)
+            return agm_session_group_stop(data, ret);
+        val = 0;
+        ret = agm_session_group_start(data, ret, msg->arg[0] ? &val : NULL);
+        reply->val = val;
+        return ret;
+    case AGM_US_SESSION_RUN_OPS:
+        return us_run_ops(client, msg, data, reply, rdata);
+    default:
+        if (msg->op >= AGM_US_OP_MAX)
+            return -EOPNOTSUPP;
+        break;
+    }
+
+    ses = us_handle_session(client, msg);
+    if (ses == NULL)
+        return -EINVAL;
+
+    switch (msg->op) {
+    case AGM_US_SESSION_SET_CONFIG:
+        if (msg->len != cfg_size)
+            return -EINVAL;
+        return agm_session_set_config(ses->handle,
+                    (struct agm_session_config *)((uint8_t *)data +
+                        sizeof(struct agm_media_config) +
+                        sizeof(struct agm_buffer_config)),
+                    data,
+                    (struct agm_buffer_config *)((uint8_t *)data +
+                        sizeof(struct agm_media_config)));
+    case AGM_US_SESSION_CLOSE:
+    case AGM_US_SESSION_CLOSE_ASYNC:
+        us_session_unmap(ses);
+        if (msg->op == AGM_US_SESSION_CLOSE_ASYNC)
+            ret = agm_session_close_async(ses->handle);
+        else
+            ret = agm_session_close(ses->handle);
+        if (!ret)
+            us_session_remove(client, ses);
+        return ret;
+    case AGM_US_SESSION_PREPARE:
+        return agm_session_prepare(ses->handle);
+    case AGM_US_SESSION_START:
+        return agm_session_start(ses->handle);
+    case AGM_US_SESSION_STOP:
+        return agm_session_stop(ses->handle);
+    case AGM_US_SESSION_PAUSE:
+        return agm_session_pause(ses->handle);
+    case AGM_US_SESSION_RESUME:
+        return agm_session_resume(ses->handle);
+    case AGM_US_SESSION_FLUSH:
+        return agm_session_flush(ses->handle);
+    case AGM_US_SESSION_SUSPEND:
+        return agm_session_suspend(ses->handle);
+    case AGM_US_SESSION_EOS:
+        return agm_session_eos(ses->handle);
+    case AGM_US_SESSION_MAP_BUF:
+        return us_map_buf(ses, msg, fds);
+    case AGM_US_SESSION_WRITE:
+        /* arg[0] set: the data is in the mapped buffer, val bytes of it */
+        if (msg->arg[0]) {
+            if (ses->buf == NULL || msg->val > ses->buf_size)
+                return -EINVAL;
+            size = msg->val;
+            ret = agm_session_write(ses->handle, ses->buf, &size);
+        } else {
+            size = msg->len;
+            ret = agm_session_write(ses->handle, data, &size);
+        }
+        reply->val = size;
+        return ret;
+    case AGM_US_SESSION_READ:
+        size = msg->val;
+        if (msg->arg[0]) {
+            if (ses->buf == NULL || size > ses->buf_size)
+                return -EINVAL;
+            ret = agm_session_read(ses->handle, ses->buf, &size);
+        } else {
+            if (size == 0 || size > AGM_US_MAX_DATA)
+                return -EINVAL;
+            *rdata = malloc(size);
+            if (*rdata == NULL)
+                return -ENOMEM;
+            ret = agm_session_read(ses->handle, *rdata, &size);
+            if (!ret)
+                reply->len = size < msg->val ? size : msg->val;
+        }
+        reply->val = size;
+        return ret;
+    case AGM_US_GET_SESSION_TIME:
+        ret = agm_get_session_time(ses->handle, &val);
+        reply->val = val;
+        return ret;
+    case AGM_US_GET_HW_PROCESSED_BUFF_CNT:
+        reply->val = agm_get_hw_processed_buff_cnt(ses->handle,
+                                                   (enum direction)msg->arg[0]);
+        return 0;
+    case AGM_US_SESSION_UPDATE_STATS:
+        if (msg->len != sizeof(struct agm_session_stats))
+            return -EINVAL;
+        return agm_session_update_stats(ses->handle, data);
+    case AGM_US_SET_GAPLESS_SESSION_METADATA:
+        return agm_set_gapless_session_metadata(ses->handle,
+                    (enum agm_gapless_silence_type)msg->arg[0], msg->arg[1]);
+    default:
+        return -EOPNOTSUPP;
+    }
+}
+
+static void *us_lane_loop(void *arg)
+{
+    struct us_lane *lane = arg;
+    struct us_client *client = lane->client;
+    struct agm_us_msg reply;
+    struct us_work *work;
+    void *rdata;
+
+    for (;;) {
+        pthread_mutex_lock(&lane->lock);
+        while (list_empty(&lane->work) && !lane->quit)
+            pthread_cond_wait(&lane->cond, &lane->lock);
+        if (list_empty(&lane->work)) {
+            pthread_mutex_unlock(&lane->lock);
+            break;
+        }
+        work = node_to_item(list_head(&lane->work), struct us_work, node);
+        list_remove(&work->node);
+        pthread_mutex_unlock(&lane->lock);
+
+        memset(&reply, 0, sizeof(reply));
+        reply.op = work->msg.op;
+        reply.id = work->msg.id;
+        reply.key = work->msg.key;
+        rdata = NULL;
+        reply.status = us_dispatch(client, &work->msg, &work->data,
+                                   work->fds, &reply, &rdata);
+        us_reply(client, &reply, rdata);
+
+        if (rdata != work->data)
+            free(rdata);
+        free(work->data);
+        us_close_fds(work->fds, work->msg.num_fds);
+        free(work);
+    }
+
+    return NULL;
+}
+
+static void us_lane_stop(struct us_lane *lane)
+{
+    pthread_mutex_lock(&lane->lock);
+    lane->quit = true;
+    pthread_cond_signal(&lane->cond);
+    pthread_mutex_unlock(&lane->lock);
+    pthread_join(lane->thread, NULL);
+
+    pthread_cond_destroy(&lane->cond);
+    pthread_mutex_destroy(&lane->lock);
+    free(lane);
+}
+
+/* only the client's reader thread adds lanes, so no lock is needed here */
+static struct us_lane *us_lane_get(struct us_client *client, uint32_t key)
+{
+    struct us_lane *lane, *module_lane = NULL;
+    struct listnode *node;
+
+    list_for_each(node, &client->lanes) {
+        lane = node_to_item(node, struct us_lane, node);
+        if (lane->key == key)
+            return lane;
+        if (lane->key == AGM_US_KEY_MODULE)
+            module_lane = lane;
+    }
+
+    if (client->num_lanes >= AGM_US_MAX_LANES && module_lane)
+        return module_lane;
+
+    lane = calloc(1, sizeof(*lane));
+    if (lane == NULL)
+        return module_lane;
+
+    lane->client = client;
+    lane->key = key;
+    list_init(&lane->work);
+    pthread_mutex_init(&lane->lock, NULL);
+    pthread_cond_init(&lane->cond, NULL);
+    if (pthread_create(&lane->thread, NULL, us_lane_loop, lane)) {
+        AGM_LOGE("no thread for lane %u of pid %d", key, client->pid);
+        pthread_cond_destroy(&lane->cond);
+        pthread_mutex_destroy(&lane->lock);
+        free(lane);
+        return module_lane;
+    }
+
+    list_add_tail(&client->lanes, &lane->node);
+    client->num_lanes++;
+    return lane;
+}
+
+static int us_queue(struct us_client *client, struct us_work *work)
+{
+    struct us_lane *lane;
+
+    /* the module lane is made first so there is one to fall back to */
+    if (list_empty(&client->lanes) &&
+        us_lane_get(client, AGM_US_KEY_MODULE) == NULL)
+        return -ENOMEM;
+
+    lane = us_lane_get(client, work->msg.key);
+    if (lane == NULL)
+        return -ENOMEM;
+
+    pthread_mutex_lock(&lane->lock);
+    list_add_tail(&lane->work, &work->node);
+    pthread_cond_signal(&lane->cond);
+    pthread_mutex_unlock(&lane->lock);
+    return 0;
+}
+
+static int us_hello(struct us_client *client, struct agm_us_msg *msg)
+{
+    struct agm_us_msg reply;
+
+    if (getrandom(&client->token, sizeof(client->token), 0) !=
+        sizeof(client->token))
+        client->token = ((uint64_t)client->pid << 32) ^ (uintptr_t)client ^
+                        (uint64_t)time(NULL);
+    if (client->token == 0)
+        client->token = 1;
+
+    memset(&reply, 0, sizeof(reply));
+    reply.op = msg->op;
+    reply.id = msg->id;
+    reply.key = msg->key;
+    reply.val = client->token;
+    reply.arg[0] = AGM_US_VERSION;
+    return us_reply(client, &reply, NULL);
+}
+
+/*
+ * Hand the connection over to the client that got token, as its event
+ * channel. Returns 0 if the connection is no longer ours.
+ */
+static int us_events(struct us_client *conn, struct agm_us_msg *msg)
+{
+    struct us_client *client = NULL, *c;
+    struct agm_us_msg reply;
+    struct listnode *node;
+    int ret = -ENOENT;
+
+    memset(&reply, 0, sizeof(reply));
+    reply.op = msg->op;
+    reply.id = msg->id;
+    reply.key = msg->key;
+
+    pthread_mutex_lock(&us_server.lock);
+    list_for_each(node, &us_server.clients) {
+        c = node_to_item(node, struct us_client, node);
+        if (c->token && c->token == msg->val && c->pid == conn->pid &&
+            c->uid == conn->uid) {
+            client = c;
+            break;
+        }
+    }
+    if (client) {
+        pthread_mutex_lock(&client->evt_lock);
+        if (client->evt_sock < 0) {
+            /* acknowledged before the first event can go out */
+            ret = agm_us_send(conn->sock, &reply, NULL, NULL);
+            if (!ret) {
+                client->evt_sock = conn->sock;
+                conn->sock = -1;
+            }
+        } else {
+            ret = -EBUSY;
+        }
+        pthread_mutex_unlock(&client->evt_lock);
+    }
+    pthread_mutex_unlock(&us_server.lock);
+
+    if (ret) {
+        AGM_LOGE("event channel of pid %d refused %d", conn->pid, ret);
+        reply.status = ret;
+        us_reply(conn, &reply, NULL);
+    }
+    return ret;
+}
+
+/*
+ * The client went away: finish what it had queued, then undo what it left
+ * behind in agm, its callbacks first so no event refers to it any more.
+ */
+static void us_client_cleanup(struct us_client *client)
+{
+    struct listnode *node, *temp;
+    struct us_session *ses;
+    struct us_lane *lane;
+    struct us_cb *cb;
+
+    list_for_each_safe(node, temp, &client->lanes) {
+        lane = node_to_item(node, struct us_lane, node);
+        list_remove(&lane->node);
+        us_lane_stop(lane);
+    }
+
+    list_for_each_safe(node, temp, &client->cbs) {
+        cb = node_to_item(node, struct us_cb, node);
+        list_remove(&cb->node);
+        agm_session_register_cb(cb->session_id, NULL,
+                                (enum event_type)cb->evt_type, cb);
+        free(cb);
+    }
+
+    list_for_each_safe(node, temp, &client->sessions) {
+        ses = node_to_item(node, struct us_session, node);
+        AGM_LOGI("closing session %u left open by pid %d", ses->session_id,
+                 client->pid);
+        list_remove(&ses->node);
+        us_session_unmap(ses);
+        agm_session_close(ses->handle);
+        free(ses);
+    }
+
+    if (client->evt_sock >= 0)
+        close(client->evt_sock);
+    client->evt_sock = -1;
+}
+
+static void *us_client_loop(void *arg)
+{
+    struct us_client *client = arg;
+    int fds[AGM_US_MAX_FDS];
+    struct agm_us_msg msg;
+    struct us_work *work;
+    void *data;
+    int ret;
+
+    for (;;) {
+        ret = agm_us_recv(client->sock, &msg, &data, fds);
+        if (ret) {
+            if (ret != -ECONNRESET)
+                AGM_LOGE("receive from pid %d failed %d", client->pid, ret);
+            break;
+        }
+
+        /* the first frame tells what the connection is for */
+        if (client->token == 0) {
+            us_close_fds(fds, msg.num_fds);
+            free(data);
+            if (msg.op == AGM_US_HELLO) {
+                if (us_hello(client, &msg))
+                    break;
+                continue;
+            }
+            if (msg.op == AGM_US_EVENTS && !us_events(client, &msg))
+                break;
+            ret = -EPROTO;
+            break;
+        }
+
+        work = calloc(1, sizeof(*work));
+        if (work == NULL) {
+            us_close_fds(fds, msg.num_fds);
+            free(data);
+            break;
+        }
+        work->msg = msg;
+        work->data = data;
+        memcpy(work->fds, fds, sizeof(int) * msg.num_fds);
+        if (us_queue(client, work)) {
+            us_close_fds(work->fds, msg.num_fds);
+            free(work->data);
+            free(work);
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&us_server.lock);
+    list_remove(&client->node);
+    pthread_mutex_unlock(&us_server.lock);
+
+    us_client_cleanup(client);
+
+    if (client->sock >= 0)
+        close(client->sock);
+    pthread_mutex_destroy(&client->evt_lock);
+    pthread_mutex_destroy(&client->send_lock);
+    pthread_mutex_destroy(&client->lock);
+    free(client);
+
+    pthread_mutex_lock(&us_server.lock);
+    us_server.num_conns--;
+    pthread_cond_broadcast(&us_server.cond);
+    pthread_mutex_unlock(&us_server.lock);
+    return NULL;
+}
+
+static int us_client_start(int sock)
+{
+    struct us_client *client;
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    pthread_attr_t attr;
+    pthread_t thread;
+    int ret;
+
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len))
+        return -errno;
+
+    client = calloc(1, sizeof(*client));
+    if (client == NULL)
+        return -ENOMEM;
+
+    client->sock = sock;
+    client->evt_sock = -1;
+    client->pid = cred.pid;
+    client->uid = cred.uid;
+    list_init(&client->lanes);
+    list_init(&client->sessions);
+    list_init(&client->cbs);
+    pthread_mutex_init(&client->lock, NULL);
+    pthread_mutex_init(&client->send_lock, NULL);
+    pthread_mutex_init(&client->evt_lock, NULL);
+
+    pthread_mutex_lock(&us_server.lock);
+    list_add_tail(&us_server.clients, &client->node);
+    us_server.num_conns++;
+    pthread_mutex_unlock(&us_server.lock);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ret = pthread_create(&thread, &attr, us_client_loop, client);
+    pthread_attr_destroy(&attr);
+    if (ret) {
+        pthread_mutex_lock(&us_server.lock);
+        list_remove(&client->node);
+        us_server.num_conns--;
+        pthread_mutex_unlock(&us_server.lock);
+        pthread_mutex_destroy(&client->evt_lock);
+        pthread_mutex_destroy(&client->send_lock);
+        pthread_mutex_destroy(&client->lock);
+        free(client);
+        return -ret;
+    }
+
+    return 0;
+}
+
+static void *us_accept_loop(void *arg __unused)
+{
+    int sock, ret;
+
+    for (;;) {
+        sock = accept4(us_server.sock, NULL, NULL, SOCK_CLOEXEC);
+        if (sock < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            /* EINVAL once deinit shut the socket down */
+            if (errno != EINVAL)
+                AGM_LOGE("accept failed %d", -errno);
+            break;
+        }
+
+        ret = us_client_start(sock);
+        if (ret) {
+            AGM_LOGE("client setup failed %d", ret);
+            close(sock);
+        }
+    }
+
+    return NULL;
+}
+
+static int us_listen(void)
+{
+    struct sockaddr_un addr;
+    char dir[sizeof(addr.sun_path)], *slash;
+    int sock, ret;
+
+    ret = agm_us_sockaddr(&addr);
+    if (ret)
+        return ret;
+
+    strcpy(dir, addr.sun_path);
+    slash = strrchr(dir, '/');
+    if (slash && slash != dir) {
+        *slash = '\0';
+        if (mkdir(dir, 0755) && errno != EEXIST)
+            AGM_LOGE("cannot create %s: %d", dir, -errno);
+    }
+
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return -errno;
+
+    unlink(addr.sun_path);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+        ret = -errno;
+        AGM_LOGE("bind to %s failed %d", addr.sun_path, ret);
+        goto err;
+    }
+    /* who may connect is up to the group of the socket */
+    chmod(addr.sun_path, 0660);
+
+    if (listen(sock, AGM_US_BACKLOG)) {
+        ret = -errno;
+        goto err;
+    }
+
+    return sock;
+
+err:
+    close(sock);
+    return ret;
+}
+
+int ipc_agm_init()
+{
+    int ret;
+
+    list_init(&us_server.clients);
+
+    ret = agm_init();
+    if (ret) {
+        AGM_LOGE("agm initialization failed %d", ret);
+        return ret;
+    }
+
+    us_server.sock = us_listen();
+    if (us_server.sock < 0) {
+        ret = us_server.sock;
+        AGM_LOGE("listen failed %d", ret);
+        goto err;
+    }
+
+    ret = pthread_create(&us_server.thread, NULL, us_accept_loop, NULL);
+    if (ret) {
+        ret = -ret;
+        goto err_close;
+    }
+    us_server.started = true;
+
+    AGM_LOGD("listening on %s", agm_us_socket_path());
+    return 0;
+
+err_close:
+    close(us_server.sock);
+    us_server.sock = -1;
+err:
+    agm_deinit();
+    return ret;
+}
+
+void ipc_agm_deinit()
+{
+    struct us_client *client;
+    struct listnode *node;
+
+    if (!us_server.started)
+        return;
+
+    shutdown(us_server.sock, SHUT_RDWR);
+    pthread_join(us_server.thread, NULL);
+    close(us_server.sock);
+    us_server.sock = -1;
+    us_server.started = false;
+    unlink(agm_us_socket_path());
+
+    /* readers see EOF and clean up after their clients */
+    pthread_mutex_lock(&us_server.lock);
+    list_for_each(node, &us_server.clients) {
+        client = node_to_item(node, struct us_client, node);
+        shutdown(client->sock, SHUT_RDWR);
+    }
+    while (us_server.num_conns)
+        pthread_cond_wait(&us_server.cond, &us_server.lock);
+    pthread_mutex_unlock(&us_server.lock);
+
+    if (agm_deinit())
+        AGM_LOGE("agm deinitialization failed");
+}
@@ -0,0 +1,466 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Transport cost of the agm unix socket IPC, the counterpart of
+ * agm_dbus_ring_bench.
+ *
+ * A forked server speaks agm-us-proto.h on a socket of its own and hands
+ * every period it receives to a memcpy standing in for agm_session_write().
+ * Like the dbus bench it runs calls on the thread that reads them, so
+ * neither has the hop to a session queue of the real servers in it. The
+ * client times:
+ *   ctl        NOP round trips, one blocking call after the other
+ *   ctl-pipe   NOPs with up to 16 in flight, as several threads calling
+ *              at once would have them
+ *   write      SESSION_WRITE with the period inline in the frame
+ *   shm        SESSION_WRITE of a period in the buffer shared with
+ *              SESSION_MAP_BUF, only the byte count goes over the socket
+ * CPU time is reported for the client and the server.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "agm-us-proto.h"
+
+#define BENCH_WINDOW    16
+
+struct server {
+    int sock;
+    uint8_t *buf;
+    size_t buf_size;
+    uint8_t *sink;
+    size_t sink_size;
+};
+
+struct run {
+    const char *name;
+    uint64_t wall_ns;
+    uint64_t client_us, server_us;
+    uint64_t *lat_ns;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* utime + stime of a process, in us */
+static uint64_t proc_cpu_us(pid_t pid)
+{
+    char path[64], buf[1024], *p;
+    unsigned long utime, stime;
+    FILE *f;
+    int i;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    f = fopen(path, "r");
+    if (!f)
+        return 0;
+    if (!fgets(buf, sizeof(buf), f)) {
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+
+    /* fields 14 and 15, counted after the ")" closing the name */
+    p = strrchr(buf, ')');
+    for (i = 0; p && i < 12; i++)
+        p = strchr(p + 1, ' ');
+    if (!p || sscanf(p, " %lu %lu", &utime, &stime) != 2)
+        return 0;
+
+    return (uint64_t)(utime + stime) * 1000000 / sysconf(_SC_CLK_TCK);
+}
+
+static uint64_t self_cpu_us(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 +
+           ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+/* stands in for agm_session_write() */
+static void server_consume(struct server *srv, const void *buf, size_t len)
+{
+    if (len > srv->sink_size)
+        len = srv->sink_size;
+    memcpy(srv->sink, buf, len);
+}
+
+static int server_map_buf(struct server *srv, struct agm_us_msg *msg,
+                          int fd)
+{
+    void *addr;
+
+    addr = mmap(NULL, msg->val, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+        return -errno;
+
+    if (srv->buf)
+        munmap(srv->buf, srv->buf_size);
+    srv->buf = addr;
+    srv->buf_size = msg->val;
+    return 0;
+}
+
+static int server_run(int listen_sock, size_t period)
+{
+    int fds[AGM_US_MAX_FDS];
+    struct agm_us_msg msg, reply;
+    struct server srv;
+    void *data;
+    uint32_t i;
+
+    memset(&srv, 0, sizeof(srv));
+    srv.sink_size = period;
+    srv.sink = malloc(period);
+    srv.sock = accept4(listen_sock, NULL, NULL, SOCK_CLOEXEC);
+    close(listen_sock);
+    if (srv.sock < 0)
+        return 1;
+
+    while (!agm_us_recv(srv.sock, &msg, &data, fds)) {
+        memset(&reply, 0, sizeof(reply));
+        reply.op = msg.op;
+        reply.id = msg.id;
+        reply.key = msg.key;
+
+        switch (msg.op) {
+        case AGM_US_HELLO:
+            reply.val = 1;
+            reply.arg[0] = AGM_US_VERSION;
+            break;
+        case AGM_US_NOP:
+            break;
+        case AGM_US_SESSION_MAP_BUF:
+            reply.status = msg.num_fds == 1 ?
+                           server_map_buf(&srv, &msg, fds[0]) : -EINVAL;
+            break;
+        case AGM_US_SESSION_WRITE:
+            if (msg.arg[0] && srv.buf && msg.val <= srv.buf_size) {
+                server_consume(&srv, srv.buf, msg.val);
+                reply.val = msg.val;
+            } else if (!msg.arg[0]) {
+                server_consume(&srv, data, msg.len);
+                reply.val = msg.len;
+            } else {
+                reply.status = -EINVAL;
+            }
+            break;
+        default:
+            reply.status = -EOPNOTSUPP;
+            break;
+        }
+
+        for (i = 0; i < msg.num_fds; i++)
+            close(fds[i]);
+        free(data);
+        if (agm_us_send(srv.sock, &reply, NULL, NULL))
+            break;
+    }
+
+    close(srv.sock);
+    return 0;
+}
+
+static int call(int sock, struct agm_us_msg *msg, const void *data,
+                const int *fds, struct agm_us_msg *reply)
+{
+    int rfds[AGM_US_MAX_FDS];
+    void *rdata;
+    int ret;
+
+    ret = agm_us_send(sock, msg, data, fds);
+    if (!ret)
+        ret = agm_us_recv(sock, reply, &rdata, rfds);
+    if (ret)
+        return ret;
+
+    free(rdata);
+    return reply->status;
+}
+
+static int run_ctl(int sock, uint32_t n, uint64_t *lat)
+{
+    struct agm_us_msg msg, reply;
+    uint64_t t;
+    uint32_t i;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.op = AGM_US_NOP;
+    msg.key = AGM_US_KEY_MODULE;
+
+    for (i = 0; i < n; i++) {
+        t = now_ns();
+        msg.id = i;
+        if (call(sock, &msg, NULL, NULL, &reply))
+            return -1;
+        lat[i] = now_ns() - t;
+    }
+
+    return 0;
+}
+
+static int run_ctl_pipe(int sock, uint32_t n)
+{
+    int fds[AGM_US_MAX_FDS];
+    struct agm_us_msg msg, reply;
+    uint32_t sent = 0, done = 0;
+    void *data;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.op = AGM_US_NOP;
+    msg.key = AGM_US_KEY_MODULE;
+
+    while (done < n) {
+        while (sent < n && sent - done < BENCH_WINDOW) {
+            msg.id = sent++;
+            if (agm_us_send(sock, &msg, NULL, NULL))
+                return -1;
+        }
+        if (agm_us_recv(sock, &reply, &data, fds) || reply.status)
+            return -1;
+        free(data);
+        done++;
+    }
+
+    return 0;
+}
+
+static int run_write(int sock, uint8_t *buf, size_t period, uint32_t n,
+                     uint64_t *lat)
+{
+    struct agm_us_msg msg, reply;
+    uint64_t t;
+    uint32_t i;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.op = AGM_US_SESSION_WRITE;
+    msg.key = 1;
+    msg.len = period;
+
+    for (i = 0; i < n; i++) {
+        t = now_ns();
+        msg.id = i;
+        if (call(sock, &msg, buf, NULL, &reply) || reply.val != period)
+            return -1;
+        lat[i] = now_ns() - t;
+    }
+
+    return 0;
+}
+
+/* the client side of agm_session_write() with a shared buffer */
+static int run_shm(int sock, uint8_t *buf, size_t period, uint32_t n,
+                   uint64_t *lat)
+{
+    struct agm_us_msg msg, reply;
+    uint8_t *shm;
+    uint64_t t;
+    uint32_t i;
+    int fd;
+
+    fd = memfd_create("agm_us_bench", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0 || ftruncate(fd, period))
+        return -1;
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+    shm = mmap(NULL, period, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED)
+        return -1;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.op = AGM_US_SESSION_MAP_BUF;
+    msg.key = 1;
+    msg.val = period;
+    msg.num_fds = 1;
+    if (call(sock, &msg, NULL, &fd, &reply))
+        return -1;
+    close(fd);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.op = AGM_US_SESSION_WRITE;
+    msg.key = 1;
+    msg.arg[0] = 1;
+    msg.val = period;
+
+    for (i = 0; i < n; i++) {
+        t = now_ns();
+        memcpy(shm, buf, period);
+        msg.id = i;
+        if (call(sock, &msg, NULL, NULL, &reply) || reply.val != period)
+            return -1;
+        lat[i] = now_ns() - t;
+    }
+
+    munmap(shm, period);
+    return 0;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* period 0 for control calls, which move no data */
+static void report(struct run *r, uint32_t n, size_t period)
+{
+    double secs = r->wall_ns / 1e9;
+
+    if (period)
+        printf("%-10s %8.0f periods/s %8.1f MB/s", r->name, n / secs,
+               n * (double)period / secs / 1e6);
+    else
+        printf("%-10s %8.0f calls/s   %13s", r->name, n / secs, "");
+    if (r->lat_ns) {
+        qsort(r->lat_ns, n, sizeof(*r->lat_ns), cmp_u64);
+        printf("  lat p50 %6.1f us p99 %6.1f us",
+               r->lat_ns[n / 2] / 1e3, r->lat_ns[n * 99 / 100] / 1e3);
+    } else {
+        printf("  %31s", "");
+    }
+    printf("  cpu/%s client %5.1f server %5.1f us\n",
+           period ? "period" : "call  ", (double)r->client_us / n,
+           (double)r->server_us / n);
+}
+
+static void usage(void)
+{
+    printf(" Usage: agm_us_bench [-p period_bytes] [-n periods]"
+           " [-s socket_path]\n");
+}
+
+int main(int argc, char **argv)
+{
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)] = "";
+    size_t period = 48 * 8 * 4 * 10;    /* 10 ms of 48 kHz, 8 ch, 32 bit */
+    uint32_t n = 2000;
+    struct agm_us_msg msg, reply;
+    struct sockaddr_un addr;
+    int listen_sock, sock, opt, i, rc = 1;
+    uint64_t *lat, c0, s0, t0;
+    struct run runs[4];
+    pid_t server_pid;
+    uint8_t *buf;
+
+    while ((opt = getopt(argc, argv, "p:n:s:h")) != -1) {
+        switch (opt) {
+        case 'p':
+            period = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            n = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            snprintf(path, sizeof(path), "%s", optarg);
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (!period || period > AGM_US_MAX_BUF || n < 100) {
+        usage();
+        return 1;
+    }
+
+    if (!path[0])
+        snprintf(path, sizeof(path), "/tmp/agm_us_bench_%d.sock",
+                 (int)getpid());
+    setenv(AGM_US_SOCKET_ENV, path, 1);
+    if (agm_us_sockaddr(&addr))
+        return 1;
+
+    listen_sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(path);
+    if (listen_sock < 0 ||
+        bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(listen_sock, 1)) {
+        fprintf(stderr, "cannot listen on %s\n", path);
+        return 1;
+    }
+
+    server_pid = fork();
+    if (server_pid == 0)
+        _exit(server_run(listen_sock, period));
+    close(listen_sock);
+
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+        fprintf(stderr, "cannot connect to %s\n", path);
+        goto done;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.op = AGM_US_HELLO;
+    msg.key = AGM_US_KEY_MODULE;
+    if (call(sock, &msg, NULL, NULL, &reply)) {
+        fprintf(stderr, "server did not answer\n");
+        goto done;
+    }
+
+    buf = malloc(period);
+    memset(buf, 0x5a, period);
+    memset(runs, 0, sizeof(runs));
+    runs[0].name = "ctl";
+    runs[1].name = "ctl-pipe";
+    runs[2].name = "write";
+    runs[3].name = "shm";
+    runs[0].lat_ns = calloc(n, sizeof(uint64_t));
+    runs[2].lat_ns = calloc(n, sizeof(uint64_t));
+    runs[3].lat_ns = calloc(n, sizeof(uint64_t));
+
+    printf("%zu byte periods, %u per run, socket %s\n", period, n, path);
+    for (i = 0; i < 4; i++) {
+        lat = runs[i].lat_ns;
+        c0 = self_cpu_us();
+        s0 = proc_cpu_us(server_pid);
+        t0 = now_ns();
+        if (i == 0)
+            rc = run_ctl(sock, n, lat);
+        else if (i == 1)
+            rc = run_ctl_pipe(sock, n);
+        else if (i == 2)
+            rc = run_write(sock, buf, period, n, lat);
+        else
+            rc = run_shm(sock, buf, period, n, lat);
+        runs[i].wall_ns = now_ns() - t0;
+        runs[i].client_us = self_cpu_us() - c0;
+        runs[i].server_us = proc_cpu_us(server_pid) - s0;
+        if (rc) {
+            fprintf(stderr, "%s failed\n", runs[i].name);
+            goto done;
+        }
+        report(&runs[i], n, i < 2 ? 0 : period);
+    }
+    rc = 0;
+
+done:
+    if (sock >= 0)
+        close(sock);
+    waitpid(server_pid, NULL, 0);
+    unlink(path);
+    return rc;
+}
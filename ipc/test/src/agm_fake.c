@@ -0,0 +1,780 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * A libagm without a DSP behind it, for timing the IPC servers on any
+ * machine. See agm_fake.h for what it does beyond returning 0.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <agm/agm_api.h>
+
+#include "agm_fake.h"
+
+#define FAKE_NUM_AIFS       4
+#define FAKE_BUF_SIZE       (64 * 1024)
+#define FAKE_TAG_INFO_SIZE  256
+
+struct fake_cb {
+    agm_event_cb cb;
+    enum event_type evt_type;
+    void *client_data;
+    struct fake_cb *next;
+};
+
+struct fake_session {
+    uint32_t session_id;
+    bool opened;
+    pthread_mutex_t lock;
+    /* also held while callbacks run, so none runs after deregistering */
+    pthread_mutex_t cb_lock;
+    struct fake_cb *cbs;
+    uint8_t *buf;
+    size_t buf_size;
+    uint64_t bytes_written;
+    uint64_t bytes_read;
+    struct agm_session_stats stats;
+    uint8_t params[FAKE_TAG_INFO_SIZE];
+    struct fake_session *next;
+};
+
+static pthread_mutex_t sessions_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct fake_session *sessions;
+static pthread_once_t latency_once = PTHREAD_ONCE_INIT;
+static long latency_us;
+
+static void latency_init(void)
+{
+    const char *env = getenv(AGM_FAKE_LATENCY_ENV);
+
+    if (env)
+        latency_us = strtol(env, NULL, 0);
+}
+
+/* what the DSP round trip of a real call would cost */
+static void fake_call(void)
+{
+    struct timespec ts;
+
+    pthread_once(&latency_once, latency_init);
+    if (latency_us <= 0)
+        return;
+
+    ts.tv_sec = latency_us / 1000000;
+    ts.tv_nsec = (latency_us % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts) == EINTR)
+        ;
+}
+
+static struct fake_session *session_get(uint32_t session_id)
+{
+    struct fake_session *ses;
+
+    pthread_mutex_lock(&sessions_lock);
+    for (ses = sessions; ses; ses = ses->next)
+        if (ses->session_id == session_id)
+            goto done;
+
+    ses = calloc(1, sizeof(*ses));
+    if (!ses)
+        goto done;
+    ses->session_id = session_id;
+    pthread_mutex_init(&ses->lock, NULL);
+    pthread_mutex_init(&ses->cb_lock, NULL);
+    ses->next = sessions;
+    sessions = ses;
+
+done:
+    pthread_mutex_unlock(&sessions_lock);
+    return ses;
+}
+
+/* the open session behind a handle, NULL for anything else */
+static struct fake_session *session_from_handle(uint64_t hndl)
+{
+    struct fake_session *ses;
+
+    pthread_mutex_lock(&sessions_lock);
+    for (ses = sessions; ses; ses = ses->next)
+        if ((uint64_t)(uintptr_t)ses == hndl && ses->opened)
+            break;
+    pthread_mutex_unlock(&sessions_lock);
+    return ses;
+}
+
+static void session_notify(struct fake_session *ses, enum event_type evt_type,
+                           uint32_t module_id, uint32_t event_id,
+                           const void *payload, uint32_t size)
+{
+    struct agm_event_cb_params *params;
+    struct fake_cb *cb;
+
+    params = malloc(sizeof(*params) + size);
+    if (!params)
+        return;
+    params->source_module_id = module_id;
+    params->event_id = event_id;
+    params->event_payload_size = size;
+    memcpy(params->event_payload, payload, size);
+
+    pthread_mutex_lock(&ses->cb_lock);
+    for (cb = ses->cbs; cb; cb = cb->next)
+        if (cb->evt_type == evt_type)
+            cb->cb(ses->session_id, params, cb->client_data);
+    pthread_mutex_unlock(&ses->cb_lock);
+
+    free(params);
+}
+
+static void session_data_done(struct fake_session *ses, uint32_t event_id,
+                              size_t count)
+{
+    struct agm_event_read_write_done_payload done;
+
+    memset(&done, 0, sizeof(done));
+    done.tag = event_id == AGM_EVENT_WRITE_DONE ? ses->stats.num_writes :
+                                                  ses->stats.num_reads;
+    done.buff.size = count;
+    session_notify(ses, AGM_EVENT_DATA_PATH, 0, event_id, &done,
+                   sizeof(done));
+}
+
+int agm_init()
+{
+    pthread_once(&latency_once, latency_init);
+    return 0;
+}
+
+int agm_deinit()
+{
+    return 0;
+}
+
+int agm_aif_set_media_config(uint32_t aif_id,
+                             struct agm_media_config *media_config)
+{
+    fake_call();
+    return aif_id < FAKE_NUM_AIFS && media_config ? 0 : -EINVAL;
+}
+
+int agm_aif_group_set_media_config(uint32_t aif_group_id,
+                             struct agm_group_media_config *media_config)
+{
+    fake_call();
+    return media_config ? 0 : -EINVAL;
+}
+
+int agm_aif_set_metadata(uint32_t aif_id, uint32_t size, uint8_t *metadata)
+{
+    fake_call();
+    return aif_id < FAKE_NUM_AIFS ? 0 : -EINVAL;
+}
+
+int agm_aif_set_params(uint32_t aif_id, void *payload, size_t size)
+{
+    fake_call();
+    return aif_id < FAKE_NUM_AIFS ? 0 : -EINVAL;
+}
+
+int agm_aif_set_params_take(uint32_t aif_id, void *payload, size_t size)
+{
+    int ret = agm_aif_set_params(aif_id, payload, size);
+
+    free(payload);
+    return ret;
+}
+
+static int fake_aif_list(struct aif_info *aif_list, size_t *num_aif_info,
+                         const char *prefix)
+{
+    size_t i;
+
+    fake_call();
+    if (!num_aif_info)
+        return -EINVAL;
+
+    if (aif_list) {
+        for (i = 0; i < *num_aif_info && i < FAKE_NUM_AIFS; i++) {
+            snprintf(aif_list[i].aif_name, AIF_NAME_MAX_LEN, "%s-%zu",
+                     prefix, i);
+            aif_list[i].dir = i % 2 ? TX : RX;
+        }
+    }
+    if (!aif_list || *num_aif_info > FAKE_NUM_AIFS)
+        *num_aif_info = FAKE_NUM_AIFS;
+    return 0;
+}
+
+int agm_get_aif_info_list(struct aif_info *aif_list, size_t *num_aif_info)
+{
+    return fake_aif_list(aif_list, num_aif_info, "FAKE-AIF");
+}
+
+int agm_get_group_aif_info_list(struct aif_info *aif_list, size_t *num_groups)
+{
+    return fake_aif_list(aif_list, num_groups, "FAKE-GROUP");
+}
+
+int agm_session_set_metadata(uint32_t session_id, uint32_t size,
+                             uint8_t *metadata)
+{
+    fake_call();
+    return session_get(session_id) ? 0 : -ENOMEM;
+}
+
+int agm_session_aif_set_metadata(uint32_t session_id, uint32_t aif_id,
+                                 uint32_t size, uint8_t *metadata)
+{
+    fake_call();
+    return aif_id < FAKE_NUM_AIFS ? 0 : -EINVAL;
+}
+
+int agm_session_aif_connect(uint32_t session_id, uint32_t aif_id, bool state)
+{
+    fake_call();
+    return aif_id < FAKE_NUM_AIFS ? 0 : -EINVAL;
+}
+
+int agm_session_aif_get_tag_module_info(uint32_t session_id, uint32_t aif_id,
+                                        void *payload, size_t *size)
+{
+    fake_call();
+    if (!size)
+        return -EINVAL;
+
+    if (payload)
+        memset(payload, 0, *size < FAKE_TAG_INFO_SIZE ?
+                           *size : FAKE_TAG_INFO_SIZE);
+    *size = FAKE_TAG_INFO_SIZE;
+    return 0;
+}
+
+int agm_session_aif_set_params(uint32_t session_id, uint32_t aif_id,
+                               void *payload, size_t size)
+{
+    fake_call();
+    return aif_id < FAKE_NUM_AIFS ? 0 : -EINVAL;
+}
+
+int agm_session_aif_set_params_take(uint32_t session_id, uint32_t aif_id,
+                                    void *payload, size_t size)
+{
+    int ret = agm_session_aif_set_params(session_id, aif_id, payload, size);
+
+    free(payload);
+    return ret;
+}
+
+int agm_session_aif_set_cal(uint32_t session_id, uint32_t aif_id,
+                            struct agm_cal_config *cal_config)
+{
+    fake_call();
+    return aif_id < FAKE_NUM_AIFS && cal_config ? 0 : -EINVAL;
+}
+
+int agm_session_set_params(uint32_t session_id, void *payload, size_t size)
+{
+    struct fake_session *ses = session_get(session_id);
+    struct agm_fake_event evt;
+
+    fake_call();
+    if (!ses || !payload)
+        return -EINVAL;
+
+    if (size >= sizeof(evt)) {
+        memcpy(&evt, payload, sizeof(evt));
+        if (evt.magic == AGM_FAKE_EVENT_MAGIC) {
+            session_notify(ses, AGM_EVENT_MODULE, AGM_FAKE_MODULE_ID,
+                           AGM_FAKE_EVENT_ID, payload, size);
+            return 0;
+        }
+    }
+
+    pthread_mutex_lock(&ses->lock);
+    memcpy(ses->params, payload,
+           size < sizeof(ses->params) ? size : sizeof(ses->params));
+    pthread_mutex_unlock(&ses->lock);
+    return 0;
+}
+
+int agm_session_get_params(uint32_t session_id, void *payload, size_t size)
+{
+    struct fake_session *ses = session_get(session_id);
+
+    fake_call();
+    if (!ses || !payload)
+        return -EINVAL;
+
+    pthread_mutex_lock(&ses->lock);
+    memcpy(payload, ses->params,
+           size < sizeof(ses->params) ? size : sizeof(ses->params));
+    pthread_mutex_unlock(&ses->lock);
+    return 0;
+}
+
+int agm_get_params_from_acdb_tunnel(void *payload, size_t *size)
+{
+    fake_call();
+    return -ENOSYS;
+}
+
+int agm_set_params_with_tag(uint32_t session_id, uint32_t aif_id,
+                            struct agm_tag_config *tag_config)
+{
+    fake_call();
+    return tag_config ? 0 : -EINVAL;
+}
+
+int agm_set_params_with_tag_to_acdb(uint32_t session_id, uint32_t aif_id,
+                                    void *payload, size_t size)
+{
+    fake_call();
+    return 0;
+}
+
+int agm_set_params_to_acdb_tunnel(void *payload, size_t size)
+{
+    fake_call();
+    return -ENOSYS;
+}
+
+int agm_session_register_cb(uint32_t session_id, agm_event_cb cb,
+                            enum event_type evt_type, void *client_data)
+{
+    struct fake_session *ses = session_get(session_id);
+    struct fake_cb **pcb, *fcb;
+
+    if (!ses)
+        return -ENOMEM;
+
+    pthread_mutex_lock(&ses->cb_lock);
+    if (cb) {
+        fcb = calloc(1, sizeof(*fcb));
+        if (!fcb) {
+            pthread_mutex_unlock(&ses->cb_lock);
+            return -ENOMEM;
+        }
+        fcb->cb = cb;
+        fcb->evt_type = evt_type;
+        fcb->client_data = client_data;
+        fcb->next = ses->cbs;
+        ses->cbs = fcb;
+    } else {
+        pcb = &ses->cbs;
+        while (*pcb) {
+            fcb = *pcb;
+            if (fcb->evt_type == evt_type && fcb->client_data == client_data) {
+                *pcb = fcb->next;
+                free(fcb);
+            } else {
+                pcb = &fcb->next;
+            }
+        }
+    }
+    pthread_mutex_unlock(&ses->cb_lock);
+    return 0;
+}
+
+int agm_session_register_for_events(uint32_t session_id,
+                                    struct agm_event_reg_cfg *evt_reg_cfg)
+{
+    fake_call();
+    return evt_reg_cfg ? 0 : -EINVAL;
+}
+
+int agm_session_open(uint32_t session_id, enum agm_session_mode sess_mode,
+                     uint64_t *hndl)
+{
+    struct fake_session *ses = session_get(session_id);
+    int ret = 0;
+
+    fake_call();
+    if (!ses || !hndl)
+        return -EINVAL;
+
+    pthread_mutex_lock(&ses->lock);
+    if (ses->opened) {
+        ret = -EALREADY;
+        goto done;
+    }
+
+    ses->buf_size = FAKE_BUF_SIZE;
+    ses->buf = malloc(ses->buf_size);
+    if (!ses->buf) {
+        ret = -ENOMEM;
+        goto done;
+    }
+    ses->bytes_written = 0;
+    ses->bytes_read = 0;
+    memset(&ses->stats, 0, sizeof(ses->stats));
+    ses->opened = true;
+    *hndl = (uint64_t)(uintptr_t)ses;
+
+done:
+    pthread_mutex_unlock(&ses->lock);
+    return ret;
+}
+
+int agm_session_set_config(uint64_t hndl,
+                           struct agm_session_config *session_config,
+                           struct agm_media_config *media_config,
+                           struct agm_buffer_config *buffer_config)
+{
+    struct fake_session *ses = session_from_handle(hndl);
+    size_t size;
+    uint8_t *buf;
+
+    fake_call();
+    if (!ses || !media_config || !buffer_config)
+        return -EINVAL;
+
+    size = (size_t)buffer_config->count * buffer_config->size;
+    if (size == 0)
+        return 0;
+
+    buf = malloc(size);
+    if (!buf)
+        return -ENOMEM;
+
+    pthread_mutex_lock(&ses->lock);
+    free(ses->buf);
+    ses->buf = buf;
+    ses->buf_size = size;
+    pthread_mutex_unlock(&ses->lock);
+    return 0;
+}
+
+int agm_session_close(uint64_t hndl)
+{
+    struct fake_session *ses = session_from_handle(hndl);
+
+    fake_call();
+    if (!ses)
+        return -EINVAL;
+
+    pthread_mutex_lock(&ses->lock);
+    ses->opened = false;
+    free(ses->buf);
+    ses->buf = NULL;
+    ses->buf_size = 0;
+    pthread_mutex_unlock(&ses->lock);
+    return 0;
+}
+
+int agm_session_close_async(uint64_t hndl)
+{
+    return agm_session_close(hndl);
+}
+
+static int session_state_call(uint64_t hndl)
+{
+    fake_call();
+    return session_from_handle(hndl) ? 0 : -EINVAL;
+}
+
+int agm_session_prepare(uint64_t hndl)
+{
+    return session_state_call(hndl);
+}
+
+int agm_session_start(uint64_t hndl)
+{
+    return session_state_call(hndl);
+}
+
+int agm_session_stop(uint64_t hndl)
+{
+    return session_state_call(hndl);
+}
+
+int agm_session_pause(uint64_t hndl)
+{
+    return session_state_call(hndl);
+}
+
+int agm_session_flush(uint64_t hndl)
+{
+    return session_state_call(hndl);
+}
+
+int agm_session_resume(uint64_t hndl)
+{
+    return session_state_call(hndl);
+}
+
+int agm_session_suspend(uint64_t hndl)
+{
+    return session_state_call(hndl);
+}
+
+int agm_session_eos(uint64_t hndl)
+{
+    return session_state_call(hndl);
+}
+
+int agm_session_group_start(uint64_t *handles, uint32_t num_handles,
+                            uint64_t *skew_us)
+{
+    uint32_t i;
+
+    fake_call();
+    for (i = 0; i < num_handles; i++)
+        if (!session_from_handle(handles[i]))
+            return -EINVAL;
+    if (skew_us)
+        *skew_us = 0;
+    return 0;
+}
+
+int agm_session_group_stop(uint64_t *handles, uint32_t num_handles)
+{
+    return agm_session_group_start(handles, num_handles, NULL);
+}
+
+/* the bytes go into the session's buffer, as they would into shared memory */
+int agm_session_write(uint64_t hndl, void *buff, size_t *count)
+{
+    struct fake_session *ses = session_from_handle(hndl);
+    size_t done = 0, len;
+
+    fake_call();
+    if (!ses || !buff || !count)
+        return -EINVAL;
+
+    pthread_mutex_lock(&ses->lock);
+    while (done < *count) {
+        len = *count - done;
+        if (len > ses->buf_size)
+            len = ses->buf_size;
+        memcpy(ses->buf, (uint8_t *)buff + done, len);
+        done += len;
+    }
+    ses->bytes_written += done;
+    ses->stats.num_writes++;
+    ses->stats.bytes_written += done;
+    pthread_mutex_unlock(&ses->lock);
+
+    session_data_done(ses, AGM_EVENT_WRITE_DONE, done);
+    return 0;
+}
+
+int agm_session_read(uint64_t hndl, void *buff, size_t *count)
+{
+    struct fake_session *ses = session_from_handle(hndl);
+    size_t done = 0, len;
+
+    fake_call();
+    if (!ses || !buff || !count)
+        return -EINVAL;
+
+    pthread_mutex_lock(&ses->lock);
+    while (done < *count) {
+        len = *count - done;
+        if (len > ses->buf_size)
+            len = ses->buf_size;
+        memcpy((uint8_t *)buff + done, ses->buf, len);
+        done += len;
+    }
+    ses->bytes_read += done;
+    ses->stats.num_reads++;
+    ses->stats.bytes_read += done;
+    pthread_mutex_unlock(&ses->lock);
+
+    session_data_done(ses, AGM_EVENT_READ_DONE, done);
+    return 0;
+}
+
+size_t agm_get_hw_processed_buff_cnt(uint64_t hndl, enum direction dir)
+{
+    struct fake_session *ses = session_from_handle(hndl);
+
+    fake_call();
+    if (!ses)
+        return 0;
+    return dir == TX ? ses->stats.num_reads : ses->stats.num_writes;
+}
+
+int agm_session_set_loopback(uint32_t capture_session_id,
+                             uint32_t playback_session_id, bool state)
+{
+    fake_call();
+    return 0;
+}
+
+int agm_session_set_ec_ref(uint32_t capture_session_id, uint32_t aif_id,
+                           bool state)
+{
+    fake_call();
+    return aif_id < FAKE_NUM_AIFS ? 0 : -EINVAL;
+}
+
+/* 48 kHz stereo 16 bit, from what went through the session */
+int agm_get_session_time(uint64_t handle, uint64_t *timestamp)
+{
+    struct fake_session *ses = session_from_handle(handle);
+
+    fake_call();
+    if (!ses || !timestamp)
+        return -EINVAL;
+
+    pthread_mutex_lock(&ses->lock);
+    *timestamp = (ses->bytes_written + ses->bytes_read) * 1000000 / 192000;
+    pthread_mutex_unlock(&ses->lock);
+    return 0;
+}
+
+int agm_get_buffer_timestamp(uint32_t session_id, uint64_t *timestamp)
+{
+    struct timespec ts;
+
+    fake_call();
+    if (!timestamp)
+        return -EINVAL;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    *timestamp = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    return 0;
+}
+
+int agm_session_get_buf_info(uint32_t session_id, struct agm_buf_info *buf_info,
+                             uint32_t flag)
+{
+    fake_call();
+    return -ENOSYS;
+}
+
+int agm_session_get_stats(uint32_t session_id, struct agm_session_stats *stats)
+{
+    struct fake_session *ses = session_get(session_id);
+
+    fake_call();
+    if (!ses || !stats)
+        return -EINVAL;
+
+    pthread_mutex_lock(&ses->lock);
+    *stats = ses->stats;
+    pthread_mutex_unlock(&ses->lock);
+    return 0;
+}
+
+int agm_session_update_stats(uint64_t hndl,
+                             const struct agm_session_stats *delta)
+{
+    struct fake_session *ses = session_from_handle(hndl);
+
+    fake_call();
+    if (!ses || !delta)
+        return -EINVAL;
+
+    pthread_mutex_lock(&ses->lock);
+    ses->stats.num_underruns += delta->num_underruns;
+    ses->stats.num_overruns += delta->num_overruns;
+    ses->stats.num_poll_timeouts += delta->num_poll_timeouts;
+    ses->stats.latency_us = delta->latency_us;
+    pthread_mutex_unlock(&ses->lock);
+    return 0;
+}
+
+int agm_set_gapless_session_metadata(uint64_t handle,
+                                     enum agm_gapless_silence_type type,
+                                     uint32_t silence)
+{
+    return session_state_call(handle);
+}
+
+uint64_t agm_get_data_generation(void)
+{
+    return 1;
+}
+
+/* there is no card to lose, so there is never anything to restore */
+int agm_recover_all(struct agm_session_recovery_info *info,
+                    size_t *num_sessions)
+{
+    fake_call();
+    if (!num_sessions)
+        return -EINVAL;
+    *num_sessions = 0;
+    return 0;
+}
+
+int agm_session_run_ops(uint32_t session_id, uint64_t *hndl,
+                        struct agm_session_op *ops, uint32_t num_ops)
+{
+    struct agm_session_op *op = NULL;
+    bool opened = false;
+    uint32_t i;
+    int ret = 0;
+
+    if (!hndl || (!ops && num_ops))
+        return -EINVAL;
+
+    for (i = 0; i < num_ops; i++)
+        ops[i].status = -ECANCELED;
+
+    for (i = 0; i < num_ops && !ret; i++) {
+        op = &ops[i];
+
+        switch (op->type) {
+        case AGM_SESSION_OP_OPEN:
+            ret = agm_session_open(session_id, op->sess_mode, hndl);
+            opened = !ret;
+            break;
+        case AGM_SESSION_OP_SET_METADATA:
+            ret = agm_session_set_metadata(session_id, op->size,
+                                           (uint8_t *)op->payload);
+            break;
+        case AGM_SESSION_OP_AIF_SET_METADATA:
+            ret = agm_session_aif_set_metadata(session_id, op->aif_id,
+                                               op->size,
+                                               (uint8_t *)op->payload);
+            break;
+        case AGM_SESSION_OP_AIF_CONNECT:
+            ret = agm_session_aif_connect(session_id, op->aif_id, op->state);
+            break;
+        case AGM_SESSION_OP_SET_PARAMS:
+            ret = agm_session_set_params(session_id, op->payload, op->size);
+            break;
+        case AGM_SESSION_OP_SET_CONFIG:
+            ret = agm_session_set_config(*hndl, op->session_config,
+                                         op->media_config,
+                                         op->buffer_config);
+            break;
+        case AGM_SESSION_OP_PREPARE:
+            ret = agm_session_prepare(*hndl);
+            break;
+        case AGM_SESSION_OP_START:
+            ret = agm_session_start(*hndl);
+            break;
+        case AGM_SESSION_OP_STOP:
+            ret = agm_session_stop(*hndl);
+            break;
+        case AGM_SESSION_OP_CLOSE:
+            ret = agm_session_close(*hndl);
+            if (!ret) {
+                *hndl = 0;
+                opened = false;
+            }
+            break;
+        default:
+            ret = -EINVAL;
+            break;
+        }
+        op->status = ret;
+    }
+
+    if (ret && opened && !agm_session_close(*hndl))
+        *hndl = 0;
+
+    return ret;
+}
@@ -0,0 +1,34 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * What agm_ipc_bench and the fake libagm agree on.
+ *
+ * The fake keeps sessions in memory and answers every call after
+ * AGM_FAKE_LATENCY_US microseconds (0 by default), so an IPC server linked
+ * against it costs only what the IPC itself costs. agm_session_write and
+ * agm_session_read raise WRITE_DONE and READ_DONE like a real session does,
+ * and agm_session_set_params with a struct agm_fake_event payload raises
+ * that payload as a module event, to let the bench time event delivery.
+ */
+
+#ifndef __AGM_FAKE_H__
+#define __AGM_FAKE_H__
+
+#include <stdint.h>
+
+#define AGM_FAKE_LATENCY_ENV    "AGM_FAKE_LATENCY_US"
+
+#define AGM_FAKE_EVENT_MAGIC    0x61676d65
+#define AGM_FAKE_EVENT_ID       0x0800fa4e
+#define AGM_FAKE_MODULE_ID      0x0700fa4e
+
+struct agm_fake_event {
+    uint32_t magic;             /* AGM_FAKE_EVENT_MAGIC */
+    uint32_t seq;
+    uint64_t sent_ns;           /* CLOCK_MONOTONIC of the sender */
+};
+
+#endif /* __AGM_FAKE_H__ */
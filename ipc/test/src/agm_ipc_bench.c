@@ -0,0 +1,826 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Cost of agm calls through an IPC backend, with no DSP in the way.
+ *
+ * The bench starts the backend's agm_server against the fake libagm of
+ * agm_fake.c, on a dbus-daemon of its own for -b dbus or on a socket of its
+ * own for -b us, and times agm calls made through the libagmclient it is
+ * linked with, which has to be the one of the same backend:
+ *   open        agm_session_open and agm_session_close
+ *   set-params  agm_session_set_params of -p bytes
+ *   time        agm_get_session_time
+ *   write       agm_session_write of each size in -B
+ *   read        agm_session_read of each size in -B
+ *   events      a module event raised with agm_session_set_params, fanned
+ *               out to -c processes that registered for it, timed from the
+ *               call until the last of them had its callback
+ *   setup       the calls that bring a session up and down: aif, session
+ *               and session aif metadata, -p bytes of params, connect,
+ *               open, set_config, prepare, start, stop, close, disconnect
+ * -a runs the tests with the dbus client's pipelined calls on.
+ * Every test runs in a process of its own, so it starts libagmclient from
+ * scratch. Latency is reported at p50, p99 and p999; CPU per operation for
+ * the client processes, the server and the bus daemon. Server and bus CPU
+ * are read off their CPU-time clocks, so they are not tick-quantized.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <agm/agm_api.h>
+
+#include "agm_fake.h"
+
+#ifndef AGM_FAKE_LIBDIR
+#define AGM_FAKE_LIBDIR         "/usr/lib/agm-fake"
+#endif
+
+#define BENCH_SESSION_ID        100
+#define BENCH_AIF_ID            1
+#define BENCH_MAX_CLIENTS       64
+#define BENCH_MAX_SIZES         16
+#define BENCH_WAIT_MS           5000
+#define BENCH_EVENT_TIMEOUT_MS  1000
+
+enum backend {
+    BACKEND_DBUS,
+    BACKEND_US,
+};
+
+struct options {
+    enum backend backend;
+    const char *server;
+    const char *bus_daemon;
+    const char *fake_libdir;
+    const char *tests;
+    uint32_t iterations;
+    uint32_t clients;
+    uint32_t latency_us;
+    uint32_t param_size;
+    uint32_t sizes[BENCH_MAX_SIZES];
+    uint32_t num_sizes;
+    bool async;
+};
+
+/* filled in by a test process, in memory shared with the bench */
+struct result {
+    int status;
+    uint64_t ops;
+    uint64_t bytes;
+    uint64_t wall_ns;
+    uint64_t client_us;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+};
+
+/* what the listeners of the events test share with the sender */
+struct fanout {
+    uint32_t clients;
+    uint32_t iterations;
+    int ready_fd;
+    int ack_fd;
+    uint64_t client_us;
+    /* clients * iterations receive times */
+    uint64_t recv_ns[];
+};
+
+static struct options opts = {
+    .backend = BACKEND_DBUS,
+    .server = "agm_server",
+    .bus_daemon = "dbus-daemon",
+    .fake_libdir = AGM_FAKE_LIBDIR,
+    .tests = "open,set-params,time,write,read,events,setup",
+    .iterations = 10000,
+    .clients = 4,
+    .latency_us = 0,
+    .param_size = 64,
+    .sizes = { 960, 3840, 15360, 61440 },
+    .num_sizes = 4,
+};
+
+static char run_dir[64];
+static pid_t bus_pid = -1;
+static pid_t server_pid = -1;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* CPU time of a process, in us, off its CPU-time clock */
+static uint64_t proc_cpu_us(pid_t pid)
+{
+    struct timespec ts;
+    clockid_t clk;
+
+    if (pid <= 0)
+        return 0;
+
+    if (clock_getcpuclockid(pid, &clk) || clock_gettime(clk, &ts))
+        return 0;
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t self_cpu_us(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 +
+           ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static void sleep_ms(uint32_t ms)
+{
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+
+    nanosleep(&ts, NULL);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void result_set_latency(struct result *res, uint64_t *lat, uint64_t n)
+{
+    if (n == 0)
+        return;
+
+    qsort(lat, n, sizeof(*lat), cmp_u64);
+    res->p50_ns = lat[n / 2];
+    res->p99_ns = lat[n * 99 / 100];
+    res->p999_ns = lat[n * 999 / 1000];
+}
+
+/* the server may still be coming up, or the bus may not have its name yet */
+static int wait_service(void)
+{
+    uint64_t deadline = now_ns() + BENCH_WAIT_MS * 1000000ULL;
+    size_t num_aifs;
+    int ret;
+
+    for (;;) {
+        num_aifs = 0;
+        ret = agm_get_aif_info_list(NULL, &num_aifs);
+        if (ret == 0 || now_ns() > deadline)
+            return ret;
+        sleep_ms(10);
+    }
+}
+
+static int session_setup(uint64_t *hndl, enum direction dir, uint32_t size)
+{
+    struct agm_session_config session_config;
+    struct agm_media_config media_config;
+    struct agm_buffer_config buffer_config;
+    int ret;
+
+    memset(&session_config, 0, sizeof(session_config));
+    memset(&media_config, 0, sizeof(media_config));
+    memset(&buffer_config, 0, sizeof(buffer_config));
+    session_config.dir = dir;
+    media_config.rate = 48000;
+    media_config.channels = 2;
+    media_config.format = AGM_FORMAT_PCM_S16_LE;
+    buffer_config.count = 4;
+    buffer_config.size = size ? size : 3840;
+
+    ret = agm_session_open(BENCH_SESSION_ID, AGM_SESSION_DEFAULT, hndl);
+    if (ret)
+        return ret;
+
+    ret = agm_session_set_config(*hndl, &session_config, &media_config,
+                                 &buffer_config);
+    if (!ret)
+        ret = agm_session_prepare(*hndl);
+    if (!ret)
+        ret = agm_session_start(*hndl);
+    if (ret)
+        agm_session_close(*hndl);
+    return ret;
+}
+
+static void session_teardown(uint64_t hndl)
+{
+    agm_session_stop(hndl);
+    agm_session_close(hndl);
+}
+
+/* one bring-up and tear-down, as a client of a real session makes it */
+static int session_cycle(uint8_t *buf)
+{
+    uint64_t hndl;
+    int ret;
+
+    ret = agm_aif_set_metadata(BENCH_AIF_ID, opts.param_size, buf);
+    if (!ret)
+        ret = agm_session_set_metadata(BENCH_SESSION_ID, opts.param_size, buf);
+    if (!ret)
+        ret = agm_session_aif_set_metadata(BENCH_SESSION_ID, BENCH_AIF_ID,
+                                           opts.param_size, buf);
+    if (!ret)
+        ret = agm_session_aif_connect(BENCH_SESSION_ID, BENCH_AIF_ID, true);
+    if (!ret)
+        ret = agm_session_set_params(BENCH_SESSION_ID, buf, opts.param_size);
+    if (!ret)
+        ret = session_setup(&hndl, RX, 0);
+    if (ret)
+        return ret;
+
+    session_teardown(hndl);
+    return agm_session_aif_connect(BENCH_SESSION_ID, BENCH_AIF_ID, false);
+}
+
+/* times n calls of one kind, size is the data size where there is one */
+static int run_calls(const char *test, uint32_t size, struct result *res)
+{
+    uint32_t n = opts.iterations, i;
+    uint64_t *lat, hndl = 0, ts, t0, start, cpu;
+    size_t count;
+    uint8_t *buf;
+    int ret = 0;
+
+    lat = calloc(n, sizeof(*lat));
+    buf = calloc(1, size > opts.param_size ? size : opts.param_size);
+    if (!lat || !buf)
+        return -ENOMEM;
+
+    if (!strcmp(test, "time") || !strcmp(test, "write"))
+        ret = session_setup(&hndl, RX, size);
+    else if (!strcmp(test, "read"))
+        ret = session_setup(&hndl, TX, size);
+    if (ret)
+        goto done;
+
+    cpu = self_cpu_us();
+    start = now_ns();
+    for (i = 0; i < n && !ret; i++) {
+        t0 = now_ns();
+        if (!strcmp(test, "open")) {
+            ret = agm_session_open(BENCH_SESSION_ID, AGM_SESSION_DEFAULT,
+                                   &hndl);
+            if (!ret)
+                ret = agm_session_close(hndl);
+        } else if (!strcmp(test, "set-params")) {
+            ret = agm_session_set_params(BENCH_SESSION_ID, buf,
+                                         opts.param_size);
+        } else if (!strcmp(test, "setup")) {
+            ret = session_cycle(buf);
+        } else if (!strcmp(test, "time")) {
+            ret = agm_get_session_time(hndl, &ts);
+        } else if (!strcmp(test, "write")) {
+            count = size;
+            ret = agm_session_write(hndl, buf, &count);
+            res->bytes += count;
+        } else {
+            count = size;
+            ret = agm_session_read(hndl, buf, &count);
+            res->bytes += count;
+        }
+        lat[i] = now_ns() - t0;
+    }
+    res->wall_ns = now_ns() - start;
+    res->client_us = self_cpu_us() - cpu;
+    res->ops = i;
+    result_set_latency(res, lat, i);
+
+    if (hndl && strcmp(test, "open"))
+        session_teardown(hndl);
+
+done:
+    free(buf);
+    free(lat);
+    return ret;
+}
+
+static struct fanout *fanout;
+static uint32_t fanout_index;
+
+static void fanout_cb(uint32_t session_id,
+                      struct agm_event_cb_params *event_params,
+                      void *client_data)
+{
+    struct agm_fake_event evt;
+    char ack = 1;
+
+    if (event_params->event_id != AGM_FAKE_EVENT_ID ||
+        event_params->event_payload_size < sizeof(evt))
+        return;
+
+    memcpy(&evt, event_params->event_payload, sizeof(evt));
+    if (evt.magic != AGM_FAKE_EVENT_MAGIC || evt.seq >= fanout->iterations)
+        return;
+
+    fanout->recv_ns[fanout_index * fanout->iterations + evt.seq] = now_ns();
+    if (write(fanout->ack_fd, &ack, 1) != 1)
+        perror("ack");
+}
+
+static int read_ack(int fd)
+{
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    char ack;
+    int ret;
+
+    do {
+        ret = poll(&pfd, 1, BENCH_EVENT_TIMEOUT_MS);
+    } while (ret < 0 && errno == EINTR);
+    if (ret == 0)
+        return -ETIMEDOUT;
+    if (ret < 0)
+        return -errno;
+    return read(fd, &ack, 1) == 1 ? 0 : -EPIPE;
+}
+
+static void fanout_listener(uint32_t index, int done_fd)
+{
+    char ready = 1, done;
+    int ret;
+
+    fanout_index = index;
+    ret = wait_service();
+    if (!ret)
+        ret = agm_session_register_cb(BENCH_SESSION_ID, fanout_cb,
+                                      AGM_EVENT_MODULE, &fanout_index);
+    if (ret) {
+        fprintf(stderr, "listener %u: register failed %d\n", index, ret);
+        _exit(1);
+    }
+
+    if (write(fanout->ready_fd, &ready, 1) != 1)
+        _exit(1);
+
+    /* the sender closes its end when it is done */
+    while (read(done_fd, &done, 1) > 0)
+        ;
+
+    agm_session_register_cb(BENCH_SESSION_ID, NULL, AGM_EVENT_MODULE,
+                            &fanout_index);
+    __atomic_add_fetch(&fanout->client_us, self_cpu_us(), __ATOMIC_RELAXED);
+    _exit(0);
+}
+
+/*
+ * The listeners are forked before this process makes its first agm call,
+ * each with a libagmclient of its own. One event is in flight at a time.
+ */
+static int run_events(struct result *res)
+{
+    uint32_t n = opts.iterations, c = opts.clients, i, j;
+    int ready[2], ack[2], done[2];
+    struct agm_fake_event evt;
+    uint64_t *lat, cpu, last;
+    size_t size;
+    pid_t pids[BENCH_MAX_CLIENTS];
+    char byte;
+    int ret = 0;
+
+    size = sizeof(*fanout) + sizeof(uint64_t) * n * c;
+    fanout = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    lat = calloc(n, sizeof(*lat));
+    if (fanout == MAP_FAILED || !lat || pipe(ready) || pipe(ack) ||
+        pipe(done))
+        return -ENOMEM;
+
+    fanout->clients = c;
+    fanout->iterations = n;
+    fanout->ready_fd = ready[1];
+    fanout->ack_fd = ack[1];
+
+    for (i = 0; i < c; i++) {
+        pids[i] = fork();
+        if (pids[i] < 0) {
+            c = i;
+            ret = -errno;
+            break;
+        }
+        if (pids[i] == 0) {
+            close(done[1]);
+            fanout_listener(i, done[0]);
+        }
+    }
+    close(done[0]);
+    if (ret)
+        goto done;
+
+    for (i = 0; i < c; i++) {
+        if (read(ready[0], &byte, 1) != 1) {
+            ret = -EPIPE;
+            goto done;
+        }
+    }
+
+    ret = wait_service();
+    if (ret)
+        goto done;
+
+    cpu = self_cpu_us();
+    res->wall_ns = now_ns();
+    for (i = 0; i < n && !ret; i++) {
+        evt.magic = AGM_FAKE_EVENT_MAGIC;
+        evt.seq = i;
+        evt.sent_ns = now_ns();
+        ret = agm_session_set_params(BENCH_SESSION_ID, &evt, sizeof(evt));
+        for (j = 0; j < c && !ret; j++)
+            ret = read_ack(ack[0]);
+        if (ret)
+            break;
+
+        last = 0;
+        for (j = 0; j < c; j++)
+            if (fanout->recv_ns[j * n + i] > last)
+                last = fanout->recv_ns[j * n + i];
+        lat[i] = last - evt.sent_ns;
+    }
+    res->wall_ns = now_ns() - res->wall_ns;
+    res->client_us = self_cpu_us() - cpu;
+    res->ops = i;
+    result_set_latency(res, lat, i);
+
+done:
+    close(done[1]);
+    for (i = 0; i < c; i++)
+        waitpid(pids[i], NULL, 0);
+    res->client_us += fanout->client_us;
+    free(lat);
+    munmap(fanout, size);
+    return ret;
+}
+
+static void test_main(const char *test, uint32_t size, struct result *res)
+{
+    int ret;
+
+    /* read by the dbus client when it starts */
+    if (opts.async)
+        setenv("AGM_CLIENT_ASYNC", "1", 1);
+
+    if (!strcmp(test, "events")) {
+        ret = run_events(res);
+    } else {
+        ret = wait_service();
+        if (!ret)
+            ret = run_calls(test, size, res);
+    }
+    res->status = ret;
+    _exit(ret ? 1 : 0);
+}
+
+static void report_header(void)
+{
+    printf("backend %s%s, server %s, fake latency %u us, %u ops per test\n",
+           opts.backend == BACKEND_DBUS ? "dbus" : "us",
+           opts.async ? " pipelined" : "", opts.server, opts.latency_us,
+           opts.iterations);
+    printf("%-11s %6s %8s %9s %9s %9s %8s %8s %7s %7s\n", "test", "size",
+           "ops/s", "p50 us", "p99 us", "p999 us", "MB/s", "cpu/op", "server",
+           "bus");
+}
+
+static void run_test(const char *test, uint32_t size)
+{
+    uint64_t server_us, bus_us;
+    struct result *res;
+    char label[32], size_str[16], mbps[16], bus[16];
+    pid_t pid;
+    int status;
+
+    res = mmap(NULL, sizeof(*res), PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (res == MAP_FAILED)
+        return;
+    memset(res, 0, sizeof(*res));
+    res->status = -ECHILD;
+
+    server_us = proc_cpu_us(server_pid);
+    bus_us = proc_cpu_us(bus_pid);
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+        test_main(test, size, res);
+    waitpid(pid, &status, 0);
+    server_us = proc_cpu_us(server_pid) - server_us;
+    bus_us = proc_cpu_us(bus_pid) - bus_us;
+
+    if (!strcmp(test, "events"))
+        snprintf(label, sizeof(label), "events/%u", opts.clients);
+    else
+        snprintf(label, sizeof(label), "%s", test);
+    if (size)
+        snprintf(size_str, sizeof(size_str), "%u", size);
+    else
+        snprintf(size_str, sizeof(size_str), "-");
+
+    if (res->status || res->ops == 0) {
+        printf("%-11s %6s failed %d\n", label, size_str, res->status);
+        goto done;
+    }
+
+    if (res->bytes)
+        snprintf(mbps, sizeof(mbps), "%.1f", res->bytes * 1e3 / res->wall_ns);
+    else
+        snprintf(mbps, sizeof(mbps), "-");
+    if (bus_pid > 0)
+        snprintf(bus, sizeof(bus), "%.2f", (double)bus_us / res->ops);
+    else
+        snprintf(bus, sizeof(bus), "-");
+
+    printf("%-11s %6s %8.0f %9.1f %9.1f %9.1f %8s %8.2f %7.2f %7s\n",
+           label, size_str, res->ops * 1e9 / res->wall_ns, res->p50_ns / 1e3,
+           res->p99_ns / 1e3, res->p999_ns / 1e3, mbps,
+           (double)res->client_us / res->ops, (double)server_us / res->ops,
+           bus);
+
+done:
+    munmap(res, sizeof(*res));
+}
+
+static int wait_socket(const char *path, pid_t pid)
+{
+    uint64_t deadline = now_ns() + BENCH_WAIT_MS * 1000000ULL;
+    struct sockaddr_un addr;
+    int sock, ret;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    for (;;) {
+        if (waitpid(pid, NULL, WNOHANG) == pid)
+            return -ECHILD;
+
+        sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sock < 0)
+            return -errno;
+        ret = connect(sock, (struct sockaddr *)&addr, sizeof(addr));
+        close(sock);
+        if (ret == 0)
+            return 0;
+        if (now_ns() > deadline)
+            return -ETIMEDOUT;
+        sleep_ms(10);
+    }
+}
+
+static int start_bus(void)
+{
+    char conf[128], sock[128], addr[160], arg[160];
+    FILE *f;
+    int ret;
+
+    snprintf(conf, sizeof(conf), "%s/bus.conf", run_dir);
+    snprintf(sock, sizeof(sock), "%s/bus", run_dir);
+
+    f = fopen(conf, "w");
+    if (!f)
+        return -errno;
+    fprintf(f,
+        "<!DOCTYPE busconfig PUBLIC "
+        "\"-//freedesktop//DTD D-BUS Bus Configuration 1.0//EN\"\n"
+        " \"http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd\">\n"
+        "<busconfig>\n"
+        "  <listen>unix:path=%s</listen>\n"
+        "  <auth>EXTERNAL</auth>\n"
+        "  <policy context=\"default\">\n"
+        "    <allow user=\"*\"/>\n"
+        "    <allow own=\"*\"/>\n"
+        "    <allow send_destination=\"*\"/>\n"
+        "    <allow receive_sender=\"*\"/>\n"
+        "  </policy>\n"
+        "</busconfig>\n", sock);
+    fclose(f);
+
+    snprintf(arg, sizeof(arg), "--config-file=%s", conf);
+    bus_pid = fork();
+    if (bus_pid == 0) {
+        execlp(opts.bus_daemon, opts.bus_daemon, arg, "--nofork",
+               (char *)NULL);
+        perror(opts.bus_daemon);
+        _exit(127);
+    }
+
+    ret = wait_socket(sock, bus_pid);
+    if (ret) {
+        fprintf(stderr, "%s did not come up: %d\n", opts.bus_daemon, ret);
+        return ret;
+    }
+
+    snprintf(addr, sizeof(addr), "unix:path=%s", sock);
+    setenv("DBUS_SYSTEM_BUS_ADDRESS", addr, 1);
+    return 0;
+}
+
+static int start_server(void)
+{
+    char path[1024], latency[16];
+    const char *old = getenv("LD_LIBRARY_PATH");
+    pid_t probe;
+    int status;
+
+    if (opts.backend == BACKEND_US) {
+        snprintf(path, sizeof(path), "%s/agm_us.sock", run_dir);
+        setenv("AGM_US_SOCKET", path, 1);
+    }
+
+    snprintf(latency, sizeof(latency), "%u", opts.latency_us);
+    server_pid = fork();
+    if (server_pid == 0) {
+        /* the fake has libagm's soname, put it in front of the real one */
+        if (old && *old)
+            snprintf(path, sizeof(path), "%s:%s", opts.fake_libdir, old);
+        else
+            snprintf(path, sizeof(path), "%s", opts.fake_libdir);
+        setenv("LD_LIBRARY_PATH", path, 1);
+        setenv(AGM_FAKE_LATENCY_ENV, latency, 1);
+        execlp(opts.server, opts.server, (char *)NULL);
+        perror(opts.server);
+        _exit(127);
+    }
+
+    /* probe from a child, this process must not start libagmclient */
+    probe = fork();
+    if (probe == 0)
+        _exit(wait_service() ? 1 : 0);
+    waitpid(probe, &status, 0);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s did not come up\n", opts.server);
+        return -ETIMEDOUT;
+    }
+    return 0;
+}
+
+static void stop_child(pid_t pid)
+{
+    if (pid <= 0)
+        return;
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+static void cleanup(void)
+{
+    char path[128];
+
+    stop_child(server_pid);
+    stop_child(bus_pid);
+
+    snprintf(path, sizeof(path), "%s/bus.conf", run_dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/bus", run_dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/agm_us.sock", run_dir);
+    unlink(path);
+    rmdir(run_dir);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [-b dbus|us] [-s server] [-d dbus-daemon] [-l fake libdir]\n"
+        "          [-t tests] [-n ops] [-c clients] [-L latency us]\n"
+        "          [-p param size] [-B size,size,...] [-a]\n"
+        "tests: open,set-params,time,write,read,events,setup\n", prog);
+}
+
+static int parse_sizes(char *arg)
+{
+    char *tok, *save = NULL;
+
+    opts.num_sizes = 0;
+    for (tok = strtok_r(arg, ",", &save); tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        if (opts.num_sizes == BENCH_MAX_SIZES)
+            return -EINVAL;
+        opts.sizes[opts.num_sizes] = strtoul(tok, NULL, 0);
+        if (opts.sizes[opts.num_sizes] == 0)
+            return -EINVAL;
+        opts.num_sizes++;
+    }
+    return opts.num_sizes ? 0 : -EINVAL;
+}
+
+int main(int argc, char **argv)
+{
+    char *tests, *test, *save = NULL;
+    uint32_t i;
+    int opt, ret;
+
+    while ((opt = getopt(argc, argv, "b:s:d:l:t:n:c:L:p:B:ah")) != -1) {
+        switch (opt) {
+        case 'b':
+            if (!strcmp(optarg, "dbus"))
+                opts.backend = BACKEND_DBUS;
+            else if (!strcmp(optarg, "us"))
+                opts.backend = BACKEND_US;
+            else
+                goto err_usage;
+            break;
+        case 's':
+            opts.server = optarg;
+            break;
+        case 'd':
+            opts.bus_daemon = optarg;
+            break;
+        case 'l':
+            opts.fake_libdir = optarg;
+            break;
+        case 't':
+            opts.tests = optarg;
+            break;
+        case 'n':
+            opts.iterations = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            opts.clients = strtoul(optarg, NULL, 0);
+            break;
+        case 'L':
+            opts.latency_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            opts.param_size = strtoul(optarg, NULL, 0);
+            break;
+        case 'B':
+            if (parse_sizes(optarg))
+                goto err_usage;
+            break;
+        case 'a':
+            opts.async = true;
+            break;
+        default:
+            goto err_usage;
+        }
+    }
+
+    if (opts.iterations == 0 || opts.clients == 0 ||
+        opts.clients > BENCH_MAX_CLIENTS || opts.param_size == 0)
+        goto err_usage;
+
+    signal(SIGPIPE, SIG_IGN);
+    snprintf(run_dir, sizeof(run_dir), "/tmp/agm_ipc_bench.XXXXXX");
+    if (!mkdtemp(run_dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    ret = opts.backend == BACKEND_DBUS ? start_bus() : 0;
+    if (!ret)
+        ret = start_server();
+    if (ret)
+        goto done;
+
+    report_header();
+    tests = strdup(opts.tests);
+    for (test = strtok_r(tests, ",", &save); test;
+         test = strtok_r(NULL, ",", &save)) {
+        if (!strcmp(test, "write") || !strcmp(test, "read")) {
+            for (i = 0; i < opts.num_sizes; i++)
+                run_test(test, opts.sizes[i]);
+        } else if (!strcmp(test, "set-params")) {
+            run_test(test, opts.param_size);
+        } else if (!strcmp(test, "open") || !strcmp(test, "time") ||
+                   !strcmp(test, "events") || !strcmp(test, "setup")) {
+            run_test(test, 0);
+        } else {
+            fprintf(stderr, "unknown test %s\n", test);
+        }
+    }
+    free(tests);
+
+done:
+    cleanup();
+    return ret ? 1 : 0;
+
+err_usage:
+    usage(argv[0]);
+    return 1;
+}
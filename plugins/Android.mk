@@ -1,3 +1,11 @@
 MY_LOCAL_PATH := $(call my-dir)
+
+# Build libagm_plugin_headers, shared by the tinyalsa and alsa-lib plugins
+include $(CLEAR_VARS)
+LOCAL_MODULE                := libagm_plugin_headers
+LOCAL_VENDOR_MODULE         := true
+LOCAL_EXPORT_C_INCLUDE_DIRS := $(MY_LOCAL_PATH)/common/inc
+include $(BUILD_HEADER_LIBRARY)
+
 include $(MY_LOCAL_PATH)/tinyalsa/Android.mk
 include $(MY_LOCAL_PATH)/tinyalsa/test/Android.mk
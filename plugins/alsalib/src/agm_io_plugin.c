@@ -28,7 +28,10 @@
 **/
 #define LOG_TAG "PLUGIN: AGMIO"
 #include <stdio.h>
+#include <sys/mman.h>
 #include <sys/poll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 
 #include <sys/eventfd.h>
 #include <alsa/asoundlib.h>
@@ -38,6 +41,9 @@
 #include <agm/agm_list.h>
 #include <snd-card-def.h>
 #include "utils.h"
+#include "agm_pcm_coalesce.h"
+#include "agm_pcm_convert.h"
+#include "agm_pcm_pos.h"
 
 #define ARRAY_SIZE(a)   (sizeof(a)/sizeof(a[0]))
 
@@ -66,6 +72,26 @@ struct agmio_priv {
     snd_pcm_uframes_t hw_pointer;
     snd_pcm_uframes_t boundary;
     int event_fd;
+    /* graph format from the card def, -1/0 when not given */
+    int native_fmt;
+    unsigned int native_channels;
+    /* client <-> graph conversion, NULL while the two match */
+    struct agm_pcm_convert *cvt;
+    void *cvt_buf;
+    size_t cvt_buf_size;
+    /* playback write aggregation, NULL unless write_coalesce_ms is set */
+    struct agm_pcm_coalesce *coalesce;
+    /* MMAP_INTERLEAVED clients run push-pull on the DSP shared buffers */
+    bool mmap;
+    struct agm_buf_info buf_info;
+    void *mmap_addr;
+    size_t mmap_size;
+    /* count * period_size, what the DSP ring and its read index wrap on */
+    snd_pcm_uframes_t mmap_frames;
+    void *pos_buf_addr;
+    snd_pcm_uframes_t mmap_pos;
+    /* period timer standing in for period events in push-pull mode */
+    int timer_fd;
 /* add private variables here */
 };
 
@@ -82,6 +108,320 @@ static int agm_get_session_handle(struct agmio_priv *priv,
     return 0;
 }
 
+static int alsa_to_cvt_format(snd_pcm_format_t format,
+                              enum agm_pcm_cvt_format *fmt)
+{
+    switch (format) {
+    case SND_PCM_FORMAT_S16_LE:
+        *fmt = AGM_PCM_CVT_S16;
+        break;
+    case SND_PCM_FORMAT_S24_3LE:
+        *fmt = AGM_PCM_CVT_S24_3LE;
+        break;
+    case SND_PCM_FORMAT_S24_LE:
+        *fmt = AGM_PCM_CVT_S24_LE;
+        break;
+    case SND_PCM_FORMAT_S32_LE:
+        *fmt = AGM_PCM_CVT_S32;
+        break;
+    case SND_PCM_FORMAT_FLOAT_LE:
+        *fmt = AGM_PCM_CVT_FLOAT;
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static enum agm_media_format cvt_to_agm_format(enum agm_pcm_cvt_format fmt)
+{
+    switch (fmt) {
+    case AGM_PCM_CVT_S24_3LE:
+        return AGM_FORMAT_PCM_S24_3LE;
+    case AGM_PCM_CVT_S24_LE:
+        return AGM_FORMAT_PCM_S24_LE;
+    case AGM_PCM_CVT_S32:
+        return AGM_FORMAT_PCM_S32_LE;
+    default:
+    case AGM_PCM_CVT_S16:
+        return AGM_FORMAT_PCM_S16_LE;
+    }
+}
+
+/*
+ * Graph side format from the pcm-device props, see agm_pcm_plugin.c:
+ * native_format, native_channels and native_channel_map.
+ */
+static void agm_io_get_native_config(struct agmio_priv *pcm)
+{
+    enum agm_pcm_cvt_format fmt;
+    char *str = NULL;
+    int channels = 0;
+
+    pcm->native_fmt = -1;
+    pcm->native_channels = 0;
+
+    if (!snd_card_def_get_str(pcm->pcm_node, "native_format", &str) && str) {
+        if (agm_pcm_cvt_format_from_str(str, &fmt) || fmt == AGM_PCM_CVT_FLOAT)
+            AGM_LOGE("%s: unsupported native_format %s\n", __func__, str);
+        else
+            pcm->native_fmt = fmt;
+    }
+
+    if (!snd_card_def_get_int(pcm->pcm_node, "native_channels", &channels)) {
+        if (channels <= 0 || channels > AGM_PCM_CVT_MAX_CH)
+            AGM_LOGE("%s: unsupported native_channels %d\n", __func__,
+                     channels);
+        else
+            pcm->native_channels = channels;
+    }
+}
+
+/*
+ * Set up the conversion between the client's hw_params and the graph
+ * config; on success the media config describes the graph side.
+ */
+static int agm_io_setup_convert(struct agmio_priv *pcm)
+{
+    snd_pcm_ioplug_t *io = &pcm->io;
+    struct agm_media_config *media_config = pcm->media_config;
+    enum agm_pcm_cvt_format client_fmt, native_fmt;
+    unsigned int native_ch;
+    int8_t map[AGM_PCM_CVT_MAX_CH];
+    uint32_t num = 0;
+    char *str = NULL;
+    int ret;
+
+    if (pcm->native_fmt < 0 && !pcm->native_channels)
+        goto no_convert;
+
+    ret = alsa_to_cvt_format(io->format, &client_fmt);
+    if (ret) {
+        AGM_LOGE("%s: unsupported client format %d\n", __func__, io->format);
+        return ret;
+    }
+
+    if (pcm->native_fmt >= 0)
+        native_fmt = pcm->native_fmt;
+    else if (client_fmt == AGM_PCM_CVT_FLOAT)
+        native_fmt = AGM_PCM_CVT_S32;
+    else
+        native_fmt = client_fmt;
+    native_ch = pcm->native_channels ? pcm->native_channels : io->channels;
+
+    if (!pcm->cvt) {
+        pcm->cvt = calloc(1, sizeof(struct agm_pcm_convert));
+        if (!pcm->cvt)
+            return -ENOMEM;
+    }
+
+    if (io->stream == SND_PCM_STREAM_CAPTURE)
+        ret = agm_pcm_convert_init(pcm->cvt, native_fmt, native_ch,
+                                   client_fmt, io->channels, true);
+    else
+        ret = agm_pcm_convert_init(pcm->cvt, client_fmt, io->channels,
+                                   native_fmt, native_ch, true);
+    if (ret) {
+        AGM_LOGE("%s: cannot convert %u ch to %u ch\n", __func__,
+                 io->channels, native_ch);
+        return ret;
+    }
+
+    if (!snd_card_def_get_str(pcm->pcm_node, "native_channel_map", &str) &&
+        str) {
+        ret = agm_pcm_convert_parse_map(str, map, &num);
+        if (!ret)
+            ret = agm_pcm_convert_set_map(pcm->cvt, map, num);
+        if (ret)
+            AGM_LOGE("%s: ignoring native_channel_map %s\n", __func__, str);
+    }
+
+    if (agm_pcm_convert_is_noop(pcm->cvt))
+        goto no_convert;
+
+    media_config->format = cvt_to_agm_format(native_fmt);
+    media_config->channels = native_ch;
+    return 0;
+
+no_convert:
+    free(pcm->cvt);
+    pcm->cvt = NULL;
+    return 0;
+}
+
+static void *agm_io_get_cvt_buf(struct agmio_priv *pcm, size_t size)
+{
+    void *buf;
+
+    if (size > pcm->cvt_buf_size) {
+        buf = realloc(pcm->cvt_buf, size);
+        if (!buf)
+            return NULL;
+        pcm->cvt_buf = buf;
+        pcm->cvt_buf_size = size;
+    }
+
+    return pcm->cvt_buf;
+}
+
+/* see agm_pcm_setup_coalesce() in the tinyalsa pcm plugin */
+static void agm_io_setup_coalesce(struct agmio_priv *pcm)
+{
+    int cap_ms = 0;
+
+    agm_pcm_coalesce_destroy(pcm->coalesce);
+    pcm->coalesce = NULL;
+
+    if (pcm->io.stream != SND_PCM_STREAM_PLAYBACK)
+        return;
+
+    if (snd_card_def_get_int(pcm->pcm_node, "write_coalesce_ms", &cap_ms) ||
+        cap_ms <= 0)
+        return;
+
+    pcm->coalesce = agm_pcm_coalesce_create(pcm->handle,
+                                            pcm->buffer_config->size, cap_ms);
+    if (!pcm->coalesce)
+        AGM_LOGE("%s: coalescing unavailable, writing through\n", __func__);
+}
+
+static void agm_io_mmap_release(struct agmio_priv *pcm)
+{
+    if (pcm->mmap_addr) {
+        munmap(pcm->mmap_addr, pcm->mmap_size);
+        pcm->mmap_addr = NULL;
+        pcm->mmap_size = 0;
+        pcm->mmap_frames = 0;
+    }
+
+    if (pcm->pos_buf_addr) {
+        munmap(pcm->pos_buf_addr, pcm->buf_info.pos_buf_size);
+        pcm->pos_buf_addr = NULL;
+    }
+
+    if (pcm->timer_fd >= 0) {
+        close(pcm->timer_fd);
+        pcm->timer_fd = -1;
+    }
+
+    pcm->mmap = false;
+}
+
+/*
+ * Map the DSP data and position buffers of a push-pull session, called
+ * once the session is configured. ioplug keeps its own ring buffer, so
+ * transfer copies between that and the data buffer at the same offset
+ * and the pointer comes straight from the DSP read index. The ring is
+ * the count periods handed to set_config and has to be the whole shared
+ * buffer, or the DSP would wrap on an offset the plugin never maps.
+ */
+static int agm_io_mmap_setup(struct agmio_priv *pcm)
+{
+    snd_pcm_uframes_t frames = pcm->buffer_config->count * pcm->period_size;
+    size_t size = frames * pcm->frame_size;
+    int ret;
+
+    ret = agm_session_get_buf_info(pcm->device, &pcm->buf_info,
+                                   DATA_BUF | POS_BUF);
+    if (ret) {
+        AGM_LOGE("%s: get_buf_info failed, err %d\n", __func__, ret);
+        return ret;
+    }
+
+    if (size != (size_t)pcm->buf_info.data_buf_size) {
+        AGM_LOGE("%s: ring of %zu bytes does not match shared buffer %d\n",
+                 __func__, size, pcm->buf_info.data_buf_size);
+        return -EINVAL;
+    }
+
+    pcm->mmap_addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                          pcm->buf_info.data_buf_fd, 0);
+    if (pcm->mmap_addr == MAP_FAILED) {
+        pcm->mmap_addr = NULL;
+        ret = -errno;
+        goto err;
+    }
+    pcm->mmap_size = size;
+    pcm->mmap_frames = frames;
+
+    pcm->pos_buf_addr = mmap(NULL, pcm->buf_info.pos_buf_size,
+                             PROT_READ | PROT_WRITE, MAP_SHARED,
+                             pcm->buf_info.pos_buf_fd, 0);
+    if (pcm->pos_buf_addr == MAP_FAILED) {
+        pcm->pos_buf_addr = NULL;
+        ret = -errno;
+        goto err;
+    }
+
+    pcm->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+                                   TFD_NONBLOCK | TFD_CLOEXEC);
+    if (pcm->timer_fd < 0) {
+        ret = -errno;
+        goto err;
+    }
+
+    pcm->mmap_pos = 0;
+    pcm->mmap = true;
+    AGM_LOGD("%s: %zu byte shared buffer mapped\n", __func__, size);
+    return 0;
+
+err:
+    AGM_LOGE("%s: failed, err %d\n", __func__, ret);
+    agm_io_mmap_release(pcm);
+    return ret;
+}
+
+/* tick once per period while running, disarm with arm == false */
+static void agm_io_mmap_set_timer(struct agmio_priv *pcm, bool arm)
+{
+    struct itimerspec its;
+    uint64_t period_ns = 0;
+
+    if (!pcm->mmap)
+        return;
+
+    if (arm)
+        period_ns = (uint64_t)pcm->io.period_size * 1000000000ULL /
+                    pcm->io.rate;
+
+    its.it_interval.tv_sec = period_ns / 1000000000ULL;
+    its.it_interval.tv_nsec = period_ns % 1000000000ULL;
+    its.it_value = its.it_interval;
+    timerfd_settime(pcm->timer_fd, 0, &its, NULL);
+}
+
+static snd_pcm_sframes_t agm_io_mmap_pointer(struct agmio_priv *pcm)
+{
+    uint32_t read_index, wall_clk_msw, wall_clk_lsw;
+
+    /* keep the last position while the DSP is mid update */
+    if (!agm_pcm_get_shared_pos(pcm->pos_buf_addr, &read_index,
+                                &wall_clk_msw, &wall_clk_lsw))
+        pcm->mmap_pos = (read_index / pcm->frame_size) % pcm->mmap_frames;
+
+    return pcm->mmap_pos;
+}
+
+static snd_pcm_sframes_t agm_io_mmap_transfer(struct agmio_priv *pcm,
+                                     const snd_pcm_channel_area_t *areas,
+                                     snd_pcm_uframes_t offset,
+                                     snd_pcm_uframes_t size)
+{
+    uint8_t *buf = (uint8_t *) areas->addr + (areas->first + areas->step * offset) / 8;
+    uint8_t *shared = (uint8_t *)pcm->mmap_addr + offset * pcm->frame_size;
+
+    if (offset + size > pcm->mmap_frames)
+        return -EINVAL;
+
+    if (pcm->io.stream == SND_PCM_STREAM_PLAYBACK)
+        memcpy(shared, buf, size * pcm->frame_size);
+    else
+        memcpy(buf, shared, size * pcm->frame_size);
+
+    return size;
+}
+
 static int agm_io_start(snd_pcm_ioplug_t * io)
 {
     struct agmio_priv *pcm = io->private_data;
@@ -102,8 +442,10 @@ static int agm_io_start(snd_pcm_ioplug_t * io)
 
     if (pcm->state != AGM_IO_STATE_RUNNING) {
         ret = agm_session_start(handle);
-        if (!ret)
+        if (!ret) {
             pcm->state = AGM_IO_STATE_RUNNING;
+            agm_io_mmap_set_timer(pcm, true);
+        }
     }
 
     AGM_LOGD("%s: exit\n", __func__);
@@ -119,6 +461,10 @@ static int agm_io_stop(snd_pcm_ioplug_t * io)
     ret = agm_get_session_handle(pcm, &handle);
     if (ret)
         return ret;
+
+    if (pcm->coalesce)
+        agm_pcm_coalesce_discard(pcm->coalesce);
+    agm_io_mmap_set_timer(pcm, false);
     ret = agm_session_stop(handle);
 
     AGM_LOGD("%s: exit\n", __func__);
@@ -127,8 +473,14 @@ static int agm_io_stop(snd_pcm_ioplug_t * io)
 
 static int agm_io_drain(snd_pcm_ioplug_t * io)
 {
+    struct agmio_priv *pcm = io->private_data;
+    int ret = 0;
+
+    if (pcm->coalesce)
+        ret = agm_pcm_coalesce_flush(pcm->coalesce);
+
     AGM_LOGD("%s: exit\n", __func__);
-    return 0;
+    return ret;
 }
 
 static snd_pcm_sframes_t agm_io_pointer(snd_pcm_ioplug_t * io)
@@ -136,6 +488,9 @@ static snd_pcm_sframes_t agm_io_pointer(snd_pcm_ioplug_t * io)
     struct agmio_priv *pcm = io->private_data;
     snd_pcm_sframes_t new_hw_ptr;
 
+    if (pcm->mmap)
+        return agm_io_mmap_pointer(pcm);
+
     new_hw_ptr = pcm->hw_pointer;
     if (io->stream == SND_PCM_STREAM_CAPTURE) {
         if (pcm->hw_pointer == 0)
@@ -155,6 +510,7 @@ static snd_pcm_sframes_t agm_io_transfer(snd_pcm_ioplug_t * io,
     struct agmio_priv *pcm = io->private_data;
     uint64_t handle;
     uint8_t *buf = (uint8_t *) areas->addr + (areas->first + areas->step * offset) / 8;
+    void *xfer;
     size_t count;
     int ret = 0;
 
@@ -168,15 +524,43 @@ static snd_pcm_sframes_t agm_io_transfer(snd_pcm_ioplug_t * io,
             return ret;
     }
 
-    count = size * pcm->frame_size;
+    if (pcm->mmap)
+        return agm_io_mmap_transfer(pcm, areas, offset, size);
 
-    if (io->stream == SND_PCM_STREAM_PLAYBACK)
-        ret = agm_session_write(handle, buf, &count);
-    else
-        ret = agm_session_read(handle, buf, &count);
+    if (pcm->cvt) {
+        count = size * (io->stream == SND_PCM_STREAM_PLAYBACK ?
+                pcm->cvt->dst_frame_bytes : pcm->cvt->src_frame_bytes);
+        xfer = agm_io_get_cvt_buf(pcm, count);
+        if (!xfer)
+            return -ENOMEM;
+    } else {
+        count = size * pcm->frame_size;
+        xfer = buf;
+    }
+
+    if (io->stream == SND_PCM_STREAM_PLAYBACK) {
+        if (pcm->cvt)
+            agm_pcm_convert_run(pcm->cvt, buf, xfer, size);
+        if (pcm->coalesce)
+            ret = agm_pcm_coalesce_write(pcm->coalesce, xfer, count);
+        else
+            ret = agm_session_write(handle, xfer, &count);
+    } else {
+        ret = agm_session_read(handle, xfer, &count);
+    }
 
     if (ret == 0) {
-        ret = snd_pcm_bytes_to_frames(io->pcm, count);
+        if (pcm->cvt) {
+            /* count is in graph frames, which match client frames 1:1 */
+            if (io->stream == SND_PCM_STREAM_PLAYBACK) {
+                ret = count / pcm->cvt->dst_frame_bytes;
+            } else {
+                ret = count / pcm->cvt->src_frame_bytes;
+                agm_pcm_convert_run(pcm->cvt, xfer, buf, ret);
+            }
+        } else {
+            ret = snd_pcm_bytes_to_frames(io->pcm, count);
+        }
         pcm->hw_pointer += ret;
     }
 
@@ -197,6 +581,9 @@ static int agm_io_prepare(snd_pcm_ioplug_t * io)
     if (ret)
         return ret;
 
+    if (pcm->coalesce)
+        agm_pcm_coalesce_discard(pcm->coalesce);
+    pcm->mmap_pos = 0;
     ret = agm_session_prepare(handle);
 
     AGM_LOGD("%s: exit\n", __func__);
@@ -215,6 +602,7 @@ static int agm_io_hw_params(snd_pcm_ioplug_t * io,
 
     ret = agm_get_session_handle(pcm, &handle);
 
+    agm_io_mmap_release(pcm);
     pcm->frame_size = (snd_pcm_format_physical_width(io->format) * io->channels) / 8;
 
     media_config = pcm->media_config;
@@ -225,19 +613,47 @@ static int agm_io_hw_params(snd_pcm_ioplug_t * io,
     media_config->channels = io->channels;
     media_config->format = io->format;
 
+    ret = agm_io_setup_convert(pcm);
+    if (ret)
+        return ret;
+
+    /* the DSP ring holds whole periods only */
+    if (io->buffer_size % io->period_size) {
+        AGM_LOGE("%s: buffer %lu not a multiple of period %lu\n", __func__,
+                 io->buffer_size, io->period_size);
+        return -EINVAL;
+    }
     buffer_config->count = io->buffer_size / io->period_size;
     pcm->period_size = io->period_size;
-    buffer_config->size = io->period_size * pcm->frame_size;
+    if (pcm->cvt)
+        buffer_config->size = io->period_size *
+                (io->stream == SND_PCM_STREAM_PLAYBACK ?
+                 pcm->cvt->dst_frame_bytes : pcm->cvt->src_frame_bytes);
+    else
+        buffer_config->size = io->period_size * pcm->frame_size;
     pcm->hw_pointer = 0;
 
     snd_card_def_get_int(pcm->pcm_node, "session_mode", &sess_mode);
 
     session_config->dir = (io->stream == SND_PCM_STREAM_PLAYBACK) ? RX : TX;
     session_config->sess_mode = sess_mode;
+    /*
+     * mmap clients get push-pull on the shared buffer; with a
+     * conversion in between they keep the write/read path.
+     */
+    if (io->access == SND_PCM_ACCESS_MMAP_INTERLEAVED && !pcm->cvt)
+        session_config->data_mode = AGM_DATA_PUSH_PULL;
+    else
+        session_config->data_mode = AGM_DATA_BLOCKING;
     ret = agm_session_set_config(pcm->handle, session_config,
                                  pcm->media_config, pcm->buffer_config);
-    if (!ret)
+    if (!ret && session_config->data_mode == AGM_DATA_PUSH_PULL)
+        ret = agm_io_mmap_setup(pcm);
+    if (!ret) {
+        if (!pcm->mmap)
+            agm_io_setup_coalesce(pcm);
         pcm->state = AGM_IO_STATE_SETUP;
+    }
 
     AGM_LOGD("%s: exit\n", __func__);
     return ret;
@@ -273,6 +689,14 @@ static int agm_io_sw_params(snd_pcm_ioplug_t *io, snd_pcm_sw_params_t *params)
     return ret;
 }
 
+static int agm_io_hw_free(snd_pcm_ioplug_t *io)
+{
+    struct agmio_priv *pcm = io->private_data;
+
+    agm_io_mmap_release(pcm);
+    return 0;
+}
+
 static int agm_io_close(snd_pcm_ioplug_t * io)
 {
     struct agmio_priv *pcm = io->private_data;
@@ -283,12 +707,16 @@ static int agm_io_close(snd_pcm_ioplug_t * io)
     if (ret)
         return ret;
 
+    agm_pcm_coalesce_destroy(pcm->coalesce);
+    agm_io_mmap_release(pcm);
     ret = agm_session_close(handle);
 
     snd_card_def_put_card(pcm->card_node);
     free(pcm->buffer_config);
     free(pcm->media_config);
     free(pcm->session_config);
+    free(pcm->cvt);
+    free(pcm->cvt_buf);
     free(io->private_data);
 
     AGM_LOGD("%s: exit\n", __func__);
@@ -309,6 +737,8 @@ static int agm_io_pause(snd_pcm_ioplug_t * io, int enable)
          ret = agm_session_pause(handle);
      else
          ret = agm_session_resume(handle);
+     if (!ret)
+         agm_io_mmap_set_timer(pcm, !enable);
 
      AGM_LOGD("%s: exit\n", __func__);
      return ret;
@@ -331,13 +761,14 @@ static int agm_io_poll_desc(snd_pcm_ioplug_t *io, struct pollfd *pfd,
         AGM_LOGE("%s space %u is not correct!\n", __func__, space);
         return -EINVAL;
     }
-    if (io->stream == SND_PCM_STREAM_PLAYBACK) {
-        pfd[0].fd = pcm->event_fd;
+    /* in push-pull mode the period timer ticks as the buffer moves */
+    pfd[0].fd = pcm->mmap ? pcm->timer_fd : pcm->event_fd;
+    if (pcm->mmap)
+        pfd[0].events = POLLIN;
+    else if (io->stream == SND_PCM_STREAM_PLAYBACK)
         pfd[0].events = POLLOUT;
-    } else {
-        pfd[0].fd = pcm->event_fd;
+    else
         pfd[0].events = POLLIN;
-    }
 
     AGM_LOGD("%s: exit\n", __func__);
     return space;
@@ -354,6 +785,17 @@ static int agm_io_poll_revents(snd_pcm_ioplug_t *io, struct pollfd *pfd,
         return -EINVAL;
     }
 
+    if (pcm->mmap) {
+        uint64_t ticks;
+
+        *revents = 0;
+        if ((pfd[0].revents & POLLIN) &&
+            read(pcm->timer_fd, &ticks, sizeof(ticks)) == sizeof(ticks))
+            *revents = (io->stream == SND_PCM_STREAM_PLAYBACK) ?
+                       POLLOUT : POLLIN;
+        return 0;
+    }
+
     if (pfd[0].revents & POLLIN) {
         *revents = POLLIN;
     } else if (pfd[0].revents & POLLOUT) {
@@ -370,6 +812,7 @@ static const snd_pcm_ioplug_callback_t agm_io_callback = {
     .transfer = agm_io_transfer,
     .prepare = agm_io_prepare,
     .hw_params = agm_io_hw_params,
+    .hw_free = agm_io_hw_free,
     .sw_params = agm_io_sw_params,
     .close = agm_io_close,
     .pause = agm_io_pause,
@@ -393,7 +836,13 @@ static int agm_hw_constraint(struct agmio_priv* priv)
         SND_PCM_FORMAT_S32_LE,
         SND_PCM_FORMAT_S24_3LE,
         SND_PCM_FORMAT_S24_LE,
+        /* only with a native config, the plugin converts it */
+        SND_PCM_FORMAT_FLOAT_LE,
     };
+    unsigned int num_formats = ARRAY_SIZE(formats);
+
+    if (priv->native_fmt < 0 && !priv->native_channels)
+        num_formats--;
 
     ret = snd_pcm_ioplug_set_param_list(io, SND_PCM_IOPLUG_HW_ACCESS,
                                         ARRAY_SIZE(access_list),
@@ -402,7 +851,7 @@ static int agm_hw_constraint(struct agmio_priv* priv)
         return ret;
 
     ret = snd_pcm_ioplug_set_param_list(io, SND_PCM_IOPLUG_HW_FORMAT,
-                                        ARRAY_SIZE(formats), formats);
+                                        num_formats, formats);
     if (ret < 0)
         return ret;
 
@@ -503,6 +952,7 @@ SND_PCM_PLUGIN_DEFINE_FUNC(agm)
         goto err_free_priv;
     }
     priv->pcm_node = pcm_node;
+    agm_io_get_native_config(priv);
 
     snd_card_def_get_int(pcm_node, "session_mode", &sess_mode);
 
@@ -519,6 +969,7 @@ SND_PCM_PLUGIN_DEFINE_FUNC(agm)
     priv->session_config = session_config;
     priv->handle = handle;
     priv->event_fd = -1;
+    priv->timer_fd = -1;
     priv->state = AGM_IO_STATE_OPEN;
     priv->io.version = SND_PCM_IOPLUG_VERSION;
     priv->io.name = "AGM PCM I/O Plugin";
@@ -0,0 +1,316 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Write coalescing for the agm pcm plugins.
+ *
+ * Clients that push chunks much smaller than the AGM buffer size would
+ * otherwise pay a session lookup, session lock, graph write and, with the
+ * IPC client, a full transaction for every one of them. When the pcm-device
+ * node carries a write_coalesce_ms prop, playback writes are staged into a
+ * buffer sized like one AGM buffer and handed to agm_session_write when it
+ * fills, on drain, or once the oldest staged byte has waited
+ * write_coalesce_ms, whichever comes first. Once nothing is staged, writes
+ * of at least a buffer go straight through whole, without a copy.
+ *
+ * The timeout flush runs on a small per-stream thread, so data never sits
+ * staged for longer than the cap even if the client stops writing. That
+ * thread wakes early by a margin tracking how late its flushes actually
+ * reached agm, wakeup latency and the write itself included, so the cap
+ * holds for the data and not just for the wakeup. Bytes agm did not take
+ * stay staged and are written again; a flush error from the thread is
+ * reported on the next write.
+ */
+
+#ifndef __AGM_PCM_COALESCE_H__
+#define __AGM_PCM_COALESCE_H__
+
+#include <agm/agm_api.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* first guess and floor of the timeout flush margin */
+#define AGM_PCM_COALESCE_MARGIN_US      1000
+#define AGM_PCM_COALESCE_MIN_MARGIN_US  500
+
+struct agm_pcm_coalesce {
+    uint64_t handle;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    bool exit;
+    uint8_t *buf;
+    size_t size;                /* one AGM buffer, in bytes */
+    size_t fill;
+    uint32_t cap_us;
+    uint32_t margin_us;         /* flush this much before the cap */
+    uint64_t cap_at_us;         /* when the oldest staged byte hits the cap */
+    struct timespec deadline;   /* CLOCK_MONOTONIC */
+    int error;
+    uint64_t num_writes;        /* client writes */
+    uint64_t num_flushes;       /* agm_session_write calls */
+};
+
+static inline uint64_t agm_pcm_coalesce_now_us(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* the oldest staged byte arrived now */
+static inline void agm_pcm_coalesce_set_deadline(struct agm_pcm_coalesce *c)
+{
+    uint64_t deadline_us;
+
+    c->cap_at_us = agm_pcm_coalesce_now_us() + c->cap_us;
+    deadline_us = c->cap_at_us - c->margin_us;
+    c->deadline.tv_sec = deadline_us / 1000000;
+    c->deadline.tv_nsec = (long)(deadline_us % 1000000) * 1000;
+}
+
+/*
+ * After a timeout flush: widen the margin right away if data reached agm
+ * later than the deadline allowed for, narrow it slowly otherwise.
+ */
+static inline void agm_pcm_coalesce_update_margin(struct agm_pcm_coalesce *c,
+                                                  uint64_t deadline_us)
+{
+    uint64_t late = agm_pcm_coalesce_now_us() - deadline_us;
+
+    if (late > c->margin_us)
+        c->margin_us = late;
+    else
+        c->margin_us -= (c->margin_us - late) / 16;
+
+    if (c->margin_us < AGM_PCM_COALESCE_MIN_MARGIN_US)
+        c->margin_us = AGM_PCM_COALESCE_MIN_MARGIN_US;
+    if (c->margin_us > c->cap_us / 2)
+        c->margin_us = c->cap_us / 2;
+}
+
+static inline bool agm_pcm_coalesce_expired(struct agm_pcm_coalesce *c)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > c->deadline.tv_sec ||
+           (now.tv_sec == c->deadline.tv_sec &&
+            now.tv_nsec >= c->deadline.tv_nsec);
+}
+
+/*
+ * Write buf until agm took all of it, fails or stops taking data; returns
+ * the bytes written in *written. Called with c->lock held.
+ */
+static inline int agm_pcm_coalesce_write_l(struct agm_pcm_coalesce *c,
+                                           const uint8_t *buf, size_t bytes,
+                                           size_t *written)
+{
+    size_t count;
+    int ret = 0;
+
+    *written = 0;
+    while (*written < bytes) {
+        count = bytes - *written;
+        ret = agm_session_write(c->handle, (void *)(buf + *written), &count);
+        c->num_flushes++;
+        if (ret)
+            break;
+        if (!count) {
+            ret = -EIO;
+            break;
+        }
+        *written += count;
+    }
+
+    return ret;
+}
+
+/* anything agm did not take stays staged, called with c->lock held */
+static inline int agm_pcm_coalesce_flush_l(struct agm_pcm_coalesce *c)
+{
+    size_t written;
+    int ret;
+
+    if (!c->fill)
+        return 0;
+
+    ret = agm_pcm_coalesce_write_l(c, c->buf, c->fill, &written);
+    c->fill -= written;
+    if (c->fill)
+        memmove(c->buf, c->buf + written, c->fill);
+
+    return ret;
+}
+
+static inline void *agm_pcm_coalesce_thread(void *arg)
+{
+    struct agm_pcm_coalesce *c = arg;
+    uint64_t deadline_us;
+    int ret;
+
+    pthread_mutex_lock(&c->lock);
+    while (!c->exit) {
+        if (!c->fill) {
+            pthread_cond_wait(&c->cond, &c->lock);
+        } else if (agm_pcm_coalesce_expired(c)) {
+            deadline_us = c->cap_at_us - c->margin_us;
+            ret = agm_pcm_coalesce_flush_l(c);
+            agm_pcm_coalesce_update_margin(c, deadline_us);
+            if (ret && !c->error)
+                c->error = ret;
+            /* retry what is left a cap later rather than spin on it */
+            if (c->fill)
+                agm_pcm_coalesce_set_deadline(c);
+        } else {
+            pthread_cond_timedwait(&c->cond, &c->lock, &c->deadline);
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    return NULL;
+}
+
+static inline struct agm_pcm_coalesce *agm_pcm_coalesce_create(
+        uint64_t handle, size_t size, uint32_t cap_ms)
+{
+    struct agm_pcm_coalesce *c;
+    pthread_condattr_t attr;
+
+    if (!size || !cap_ms)
+        return NULL;
+
+    c = calloc(1, sizeof(*c));
+    if (!c)
+        return NULL;
+
+    c->buf = malloc(size);
+    if (!c->buf)
+        goto err_free;
+
+    c->handle = handle;
+    c->size = size;
+    c->cap_us = cap_ms * 1000;
+    c->margin_us = AGM_PCM_COALESCE_MARGIN_US;
+    if (c->margin_us > c->cap_us / 2)
+        c->margin_us = c->cap_us / 2;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&c->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&c->lock, NULL);
+
+    if (pthread_create(&c->thread, NULL, agm_pcm_coalesce_thread, c))
+        goto err_destroy;
+
+    return c;
+
+err_destroy:
+    pthread_cond_destroy(&c->cond);
+    pthread_mutex_destroy(&c->lock);
+    free(c->buf);
+err_free:
+    free(c);
+    return NULL;
+}
+
+static inline int agm_pcm_coalesce_write(struct agm_pcm_coalesce *c,
+                                         const void *buf, size_t bytes)
+{
+    const uint8_t *src = buf;
+    size_t written, n;
+    bool was_empty;
+    int ret = 0;
+
+    pthread_mutex_lock(&c->lock);
+    c->num_writes++;
+    if (c->error) {
+        ret = c->error;
+        c->error = 0;
+        goto done;
+    }
+
+    while (bytes) {
+        if (!c->fill && bytes >= c->size) {
+            ret = agm_pcm_coalesce_write_l(c, src, bytes, &written);
+            if (ret)
+                goto done;
+            break;
+        }
+
+        was_empty = !c->fill;
+        n = c->size - c->fill;
+        if (n > bytes)
+            n = bytes;
+        memcpy(c->buf + c->fill, src, n);
+        c->fill += n;
+        src += n;
+        bytes -= n;
+
+        if (c->fill == c->size) {
+            ret = agm_pcm_coalesce_flush_l(c);
+            if (ret)
+                goto done;
+        } else if (was_empty) {
+            agm_pcm_coalesce_set_deadline(c);
+            pthread_cond_signal(&c->cond);
+        }
+    }
+
+done:
+    pthread_mutex_unlock(&c->lock);
+    return ret;
+}
+
+/* push out whatever is staged, for drain */
+static inline int agm_pcm_coalesce_flush(struct agm_pcm_coalesce *c)
+{
+    int ret;
+
+    pthread_mutex_lock(&c->lock);
+    ret = agm_pcm_coalesce_flush_l(c);
+    if (!ret && c->error)
+        ret = c->error;
+    c->error = 0;
+    pthread_mutex_unlock(&c->lock);
+
+    return ret;
+}
+
+/* throw away whatever is staged, for drop/stop */
+static inline void agm_pcm_coalesce_discard(struct agm_pcm_coalesce *c)
+{
+    pthread_mutex_lock(&c->lock);
+    c->fill = 0;
+    c->error = 0;
+    pthread_mutex_unlock(&c->lock);
+}
+
+static inline void agm_pcm_coalesce_destroy(struct agm_pcm_coalesce *c)
+{
+    if (!c)
+        return;
+
+    pthread_mutex_lock(&c->lock);
+    c->exit = true;
+    pthread_cond_signal(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+    pthread_join(c->thread, NULL);
+
+    pthread_cond_destroy(&c->cond);
+    pthread_mutex_destroy(&c->lock);
+    free(c->buf);
+    free(c);
+}
+
+#endif /* __AGM_PCM_COALESCE_H__ */
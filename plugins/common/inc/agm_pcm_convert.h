@@ -0,0 +1,702 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Sample format and channel layout conversion for the agm pcm plugins.
+ *
+ * When the pcm-device node in the card definition carries native_format
+ * and/or native_channels props, the plugins open the AGM session with that
+ * native configuration and convert between it and whatever the client asked
+ * for in hw_params, instead of requiring the graph to be reconfigured.
+ *
+ * Samples go through a left justified S32 intermediate, a chunk at a time
+ * so both staging buffers stay in L1:
+ *     src format -> S32 -> channel remap/mix -> S32 -> dst format
+ * The format kernels have NEON and SSE2/AVX2 variants, chosen at build
+ * time, with scalar fallbacks used for the tails and other targets.
+ */
+
+#ifndef __AGM_PCM_CONVERT_H__
+#define __AGM_PCM_CONVERT_H__
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define AGM_PCM_CVT_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define AGM_PCM_CVT_SSE2
+#ifdef __AVX2__
+#include <immintrin.h>
+#define AGM_PCM_CVT_AVX2
+#endif
+#endif
+
+#define AGM_PCM_CVT_MAX_CH 8
+#define AGM_PCM_CVT_CHUNK_FRAMES 256
+
+/* unity gain of the Q14 mix coefficients */
+#define AGM_PCM_CVT_UNITY (1 << 14)
+
+enum agm_pcm_cvt_format {
+    AGM_PCM_CVT_S16 = 0,
+    AGM_PCM_CVT_S24_3LE,
+    AGM_PCM_CVT_S24_LE,
+    AGM_PCM_CVT_S32,
+    AGM_PCM_CVT_FLOAT,
+    AGM_PCM_CVT_FMT_MAX,
+};
+
+typedef void (*agm_pcm_cvt_to_s32_fn)(const void *src, int32_t *dst,
+                                      size_t n);
+typedef void (*agm_pcm_cvt_from_s32_fn)(const int32_t *src, void *dst,
+                                        size_t n);
+
+enum agm_pcm_cvt_layout {
+    AGM_PCM_CVT_LAYOUT_COPY,  /* same channels in the same order */
+    AGM_PCM_CVT_LAYOUT_MAP,   /* every output takes one input or silence */
+    AGM_PCM_CVT_LAYOUT_MIX,   /* outputs are weighted sums of inputs */
+};
+
+struct agm_pcm_convert {
+    enum agm_pcm_cvt_format src_fmt;
+    enum agm_pcm_cvt_format dst_fmt;
+    uint32_t src_ch;
+    uint32_t dst_ch;
+    size_t src_frame_bytes;
+    size_t dst_frame_bytes;
+    agm_pcm_cvt_to_s32_fn to_s32;
+    agm_pcm_cvt_from_s32_fn from_s32;
+    enum agm_pcm_cvt_layout layout;
+    /* output channel d takes input channel map[d], -1 for silence */
+    int8_t map[AGM_PCM_CVT_MAX_CH];
+    /* Q14 gain of input channel s in output channel d */
+    int16_t coef[AGM_PCM_CVT_MAX_CH][AGM_PCM_CVT_MAX_CH];
+    int32_t in[AGM_PCM_CVT_CHUNK_FRAMES * AGM_PCM_CVT_MAX_CH];
+    int32_t out[AGM_PCM_CVT_CHUNK_FRAMES * AGM_PCM_CVT_MAX_CH];
+};
+
+static inline size_t agm_pcm_cvt_sample_bytes(enum agm_pcm_cvt_format fmt)
+{
+    switch (fmt) {
+    case AGM_PCM_CVT_S16:
+        return 2;
+    case AGM_PCM_CVT_S24_3LE:
+        return 3;
+    default:
+        return 4;
+    }
+}
+
+static inline int agm_pcm_cvt_format_from_str(const char *str,
+                                              enum agm_pcm_cvt_format *fmt)
+{
+    if (!strcmp(str, "S16_LE"))
+        *fmt = AGM_PCM_CVT_S16;
+    else if (!strcmp(str, "S24_3LE"))
+        *fmt = AGM_PCM_CVT_S24_3LE;
+    else if (!strcmp(str, "S24_LE"))
+        *fmt = AGM_PCM_CVT_S24_LE;
+    else if (!strcmp(str, "S32_LE"))
+        *fmt = AGM_PCM_CVT_S32;
+    else if (!strcmp(str, "FLOAT_LE"))
+        *fmt = AGM_PCM_CVT_FLOAT;
+    else
+        return -EINVAL;
+
+    return 0;
+}
+
+/* Scalar kernels */
+
+static inline void agm_pcm_cvt_s16_to_s32_c(const void *src, int32_t *dst,
+                                            size_t n)
+{
+    const int16_t *s = src;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = (int32_t)((uint32_t)(uint16_t)s[i] << 16);
+}
+
+static inline void agm_pcm_cvt_s32_to_s16_c(const int32_t *src, void *dst,
+                                            size_t n)
+{
+    int16_t *d = dst;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        d[i] = (int16_t)(src[i] >> 16);
+}
+
+static inline void agm_pcm_cvt_s24_3le_to_s32_c(const void *src, int32_t *dst,
+                                                size_t n)
+{
+    const uint8_t *s = src;
+    size_t i;
+
+    for (i = 0; i < n; i++, s += 3)
+        dst[i] = (int32_t)(((uint32_t)s[0] << 8) | ((uint32_t)s[1] << 16) |
+                           ((uint32_t)s[2] << 24));
+}
+
+static inline void agm_pcm_cvt_s32_to_s24_3le_c(const int32_t *src, void *dst,
+                                                size_t n)
+{
+    uint8_t *d = dst;
+    size_t i;
+
+    for (i = 0; i < n; i++, d += 3) {
+        d[0] = (uint8_t)(src[i] >> 8);
+        d[1] = (uint8_t)(src[i] >> 16);
+        d[2] = (uint8_t)(src[i] >> 24);
+    }
+}
+
+/* S24_LE keeps the sample in the low 3 bytes, the top byte is ignored */
+static inline void agm_pcm_cvt_s24_le_to_s32_c(const void *src, int32_t *dst,
+                                               size_t n)
+{
+    const int32_t *s = src;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = (int32_t)((uint32_t)s[i] << 8);
+}
+
+static inline void agm_pcm_cvt_s32_to_s24_le_c(const int32_t *src, void *dst,
+                                               size_t n)
+{
+    int32_t *d = dst;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        d[i] = src[i] >> 8;
+}
+
+static inline void agm_pcm_cvt_s32_to_s32_c(const void *src, int32_t *dst,
+                                            size_t n)
+{
+    memcpy(dst, src, n * sizeof(int32_t));
+}
+
+static inline void agm_pcm_cvt_s32_from_s32_c(const int32_t *src, void *dst,
+                                              size_t n)
+{
+    memcpy(dst, src, n * sizeof(int32_t));
+}
+
+#define AGM_PCM_CVT_FLOAT_SCALE 2147483648.0f
+
+/*
+ * Truncates toward zero, saturates at +-1.0 and turns NaN into silence,
+ * the way the NEON fixed point convert does; the SSE kernels match it.
+ */
+static inline void agm_pcm_cvt_float_to_s32_c(const void *src, int32_t *dst,
+                                              size_t n)
+{
+    const float *s = src;
+    float v;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        v = s[i] * AGM_PCM_CVT_FLOAT_SCALE;
+        if (v != v)
+            dst[i] = 0;
+        else if (v >= AGM_PCM_CVT_FLOAT_SCALE)
+            dst[i] = INT32_MAX;
+        else if (v <= -AGM_PCM_CVT_FLOAT_SCALE)
+            dst[i] = INT32_MIN;
+        else
+            dst[i] = (int32_t)v;
+    }
+}
+
+static inline void agm_pcm_cvt_s32_to_float_c(const int32_t *src, void *dst,
+                                              size_t n)
+{
+    float *d = dst;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        d[i] = (float)src[i] * (1.0f / AGM_PCM_CVT_FLOAT_SCALE);
+}
+
+/* SIMD kernels, each finishes the tail with its scalar counterpart */
+
+#if defined(AGM_PCM_CVT_NEON)
+
+static inline void agm_pcm_cvt_s16_to_s32_simd(const void *src, int32_t *dst,
+                                               size_t n)
+{
+    const int16_t *s = src;
+    size_t i = 0;
+    int16x8_t v;
+
+    for (; i + 8 <= n; i += 8) {
+        v = vld1q_s16(s + i);
+        vst1q_s32(dst + i, vshll_n_s16(vget_low_s16(v), 16));
+        vst1q_s32(dst + i + 4, vshll_n_s16(vget_high_s16(v), 16));
+    }
+    agm_pcm_cvt_s16_to_s32_c(s + i, dst + i, n - i);
+}
+
+static inline void agm_pcm_cvt_s32_to_s16_simd(const int32_t *src, void *dst,
+                                               size_t n)
+{
+    int16_t *d = dst;
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+        vst1q_s16(d + i, vcombine_s16(vshrn_n_s32(vld1q_s32(src + i), 16),
+                                      vshrn_n_s32(vld1q_s32(src + i + 4), 16)));
+    agm_pcm_cvt_s32_to_s16_c(src + i, d + i, n - i);
+}
+
+static inline void agm_pcm_cvt_s24_le_to_s32_simd(const void *src, int32_t *dst,
+                                                  size_t n)
+{
+    const int32_t *s = src;
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+        vst1q_s32(dst + i, vshlq_n_s32(vld1q_s32(s + i), 8));
+    agm_pcm_cvt_s24_le_to_s32_c(s + i, dst + i, n - i);
+}
+
+static inline void agm_pcm_cvt_s32_to_s24_le_simd(const int32_t *src, void *dst,
+                                                  size_t n)
+{
+    int32_t *d = dst;
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+        vst1q_s32(d + i, vshrq_n_s32(vld1q_s32(src + i), 8));
+    agm_pcm_cvt_s32_to_s24_le_c(src + i, d + i, n - i);
+}
+
+/* vcvtq_n_s32_f32 saturates and returns 0 for NaN, no clipping needed */
+static inline void agm_pcm_cvt_float_to_s32_simd(const void *src, int32_t *dst,
+                                                 size_t n)
+{
+    const float *s = src;
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+        vst1q_s32(dst + i, vcvtq_n_s32_f32(vld1q_f32(s + i), 31));
+    agm_pcm_cvt_float_to_s32_c(s + i, dst + i, n - i);
+}
+
+static inline void agm_pcm_cvt_s32_to_float_simd(const int32_t *src, void *dst,
+                                                 size_t n)
+{
+    float *d = dst;
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+        vst1q_f32(d + i, vcvtq_n_f32_s32(vld1q_s32(src + i), 31));
+    agm_pcm_cvt_s32_to_float_c(src + i, d + i, n - i);
+}
+
+#elif defined(AGM_PCM_CVT_SSE2)
+
+static inline void agm_pcm_cvt_s16_to_s32_simd(const void *src, int32_t *dst,
+                                               size_t n)
+{
+    const int16_t *s = src;
+    size_t i = 0;
+#ifdef AGM_PCM_CVT_AVX2
+    __m256i w;
+
+    for (; i + 8 <= n; i += 8) {
+        w = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(s + i)));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_slli_epi32(w, 16));
+    }
+#else
+    __m128i v, zero = _mm_setzero_si128();
+
+    /* interleaving zeros below each sample is the << 16 */
+    for (; i + 8 <= n; i += 8) {
+        v = _mm_loadu_si128((const __m128i *)(s + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi16(zero, v));
+        _mm_storeu_si128((__m128i *)(dst + i + 4), _mm_unpackhi_epi16(zero, v));
+    }
+#endif
+    agm_pcm_cvt_s16_to_s32_c(s + i, dst + i, n - i);
+}
+
+static inline void agm_pcm_cvt_s32_to_s16_simd(const int32_t *src, void *dst,
+                                               size_t n)
+{
+    int16_t *d = dst;
+    size_t i = 0;
+    __m128i lo, hi;
+
+    for (; i + 8 <= n; i += 8) {
+        lo = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(src + i)), 16);
+        hi = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(src + i + 4)), 16);
+        _mm_storeu_si128((__m128i *)(d + i), _mm_packs_epi32(lo, hi));
+    }
+    agm_pcm_cvt_s32_to_s16_c(src + i, d + i, n - i);
+}
+
+static inline void agm_pcm_cvt_s24_le_to_s32_simd(const void *src, int32_t *dst,
+                                                  size_t n)
+{
+    const int32_t *s = src;
+    size_t i = 0;
+#ifdef AGM_PCM_CVT_AVX2
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_slli_epi32(
+                _mm256_loadu_si256((const __m256i *)(s + i)), 8));
+#endif
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_slli_epi32(
+                _mm_loadu_si128((const __m128i *)(s + i)), 8));
+    agm_pcm_cvt_s24_le_to_s32_c(s + i, dst + i, n - i);
+}
+
+static inline void agm_pcm_cvt_s32_to_s24_le_simd(const int32_t *src, void *dst,
+                                                  size_t n)
+{
+    int32_t *d = dst;
+    size_t i = 0;
+#ifdef AGM_PCM_CVT_AVX2
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_si256((__m256i *)(d + i), _mm256_srai_epi32(
+                _mm256_loadu_si256((const __m256i *)(src + i)), 8));
+#endif
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_si128((__m128i *)(d + i), _mm_srai_epi32(
+                _mm_loadu_si128((const __m128i *)(src + i)), 8));
+    agm_pcm_cvt_s32_to_s24_le_c(src + i, d + i, n - i);
+}
+
+/*
+ * cvttps_epi32 returns INT32_MIN for anything out of range and for NaN:
+ * flipping it where v >= 2^31 gives INT32_MAX, and masking it where v is
+ * NaN gives 0, as in the scalar kernel.
+ */
+static inline void agm_pcm_cvt_float_to_s32_simd(const void *src, int32_t *dst,
+                                                 size_t n)
+{
+    const float *s = src;
+    size_t i = 0;
+#ifdef AGM_PCM_CVT_AVX2
+    const __m256 scale8 = _mm256_set1_ps(AGM_PCM_CVT_FLOAT_SCALE);
+    __m256 v8;
+    __m256i t8;
+
+    for (; i + 8 <= n; i += 8) {
+        v8 = _mm256_mul_ps(_mm256_loadu_ps(s + i), scale8);
+        t8 = _mm256_xor_si256(_mm256_cvttps_epi32(v8), _mm256_castps_si256(
+                _mm256_cmp_ps(v8, scale8, _CMP_GE_OQ)));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_and_si256(t8,
+                _mm256_castps_si256(_mm256_cmp_ps(v8, v8, _CMP_ORD_Q))));
+    }
+#endif
+    const __m128 scale = _mm_set1_ps(AGM_PCM_CVT_FLOAT_SCALE);
+    __m128 v;
+    __m128i t;
+
+    for (; i + 4 <= n; i += 4) {
+        v = _mm_mul_ps(_mm_loadu_ps(s + i), scale);
+        t = _mm_xor_si128(_mm_cvttps_epi32(v),
+                          _mm_castps_si128(_mm_cmpge_ps(v, scale)));
+        _mm_storeu_si128((__m128i *)(dst + i),
+                         _mm_and_si128(t, _mm_castps_si128(_mm_cmpord_ps(v, v))));
+    }
+    agm_pcm_cvt_float_to_s32_c(s + i, dst + i, n - i);
+}
+
+static inline void agm_pcm_cvt_s32_to_float_simd(const int32_t *src, void *dst,
+                                                 size_t n)
+{
+    float *d = dst;
+    size_t i = 0;
+#ifdef AGM_PCM_CVT_AVX2
+    const __m256 scale8 = _mm256_set1_ps(1.0f / AGM_PCM_CVT_FLOAT_SCALE);
+
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(d + i, _mm256_mul_ps(_mm256_cvtepi32_ps(
+                _mm256_loadu_si256((const __m256i *)(src + i))), scale8));
+#endif
+    const __m128 scale = _mm_set1_ps(1.0f / AGM_PCM_CVT_FLOAT_SCALE);
+
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(d + i, _mm_mul_ps(_mm_cvtepi32_ps(
+                _mm_loadu_si128((const __m128i *)(src + i))), scale));
+    agm_pcm_cvt_s32_to_float_c(src + i, d + i, n - i);
+}
+
+#else
+
+#define agm_pcm_cvt_s16_to_s32_simd agm_pcm_cvt_s16_to_s32_c
+#define agm_pcm_cvt_s32_to_s16_simd agm_pcm_cvt_s32_to_s16_c
+#define agm_pcm_cvt_s24_le_to_s32_simd agm_pcm_cvt_s24_le_to_s32_c
+#define agm_pcm_cvt_s32_to_s24_le_simd agm_pcm_cvt_s32_to_s24_le_c
+#define agm_pcm_cvt_float_to_s32_simd agm_pcm_cvt_float_to_s32_c
+#define agm_pcm_cvt_s32_to_float_simd agm_pcm_cvt_s32_to_float_c
+
+#endif
+
+/* Packed 3 byte samples are byte shuffles, they stay scalar everywhere */
+static inline agm_pcm_cvt_to_s32_fn agm_pcm_cvt_get_to_s32(
+        enum agm_pcm_cvt_format fmt, bool simd)
+{
+    switch (fmt) {
+    case AGM_PCM_CVT_S16:
+        return simd ? agm_pcm_cvt_s16_to_s32_simd : agm_pcm_cvt_s16_to_s32_c;
+    case AGM_PCM_CVT_S24_3LE:
+        return agm_pcm_cvt_s24_3le_to_s32_c;
+    case AGM_PCM_CVT_S24_LE:
+        return simd ? agm_pcm_cvt_s24_le_to_s32_simd :
+                      agm_pcm_cvt_s24_le_to_s32_c;
+    case AGM_PCM_CVT_S32:
+        return agm_pcm_cvt_s32_to_s32_c;
+    case AGM_PCM_CVT_FLOAT:
+        return simd ? agm_pcm_cvt_float_to_s32_simd :
+                      agm_pcm_cvt_float_to_s32_c;
+    default:
+        return NULL;
+    }
+}
+
+static inline agm_pcm_cvt_from_s32_fn agm_pcm_cvt_get_from_s32(
+        enum agm_pcm_cvt_format fmt, bool simd)
+{
+    switch (fmt) {
+    case AGM_PCM_CVT_S16:
+        return simd ? agm_pcm_cvt_s32_to_s16_simd : agm_pcm_cvt_s32_to_s16_c;
+    case AGM_PCM_CVT_S24_3LE:
+        return agm_pcm_cvt_s32_to_s24_3le_c;
+    case AGM_PCM_CVT_S24_LE:
+        return simd ? agm_pcm_cvt_s32_to_s24_le_simd :
+                      agm_pcm_cvt_s32_to_s24_le_c;
+    case AGM_PCM_CVT_S32:
+        return agm_pcm_cvt_s32_from_s32_c;
+    case AGM_PCM_CVT_FLOAT:
+        return simd ? agm_pcm_cvt_s32_to_float_simd :
+                      agm_pcm_cvt_s32_to_float_c;
+    default:
+        return NULL;
+    }
+}
+
+/* Channel layout */
+
+static inline void agm_pcm_cvt_layout_update(struct agm_pcm_convert *cvt)
+{
+    uint32_t d, s, taps;
+    bool copy = (cvt->src_ch == cvt->dst_ch);
+
+    cvt->layout = AGM_PCM_CVT_LAYOUT_MAP;
+    for (d = 0; d < cvt->dst_ch; d++) {
+        cvt->map[d] = -1;
+        taps = 0;
+        for (s = 0; s < cvt->src_ch; s++) {
+            if (!cvt->coef[d][s])
+                continue;
+            taps++;
+            if (cvt->coef[d][s] == AGM_PCM_CVT_UNITY)
+                cvt->map[d] = s;
+        }
+        if (taps > 1 || (taps == 1 && cvt->map[d] < 0))
+            cvt->layout = AGM_PCM_CVT_LAYOUT_MIX;
+        if (cvt->map[d] != (int8_t)d)
+            copy = false;
+    }
+
+    if (copy && cvt->layout == AGM_PCM_CVT_LAYOUT_MAP)
+        cvt->layout = AGM_PCM_CVT_LAYOUT_COPY;
+}
+
+/*
+ * Default layout: equal counts pass through, mono is copied to every
+ * output, a mono output averages all inputs, extra outputs are silent and
+ * extra inputs s are folded into output s % dst_ch.
+ */
+static inline void agm_pcm_cvt_default_layout(struct agm_pcm_convert *cvt)
+{
+    uint32_t d, s, taps;
+
+    memset(cvt->coef, 0, sizeof(cvt->coef));
+    for (d = 0; d < cvt->dst_ch; d++) {
+        if (cvt->src_ch == 1) {
+            cvt->coef[d][0] = AGM_PCM_CVT_UNITY;
+            continue;
+        }
+        taps = 0;
+        for (s = d; s < cvt->src_ch; s += cvt->dst_ch)
+            taps++;
+        for (s = d; s < cvt->src_ch; s += cvt->dst_ch)
+            cvt->coef[d][s] = AGM_PCM_CVT_UNITY / taps;
+    }
+    agm_pcm_cvt_layout_update(cvt);
+}
+
+/*
+ * Explicit remap: output channel d takes input channel map[d], negative
+ * entries leave the output silent.
+ */
+static inline int agm_pcm_convert_set_map(struct agm_pcm_convert *cvt,
+                                          const int8_t *map, uint32_t num)
+{
+    uint32_t d;
+
+    if (num != cvt->dst_ch)
+        return -EINVAL;
+
+    for (d = 0; d < num; d++) {
+        if (map[d] >= (int8_t)cvt->src_ch)
+            return -EINVAL;
+    }
+
+    memset(cvt->coef, 0, sizeof(cvt->coef));
+    for (d = 0; d < num; d++) {
+        if (map[d] >= 0)
+            cvt->coef[d][map[d]] = AGM_PCM_CVT_UNITY;
+    }
+    agm_pcm_cvt_layout_update(cvt);
+
+    return 0;
+}
+
+/* Parse a remap written as comma separated input channels, "-" for silence */
+static inline int agm_pcm_convert_parse_map(const char *str, int8_t *map,
+                                            uint32_t *num)
+{
+    char *end;
+    long ch;
+    uint32_t n = 0;
+
+    while (*str) {
+        if (n == AGM_PCM_CVT_MAX_CH)
+            return -EINVAL;
+        if (*str == '-') {
+            ch = -1;
+            end = (char *)str + 1;
+        } else {
+            ch = strtol(str, &end, 10);
+            if (end == str || ch < 0 || ch >= AGM_PCM_CVT_MAX_CH)
+                return -EINVAL;
+        }
+        map[n++] = (int8_t)ch;
+        str = end;
+        if (*str == ',')
+            str++;
+        else if (*str)
+            return -EINVAL;
+    }
+    *num = n;
+
+    return n ? 0 : -EINVAL;
+}
+
+static inline int agm_pcm_convert_init(struct agm_pcm_convert *cvt,
+        enum agm_pcm_cvt_format src_fmt, uint32_t src_ch,
+        enum agm_pcm_cvt_format dst_fmt, uint32_t dst_ch, bool simd)
+{
+    if (src_fmt >= AGM_PCM_CVT_FMT_MAX || dst_fmt >= AGM_PCM_CVT_FMT_MAX ||
+        !src_ch || src_ch > AGM_PCM_CVT_MAX_CH ||
+        !dst_ch || dst_ch > AGM_PCM_CVT_MAX_CH)
+        return -EINVAL;
+
+    cvt->src_fmt = src_fmt;
+    cvt->dst_fmt = dst_fmt;
+    cvt->src_ch = src_ch;
+    cvt->dst_ch = dst_ch;
+    cvt->src_frame_bytes = src_ch * agm_pcm_cvt_sample_bytes(src_fmt);
+    cvt->dst_frame_bytes = dst_ch * agm_pcm_cvt_sample_bytes(dst_fmt);
+    cvt->to_s32 = agm_pcm_cvt_get_to_s32(src_fmt, simd);
+    cvt->from_s32 = agm_pcm_cvt_get_from_s32(dst_fmt, simd);
+    agm_pcm_cvt_default_layout(cvt);
+
+    return 0;
+}
+
+static inline bool agm_pcm_convert_is_noop(struct agm_pcm_convert *cvt)
+{
+    return cvt->src_fmt == cvt->dst_fmt &&
+           cvt->layout == AGM_PCM_CVT_LAYOUT_COPY;
+}
+
+static inline void agm_pcm_cvt_map(struct agm_pcm_convert *cvt,
+                                   const int32_t *in, int32_t *out,
+                                   size_t frames)
+{
+    uint32_t src_ch = cvt->src_ch, dst_ch = cvt->dst_ch, d;
+    size_t f;
+
+    for (f = 0; f < frames; f++, in += src_ch, out += dst_ch) {
+        for (d = 0; d < dst_ch; d++)
+            out[d] = cvt->map[d] < 0 ? 0 : in[cvt->map[d]];
+    }
+}
+
+static inline void agm_pcm_cvt_mix(struct agm_pcm_convert *cvt,
+                                   const int32_t *in, int32_t *out,
+                                   size_t frames)
+{
+    uint32_t src_ch = cvt->src_ch, dst_ch = cvt->dst_ch, d, s;
+    int64_t acc;
+    size_t f;
+
+    for (f = 0; f < frames; f++, in += src_ch, out += dst_ch) {
+        for (d = 0; d < dst_ch; d++) {
+            acc = 0;
+            for (s = 0; s < src_ch; s++)
+                acc += (int64_t)cvt->coef[d][s] * in[s];
+            acc >>= 14;
+            if (acc > INT32_MAX)
+                acc = INT32_MAX;
+            else if (acc < INT32_MIN)
+                acc = INT32_MIN;
+            out[d] = (int32_t)acc;
+        }
+    }
+}
+
+/* Convert frames from src into dst, dst holds frames * dst_frame_bytes */
+static inline void agm_pcm_convert_run(struct agm_pcm_convert *cvt,
+                                       const void *src, void *dst,
+                                       size_t frames)
+{
+    const uint8_t *s = src;
+    uint8_t *d = dst;
+    int32_t *out;
+    size_t n;
+
+    while (frames) {
+        n = frames < AGM_PCM_CVT_CHUNK_FRAMES ? frames :
+                                                AGM_PCM_CVT_CHUNK_FRAMES;
+        cvt->to_s32(s, cvt->in, n * cvt->src_ch);
+        switch (cvt->layout) {
+        case AGM_PCM_CVT_LAYOUT_MAP:
+            agm_pcm_cvt_map(cvt, cvt->in, cvt->out, n);
+            out = cvt->out;
+            break;
+        case AGM_PCM_CVT_LAYOUT_MIX:
+            agm_pcm_cvt_mix(cvt, cvt->in, cvt->out, n);
+            out = cvt->out;
+            break;
+        default:
+            out = cvt->in;
+            break;
+        }
+        cvt->from_s32(out, d, n * cvt->dst_ch);
+
+        s += n * cvt->src_frame_bytes;
+        d += n * cvt->dst_frame_bytes;
+        frames -= n;
+    }
+}
+
+#endif /* __AGM_PCM_CONVERT_H__ */
@@ -0,0 +1,65 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Layout of the DSP position buffer shared with push-pull (mmap) sessions,
+ * as returned through agm_session_get_buf_info(POS_BUF), and a reader for
+ * it shared by the tinyalsa and alsa-lib pcm plugins.
+ *
+ * The DSP bumps frame_counter around every update, so a sample is only
+ * consistent when the counter reads the same, and non zero, before and
+ * after the other fields.
+ */
+
+#ifndef __AGM_PCM_POS_H__
+#define __AGM_PCM_POS_H__
+
+#include <errno.h>
+#include <stdint.h>
+
+/* pull-push mode macros */
+#define AGM_PULL_PUSH_IDX_RETRY_COUNT 2
+#define AGM_PULL_PUSH_FRAME_CNT_RETRY_COUNT 5
+
+struct agm_shared_pos_buffer {
+    volatile uint32_t frame_counter;
+    volatile uint32_t read_index;
+    volatile uint32_t wall_clock_us_lsw;
+    volatile uint32_t wall_clock_us_msw;
+};
+
+/*
+ * read_index is a byte offset into the data buffer; returns -EAGAIN if
+ * the DSP kept updating while we read.
+ */
+static inline int agm_pcm_get_shared_pos(void *pos_buf_addr,
+        uint32_t *read_index, uint32_t *wall_clk_msw,
+        uint32_t *wall_clk_lsw)
+{
+    struct agm_shared_pos_buffer *buf = pos_buf_addr;
+    uint32_t frame_cnt1 = 0, frame_cnt2;
+    int i, j;
+
+    for (i = 0; i < AGM_PULL_PUSH_IDX_RETRY_COUNT; ++i) {
+        for (j = 0; j < AGM_PULL_PUSH_FRAME_CNT_RETRY_COUNT; ++j) {
+            frame_cnt1 = buf->frame_counter;
+            if (frame_cnt1 != 0)
+                break;
+        }
+        *wall_clk_msw = buf->wall_clock_us_msw;
+        *wall_clk_lsw = buf->wall_clock_us_lsw;
+        *read_index = buf->read_index; /* 0,.... Circ_buf_size-1 */
+        frame_cnt2 = buf->frame_counter;
+
+        if (frame_cnt1 != frame_cnt2)
+            continue;
+
+        return 0;
+    }
+
+    return -EAGAIN;
+}
+
+#endif /* __AGM_PCM_POS_H__ */
@@ -12,6 +12,7 @@ LOCAL_SRC_FILES     := src/agm_pcm_plugin.c
 
 LOCAL_HEADER_LIBRARIES := \
     libagm_headers \
+    libagm_plugin_headers \
     libarpal_headers \
     libarosal_headers
 
@@ -0,0 +1,111 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Level triggered readiness fd for the agm compress plugin.
+ *
+ * The fd is readable exactly while the stream is ready, so it can sit in
+ * the caller's own poll()/epoll set next to its other fds. The owner
+ * recomputes readiness under its lock after every state change and calls
+ * agm_compr_ready_set(), which only makes a syscall when the level flips.
+ * An eventfd is used where available, a non-blocking pipe otherwise.
+ */
+
+#ifndef __AGM_COMPRESS_EVENT_H__
+#define __AGM_COMPRESS_EVENT_H__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+struct agm_compr_ready {
+    int fd[2];      /* read end, write end; the same fd for an eventfd */
+    bool armed;
+};
+
+static inline int agm_compr_ready_init(struct agm_compr_ready *r)
+{
+    int i;
+
+    r->armed = false;
+    r->fd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (r->fd[0] >= 0) {
+        r->fd[1] = r->fd[0];
+        return 0;
+    }
+
+    if (pipe(r->fd)) {
+        r->fd[0] = r->fd[1] = -1;
+        return -errno;
+    }
+    for (i = 0; i < 2; i++) {
+        fcntl(r->fd[i], F_SETFL, fcntl(r->fd[i], F_GETFL) | O_NONBLOCK);
+        fcntl(r->fd[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    return 0;
+}
+
+static inline void agm_compr_ready_deinit(struct agm_compr_ready *r)
+{
+    if (r->fd[1] >= 0 && r->fd[1] != r->fd[0])
+        close(r->fd[1]);
+    if (r->fd[0] >= 0)
+        close(r->fd[0]);
+    r->fd[0] = r->fd[1] = -1;
+}
+
+/* called with the owner's lock held */
+static inline void agm_compr_ready_set(struct agm_compr_ready *r, bool ready)
+{
+    uint64_t val = 1;
+    ssize_t ret;
+
+    if (ready == r->armed || r->fd[0] < 0)
+        return;
+
+    if (ready) {
+        if (r->fd[1] == r->fd[0])
+            ret = write(r->fd[1], &val, sizeof(val));
+        else
+            ret = write(r->fd[1], &val, 1);
+    } else {
+        /* an eventfd read returns the whole count, a pipe holds one byte */
+        ret = read(r->fd[0], &val, sizeof(val));
+    }
+
+    if (ret > 0)
+        r->armed = ready;
+}
+
+/*
+ * Wait up to timeout_ms (negative: forever) for the fd to become
+ * readable; returns 1 when ready, 0 on timeout, negative errno otherwise.
+ */
+static inline int agm_compr_ready_wait(struct agm_compr_ready *r,
+                                       int timeout_ms)
+{
+    struct pollfd pfd;
+    int ret;
+
+    pfd.fd = r->fd[0];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    do {
+        ret = poll(&pfd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0)
+        return -errno;
+
+    return ret > 0 ? 1 : 0;
+}
+
+#endif /* __AGM_COMPRESS_EVENT_H__ */
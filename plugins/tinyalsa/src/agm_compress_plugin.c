@@ -48,6 +48,8 @@
 #include <sound/compress_params.h>
 #include <sound/compress_offload.h>
 #include <agm/utils.h>
+#include "agm_compress_event.h"
+#include "agm_pcm_stats.h"
 
 #ifdef DYNAMIC_LOG_ENABLED
 #include <log_xml_parser.h>
@@ -61,6 +63,13 @@
 #define COMPR_PLAYBACK_MIN_NUM_FRAGMENTS (4)
 #define COMPR_PLAYBACK_MAX_NUM_FRAGMENTS (16)
 
+/* what a drain is blocked on */
+enum agm_compress_wait {
+    AGM_COMPRESS_WAIT_NONE,
+    AGM_COMPRESS_WAIT_EOS,
+    AGM_COMPRESS_WAIT_EARLY_EOS,
+};
+
 struct agm_compress_priv {
     struct agm_media_config media_config;
     struct agm_buffer_config buffer_config;
@@ -71,14 +80,15 @@ struct agm_compress_priv {
     uint64_t bytes_copied; /* Copied to DSP buffer */
     uint64_t total_buf_size; /* Total buffer size */
 
-    int64_t bytes_avail; /* avail size to write/read */
+    /* playback: free space to write, capture: filled data to read */
+    int64_t bytes_avail;
 
     uint64_t bytes_received;  /* from DSP */
     uint64_t bytes_read;  /* Consumed by client */
-    bool start_drain;
-    bool eos;
-    bool early_eos;
+    enum agm_compress_wait wait;
     bool eos_received;
+    bool error;
+    bool closing;
 
     enum agm_gapless_silence_type type;   /* Silence Type (Initial/Trailing) */
     uint32_t silence;  /* Samples to remove */
@@ -86,15 +96,13 @@ struct agm_compress_priv {
     void *client_data;
     void *card_node;
     int session_id;
-    pthread_cond_t drain_cond;
-    pthread_mutex_t drain_lock;
-    pthread_cond_t eos_cond;
-    pthread_mutex_t eos_lock;
-    pthread_cond_t early_eos_cond;
-    pthread_mutex_t early_eos_lock;
+    /* one lock for all the stream state, cond only for drain waits */
     pthread_mutex_t lock;
-    pthread_cond_t poll_cond;
-    pthread_mutex_t poll_lock;
+    pthread_cond_t cond;
+    /* readable while a write (playback) or read (capture) can proceed */
+    struct agm_compr_ready ready;
+    /* underruns and poll timeouts, reported to the session */
+    struct agm_pcm_stats stats;
 };
 
 void agm_session_update_codec_options(struct agm_session_config*, struct snd_compr_params *);
@@ -112,6 +120,45 @@ static int agm_get_session_handle(struct agm_compress_priv *priv,
     return 0;
 }
 
+/*
+ * Recompute readiness after a state change, called with priv->lock held.
+ * Playback is ready once a whole fragment is free, capture once READ_DONE
+ * reported data the client has not read yet. Errors and close wake
+ * pollers too, they see POLLERR.
+ */
+static void agm_compress_update_ready_l(struct agm_compress_priv *priv)
+{
+    bool ready;
+
+    if (priv->error || priv->closing)
+        ready = true;
+    else if (priv->session_config.dir == RX)
+        ready = priv->buffer_config.size &&
+                priv->bytes_avail >= (int64_t)priv->buffer_config.size;
+    else
+        ready = priv->bytes_avail > 0;
+
+    agm_compr_ready_set(&priv->ready, ready);
+}
+
+/* nothing written yet for playback, nothing captured yet for capture */
+static void agm_compress_reset_avail_l(struct agm_compress_priv *priv)
+{
+    if (priv->session_config.dir == RX)
+        priv->bytes_avail = priv->total_buf_size;
+    else
+        priv->bytes_avail = 0;
+}
+
+/* wake a drain blocked on EOS or early EOS, for stop and close */
+static void agm_compress_abort_wait_l(struct agm_compress_priv *priv)
+{
+    if (priv->wait != AGM_COMPRESS_WAIT_NONE) {
+        priv->wait = AGM_COMPRESS_WAIT_NONE;
+        pthread_cond_broadcast(&priv->cond);
+    }
+}
+
 void agm_compress_event_cb(uint32_t session_id __unused,
                            struct agm_event_cb_params *event_params,
                            void *client_data)
@@ -143,51 +190,48 @@ void agm_compress_event_cb(uint32_t session_id __unused,
          */
         priv->bytes_avail += priv->buffer_config.size;
         if (priv->bytes_avail > priv->total_buf_size) {
+            /* stop resets the accounting while write dones are in flight */
             AGM_LOGE("%s: Error: bytes_avail %lld, total size = %llu\n",
                    __func__, priv->bytes_avail, (unsigned long long) priv->total_buf_size);
-            pthread_mutex_unlock(&priv->lock);
-            return;
+            priv->bytes_avail = priv->total_buf_size;
         }
-
-        pthread_mutex_lock(&priv->drain_lock);
-        if (priv->start_drain &&
-            (priv->bytes_avail == priv->total_buf_size))
-            pthread_cond_signal(&priv->drain_cond);
-        pthread_mutex_unlock(&priv->drain_lock);
+        /* the DSP ran the buffer dry without being asked to drain */
+        agm_pcm_stats_xrun(&priv->stats,
+                priv->bytes_avail == (int64_t)priv->total_buf_size &&
+                priv->wait == AGM_COMPRESS_WAIT_NONE, false);
     } else if (event_params->event_id == AGM_EVENT_READ_DONE) {
         /* Read done cb expected for every DSP read with Fragment size */
         priv->bytes_avail += priv->buffer_config.size;
         priv->bytes_received += priv->buffer_config.size;
+        if (priv->bytes_avail > priv->total_buf_size) {
+            /* stop resets the accounting while read dones are in flight */
+            AGM_LOGE("%s: Error: bytes_avail %lld, total size = %llu\n",
+                   __func__, priv->bytes_avail, (unsigned long long) priv->total_buf_size);
+            priv->bytes_avail = priv->total_buf_size;
+        }
     } else if (event_params->event_id == AGM_EVENT_EOS_RENDERED) {
         AGM_LOGD("%s: EOS event received \n", __func__);
         /* Unblock eos wait if all the buffers are rendered */
-        pthread_mutex_lock(&priv->eos_lock);
-        if (priv->eos) {
-            pthread_cond_signal(&priv->eos_cond);
-            priv->eos = false;
+        if (priv->wait == AGM_COMPRESS_WAIT_EOS) {
+            priv->wait = AGM_COMPRESS_WAIT_NONE;
+            pthread_cond_broadcast(&priv->cond);
         } else {
             AGM_LOGD("%s: EOS received before drain called\n", __func__);
             priv->eos_received = true;
         }
-        pthread_mutex_unlock(&priv->eos_lock);
     } else if (event_params->event_id == AGM_EVENT_EARLY_EOS) {
         AGM_LOGD("%s: Early EOS event received \n", __func__);
         /* Unblock early eos wait */
-        pthread_mutex_lock(&priv->early_eos_lock);
-        if (priv->early_eos) {
-            priv->early_eos = false;
-            pthread_cond_signal(&priv->early_eos_cond);
+        if (priv->wait == AGM_COMPRESS_WAIT_EARLY_EOS) {
+            priv->wait = AGM_COMPRESS_WAIT_NONE;
+            pthread_cond_broadcast(&priv->cond);
         }
-        pthread_mutex_unlock(&priv->early_eos_lock);
     } else {
         AGM_LOGE("%s: error: Invalid event params id: %d\n", __func__,
            event_params->event_id);
     }
+    agm_compress_update_ready_l(priv);
     pthread_mutex_unlock(&priv->lock);
-    /* Signal Poll */
-    pthread_mutex_lock(&priv->poll_lock);
-    pthread_cond_signal(&priv->poll_cond);
-    pthread_mutex_unlock(&priv->poll_lock);
 }
 
 int agm_compress_write(struct compress_plugin *plugin, const void *buff,
@@ -202,8 +246,9 @@ int agm_compress_write(struct compress_plugin *plugin, const void *buff,
     if (ret)
         return ret;
 
-    if (priv->eos_received)
-        priv->eos_received = false;
+    pthread_mutex_lock(&priv->lock);
+    priv->eos_received = false;
+    pthread_mutex_unlock(&priv->lock);
 
     if (count > priv->total_buf_size) {
         AGM_LOGE("%s: Size %zu is greater than total buf size %llu\n",
@@ -224,6 +269,10 @@ int agm_compress_write(struct compress_plugin *plugin, const void *buff,
 
     ret = agm_session_write(handle, (void *)buff, (size_t*)&size);
     if (ret) {
+        pthread_mutex_lock(&priv->lock);
+        priv->error = true;
+        agm_compress_update_ready_l(priv);
+        pthread_mutex_unlock(&priv->lock);
         errno = ret;
         return ret;
     }
@@ -237,14 +286,18 @@ int agm_compress_write(struct compress_plugin *plugin, const void *buff,
     priv->bytes_avail -= (buf_cnt * priv->buffer_config.size);
     if (priv->bytes_avail < 0) {
         AGM_LOGE("%s: err: bytes_avail = %lld", __func__, (long long) priv->bytes_avail);
+        priv->error = true;
         ret = -EINVAL;
         goto err;
     }
     AGM_LOGV("%s: count = %zu, priv->bytes_avail: %lld\n",
                      __func__, count, (long long) priv->bytes_avail);
     priv->bytes_copied += size;
+    agm_pcm_stats_xrun(&priv->stats, false, false);
+    agm_pcm_stats_flush(&priv->stats, priv->handle, false);
     ret = size;
 err:
+    agm_compress_update_ready_l(priv);
     pthread_mutex_unlock(&priv->lock);
 
     return ret;
@@ -254,17 +307,20 @@ int agm_compress_read(struct compress_plugin *plugin, void *buff, size_t count)
 {
     struct agm_compress_priv *priv = plugin->priv;
     uint64_t handle;
-    int ret = 0, buf_cnt = 0;
+    int ret = 0;
     AGM_LOGV("Enter");
 
     ret = agm_get_session_handle(priv, &handle);
     if (ret)
         return ret;
 
+    pthread_mutex_lock(&priv->lock);
     if (count > priv->bytes_avail) {
+        pthread_mutex_unlock(&priv->lock);
         AGM_LOGE("%s: Invalid requested size %zu", __func__, count);
         return -EINVAL;
     }
+    pthread_mutex_unlock(&priv->lock);
 
     ret = agm_session_read(handle, buff, &count);
     if (ret < 0) {
@@ -274,6 +330,10 @@ int agm_compress_read(struct compress_plugin *plugin, void *buff, size_t count)
     pthread_mutex_lock(&priv->lock);
 
     priv->bytes_read += count;
+    priv->bytes_avail -= count;
+    if (priv->bytes_avail < 0)
+        priv->bytes_avail = 0;
+    agm_compress_update_ready_l(priv);
 
     pthread_mutex_unlock(&priv->lock);
     AGM_LOGV("Exit: read bytes: %d",count);
@@ -491,10 +551,11 @@ int agm_compress_set_params(struct compress_plugin *plugin,
     priv->total_buf_size = buf_cfg->size * buf_cfg->count;
 
     sess_cfg = &priv->session_config;
-    if (sess_cfg->dir == RX)
-        priv->bytes_avail = priv->total_buf_size;
-    else
-        priv->bytes_avail = priv->total_buf_size;
+    pthread_mutex_lock(&priv->lock);
+    agm_compress_reset_avail_l(priv);
+    priv->error = false;
+    agm_compress_update_ready_l(priv);
+    pthread_mutex_unlock(&priv->lock);
 
     sess_cfg->start_threshold = 0;
     sess_cfg->stop_threshold = 0;
@@ -584,27 +645,11 @@ static int agm_compress_stop(struct compress_plugin *plugin)
     if (ret)
         return ret;
 
-    /* Unlock drain if its waiting for EOS rendered */
-    pthread_mutex_lock(&priv->eos_lock);
-    if (priv->eos) {
-        pthread_cond_signal(&priv->eos_cond);
-        priv->eos = false;
-    }
+    /* Unblock drain if it is waiting for EOS rendered or early EOS */
+    pthread_mutex_lock(&priv->lock);
+    agm_compress_abort_wait_l(priv);
     priv->eos_received = true;
-    pthread_mutex_unlock(&priv->eos_lock);
-
-    /* Unblock eos wait if early eos event cb has not been called */
-    pthread_mutex_lock(&priv->early_eos_lock);
-    if (priv->early_eos) {
-        pthread_cond_signal(&priv->early_eos_cond);
-        priv->early_eos = false;
-    }
-    pthread_mutex_unlock(&priv->early_eos_lock);
-
-    /* Signal Poll */
-    pthread_mutex_lock(&priv->poll_lock);
-    pthread_cond_signal(&priv->poll_cond);
-    pthread_mutex_unlock(&priv->poll_lock);
+    pthread_mutex_unlock(&priv->lock);
 
     ret = agm_session_stop(handle);
     if (ret) {
@@ -612,8 +657,12 @@ static int agm_compress_stop(struct compress_plugin *plugin)
         return ret;
     }
     /* stop will reset all the buffers and it called during seek also */
-    priv->bytes_avail = priv->total_buf_size;
+    pthread_mutex_lock(&priv->lock);
+    agm_compress_reset_avail_l(priv);
     priv->bytes_copied = 0;
+    priv->error = false;
+    agm_compress_update_ready_l(priv);
+    pthread_mutex_unlock(&priv->lock);
 
     return ret;
 }
@@ -646,6 +695,43 @@ static int agm_compress_resume(struct compress_plugin *plugin)
     return ret;
 }
 
+/*
+ * Send EOS and block until the event named by wait arrives, or stop/close
+ * abort the wait. The lock is dropped around agm_session_eos so the event
+ * callback is never held off by it.
+ */
+static int agm_compress_eos_wait(struct agm_compress_priv *priv,
+                                 uint64_t handle, enum agm_compress_wait wait)
+{
+    int ret;
+
+    pthread_mutex_lock(&priv->lock);
+    if (wait == AGM_COMPRESS_WAIT_EOS && priv->eos_received) {
+        priv->eos_received = false;
+        pthread_mutex_unlock(&priv->lock);
+        return 0;
+    }
+    priv->wait = wait;
+    pthread_mutex_unlock(&priv->lock);
+
+    ret = agm_session_eos(handle);
+
+    pthread_mutex_lock(&priv->lock);
+    if (ret) {
+        AGM_LOGE("%s: EOS fail\n", __func__);
+        if (priv->wait == wait)
+            priv->wait = AGM_COMPRESS_WAIT_NONE;
+    } else {
+        while (priv->wait == wait)
+            pthread_cond_wait(&priv->cond, &priv->lock);
+    }
+    if (wait == AGM_COMPRESS_WAIT_EOS)
+        priv->eos_received = false;
+    pthread_mutex_unlock(&priv->lock);
+
+    return ret;
+}
+
 static int agm_compress_drain(struct compress_plugin *plugin)
 {
     struct agm_compress_priv *priv = plugin->priv;
@@ -662,21 +748,12 @@ static int agm_compress_drain(struct compress_plugin *plugin)
      * write and EOS cmds are sequential
      */
     /* TODO: how to handle wake up in SSR scenario */
-    pthread_mutex_lock(&priv->eos_lock);
-    if (!priv->eos_received) {
-        priv->eos = true;
-        ret = agm_session_eos(handle);
-        if (ret) {
-            AGM_LOGE("%s: EOS fail\n", __func__);
-            errno = ret;
-            pthread_mutex_unlock(&priv->eos_lock);
-            return ret;
-        }
-        pthread_cond_wait(&priv->eos_cond, &priv->eos_lock);
-        AGM_LOGD("%s: out of eos wait\n", __func__);
+    ret = agm_compress_eos_wait(priv, handle, AGM_COMPRESS_WAIT_EOS);
+    if (ret) {
+        errno = ret;
+        return ret;
     }
-    priv->eos_received = false;
-    pthread_mutex_unlock(&priv->eos_lock);
+    AGM_LOGD("%s: out of eos wait\n", __func__);
 
     return 0;
 }
@@ -692,17 +769,10 @@ static int agm_compress_partial_drain(struct compress_plugin *plugin)
         return ret;
 
     // Send EOS command and wait for EARLY EOS event
-    pthread_mutex_lock(&priv->early_eos_lock);
-    priv->early_eos = true;
-    ret = agm_session_eos(handle);
-    if (ret) {
-        AGM_LOGE("%s: EOS fail\n", __func__);
-        pthread_mutex_unlock(&priv->early_eos_lock);
+    ret = agm_compress_eos_wait(priv, handle, AGM_COMPRESS_WAIT_EARLY_EOS);
+    if (ret)
         return ret;
-    }
-    pthread_cond_wait(&priv->early_eos_cond, &priv->early_eos_lock);
     AGM_LOGD("%s: out of early eos wait\n", __func__);
-    pthread_mutex_unlock(&priv->early_eos_lock);
 
     AGM_LOGV("%s: exit\n", __func__);
     return ret;
@@ -749,32 +819,41 @@ static int agm_compress_poll(struct compress_plugin *plugin,
 {
     struct agm_compress_priv *priv = plugin->priv;
     uint64_t handle;
-    struct timespec poll_ts;
     int ret = 0;
 
     ret = agm_get_session_handle(priv, &handle);
     if (ret)
         return ret;
 
-    clock_gettime(CLOCK_MONOTONIC, &poll_ts);
-    poll_ts.tv_sec += timeout/1000;
-    /* Unblock poll wait if avail bytes to write/read is more than one fragment */
-    pthread_mutex_lock(&priv->poll_lock);
-    /* If timeout is -1 then its infinite wait */
-    if (timeout < 0)
-        ret = pthread_cond_wait(&priv->poll_cond, &priv->poll_lock);
-    else
-        ret = pthread_cond_timedwait(&priv->poll_cond, &priv->poll_lock, &poll_ts);
-    pthread_mutex_unlock(&priv->poll_lock);
+    /* callers can multiplex the stream with their own fds */
+    fds->fd = priv->ready.fd[0];
+    fds->revents = 0;
 
-    if (ret == ETIMEDOUT) {
+    /* If timeout is -1 then its infinite wait */
+    ret = agm_compr_ready_wait(&priv->ready, timeout);
+    if (ret <= 0) {
         /* Poll() expects 0 return value in case of timeout */
-        ret = 0;
-    } else {
-        fds->revents |= POLLOUT;
-        ret = POLLOUT;
+        if (ret < 0)
+            errno = -ret;
+        if (ret == 0 && timeout > 0) {
+            pthread_mutex_lock(&priv->lock);
+            agm_pcm_stats_poll_timeout(&priv->stats);
+            agm_pcm_stats_flush(&priv->stats, handle, false);
+            pthread_mutex_unlock(&priv->lock);
+        }
+        return ret;
     }
-    return ret;
+
+    pthread_mutex_lock(&priv->lock);
+    if (priv->error || priv->closing)
+        fds->revents |= POLLERR;
+    else if (priv->session_config.dir == RX)
+        fds->revents |= POLLOUT;
+    else
+        fds->revents |= POLLIN;
+    pthread_mutex_unlock(&priv->lock);
+
+    return 1;
 }
 
 void agm_compress_close(struct compress_plugin *plugin)
@@ -794,33 +873,25 @@ void agm_compress_close(struct compress_plugin *plugin)
         ret = agm_session_register_cb(priv->session_id, NULL,
                                   AGM_EVENT_MODULE, plugin);
     }
+    pthread_mutex_lock(&priv->lock);
+    agm_pcm_stats_flush(&priv->stats, handle, true);
+    pthread_mutex_unlock(&priv->lock);
     ret = agm_session_close(handle);
     if (ret)
         AGM_LOGE("%s: agm_session_close failed \n", __func__);
 
     snd_card_def_put_card(priv->card_node);
-    /* Unblock eos wait if eos-rendered event cb has not been called */
-    pthread_mutex_lock(&priv->eos_lock);
-    if (priv->eos) {
-        pthread_cond_signal(&priv->eos_cond);
-        priv->eos = false;
-    }
-    pthread_mutex_unlock(&priv->eos_lock);
-
-    /* Unblock eos wait if early eos event cb has not been called */
-    pthread_mutex_lock(&priv->early_eos_lock);
-    if (priv->early_eos) {
-        pthread_cond_signal(&priv->early_eos_cond);
-        priv->early_eos = false;
-    }
-    pthread_mutex_unlock(&priv->early_eos_lock);
-
-    /* Signal Poll */
-    pthread_mutex_lock(&priv->poll_lock);
-    pthread_cond_signal(&priv->poll_cond);
-    pthread_mutex_unlock(&priv->poll_lock);
+    /* Unblock drain and poll waiters if their events never came */
+    pthread_mutex_lock(&priv->lock);
+    priv->closing = true;
+    agm_compress_abort_wait_l(priv);
+    agm_compress_update_ready_l(priv);
+    pthread_mutex_unlock(&priv->lock);
 
     /* Make sure callbacks are not running at this point */
+    agm_compr_ready_deinit(&priv->ready);
+    pthread_cond_destroy(&priv->cond);
+    pthread_mutex_destroy(&priv->lock);
     free(plugin->priv);
     free(plugin);
 
@@ -949,10 +1020,18 @@ COMPRESS_PLUGIN_OPEN_FN(agm_compress_plugin)
         goto err_card_put;
     }
 
+    pthread_mutex_init(&priv->lock, (const pthread_mutexattr_t *) NULL);
+    pthread_cond_init(&priv->cond, (const pthread_condattr_t *) NULL);
+    ret = agm_compr_ready_init(&priv->ready);
+    if (ret) {
+        AGM_LOGE("%s: no readiness fd, ret %d\n", __func__, ret);
+        goto err_lock_destroy;
+    }
+
     ret = agm_session_open(session_id, sess_mode, &handle);
     if (ret) {
         errno = ret;
-        goto err_card_put;
+        goto err_ready_deinit;
     }
     // TODO introduce nonblock flag here
     // instead of checking with direction and then registering callback
@@ -975,16 +1054,16 @@ COMPRESS_PLUGIN_OPEN_FN(agm_compress_plugin)
     agm_populate_codec_caps(priv);
     priv->handle = handle;
     *plugin = agm_compress_plugin;
-    pthread_mutex_init(&priv->lock, (const pthread_mutexattr_t *) NULL);
-    pthread_mutex_init(&priv->eos_lock, (const pthread_mutexattr_t *) NULL);
-    pthread_mutex_init(&priv->drain_lock, (const pthread_mutexattr_t *) NULL);
-    pthread_mutex_init(&priv->poll_lock, (const pthread_mutexattr_t *) NULL);
-    pthread_mutex_init(&priv->early_eos_lock, (const pthread_mutexattr_t *) NULL);
 
     return 0;
 
 err_sess_cls:
     agm_session_close(handle);
+err_ready_deinit:
+    agm_compr_ready_deinit(&priv->ready);
+err_lock_destroy:
+    pthread_cond_destroy(&priv->cond);
+    pthread_mutex_destroy(&priv->lock);
 err_card_put:
     snd_card_def_put_card(card_node);
 err_priv_free:
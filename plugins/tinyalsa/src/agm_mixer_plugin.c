@@ -66,8 +66,13 @@
 #define AMP_PRIV_GET_CTL_PTR(p, idx) \
     (p->ctls + idx)
 
-#define AMP_PRIV_GET_CTL_NAME_PTR(p, idx) \
-    (p->ctl_names[idx])
+/* hash buckets per control, see amp_find_ctl() */
+#define AMP_CTL_HASH_LOAD 2
+
+/* module events held for a subscriber, the oldest is overwritten when full */
+#define AMP_EVENT_RING_SIZE 16
+/* payload bytes kept in a ring slot, larger payloads go to the heap */
+#define AMP_EVENT_PAYLOAD_MAX 512
 
 enum {
     BE_CTL_NAME_MEDIA_CONFIG = 0,
@@ -113,6 +118,7 @@ enum {
     PCM_CTL_NAME_SET_CALIBRATION,
     PCM_CTL_NAME_GET_PARAM,
     PCM_CTL_NAME_BUF_INFO,
+    PCM_CTL_NAME_STATS,
     /* Add new ones here */
 };
 
@@ -130,6 +136,7 @@ static char *amp_pcm_ctl_name_extn[] = {
     "setCalibration",
     "getParam",
     "getBufInfo",
+    "stats",
     /* Add new ones below, be sure to update enum as well */
 };
 
@@ -190,13 +197,44 @@ struct amp_be_group_info {
     int count;
 };
 
+struct amp_event_rec {
+    /* "<pcm> event" control of the session */
+    struct snd_control *ctl;
+    uint32_t session_id;
+    /* not yet returned by read_event */
+    bool notify_pending;
+    /* not yet read back through ctl */
+    bool params_pending;
+    /* points at storage, or at a heap copy for oversized payloads */
+    struct agm_event_cb_params *params;
+    uint32_t storage[(sizeof(struct agm_event_cb_params) +
+                      AMP_EVENT_PAYLOAD_MAX) / sizeof(uint32_t)];
+};
+
+/*
+ * Preallocated while a client is subscribed. A record is reused once
+ * both the notification and the params have been consumed, or when it
+ * is the oldest and a new event arrives on a full ring.
+ */
+struct amp_event_ring {
+    struct amp_event_rec *recs;
+    unsigned int head;
+    unsigned int count;
+    uint64_t num_events;
+    uint64_t num_dropped;
+    uint64_t num_oversized;
+};
+
 struct amp_priv {
     unsigned int card;
     void *card_node;
 
     struct aif_info *aif_list;
-    struct listnode events_list;
-    struct listnode events_paramlist;
+    struct amp_event_ring events;
+
+    /* session id -> "<pcm> event" control, while cb_registered */
+    struct snd_control **event_ctl_map;
+    int event_ctl_map_size;
 
     struct amp_dev_info rx_be_devs;
     struct amp_dev_info tx_be_devs;
@@ -207,9 +245,23 @@ struct amp_priv {
     struct amp_be_group_info group_be_devs;
 
     struct snd_control *ctls;
-    char (*ctl_names)[AIF_NAME_MAX_LEN + 16];
     int ctl_count;
 
+    /*
+     * Control names are interned back to back in one pool sized
+     * exactly at open, instead of a fixed size slot per control.
+     */
+    char *ctl_name_pool;
+    size_t ctl_name_pool_size;
+    size_t ctl_name_pool_used;
+
+    /* name -> control index, built on the first amp_find_ctl() */
+    int *ctl_hash;
+    int *ctl_hash_next;
+    unsigned int ctl_hash_mask;
+
+    bool cb_registered;
+
     struct snd_value_enum tx_be_enum;
     struct snd_value_enum rx_be_enum;
 
@@ -217,17 +269,6 @@ struct amp_priv {
     pthread_mutex_t lock;
 };
 
-struct event_params_node {
-    uint32_t session_id;
-    struct listnode node;
-    struct agm_event_cb_params event_params;
-};
-
-struct mixer_plugin_event_data {
-    struct ctl_event ev;
-    struct listnode node;
-};
-
 static enum agm_media_format alsa_to_agm_fmt(int fmt)
 {
     enum agm_media_format agm_pcm_fmt = AGM_FORMAT_INVALID;
@@ -333,9 +374,21 @@ static void amp_free_pcm_dev_info(struct amp_priv *amp_priv)
 
 static void amp_free_ctls(struct amp_priv *amp_priv)
 {
-    if (amp_priv->ctl_names) {
-        free(amp_priv->ctl_names);
-        amp_priv->ctl_names = NULL;
+    if (amp_priv->ctl_name_pool) {
+        free(amp_priv->ctl_name_pool);
+        amp_priv->ctl_name_pool = NULL;
+    }
+    amp_priv->ctl_name_pool_size = 0;
+    amp_priv->ctl_name_pool_used = 0;
+
+    if (amp_priv->ctl_hash) {
+        free(amp_priv->ctl_hash);
+        amp_priv->ctl_hash = NULL;
+    }
+
+    if (amp_priv->ctl_hash_next) {
+        free(amp_priv->ctl_hash_next);
+        amp_priv->ctl_hash_next = NULL;
     }
 
     if (amp_priv->ctls) {
@@ -346,26 +399,204 @@ static void amp_free_ctls(struct amp_priv *amp_priv)
     amp_priv->ctl_count = 0;
 }
 
-static void amp_add_event_params(struct amp_priv *amp_priv,
-                                 uint32_t session_id,
-                                 struct agm_event_cb_params *event_params)
+static char *amp_intern_ctl_name(struct amp_priv *amp_priv,
+                const char *pname, const char *extn)
 {
-    struct event_params_node *event_node;
-    struct agm_event_cb_params *eparams;
-    uint32_t len = event_params->event_payload_size;
+    char *name;
+    size_t len = strlen(pname) + 1 + strlen(extn) + 1;
+
+    if (amp_priv->ctl_name_pool_used + len > amp_priv->ctl_name_pool_size) {
+        AGM_LOGE("%s: name pool exhausted for %s %s\n", __func__,
+                 pname, extn);
+        return "";
+    }
+
+    name = amp_priv->ctl_name_pool + amp_priv->ctl_name_pool_used;
+    snprintf(name, len, "%s %s", pname, extn);
+    amp_priv->ctl_name_pool_used += len;
+
+    return name;
+}
+
+static unsigned int amp_hash_name(const char *name)
+{
+    unsigned int hash = 2166136261u;
+
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static int amp_build_ctl_hash(struct amp_priv *amp_priv)
+{
+    unsigned int size = 1, bucket;
+    int i;
+
+    while (size < (unsigned int)amp_priv->ctl_count * AMP_CTL_HASH_LOAD)
+        size <<= 1;
+
+    amp_priv->ctl_hash = malloc(size * sizeof(*amp_priv->ctl_hash));
+    amp_priv->ctl_hash_next = malloc(amp_priv->ctl_count *
+                                     sizeof(*amp_priv->ctl_hash_next));
+    if (!amp_priv->ctl_hash || !amp_priv->ctl_hash_next) {
+        free(amp_priv->ctl_hash);
+        free(amp_priv->ctl_hash_next);
+        amp_priv->ctl_hash = NULL;
+        amp_priv->ctl_hash_next = NULL;
+        return -ENOMEM;
+    }
+
+    memset(amp_priv->ctl_hash, 0xff, size * sizeof(*amp_priv->ctl_hash));
+    amp_priv->ctl_hash_mask = size - 1;
+    for (i = 0; i < amp_priv->ctl_count; i++) {
+        bucket = amp_hash_name(amp_priv->ctls[i].name) &
+                 amp_priv->ctl_hash_mask;
+        amp_priv->ctl_hash_next[i] = amp_priv->ctl_hash[bucket];
+        amp_priv->ctl_hash[bucket] = i;
+    }
+
+    return 0;
+}
+
+/*
+ * Returns the control registered under name, or NULL.
+ * The hash is only built once something looks a control up, so opens
+ * that never do (most of them) do not pay for it. Called with lock held.
+ */
+static struct snd_control *amp_find_ctl(struct amp_priv *amp_priv,
+                const char *name)
+{
+    int i;
+
+    if (!amp_priv->ctl_hash && amp_build_ctl_hash(amp_priv)) {
+        for (i = 0; i < amp_priv->ctl_count; i++) {
+            if (!strcmp(amp_priv->ctls[i].name, name))
+                return &amp_priv->ctls[i];
+        }
+        return NULL;
+    }
+
+    i = amp_priv->ctl_hash[amp_hash_name(name) & amp_priv->ctl_hash_mask];
+    for (; i >= 0; i = amp_priv->ctl_hash_next[i]) {
+        if (!strcmp(amp_priv->ctls[i].name, name))
+            return &amp_priv->ctls[i];
+    }
+
+    return NULL;
+}
+
+/*
+ * Per node caches backing the "control" and "getParam" controls are
+ * allocated when a client first writes one of them, so nodes nobody
+ * touches cost nothing beyond their control entries.
+ */
+static int *amp_get_mtd_ctl_cache(struct amp_dev_info *adi, bool alloc)
+{
+    if (!adi->pcm_mtd_ctl && alloc)
+        adi->pcm_mtd_ctl = calloc(adi->count, sizeof(*adi->pcm_mtd_ctl));
+
+    return adi->pcm_mtd_ctl;
+}
+
+static struct amp_get_param_info *amp_get_param_cache(
+                struct amp_dev_info *adi, int idx, bool alloc)
+{
+    if (idx < 0 || idx >= adi->count)
+        return NULL;
+
+    if (!adi->get_param_info && alloc)
+        adi->get_param_info = calloc(adi->count,
+                                     sizeof(*adi->get_param_info));
+
+    return adi->get_param_info ? &adi->get_param_info[idx] : NULL;
+}
 
-    event_node = calloc(1, sizeof(struct event_params_node) + len);
-    if (!event_node)
+static void amp_event_rec_release(struct amp_event_rec *rec)
+{
+    if (rec->params && rec->params != (void *)rec->storage)
+        free(rec->params);
+    rec->params = NULL;
+    rec->notify_pending = false;
+    rec->params_pending = false;
+}
+
+/* drop fully consumed records off the head; called with lock held */
+static void amp_event_ring_trim_l(struct amp_event_ring *ring)
+{
+    struct amp_event_rec *rec;
+
+    while (ring->count) {
+        rec = &ring->recs[ring->head];
+        if (rec->notify_pending || rec->params_pending)
+            break;
+        amp_event_rec_release(rec);
+        ring->head = (ring->head + 1) % AMP_EVENT_RING_SIZE;
+        ring->count--;
+    }
+}
+
+static void amp_event_ring_reset_l(struct amp_event_ring *ring)
+{
+    int i;
+
+    if (!ring->recs)
         return;
 
-    event_node->session_id = session_id;
-    eparams = &event_node->event_params;
-    eparams->source_module_id = event_params->source_module_id;
-    eparams->event_id = event_params->event_id;
-    eparams->event_payload_size = len;
+    for (i = 0; i < AMP_EVENT_RING_SIZE; i++)
+        amp_event_rec_release(&ring->recs[i]);
+    ring->head = 0;
+    ring->count = 0;
+}
+
+/* called with lock held */
+static struct amp_event_rec *amp_event_ring_push_l(struct amp_event_ring *ring,
+                struct snd_control *ctl, uint32_t session_id,
+                struct agm_event_cb_params *event_params)
+{
+    struct amp_event_rec *rec;
+    uint32_t len = event_params->event_payload_size;
+
+    if (!ring->recs)
+        return NULL;
+
+    ring->num_events++;
+    amp_event_ring_trim_l(ring);
+    if (ring->count == AMP_EVENT_RING_SIZE) {
+        /* reader is behind, newer events win */
+        amp_event_rec_release(&ring->recs[ring->head]);
+        ring->head = (ring->head + 1) % AMP_EVENT_RING_SIZE;
+        ring->count--;
+        ring->num_dropped++;
+        AGM_LOGV("%s: event ring full, dropped oldest (%llu so far)\n",
+                 __func__, (unsigned long long)ring->num_dropped);
+    }
+
+    rec = &ring->recs[(ring->head + ring->count) % AMP_EVENT_RING_SIZE];
+    if (len <= AMP_EVENT_PAYLOAD_MAX) {
+        rec->params = (struct agm_event_cb_params *)rec->storage;
+    } else {
+        ring->num_oversized++;
+        rec->params = malloc(sizeof(*rec->params) + len);
+        if (!rec->params) {
+            ring->num_dropped++;
+            return NULL;
+        }
+    }
+
+    rec->ctl = ctl;
+    rec->session_id = session_id;
+    rec->params->source_module_id = event_params->source_module_id;
+    rec->params->event_id = event_params->event_id;
+    rec->params->event_payload_size = len;
+    memcpy(rec->params->event_payload, event_params->event_payload, len);
+    rec->notify_pending = true;
+    rec->params_pending = true;
+    ring->count++;
 
-    memcpy(&eparams->event_payload, &event_params->event_payload, len);
-    list_add_tail(&amp_priv->events_paramlist, &event_node->node);
+    return rec;
 }
 
 void amp_event_cb(uint32_t session_id, struct agm_event_cb_params *event_params,
@@ -373,13 +604,8 @@ void amp_event_cb(uint32_t session_id, struct agm_event_cb_params *event_params,
 {
     struct mixer_plugin *plugin = client_data;
     struct amp_priv *amp_priv;
-    struct ctl_event event;
-    struct mixer_plugin_event_data *data;
-    char *stream = NULL;
-    char *ctl_name = "event";
-    char *mixer_str = NULL;
-    int ctl_len, i;
-    struct amp_dev_info *adi = NULL;
+    struct amp_event_rec *rec = NULL;
+    struct snd_control *ctl;
 
     if (!plugin)
         return;
@@ -391,56 +617,17 @@ void amp_event_cb(uint32_t session_id, struct agm_event_cb_params *event_params,
     if (!amp_priv)
         return;
 
-    /* Get device node name
-     * Check Rx device nodes followed by Tx.
-     */
-    adi = &amp_priv->rx_pcm_devs;
-    for (i = 0; i < adi->count; i++) {
-        if(adi->idx_arr[i] == session_id) {
-            stream = adi->names[i];
-            goto found;
-        }
-    }
-
-    adi = &amp_priv->tx_pcm_devs;
-    for (i = 0; i < adi->count; i++) {
-        if(adi->idx_arr[i] == session_id) {
-            stream = adi->names[i];
-            goto found;
-        }
-    }
-
-    if (!stream)
-        return;
-found:
     pthread_mutex_lock(&amp_priv->lock);
-    amp_add_event_params(amp_priv, session_id, event_params);
-    event.type = SNDRV_CTL_EVENT_ELEM;
-    ctl_len = (int)(strlen(stream) + 1 + strlen(ctl_name) + 1);
-    mixer_str = calloc(1, ctl_len);
-    if (!mixer_str) {
-        pthread_mutex_unlock(&amp_priv->lock);
-        return;
+    if (session_id < (uint32_t)amp_priv->event_ctl_map_size) {
+        ctl = amp_priv->event_ctl_map[session_id];
+        if (ctl)
+            rec = amp_event_ring_push_l(&amp_priv->events, ctl,
+                                        session_id, event_params);
     }
-
-    snprintf(mixer_str, ctl_len, "%s %s", stream, ctl_name);
-    strlcpy((char*)event.data.elem.id.name, mixer_str, sizeof(event.data.elem.id.name));
-
-    data = calloc(1, sizeof(struct mixer_plugin_event_data));
-    if (!data) {
-        pthread_mutex_unlock(&amp_priv->lock);
-        goto done;
-    }
-
-    data->ev = event;
-    list_add_tail(&amp_priv->events_list, &data->node);
     pthread_mutex_unlock(&amp_priv->lock);
 
-    if (amp_priv->event_cb)
+    if (rec && amp_priv->event_cb)
         amp_priv->event_cb(plugin);
-
-done:
-    free(mixer_str);
 }
 
 static void amp_copy_be_names_from_aif_list(struct aif_info *aif_list,
@@ -770,6 +957,52 @@ done:
     return ret;
 }
 
+static int amp_create_event_ctl_map(struct amp_priv *amp_priv)
+{
+    struct amp_dev_info *adis[] = {
+        &amp_priv->rx_pcm_devs, &amp_priv->tx_pcm_devs,
+    };
+    struct snd_control **map;
+    char name[AIF_NAME_MAX_LEN + 16];
+    int i, idx, size = 0;
+
+    for (i = 0; i < (int)ARRAY_SIZE(adis); i++) {
+        for (idx = 1; idx < adis[i]->count; idx++) {
+            if (adis[i]->idx_arr[idx] >= size)
+                size = adis[i]->idx_arr[idx] + 1;
+        }
+    }
+
+    map = calloc(size ? size : 1, sizeof(*map));
+    if (!map)
+        return -ENOMEM;
+
+    pthread_mutex_lock(&amp_priv->lock);
+    for (i = 0; i < (int)ARRAY_SIZE(adis); i++) {
+        for (idx = 1; idx < adis[i]->count; idx++) {
+            if (adis[i]->idx_arr[idx] < 0)
+                continue;
+            snprintf(name, sizeof(name), "%s %s", adis[i]->names[idx],
+                     amp_pcm_ctl_name_extn[PCM_CTL_NAME_EVENT]);
+            map[adis[i]->idx_arr[idx]] = amp_find_ctl(amp_priv, name);
+        }
+    }
+    amp_priv->event_ctl_map = map;
+    amp_priv->event_ctl_map_size = size;
+    pthread_mutex_unlock(&amp_priv->lock);
+
+    return 0;
+}
+
+static void amp_free_event_ctl_map(struct amp_priv *amp_priv)
+{
+    pthread_mutex_lock(&amp_priv->lock);
+    free(amp_priv->event_ctl_map);
+    amp_priv->event_ctl_map = NULL;
+    amp_priv->event_ctl_map_size = 0;
+    pthread_mutex_unlock(&amp_priv->lock);
+}
+
 static void amp_register_event_callback(struct mixer_plugin *plugin, int enable)
 {
     struct amp_priv *amp_priv = plugin->priv;
@@ -792,6 +1025,8 @@ static void amp_register_event_callback(struct mixer_plugin *plugin, int enable)
         session_id = tx_adi->idx_arr[idx];
         agm_session_register_cb(session_id, cb, AGM_EVENT_MODULE, plugin);
     }
+
+    amp_priv->cb_registered = !!enable;
 }
 
 static int amp_get_be_ctl_count(struct amp_priv *amp_priv)
@@ -847,6 +1082,59 @@ static int amp_get_pcm_ctl_count(struct amp_priv *amp_priv)
     return count;
 }
 
+static size_t amp_get_names_size(char **names, int start, int count,
+                char **extn, int num_extn)
+{
+    size_t size = 0, extn_size = 0;
+    int i;
+
+    /* "<node> <extn>" plus terminator for every extn */
+    for (i = 0; i < num_extn; i++)
+        extn_size += strlen(extn[i]) + 1;
+
+    for (i = start; i < count; i++)
+        size += (strlen(names[i]) + 1) * num_extn + extn_size;
+
+    return size;
+}
+
+static size_t amp_get_ctl_names_size(struct amp_priv *amp_priv)
+{
+    struct amp_dev_info *adis[] = {
+        &amp_priv->rx_be_devs, &amp_priv->tx_be_devs,
+    };
+    struct amp_dev_info *rx_adi = &amp_priv->rx_pcm_devs;
+    struct amp_dev_info *tx_adi = &amp_priv->tx_pcm_devs;
+    struct amp_be_group_info *grp_info = &amp_priv->group_be_devs;
+    size_t size = 0;
+    int i;
+
+    /* index 0 is the ZERO entry and has no controls */
+    for (i = 0; i < (int)ARRAY_SIZE(adis); i++)
+        size += amp_get_names_size(adis[i]->names, 1, adis[i]->count,
+                        amp_be_ctl_name_extn,
+                        (int)ARRAY_SIZE(amp_be_ctl_name_extn));
+
+    size += amp_get_names_size(grp_info->names, 0, grp_info->count,
+                        amp_group_be_ctl_name_extn,
+                        (int)ARRAY_SIZE(amp_group_be_ctl_name_extn));
+
+    size += amp_get_names_size(rx_adi->names, 1, rx_adi->count,
+                        amp_pcm_ctl_name_extn,
+                        (int)ARRAY_SIZE(amp_pcm_ctl_name_extn));
+    size += amp_get_names_size(rx_adi->names, 1, rx_adi->count,
+                        amp_pcm_rx_ctl_names,
+                        (int)ARRAY_SIZE(amp_pcm_rx_ctl_names));
+    size += amp_get_names_size(tx_adi->names, 1, tx_adi->count,
+                        amp_pcm_ctl_name_extn,
+                        (int)ARRAY_SIZE(amp_pcm_ctl_name_extn));
+    size += amp_get_names_size(tx_adi->names, 1, tx_adi->count,
+                        amp_pcm_tx_ctl_names,
+                        (int)ARRAY_SIZE(amp_pcm_tx_ctl_names));
+
+    return size;
+}
+
 static int amp_pcm_get_control_value(struct amp_priv *amp_priv __unused,
                 int pcm_idx, struct amp_dev_info *pcm_adi)
 {
@@ -864,6 +1152,10 @@ static int amp_pcm_get_control_value(struct amp_priv *amp_priv __unused,
         return -EINVAL;
     }
 
+    /* nothing written to "control" yet */
+    if (!pcm_adi->pcm_mtd_ctl)
+        return 0;
+
     return pcm_adi->pcm_mtd_ctl[mtd_idx];
 }
 
@@ -952,6 +1244,24 @@ static int amp_pcm_buf_info_put(struct mixer_plugin *plugin __unused,
     return 0;
 }
 
+static int amp_pcm_stats_get(struct mixer_plugin *plugin __unused,
+    struct snd_control *ctl, struct snd_ctl_elem_value *ev)
+{
+    struct agm_session_stats *stats;
+    int pcm_idx = ctl->private_value;
+
+    stats = (struct agm_session_stats *) ev->value.bytes.data;
+
+    return agm_session_get_stats(pcm_idx, stats);
+}
+
+static int amp_pcm_stats_put(struct mixer_plugin *plugin __unused,
+    struct snd_control *ctl __unused, struct snd_ctl_elem_value *ev __unused)
+{
+    /* counters are read only, they restart when the session is opened */
+    return -EINVAL;
+}
+
 static int amp_be_set_param_get(struct mixer_plugin *plugin __unused,
                 struct snd_control *ctl __unused, struct snd_ctl_tlv *ev __unused)
 {
@@ -1079,7 +1389,8 @@ static int amp_pcm_mtd_control_get(struct mixer_plugin *plugin __unused,
     struct amp_dev_info *pcm_adi = ctl->private_data;
     int idx    = ctl->private_value;
 
-    ev->value.enumerated.item[0] = pcm_adi->pcm_mtd_ctl[idx];
+    ev->value.enumerated.item[0] =
+            pcm_adi->pcm_mtd_ctl ? pcm_adi->pcm_mtd_ctl[idx] : 0;
 
     AGM_LOGV("%s: enter, val = %u\n", __func__,
             ev->value.enumerated.item[0]);
@@ -1091,10 +1402,15 @@ static int amp_pcm_mtd_control_put(struct mixer_plugin *plugin __unused,
 {
     struct amp_dev_info *pcm_adi = ctl->private_data;
     int idx = ctl->private_value;
+    int *mtd_ctl;
     unsigned int val;
 
+    mtd_ctl = amp_get_mtd_ctl_cache(pcm_adi, true);
+    if (!mtd_ctl)
+        return -ENOMEM;
+
     val = ev->value.enumerated.item[0];
-    pcm_adi->pcm_mtd_ctl[idx] = val;
+    mtd_ctl[idx] = val;
 
     AGM_LOGV("%s: value = %u\n", __func__, val);
     return 0;
@@ -1104,11 +1420,12 @@ static int amp_pcm_event_get(struct mixer_plugin *plugin,
                 struct snd_control *ctl, struct snd_ctl_tlv *tlv)
 {
     struct amp_priv *amp_priv = plugin->priv;
-    struct listnode *eparams_node, *temp;
-    struct event_params_node *event_node;
+    struct amp_event_ring *ring = &amp_priv->events;
+    struct amp_event_rec *rec;
     struct agm_event_cb_params *eparams;
     int session_id = ctl->private_value;
     uint32_t tlv_size, event_payload_size;
+    unsigned int i;
     void *payload;
     int ret = 0;
 
@@ -1123,23 +1440,22 @@ static int amp_pcm_event_get(struct mixer_plugin *plugin,
         return -EINVAL;
     }
     pthread_mutex_lock(&amp_priv->lock);
-    list_for_each_safe(eparams_node, temp, &amp_priv->events_paramlist) {
-        event_node = node_to_item(eparams_node, struct event_params_node, node);
-        if (event_node->session_id == session_id) {
-            eparams = &event_node->event_params;
-            event_payload_size = sizeof(struct agm_event_cb_params) + eparams->event_payload_size;
-            if (tlv_size < event_payload_size) {
-                AGM_LOGE("Expected %d size, received %d\n", event_payload_size, tlv_size);
-                ret = -EINVAL;
-                goto done;
-            }
-            memcpy(payload, eparams,
-                   sizeof(struct agm_event_cb_params)
-                   + eparams->event_payload_size);
-            list_remove(&event_node->node);
-            free(event_node);
+    for (i = 0; i < ring->count; i++) {
+        rec = &ring->recs[(ring->head + i) % AMP_EVENT_RING_SIZE];
+        if (!rec->params_pending || rec->session_id != session_id)
+            continue;
+
+        eparams = rec->params;
+        event_payload_size = sizeof(struct agm_event_cb_params) + eparams->event_payload_size;
+        if (tlv_size < event_payload_size) {
+            AGM_LOGE("Expected %d size, received %d\n", event_payload_size, tlv_size);
+            ret = -EINVAL;
             goto done;
         }
+        memcpy(payload, eparams, event_payload_size);
+        rec->params_pending = false;
+        amp_event_ring_trim_l(ring);
+        goto done;
     }
 
 done:
@@ -1320,6 +1636,7 @@ static int amp_pcm_get_acdb_tunnel_get(struct mixer_plugin *plugin ,
                 struct snd_control *ctl, struct snd_ctl_tlv *tlv)
 {
     struct amp_dev_info *pcm_adi = ctl->private_data;
+    struct amp_get_param_info *gpi;
     struct amp_dev_info *be_adi;
     void *payload;
     int pcm_idx = ctl->private_value;
@@ -1329,7 +1646,8 @@ static int amp_pcm_get_acdb_tunnel_get(struct mixer_plugin *plugin ,
 
     AGM_LOGV("%s: enter\n", __func__);
 
-    if (!pcm_adi->get_param_info[pcm_idx].get_param_payload) {
+    gpi = amp_get_param_cache(pcm_adi, pcm_idx, false);
+    if (!gpi || !gpi->get_param_payload) {
         AGM_LOGE("%s: put() for getParam not called\n", __func__);
         return -EINVAL;
     }
@@ -1337,21 +1655,20 @@ static int amp_pcm_get_acdb_tunnel_get(struct mixer_plugin *plugin ,
     payload = &tlv->tlv[0];
     tlv_size = tlv->length;
 
-    if (tlv_size < pcm_adi->get_param_info[pcm_idx].get_param_payload_size) {
+    if (tlv_size < gpi->get_param_payload_size) {
         AGM_LOGE("%s: Buffer size less than expected\n", __func__);
         return -EINVAL;
     }
 
-    memcpy(payload, pcm_adi->get_param_info[pcm_idx].get_param_payload,
-        pcm_adi->get_param_info[pcm_idx].get_param_payload_size);
+    memcpy(payload, gpi->get_param_payload, gpi->get_param_payload_size);
     ret = agm_get_params_from_acdb_tunnel(payload, &tlv_size);
 
     if (ret)
         AGM_LOGE("%s: failed err %d for %s\n", __func__, ret, ctl->name);
 
-    free(pcm_adi->get_param_info[pcm_idx].get_param_payload);
-    pcm_adi->get_param_info[pcm_idx].get_param_payload = NULL;
-    pcm_adi->get_param_info[pcm_idx].get_param_payload_size = 0;
+    free(gpi->get_param_payload);
+    gpi->get_param_payload = NULL;
+    gpi->get_param_payload_size = 0;
 
     return ret;
 }
@@ -1360,23 +1677,26 @@ static int amp_pcm_get_acdb_tunnel_put(struct mixer_plugin *plugin,
                 struct snd_control *ctl, struct snd_ctl_tlv *tlv)
 {
     struct amp_dev_info *pcm_adi = ctl->private_data;
+    struct amp_get_param_info *gpi;
     int pcm_idx = ctl->private_value;
     void *payload;
 
-    if (pcm_adi->get_param_info[pcm_idx].get_param_payload) {
-        free(pcm_adi->get_param_info[pcm_idx].get_param_payload);
-        pcm_adi->get_param_info[pcm_idx].get_param_payload = NULL;
+    gpi = amp_get_param_cache(pcm_adi, pcm_idx, true);
+    if (!gpi)
+        return -ENOMEM;
+
+    if (gpi->get_param_payload) {
+        free(gpi->get_param_payload);
+        gpi->get_param_payload = NULL;
     }
     payload = &tlv->tlv[0];
 
-    pcm_adi->get_param_info[pcm_idx].get_param_payload_size = tlv->length;
-    pcm_adi->get_param_info[pcm_idx].get_param_payload =
-        calloc(1, pcm_adi->get_param_info[pcm_idx].get_param_payload_size);
-    if (!pcm_adi->get_param_info[pcm_idx].get_param_payload)
+    gpi->get_param_payload_size = tlv->length;
+    gpi->get_param_payload = calloc(1, gpi->get_param_payload_size);
+    if (!gpi->get_param_payload)
         return -ENOMEM;
 
-    memcpy(pcm_adi->get_param_info[pcm_idx].get_param_payload, payload,
-        pcm_adi->get_param_info[pcm_idx].get_param_payload_size);
+    memcpy(gpi->get_param_payload, payload, gpi->get_param_payload_size);
 
     return 0;
 }
@@ -1448,6 +1768,7 @@ static int amp_pcm_get_param_get(struct mixer_plugin *plugin __unused,
                 struct snd_control *ctl, struct snd_ctl_tlv *tlv)
 {
     struct amp_dev_info *pcm_adi = ctl->private_data;
+    struct amp_get_param_info *gpi;
     void *payload;
     int pcm_idx;
     int idx = ctl->private_value;
@@ -1460,18 +1781,18 @@ static int amp_pcm_get_param_get(struct mixer_plugin *plugin __unused,
     tlv_size = tlv->length;
     pcm_idx = pcm_adi->idx_arr[idx];
 
-    if (!pcm_adi->get_param_info[idx].get_param_payload) {
+    gpi = amp_get_param_cache(pcm_adi, idx, false);
+    if (!gpi || !gpi->get_param_payload) {
         AGM_LOGE("%s: put() for getParam not called\n", __func__);
         return -EINVAL;
     }
 
-    if (tlv_size < pcm_adi->get_param_info[idx].get_param_payload_size) {
+    if (tlv_size < gpi->get_param_payload_size) {
         AGM_LOGE("%s: Buffer size less than expected\n", __func__);
         return -EINVAL;
     }
 
-    memcpy(payload, pcm_adi->get_param_info[idx].get_param_payload,
-                    pcm_adi->get_param_info[idx].get_param_payload_size);
+    memcpy(payload, gpi->get_param_payload, gpi->get_param_payload_size);
     ret = agm_session_get_params(pcm_idx, payload, tlv_size);
 
     if (ret == -EALREADY)
@@ -1480,9 +1801,9 @@ static int amp_pcm_get_param_get(struct mixer_plugin *plugin __unused,
     if (ret)
         AGM_LOGE("%s: failed err %d for %s\n", __func__, ret, ctl->name);
 
-    free(pcm_adi->get_param_info[idx].get_param_payload);
-    pcm_adi->get_param_info[idx].get_param_payload = NULL;
-    pcm_adi->get_param_info[idx].get_param_payload_size = 0;
+    free(gpi->get_param_payload);
+    gpi->get_param_payload = NULL;
+    gpi->get_param_payload_size = 0;
     errno = ret;
     return ret;
 }
@@ -1491,25 +1812,28 @@ static int amp_pcm_get_param_put(struct mixer_plugin *plugin __unused,
                 struct snd_control *ctl, struct snd_ctl_tlv *tlv)
 {
     struct amp_dev_info *pcm_adi = ctl->private_data;
+    struct amp_get_param_info *gpi;
     int idx = ctl->private_value;
     void *payload;
 
     AGM_LOGV("%s: enter\n", __func__);
 
-    if (pcm_adi->get_param_info[idx].get_param_payload) {
-        free(pcm_adi->get_param_info[idx].get_param_payload);
-        pcm_adi->get_param_info[idx].get_param_payload = NULL;
+    gpi = amp_get_param_cache(pcm_adi, idx, true);
+    if (!gpi)
+        return -ENOMEM;
+
+    if (gpi->get_param_payload) {
+        free(gpi->get_param_payload);
+        gpi->get_param_payload = NULL;
     }
     payload = &tlv->tlv[0];
-    pcm_adi->get_param_info[idx].get_param_payload_size = tlv->length;
+    gpi->get_param_payload_size = tlv->length;
 
-    pcm_adi->get_param_info[idx].get_param_payload = calloc(1,
-                                                         pcm_adi->get_param_info[idx].get_param_payload_size);
-    if (!pcm_adi->get_param_info[idx].get_param_payload)
+    gpi->get_param_payload = calloc(1, gpi->get_param_payload_size);
+    if (!gpi->get_param_payload)
         return -ENOMEM;
 
-    memcpy(pcm_adi->get_param_info[idx].get_param_payload, payload,
-                      pcm_adi->get_param_info[idx].get_param_payload_size);
+    memcpy(gpi->get_param_payload, payload, gpi->get_param_payload_size);
 
     return 0;
 }
@@ -1706,6 +2030,8 @@ static struct snd_value_tlv_bytes pcm_event_bytes =
     SND_VALUE_TLV_BYTES(128 * 1024, amp_pcm_event_get, amp_pcm_event_put);
 static struct snd_value_bytes pcm_buf_info_bytes =
     SND_VALUE_BYTES(512 - 16);
+static struct snd_value_bytes pcm_stats_bytes =
+    SND_VALUE_BYTES(sizeof(struct agm_session_stats));
 static struct snd_value_bytes pcm_write_datapath_params_bytes =
     SND_VALUE_BYTES(512 - 16);
 
@@ -1724,10 +2050,9 @@ static void amp_create_connect_ctl(struct amp_priv *amp_priv,
             int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, pname,
+                            amp_pcm_ctl_name_extn[PCM_CTL_NAME_CONNECT]);
 
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-             pname, amp_pcm_ctl_name_extn[PCM_CTL_NAME_CONNECT]);
     INIT_SND_CONTROL_ENUM(ctl, ctl_name, amp_pcm_aif_connect_get,
                     amp_pcm_aif_connect_put, e, pval, pdata);
 }
@@ -1737,10 +2062,9 @@ static void amp_create_disconnect_ctl(struct amp_priv *amp_priv,
             int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, pname,
+                            amp_pcm_ctl_name_extn[PCM_CTL_NAME_DISCONNECT]);
 
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-             pname, amp_pcm_ctl_name_extn[PCM_CTL_NAME_DISCONNECT]);
     INIT_SND_CONTROL_ENUM(ctl, ctl_name, amp_pcm_aif_connect_get,
                     amp_pcm_aif_connect_put, e, pval, pdata);
 }
@@ -1750,10 +2074,9 @@ static void amp_create_mtd_control_ctl(struct amp_priv *amp_priv,
                 int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, pname,
+                            amp_pcm_ctl_name_extn[PCM_CTL_NAME_MTD_CONTROL]);
 
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-             pname, amp_pcm_ctl_name_extn[PCM_CTL_NAME_MTD_CONTROL]);
     INIT_SND_CONTROL_ENUM(ctl, ctl_name, amp_pcm_mtd_control_get,
                     amp_pcm_mtd_control_put, e, pval, pdata);
 
@@ -1763,10 +2086,8 @@ static void amp_create_pcm_event_ctl(struct amp_priv *amp_priv,
                 char *name, int ctl_idx, int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
-
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-             name, amp_pcm_ctl_name_extn[PCM_CTL_NAME_EVENT]);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, name,
+                            amp_pcm_ctl_name_extn[PCM_CTL_NAME_EVENT]);
 
     INIT_SND_CONTROL_TLV_BYTES(ctl, ctl_name, pcm_event_bytes,
                     pval, pdata);
@@ -1776,10 +2097,8 @@ static void amp_create_pcm_metadata_ctl(struct amp_priv *amp_priv,
                 char *name, int ctl_idx, int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
-
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-             name, amp_pcm_ctl_name_extn[PCM_CTL_NAME_METADATA]);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, name,
+                            amp_pcm_ctl_name_extn[PCM_CTL_NAME_METADATA]);
 
     INIT_SND_CONTROL_TLV_BYTES(ctl, ctl_name, pcm_metadata_bytes,
                     pval, pdata);
@@ -1790,22 +2109,22 @@ static void amp_create_pcm_set_param_ctl(struct amp_priv *amp_priv,
                 bool istagged_setparam, bool is_acdb)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
+    char *ctl_name;
 
     if (!istagged_setparam) {
-        snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-             name, amp_pcm_ctl_name_extn[PCM_CTL_NAME_SET_PARAM]);
+        ctl_name = amp_intern_ctl_name(amp_priv, name,
+                        amp_pcm_ctl_name_extn[PCM_CTL_NAME_SET_PARAM]);
         INIT_SND_CONTROL_TLV_BYTES(ctl, ctl_name, pcm_setparam_bytes,
                     pval, pdata);
     } else {
         if (!is_acdb) {
-            snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-                 name, amp_pcm_ctl_name_extn[PCM_CTL_NAME_SET_PARAM_TAG]);
+            ctl_name = amp_intern_ctl_name(amp_priv, name,
+                            amp_pcm_ctl_name_extn[PCM_CTL_NAME_SET_PARAM_TAG]);
             INIT_SND_CONTROL_TLV_BYTES(ctl, ctl_name, pcm_setparamtag_bytes,
                         pval, pdata);
         } else {
-            snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-                 name, amp_pcm_ctl_name_extn[PCM_CTL_NAME_SET_PARAM_TAG_ACDB]);
+            ctl_name = amp_intern_ctl_name(amp_priv, name,
+                            amp_pcm_ctl_name_extn[PCM_CTL_NAME_SET_PARAM_TAG_ACDB]);
             INIT_SND_CONTROL_TLV_BYTES(ctl, ctl_name, pcm_setparamtagacdb_bytes,
                         pval, pdata);
         }
@@ -1817,10 +2136,9 @@ static void amp_create_pcm_get_param_ctl(struct amp_priv *amp_priv,
                 char *name, int ctl_idx, int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, name,
+                            amp_pcm_ctl_name_extn[PCM_CTL_NAME_GET_PARAM]);
 
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-         name, amp_pcm_ctl_name_extn[PCM_CTL_NAME_GET_PARAM]);
     INIT_SND_CONTROL_TLV_BYTES(ctl, ctl_name, pcm_getparam_bytes,
                 pval, pdata);
 
@@ -1830,10 +2148,8 @@ static void amp_create_pcm_get_tag_info_ctl(struct amp_priv *amp_priv,
                 char *name, int ctl_idx, int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
-
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-             name, amp_pcm_ctl_name_extn[PCM_CTL_NAME_GET_TAG_INFO]);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, name,
+                            amp_pcm_ctl_name_extn[PCM_CTL_NAME_GET_TAG_INFO]);
 
     INIT_SND_CONTROL_TLV_BYTES(ctl, ctl_name, pcm_taginfo_bytes,
                     pval, pdata);
@@ -1845,10 +2161,9 @@ static void amp_create_pcm_loopback_ctl(struct amp_priv *amp_priv,
             int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, pname,
+                            amp_pcm_tx_ctl_names[PCM_TX_CTL_NAME_LOOPBACK]);
 
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-             pname, amp_pcm_tx_ctl_names[PCM_TX_CTL_NAME_LOOPBACK]);
     INIT_SND_CONTROL_ENUM(ctl, ctl_name, amp_pcm_loopback_get,
                     amp_pcm_loopback_put, e, pval, pdata);
 }
@@ -1858,10 +2173,9 @@ static void amp_create_pcm_echoref_ctl(struct amp_priv *amp_priv,
             int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, pname,
+                            amp_pcm_tx_ctl_names[PCM_TX_CTL_NAME_ECHOREF]);
 
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-             pname, amp_pcm_tx_ctl_names[PCM_TX_CTL_NAME_ECHOREF]);
     INIT_SND_CONTROL_ENUM(ctl, ctl_name, amp_pcm_echoref_get,
                     amp_pcm_echoref_put, e, pval, pdata);
 }
@@ -1872,10 +2186,9 @@ static void amp_create_pcm_sidetone_ctl(struct amp_priv *amp_priv,
             int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, pname,
+                            amp_pcm_rx_ctl_names[PCM_RX_CTL_NAME_SIDETONE]);
 
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-             pname, amp_pcm_rx_ctl_names[PCM_RX_CTL_NAME_SIDETONE]);
     INIT_SND_CONTROL_ENUM(ctl, ctl_name, amp_pcm_sidetone_get,
                     amp_pcm_sidetone_put, e, pval, pdata);
 }
@@ -1885,10 +2198,8 @@ static void amp_create_pcm_calibration_ctl(struct amp_priv *amp_priv,
                 char *name, int ctl_idx, int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
-
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-             name, amp_pcm_ctl_name_extn[PCM_CTL_NAME_SET_CALIBRATION]);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, name,
+                            amp_pcm_ctl_name_extn[PCM_CTL_NAME_SET_CALIBRATION]);
 
     INIT_SND_CONTROL_BYTES(ctl, ctl_name, amp_pcm_calibration_get,
                     amp_pcm_calibration_put, pcm_calibration_bytes,
@@ -1899,10 +2210,8 @@ static void amp_create_pcm_buf_tstamp_ctl(struct amp_priv *amp_priv,
                 char *name, int ctl_idx, int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
-
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-             name, amp_pcm_tx_ctl_names[PCM_CTL_NAME_BUF_TSTAMP]);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, name,
+                            amp_pcm_tx_ctl_names[PCM_CTL_NAME_BUF_TSTAMP]);
 
     INIT_SND_CONTROL_BYTES(ctl, ctl_name, amp_pcm_buf_tstamp_get,
                     amp_pcm_buf_tstamp_put, pcm_buf_tstamp_bytes,
@@ -1913,24 +2222,32 @@ static void amp_create_pcm_bufinfo_ctl(struct amp_priv *amp_priv,
     char *name, int ctl_idx, int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
-
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-            name, amp_pcm_ctl_name_extn[PCM_CTL_NAME_BUF_INFO]);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, name,
+                            amp_pcm_ctl_name_extn[PCM_CTL_NAME_BUF_INFO]);
 
     INIT_SND_CONTROL_BYTES(ctl, ctl_name, amp_pcm_buf_info_get,
             amp_pcm_buf_info_put, pcm_buf_info_bytes,
             pval, pdata);
 }
 
-static void amp_create_pcm_write_with_metadata_ctl(struct amp_priv *amp_priv,
+static void amp_create_pcm_stats_ctl(struct amp_priv *amp_priv,
     char *name, int ctl_idx, int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, name,
+                            amp_pcm_ctl_name_extn[PCM_CTL_NAME_STATS]);
 
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-            name, amp_pcm_rx_ctl_names[PCM_RX_CTL_NAME_DATAPATH_PARAMS]);
+    INIT_SND_CONTROL_BYTES(ctl, ctl_name, amp_pcm_stats_get,
+            amp_pcm_stats_put, pcm_stats_bytes,
+            pval, pdata);
+}
+
+static void amp_create_pcm_write_with_metadata_ctl(struct amp_priv *amp_priv,
+    char *name, int ctl_idx, int pval, void *pdata)
+{
+    struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, name,
+                            amp_pcm_rx_ctl_names[PCM_RX_CTL_NAME_DATAPATH_PARAMS]);
 
     INIT_SND_CONTROL_BYTES(ctl, ctl_name, amp_pcm_write_datapath_params_get,
             amp_pcm_write_datapath_params_put, pcm_write_datapath_params_bytes,
@@ -1964,10 +2281,8 @@ static void amp_create_metadata_ctl(struct amp_priv *amp_priv,
                 char *be_name, int ctl_idx, int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
-
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-             be_name, amp_be_ctl_name_extn[BE_CTL_NAME_METADATA]);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, be_name,
+                            amp_be_ctl_name_extn[BE_CTL_NAME_METADATA]);
 
     INIT_SND_CONTROL_TLV_BYTES(ctl, ctl_name, be_metadata_bytes,
                     pval, pdata);
@@ -1977,10 +2292,9 @@ static void amp_create_media_fmt_ctl(struct amp_priv *amp_priv,
                 char *be_name, int ctl_idx, int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, be_name,
+                            amp_be_ctl_name_extn[BE_CTL_NAME_MEDIA_CONFIG]);
 
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-             be_name, amp_be_ctl_name_extn[BE_CTL_NAME_MEDIA_CONFIG]);
     INIT_SND_CONTROL_INTEGER(ctl, ctl_name, amp_be_media_fmt_get,
                     amp_be_media_fmt_put, media_fmt_int, pval, pdata);
 }
@@ -1989,10 +2303,9 @@ static void amp_create_be_set_param_ctl(struct amp_priv *amp_priv,
                 char *be_name, int ctl_idx, int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, be_name,
+                            amp_be_ctl_name_extn[BE_CTL_NAME_SET_PARAM]);
 
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-         be_name, amp_be_ctl_name_extn[BE_CTL_NAME_SET_PARAM]);
     INIT_SND_CONTROL_TLV_BYTES(ctl, ctl_name, be_setparam_bytes,
                 pval, pdata);
 }
@@ -2034,10 +2347,9 @@ static void amp_create_group_be_media_fmt_ctl(struct amp_priv *amp_priv,
                 char *group_be_name, int ctl_idx, int pval, void *pdata)
 {
     struct snd_control *ctl = AMP_PRIV_GET_CTL_PTR(amp_priv, ctl_idx);
-    char *ctl_name = AMP_PRIV_GET_CTL_NAME_PTR(amp_priv, ctl_idx);
+    char *ctl_name = amp_intern_ctl_name(amp_priv, group_be_name,
+                            amp_group_be_ctl_name_extn[BE_GROUP_CTL_NAME_MEDIA_CONFIG]);
 
-    snprintf(ctl_name, AIF_NAME_MAX_LEN + 16, "%s %s",
-             group_be_name, amp_group_be_ctl_name_extn[BE_GROUP_CTL_NAME_MEDIA_CONFIG]);
     INIT_SND_CONTROL_INTEGER(ctl, ctl_name, amp_group_be_media_fmt_get,
                     amp_group_be_media_fmt_put, group_media_fmt_int, pval, pdata);
 }
@@ -2060,16 +2372,6 @@ static int amp_form_common_pcm_ctls(struct amp_priv *amp_priv, int *ctl_idx,
 {
     int i;
 
-    pcm_adi->pcm_mtd_ctl = calloc(pcm_adi->count, sizeof(int));
-    if (!pcm_adi->pcm_mtd_ctl)
-        return -ENOMEM;
-
-    pcm_adi->get_param_info = (struct amp_get_param_info *)calloc(pcm_adi->count, sizeof(struct amp_get_param_info));
-    if (!pcm_adi->get_param_info) {
-        free(pcm_adi->pcm_mtd_ctl);
-        return -ENOMEM;
-    }
-
     for (i = 1; i < pcm_adi->count; i++) {
         char *name = pcm_adi->names[i];
         int idx = pcm_adi->idx_arr[i];
@@ -2097,6 +2399,8 @@ static int amp_form_common_pcm_ctls(struct amp_priv *amp_priv, int *ctl_idx,
                         i, pcm_adi);
         amp_create_pcm_bufinfo_ctl(amp_priv, name, (*ctl_idx)++,
                         idx, pcm_adi);
+        amp_create_pcm_stats_ctl(amp_priv, name, (*ctl_idx)++,
+                        idx, pcm_adi);
     }
 
     return 0;
@@ -2180,12 +2484,6 @@ static int amp_form_pcm_ctls(struct amp_priv *amp_priv, int ctl_idx, int ctl_cnt
 static int amp_form_acdb_ctls(struct amp_priv *amp_priv, int ctl_idx)
 {
     struct amp_dev_info *acdb_adi = &amp_priv->acdb_tunnels;
-    acdb_adi->get_param_info =
-        (struct amp_get_param_info *)calloc(acdb_adi->count,
-        sizeof(struct amp_get_param_info));
-
-    if (!acdb_adi->get_param_info)
-        return -ENOMEM;
 
     amp_create_acdb_tunnel_set_ctl(amp_priv, ctl_idx++, acdb_adi->idx_arr[0],
                                     acdb_adi);
@@ -2199,29 +2497,29 @@ static ssize_t amp_read_event(struct mixer_plugin *plugin,
                               struct ctl_event *ev, size_t size)
 {
     struct amp_priv *amp_priv = plugin->priv;
+    struct amp_event_ring *ring = &amp_priv->events;
+    struct amp_event_rec *rec;
     ssize_t result = 0;
+    unsigned int i;
 
-    while (size >= sizeof(struct ctl_event)) {
-        struct mixer_plugin_event_data *data;
-
-        pthread_mutex_lock(&amp_priv->lock);
-        if (list_empty(&amp_priv->events_list)) {
-            pthread_mutex_unlock(&amp_priv->lock);
-            return result;
-        }
-
-        data = node_to_item(amp_priv->events_list.next,
-                            struct mixer_plugin_event_data, node);
-        memcpy(ev, &data->ev, sizeof(struct ctl_event));
+    pthread_mutex_lock(&amp_priv->lock);
+    for (i = 0; i < ring->count && size >= sizeof(struct ctl_event); i++) {
+        rec = &ring->recs[(ring->head + i) % AMP_EVENT_RING_SIZE];
+        if (!rec->notify_pending)
+            continue;
 
-        list_remove(&data->node);
-        free(data);
-        pthread_mutex_unlock(&amp_priv->lock);
+        memset(ev, 0, sizeof(struct ctl_event));
+        ev->type = SNDRV_CTL_EVENT_ELEM;
+        strlcpy((char *)ev->data.elem.id.name, rec->ctl->name,
+                sizeof(ev->data.elem.id.name));
+        rec->notify_pending = false;
 
-        ev += sizeof(struct ctl_event);
+        ev++;
         size -= sizeof(struct ctl_event);
         result += sizeof(struct ctl_event);
     }
+    amp_event_ring_trim_l(ring);
+    pthread_mutex_unlock(&amp_priv->lock);
 
     return result;
 }
@@ -2230,27 +2528,48 @@ static int amp_subscribe_events(struct mixer_plugin *plugin,
                                   event_callback event_cb)
 {
     struct amp_priv *amp_priv = plugin->priv;
-    struct listnode *eparams_node, *ev_node, *temp, *temp2;
-    struct event_params_node *event_node;
-    struct mixer_plugin_event_data *ev_data;
+    struct amp_event_ring *ring = &amp_priv->events;
+    struct amp_event_rec *recs;
 
     AGM_LOGV("%s: enter\n", __func__);
 
     amp_priv->event_cb = event_cb;
 
-    /* clear all event params on unsubscribe */
-    if (event_cb == NULL) {
-        list_for_each_safe(eparams_node, temp, &amp_priv->events_paramlist) {
-            event_node = node_to_item(eparams_node, struct event_params_node, node);
-            list_remove(&event_node->node);
-            free(event_node);
+    /*
+     * Module events are only delivered to subscribed clients, so the
+     * per session callbacks, the session map and the event ring are
+     * only set up here rather than at open, where they would cost two
+     * AGM calls per pcm for every mixer_open.
+     */
+    if (event_cb && !amp_priv->cb_registered) {
+        if (!ring->recs) {
+            recs = calloc(AMP_EVENT_RING_SIZE, sizeof(*recs));
+            if (!recs)
+                return -ENOMEM;
+            pthread_mutex_lock(&amp_priv->lock);
+            ring->recs = recs;
+            pthread_mutex_unlock(&amp_priv->lock);
         }
+        if (amp_create_event_ctl_map(amp_priv))
+            return -ENOMEM;
+        amp_register_event_callback(plugin, 1);
+    } else if (!event_cb && amp_priv->cb_registered) {
+        amp_register_event_callback(plugin, 0);
+        amp_free_event_ctl_map(amp_priv);
+    }
 
-        list_for_each_safe(ev_node, temp2, &amp_priv->events_list) {
-            ev_data = node_to_item(ev_node, struct mixer_plugin_event_data, node);
-            list_remove(&ev_data->node);
-            free(ev_data);
-        }
+    /* clear all pending events on unsubscribe */
+    if (event_cb == NULL) {
+        pthread_mutex_lock(&amp_priv->lock);
+        if (ring->num_dropped)
+            AGM_LOGI("%s: %llu of %llu events dropped, %llu oversized\n",
+                     __func__, (unsigned long long)ring->num_dropped,
+                     (unsigned long long)ring->num_events,
+                     (unsigned long long)ring->num_oversized);
+        amp_event_ring_reset_l(ring);
+        free(ring->recs);
+        ring->recs = NULL;
+        pthread_mutex_unlock(&amp_priv->lock);
     }
     return 0;
 }
@@ -2263,7 +2582,6 @@ static void amp_close(struct mixer_plugin **plugin)
     /* unblock mixer event during close */
     if (amp_priv->event_cb)
         amp_priv->event_cb(amp);
-    amp_register_event_callback(amp, 0);
     amp_subscribe_events(amp, NULL);
     snd_card_def_put_card(amp_priv->card_node);
     amp_free_pcm_dev_info(amp_priv);
@@ -2351,8 +2669,9 @@ MIXER_PLUGIN_OPEN_FN(agm_mixer_plugin)
      * exactly the same number of controls as of total_ctl_cnt;
      */
     amp_priv->ctls = calloc(total_ctl_cnt, sizeof(*amp_priv->ctls));
-    amp_priv->ctl_names = calloc(total_ctl_cnt, sizeof(*amp_priv->ctl_names));
-    if (!amp_priv->ctls || !amp_priv->ctl_names)
+    amp_priv->ctl_name_pool_size = amp_get_ctl_names_size(amp_priv);
+    amp_priv->ctl_name_pool = malloc(amp_priv->ctl_name_pool_size);
+    if (!amp_priv->ctls || !amp_priv->ctl_name_pool)
             goto err_ctls_alloc;
 
     ret = amp_form_be_ctls(amp_priv, 0, be_ctl_cnt);
@@ -2384,11 +2703,9 @@ MIXER_PLUGIN_OPEN_FN(agm_mixer_plugin)
     amp->priv = amp_priv;
     *plugin = amp;
 
-    amp_register_event_callback(amp, 1);
-    list_init(&amp_priv->events_paramlist);
-    list_init(&amp_priv->events_list);
     pthread_mutex_init(&amp_priv->lock, (const pthread_mutexattr_t *) NULL);
-    AGM_LOGV("%s: total_ctl_cnt = %d\n", __func__, total_ctl_cnt);
+    AGM_LOGV("%s: total_ctl_cnt = %d, names %zu bytes\n", __func__,
+             total_ctl_cnt, amp_priv->ctl_name_pool_size);
 
     return 0;
 
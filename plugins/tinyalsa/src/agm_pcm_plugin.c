@@ -33,6 +33,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <linux/ioctl.h>
+#include <poll.h>
 #include <sys/time.h>
 #include <sys/mman.h>
 #include <sound/asound.h>
@@ -46,6 +47,11 @@
 #include <snd-card-def.h>
 #include <tinyalsa/asoundlib.h>
 #include <agm/utils.h>
+#include "agm_pcm_coalesce.h"
+#include "agm_pcm_convert.h"
+#include "agm_pcm_pos.h"
+#include "agm_pcm_stats.h"
+#include "agm_pcm_timer.h"
 #ifdef DYNAMIC_LOG_ENABLED
 #include <log_xml_parser.h>
 #define LOG_MASK AGM_MOD_FILE_AGM_PCM_PLUGIN
@@ -56,25 +62,18 @@
 #define PCM_MASK_SIZE (2)
 #define PCM_FORMAT_BIT(x) ((uint64_t)1 << x)
 
-/* pull-push mode macros */
-#define AGM_PULL_PUSH_IDX_RETRY_COUNT 2
-#define AGM_PULL_PUSH_FRAME_CNT_RETRY_COUNT 5
-
 /* multiplier of timeout for wating for mmap buffers */
 #define MMAP_TOUT_MULTI 4
 
-struct agm_shared_pos_buffer {
-    volatile uint32_t frame_counter;
-    volatile uint32_t read_index;
-    volatile uint32_t wall_clock_us_lsw;
-    volatile uint32_t wall_clock_us_msw;
-};
+/* torn position reads: retries, first backoff doubling every retry */
+#define AGM_POS_READ_RETRY_COUNT 6
+#define AGM_POS_READ_BACKOFF_US 5
 
 struct pcm_plugin_pos_buf_info {
     void *pos_buf_addr;
     unsigned int boundary;       /* pcm boundary */
     snd_pcm_uframes_t hw_ptr;    /* RO: hw ptr (0...boundary-1) */
-    snd_pcm_uframes_t hw_ptr_base;
+    snd_pcm_uframes_t sample_hw_ptr; /* hw ptr at the last DSP update */
     struct timespec tstamp;
     snd_pcm_uframes_t appl_ptr;  /* RW: appl ptr (0...boundary-1) */
     snd_pcm_uframes_t avail_min; /* RW: min available frames for wakeup */
@@ -101,7 +100,22 @@ struct agm_pcm_priv {
     /* idx: 0: out port, 1: in port */
     struct agm_mmap_buffer_port mmap_buffer_port[2];
     bool mmap_status;
-    uint32_t mmap_buf_tout;
+    /* time spent waiting for a period in poll, in us */
+    uint64_t mmap_buf_tout;
+    /* armed for the next predicted period boundary in poll */
+    struct agm_pcm_timer timer;
+    /* graph format from the card def, -1/0 when not given */
+    int native_fmt;
+    uint32_t native_channels;
+    /* client <-> graph conversion, NULL while the two match */
+    struct agm_pcm_convert *cvt;
+    void *cvt_buf;
+    size_t cvt_buf_size;
+    /* playback write aggregation, NULL unless write_coalesce_ms is set */
+    struct agm_pcm_coalesce *coalesce;
+    /* xruns, timeouts and position gaps, reported to the session */
+    struct agm_pcm_stats stats;
+    struct pcm_plugin_hw_constraints constrs;
 };
 
 struct pcm_plugin_hw_constraints agm_pcm_constrs = {
@@ -203,6 +217,46 @@ static enum agm_media_format alsa_to_agm_format(int format)
     };
 }
 
+static int alsa_to_cvt_format(int format, enum agm_pcm_cvt_format *fmt)
+{
+    switch (format) {
+    case SNDRV_PCM_FORMAT_S16_LE:
+        *fmt = AGM_PCM_CVT_S16;
+        break;
+    case SNDRV_PCM_FORMAT_S24_3LE:
+        *fmt = AGM_PCM_CVT_S24_3LE;
+        break;
+    case SNDRV_PCM_FORMAT_S24_LE:
+        *fmt = AGM_PCM_CVT_S24_LE;
+        break;
+    case SNDRV_PCM_FORMAT_S32_LE:
+        *fmt = AGM_PCM_CVT_S32;
+        break;
+    case SNDRV_PCM_FORMAT_FLOAT_LE:
+        *fmt = AGM_PCM_CVT_FLOAT;
+        break;
+    default:
+        return -EINVAL;
+    };
+
+    return 0;
+}
+
+static enum agm_media_format cvt_to_agm_format(enum agm_pcm_cvt_format fmt)
+{
+    switch (fmt) {
+    case AGM_PCM_CVT_S24_3LE:
+        return AGM_FORMAT_PCM_S24_3LE;
+    case AGM_PCM_CVT_S24_LE:
+        return AGM_FORMAT_PCM_S24_LE;
+    case AGM_PCM_CVT_S32:
+        return AGM_FORMAT_PCM_S32_LE;
+    default:
+    case AGM_PCM_CVT_S16:
+        return AGM_FORMAT_PCM_S16_LE;
+    };
+}
+
 static enum agm_media_format param_get_mask_val(struct snd_pcm_hw_params *p,
                                         int n)
 {
@@ -281,110 +335,118 @@ static snd_pcm_uframes_t agm_pcm_plugin_get_hw_ptr(struct agm_pcm_priv *priv)
     return pos->hw_ptr;
 }
 
-static int agm_pcm_plugin_get_shared_pos(struct pcm_plugin_pos_buf_info *pos_buf,
-        uint32_t *read_index, uint32_t *wall_clk_msw,
-        uint32_t *wall_clk_lsw)
+static uint64_t agm_pcm_timespec_to_us(struct timespec *ts)
 {
-    struct agm_shared_pos_buffer *buf;
-    int i, j;
-    uint32_t frame_cnt1, frame_cnt2;
+    return (uint64_t)ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+}
 
-    buf = (struct agm_shared_pos_buffer *)pos_buf->pos_buf_addr;
-    for (i = 0; i < AGM_PULL_PUSH_IDX_RETRY_COUNT; ++i) {
-        for (j = 0; j < AGM_PULL_PUSH_FRAME_CNT_RETRY_COUNT; ++j) {
-            frame_cnt1 = buf->frame_counter;
-            if (frame_cnt1 != 0)
-                break;
-        }
-        *wall_clk_msw = buf->wall_clock_us_msw;
-        *wall_clk_lsw = buf->wall_clock_us_lsw;
-        *read_index = buf->read_index; /* 0,.... Circ_buf_size-1 */
-        frame_cnt2 = buf->frame_counter;
+/*
+ * Read a consistent (read_index, wall clock) sample. A torn read means the
+ * DSP is writing right now, so back off a little longer on every retry.
+ */
+static int agm_pcm_plugin_read_shared_pos(struct agm_pcm_priv *priv,
+        uint32_t *read_index, uint32_t *wall_clk_msw, uint32_t *wall_clk_lsw)
+{
+    struct timespec backoff;
+    int ret = 0;
+    int i;
 
-        if (frame_cnt1 != frame_cnt2)
-            continue;
+    for (i = 0; i < AGM_POS_READ_RETRY_COUNT; i++) {
+        ret = agm_pcm_get_shared_pos(priv->pos_buf->pos_buf_addr,
+                read_index, wall_clk_msw, wall_clk_lsw);
+        if (ret != -EAGAIN)
+            break;
 
-        return 0;
+        backoff.tv_sec = 0;
+        backoff.tv_nsec = (AGM_POS_READ_BACKOFF_US << i) * 1000;
+        nanosleep(&backoff, NULL);
     }
 
-    return -EAGAIN;
+    if (ret)
+        AGM_LOGE("%s: no consistent position after %d reads\n",
+                 __func__, AGM_POS_READ_RETRY_COUNT);
+
+    return ret;
 }
 
+/*
+ * hw_ptr is estimated from the last consistent DSP sample: the exact
+ * read_index, unwrapped with the DSP wall clock delta to the previous
+ * sample, plus the frames played since then at the stream rate on the
+ * DSP clock (CLOCK_MONOTONIC translated with the tracked offset). The
+ * extrapolation is capped at one period so hw_ptr never runs more than
+ * one DSP update ahead, and hw_ptr never moves backwards. Capture stays
+ * at the DSP sample: frames past it have not been written yet.
+ */
 static int agm_pcm_plugin_update_hw_ptr(struct agm_pcm_priv *priv)
 {
-    int retries = 10;
-    snd_pcm_sframes_t circ_buf_pos;
-    snd_pcm_uframes_t pos, old_hw_ptr, new_hw_ptr, hw_base;
+    struct pcm_plugin_pos_buf_info *pos_buf = priv->pos_buf;
+    snd_pcm_uframes_t pos, old_pos, advance, sample_hw_ptr, new_hw_ptr;
+    snd_pcm_uframes_t total = priv->total_size_frames;
     uint32_t read_index, wall_clk_msw, wall_clk_lsw;
-    int64_t delta_wall_clk_us = 0;
-    uint32_t delta_wall_clk_frames = 0;
+    uint32_t rate = priv->media_config->rate;
+    uint64_t dsp_wall_clk, cached_wall_clk, now_us, expected, extra = 0;
+    bool new_pos_update;
     int ret = 0;
-    uint32_t period_size = priv->period_size; /** in frames */
-    uint32_t crossed_boundary = 0;
-
-    do {
-        ret = agm_pcm_plugin_get_shared_pos(priv->pos_buf,
-                &read_index, &wall_clk_msw, &wall_clk_lsw);
-    } while (ret == -EAGAIN && --retries);
-
-    if (ret == 0) {
-        circ_buf_pos = agm_pcm_bytes_to_frames(read_index, priv->media_config);
-        pos = (circ_buf_pos / period_size) * period_size;
-        old_hw_ptr = agm_pcm_plugin_get_hw_ptr(priv);
-        hw_base = priv->pos_buf->hw_ptr_base;
-        new_hw_ptr = hw_base + pos;
-
-        // Set delta_wall_clk_us only if cached wall clk is non-zero
-        if (priv->pos_buf->wall_clk_msw || priv->pos_buf->wall_clk_lsw) {
-            uint64_t dsp_wall_clk =  (((uint64_t)wall_clk_msw) << 32 | wall_clk_lsw);
-            uint64_t cached_wall_clk = (((uint64_t)priv->pos_buf->wall_clk_msw) << 32 |
-                                         priv->pos_buf->wall_clk_lsw);
-            //Compute delta only if diff is greater than zero
-            if (dsp_wall_clk > cached_wall_clk) {
-                delta_wall_clk_us = (int64_t)(dsp_wall_clk - cached_wall_clk);
+
+    ret = agm_pcm_plugin_read_shared_pos(priv, &read_index,
+                                         &wall_clk_msw, &wall_clk_lsw);
+    if (ret)
+        return ret;
+
+    clock_gettime(CLOCK_MONOTONIC, &pos_buf->tstamp);
+    now_us = agm_pcm_timespec_to_us(&pos_buf->tstamp);
+
+    dsp_wall_clk = ((uint64_t)wall_clk_msw) << 32 | wall_clk_lsw;
+    cached_wall_clk = ((uint64_t)pos_buf->wall_clk_msw) << 32 |
+                      pos_buf->wall_clk_lsw;
+    new_pos_update = (dsp_wall_clk != cached_wall_clk);
+
+    pos = agm_pcm_bytes_to_frames(read_index, priv->media_config) % total;
+    sample_hw_ptr = pos_buf->sample_hw_ptr;
+
+    if (new_pos_update) {
+        old_pos = sample_hw_ptr % total;
+        advance = (pos + total - old_pos) % total;
+
+        // Whole loops of the shared buffer the read index went through
+        // since the previous sample, from the wall clock delta
+        if (cached_wall_clk && dsp_wall_clk > cached_wall_clk) {
+            expected = (dsp_wall_clk - cached_wall_clk) * rate / 1000000;
+            if (expected > advance + total / 2) {
+                advance += ((expected - advance + total / 2) / total) * total;
+                AGM_LOGD("%s: read index wrapped, %lu frames in %llu us\n",
+                         __func__, advance,
+                         (unsigned long long)(dsp_wall_clk - cached_wall_clk));
             }
         }
-        // Identify the number of times of shared buffer length that the
-        // hw ptr has jumped through by checking wall clock time delta
-        // and assuming read ptr moved at a constant rate
-        if (delta_wall_clk_us > 0 ) {
-            delta_wall_clk_frames = ((delta_wall_clk_us / 1000000)
-                                        * (priv->media_config->rate)
-                                        * priv->media_config->channels);
-            crossed_boundary = delta_wall_clk_frames / priv->total_size_frames;
-        }
 
-        // More than 1 loop of shared buffer completed by hw_ptr
-        // No need to check if new_hw_ptr < old_hw_ptr, as new_hw_ptr
-        // has crossed old_hw_ptr atleast once if not more
-        if (crossed_boundary > 0) {
-            hw_base += (crossed_boundary * priv->total_size_frames);
-            if (hw_base >= priv->pos_buf->boundary)
-                hw_base = 0;
-            new_hw_ptr = hw_base + pos;
-            priv->pos_buf->hw_ptr_base = hw_base;
-            AGM_LOGD("%s: crossed_boundary = %u, new_hw_ptr=%ld \n",
-                                                __func__, crossed_boundary, new_hw_ptr);
-            AGM_LOGD("%s: delta_wall_clk_frames = %lx, delta_wall_clk_us=%ld \n",
-                                                __func__, delta_wall_clk_frames, delta_wall_clk_us);
-            AGM_LOGD("%s: shared buffer length = %lx \n",
-                                                __func__, priv->total_size_frames);
-        } else {
-            if (new_hw_ptr < old_hw_ptr) {
-                hw_base += priv->total_size_frames;
-                if (hw_base >= priv->pos_buf->boundary)
-                    hw_base = 0;
-                new_hw_ptr = hw_base + pos;
-                priv->pos_buf->hw_ptr_base = hw_base;
-            }
+        sample_hw_ptr = (sample_hw_ptr + advance) % pos_buf->boundary;
+        pos_buf->sample_hw_ptr = sample_hw_ptr;
+        pos_buf->wall_clk_lsw = wall_clk_lsw;
+        pos_buf->wall_clk_msw = wall_clk_msw;
+        if (dsp_wall_clk) {
+            agm_pcm_timer_sync(&priv->timer, now_us, dsp_wall_clk);
+            agm_pcm_stats_pos_update(&priv->stats, dsp_wall_clk);
         }
+    }
 
-        priv->pos_buf->hw_ptr = new_hw_ptr;
-        priv->pos_buf->wall_clk_lsw = wall_clk_lsw;
-        priv->pos_buf->wall_clk_msw = wall_clk_msw;
-        clock_gettime(CLOCK_MONOTONIC, &priv->pos_buf->tstamp);
+    if (priv->session_config->dir == RX &&
+        dsp_wall_clk && priv->timer.dsp_clk_offset_valid &&
+        now_us > dsp_wall_clk + priv->timer.dsp_clk_offset_us) {
+        extra = (now_us - dsp_wall_clk - priv->timer.dsp_clk_offset_us) *
+                rate / 1000000;
+        if (extra > priv->period_size)
+            extra = priv->period_size;
     }
 
+    new_hw_ptr = (sample_hw_ptr + extra) % pos_buf->boundary;
+    /* keep the previous estimate if it was further along */
+    if ((new_hw_ptr + pos_buf->boundary - pos_buf->hw_ptr) %
+            pos_buf->boundary > pos_buf->boundary / 2)
+        new_hw_ptr = pos_buf->hw_ptr;
+    pos_buf->hw_ptr = new_hw_ptr;
+
     return ret;
 }
 
@@ -426,13 +488,172 @@ static int agm_pcm_plugin_reset(struct pcm_plugin *plugin)
     }
     agm_pcm_plugin_update_hw_ptr(priv);
     priv->pos_buf->hw_ptr = (snd_pcm_uframes_t)(priv->pos_buf->hw_ptr % priv->total_size_frames);
-    priv->pos_buf->hw_ptr_base = 0;
+    priv->pos_buf->sample_hw_ptr = priv->pos_buf->hw_ptr;
     priv->pos_buf->wall_clk_msw = 0;
     priv->pos_buf->wall_clk_lsw = 0;
     AGM_LOGD("%s: reset hw_ptr to %d \n", __func__, priv->pos_buf->hw_ptr);
     return ret;
 }
 
+/*
+ * Read the graph side format from the pcm-device props:
+ *   native_format      S16_LE, S24_3LE, S24_LE or S32_LE
+ *   native_channels    channel count of the graph
+ *   native_channel_map optional remap, e.g. "1,0" swaps a stereo pair
+ */
+static void agm_pcm_get_native_config(struct agm_pcm_priv *priv,
+                                      void *pcm_node)
+{
+    enum agm_pcm_cvt_format fmt;
+    char *str = NULL;
+    int channels = 0;
+
+    priv->native_fmt = -1;
+    priv->native_channels = 0;
+
+    if (!snd_card_def_get_str(pcm_node, "native_format", &str) && str) {
+        if (agm_pcm_cvt_format_from_str(str, &fmt) || fmt == AGM_PCM_CVT_FLOAT)
+            AGM_LOGE("%s: unsupported native_format %s\n", __func__, str);
+        else
+            priv->native_fmt = fmt;
+    }
+
+    if (!snd_card_def_get_int(pcm_node, "native_channels", &channels)) {
+        if (channels <= 0 || channels > AGM_PCM_CVT_MAX_CH)
+            AGM_LOGE("%s: unsupported native_channels %d\n", __func__,
+                     channels);
+        else
+            priv->native_channels = channels;
+    }
+}
+
+/*
+ * Pick the graph config for the client's hw_params and set up the
+ * conversion between the two. The media config is left describing the
+ * graph side, which is what AGM gets configured with.
+ */
+static int agm_pcm_setup_convert(struct pcm_plugin *plugin, int alsa_fmt,
+                                 uint32_t channels)
+{
+    struct agm_pcm_priv *priv = plugin->priv;
+    struct agm_media_config *media_config = priv->media_config;
+    enum agm_pcm_cvt_format client_fmt, native_fmt;
+    uint32_t native_ch;
+    int8_t map[AGM_PCM_CVT_MAX_CH];
+    uint32_t num = 0;
+    char *str = NULL;
+    int ret;
+
+    if (priv->native_fmt < 0 && !priv->native_channels)
+        goto no_convert;
+
+    /* mmap clients write the DSP buffer directly, nothing to hook into */
+    if (plugin->mode & PCM_MMAP) {
+        AGM_LOGI("%s: no conversion in mmap mode\n", __func__);
+        goto no_convert;
+    }
+
+    ret = alsa_to_cvt_format(alsa_fmt, &client_fmt);
+    if (ret) {
+        AGM_LOGE("%s: unsupported client format %d\n", __func__, alsa_fmt);
+        return ret;
+    }
+
+    if (priv->native_fmt >= 0)
+        native_fmt = priv->native_fmt;
+    else if (client_fmt == AGM_PCM_CVT_FLOAT)
+        native_fmt = AGM_PCM_CVT_S32;
+    else
+        native_fmt = client_fmt;
+    native_ch = priv->native_channels ? priv->native_channels : channels;
+
+    if (!priv->cvt) {
+        priv->cvt = calloc(1, sizeof(struct agm_pcm_convert));
+        if (!priv->cvt)
+            return -ENOMEM;
+    }
+
+    if (plugin->mode & PCM_IN)
+        ret = agm_pcm_convert_init(priv->cvt, native_fmt, native_ch,
+                                   client_fmt, channels, true);
+    else
+        ret = agm_pcm_convert_init(priv->cvt, client_fmt, channels,
+                                   native_fmt, native_ch, true);
+    if (ret) {
+        AGM_LOGE("%s: cannot convert %u ch to %u ch\n", __func__,
+                 channels, native_ch);
+        return ret;
+    }
+
+    if (!snd_card_def_get_str(plugin->node, "native_channel_map", &str) &&
+        str) {
+        ret = agm_pcm_convert_parse_map(str, map, &num);
+        if (!ret)
+            ret = agm_pcm_convert_set_map(priv->cvt, map, num);
+        if (ret)
+            AGM_LOGE("%s: ignoring native_channel_map %s\n", __func__, str);
+    }
+
+    if (agm_pcm_convert_is_noop(priv->cvt))
+        goto no_convert;
+
+    AGM_LOGD("%s: client fmt %d ch %u, graph fmt %d ch %u\n", __func__,
+             client_fmt, channels, native_fmt, native_ch);
+    media_config->format = cvt_to_agm_format(native_fmt);
+    media_config->channels = native_ch;
+    return 0;
+
+no_convert:
+    free(priv->cvt);
+    priv->cvt = NULL;
+    return 0;
+}
+
+static void *agm_pcm_get_cvt_buf(struct agm_pcm_priv *priv, size_t size)
+{
+    void *buf;
+
+    if (size > priv->cvt_buf_size) {
+        buf = realloc(priv->cvt_buf, size);
+        if (!buf)
+            return NULL;
+        priv->cvt_buf = buf;
+        priv->cvt_buf_size = size;
+    }
+
+    return priv->cvt_buf;
+}
+
+/*
+ * Small writes from playback clients are aggregated into AGM buffer sized
+ * chunks when the pcm-device sets write_coalesce_ms, the longest a staged
+ * byte may wait before it is written anyway.
+ */
+static void agm_pcm_setup_coalesce(struct pcm_plugin *plugin)
+{
+    struct agm_pcm_priv *priv = plugin->priv;
+    int cap_ms = 0;
+
+    agm_pcm_coalesce_destroy(priv->coalesce);
+    priv->coalesce = NULL;
+
+    if (plugin->mode & (PCM_IN | PCM_MMAP))
+        return;
+
+    if (snd_card_def_get_int(plugin->node, "write_coalesce_ms", &cap_ms) ||
+        cap_ms <= 0)
+        return;
+
+    priv->coalesce = agm_pcm_coalesce_create(priv->handle,
+                                             priv->buffer_config->size,
+                                             cap_ms);
+    if (!priv->coalesce)
+        AGM_LOGE("%s: coalescing unavailable, writing through\n", __func__);
+    else
+        AGM_LOGD("%s: coalescing %u byte writes, cap %d ms\n", __func__,
+                 priv->buffer_config->size, cap_ms);
+}
+
 static int agm_pcm_hw_params(struct pcm_plugin *plugin,
                              struct snd_pcm_hw_params *params)
 {
@@ -455,6 +676,12 @@ static int agm_pcm_hw_params(struct pcm_plugin *plugin,
     media_config->channels = param_get_int(params, SNDRV_PCM_HW_PARAM_CHANNELS);
     media_config->format = param_get_mask_val(params, SNDRV_PCM_HW_PARAM_FORMAT);
 
+    ret = agm_pcm_setup_convert(plugin,
+            snd_mask_val(param_to_mask(params, SNDRV_PCM_HW_PARAM_FORMAT)),
+            media_config->channels);
+    if (ret)
+        return ret;
+
     buffer_config->count = param_get_int(params, SNDRV_PCM_HW_PARAM_PERIODS);
     buffer_config->max_metadata_size = 0;
     priv->period_size = param_get_int(params, SNDRV_PCM_HW_PARAM_PERIOD_SIZE);
@@ -473,6 +700,10 @@ static int agm_pcm_hw_params(struct pcm_plugin *plugin,
 
     ret = agm_session_set_config(priv->handle, session_config,
                                  priv->media_config, priv->buffer_config);
+    if (ret)
+        return ret;
+
+    agm_pcm_setup_coalesce(plugin);
     return ret;
 }
 
@@ -502,6 +733,57 @@ static int agm_pcm_sw_params(struct pcm_plugin *plugin,
     return ret;
 }
 
+static snd_pcm_sframes_t agm_pcm_get_avail(struct pcm_plugin *plugin)
+{
+    struct agm_pcm_priv *priv = plugin->priv;
+    snd_pcm_sframes_t avail = 0;
+    enum direction dir;
+
+    dir = (plugin->mode & PCM_IN) ? TX : RX;
+
+    if (dir == RX) {
+        avail = priv->pos_buf->hw_ptr +
+            priv->total_size_frames -
+            priv->pos_buf->appl_ptr;
+
+        if (avail < 0)
+            avail += priv->pos_buf->boundary;
+        else if ((snd_pcm_uframes_t)avail >= priv->pos_buf->boundary)
+            avail -= priv->pos_buf->boundary;
+    } else if (dir == TX) {
+        __builtin_sub_overflow(priv->pos_buf->hw_ptr, priv->pos_buf->appl_ptr, &avail);
+        if (avail < 0)
+            avail += priv->pos_buf->boundary;
+    }
+
+    return avail;
+}
+
+/*
+ * Feed the counters from a fresh avail: the stream is in xrun once the
+ * DSP got a whole buffer past the client, and the latency is what sits
+ * in the ring plus the period the DSP is working on.
+ */
+static void agm_pcm_update_stats(struct pcm_plugin *plugin,
+                                 snd_pcm_sframes_t avail)
+{
+    struct agm_pcm_priv *priv = plugin->priv;
+    snd_pcm_uframes_t total = priv->total_size_frames;
+    snd_pcm_uframes_t queued;
+    bool capture = plugin->mode & PCM_IN;
+    bool xrun = (snd_pcm_uframes_t)avail > total;
+
+    agm_pcm_stats_xrun(&priv->stats, xrun, capture);
+    if (xrun)
+        queued = capture ? total : 0;
+    else
+        queued = capture ? (snd_pcm_uframes_t)avail : total - avail;
+    agm_pcm_stats_latency(&priv->stats,
+            (queued + priv->period_size) * 1000000ULL /
+            priv->media_config->rate);
+    agm_pcm_stats_flush(&priv->stats, priv->handle, false);
+}
+
 static int agm_pcm_sync_ptr(struct pcm_plugin *plugin,
                             struct snd_pcm_sync_ptr *sync_ptr)
 {
@@ -524,6 +806,7 @@ static int agm_pcm_sync_ptr(struct pcm_plugin *plugin,
         ret = agm_pcm_plugin_update_hw_ptr(priv);
         if (ret < 0)
             return ret;
+        agm_pcm_update_stats(plugin, agm_pcm_get_avail(plugin));
     }
 
     if (!(sync_ptr->flags & SNDRV_PCM_SYNC_PTR_APPL)) {
@@ -560,7 +843,17 @@ static int agm_pcm_writei_frames(struct pcm_plugin *plugin, struct snd_xferi *x)
     count = x->frames * (priv->media_config->channels *
             agm_format_to_bits(priv->media_config->format) / 8);
 
-    ret = agm_session_write(handle, buff, &count);
+    if (priv->cvt) {
+        buff = agm_pcm_get_cvt_buf(priv, count);
+        if (!buff)
+            return -ENOMEM;
+        agm_pcm_convert_run(priv->cvt, x->buf, buff, x->frames);
+    }
+
+    if (priv->coalesce)
+        ret = agm_pcm_coalesce_write(priv->coalesce, buff, count);
+    else
+        ret = agm_session_write(handle, buff, &count);
     errno = ret;
 
     return ret;
@@ -581,9 +874,20 @@ static int agm_pcm_readi_frames(struct pcm_plugin *plugin, struct snd_xferi *x)
     buff = x->buf;
     count = x->frames * (priv->media_config->channels *
             agm_format_to_bits(priv->media_config->format) / 8);
+
+    if (priv->cvt) {
+        buff = agm_pcm_get_cvt_buf(priv, count);
+        if (!buff)
+            return -ENOMEM;
+    }
+
     ret = agm_session_read(handle, buff, &count);
     errno = ret;
 
+    if (!ret && priv->cvt)
+        agm_pcm_convert_run(priv->cvt, buff, x->buf,
+                            count / priv->cvt->src_frame_bytes);
+
     return ret;
 }
 
@@ -611,11 +915,15 @@ static int agm_pcm_prepare(struct pcm_plugin *plugin)
         priv->pos_buf->wall_clk_msw = 0;
         priv->pos_buf->wall_clk_lsw = 0;
     }
+    agm_pcm_stats_reset(&priv->stats);
 
     ret = agm_get_session_handle(priv, &handle);
     if (ret)
         return ret;
 
+    if (priv->coalesce)
+        agm_pcm_coalesce_discard(priv->coalesce);
+
     ret = agm_session_prepare(handle);
     errno = ret;
 
@@ -648,6 +956,9 @@ static int agm_pcm_drop(struct pcm_plugin *plugin)
     if (ret)
         return ret;
 
+    if (priv->coalesce)
+        agm_pcm_coalesce_discard(priv->coalesce);
+
     ret = agm_session_stop(handle);
     errno = ret;
 
@@ -665,13 +976,18 @@ static int agm_pcm_close(struct pcm_plugin *plugin)
     if (ret)
         return ret;
 
+    agm_pcm_coalesce_destroy(priv->coalesce);
+    agm_pcm_stats_flush(&priv->stats, handle, true);
     ret = agm_session_close(handle);
     errno = ret;
 
+    agm_pcm_timer_close(&priv->timer);
     snd_card_def_put_card(priv->card_node);
     free(priv->buffer_config);
     free(priv->media_config);
     free(priv->session_config);
+    free(priv->cvt);
+    free(priv->cvt_buf);
     // unmap memory in case agm_pcm_munmap not called before close
     if (priv->mmap_status) {
         if (plugin->mode & PCM_NOIRQ) {
@@ -698,30 +1014,15 @@ static int agm_pcm_close(struct pcm_plugin *plugin)
     return ret;
 }
 
-static snd_pcm_sframes_t agm_pcm_get_avail(struct pcm_plugin *plugin)
+/* when the position buffer should show need more frames than now */
+static uint64_t agm_pcm_predict_wakeup(struct agm_pcm_priv *priv,
+                                       snd_pcm_uframes_t need, uint64_t now_us)
 {
-    struct agm_pcm_priv *priv = plugin->priv;
-    snd_pcm_sframes_t avail = 0;
-    enum direction dir;
+    uint64_t dsp_wall_clk = ((uint64_t)priv->pos_buf->wall_clk_msw) << 32 |
+                            priv->pos_buf->wall_clk_lsw;
 
-    dir = (plugin->mode & PCM_IN) ? TX : RX;
-
-    if (dir == RX) {
-        avail = priv->pos_buf->hw_ptr +
-            priv->total_size_frames -
-            priv->pos_buf->appl_ptr;
-
-        if (avail < 0)
-            avail += priv->pos_buf->boundary;
-        else if ((snd_pcm_uframes_t)avail >= priv->pos_buf->boundary)
-            avail -= priv->pos_buf->boundary;
-    } else if (dir == TX) {
-        __builtin_sub_overflow(priv->pos_buf->hw_ptr, priv->pos_buf->appl_ptr, &avail);
-        if (avail < 0)
-            avail += priv->pos_buf->boundary;
-    }
-
-    return avail;
+    return agm_pcm_timer_predict(&priv->timer, priv->media_config->rate,
+                                 priv->period_size, dsp_wall_clk, need, now_us);
 }
 
 static int agm_pcm_poll(struct pcm_plugin *plugin, struct pollfd *pfd,
@@ -732,18 +1033,42 @@ static int agm_pcm_poll(struct pcm_plugin *plugin, struct pollfd *pfd,
     snd_pcm_sframes_t avail;
     int ret = 0;
     uint32_t period_to_msec = period_size / (priv->media_config->rate / 1000);
+    uint64_t waited_us = 0, now_us;
+    int64_t waited;
 
     avail = agm_pcm_get_avail(plugin);
 
     if (avail < period_size) {
         if (timeout == 0) //wait for 1msec
             timeout = 1;
-        usleep(timeout * 1000);
+        now_us = agm_pcm_timer_now_us();
+        waited = agm_pcm_timer_wait(&priv->timer,
+                agm_pcm_predict_wakeup(priv, period_size - avail, now_us),
+                timeout);
+        if (waited < 0) {
+            AGM_LOGE("%s: period timer failed %d, using sleep\n",
+                     __func__, (int)waited);
+            usleep(timeout * 1000);
+            waited = (int64_t)timeout * 1000;
+        }
+        waited_us = waited;
         ret = agm_pcm_plugin_update_hw_ptr(priv);
         if (ret == 0)
             avail = agm_pcm_get_avail(plugin);
     }
 
+    /*
+     * Leave the period timer armed for when a period should be available,
+     * right away if one already is, so callers can multiplex it with their
+     * own fds and come back here when it fires.
+     */
+    now_us = agm_pcm_timer_now_us();
+    if (!agm_pcm_timer_arm(&priv->timer, avail >= period_size ? now_us :
+                agm_pcm_predict_wakeup(priv, period_size - avail, now_us))) {
+        pfd->fd = priv->timer.fd;
+        pfd->events = POLLIN;
+    }
+
     if (avail >= period_size) {
         if (plugin->mode & PCM_IN) {
             pfd->revents = POLLIN | POLLOUT;
@@ -755,14 +1080,18 @@ static int agm_pcm_poll(struct pcm_plugin *plugin, struct pollfd *pfd,
         priv->mmap_buf_tout = 0;
     } else {
         ret = 0; /* TIMEOUT */
-        priv->mmap_buf_tout += timeout;
-        if (priv->mmap_buf_tout > (period_to_msec * MMAP_TOUT_MULTI)) {
+        priv->mmap_buf_tout += waited_us;
+        if (priv->mmap_buf_tout >
+                (uint64_t)period_to_msec * 1000 * MMAP_TOUT_MULTI) {
             AGM_LOGE("timeout in waiting for mmap buffer");
             priv->mmap_buf_tout = 0;
+            agm_pcm_stats_poll_timeout(&priv->stats);
+            agm_pcm_stats_flush(&priv->stats, priv->handle, false);
             errno = ETIMEDOUT;
             return -ETIMEDOUT;
         }
     }
+    agm_pcm_update_stats(plugin, avail);
 
     return ret;
 }
@@ -874,6 +1203,10 @@ static int agm_pcm_ioctl(struct pcm_plugin *plugin, int cmd, ...)
     case SNDRV_PCM_IOCTL_RESET:
         ret = agm_pcm_plugin_reset(plugin);
         break;
+    case SNDRV_PCM_IOCTL_DRAIN:
+        if (priv->coalesce)
+            ret = agm_pcm_coalesce_flush(priv->coalesce);
+        break;
     default:
         break;
     }
@@ -950,18 +1283,28 @@ PCM_PLUGIN_OPEN_FN(agm_pcm_plugin)
         goto err_card_put;
     }
 
-    agm_pcm_constrs.access = (PCM_FORMAT_BIT(SNDRV_PCM_ACCESS_RW_INTERLEAVED) |
-                              PCM_FORMAT_BIT(SNDRV_PCM_ACCESS_RW_NONINTERLEAVED));
-    agm_pcm_constrs.format = (PCM_FORMAT_BIT(SNDRV_PCM_FORMAT_S16_LE) |
-                              PCM_FORMAT_BIT(SNDRV_PCM_FORMAT_S24_LE) |
-                              PCM_FORMAT_BIT(SNDRV_PCM_FORMAT_S24_3LE) |
-                              PCM_FORMAT_BIT(SNDRV_PCM_FORMAT_S32_LE));
+    priv->constrs = agm_pcm_constrs;
+    priv->constrs.access = (PCM_FORMAT_BIT(SNDRV_PCM_ACCESS_RW_INTERLEAVED) |
+                            PCM_FORMAT_BIT(SNDRV_PCM_ACCESS_RW_NONINTERLEAVED));
+    priv->constrs.format = (PCM_FORMAT_BIT(SNDRV_PCM_FORMAT_S16_LE) |
+                            PCM_FORMAT_BIT(SNDRV_PCM_FORMAT_S24_LE) |
+                            PCM_FORMAT_BIT(SNDRV_PCM_FORMAT_S24_3LE) |
+                            PCM_FORMAT_BIT(SNDRV_PCM_FORMAT_S32_LE));
+
+    /*
+     * with a native config the plugin converts, float included; mmap
+     * clients write the DSP buffer directly and get no conversion
+     */
+    agm_pcm_get_native_config(priv, pcm_node);
+    if ((priv->native_fmt >= 0 || priv->native_channels) &&
+        !(mode & PCM_MMAP))
+        priv->constrs.format |= PCM_FORMAT_BIT(SNDRV_PCM_FORMAT_FLOAT_LE);
 
     agm_pcm_plugin->card = card;
     agm_pcm_plugin->ops = &agm_pcm_ops;
     agm_pcm_plugin->node = pcm_node;
     agm_pcm_plugin->mode = mode;
-    agm_pcm_plugin->constraints = &agm_pcm_constrs;
+    agm_pcm_plugin->constraints = &priv->constrs;
     agm_pcm_plugin->priv = priv;
 
     priv->media_config = media_config;
@@ -970,6 +1313,7 @@ PCM_PLUGIN_OPEN_FN(agm_pcm_plugin)
     priv->card_node = card_node;
     priv->session_id = session_id;
     priv->mmap_status = false;
+    agm_pcm_timer_init(&priv->timer);
     snd_card_def_get_int(pcm_node, "session_mode", &sess_mode);
 
     ret = agm_session_open(session_id, sess_mode, &handle);
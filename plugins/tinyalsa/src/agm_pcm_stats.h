@@ -0,0 +1,120 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Client side stream counters for the agm plugins.
+ *
+ * AGM counts the data moved through a session itself; what only the
+ * plugin sees (xruns on the shared position buffer, poll timeouts, gaps
+ * between DSP position updates, latency) is collected here and handed
+ * to agm_session_update_stats(). Xruns and timeouts go out right away,
+ * the rest at most once a second, so streams without incidents cost
+ * one call per second. They can be read back with the "<pcm> stats"
+ * mixer control.
+ */
+
+#ifndef __AGM_PCM_STATS_H__
+#define __AGM_PCM_STATS_H__
+
+#include <agm/agm_api.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define AGM_PCM_STATS_FLUSH_US 1000000
+
+struct agm_pcm_stats {
+    struct agm_session_stats delta;     /* not reported yet */
+    uint64_t last_flush_us;
+    uint64_t last_wall_clk;             /* DSP wall clock of the last update */
+    uint32_t max_pos_interval_us;
+    bool in_xrun;
+    bool dirty;
+};
+
+static inline uint64_t agm_pcm_stats_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* start over on prepare, the position restarts from zero */
+static inline void agm_pcm_stats_reset(struct agm_pcm_stats *s)
+{
+    s->last_wall_clk = 0;
+    s->in_xrun = false;
+}
+
+static inline void agm_pcm_stats_pos_update(struct agm_pcm_stats *s,
+                                            uint64_t dsp_wall_clk)
+{
+    uint64_t interval;
+
+    if (s->last_wall_clk && dsp_wall_clk > s->last_wall_clk) {
+        interval = dsp_wall_clk - s->last_wall_clk;
+        if (interval > s->max_pos_interval_us) {
+            s->max_pos_interval_us = interval > UINT32_MAX ?
+                                     UINT32_MAX : interval;
+            s->delta.max_pos_interval_us = s->max_pos_interval_us;
+            s->dirty = true;
+        }
+    }
+    s->last_wall_clk = dsp_wall_clk;
+}
+
+/* count each xrun once, however long the stream stays in it */
+static inline void agm_pcm_stats_xrun(struct agm_pcm_stats *s, bool xrun,
+                                      bool capture)
+{
+    if (xrun && !s->in_xrun) {
+        if (capture)
+            s->delta.num_overruns++;
+        else
+            s->delta.num_underruns++;
+    }
+    s->in_xrun = xrun;
+}
+
+static inline void agm_pcm_stats_poll_timeout(struct agm_pcm_stats *s)
+{
+    s->delta.num_poll_timeouts++;
+}
+
+static inline void agm_pcm_stats_latency(struct agm_pcm_stats *s,
+                                         uint32_t latency_us)
+{
+    if (latency_us && latency_us != s->delta.latency_us) {
+        s->delta.latency_us = latency_us;
+        s->dirty = true;
+    }
+}
+
+static inline void agm_pcm_stats_flush(struct agm_pcm_stats *s,
+                                       uint64_t handle, bool force)
+{
+    struct agm_session_stats *d = &s->delta;
+    bool events = d->num_underruns || d->num_overruns ||
+                  d->num_poll_timeouts;
+    uint64_t now_us;
+
+    if (!events && !s->dirty)
+        return;
+
+    now_us = agm_pcm_stats_now_us();
+    if (!force && !events &&
+        now_us - s->last_flush_us < AGM_PCM_STATS_FLUSH_US)
+        return;
+
+    if (!agm_session_update_stats(handle, d)) {
+        memset(d, 0, sizeof(*d));
+        s->dirty = false;
+        s->last_flush_us = now_us;
+    }
+}
+
+#endif /* __AGM_PCM_STATS_H__ */
@@ -0,0 +1,154 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Period timer of the pcm plugin NOIRQ (mmap) poll.
+ *
+ * The DSP moves the shared position a period at a time and stamps every
+ * update with its wall clock. The timer predicts the next update from that
+ * wall clock, translated to CLOCK_MONOTONIC with a tracked offset, and
+ * sleeps on a timerfd until then. Between polls the timerfd stays armed
+ * for the next predicted update, so callers can poll it with their own fds.
+ */
+
+#ifndef __AGM_PCM_TIMER_H__
+#define __AGM_PCM_TIMER_H__
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+/* wake this long after the predicted DSP position update */
+#define AGM_POLL_WAKEUP_SLACK_US 200
+
+struct agm_pcm_timer {
+    int fd;                         /* -1 until first armed */
+    int64_t dsp_clk_offset_us;      /* CLOCK_MONOTONIC - DSP wall clock */
+    bool dsp_clk_offset_valid;
+};
+
+static inline uint64_t agm_pcm_timer_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static inline void agm_pcm_timer_init(struct agm_pcm_timer *t)
+{
+    t->fd = -1;
+    t->dsp_clk_offset_us = 0;
+    t->dsp_clk_offset_valid = false;
+}
+
+static inline void agm_pcm_timer_close(struct agm_pcm_timer *t)
+{
+    if (t->fd >= 0)
+        close(t->fd);
+    t->fd = -1;
+}
+
+/*
+ * Track the offset between CLOCK_MONOTONIC and the DSP wall clock. We only
+ * see an update some time after the DSP wrote it, so the smallest offset
+ * seen is the best one; it may creep up by 1us per update to follow drift.
+ */
+static inline void agm_pcm_timer_sync(struct agm_pcm_timer *t,
+                                      uint64_t local_us, uint64_t dsp_wall_clk)
+{
+    int64_t offset = (int64_t)(local_us - dsp_wall_clk);
+
+    if (!t->dsp_clk_offset_valid || offset < t->dsp_clk_offset_us + 1)
+        t->dsp_clk_offset_us = offset;
+    else
+        t->dsp_clk_offset_us += 1;
+    t->dsp_clk_offset_valid = true;
+}
+
+/*
+ * CLOCK_MONOTONIC time at which the position should show need more frames
+ * than at the update stamped dsp_wall_clk: that update plus whole periods,
+ * translated to the local clock. Without a wall clock the rate alone is
+ * used.
+ */
+static inline uint64_t agm_pcm_timer_predict(struct agm_pcm_timer *t,
+        uint32_t rate, uint32_t period_size, uint64_t dsp_wall_clk,
+        uint64_t need, uint64_t now_us)
+{
+    uint64_t period_us = (uint64_t)period_size * 1000000 / rate;
+    uint64_t num_periods = (need + period_size - 1) / period_size;
+    uint64_t wakeup_us;
+
+    if (!dsp_wall_clk || !t->dsp_clk_offset_valid)
+        return now_us + need * 1000000 / rate;
+
+    wakeup_us = dsp_wall_clk + t->dsp_clk_offset_us +
+                num_periods * period_us + AGM_POLL_WAKEUP_SLACK_US;
+
+    /* update is late, look again in a fraction of a period */
+    if (wakeup_us <= now_us)
+        wakeup_us = now_us + period_us / 8;
+
+    return wakeup_us;
+}
+
+/* the fd turns readable at wakeup_us, right away if that has passed */
+static inline int agm_pcm_timer_arm(struct agm_pcm_timer *t, uint64_t wakeup_us)
+{
+    struct itimerspec its;
+
+    if (t->fd < 0) {
+        t->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (t->fd < 0)
+            return -errno;
+    }
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = wakeup_us / 1000000;
+    its.it_value.tv_nsec = (wakeup_us % 1000000) * 1000;
+    if (timerfd_settime(t->fd, TFD_TIMER_ABSTIME, &its, NULL))
+        return -errno;
+
+    return 0;
+}
+
+/*
+ * Sleep until wakeup_us or the timeout, whichever is first, and leave the
+ * timer disarmed. Returns the time slept in us, or a negative error if
+ * the timer could not be armed and the caller has to sleep by itself.
+ */
+static inline int64_t agm_pcm_timer_wait(struct agm_pcm_timer *t,
+                                         uint64_t wakeup_us, int timeout)
+{
+    struct pollfd tfd;
+    uint64_t now_us = agm_pcm_timer_now_us();
+    uint64_t expirations;
+    int ret;
+
+    if (wakeup_us > now_us + (uint64_t)timeout * 1000)
+        wakeup_us = now_us + (uint64_t)timeout * 1000;
+
+    ret = agm_pcm_timer_arm(t, wakeup_us);
+    if (ret)
+        return ret;
+
+    tfd.fd = t->fd;
+    tfd.events = POLLIN;
+    tfd.revents = 0;
+    /* a short read only means another poller of the fd drained it first */
+    if (poll(&tfd, 1, timeout + 1) > 0 &&
+        read(t->fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        expirations = 0;
+
+    return (int64_t)(agm_pcm_timer_now_us() - now_us);
+}
+
+#endif /* __AGM_PCM_TIMER_H__ */
@@ -0,0 +1,170 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Effect of the pcm plugin write coalescing on agm_session_write traffic.
+ *
+ * A client pushes small writes at real time pace into the coalescing layer
+ * of the pcm plugins. agm_session_write is replaced by a stub that counts
+ * calls and records how long the oldest byte of each write was held back,
+ * so the run shows the calls per second saved and checks the latency cap:
+ * the run fails if any write reaches agm after the cap. With -w the stub
+ * takes only half of every Nth write, and the run also fails unless every
+ * byte the client wrote reached agm exactly once.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "agm_pcm_coalesce.h"
+
+static uint64_t num_calls;
+static uint64_t max_hold_us;
+static uint64_t over_cap_us;
+static uint64_t num_over_cap;
+static uint64_t staged_at_us;   /* time the oldest unwritten byte arrived */
+static size_t pending;          /* bytes written by the client, not by agm */
+static uint64_t bytes_written;
+static uint32_t short_every;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* stands in for libagm, called with the coalescer lock held */
+int agm_session_write(uint64_t handle, void *buff, size_t *count)
+{
+    uint64_t hold = now_us() - staged_at_us;
+
+    num_calls++;
+    if (hold > max_hold_us)
+        max_hold_us = hold;
+    if (hold > over_cap_us)
+        num_over_cap++;
+
+    if (short_every && num_calls % short_every == 0 && *count > 1)
+        *count /= 2;
+    bytes_written += *count;
+    pending -= *count;
+
+    return 0;
+}
+
+static void usage(void)
+{
+    printf(" Usage: agm_coalesce_bench [-r rate] [-c chunk_frames]"
+           " [-b buffer_frames] [-l cap_ms] [-s seconds]"
+           " [-w short_write_every]\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct agm_pcm_coalesce *c;
+    uint32_t rate = 48000, chunk = 48, buffer = 960, cap_ms = 5, secs = 2;
+    uint32_t frame_bytes = 4, i, n;
+    uint64_t chunk_us, start, calls_direct, bytes_client = 0;
+    struct timespec next;
+    uint8_t *data;
+    int opt, ret;
+
+    while ((opt = getopt(argc, argv, "r:c:b:l:s:w:h")) != -1) {
+        switch (opt) {
+        case 'r':
+            rate = atoi(optarg);
+            break;
+        case 'c':
+            chunk = atoi(optarg);
+            break;
+        case 'b':
+            buffer = atoi(optarg);
+            break;
+        case 'l':
+            cap_ms = atoi(optarg);
+            break;
+        case 's':
+            secs = atoi(optarg);
+            break;
+        case 'w':
+            short_every = atoi(optarg);
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (!rate || !chunk || !buffer || !cap_ms || !secs) {
+        usage();
+        return 1;
+    }
+
+    data = calloc(chunk, frame_bytes);
+    c = agm_pcm_coalesce_create(1, (size_t)buffer * frame_bytes, cap_ms);
+    if (!data || !c) {
+        printf("setup failed\n");
+        return 1;
+    }
+
+    over_cap_us = (uint64_t)cap_ms * 1000;
+    chunk_us = (uint64_t)chunk * 1000000 / rate;
+    n = (uint64_t)secs * rate / chunk;
+    calls_direct = n;
+
+    printf("%u Hz, %u frame writes every %llu us, %u frame buffers, "
+           "cap %u ms, %u s\n", rate, chunk, (unsigned long long)chunk_us,
+           buffer, cap_ms, secs);
+
+    start = now_us();
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (i = 0; i < n; i++) {
+        pthread_mutex_lock(&c->lock);
+        if (!pending)
+            staged_at_us = now_us();
+        pending += (size_t)chunk * frame_bytes;
+        pthread_mutex_unlock(&c->lock);
+
+        agm_pcm_coalesce_write(c, data, (size_t)chunk * frame_bytes);
+        bytes_client += (size_t)chunk * frame_bytes;
+
+        next.tv_nsec += chunk_us * 1000;
+        while (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    agm_pcm_coalesce_flush(c);
+
+    printf("client writes      %llu (%.0f/s)\n",
+           (unsigned long long)calls_direct,
+           calls_direct * 1e6 / (now_us() - start));
+    printf("agm_session_write  %llu (%.0f/s)\n", (unsigned long long)num_calls,
+           num_calls * 1e6 / (now_us() - start));
+    printf("max hold           %llu us (cap %u us)\n",
+           (unsigned long long)max_hold_us, cap_ms * 1000);
+    ret = num_over_cap > 0;
+    printf("over cap           %llu of %llu %s\n",
+           (unsigned long long)num_over_cap, (unsigned long long)num_calls,
+           num_over_cap ? "FAIL" : "ok");
+    if (bytes_written != bytes_client)
+        ret = 1;
+    printf("bytes written      %llu of %llu %s\n",
+           (unsigned long long)bytes_written,
+           (unsigned long long)bytes_client,
+           bytes_written != bytes_client ? "FAIL" : "ok");
+
+    agm_pcm_coalesce_destroy(c);
+    free(data);
+
+    return ret;
+}
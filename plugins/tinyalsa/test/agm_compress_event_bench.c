@@ -0,0 +1,236 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * CPU cost of the compress plugin event path, per second of offloaded audio.
+ *
+ * A thread stands in for the DSP and returns one fragment per fragment
+ * period, the way WRITE_DONE events arrive for offload playback. A writer
+ * keeps the buffer full, waiting for room the way compress_wait() does.
+ * Two event paths are compared:
+ *   legacy   per-purpose mutex/condvar pairs, every event signalling the
+ *            drain and poll conditions, poll on a timed condvar wait
+ *   eventfd  one lock plus the level triggered readiness fd the plugin
+ *            uses now, poll() on the fd
+ * Time can be compressed with -x to get through more events quickly; the
+ * result is still reported per second of audio.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/agm_compress_event.h"
+
+struct stream {
+    int64_t bytes_avail;
+    int64_t total;
+    int64_t frag;
+    volatile int done;
+    /* legacy */
+    pthread_mutex_t lock;
+    pthread_mutex_t drain_lock;
+    pthread_cond_t drain_cond;
+    pthread_mutex_t poll_lock;
+    pthread_cond_t poll_cond;
+    /* eventfd */
+    struct agm_compr_ready ready;
+    int use_fd;
+    uint32_t num_frags;
+    uint64_t period_ns;
+    uint64_t wakeups;
+};
+
+static uint64_t cpu_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void update_ready_l(struct stream *st)
+{
+    agm_compr_ready_set(&st->ready, st->done || st->bytes_avail >= st->frag);
+}
+
+static void write_done(struct stream *st)
+{
+    pthread_mutex_lock(&st->lock);
+    st->bytes_avail += st->frag;
+    if (st->use_fd) {
+        update_ready_l(st);
+        pthread_mutex_unlock(&st->lock);
+        return;
+    }
+    pthread_mutex_lock(&st->drain_lock);
+    pthread_cond_signal(&st->drain_cond);
+    pthread_mutex_unlock(&st->drain_lock);
+    pthread_mutex_unlock(&st->lock);
+
+    pthread_mutex_lock(&st->poll_lock);
+    pthread_cond_signal(&st->poll_cond);
+    pthread_mutex_unlock(&st->poll_lock);
+}
+
+static void *dsp_thread(void *arg)
+{
+    struct stream *st = arg;
+    struct timespec next;
+    uint32_t i;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (i = 0; i < st->num_frags; i++) {
+        next.tv_nsec += st->period_ns;
+        while (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        write_done(st);
+    }
+
+    pthread_mutex_lock(&st->lock);
+    st->done = 1;
+    if (st->use_fd)
+        update_ready_l(st);
+    pthread_mutex_unlock(&st->lock);
+    pthread_mutex_lock(&st->poll_lock);
+    pthread_cond_signal(&st->poll_cond);
+    pthread_mutex_unlock(&st->poll_lock);
+
+    return NULL;
+}
+
+static void legacy_wait(struct stream *st, int timeout_ms)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    pthread_mutex_lock(&st->poll_lock);
+    pthread_cond_timedwait(&st->poll_cond, &st->poll_lock, &ts);
+    pthread_mutex_unlock(&st->poll_lock);
+}
+
+static void writer(struct stream *st)
+{
+    int room;
+
+    for (;;) {
+        pthread_mutex_lock(&st->lock);
+        room = st->bytes_avail >= st->frag;
+        if (room)
+            st->bytes_avail -= st->frag;
+        if (st->use_fd)
+            update_ready_l(st);
+        pthread_mutex_unlock(&st->lock);
+        if (room)
+            continue;
+        if (st->done)
+            break;
+
+        st->wakeups++;
+        if (st->use_fd)
+            agm_compr_ready_wait(&st->ready, 1000);
+        else
+            legacy_wait(st, 1000);
+    }
+}
+
+static int run(const char *name, int use_fd, uint32_t num_frags,
+               uint64_t period_ns, double audio_secs)
+{
+    struct stream st;
+    pthread_t tid;
+    uint64_t start;
+    double cpu_us;
+
+    memset(&st, 0, sizeof(st));
+    st.frag = 4096;
+    st.total = st.frag * 4;
+    st.bytes_avail = st.total;
+    st.use_fd = use_fd;
+    st.num_frags = num_frags;
+    st.period_ns = period_ns;
+    pthread_mutex_init(&st.lock, NULL);
+    pthread_mutex_init(&st.drain_lock, NULL);
+    pthread_cond_init(&st.drain_cond, NULL);
+    pthread_mutex_init(&st.poll_lock, NULL);
+    pthread_cond_init(&st.poll_cond, NULL);
+    if (agm_compr_ready_init(&st.ready))
+        return -1;
+
+    pthread_mutex_lock(&st.lock);
+    update_ready_l(&st);
+    pthread_mutex_unlock(&st.lock);
+
+    start = cpu_ns();
+    if (pthread_create(&tid, NULL, dsp_thread, &st))
+        return -1;
+    writer(&st);
+    pthread_join(tid, NULL);
+    cpu_us = (cpu_ns() - start) / 1000.0;
+
+    printf("%-8s cpu %8.1f us per s of audio, %6.2f writer wakeups per "
+           "fragment\n", name, cpu_us / audio_secs,
+           (double)st.wakeups / num_frags);
+
+    agm_compr_ready_deinit(&st.ready);
+    return 0;
+}
+
+static void usage(void)
+{
+    printf(" Usage: agm_compress_event_bench [-f fragment_ms] [-s seconds]"
+           " [-x speedup]\n");
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t frag_ms = 20, secs = 60, speedup = 20, num_frags;
+    uint64_t period_ns;
+    double audio_secs;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:s:x:h")) != -1) {
+        switch (opt) {
+        case 'f':
+            frag_ms = atoi(optarg);
+            break;
+        case 's':
+            secs = atoi(optarg);
+            break;
+        case 'x':
+            speedup = atoi(optarg);
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (!frag_ms || !secs || !speedup) {
+        usage();
+        return 1;
+    }
+
+    num_frags = secs * 1000 / frag_ms;
+    period_ns = (uint64_t)frag_ms * 1000000 / speedup;
+    audio_secs = (double)num_frags * frag_ms / 1000;
+
+    printf("%u ms fragments, %.0f s of audio at %ux\n", frag_ms, audio_secs,
+           speedup);
+    if (run("legacy", 0, num_frags, period_ns, audio_secs) ||
+        run("eventfd", 1, num_frags, period_ns, audio_secs))
+        return 1;
+
+    return 0;
+}
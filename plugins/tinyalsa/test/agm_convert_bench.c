@@ -0,0 +1,267 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Throughput of the pcm plugin conversion kernels.
+ *
+ * Every format kernel is run scalar and with the SIMD variant this build
+ * selected, over a buffer sized like a typical write, and the outputs are
+ * compared so a broken kernel fails the run instead of just looking fast.
+ * The full conversion pipeline is then timed for a few common client and
+ * graph combinations, including up-mix, down-mix and remap.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "agm_pcm_convert.h"
+
+static const char *fmt_name[AGM_PCM_CVT_FMT_MAX] = {
+    "S16_LE", "S24_3LE", "S24_LE", "S32_LE", "FLOAT_LE",
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* full scale noise in the given format */
+static void fill(enum agm_pcm_cvt_format fmt, void *buf, size_t n)
+{
+    int32_t *s32;
+    size_t i;
+
+    s32 = malloc(n * sizeof(int32_t));
+    if (!s32)
+        return;
+    for (i = 0; i < n; i++)
+        s32[i] = (int32_t)(((uint32_t)rand() << 16) ^ (uint32_t)rand());
+    agm_pcm_cvt_get_from_s32(fmt, false)(s32, buf, n);
+    free(s32);
+}
+
+/* out of range floats, both SIMD lanes and the scalar tail must agree */
+static void fill_float_edges(float *buf, size_t n)
+{
+    static const float edges[] = {
+        1.0f, -1.0f, 2.0f, -2.0f, NAN, -NAN, INFINITY, -INFINITY,
+        0.99999994f, -0.99999994f, 1e-10f, -1e-10f,
+    };
+    size_t i, e = sizeof(edges) / sizeof(edges[0]);
+
+    for (i = 0; i < e && i < n; i++)
+        buf[i] = edges[i];
+    for (i = 0; i < e && i < n; i++)
+        buf[n - 1 - i] = edges[i];
+}
+
+static double msamples_per_sec(uint64_t ns, size_t n, int iters)
+{
+    return ns ? (double)n * iters * 1000.0 / ns : 0;
+}
+
+static int bench_kernels(size_t n, int iters)
+{
+    agm_pcm_cvt_to_s32_fn to_c, to_simd;
+    agm_pcm_cvt_from_s32_fn from_c, from_simd;
+    uint8_t *src, *dst_c, *dst_simd;
+    int32_t *s32_c, *s32_simd;
+    uint64_t t, ns_c, ns_simd;
+    int fmt, i, ret = 0;
+
+    src = malloc(n * 4);
+    dst_c = malloc(n * 4);
+    dst_simd = malloc(n * 4);
+    s32_c = malloc(n * sizeof(int32_t));
+    s32_simd = malloc(n * sizeof(int32_t));
+    if (!src || !dst_c || !dst_simd || !s32_c || !s32_simd) {
+        ret = -1;
+        goto done;
+    }
+
+    printf("%-20s %12s %12s %8s\n", "kernel", "scalar Ms/s", "simd Ms/s",
+           "speedup");
+    for (fmt = 0; fmt < AGM_PCM_CVT_FMT_MAX; fmt++) {
+        fill(fmt, src, n);
+        if (fmt == AGM_PCM_CVT_FLOAT)
+            fill_float_edges((float *)src, n);
+        to_c = agm_pcm_cvt_get_to_s32(fmt, false);
+        to_simd = agm_pcm_cvt_get_to_s32(fmt, true);
+
+        t = now_ns();
+        for (i = 0; i < iters; i++)
+            to_c(src, s32_c, n);
+        ns_c = now_ns() - t;
+        t = now_ns();
+        for (i = 0; i < iters; i++)
+            to_simd(src, s32_simd, n);
+        ns_simd = now_ns() - t;
+
+        if (memcmp(s32_c, s32_simd, n * sizeof(int32_t))) {
+            printf("%s -> S32 mismatch\n", fmt_name[fmt]);
+            ret = -1;
+        }
+        printf("%-8s -> S32      %12.1f %12.1f %7.2fx\n", fmt_name[fmt],
+               msamples_per_sec(ns_c, n, iters),
+               msamples_per_sec(ns_simd, n, iters),
+               ns_simd ? (double)ns_c / ns_simd : 0);
+
+        from_c = agm_pcm_cvt_get_from_s32(fmt, false);
+        from_simd = agm_pcm_cvt_get_from_s32(fmt, true);
+
+        t = now_ns();
+        for (i = 0; i < iters; i++)
+            from_c(s32_c, dst_c, n);
+        ns_c = now_ns() - t;
+        t = now_ns();
+        for (i = 0; i < iters; i++)
+            from_simd(s32_c, dst_simd, n);
+        ns_simd = now_ns() - t;
+
+        if (memcmp(dst_c, dst_simd, n * agm_pcm_cvt_sample_bytes(fmt))) {
+            printf("S32 -> %s mismatch\n", fmt_name[fmt]);
+            ret = -1;
+        }
+        printf("S32      -> %-8s %12.1f %12.1f %7.2fx\n", fmt_name[fmt],
+               msamples_per_sec(ns_c, n, iters),
+               msamples_per_sec(ns_simd, n, iters),
+               ns_simd ? (double)ns_c / ns_simd : 0);
+    }
+
+done:
+    free(src);
+    free(dst_c);
+    free(dst_simd);
+    free(s32_c);
+    free(s32_simd);
+    return ret;
+}
+
+struct pipeline_case {
+    enum agm_pcm_cvt_format src_fmt;
+    uint32_t src_ch;
+    enum agm_pcm_cvt_format dst_fmt;
+    uint32_t dst_ch;
+    const char *map;
+};
+
+static const struct pipeline_case cases[] = {
+    { AGM_PCM_CVT_S16, 2, AGM_PCM_CVT_S24_LE, 2, NULL },
+    { AGM_PCM_CVT_S16, 2, AGM_PCM_CVT_S32, 2, NULL },
+    { AGM_PCM_CVT_FLOAT, 2, AGM_PCM_CVT_S32, 2, NULL },
+    { AGM_PCM_CVT_S24_3LE, 2, AGM_PCM_CVT_S16, 2, NULL },
+    { AGM_PCM_CVT_S16, 2, AGM_PCM_CVT_S16, 2, "1,0" },
+    { AGM_PCM_CVT_S16, 1, AGM_PCM_CVT_S32, 2, NULL },
+    { AGM_PCM_CVT_S16, 2, AGM_PCM_CVT_S24_LE, 8, NULL },
+    { AGM_PCM_CVT_S32, 8, AGM_PCM_CVT_S16, 2, NULL },
+    { AGM_PCM_CVT_S32, 2, AGM_PCM_CVT_FLOAT, 1, NULL },
+};
+
+static int bench_pipelines(size_t frames, int iters)
+{
+    struct agm_pcm_convert *cvt;
+    const struct pipeline_case *c;
+    uint8_t *src = NULL, *dst = NULL;
+    int8_t map[AGM_PCM_CVT_MAX_CH];
+    uint32_t num;
+    uint64_t t, ns;
+    size_t k;
+    int i, ret = 0;
+
+    cvt = calloc(1, sizeof(*cvt));
+    src = malloc(frames * AGM_PCM_CVT_MAX_CH * 4);
+    dst = malloc(frames * AGM_PCM_CVT_MAX_CH * 4);
+    if (!cvt || !src || !dst) {
+        ret = -1;
+        goto done;
+    }
+
+    printf("\n%-30s %12s\n", "pipeline", "Mframes/s");
+    for (k = 0; k < sizeof(cases) / sizeof(cases[0]); k++) {
+        c = &cases[k];
+        if (agm_pcm_convert_init(cvt, c->src_fmt, c->src_ch, c->dst_fmt,
+                                 c->dst_ch, true)) {
+            ret = -1;
+            continue;
+        }
+        if (c->map && (agm_pcm_convert_parse_map(c->map, map, &num) ||
+                       agm_pcm_convert_set_map(cvt, map, num))) {
+            ret = -1;
+            continue;
+        }
+        fill(c->src_fmt, src, frames * c->src_ch);
+
+        t = now_ns();
+        for (i = 0; i < iters; i++)
+            agm_pcm_convert_run(cvt, src, dst, frames);
+        ns = now_ns() - t;
+
+        printf("%-8s %uch -> %-8s %uch %-4s %12.1f\n",
+               fmt_name[c->src_fmt], c->src_ch, fmt_name[c->dst_fmt],
+               c->dst_ch, c->map ? "map" : "", msamples_per_sec(ns, frames,
+               iters));
+    }
+
+done:
+    free(cvt);
+    free(src);
+    free(dst);
+    return ret;
+}
+
+static void usage(void)
+{
+    printf(" Usage: agm_convert_bench [-f frames] [-i iterations]\n");
+}
+
+int main(int argc, char **argv)
+{
+    size_t frames = 960;
+    int iters = 20000;
+    int opt, ret;
+
+    while ((opt = getopt(argc, argv, "f:i:h")) != -1) {
+        switch (opt) {
+        case 'f':
+            frames = atoi(optarg);
+            break;
+        case 'i':
+            iters = atoi(optarg);
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (!frames || iters <= 0) {
+        usage();
+        return 1;
+    }
+
+#if defined(AGM_PCM_CVT_NEON)
+    printf("simd: neon\n");
+#elif defined(AGM_PCM_CVT_AVX2)
+    printf("simd: sse2 + avx2\n");
+#elif defined(AGM_PCM_CVT_SSE2)
+    printf("simd: sse2\n");
+#else
+    printf("simd: none, scalar only\n");
+#endif
+    printf("%zu samples per call, %d calls\n\n", frames * 2, iters);
+
+    ret = bench_kernels(frames * 2, iters);
+    ret |= bench_pipelines(frames, iters / 4 ? iters / 4 : 1);
+
+    return ret ? 1 : 0;
+}
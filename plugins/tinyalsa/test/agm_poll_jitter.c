@@ -0,0 +1,305 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Wakeup jitter of the NOIRQ mmap poll strategies of the agm pcm plugin.
+ *
+ * A thread stands in for the DSP: once per period it moves the read index
+ * of a position buffer laid out like agm_shared_pos_buffer and stamps it
+ * with its own wall clock, which runs at an offset from CLOCK_MONOTONIC.
+ * The consumer waits for each period either with the usleep(timeout) loop
+ * poll used before, or with the plugin's period timer (agm_pcm_timer.h)
+ * driven the way agm_pcm_poll drives it, and records how late it saw each
+ * update and how often it woke up. In pollfd mode the consumer sleeps in
+ * its own poll() on the fd agm_pcm_poll hands back, as a client
+ * multiplexing the stream with other fds does.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/agm_pcm_timer.h"
+
+#define DSP_CLK_OFFSET_US 123456789ULL
+
+struct shared_pos {
+    volatile uint32_t frame_counter;
+    volatile uint32_t read_index;
+    volatile uint32_t wall_clock_us_lsw;
+    volatile uint32_t wall_clock_us_msw;
+    /* not in the real buffer: local time of the update, for measuring */
+    volatile uint64_t update_us;
+};
+
+struct bench {
+    struct shared_pos pos;
+    uint32_t rate;
+    uint32_t period_size;
+    uint32_t num_periods;
+    uint64_t period_us;
+    volatile bool done;
+};
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void *dsp_thread(void *arg)
+{
+    struct bench *b = arg;
+    struct timespec next;
+    uint64_t t, dsp_clk;
+    uint32_t i;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (i = 0; i < b->num_periods; i++) {
+        next.tv_nsec += b->period_us * 1000;
+        while (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        t = now_us();
+        dsp_clk = t + DSP_CLK_OFFSET_US;
+        b->pos.frame_counter++;
+        b->pos.wall_clock_us_lsw = (uint32_t)dsp_clk;
+        b->pos.wall_clock_us_msw = (uint32_t)(dsp_clk >> 32);
+        b->pos.update_us = t;
+        __sync_synchronize();
+        b->pos.read_index += b->period_size;
+    }
+    b->done = true;
+
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, uint64_t *lat, uint32_t n,
+                   uint64_t wakeups)
+{
+    uint64_t sum = 0;
+    uint32_t i;
+
+    if (!n) {
+        printf("%-8s no periods measured\n", name);
+        return;
+    }
+
+    for (i = 0; i < n; i++)
+        sum += lat[i];
+    qsort(lat, n, sizeof(uint64_t), cmp_u64);
+    printf("%-8s periods seen %5u late(us) mean %5llu p50 %5llu p99 %5llu "
+           "max %5llu wakeups/period %.2f\n", name, n,
+           (unsigned long long)(sum / n),
+           (unsigned long long)lat[n / 2],
+           (unsigned long long)lat[(n * 99) / 100],
+           (unsigned long long)lat[n - 1],
+           (double)wakeups / n);
+}
+
+/* poll as before: sleep the whole timeout and look once */
+static void run_usleep(struct bench *b, int timeout_ms, uint64_t *lat)
+{
+    uint32_t seen = b->pos.read_index, n = 0;
+    uint64_t wakeups = 0;
+
+    while (!b->done && n < b->num_periods) {
+        if (b->pos.read_index == seen) {
+            usleep(timeout_ms * 1000);
+            wakeups++;
+            if (b->pos.read_index == seen)
+                continue;
+        }
+        lat[n++] = now_us() - b->pos.update_us;
+        seen = b->pos.read_index;
+    }
+    report("usleep", lat, n, wakeups);
+}
+
+struct consumer {
+    struct agm_pcm_timer timer;
+    uint32_t seen;
+    uint64_t *lat;
+    uint32_t n;
+};
+
+/* agm_pcm_plugin_update_hw_ptr: note a new DSP update, returns avail */
+static uint32_t consumer_update(struct bench *b, struct consumer *c)
+{
+    uint64_t dsp_clk, t;
+
+    if (b->pos.read_index == c->seen)
+        return 0;
+
+    t = now_us();
+    c->lat[c->n++] = t - b->pos.update_us;
+    c->seen = b->pos.read_index;
+    dsp_clk = ((uint64_t)b->pos.wall_clock_us_msw << 32) |
+              b->pos.wall_clock_us_lsw;
+    agm_pcm_timer_sync(&c->timer, t, dsp_clk);
+
+    return b->period_size;
+}
+
+static uint64_t consumer_predict(struct bench *b, struct consumer *c,
+                                 uint32_t need, uint64_t now)
+{
+    uint64_t dsp_clk = ((uint64_t)b->pos.wall_clock_us_msw << 32) |
+                       b->pos.wall_clock_us_lsw;
+
+    return agm_pcm_timer_predict(&c->timer, b->rate, b->period_size,
+                                 dsp_clk, need, now);
+}
+
+/* the steps of agm_pcm_poll, returns the fd left armed or -1 */
+static int consumer_poll(struct bench *b, struct consumer *c, int timeout_ms)
+{
+    uint32_t avail = consumer_update(b, c);
+    uint64_t t;
+
+    if (avail < b->period_size) {
+        t = now_us();
+        if (agm_pcm_timer_wait(&c->timer,
+                consumer_predict(b, c, b->period_size - avail, t),
+                timeout_ms) < 0)
+            usleep(timeout_ms * 1000);
+        avail = consumer_update(b, c);
+    }
+
+    t = now_us();
+    if (agm_pcm_timer_arm(&c->timer, avail >= b->period_size ? t :
+                consumer_predict(b, c, b->period_size - avail, t)))
+        return -1;
+
+    return c->timer.fd;
+}
+
+/*
+ * Wait for periods through agm_pcm_poll, or with external set in the
+ * caller's own poll() on the fd it returns.
+ */
+static void run_timer(struct bench *b, int timeout_ms, uint64_t *lat,
+                      bool external)
+{
+    struct consumer c;
+    struct pollfd pfd;
+    uint64_t wakeups = 0;
+    int fd;
+
+    memset(&c, 0, sizeof(c));
+    agm_pcm_timer_init(&c.timer);
+    c.seen = b->pos.read_index;
+    c.lat = lat;
+
+    while (!b->done && c.n < b->num_periods) {
+        fd = consumer_poll(b, &c, timeout_ms);
+        wakeups++;
+        if (!external)
+            continue;
+        if (fd < 0) {
+            printf("period timer could not be armed\n");
+            break;
+        }
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        poll(&pfd, 1, timeout_ms);
+        wakeups++;
+    }
+    agm_pcm_timer_close(&c.timer);
+    report(external ? "pollfd" : "timerfd", lat, c.n, wakeups);
+}
+
+static void usage(void)
+{
+    printf(" Usage: agm_poll_jitter [-r rate] [-p period_size] [-n periods]"
+           " [-t timeout_ms]\n");
+    printf(" timeout_ms is the poll timeout passed by the caller,"
+           " 1 models the busy 1ms nap\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct bench b;
+    pthread_t tid;
+    uint64_t *lat;
+    int timeout_ms = 1, mode;
+    int opt;
+
+    memset(&b, 0, sizeof(b));
+    b.rate = 48000;
+    b.period_size = 240;
+    b.num_periods = 2000;
+
+    while ((opt = getopt(argc, argv, "r:p:n:t:h")) != -1) {
+        switch (opt) {
+        case 'r':
+            b.rate = atoi(optarg);
+            break;
+        case 'p':
+            b.period_size = atoi(optarg);
+            break;
+        case 'n':
+            b.num_periods = atoi(optarg);
+            break;
+        case 't':
+            timeout_ms = atoi(optarg);
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (!b.rate || !b.period_size || !b.num_periods || timeout_ms <= 0) {
+        usage();
+        return 1;
+    }
+
+    b.period_us = (uint64_t)b.period_size * 1000000 / b.rate;
+    lat = calloc(b.num_periods, sizeof(uint64_t));
+    if (!lat)
+        return 1;
+
+    printf("rate %u period %u frames (%llu us), %u periods, timeout %d ms\n",
+           b.rate, b.period_size, (unsigned long long)b.period_us,
+           b.num_periods, timeout_ms);
+
+    for (mode = 0; mode < 3; mode++) {
+        memset((void *)&b.pos, 0, sizeof(b.pos));
+        b.done = false;
+        if (pthread_create(&tid, NULL, dsp_thread, &b)) {
+            free(lat);
+            return 1;
+        }
+        if (mode == 0)
+            run_usleep(&b, timeout_ms, lat);
+        else
+            run_timer(&b, timeout_ms, lat, mode == 2);
+        pthread_join(tid, NULL);
+    }
+
+    free(lat);
+    return 0;
+}
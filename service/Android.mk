@@ -34,6 +34,7 @@ LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)/inc/public
 
 LOCAL_SRC_FILES  := \
     src/agm.c\
+    src/agm_async.c\
     src/graph.c\
     src/graph_module.c\
     src/metadata.c\
@@ -200,11 +200,20 @@ struct device_obj {
     int num_virtual_child;
     struct device_obj *parent_dev;
     struct device_group_data *group_data;
+
+    /* deferred closes queued on this backend, opens wait for them */
+    uint32_t close_pending;
+    pthread_cond_t close_cond;
 };
 
 /* Initializes device_obj, enumerate and fill device related information */
 int device_init();
 void device_deinit();
+/* called from the monitor thread when the snd card is back online */
+typedef void (*device_card_online_cb)(void);
+/* watch the snd card state and call cb on every offline to online change */
+int device_card_monitor_start(device_card_online_cb cb);
+void device_card_monitor_stop(void);
 /* Returns list of supported devices */
 int device_get_aif_info_list(struct aif_info *aif_list, size_t *audio_intfs);
 /* returns device_obj associated with device_id */
@@ -218,6 +227,9 @@ int device_prepare(struct device_obj *dev_obj);
 int device_start(struct device_obj *dev_obj);
 int device_stop(struct device_obj *dev_obj);
 int device_close(struct device_obj *dev_obj);
+/* fence opens of the device until device_close_deferred() runs */
+void device_mark_close_pending(struct device_obj *dev_obj);
+int device_close_deferred(struct device_obj *dev_obj);
 
 enum device_state device_current_state(struct device_obj *obj);
 /* api to set device media config */
@@ -228,6 +240,9 @@ int device_set_metadata(struct device_obj *obj, uint32_t size,
                  uint8_t *payload);
 /* api to set device setparam payload */
 int device_set_params(struct device_obj *obj, void *payload, size_t size);
+/* same, keeping payload, which is freed by the device */
+int device_set_params_take(struct device_obj *obj, void *payload,
+                 size_t size);
 
 int populate_device_hw_ep_info(struct device_obj *dev_obj);
 
@@ -240,6 +255,7 @@ int device_get_group_data(uint32_t group_id , struct device_group_data **grp_dat
 int device_get_group_list(struct aif_info *aif_list, size_t *num_groups);
 
 int device_get_start_refcnt(struct device_obj *dev_obj);
+int device_get_open_refcnt(struct device_obj *dev_obj);
 int device_get_state(struct device_obj *dev_obj);
 bool get_file_path_extn(char* file_path_extn);
 #endif
@@ -336,6 +336,18 @@ int graph_eos(struct graph_obj *gph_obj);
  */
 int graph_get_session_time(struct graph_obj *gph_obj, uint64_t *timestamp);
 
+/**
+ *\brief Get the DSP wall clock time at which the running graph started,
+ * derived from the SPR session time and its absolute time.
+ *\param [in] graph_obj: associated graph obj
+ *\param [out] start_time: start time in micro seconds if success
+ *
+ * return AR_EOK on success, -ENODATA if the graph has no SPR module or
+ * is not started, or error code otherwise.
+ */
+int graph_get_session_start_time(struct graph_obj *gph_obj,
+                                 uint64_t *start_time);
+
 /**
  *\brief Get timestamp of the last read buffer
  *\param [in] graph_obj: associated graph obj
@@ -61,6 +61,8 @@ struct aif {
     struct agm_meta_data_gsl sess_aif_meta;
     void *params;
     size_t params_size;
+    /* params were sent to the current graph, kept for recovery replay */
+    bool params_applied;
     struct agm_tag_config *tag_config;
 };
 
@@ -79,6 +81,20 @@ struct session_cb {
     void *client_data;
 };
 
+/*
+ * A single module parameter cached for a session, keyed by
+ * module instance id and param id. data holds the complete
+ * apm_module_param_data_t header and payload, padded to 8 bytes.
+ */
+struct sess_param {
+    struct listnode node;
+    uint32_t miid;
+    uint32_t param_id;
+    bool applied;
+    size_t size;
+    uint8_t *data;
+};
+
 struct session_obj {
     struct listnode node;
     uint32_t sess_id;
@@ -92,14 +108,14 @@ struct session_obj {
     struct agm_media_config out_media_config;
     struct agm_buffer_config in_buffer_config;
     struct agm_buffer_config out_buffer_config;
-    void *params;
-    size_t params_size;
+    struct listnode param_store;
     uint32_t loopback_sess_id;
     bool loopback_state;
     uint32_t ec_ref_aif_id;
     bool ec_ref_state;
     uint32_t rx_metadata_sz;
     uint32_t tx_metadata_sz;
+    struct agm_session_stats stats;
     pthread_mutex_t lock;
     pthread_mutex_t cb_pool_lock;
 };
@@ -125,13 +141,23 @@ int session_obj_set_config(struct session_obj *session,
 int session_obj_prepare(struct session_obj *sess_obj);
 int session_obj_start(struct session_obj *sess_obj);
 int session_obj_stop(struct session_obj *sess_obj);
+int session_obj_group_start(struct session_obj **sessions, uint32_t num,
+                             uint64_t *start_skew_us);
+int session_obj_group_stop(struct session_obj **sessions, uint32_t num);
+int session_obj_recover_all(struct agm_session_recovery_info *info,
+                             size_t *num_sessions);
 int session_obj_close(struct session_obj *sess_obj);
+int session_obj_close_async(struct session_obj *sess_obj);
 int session_obj_pause(struct session_obj *sess_obj);
 int session_obj_flush(struct session_obj *sess_obj);
 int session_obj_resume(struct session_obj *sess_obj);
 int session_obj_suspend(struct session_obj *sess_obj);
 int session_obj_read(struct session_obj *sess_obj, void *buff, size_t *count);
 int session_obj_write(struct session_obj *sess_obj, void *buff, size_t *count);
+int session_obj_get_stats(struct session_obj *sess_obj,
+                          struct agm_session_stats *stats);
+int session_obj_update_stats(struct session_obj *sess_obj,
+                             const struct agm_session_stats *delta);
 int session_obj_sess_aif_connect(struct session_obj *sess_obj,
                              uint32_t audio_intf, bool state);
 int session_obj_set_sess_metadata(struct session_obj *sess_obj, uint32_t size,
@@ -144,6 +170,9 @@ int session_obj_set_sess_params(struct session_obj *sess_obj,
 int session_obj_set_sess_aif_params(struct session_obj *sess_obj,
                              uint32_t audio_intf,
                              void *payload, size_t size);
+int session_obj_set_sess_aif_params_take(struct session_obj *sess_obj,
+                             uint32_t audio_intf,
+                             void *payload, size_t size);
 int session_obj_get_sess_params(struct session_obj *sess_obj,
                              void *payload, size_t size);
 int session_obj_set_sess_aif_params_with_tag(struct session_obj *sess_obj,
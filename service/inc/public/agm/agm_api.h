@@ -567,6 +567,98 @@ typedef void (*agm_event_cb)(uint32_t session_id,
  */
 typedef void (*agm_service_crash_cb)(uint64_t cookie);
 
+/** outcome of restoring one session in agm_recover_all */
+struct agm_session_recovery_info {
+    uint32_t session_id;
+    int status;                 /**< 0 if the session was fully restored */
+    uint64_t recovery_time_us;  /**< time taken to restore the session */
+};
+
+/**
+ * runtime counters of a session, kept from agm_session_open until the
+ * session is opened again. Transfer counts are kept by AGM; xruns, poll
+ * timeouts, position gaps and latency are what the client reported
+ * through agm_session_update_stats.
+ */
+struct agm_session_stats {
+    uint64_t num_writes;            /**< write calls */
+    uint64_t num_reads;             /**< read calls */
+    uint64_t bytes_written;
+    uint64_t bytes_read;
+    uint32_t num_underruns;
+    uint32_t num_overruns;
+    uint32_t num_poll_timeouts;
+    uint32_t max_pos_interval_us;   /**< longest gap between DSP position updates */
+    uint32_t latency_us;            /**< latest end-to-end latency estimate */
+    uint32_t reserved;
+};
+
+/** steps of agm_session_run_ops */
+enum agm_session_op_type {
+    AGM_SESSION_OP_OPEN,             /**< sess_mode */
+    AGM_SESSION_OP_SET_METADATA,     /**< size, payload */
+    AGM_SESSION_OP_AIF_SET_METADATA, /**< aif_id, size, payload */
+    AGM_SESSION_OP_AIF_CONNECT,      /**< aif_id, state */
+    AGM_SESSION_OP_SET_PARAMS,       /**< size, payload */
+    AGM_SESSION_OP_SET_CONFIG,       /**< session, media and buffer config */
+    AGM_SESSION_OP_PREPARE,
+    AGM_SESSION_OP_START,
+    AGM_SESSION_OP_STOP,
+    AGM_SESSION_OP_CLOSE,
+};
+
+/** one step of agm_session_run_ops, only the fields of its type are used */
+struct agm_session_op {
+    enum agm_session_op_type type;
+    enum agm_session_mode sess_mode;
+    uint32_t aif_id;
+    bool state;
+    uint32_t size;
+    void *payload;
+    struct agm_session_config *session_config;
+    struct agm_media_config *media_config;
+    struct agm_buffer_config *buffer_config;
+    int status;                 /**< result, -ECANCELED if not reached */
+};
+
+/** control operations that can be queued with the *_async APIs */
+enum agm_async_op {
+    AGM_ASYNC_OP_OPEN,
+    AGM_ASYNC_OP_AIF_CONNECT,
+    AGM_ASYNC_OP_PREPARE,
+    AGM_ASYNC_OP_START,
+    AGM_ASYNC_OP_STOP,
+    AGM_ASYNC_OP_CLOSE,
+};
+
+/**
+ * \brief Callback function signature for completion of an async operation
+ *
+ * \param[in] session_id - audio session id the operation was queued on
+ * \param[in] hndl - session handle, for AGM_ASYNC_OP_OPEN the new handle
+ * \param[in] op - operation that completed
+ * \param[in] status - 0 on success, error code of the operation otherwise
+ * \param[in] client_data - client data passed with the operation
+ */
+typedef void (*agm_async_cb)(uint32_t session_id, uint64_t hndl,
+              enum agm_async_op op, int status, void *client_data);
+
+/**
+ * Completion of an async operation, copied when the operation is queued.
+ * Any combination can be used: status and hndl are written, then cb is
+ * invoked, then efd is signalled, all from an agm worker thread.
+ * The completion holds pointers and an fd of the caller, so the APIs
+ * taking one are served by libagm only and are not exported over IPC;
+ * a remote client issues the blocking call from its own thread instead.
+ */
+struct agm_async_completion {
+    agm_async_cb cb;       /**< callback, may be NULL */
+    void *client_data;     /**< passed back to cb */
+    int efd;               /**< eventfd to signal, -1 if unused */
+    int *status;           /**< result of the operation, may be NULL */
+    uint64_t *hndl;        /**< session handle, may be NULL */
+};
+
 /**
  *  \brief Initialize agm.
  *
@@ -690,6 +782,23 @@ int agm_session_aif_get_tag_module_info(uint32_t session_id,
 int agm_aif_set_params(uint32_t aif_id,
                         void* payload, size_t size);
 
+/**
+ * \brief Set parameters for modules in audio interface, handing the
+ *        payload to AGM
+ *
+ * Same as agm_aif_set_params(), except that AGM keeps payload itself
+ * instead of a copy of it.
+ *
+ * \param[in] aif_id - Valid audio interface id
+ * \param[in] payload - payload from malloc(), freed by AGM, also when
+ *            the call fails
+ * \param[in] size - payload size in bytes
+ *
+ *  \return 0 on success, error code on failure.
+ */
+int agm_aif_set_params_take(uint32_t aif_id,
+                            void* payload, size_t size);
+
 /**
  * \brief Set parameters for modules in b/w stream and audio interface
  *
@@ -706,6 +815,25 @@ int agm_session_aif_set_params(uint32_t session_id,
                                uint32_t aif_id,
                                void* payload, size_t size);
 
+/**
+ * \brief Set parameters for modules in b/w stream and audio interface,
+ *        handing the payload to AGM
+ *
+ * Same as agm_session_aif_set_params(), except that AGM keeps payload
+ * itself instead of a copy of it.
+ *
+ * \param[in] session_id - Valid audio session id
+ * \param[in] aif_id - Valid audio interface id
+ * \param[in] payload - payload from malloc(), freed by AGM, also when
+ *            the call fails
+ * \param[in] size - payload size in bytes
+ *
+ *  \return 0 on success, error code on failure.
+ */
+int agm_session_aif_set_params_take(uint32_t session_id,
+                                    uint32_t aif_id,
+                                    void* payload, size_t size);
+
 /**
  * \brief Set calibration for modules in b/w stream and audio interface
  *
@@ -869,6 +997,20 @@ int agm_session_set_config(uint64_t hndl,
   */
 int agm_session_close(uint64_t hndl);
 
+/**
+  * \brief Close the session without waiting for the teardown.
+  *        The session is closed and can be reopened on return; graph
+  *        and device teardown completes in the background. Opening a
+  *        session on one of the same backends waits only for the
+  *        teardown of that backend.
+  *
+  * \param[in] handle - Valid session handle obtained
+  *       from agm_session_open
+  *
+  * \return 0 on success, error code otherwise
+  */
+int agm_session_close_async(uint64_t hndl);
+
 /**
   * \brief prepare the session.
   *
@@ -901,6 +1043,38 @@ int agm_session_start(uint64_t hndl);
   */
 int agm_session_stop(uint64_t hndl);
 
+/**
+  * \brief Start a group of sessions together. Sessions not yet
+  *        prepared are prepared first; the graph starts are then issued
+  *        back-to-back under one lock, with a loopback/ec_ref partner in
+  *        the group started before the session that depends on it.
+  *        Either all sessions are started or none is.
+  *
+  * \param[in] handles - array of valid session handles obtained
+  *       from agm_session_open
+  * \param[in] num_handles - number of handles in the array
+  * \param[out] start_skew_us - spread of the DSP start times of the
+  *       sessions in microseconds, 0 if fewer than two sessions report
+  *       their session time. May be NULL.
+  *
+  * \return 0 on success, error code otherwise
+  */
+int agm_session_group_start(uint64_t *handles, uint32_t num_handles,
+                            uint64_t *start_skew_us);
+
+/**
+  * \brief Stop a group of sessions together, dependent sessions
+  *        before their partners. Sessions not in started state
+  *        are skipped.
+  *
+  * \param[in] handles - array of valid session handles obtained
+  *       from agm_session_open
+  * \param[in] num_handles - number of handles in the array
+  *
+  * \return 0 on success, error code otherwise
+  */
+int agm_session_group_stop(uint64_t *handles, uint32_t num_handles);
+
 /**
   * \brief Pause the session. session must be in started state
   *        before resuming.
@@ -1070,6 +1244,31 @@ int agm_get_buffer_timestamp(uint32_t session_id, uint64_t *timestamp);
  */
 int agm_session_get_buf_info(uint32_t session_id, struct agm_buf_info *buf_info, uint32_t flag);
 
+/**
+  * \brief Get the runtime counters of a session.
+  *
+  * \param[in] session_id - Valid audio session id
+  * \param[out] stats - counters since the session was last opened
+  *
+  * \return 0 on success, error code otherwise
+  */
+int agm_session_get_stats(uint32_t session_id, struct agm_session_stats *stats);
+
+/**
+  * \brief Add client side observations to the session counters.
+  *        Counts in delta are added, max_pos_interval_us raises the
+  *        maximum and a non zero latency_us replaces the estimate.
+  *        Transfer counts are kept by AGM and ignored here.
+  *
+  * \param[in] hndl - Valid session handle obtained
+  *       from agm_session_open
+  * \param[in] delta - observations since the previous update
+  *
+  * \return 0 on success, error code otherwise
+  */
+int agm_session_update_stats(uint64_t hndl,
+                             const struct agm_session_stats *delta);
+
 /**
   * \brief This api is a no-op if agm runs in clients context.
   *        In scenarios where AGM runs in its own process context
@@ -1205,6 +1404,144 @@ int agm_session_write_datapath_params(uint32_t session_id, struct agm_buff *buff
   */
 int agm_dump(struct agm_dump_info *dump_info);
 
+/**
+  * \brief Queue agm_session_open without waiting for it.
+  *        Operations queued for one session id complete in the
+  *        order they were queued; different sessions run in parallel.
+  *
+  * \param[in] session_id - Valid audio session id
+  * \param[in] sess_mode - Session mode
+  * \param[in] done - how completion is reported; the new
+  *       handle is passed in the callback and written to done->hndl
+  *
+  * \return 0 if queued, error code otherwise
+  */
+int agm_session_open_async(uint32_t session_id,
+                           enum agm_session_mode sess_mode,
+                           struct agm_async_completion *done);
+
+/**
+  * \brief Queue agm_session_aif_connect without waiting for it.
+  *
+  * \param[in] session_id - Valid audio session id
+  * \param[in] aif_id - Valid audio interface id
+  * \param[in] state - Connect or Disconnect AIF to Session
+  * \param[in] done - how completion is reported
+  *
+  * \return 0 if queued, error code otherwise
+  */
+int agm_session_aif_connect_async(uint32_t session_id, uint32_t aif_id,
+                                  bool state,
+                                  struct agm_async_completion *done);
+
+/**
+  * \brief Queue agm_session_prepare without waiting for it.
+  *
+  * \param[in] hndl - Valid session handle obtained
+  *       from agm_session_open
+  * \param[in] done - how completion is reported
+  *
+  * \return 0 if queued, error code otherwise
+  */
+int agm_session_prepare_async(uint64_t hndl, struct agm_async_completion *done);
+
+/**
+  * \brief Queue agm_session_start without waiting for it.
+  *
+  * \param[in] hndl - Valid session handle obtained
+  *       from agm_session_open
+  * \param[in] done - how completion is reported
+  *
+  * \return 0 if queued, error code otherwise
+  */
+int agm_session_start_async(uint64_t hndl, struct agm_async_completion *done);
+
+/**
+  * \brief Queue agm_session_stop without waiting for it.
+  *
+  * \param[in] hndl - Valid session handle obtained
+  *       from agm_session_open
+  * \param[in] done - how completion is reported
+  *
+  * \return 0 if queued, error code otherwise
+  */
+int agm_session_stop_async(uint64_t hndl, struct agm_async_completion *done);
+
+/**
+  * \brief Queue agm_session_close without waiting for it.
+  *        Unlike agm_session_close_async, the session is closed
+  *        only when the queued close runs.
+  *
+  * \param[in] hndl - Valid session handle obtained
+  *       from agm_session_open
+  * \param[in] done - how completion is reported
+  *
+  * \return 0 if queued, error code otherwise
+  */
+int agm_session_close_queued(uint64_t hndl, struct agm_async_completion *done);
+
+/**
+  * \brief Rebuild every open session after an ADSP restart.
+  *        Graphs and devices of all sessions not in closed state are
+  *        first torn down together, so backends shared by several
+  *        sessions are really closed, then reopened with their metadata,
+  *        calibration, aif connections, configs, cached params and
+  *        loopback/ec_ref links, and prepared and started again if they
+  *        were before. Sessions are restored in parallel, with
+  *        loopback/ec_ref partners ahead of the sessions depending on
+  *        them. AGM runs this itself when the sound card state goes
+  *        from offline back to online; clients can also call it, e.g.
+  *        when they learn of a restart some other way.
+  *
+  * \param[out] info - per session result and recovery time, may be
+  *       NULL
+  * \param[in,out] num_sessions - number of entries in info; on return
+  *       the number of sessions that were restored
+  *
+  * \return 0 if all sessions were restored, -EBUSY if a backend was
+  *       still open after the teardown (nothing is reopened then),
+  *       error code of the first failing session otherwise
+  */
+int agm_recover_all(struct agm_session_recovery_info *info,
+                    size_t *num_sessions);
+
+/**
+  * \brief Get the generation of data that only changes when ACDB data or
+  *        metadata is written through AGM, such as tag module info. It
+  *        changes with every such write and starts at a new value on
+  *        every agm_init(), so a result stays valid as long as the
+  *        generation it was obtained under is current.
+  *
+  * \return current generation
+  */
+uint64_t agm_get_data_generation(void);
+
+/**
+  * \brief Run a list of session operations in one call, typically the
+  *        bring-up (open, metadata, aif connect, set_config, prepare,
+  *        start) or teardown (stop, aif disconnect, close) of a stream.
+  *        Steps run in order and stop at the first failure; each step's
+  *        result is left in its status. On a failure the steps that
+  *        succeeded are undone, last one first: a session opened by the
+  *        list is stopped and closed, aif connects are reversed, and
+  *        session and session aif metadata and session params set by
+  *        the list are cleared (not restored to earlier values).
+  *        set_config, stop and close are not undone. Over IPC
+  *        the whole list is a single request and no other request for
+  *        the session runs in between.
+  *
+  * \param[in] session_id - Valid audio session id
+  * \param[in,out] hndl - session handle the steps work on; set by an
+  *       open step, 0 on return if the session was closed
+  * \param[in,out] ops - steps to run
+  * \param[in] num_ops - number of steps
+  *
+  * \return 0 if all steps succeeded, error code of the failing step
+  *       otherwise
+  */
+int agm_session_run_ops(uint32_t session_id, uint64_t *hndl,
+                        struct agm_session_op *ops, uint32_t num_ops);
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif
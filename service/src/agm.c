@@ -61,6 +61,7 @@
  */
 #define LOG_TAG "AGM: API"
 #include <agm/agm_api.h>
+#include <agm/agm_async.h>
 #include <agm/device.h>
 #include <agm/session_obj.h>
 #include <agm/utils.h>
@@ -68,6 +69,7 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <pthread.h>
+#include <time.h>
 #include <unistd.h>
 
 #ifdef DYNAMIC_LOG_ENABLED
@@ -80,6 +82,13 @@
 static bool agm_initialized = 0;
 static pthread_t ats_thread;
 static const int MAX_RETRIES = 120;
+/* see agm_get_data_generation() */
+static uint64_t data_generation;
+
+static void agm_data_changed(void)
+{
+    __atomic_add_fetch(&data_generation, 1, __ATOMIC_RELEASE);
+}
 
 static void *ats_init_thread(void *obj __unused)
 {
@@ -102,8 +111,22 @@ static void *ats_init_thread(void *obj __unused)
     return NULL;
 }
 
+/* the snd card came back after an ADSP restart, rebuild the sessions */
+static void agm_card_online(void)
+{
+    size_t num_sessions = 0;
+    int ret;
+
+    ret = session_obj_recover_all(NULL, &num_sessions);
+    if (ret)
+        AGM_LOGE("Error:%d recovering %zu sessions\n", ret, num_sessions);
+    else
+        AGM_LOGI("recovered %zu sessions\n", num_sessions);
+}
+
 int agm_init()
 {
+    struct timespec ts;
     int ret = 0;
 
     if (agm_initialized)
@@ -132,6 +155,24 @@ int agm_init()
         AGM_LOGE("Session_obj_init failed with %d", ret);
         goto exit;
     }
+
+    ret = agm_async_init();
+    if (ret) {
+        AGM_LOGE("async init failed with %d, *_async APIs unavailable", ret);
+        ret = 0;
+    }
+
+    ret = device_card_monitor_start(agm_card_online);
+    if (ret) {
+        AGM_LOGE("snd card monitor failed with %d, no recovery on SSR", ret);
+        ret = 0;
+    }
+
+    /* start past anything an earlier instance could have handed out */
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    __atomic_store_n(&data_generation,
+                     (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec,
+                     __ATOMIC_RELEASE);
     agm_initialized = 1;
 
 exit:
@@ -144,6 +185,8 @@ int agm_deinit()
     if (agm_initialized) {
         AGM_LOGD("Deinitializing ATS...");
         ats_deinit();
+        device_card_monitor_stop();
+        agm_async_deinit();
         session_obj_deinit();
         agm_initialized = 0;
     }
@@ -189,6 +232,7 @@ int agm_aif_set_metadata(uint32_t aif_id, uint32_t size, uint8_t *metadata)
                                   "audio_intf id=%d\n", ret, aif_id);
         goto done;
     }
+    agm_data_changed();
 
 done:
     return ret;
@@ -262,6 +306,7 @@ int agm_session_set_metadata(uint32_t session_id,
                                session id=%d\n", ret, session_id);
         goto done;
     }
+    agm_data_changed();
 
 done:
     return ret;
@@ -288,6 +333,7 @@ int agm_session_aif_set_metadata(uint32_t session_id,
           with session id=%d, aif_id=%d\n", ret, session_id, aif_id);
         goto done;
     }
+    agm_data_changed();
 
 done:
     return ret;
@@ -417,6 +463,31 @@ done:
     return ret;
 }
 
+int agm_aif_set_params_take(uint32_t aif_id,
+                        void* payload, size_t size)
+{
+    struct device_obj *obj = NULL;
+    int32_t ret = 0;
+
+    ret = device_get_obj(aif_id, &obj);
+    if (ret) {
+        AGM_LOGE("Error:%d retrieving device obj with audio_intf id=%d\n",
+                                         ret, aif_id);
+        free(payload);
+        goto done;
+    }
+
+    ret = device_set_params_take(obj, payload, size);
+    if (ret) {
+        AGM_LOGE("Error:%d set params for aif_id=%d\n",
+                        ret, aif_id);
+        goto done;
+    }
+
+done:
+    return ret;
+}
+
 int agm_session_aif_set_params(uint32_t session_id,
                         uint32_t aif_id,
                         void* payload, size_t size)
@@ -443,6 +514,33 @@ done:
     return ret;
 }
 
+int agm_session_aif_set_params_take(uint32_t session_id,
+                        uint32_t aif_id,
+                        void* payload, size_t size)
+{
+    struct session_obj *obj = NULL;
+    int ret = 0;
+
+    ret = session_obj_get(session_id, &obj);
+    if (ret) {
+        AGM_LOGE("Error:%d retrieving session obj with \
+                        session id=%d\n", ret, session_id);
+        free(payload);
+        goto done;
+    }
+
+    ret = session_obj_set_sess_aif_params_take(obj, aif_id, payload, size);
+    if (ret) {
+        AGM_LOGE("Error:%d setting parameters for session obj with \
+                                          session id=%d, aif_id=%d\n",
+                                        ret, session_id, aif_id);
+        goto done;
+    }
+
+done:
+    return ret;
+}
+
 int agm_session_get_params(uint32_t session_id,
         void* payload, size_t size)
 {
@@ -535,6 +633,7 @@ int agm_set_params_with_tag_to_acdb(uint32_t session_id, uint32_t aif_id,
                            session id=%d\n", ret, session_id);
         goto done;
     }
+    agm_data_changed();
 
 done:
     return ret;
@@ -579,6 +678,7 @@ int agm_set_params_to_acdb_tunnel(void *payload, size_t size)
          AGM_LOGE("Error get tag list");
          goto error;
     }
+    agm_data_changed();
 
 error:
     return ret;
@@ -749,6 +849,196 @@ int agm_session_stop(uint64_t hndl)
     return session_obj_stop(handle);
 }
 
+static int agm_session_group_get(uint64_t *handles, uint32_t num_handles,
+                                 struct session_obj ***sessions)
+{
+    struct session_obj **group = NULL;
+    uint32_t i;
+
+    if (!handles || num_handles == 0) {
+        AGM_LOGE("Invalid session group\n");
+        return -EINVAL;
+    }
+
+    group = calloc(num_handles, sizeof(struct session_obj *));
+    if (!group)
+        return -ENOMEM;
+
+    for (i = 0; i < num_handles; i++) {
+        if (!handles[i] || !session_obj_valid_check(handles[i])) {
+            AGM_LOGE("Invalid handle at index %d\n", i);
+            free(group);
+            return -EINVAL;
+        }
+        group[i] = (struct session_obj *) handles[i];
+    }
+
+    *sessions = group;
+    return 0;
+}
+
+int agm_session_group_start(uint64_t *handles, uint32_t num_handles,
+                            uint64_t *start_skew_us)
+{
+    struct session_obj **group = NULL;
+    int ret = 0;
+
+    ret = agm_session_group_get(handles, num_handles, &group);
+    if (ret)
+        return ret;
+
+    ret = session_obj_group_start(group, num_handles, start_skew_us);
+    free(group);
+    return ret;
+}
+
+int agm_session_group_stop(uint64_t *handles, uint32_t num_handles)
+{
+    struct session_obj **group = NULL;
+    int ret = 0;
+
+    ret = agm_session_group_get(handles, num_handles, &group);
+    if (ret)
+        return ret;
+
+    ret = session_obj_group_stop(group, num_handles);
+    free(group);
+    return ret;
+}
+
+int agm_recover_all(struct agm_session_recovery_info *info,
+                    size_t *num_sessions)
+{
+    if (!num_sessions) {
+        AGM_LOGE("Error Invalid params\n");
+        return -EINVAL;
+    }
+
+    return session_obj_recover_all(info, num_sessions);
+}
+
+uint64_t agm_get_data_generation(void)
+{
+    return __atomic_load_n(&data_generation, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Undo a step of agm_session_run_ops that succeeded. Metadata and params
+ * are cleared rather than restored, set_config is left for the next
+ * set_config, prepare is undone by closing, and stop and close stay done.
+ */
+static void agm_session_op_undo(uint32_t session_id, uint64_t *hndl,
+                                struct agm_session_op *op)
+{
+    int ret = 0;
+
+    switch (op->type) {
+    case AGM_SESSION_OP_OPEN:
+        if (*hndl) {
+            ret = agm_session_close(*hndl);
+            if (!ret)
+                *hndl = 0;
+        }
+        break;
+    case AGM_SESSION_OP_SET_METADATA:
+        ret = agm_session_set_metadata(session_id, 0, NULL);
+        break;
+    case AGM_SESSION_OP_AIF_SET_METADATA:
+        ret = agm_session_aif_set_metadata(session_id, op->aif_id, 0, NULL);
+        break;
+    case AGM_SESSION_OP_AIF_CONNECT:
+        ret = agm_session_aif_connect(session_id, op->aif_id, !op->state);
+        break;
+    case AGM_SESSION_OP_SET_PARAMS:
+        ret = agm_session_set_params(session_id, NULL, 0);
+        break;
+    case AGM_SESSION_OP_START:
+        if (*hndl)
+            ret = agm_session_stop(*hndl);
+        break;
+    default:
+        break;
+    }
+
+    if (ret)
+        AGM_LOGE("Error:%d undoing op %d of session id=%d\n",
+                 ret, op->type, session_id);
+}
+
+int agm_session_run_ops(uint32_t session_id, uint64_t *hndl,
+                        struct agm_session_op *ops, uint32_t num_ops)
+{
+    struct agm_session_op *op = NULL;
+    uint32_t i;
+    int ret = 0;
+
+    if (!hndl || (!ops && num_ops)) {
+        AGM_LOGE("Error Invalid params\n");
+        return -EINVAL;
+    }
+
+    for (i = 0; i < num_ops; i++)
+        ops[i].status = -ECANCELED;
+
+    for (i = 0; i < num_ops && !ret; i++) {
+        op = &ops[i];
+
+        switch (op->type) {
+        case AGM_SESSION_OP_OPEN:
+            ret = agm_session_open(session_id, op->sess_mode, hndl);
+            break;
+        case AGM_SESSION_OP_SET_METADATA:
+            ret = agm_session_set_metadata(session_id, op->size,
+                                           (uint8_t *)op->payload);
+            break;
+        case AGM_SESSION_OP_AIF_SET_METADATA:
+            ret = agm_session_aif_set_metadata(session_id, op->aif_id,
+                                               op->size,
+                                               (uint8_t *)op->payload);
+            break;
+        case AGM_SESSION_OP_AIF_CONNECT:
+            ret = agm_session_aif_connect(session_id, op->aif_id, op->state);
+            break;
+        case AGM_SESSION_OP_SET_PARAMS:
+            ret = agm_session_set_params(session_id, op->payload, op->size);
+            break;
+        case AGM_SESSION_OP_SET_CONFIG:
+            ret = agm_session_set_config(*hndl, op->session_config,
+                                         op->media_config,
+                                         op->buffer_config);
+            break;
+        case AGM_SESSION_OP_PREPARE:
+            ret = agm_session_prepare(*hndl);
+            break;
+        case AGM_SESSION_OP_START:
+            ret = agm_session_start(*hndl);
+            break;
+        case AGM_SESSION_OP_STOP:
+            ret = agm_session_stop(*hndl);
+            break;
+        case AGM_SESSION_OP_CLOSE:
+            ret = agm_session_close(*hndl);
+            if (!ret)
+                *hndl = 0;
+            break;
+        default:
+            ret = -EINVAL;
+            break;
+        }
+        op->status = ret;
+    }
+
+    if (ret) {
+        AGM_LOGE("Error:%d in step %d (op %d) of session id=%d\n",
+                 ret, i - 1, op->type, session_id);
+        /* roll back the steps that succeeded, last one first */
+        for (i = i - 1; i > 0; i--)
+            agm_session_op_undo(session_id, hndl, &ops[i - 1]);
+    }
+
+    return ret;
+}
+
 int agm_session_close(uint64_t hndl)
 {
     struct session_obj *handle = (struct session_obj *) hndl;
@@ -764,6 +1054,21 @@ int agm_session_close(uint64_t hndl)
     return session_obj_close(handle);
 }
 
+int agm_session_close_async(uint64_t hndl)
+{
+    struct session_obj *handle = (struct session_obj *) hndl;
+    if (!handle) {
+        AGM_LOGE("Invalid handle\n");
+        return -EINVAL;
+    }
+
+    if (!session_obj_valid_check(hndl)) {
+        AGM_LOGE("Invalid handle\n");
+        return -EINVAL;
+    }
+    return session_obj_close_async(handle);
+}
+
 int agm_session_pause(uint64_t hndl)
 {
     struct session_obj *handle = (struct session_obj *) hndl;
@@ -987,6 +1292,44 @@ done:
     return ret;
 }
 
+int agm_session_get_stats(uint32_t session_id, struct agm_session_stats *stats)
+{
+    struct session_obj *obj = NULL;
+    int ret = 0;
+
+    if (!stats) {
+        AGM_LOGE("Invalid stats pointer\n");
+        return -EINVAL;
+    }
+
+    ret = session_obj_get(session_id, &obj);
+    if (ret) {
+        AGM_LOGE("Error:%d retrieving session obj with session id=%d\n",
+                 ret, session_id);
+        return ret;
+    }
+
+    return session_obj_get_stats(obj, stats);
+}
+
+int agm_session_update_stats(uint64_t hndl,
+                             const struct agm_session_stats *delta)
+{
+    struct session_obj *handle = (struct session_obj *) hndl;
+
+    if (!handle || !delta) {
+        AGM_LOGE("Invalid handle or stats\n");
+        return -EINVAL;
+    }
+
+    if (!session_obj_valid_check(hndl)) {
+        AGM_LOGE("Invalid handle\n");
+        return -EINVAL;
+    }
+
+    return session_obj_update_stats(handle, delta);
+}
+
 int agm_register_service_crash_callback(agm_service_crash_cb cb __unused,
                                         uint64_t cookie __unused)
 {
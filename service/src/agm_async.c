@@ -0,0 +1,384 @@
+/*
+ * Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the
+ * disclaimer below) provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *
+ *     * Neither the name of Qualcomm Innovation Center, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE
+ * GRANTED BY THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT
+ * HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define LOG_TAG "AGM: async"
+#include <agm/agm_api.h>
+#include <agm/agm_async.h>
+#include <agm/session_obj.h>
+#include <agm/utils.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifdef DYNAMIC_LOG_ENABLED
+#include <log_xml_parser.h>
+#define LOG_MASK AGM_MOD_FILE_AGM_SRC
+#include <log_utils.h>
+#endif
+
+#define AGM_ASYNC_NUM_WORKERS 4
+
+struct async_cmd {
+    struct listnode node;
+    enum agm_async_op op;
+    uint64_t hndl;
+    uint32_t session_id;
+    enum agm_session_mode sess_mode;
+    uint32_t aif_id;
+    bool state;
+    struct agm_async_completion done;
+};
+
+/*
+ * Commands of one session run one at a time and in submission order; a
+ * queue is on the ready list only while it has commands and no worker is
+ * running one of them, so different sessions proceed in parallel.
+ */
+struct async_session_queue {
+    struct listnode node;
+    struct listnode ready_node;
+    uint32_t session_id;
+    struct listnode cmds;
+    bool busy;
+};
+
+static struct listnode queue_list;
+static struct listnode ready_list;
+static pthread_mutex_t async_lock;
+static pthread_cond_t async_cond;
+static pthread_t workers[AGM_ASYNC_NUM_WORKERS];
+static int num_workers;
+static bool async_exit;
+
+static struct async_session_queue *async_queue_get(uint32_t session_id)
+{
+    struct async_session_queue *q = NULL;
+    struct listnode *node;
+
+    list_for_each(node, &queue_list) {
+        q = node_to_item(node, struct async_session_queue, node);
+        if (q->session_id == session_id)
+            return q;
+    }
+
+    q = calloc(1, sizeof(struct async_session_queue));
+    if (!q)
+        return NULL;
+
+    q->session_id = session_id;
+    list_init(&q->cmds);
+    list_init(&q->ready_node);
+    list_add_tail(&queue_list, &q->node);
+
+    return q;
+}
+
+static void async_cmd_complete(struct async_cmd *cmd, uint64_t hndl, int status)
+{
+    uint64_t val = 1;
+
+    if (cmd->done.status)
+        *cmd->done.status = status;
+    if (cmd->done.hndl)
+        *cmd->done.hndl = hndl;
+
+    if (cmd->done.cb)
+        cmd->done.cb(cmd->session_id, hndl, cmd->op, status,
+                     cmd->done.client_data);
+
+    if (cmd->done.efd >= 0 &&
+        write(cmd->done.efd, &val, sizeof(val)) != sizeof(val))
+        AGM_LOGE("Error:%d signalling eventfd for session id:%d\n",
+                 errno, cmd->session_id);
+}
+
+static void async_cmd_run(struct async_cmd *cmd)
+{
+    int ret = 0;
+    uint64_t hndl = cmd->hndl;
+
+    switch (cmd->op) {
+    case AGM_ASYNC_OP_OPEN:
+        ret = agm_session_open(cmd->session_id, cmd->sess_mode, &hndl);
+        break;
+    case AGM_ASYNC_OP_AIF_CONNECT:
+        ret = agm_session_aif_connect(cmd->session_id, cmd->aif_id,
+                                      cmd->state);
+        break;
+    case AGM_ASYNC_OP_PREPARE:
+        ret = agm_session_prepare(hndl);
+        break;
+    case AGM_ASYNC_OP_START:
+        ret = agm_session_start(hndl);
+        break;
+    case AGM_ASYNC_OP_STOP:
+        ret = agm_session_stop(hndl);
+        break;
+    case AGM_ASYNC_OP_CLOSE:
+        ret = agm_session_close(hndl);
+        break;
+    default:
+        ret = -EINVAL;
+        break;
+    }
+
+    if (ret)
+        AGM_LOGE("Error:%d async op %d on session id:%d\n",
+                 ret, cmd->op, cmd->session_id);
+
+    async_cmd_complete(cmd, hndl, ret);
+}
+
+static void *async_worker(void *arg __unused)
+{
+    struct async_session_queue *q;
+    struct async_cmd *cmd;
+
+    pthread_mutex_lock(&async_lock);
+    while (true) {
+        if (list_empty(&ready_list)) {
+            if (async_exit)
+                break;
+            pthread_cond_wait(&async_cond, &async_lock);
+            continue;
+        }
+
+        q = node_to_item(list_head(&ready_list),
+                         struct async_session_queue, ready_node);
+        list_remove(&q->ready_node);
+        list_init(&q->ready_node);
+        q->busy = true;
+
+        cmd = node_to_item(list_head(&q->cmds), struct async_cmd, node);
+        list_remove(&cmd->node);
+        pthread_mutex_unlock(&async_lock);
+
+        async_cmd_run(cmd);
+        free(cmd);
+
+        pthread_mutex_lock(&async_lock);
+        q->busy = false;
+        if (!list_empty(&q->cmds)) {
+            list_add_tail(&ready_list, &q->ready_node);
+        } else {
+            list_remove(&q->node);
+            free(q);
+        }
+    }
+    pthread_mutex_unlock(&async_lock);
+
+    return NULL;
+}
+
+static int async_submit(struct async_cmd *cmd)
+{
+    int ret = 0;
+    struct async_session_queue *q;
+
+    pthread_mutex_lock(&async_lock);
+    if (!num_workers || async_exit) {
+        AGM_LOGE("async command queue not running\n");
+        ret = -ENODEV;
+        goto done;
+    }
+
+    q = async_queue_get(cmd->session_id);
+    if (!q) {
+        AGM_LOGE("No memory for command queue of session id:%d\n",
+                 cmd->session_id);
+        ret = -ENOMEM;
+        goto done;
+    }
+
+    list_add_tail(&q->cmds, &cmd->node);
+    if (!q->busy && list_empty(&q->ready_node)) {
+        list_add_tail(&ready_list, &q->ready_node);
+        pthread_cond_signal(&async_cond);
+    }
+
+done:
+    pthread_mutex_unlock(&async_lock);
+    return ret;
+}
+
+static int async_queue_cmd(enum agm_async_op op, uint64_t hndl,
+                           uint32_t session_id,
+                           struct agm_async_completion *done,
+                           struct async_cmd **out)
+{
+    struct async_cmd *cmd = NULL;
+
+    if (!done) {
+        AGM_LOGE("Invalid completion\n");
+        return -EINVAL;
+    }
+
+    cmd = calloc(1, sizeof(struct async_cmd));
+    if (!cmd) {
+        AGM_LOGE("No memory for async command\n");
+        return -ENOMEM;
+    }
+
+    cmd->op = op;
+    cmd->hndl = hndl;
+    cmd->session_id = session_id;
+    cmd->done = *done;
+    *out = cmd;
+
+    return 0;
+}
+
+static int async_submit_hndl(enum agm_async_op op, uint64_t hndl,
+                             struct agm_async_completion *done)
+{
+    struct async_cmd *cmd = NULL;
+    int ret = 0;
+
+    if (!hndl || !session_obj_valid_check(hndl)) {
+        AGM_LOGE("Invalid handle\n");
+        return -EINVAL;
+    }
+
+    ret = async_queue_cmd(op, hndl, ((struct session_obj *)hndl)->sess_id,
+                          done, &cmd);
+    if (ret)
+        return ret;
+
+    ret = async_submit(cmd);
+    if (ret)
+        free(cmd);
+
+    return ret;
+}
+
+int agm_session_open_async(uint32_t session_id,
+                           enum agm_session_mode sess_mode,
+                           struct agm_async_completion *done)
+{
+    struct async_cmd *cmd = NULL;
+    int ret = 0;
+
+    ret = async_queue_cmd(AGM_ASYNC_OP_OPEN, 0, session_id, done, &cmd);
+    if (ret)
+        return ret;
+
+    cmd->sess_mode = sess_mode;
+    ret = async_submit(cmd);
+    if (ret)
+        free(cmd);
+
+    return ret;
+}
+
+int agm_session_aif_connect_async(uint32_t session_id, uint32_t aif_id,
+                                  bool state,
+                                  struct agm_async_completion *done)
+{
+    struct async_cmd *cmd = NULL;
+    int ret = 0;
+
+    ret = async_queue_cmd(AGM_ASYNC_OP_AIF_CONNECT, 0, session_id, done,
+                          &cmd);
+    if (ret)
+        return ret;
+
+    cmd->aif_id = aif_id;
+    cmd->state = state;
+    ret = async_submit(cmd);
+    if (ret)
+        free(cmd);
+
+    return ret;
+}
+
+int agm_session_prepare_async(uint64_t hndl, struct agm_async_completion *done)
+{
+    return async_submit_hndl(AGM_ASYNC_OP_PREPARE, hndl, done);
+}
+
+int agm_session_start_async(uint64_t hndl, struct agm_async_completion *done)
+{
+    return async_submit_hndl(AGM_ASYNC_OP_START, hndl, done);
+}
+
+int agm_session_stop_async(uint64_t hndl, struct agm_async_completion *done)
+{
+    return async_submit_hndl(AGM_ASYNC_OP_STOP, hndl, done);
+}
+
+int agm_session_close_queued(uint64_t hndl, struct agm_async_completion *done)
+{
+    return async_submit_hndl(AGM_ASYNC_OP_CLOSE, hndl, done);
+}
+
+int agm_async_init()
+{
+    int ret = 0;
+    int i;
+
+    list_init(&queue_list);
+    list_init(&ready_list);
+    pthread_mutex_init(&async_lock, (const pthread_mutexattr_t *) NULL);
+    pthread_cond_init(&async_cond, (const pthread_condattr_t *) NULL);
+    async_exit = false;
+    num_workers = 0;
+
+    for (i = 0; i < AGM_ASYNC_NUM_WORKERS; i++) {
+        ret = pthread_create(&workers[i], (const pthread_attr_t *) NULL,
+                             async_worker, NULL);
+        if (ret) {
+            AGM_LOGE("Error:%d creating async worker %d\n", ret, i);
+            break;
+        }
+        num_workers++;
+    }
+
+    return num_workers ? 0 : -ret;
+}
+
+void agm_async_deinit()
+{
+    int i;
+
+    /* commands already queued still complete */
+    pthread_mutex_lock(&async_lock);
+    async_exit = true;
+    pthread_cond_broadcast(&async_cond);
+    pthread_mutex_unlock(&async_lock);
+
+    for (i = 0; i < num_workers; i++)
+        pthread_join(workers[i], (void **) NULL);
+    num_workers = 0;
+}
@@ -34,6 +34,8 @@
 #define LOG_TAG "AGM: device"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
 #include <sched.h>
 #include <stdio.h>
@@ -42,6 +44,7 @@
 #include <unistd.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <sys/eventfd.h>
 #include <agm/device.h>
 #include <agm/metadata.h>
 #include <agm/utils.h>
@@ -82,6 +85,10 @@ static snd_ctl_t *mixer;
 static struct mixer *mixer = NULL;
 #endif
 
+static pthread_t card_monitor_thread;
+static int card_monitor_efd = -1;
+static device_card_online_cb card_online_cb;
+
 #define MAX_BUF_SIZE                 2048
 /**
   * The maximum period bytes for dummy dai is 8192 bytes.
@@ -148,6 +155,19 @@ static struct device_obj *device_get_pcm_obj(struct device_obj *dev_obj)
         return dev_obj;
 }
 
+/*
+ * A session closed with agm_session_close_async may still be stopping and
+ * closing this backend on the teardown worker; opens wait for it here.
+ * Caller holds obj->lock.
+ */
+static void device_wait_close_pending(struct device_obj *obj)
+{
+    while (obj->close_pending) {
+        AGM_LOGD("PCM device %u waiting for deferred close\n", obj->pcm_id);
+        pthread_cond_wait(&obj->close_cond, &obj->lock);
+    }
+}
+
 #ifdef DEVICE_USES_ALSALIB
 snd_pcm_format_t agm_to_alsa_format(enum agm_media_format format)
 {
@@ -193,6 +213,7 @@ int device_open(struct device_obj *dev_obj)
              SND_PCM_STREAM_PLAYBACK : SND_PCM_STREAM_CAPTURE;
 
     pthread_mutex_lock(&obj->lock);
+    device_wait_close_pending(obj);
 
     if (obj->group_data)
         grp_data = obj->group_data;
@@ -288,6 +309,7 @@ int device_open(struct device_obj *dev_obj)
 
     obj = device_get_pcm_obj(dev_obj);
     pthread_mutex_lock(&obj->lock);
+    device_wait_close_pending(obj);
 
     if (obj->group_data)
         grp_data = obj->group_data;
@@ -520,6 +542,30 @@ done:
     return ret;
 }
 
+void device_mark_close_pending(struct device_obj *dev_obj)
+{
+    struct device_obj *obj = device_get_pcm_obj(dev_obj);
+
+    pthread_mutex_lock(&obj->lock);
+    obj->close_pending++;
+    pthread_mutex_unlock(&obj->lock);
+}
+
+int device_close_deferred(struct device_obj *dev_obj)
+{
+    int ret = 0;
+    struct device_obj *obj = device_get_pcm_obj(dev_obj);
+
+    ret = device_close(dev_obj);
+
+    pthread_mutex_lock(&obj->lock);
+    if (obj->close_pending && --obj->close_pending == 0)
+        pthread_cond_broadcast(&obj->close_cond);
+    pthread_mutex_unlock(&obj->lock);
+
+    return ret;
+}
+
 enum device_state device_current_state(struct device_obj *dev_obj)
 {
     return dev_obj->state;
@@ -664,30 +710,30 @@ int device_set_metadata(struct device_obj *dev_obj, uint32_t size,
 int device_set_params(struct device_obj *dev_obj,
                       void *payload, size_t size)
 {
-   int ret = 0;
+   void *params;
 
-   pthread_mutex_lock(&dev_obj->lock);
-
-   if (dev_obj->params) {
-       free(dev_obj->params);
-       dev_obj->params = NULL;
-       dev_obj->params_size = 0;
-   }
-
-   dev_obj->params = calloc(1, size);
-   if (!dev_obj->params) {
+   params = calloc(1, size);
+   if (!params) {
        AGM_LOGE("No memory for dev params on dev_id:%d\n",
                                    dev_obj->pcm_id);
-       ret = -EINVAL;
-       goto done;
+       return -EINVAL;
    }
 
-   memcpy(dev_obj->params, payload, size);
+   memcpy(params, payload, size);
+   return device_set_params_take(dev_obj, params, size);
+}
+
+int device_set_params_take(struct device_obj *dev_obj,
+                           void *payload, size_t size)
+{
+   pthread_mutex_lock(&dev_obj->lock);
+
+   free(dev_obj->params);
+   dev_obj->params = payload;
    dev_obj->params_size = size;
 
-done:
    pthread_mutex_unlock(&dev_obj->lock);
-   return ret;
+   return 0;
 }
 
 #ifdef DEVICE_USES_ALSALIB
@@ -852,6 +898,24 @@ int device_get_start_refcnt(struct device_obj *dev_obj)
 
 }
 
+int device_get_open_refcnt(struct device_obj *dev_obj)
+{
+    int refcnt;
+    struct device_obj *obj = NULL;
+
+    if (dev_obj == NULL) {
+        AGM_LOGE("Invalid device object\n");
+        return 0;
+    }
+
+    obj = device_get_pcm_obj(dev_obj);
+    pthread_mutex_lock(&obj->lock);
+    refcnt = obj->refcnt.open;
+    pthread_mutex_unlock(&obj->lock);
+
+    return refcnt;
+}
+
 int device_get_state(struct device_obj *dev_obj)
 {
     if (dev_obj == NULL) {
@@ -952,6 +1016,7 @@ int parse_snd_card()
         }
 
         pthread_mutex_init(&dev_obj->lock, (const pthread_mutexattr_t *) NULL);
+        pthread_cond_init(&dev_obj->close_cond, (const pthread_condattr_t *) NULL);
         list_add_tail(&device_list, &dev_obj->list_node);
         count++;
         if (dev_obj->num_virtual_child) {
@@ -1038,6 +1103,112 @@ static int wait_for_snd_card_to_online()
     return ret;
 }
 
+static snd_card_status_t read_snd_card_status(int fd)
+{
+    char buf[2];
+    snd_card_status_t card_status = SND_CARD_STATUS_NONE;
+
+    memset(buf, 0, sizeof(buf));
+    lseek(fd, 0L, SEEK_SET);
+    if (read(fd, buf, 1) != 1)
+        return SND_CARD_STATUS_NONE;
+
+    sscanf(buf, "%d", &card_status);
+    return card_status;
+}
+
+static void *card_monitor_thread_loop(void *arg __unused)
+{
+    struct pollfd fds[2];
+    snd_card_status_t prev, cur;
+    int fd;
+
+    fd = open(SNDCARD_PATH, O_RDONLY);
+    if (fd < 0) {
+        AGM_LOGE("Error:%d opening %s, no recovery on SSR\n", -errno,
+                 SNDCARD_PATH);
+        return NULL;
+    }
+
+    /* sysfs only flags a change made after the attribute was last read */
+    prev = read_snd_card_status(fd);
+
+    fds[0].fd = fd;
+    fds[0].events = POLLPRI | POLLERR;
+    fds[1].fd = card_monitor_efd;
+    fds[1].events = POLLIN;
+
+    while (1) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            AGM_LOGE("Error:%d polling snd card state\n", -errno);
+            break;
+        }
+        if (fds[1].revents & POLLIN)
+            break;
+        if (!(fds[0].revents & (POLLPRI | POLLERR)))
+            continue;
+
+        cur = read_snd_card_status(fd);
+        if (cur == prev || cur == SND_CARD_STATUS_NONE)
+            continue;
+
+        AGM_LOGI("snd card state %d -> %d\n", prev, cur);
+        if (prev == SND_CARD_STATUS_OFFLINE && cur == SND_CARD_STATUS_ONLINE)
+            card_online_cb();
+        prev = cur;
+    }
+
+    close(fd);
+    return NULL;
+}
+
+int device_card_monitor_start(device_card_online_cb cb)
+{
+    int ret = 0;
+
+    if (!cb || card_monitor_efd >= 0)
+        return -EINVAL;
+
+    card_monitor_efd = eventfd(0, EFD_CLOEXEC);
+    if (card_monitor_efd < 0) {
+        ret = -errno;
+        AGM_LOGE("Error:%d creating eventfd\n", ret);
+        return ret;
+    }
+
+    card_online_cb = cb;
+    ret = pthread_create(&card_monitor_thread, (const pthread_attr_t *) NULL,
+                         card_monitor_thread_loop, NULL);
+    if (ret) {
+        AGM_LOGE("Error:%d creating snd card monitor thread\n", ret);
+        close(card_monitor_efd);
+        card_monitor_efd = -1;
+        card_online_cb = NULL;
+        return -ret;
+    }
+
+    return 0;
+}
+
+void device_card_monitor_stop(void)
+{
+    uint64_t val = 1;
+
+    if (card_monitor_efd < 0)
+        return;
+
+    if (write(card_monitor_efd, &val, sizeof(val)) != sizeof(val))
+        AGM_LOGE("Error:%d stopping snd card monitor\n", -errno);
+    else
+        pthread_join(card_monitor_thread, (void **) NULL);
+
+    close(card_monitor_efd);
+    card_monitor_efd = -1;
+    card_online_cb = NULL;
+}
+
 int device_init()
 {
     int ret = 0;
@@ -1880,7 +1880,13 @@ int graph_eos(struct graph_obj *graph_obj)
     return ar_err_get_lnx_err_code(ret);
 }
 
-int graph_get_session_time(struct graph_obj *graph_obj, uint64_t *tstamp)
+/*
+ * Query SPR for the session time and the DSP absolute time at which it was
+ * sampled. Leaves the outputs untouched if the graph is not started or has
+ * no SPR module. Caller holds graph_obj->lock.
+ */
+static int graph_query_spr_time(struct graph_obj *graph_obj,
+                                uint64_t *session_time, uint64_t *abs_time)
 {
     int ret = 0;
     uint8_t *payload = NULL;
@@ -1889,12 +1895,6 @@ int graph_get_session_time(struct graph_obj *graph_obj, uint64_t *tstamp)
     size_t payload_size = 0;
     uint64_t timestamp;
 
-    if (graph_obj == NULL || tstamp == NULL) {
-        AGM_LOGE("Invalid Input Params\n");
-        return -EINVAL;
-    }
-
-    pthread_mutex_lock(&graph_obj->lock);
     if (!(graph_obj->state & (STARTED))) {
        AGM_LOGV("graph object is not in correct state, current state %d\n",
                     graph_obj->state);
@@ -1942,15 +1942,59 @@ int graph_get_session_time(struct graph_obj *graph_obj, uint64_t *tstamp)
 
     timestamp = (uint64_t)sess_time->session_time.value_msw;
     timestamp = timestamp  << 32 | sess_time->session_time.value_lsw;
-    *tstamp = timestamp;
+    *session_time = timestamp;
+
+    if (abs_time) {
+        timestamp = (uint64_t)sess_time->absolute_time.value_msw;
+        timestamp = timestamp  << 32 | sess_time->absolute_time.value_lsw;
+        *abs_time = timestamp;
+    }
 
 get_fail:
     free(payload);
 done:
+    return ret;
+}
+
+int graph_get_session_time(struct graph_obj *graph_obj, uint64_t *tstamp)
+{
+    int ret = 0;
+
+    if (graph_obj == NULL || tstamp == NULL) {
+        AGM_LOGE("Invalid Input Params\n");
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&graph_obj->lock);
+    ret = graph_query_spr_time(graph_obj, tstamp, NULL);
     pthread_mutex_unlock(&graph_obj->lock);
     return ret;
 }
 
+int graph_get_session_start_time(struct graph_obj *graph_obj,
+                                 uint64_t *start_time)
+{
+    int ret = 0;
+    uint64_t session_time = 0, abs_time = 0;
+
+    if (graph_obj == NULL || start_time == NULL) {
+        AGM_LOGE("Invalid Input Params\n");
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&graph_obj->lock);
+    ret = graph_query_spr_time(graph_obj, &session_time, &abs_time);
+    pthread_mutex_unlock(&graph_obj->lock);
+    if (ret)
+        return ret;
+
+    if (abs_time == 0 || abs_time < session_time)
+        return -ENODATA;
+
+    *start_time = abs_time - session_time;
+    return 0;
+}
+
 int graph_get_buffer_timestamp(struct graph_obj *graph_obj, uint64_t *tstamp)
 {
     int ret = 0;
@@ -35,7 +35,9 @@
 
 #include <malloc.h>
 #include <string.h>
+#include <time.h>
 #include <agm/session_obj.h>
+#include <agm/graph_module.h>
 #include <agm/utils.h>
 
 #ifdef DYNAMIC_LOG_ENABLED
@@ -142,6 +144,202 @@ uint32_t aif_obj_get_count_with_state(struct session_obj *sess_obj,
     return count;
 }
 
+static struct sess_param *sess_param_get(struct session_obj *sess_obj,
+                                         uint32_t miid, uint32_t param_id)
+{
+    struct listnode *node;
+    struct sess_param *param;
+
+    list_for_each(node, &sess_obj->param_store) {
+        param = node_to_item(node, struct sess_param, node);
+        if (param->miid == miid && param->param_id == param_id)
+            return param;
+    }
+
+    return NULL;
+}
+
+static void sess_param_store_free(struct session_obj *sess_obj)
+{
+    struct sess_param *param;
+    struct listnode *node, *next;
+
+    list_for_each_safe(node, next, &sess_obj->param_store) {
+        param = node_to_item(node, struct sess_param, node);
+        list_remove(&param->node);
+        free(param->data);
+        free(param);
+    }
+}
+
+static void sess_param_store_invalidate(struct session_obj *sess_obj)
+{
+    struct listnode *node;
+    struct sess_param *param;
+
+    list_for_each(node, &sess_obj->param_store) {
+        param = node_to_item(node, struct sess_param, node);
+        param->applied = false;
+    }
+}
+
+/*
+ * Merge a set_params payload (a list of apm_module_param_data_t entries)
+ * into the session parameter store. Entries whose bytes match what is
+ * already stored and applied are dropped, everything else replaces the
+ * stored copy and is appended to the delta payload which the caller
+ * sends to the graph, if open.
+ */
+static int sess_param_store_update(struct session_obj *sess_obj,
+                                   uint8_t *payload, size_t size,
+                                   uint8_t *delta, size_t *delta_size)
+{
+    struct apm_module_param_data_t *header;
+    struct sess_param *param;
+    size_t offset = 0, len, aligned_len;
+    uint8_t *data;
+
+    *delta_size = 0;
+    while (offset < size) {
+        if (size - offset < sizeof(struct apm_module_param_data_t)) {
+            AGM_LOGE("truncated param header at offset %zu, size %zu\n",
+                      offset, size);
+            return -EINVAL;
+        }
+
+        header = (struct apm_module_param_data_t *)(payload + offset);
+        len = sizeof(struct apm_module_param_data_t) + header->param_size;
+        if (len > size - offset) {
+            AGM_LOGE("param 0x%x of miid 0x%x exceeds payload size %zu\n",
+                      header->param_id, header->module_instance_id, size);
+            return -EINVAL;
+        }
+        aligned_len = len;
+        ALIGN_PAYLOAD(aligned_len, 8);
+
+        param = sess_param_get(sess_obj, header->module_instance_id,
+                               header->param_id);
+        if (param && param->applied &&
+            ((struct apm_module_param_data_t *)param->data)->param_size ==
+                                                     header->param_size &&
+            !memcmp(param->data + sizeof(struct apm_module_param_data_t),
+                    payload + offset + sizeof(struct apm_module_param_data_t),
+                    header->param_size)) {
+            AGM_LOGV("skip unchanged param 0x%x miid 0x%x sess_id:%d\n",
+                      header->param_id, header->module_instance_id,
+                      sess_obj->sess_id);
+            goto next;
+        }
+
+        data = calloc(1, aligned_len);
+        if (!data) {
+            AGM_LOGE("No memory for param 0x%x on sess_id:%d\n",
+                      header->param_id, sess_obj->sess_id);
+            return -ENOMEM;
+        }
+        memcpy(data, header, len);
+
+        if (!param) {
+            param = calloc(1, sizeof(struct sess_param));
+            if (!param) {
+                AGM_LOGE("No memory for param node on sess_id:%d\n",
+                          sess_obj->sess_id);
+                free(data);
+                return -ENOMEM;
+            }
+            param->miid = header->module_instance_id;
+            param->param_id = header->param_id;
+            list_add_tail(&sess_obj->param_store, &param->node);
+        }
+        free(param->data);
+        param->data = data;
+        param->size = aligned_len;
+        param->applied = false;
+
+        memcpy(delta + *delta_size, data, aligned_len);
+        *delta_size += aligned_len;
+next:
+        offset += (aligned_len < size - offset) ? aligned_len : size - offset;
+    }
+
+    return 0;
+}
+
+static void sess_param_store_mark_applied(struct session_obj *sess_obj,
+                                          uint8_t *delta, size_t delta_size,
+                                          bool applied)
+{
+    struct apm_module_param_data_t *header;
+    struct sess_param *param;
+    size_t offset = 0, len;
+
+    while (offset < delta_size) {
+        header = (struct apm_module_param_data_t *)(delta + offset);
+        param = sess_param_get(sess_obj, header->module_instance_id,
+                               header->param_id);
+        if (param)
+            param->applied = applied;
+        len = sizeof(struct apm_module_param_data_t) + header->param_size;
+        ALIGN_PAYLOAD(len, 8);
+        offset += len;
+    }
+}
+
+/*
+ * Send every stored session param to a freshly opened graph in a single
+ * set_config. On failure the store is dropped so a stale payload cannot
+ * break the next usecase, matching the old one-shot cache behaviour.
+ */
+static int session_replay_params(struct session_obj *sess_obj,
+                                 struct graph_obj *graph)
+{
+    int ret = 0;
+    struct listnode *node;
+    struct sess_param *param;
+    size_t batch_size = 0;
+    uint8_t *batch = NULL;
+
+    list_for_each(node, &sess_obj->param_store) {
+        param = node_to_item(node, struct sess_param, node);
+        batch_size += param->size;
+    }
+
+    if (batch_size == 0)
+        goto done;
+
+    batch = calloc(1, batch_size);
+    if (!batch) {
+        AGM_LOGE("No memory to replay params on sess_id:%d\n",
+                  sess_obj->sess_id);
+        ret = -ENOMEM;
+        goto free_store;
+    }
+
+    batch_size = 0;
+    list_for_each(node, &sess_obj->param_store) {
+        param = node_to_item(node, struct sess_param, node);
+        memcpy(batch + batch_size, param->data, param->size);
+        batch_size += param->size;
+    }
+
+    ret = graph_set_config(graph, batch, batch_size);
+    free(batch);
+    if (ret == 0) {
+        list_for_each(node, &sess_obj->param_store) {
+            param = node_to_item(node, struct sess_param, node);
+            param->applied = true;
+        }
+        goto done;
+    }
+
+free_store:
+    AGM_LOGE("Error:%d replaying session params: %d\n",
+              ret, sess_obj->sess_id);
+    sess_param_store_free(sess_obj);
+done:
+    return ret;
+}
+
 static struct agm_meta_data_gsl* session_get_merged_metadata(struct session_obj *sess_obj)
 {
     struct agm_meta_data_gsl *merged = NULL;
@@ -251,8 +449,8 @@ static void sess_obj_free(struct session_obj *sess_obj)
 {
     aif_pool_free(sess_obj);
     session_cb_pool_free(sess_obj);
+    sess_param_store_free(sess_obj);
     metadata_free(&sess_obj->sess_meta);
-    free(sess_obj->params);
     free(sess_obj);
 }
 
@@ -294,6 +492,7 @@ static struct session_obj* session_obj_create(int session_id)
     obj->sess_id = session_id;
     list_init(&obj->aif_pool);
     list_init(&obj->cb_pool);
+    list_init(&obj->param_store);
     pthread_mutex_init(&obj->lock, (const pthread_mutexattr_t *) NULL);
     pthread_mutex_init(&obj->cb_pool_lock, (const pthread_mutexattr_t *) NULL);
 
@@ -766,32 +965,22 @@ static int session_connect_aif(struct session_obj *sess_obj,
             }
     }
 
-    //step 2.c set cached params for stream only in closed
-    if (sess_obj->state == SESSION_CLOSED && sess_obj->params != NULL) {
-        ret = graph_set_config(graph, sess_obj->params, sess_obj->params_size);
-        /* clean up params irrespective of success or failure to avoid
-         * impact to next usecase */
-        free(sess_obj->params);
-        sess_obj->params = NULL;
-        sess_obj->params_size = 0;
-        if (ret) {
-            AGM_LOGE("Error:%d setting session cached params: %d\n",
-                ret, sess_obj->sess_id);
+    //step 2.c replay stored stream params only in closed
+    if (sess_obj->state == SESSION_CLOSED) {
+        ret = session_replay_params(sess_obj, graph);
+        if (ret)
             goto graph_cleanup;
-        }
     }
 
-    //step 2.d set cached streamdevice params
-    if (aif_obj->params != NULL) {
+    //step 2.d set cached streamdevice params, kept for session recovery
+    if (aif_obj->params != NULL && !aif_obj->params_applied) {
         ret = graph_set_config(graph, aif_obj->params, aif_obj->params_size);
         if (ret) {
             AGM_LOGE("Error:%d setting session cached params: %d\n",
                 ret, sess_obj->sess_id);
             goto graph_cleanup;
         }
-        free(aif_obj->params);
-        aif_obj->params = NULL;
-        aif_obj->params_size = 0;
+        aif_obj->params_applied = true;
     }
 
     //step 2.e set cached device params
@@ -939,17 +1128,11 @@ static int session_open_without_device(struct session_obj *sess_obj)
                 goto graph_cleanup;
             }
     }
-    //step 2.c set cached params for stream only in closed
-    if (sess_obj->state == SESSION_CLOSED && sess_obj->params != NULL) {
-        ret = graph_set_config(graph, sess_obj->params, sess_obj->params_size);
-        if (ret) {
-            AGM_LOGE("Error:%d setting session cached params: %d\n",
-                ret, sess_obj->sess_id);
+    //step 2.c replay stored stream params only in closed
+    if (sess_obj->state == SESSION_CLOSED) {
+        ret = session_replay_params(sess_obj, graph);
+        if (ret)
             goto graph_cleanup;
-        }
-        free(sess_obj->params);
-        sess_obj->params = NULL;
-        sess_obj->params_size = 0;
     }
 
     goto done;
@@ -1015,155 +1198,190 @@ done:
     return ret;
 }
 
-static int session_start(struct session_obj *sess_obj)
+/*
+ * A capture session in loopback needs its playback partner in STARTED
+ * state and one with an ec reference needs the RX device started,
+ * otherwise graph_start of the capture graph fails.
+ */
+static int session_start_check_deps(struct session_obj *sess_obj)
 {
     int ret = 0;
-    struct aif *aif_obj = NULL;
-    enum direction dir = sess_obj->stream_config.dir;
-    enum agm_session_mode sess_mode = sess_obj->stream_config.sess_mode;
-    struct listnode *node = NULL;
-    uint32_t count = 0;
     struct session_obj *pb_obj = NULL;
     struct device_obj *ec_ref_dev_obj = NULL;
 
-    if (sess_mode != AGM_SESSION_NON_TUNNEL && sess_mode != AGM_SESSION_NO_CONFIG) {
-        count = aif_obj_get_count_with_state(sess_obj, AIF_OPENED, false);
-        if (count == 0) {
-            AGM_LOGE("Error:%d No aif in right state to proceed with \
-                      session start for session id :%d\n",
-                     ret, sess_obj->sess_id);
+    if (sess_obj->stream_config.dir != TX)
+        goto done;
+
+    // For loopback, check if the playback session is in STARTED state,
+    //otherwise return failure
+    if (sess_obj->loopback_state == true) {
+        ret = session_obj_get(sess_obj->loopback_sess_id, &pb_obj);
+        if (ret) {
+            AGM_LOGE("Error:%d getting session object with \
+                      session id:%d\n",
+                      ret, sess_obj->loopback_sess_id);
+            goto done;
+        }
+
+        if (pb_obj->state != SESSION_STARTED) {
+            AGM_LOGE("Error:%d Playback session with session id:%d\n"
+                      "not in STARTED state, current state:%d\n",
+                      ret, pb_obj->sess_id, pb_obj->state);
             ret = -EINVAL;
             goto done;
         }
+    }
 
-        if (dir == TX) {
-            // For loopback, check if the playback session is in STARTED state,
-            //otherwise return failure
-            if (sess_obj->loopback_state == true) {
-                ret = session_obj_get(sess_obj->loopback_sess_id, &pb_obj);
-                if (ret) {
-                    AGM_LOGE("Error:%d getting session object with \
-                              session id:%d\n",
-                              ret, sess_obj->loopback_sess_id);
-                    goto done;
-                }
+    /*
+     * For ec ref, check if the device object is in STARTED,
+     * otherwise return failure.
+     * The RX(EC) device EP should be in started state, this ensures
+     * the RX EP is configured and hence capture session start() succeeds
+     * if RX(EC) device EP is not started, graph_start of capture will fail.
+     */
+    if (sess_obj->ec_ref_state == true) {
+        ret = device_get_obj(sess_obj->ec_ref_aif_id, &ec_ref_dev_obj);
+        if (ret) {
+            AGM_LOGE("Error:%d getting device object with aif id:%d\n",
+                    ret, sess_obj->ec_ref_aif_id);
+            goto done;
+        }
 
-                if (pb_obj->state != SESSION_STARTED) {
-                    AGM_LOGE("Error:%d Playback session with session id:%d\n"
-                              "not in STARTED state, current state:%d\n",
-                              ret, pb_obj->sess_id, pb_obj->state);
-                    ret = -EINVAL;
-                    goto done;
-                }
-            }
+        if (device_get_state(ec_ref_dev_obj) != DEV_STARTED) {
+            AGM_LOGE("Error:%d Device object with aif id:%d\n"
+                      "not in STARTED state, current state:%d\n",
+                      ret, sess_obj->ec_ref_aif_id,
+                    ec_ref_dev_obj->state);
+            ret = -EINVAL;
+            goto done;
+        }
+    }
 
-            /*
-             * For ec ref, check if the device object is in STARTED,
-             * otherwise return failure.
-             * The RX(EC) device EP should be in started state, this ensures
-             * the RX EP is configured and hence capture session start() succeeds
-             * if RX(EC) device EP is not started, graph_start of capture will fail.
-             */
-            if (sess_obj->ec_ref_state == true) {
-                ret = device_get_obj(sess_obj->ec_ref_aif_id, &ec_ref_dev_obj);
-                if (ret) {
-                    AGM_LOGE("Error:%d getting device object with aif id:%d\n",
-                            ret, sess_obj->ec_ref_aif_id);
-                    goto done;
-                }
+done:
+    return ret;
+}
 
-                if (device_get_state(ec_ref_dev_obj) != DEV_STARTED) {
-                    AGM_LOGE("Error:%d Device object with aif id:%d\n"
-                              "not in STARTED state, current state:%d\n",
-                              ret, sess_obj->ec_ref_aif_id,
-                            ec_ref_dev_obj->state);
-                    ret = -EINVAL;
-                    goto done;
-                }
+/*
+ * Prepare and start the devices of a session. SLIMBUS EPs are configured
+ * before graph_start (early), the slave ports via device_prepare/start and
+ * then the master side via graph_start; every other EP after it.
+ * Caller holds hwep_lock.
+ */
+static int session_start_devices(struct session_obj *sess_obj, bool early)
+{
+    int ret = 0;
+    struct aif *aif_obj = NULL;
+    struct listnode *node = NULL;
+
+    list_for_each(node, &sess_obj->aif_pool) {
+        aif_obj = node_to_item(node, struct aif, node);
+        if (!aif_obj) {
+            AGM_LOGE("Error:%d could not find aif node\n", ret);
+            ret = -EINVAL;
+            goto done;
+        }
+
+        if ((aif_obj->dev_obj->hw_ep_info.intf == SLIMBUS) != early)
+            continue;
+
+        if (early)
+            AGM_LOGD("configuring device early - for SLIMBUS EPs\n");
+
+        if (aif_obj->state == AIF_OPENED || aif_obj->state == AIF_STOPPED) {
+            ret = device_prepare(aif_obj->dev_obj);
+            if (ret) {
+                AGM_LOGE("Error:%d preparing device\n", ret);
+                goto done;
             }
+            aif_obj->state = AIF_PREPARED;
         }
 
-        pthread_mutex_lock(&hwep_lock);
+        if (aif_obj->state == AIF_OPENED || aif_obj->state == AIF_PREPARED ||
+                                             aif_obj->state == AIF_STOPPED ) {
+            ret = device_start(aif_obj->dev_obj);
+            if (ret) {
+                AGM_LOGE("Error:%d starting device id:%d\n",
+                               ret, aif_obj->aif_id);
+                goto done;
+            }
+            aif_obj->state = AIF_STARTED;
+        }
+    }
+
+done:
+    return ret;
+}
+
+/* Caller holds hwep_lock */
+static void session_start_unwind(struct session_obj *sess_obj,
+                                 bool graph_started)
+{
+    struct aif *aif_obj = NULL;
+    enum agm_session_mode sess_mode = sess_obj->stream_config.sess_mode;
+    struct listnode *node = NULL;
 
-        //For Slimbus EP - First configure the slave ports via device_prepare/start
-        //and then start the master side via graph_start.
+    if (graph_started)
+        graph_stop(sess_obj->graph, NULL);
+
+    if (sess_mode != AGM_SESSION_NON_TUNNEL  && sess_mode != AGM_SESSION_NO_CONFIG) {
         list_for_each(node, &sess_obj->aif_pool) {
             aif_obj = node_to_item(node, struct aif, node);
-            if (!aif_obj) {
-                AGM_LOGE("Error:%d could not find aif node\n", ret);
-                goto device_stop;
+            if (aif_obj && (aif_obj->state == AIF_STARTED)) {
+                device_stop(aif_obj->dev_obj);
+                //If start fails, client will retry with a prepare call,
+                //so moving to opened state will allow prepare to go through
+                aif_obj->state = AIF_OPENED;
             }
+        }
+    }
+}
 
-            if (aif_obj->dev_obj->hw_ep_info.intf == SLIMBUS) {
-                AGM_LOGD("configuring device early - for SLIMBUS EPs\n");
-                if (aif_obj->state == AIF_OPENED || aif_obj->state == AIF_STOPPED) {
-                    ret = device_prepare(aif_obj->dev_obj);
-                    if (ret) {
-                        AGM_LOGE("Error:%d preparing device\n", ret);
-                        goto device_stop;
-                    }
-                    aif_obj->state = AIF_PREPARED;
-                }
+static int session_start(struct session_obj *sess_obj)
+{
+    int ret = 0;
+    enum agm_session_mode sess_mode = sess_obj->stream_config.sess_mode;
+    uint32_t count = 0;
 
-                if (aif_obj->state == AIF_OPENED || aif_obj->state == AIF_PREPARED ||
-                                                     aif_obj->state == AIF_STOPPED ) {
-                    ret = device_start(aif_obj->dev_obj);
-                    if (ret) {
-                        AGM_LOGE("Error:%d starting device id:%d\n",
-                                       ret, aif_obj->aif_id);
-                        goto device_stop;
-                    }
-                    aif_obj->state = AIF_STARTED;
-                }
-            }
+    if (sess_mode != AGM_SESSION_NON_TUNNEL && sess_mode != AGM_SESSION_NO_CONFIG) {
+        count = aif_obj_get_count_with_state(sess_obj, AIF_OPENED, false);
+        if (count == 0) {
+            AGM_LOGE("Error:%d No aif in right state to proceed with \
+                      session start for session id :%d\n",
+                     ret, sess_obj->sess_id);
+            ret = -EINVAL;
+            goto done;
         }
 
+        ret = session_start_check_deps(sess_obj);
+        if (ret)
+            goto done;
+
+        pthread_mutex_lock(&hwep_lock);
+        ret = session_start_devices(sess_obj, true);
+        if (ret)
+            goto unwind;
+
         ret = graph_start(sess_obj->graph);
         if (ret) {
             AGM_LOGE("Error:%d starting graph\n", ret);
-            goto device_stop;
+            goto unwind;
         }
 
-        list_for_each(node, &sess_obj->aif_pool) {
-            aif_obj = node_to_item(node, struct aif, node);
-            if (!aif_obj) {
-                AGM_LOGE("Error:%d could not find aif node\n", ret);
-                pthread_mutex_unlock(&hwep_lock);
-                goto unwind;
-            }
-
-            //Continue/SKIP for SLIMBUS EP as they are started early.
-            if (aif_obj->dev_obj->hw_ep_info.intf == SLIMBUS)
-                continue;
-
-            if (aif_obj->state == AIF_OPENED || aif_obj->state == AIF_STOPPED) {
-                ret = device_prepare(aif_obj->dev_obj);
-                if (ret) {
-                    AGM_LOGE("Error:%d preparing device\n", ret);
-                    pthread_mutex_unlock(&hwep_lock);
-                    goto unwind;
-                }
-                aif_obj->state = AIF_PREPARED;
-            }
-
-            if (aif_obj->state == AIF_OPENED || aif_obj->state == AIF_PREPARED ||
-                                                 aif_obj->state == AIF_STOPPED ) {
-                ret = device_start(aif_obj->dev_obj);
-                if (ret) {
-                    AGM_LOGE("Error:%d starting device id:%d\n",
-                                   ret, aif_obj->aif_id);
-                    pthread_mutex_unlock(&hwep_lock);
-                    goto unwind;
-                }
-                aif_obj->state = AIF_STARTED;
-            }
+        ret = session_start_devices(sess_obj, false);
+        if (ret) {
+            session_start_unwind(sess_obj, true);
+            pthread_mutex_unlock(&hwep_lock);
+            goto done;
         }
         pthread_mutex_unlock(&hwep_lock);
     } else {
         ret = graph_start(sess_obj->graph);
         if (ret) {
             AGM_LOGE("Error:%d starting graph\n", ret);
-            goto unwind;
+            pthread_mutex_lock(&hwep_lock);
+            session_start_unwind(sess_obj, true);
+            pthread_mutex_unlock(&hwep_lock);
+            goto done;
         }
     }
 
@@ -1171,32 +1389,42 @@ static int session_start(struct session_obj *sess_obj)
     goto done;
 
 unwind:
-    pthread_mutex_lock(&hwep_lock);
-    graph_stop(sess_obj->graph, NULL);
-device_stop:
-    if (sess_mode != AGM_SESSION_NON_TUNNEL  && sess_mode != AGM_SESSION_NO_CONFIG) {
-        list_for_each(node, &sess_obj->aif_pool) {
-            aif_obj = node_to_item(node, struct aif, node);
-            if (aif_obj && (aif_obj->state == AIF_STARTED)) {
-                device_stop(aif_obj->dev_obj);
-                //If start fails, client will retry with a prepare call,
-                //so moving to opened state will allow prepare to go through
-                aif_obj->state = AIF_OPENED;
-            }
-        }
-    }
+    session_start_unwind(sess_obj, false);
     pthread_mutex_unlock(&hwep_lock);
 done:
     return ret;
 }
 
-static int session_stop(struct session_obj *sess_obj)
+/* Caller holds hwep_lock */
+static void session_stop_devices(struct session_obj *sess_obj)
 {
     int ret = 0;
     struct aif *aif_obj = NULL;
+    struct listnode *node = NULL;
+
+    list_for_each(node, &sess_obj->aif_pool) {
+        aif_obj = node_to_item(node, struct aif, node);
+        if (!aif_obj) {
+            AGM_LOGE("Error:%d could not find aif node\n", ret);
+            continue;
+        }
+
+        if (aif_obj->state == AIF_STARTED) {
+            ret = device_stop(aif_obj->dev_obj);
+            if (ret) {
+                AGM_LOGE("Error:%d stopping device id:%d\n",
+                               ret, aif_obj->aif_id);
+            }
+            aif_obj->state = AIF_STOPPED;
+        }
+    }
+}
+
+static int session_stop(struct session_obj *sess_obj)
+{
+    int ret = 0;
     enum direction dir = sess_obj->stream_config.dir;
     enum agm_session_mode sess_mode = sess_obj->stream_config.sess_mode;
-    struct listnode *node = NULL;
 
     if (sess_obj->state != SESSION_STARTED) {
         AGM_LOGE("session not in STARTED state, current state:%d\n",
@@ -1216,22 +1444,7 @@ static int session_stop(struct session_obj *sess_obj)
             }
         }
 
-        list_for_each(node, &sess_obj->aif_pool) {
-            aif_obj = node_to_item(node, struct aif, node);
-            if (!aif_obj) {
-                AGM_LOGE("Error:%d could not find aif node\n", ret);
-                continue;
-            }
-
-            if (aif_obj->state == AIF_STARTED) {
-                ret = device_stop(aif_obj->dev_obj);
-                if (ret) {
-                    AGM_LOGE("Error:%d stopping device id:%d\n",
-                                   ret, aif_obj->aif_id);
-                }
-                aif_obj->state = AIF_STOPPED;
-            }
-        }
+        session_stop_devices(sess_obj);
 
         if (dir == TX) {
             ret = graph_stop(sess_obj->graph, NULL);
@@ -1282,6 +1495,7 @@ static int session_close(struct session_obj *sess_obj)
     sess_obj->graph = NULL;
     sess_obj->ec_ref_state = false;
     sess_obj->loopback_state = false;
+    sess_param_store_invalidate(sess_obj);
 
     if (sess_mode != AGM_SESSION_NON_TUNNEL  && sess_mode != AGM_SESSION_NO_CONFIG) {
         list_for_each_safe(node, next, &sess_obj->aif_pool) {
@@ -1313,8 +1527,201 @@ done:
     return ret;
 }
 
+/*
+ * Teardown of a session closed with session_obj_close_async. The graph and
+ * the devices are detached from the session object, which is CLOSED and
+ * can be reopened right away; the worker stops and closes them in the
+ * order session_close() would.
+ */
+struct session_teardown {
+    struct listnode node;
+    uint32_t sess_id;
+    struct graph_obj *graph;
+    bool graph_started;
+    uint32_t num_devs;
+    struct device_obj **devs;
+};
+
+static struct listnode teardown_list;
+static pthread_mutex_t teardown_lock;
+static pthread_cond_t teardown_cond;
+static pthread_t teardown_thread;
+static bool teardown_thread_running;
+static bool teardown_exit;
+
+/* events still in flight on a detached graph belong to no session */
+static void graph_detached_event_cb(struct agm_event_cb_params *event_params,
+                                    void *client_data)
+{
+    AGM_LOGD("dropping event %d of detached graph of session id:%d\n",
+             event_params ? (int)event_params->event_id : -1,
+             (uint32_t)((uintptr_t)client_data));
+}
+
+static void session_teardown_run(struct session_teardown *td)
+{
+    int ret = 0;
+    uint32_t i;
+
+    pthread_mutex_lock(&hwep_lock);
+    if (td->graph) {
+        if (td->graph_started) {
+            ret = graph_stop(td->graph, NULL);
+            if (ret)
+                AGM_LOGE("Error:%d stopping graph\n", ret);
+        }
+        ret = graph_close(td->graph);
+        if (ret)
+            AGM_LOGE("Error:%d closing graph\n", ret);
+    }
+
+    for (i = 0; i < td->num_devs; i++) {
+        ret = device_close_deferred(td->devs[i]);
+        if (ret)
+            AGM_LOGE("Error:%d closing device\n", ret);
+    }
+    pthread_mutex_unlock(&hwep_lock);
+
+    AGM_LOGD("deferred teardown of session id:%d done\n", td->sess_id);
+}
+
+static void *session_teardown_thread(void *arg __unused)
+{
+    struct session_teardown *td;
+
+    pthread_mutex_lock(&teardown_lock);
+    while (true) {
+        if (list_empty(&teardown_list)) {
+            if (teardown_exit)
+                break;
+            pthread_cond_wait(&teardown_cond, &teardown_lock);
+            continue;
+        }
+
+        td = node_to_item(list_head(&teardown_list),
+                          struct session_teardown, node);
+        list_remove(&td->node);
+        pthread_mutex_unlock(&teardown_lock);
+
+        session_teardown_run(td);
+        free(td->devs);
+        free(td);
+
+        pthread_mutex_lock(&teardown_lock);
+    }
+    pthread_mutex_unlock(&teardown_lock);
+
+    return NULL;
+}
+
+static int session_teardown_init()
+{
+    int ret = 0;
+
+    list_init(&teardown_list);
+    pthread_mutex_init(&teardown_lock, (const pthread_mutexattr_t *) NULL);
+    pthread_cond_init(&teardown_cond, (const pthread_condattr_t *) NULL);
+    teardown_exit = false;
+
+    ret = pthread_create(&teardown_thread, (const pthread_attr_t *) NULL,
+                         session_teardown_thread, NULL);
+    if (ret) {
+        AGM_LOGE("Error:%d creating teardown thread, closing synchronously\n",
+                 ret);
+        return -ret;
+    }
+    teardown_thread_running = true;
+
+    return ret;
+}
+
+/* runs every queued teardown before returning */
+static void session_teardown_deinit()
+{
+    if (!teardown_thread_running)
+        return;
+
+    pthread_mutex_lock(&teardown_lock);
+    teardown_exit = true;
+    pthread_cond_signal(&teardown_cond);
+    pthread_mutex_unlock(&teardown_lock);
+
+    pthread_join(teardown_thread, (void **) NULL);
+    teardown_thread_running = false;
+}
+
+/* Caller holds sess_obj->lock */
+static int session_close_async(struct session_obj *sess_obj)
+{
+    struct session_teardown *td = NULL;
+    struct aif *aif_obj = NULL;
+    enum agm_session_mode sess_mode = sess_obj->stream_config.sess_mode;
+    struct listnode *node = NULL;
+    uint32_t num_devs = 0;
+
+    if (sess_obj->state == SESSION_CLOSED) {
+        AGM_LOGE("session already in CLOSED state\n");
+        return -EALREADY;
+    }
+
+    if (!teardown_thread_running)
+        return session_close(sess_obj);
+
+    if (sess_mode != AGM_SESSION_NON_TUNNEL  && sess_mode != AGM_SESSION_NO_CONFIG)
+        num_devs = aif_obj_get_count_with_state(sess_obj, AIF_OPENED, false);
+
+    td = calloc(1, sizeof(struct session_teardown));
+    if (td && num_devs)
+        td->devs = calloc(num_devs, sizeof(struct device_obj *));
+    if (!td || (num_devs && !td->devs)) {
+        AGM_LOGE("No memory for deferred teardown, closing synchronously\n");
+        free(td);
+        return session_close(sess_obj);
+    }
+
+    td->sess_id = sess_obj->sess_id;
+    td->graph = sess_obj->graph;
+    td->graph_started = (sess_obj->state == SESSION_STARTED);
+    if (td->graph)
+        graph_register_cb(td->graph, graph_detached_event_cb,
+                          (void *)((uintptr_t) sess_obj->sess_id));
+
+    if (num_devs) {
+        list_for_each(node, &sess_obj->aif_pool) {
+            aif_obj = node_to_item(node, struct aif, node);
+            if (aif_obj->state >= AIF_OPENED && td->num_devs < num_devs) {
+                /* new opens of this backend wait for the worker */
+                device_mark_close_pending(aif_obj->dev_obj);
+                td->devs[td->num_devs++] = aif_obj->dev_obj;
+                aif_obj->state = AIF_CLOSED;
+            }
+
+            if (aif_obj->tag_config) {
+                free(aif_obj->tag_config);
+                aif_obj->tag_config = NULL;
+            }
+        }
+    }
+
+    sess_obj->graph = NULL;
+    sess_obj->ec_ref_state = false;
+    sess_obj->loopback_state = false;
+    sess_param_store_invalidate(sess_obj);
+    sess_obj->state = SESSION_CLOSED;
+
+    pthread_mutex_lock(&teardown_lock);
+    list_add_tail(&teardown_list, &td->node);
+    pthread_cond_signal(&teardown_cond);
+    pthread_mutex_unlock(&teardown_lock);
+
+    AGM_LOGD("session id:%d detached, %d device(s) closing in background\n",
+             sess_obj->sess_id, num_devs);
+    return 0;
+}
+
 int session_obj_deinit()
 {
+    session_teardown_deinit();
     session_pool_free();
     device_deinit();
     graph_deinit();
@@ -1344,6 +1751,9 @@ int session_obj_init()
         goto graph_deinit;
     }
     pthread_mutex_init(&hwep_lock, (const pthread_mutexattr_t *) NULL);
+
+    /* without the worker close_async falls back to a synchronous close */
+    session_teardown_init();
     goto done;
 
 graph_deinit:
@@ -1361,10 +1771,24 @@ int session_obj_set_sess_metadata(struct session_obj *sess_obj,
 {
 
     int ret = 0;
+    struct agm_meta_data_gsl new_meta = {0};
 
     pthread_mutex_lock(&sess_obj->lock);
+    ret = metadata_copy(&new_meta, size, metadata);
+    if (ret)
+        goto done;
+
+    /* stored params belong to the old graph once the usecase changes */
+    if (new_meta.gkv.num_kvs != sess_obj->sess_meta.gkv.num_kvs ||
+        (new_meta.gkv.num_kvs &&
+         memcmp(new_meta.gkv.kv, sess_obj->sess_meta.gkv.kv,
+                new_meta.gkv.num_kvs * sizeof(struct agm_key_value))))
+        sess_param_store_free(sess_obj);
+
     metadata_free(&(sess_obj->sess_meta));
-    ret = metadata_copy(&(sess_obj->sess_meta), size, metadata);
+    sess_obj->sess_meta = new_meta;
+
+done:
     pthread_mutex_unlock(&sess_obj->lock);
 
     return ret;
@@ -1373,50 +1797,73 @@ int session_obj_set_sess_metadata(struct session_obj *sess_obj,
 int session_obj_set_sess_params(struct session_obj *sess_obj,
     void *payload, size_t size)
 {
-   int ret = 0;
-
-   pthread_mutex_lock(&sess_obj->lock);
-
-   if (sess_obj->params) {
-       free(sess_obj->params);
-       sess_obj->params = NULL;
-       sess_obj->params_size = 0;
-   }
+    int ret = 0;
+    uint8_t *delta = NULL;
+    size_t delta_size = 0;
 
-   if ((size == 0) ||(payload == NULL))
-       goto done;
+    pthread_mutex_lock(&sess_obj->lock);
 
-   sess_obj->params = calloc(1, size);
-   if (!sess_obj->params) {
-       AGM_LOGE("No memory for sess params on sess_id:%d\n",
-                                   sess_obj->sess_id);
-       ret = -EINVAL;
-       goto done;
-   }
+    /* empty payload drops all params stored for the session */
+    if ((size == 0) || (payload == NULL)) {
+        sess_param_store_free(sess_obj);
+        goto done;
+    }
 
-   memcpy(sess_obj->params, payload, size);
-   sess_obj->params_size = size;
+    /* room for padding of a trailing unaligned param */
+    delta = calloc(1, size + 8);
+    if (!delta) {
+        AGM_LOGE("No memory for sess params on sess_id:%d\n",
+                                    sess_obj->sess_id);
+        ret = -ENOMEM;
+        goto done;
+    }
 
-   if (sess_obj->state != SESSION_CLOSED) {
-       ret = graph_set_config(sess_obj->graph, sess_obj->params,
-                                         sess_obj->params_size);
-       if (ret) {
-           AGM_LOGE("Error:%d setting for sess params on sess_id:%d\n",
+    ret = sess_param_store_update(sess_obj, payload, size, delta, &delta_size);
+    if (ret) {
+        AGM_LOGE("Error:%d storing sess params on sess_id:%d\n",
                    ret, sess_obj->sess_id);
-       }
-       free(sess_obj->params);
-       sess_obj->params = NULL;
-       sess_obj->params_size = 0;
-   }
+        goto done;
+    }
+
+    if (sess_obj->state != SESSION_CLOSED && delta_size > 0) {
+        ret = graph_set_config(sess_obj->graph, delta, delta_size);
+        if (ret) {
+            AGM_LOGE("Error:%d setting for sess params on sess_id:%d\n",
+                    ret, sess_obj->sess_id);
+        }
+        sess_param_store_mark_applied(sess_obj, delta, delta_size, ret == 0);
+    }
 
 done:
-   pthread_mutex_unlock(&sess_obj->lock);
-   return ret;
+    free(delta);
+    pthread_mutex_unlock(&sess_obj->lock);
+    return ret;
 }
 
 int session_obj_set_sess_aif_params(struct session_obj *sess_obj,
     uint32_t aif_id,
     void* payload, size_t size)
+{
+    void *params = NULL;
+
+    if ((size > 0) && (payload != NULL)) {
+        params = calloc(1, size);
+        if (!params) {
+            AGM_LOGE("No memory for sess_aif params on sess_id:%d, aif_id:%d\n",
+                                      sess_obj->sess_id, aif_id);
+            return -EINVAL;
+        }
+        memcpy(params, payload, size);
+    }
+
+    return session_obj_set_sess_aif_params_take(sess_obj, aif_id, params,
+                                                size);
+}
+
+/* the aif keeps payload as its cached params, nothing is copied */
+int session_obj_set_sess_aif_params_take(struct session_obj *sess_obj,
+    uint32_t aif_id,
+    void* payload, size_t size)
 {
     int ret = 0;
     struct aif *aif_obj = NULL;
@@ -1426,6 +1873,7 @@ int session_obj_set_sess_aif_params(struct session_obj *sess_obj,
     if (ret) {
         AGM_LOGE("Error obtaining aif object with sess_id:%d,  aif id:%d\n",
             sess_obj->sess_id, aif_id);
+        free(payload);
         goto done;
     }
 
@@ -1435,19 +1883,14 @@ int session_obj_set_sess_aif_params(struct session_obj *sess_obj,
        aif_obj->params_size = 0;
    }
 
-   if ((size == 0) || (payload == NULL))
-       goto done;
-
-   aif_obj->params = calloc(1, size);
-   if (!aif_obj->params) {
-       AGM_LOGE("No memory for sess_aif params on sess_id:%d, aif_id:%d\n",
-                                 sess_obj->sess_id, aif_obj->aif_id);
-       ret = -EINVAL;
+   if ((size == 0) || (payload == NULL)) {
+       free(payload);
        goto done;
    }
 
-   memcpy(aif_obj->params, payload, size);
+   aif_obj->params = payload;
    aif_obj->params_size = size;
+   aif_obj->params_applied = false;
 
    if (sess_obj->state != SESSION_CLOSED && aif_obj->state >= AIF_OPENED) {
        ret = graph_set_config(sess_obj->graph, aif_obj->params, aif_obj->params_size);
@@ -1455,10 +1898,9 @@ int session_obj_set_sess_aif_params(struct session_obj *sess_obj,
            AGM_LOGE("Error:%d setting for sess_aif params on sess_id:%d, \
                      aif_id:%d\n", ret,
                      sess_obj->sess_id, aif_obj->aif_id);
+       } else {
+           aif_obj->params_applied = true;
        }
-       free(aif_obj->params);
-       aif_obj->params = NULL;
-       aif_obj->params_size = 0;
    }
 
 done:
@@ -2056,24 +2498,15 @@ done:
     return ret;
 }
 
-int session_obj_open(uint32_t session_id,
-                     enum agm_session_mode sess_mode,
-                     struct session_obj **session)
+/* Caller holds sess_obj->lock */
+static int session_open(struct session_obj *sess_obj,
+                        enum agm_session_mode sess_mode)
 {
-
-    struct session_obj *sess_obj = NULL;
     int ret = 0;
     int ret_unwind = 0;
     struct listnode *node;
     struct aif *aif_obj = NULL;
 
-    ret = session_obj_get(session_id, &sess_obj);
-    if (ret) {
-        AGM_LOGE("Error getting session object\n");
-        return ret;
-    }
-
-    pthread_mutex_lock(&sess_obj->lock);
     if (sess_obj->state != SESSION_CLOSED) {
         AGM_LOGE("Session already Opened, session_state:%d\n",
                                        sess_obj->state);
@@ -2141,7 +2574,6 @@ int session_obj_open(uint32_t session_id,
     }
 
     sess_obj->state = SESSION_OPENED;
-    *session = sess_obj;
     goto done;
 
 unwind:
@@ -2164,7 +2596,30 @@ unwind:
     sess_obj->graph = NULL;
 
 done:
+    return ret;
+}
+
+int session_obj_open(uint32_t session_id,
+                     enum agm_session_mode sess_mode,
+                     struct session_obj **session)
+{
+    struct session_obj *sess_obj = NULL;
+    int ret = 0;
+
+    ret = session_obj_get(session_id, &sess_obj);
+    if (ret) {
+        AGM_LOGE("Error getting session object\n");
+        return ret;
+    }
+
+    pthread_mutex_lock(&sess_obj->lock);
+    ret = session_open(sess_obj, sess_mode);
+    if (!ret) {
+        memset(&sess_obj->stats, 0, sizeof(sess_obj->stats));
+        *session = sess_obj;
+    }
     pthread_mutex_unlock(&sess_obj->lock);
+
     return ret;
 }
 
@@ -2236,6 +2691,571 @@ int session_obj_stop(struct session_obj *sess_obj)
     return ret;
 }
 
+static int session_cmp_by_id(const void *a, const void *b)
+{
+    const struct session_obj *sa = *(struct session_obj * const *)a;
+    const struct session_obj *sb = *(struct session_obj * const *)b;
+
+    return (sa->sess_id > sb->sess_id) - (sa->sess_id < sb->sess_id);
+}
+
+/* returns true if sess_obj needs partner to be started before it */
+static bool session_depends_on(struct session_obj *sess_obj,
+                               struct session_obj *partner)
+{
+    struct listnode *node;
+    struct aif *aif_obj;
+
+    if (sess_obj == partner || sess_obj->stream_config.dir != TX)
+        return false;
+
+    if (sess_obj->loopback_state &&
+        sess_obj->loopback_sess_id == partner->sess_id)
+        return true;
+
+    if (sess_obj->ec_ref_state && partner->stream_config.dir == RX) {
+        list_for_each(node, &partner->aif_pool) {
+            aif_obj = node_to_item(node, struct aif, node);
+            if (aif_obj->aif_id == sess_obj->ec_ref_aif_id &&
+                aif_obj->state >= AIF_OPENED)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Assign each session of a group to a start wave: sessions without a
+ * partner in the group go into wave 0, a session depending on a partner
+ * goes into the wave after it. Returns the number of waves or an error
+ * if the dependencies form a cycle.
+ */
+static int session_group_waves(struct session_obj **group, uint32_t num,
+                               uint32_t *wave)
+{
+    uint32_t i, j, pass, num_waves = 1;
+    bool changed = true;
+
+    memset(wave, 0, num * sizeof(uint32_t));
+    for (pass = 0; changed && pass <= num; pass++) {
+        changed = false;
+        for (i = 0; i < num; i++) {
+            for (j = 0; j < num; j++) {
+                if (session_depends_on(group[i], group[j]) &&
+                    wave[i] <= wave[j]) {
+                    wave[i] = wave[j] + 1;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    if (changed) {
+        AGM_LOGE("circular loopback/ec_ref dependency in session group\n");
+        return -EINVAL;
+    }
+
+    for (i = 0; i < num; i++) {
+        if (wave[i] + 1 > num_waves)
+            num_waves = wave[i] + 1;
+    }
+
+    return (int)num_waves;
+}
+
+static bool session_has_device(struct session_obj *sess_obj)
+{
+    enum agm_session_mode sess_mode = sess_obj->stream_config.sess_mode;
+
+    return sess_mode != AGM_SESSION_NON_TUNNEL &&
+           sess_mode != AGM_SESSION_NO_CONFIG;
+}
+
+/* spread of the SPR start times of the sessions that have one */
+static uint64_t session_group_start_skew(struct session_obj **group,
+                                         uint32_t num)
+{
+    uint32_t i, valid = 0;
+    uint64_t start_time, min = UINT64_MAX, max = 0;
+
+    for (i = 0; i < num; i++) {
+        if (graph_get_session_start_time(group[i]->graph, &start_time))
+            continue;
+        if (start_time < min)
+            min = start_time;
+        if (start_time > max)
+            max = start_time;
+        valid++;
+    }
+
+    if (valid < 2) {
+        AGM_LOGD("start skew needs SPR on at least 2 sessions, got %d\n",
+                  valid);
+        return 0;
+    }
+
+    return max - min;
+}
+
+int session_obj_group_start(struct session_obj **sessions, uint32_t num,
+                            uint64_t *start_skew_us)
+{
+    int ret = 0;
+    int num_waves;
+    uint32_t i, w;
+    uint32_t *wave = NULL;
+    bool *started = NULL;
+    struct session_obj **group = NULL;
+
+    group = calloc(num, sizeof(struct session_obj *));
+    wave = calloc(num, sizeof(uint32_t));
+    started = calloc(num, sizeof(bool));
+    if (!group || !wave || !started) {
+        AGM_LOGE("No memory for session group of %d\n", num);
+        ret = -ENOMEM;
+        goto free_group;
+    }
+
+    /* lock in session id order so two overlapping groups cannot deadlock */
+    memcpy(group, sessions, num * sizeof(struct session_obj *));
+    qsort(group, num, sizeof(struct session_obj *), session_cmp_by_id);
+    for (i = 1; i < num; i++) {
+        if (group[i] == group[i - 1]) {
+            AGM_LOGE("session id:%d listed twice in group\n",
+                      group[i]->sess_id);
+            ret = -EINVAL;
+            goto free_group;
+        }
+    }
+    for (i = 0; i < num; i++)
+        pthread_mutex_lock(&group[i]->lock);
+
+    num_waves = session_group_waves(group, num, wave);
+    if (num_waves < 0) {
+        ret = num_waves;
+        goto unlock;
+    }
+
+    /* prepare everything up front so only starts remain below */
+    for (i = 0; i < num; i++) {
+        if (group[i]->state == SESSION_STARTED)
+            continue;
+        if (group[i]->state == SESSION_CLOSED) {
+            AGM_LOGE("session id:%d in group is not opened\n",
+                      group[i]->sess_id);
+            ret = -EINVAL;
+            goto unlock;
+        }
+        if (session_has_device(group[i]) &&
+            aif_obj_get_count_with_state(group[i], AIF_OPENED, false) == 0) {
+            AGM_LOGE("No aif in right state to start session id:%d\n",
+                      group[i]->sess_id);
+            ret = -EINVAL;
+            goto unlock;
+        }
+        if (group[i]->state != SESSION_PREPARED) {
+            ret = session_prepare(group[i]);
+            if (ret) {
+                AGM_LOGE("Error:%d preparing session id:%d of group\n",
+                          ret, group[i]->sess_id);
+                goto unlock;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&hwep_lock);
+    for (w = 0; w < (uint32_t)num_waves; w++) {
+        for (i = 0; i < num; i++) {
+            if (wave[i] != w || group[i]->state == SESSION_STARTED)
+                continue;
+            ret = session_start_check_deps(group[i]);
+            if (ret)
+                goto unwind;
+            if (session_has_device(group[i])) {
+                ret = session_start_devices(group[i], true);
+                if (ret)
+                    goto unwind;
+            }
+        }
+
+        /* graph starts of one wave are issued back-to-back */
+        for (i = 0; i < num; i++) {
+            if (wave[i] != w || group[i]->state == SESSION_STARTED)
+                continue;
+            ret = graph_start(group[i]->graph);
+            if (ret) {
+                AGM_LOGE("Error:%d starting graph of session id:%d\n",
+                          ret, group[i]->sess_id);
+                goto unwind;
+            }
+            started[i] = true;
+        }
+
+        for (i = 0; i < num; i++) {
+            if (wave[i] != w || !started[i])
+                continue;
+            if (session_has_device(group[i])) {
+                ret = session_start_devices(group[i], false);
+                if (ret)
+                    goto unwind;
+            }
+            group[i]->state = SESSION_STARTED;
+        }
+    }
+    pthread_mutex_unlock(&hwep_lock);
+
+    if (start_skew_us) {
+        *start_skew_us = session_group_start_skew(group, num);
+        AGM_LOGI("started group of %d sessions, start skew %llu us\n",
+                  num, (unsigned long long)*start_skew_us);
+    }
+    goto unlock;
+
+unwind:
+    /* nothing from a failed group start is left running */
+    for (i = 0; i < num; i++) {
+        if (started[i]) {
+            session_start_unwind(group[i], true);
+            group[i]->state = SESSION_PREPARED;
+        } else if (wave[i] == w && group[i]->state != SESSION_STARTED) {
+            /* early devices of the failing wave */
+            session_start_unwind(group[i], false);
+        }
+    }
+    pthread_mutex_unlock(&hwep_lock);
+
+unlock:
+    for (i = num; i > 0; i--)
+        pthread_mutex_unlock(&group[i - 1]->lock);
+free_group:
+    free(started);
+    free(wave);
+    free(group);
+    return ret;
+}
+
+int session_obj_group_stop(struct session_obj **sessions, uint32_t num)
+{
+    int ret = 0, err;
+    int num_waves;
+    uint32_t i, w;
+    uint32_t *wave = NULL;
+    struct session_obj **group = NULL;
+
+    group = calloc(num, sizeof(struct session_obj *));
+    wave = calloc(num, sizeof(uint32_t));
+    if (!group || !wave) {
+        AGM_LOGE("No memory for session group of %d\n", num);
+        ret = -ENOMEM;
+        goto free_group;
+    }
+
+    memcpy(group, sessions, num * sizeof(struct session_obj *));
+    qsort(group, num, sizeof(struct session_obj *), session_cmp_by_id);
+    for (i = 1; i < num; i++) {
+        if (group[i] == group[i - 1]) {
+            AGM_LOGE("session id:%d listed twice in group\n",
+                      group[i]->sess_id);
+            ret = -EINVAL;
+            goto free_group;
+        }
+    }
+    for (i = 0; i < num; i++)
+        pthread_mutex_lock(&group[i]->lock);
+
+    num_waves = session_group_waves(group, num, wave);
+    if (num_waves < 0) {
+        ret = num_waves;
+        goto unlock;
+    }
+
+    /*
+     * Dependents stop first. Within a wave, RX graphs stop before their
+     * devices and TX graphs after them, as in session_stop().
+     */
+    pthread_mutex_lock(&hwep_lock);
+    for (w = (uint32_t)num_waves; w > 0; w--) {
+        for (i = 0; i < num; i++) {
+            if (wave[i] != w - 1 || group[i]->state != SESSION_STARTED)
+                continue;
+            if (session_has_device(group[i]) &&
+                group[i]->stream_config.dir == TX)
+                continue;
+            err = graph_stop(group[i]->graph, NULL);
+            if (err) {
+                AGM_LOGE("Error:%d stopping graph of session id:%d\n",
+                          err, group[i]->sess_id);
+                ret = ret ? ret : err;
+            }
+        }
+
+        for (i = 0; i < num; i++) {
+            if (wave[i] != w - 1 || group[i]->state != SESSION_STARTED)
+                continue;
+            if (!session_has_device(group[i]))
+                continue;
+            session_stop_devices(group[i]);
+            if (group[i]->stream_config.dir == TX) {
+                err = graph_stop(group[i]->graph, NULL);
+                if (err) {
+                    AGM_LOGE("Error:%d stopping graph of session id:%d\n",
+                              err, group[i]->sess_id);
+                    ret = ret ? ret : err;
+                }
+            }
+        }
+
+        for (i = 0; i < num; i++) {
+            if (wave[i] == w - 1 && group[i]->state == SESSION_STARTED)
+                group[i]->state = SESSION_STOPPED;
+        }
+    }
+    pthread_mutex_unlock(&hwep_lock);
+
+unlock:
+    for (i = num; i > 0; i--)
+        pthread_mutex_unlock(&group[i - 1]->lock);
+free_group:
+    free(wave);
+    free(group);
+    return ret;
+}
+
+
+struct session_recovery {
+    struct session_obj *sess_obj;
+    enum session_state state;
+    int status;
+    uint64_t time_us;
+};
+
+static uint64_t session_time_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Drop the graph and pcm handles that died with the DSP while keeping
+ * everything needed to rebuild them: the aifs stay connected, the stream
+ * and streamdevice params are marked for replay and the loopback/ec_ref
+ * links are left set so session_open() reapplies them. Started backends
+ * are stopped before they are closed so their start refcount unwinds too.
+ * Caller holds sess_obj->lock.
+ */
+static void session_recover_teardown(struct session_obj *sess_obj)
+{
+    struct aif *aif_obj = NULL;
+    struct listnode *node = NULL;
+
+    pthread_mutex_lock(&hwep_lock);
+    if (sess_obj->graph) {
+        if (sess_obj->state == SESSION_STARTED)
+            graph_stop(sess_obj->graph, NULL);
+        graph_close(sess_obj->graph);
+        sess_obj->graph = NULL;
+    }
+
+    list_for_each(node, &sess_obj->aif_pool) {
+        aif_obj = node_to_item(node, struct aif, node);
+        if (aif_obj->state == AIF_STARTED)
+            device_stop(aif_obj->dev_obj);
+        if (aif_obj->state >= AIF_OPENED) {
+            device_close(aif_obj->dev_obj);
+            aif_obj->state = AIF_OPEN;
+        }
+        aif_obj->params_applied = false;
+    }
+    pthread_mutex_unlock(&hwep_lock);
+
+    sess_param_store_invalidate(sess_obj);
+    sess_obj->state = SESSION_CLOSED;
+}
+
+/*
+ * A backend shared by several sessions only reopens its pcm once the
+ * last of them has closed it; anything still holding it would hand the
+ * rebuilt sessions the handle that died with the DSP.
+ */
+static int session_recover_check_closed(struct session_obj *sess_obj)
+{
+    struct aif *aif_obj = NULL;
+    struct listnode *node = NULL;
+    int ret = 0;
+
+    list_for_each(node, &sess_obj->aif_pool) {
+        aif_obj = node_to_item(node, struct aif, node);
+        if (device_get_open_refcnt(aif_obj->dev_obj)) {
+            AGM_LOGE("device id:%d of session id:%d still open after teardown\n",
+                      aif_obj->aif_id, sess_obj->sess_id);
+            ret = -EBUSY;
+        }
+    }
+
+    return ret;
+}
+
+/* Caller holds sess_obj->lock for the whole recovery */
+static void *session_recover(void *arg)
+{
+    struct session_recovery *rec = (struct session_recovery *)arg;
+    struct session_obj *sess_obj = rec->sess_obj;
+    uint64_t begin = session_time_us();
+    int ret = 0;
+
+    ret = session_open(sess_obj, sess_obj->stream_config.sess_mode);
+    if (ret) {
+        AGM_LOGE("Error:%d reopening session id:%d\n", ret, sess_obj->sess_id);
+        goto done;
+    }
+
+    if (rec->state == SESSION_OPENED)
+        goto done;
+
+    ret = session_prepare(sess_obj);
+    if (ret) {
+        AGM_LOGE("Error:%d preparing session id:%d\n", ret, sess_obj->sess_id);
+        goto done;
+    }
+
+    if (rec->state == SESSION_STARTED) {
+        ret = session_start(sess_obj);
+        if (ret)
+            AGM_LOGE("Error:%d starting session id:%d\n",
+                     ret, sess_obj->sess_id);
+    }
+
+done:
+    rec->status = ret;
+    rec->time_us += session_time_us() - begin;
+    AGM_LOGI("session id:%d recovered to state %d in %llu us, ret %d\n",
+             sess_obj->sess_id, ret ? sess_obj->state : rec->state,
+             (unsigned long long)rec->time_us, ret);
+
+    return NULL;
+}
+
+int session_obj_recover_all(struct agm_session_recovery_info *info,
+                            size_t *num_sessions)
+{
+    int ret = 0, num_waves;
+    uint32_t i, w, num = 0, count = 0;
+    uint32_t *wave = NULL;
+    pthread_t *threads = NULL;
+    bool *threaded = NULL;
+    struct session_obj **group = NULL, **live = NULL;
+    struct session_recovery *recs = NULL;
+    struct listnode *node;
+    uint64_t begin;
+
+    /* session objects are never freed before deinit */
+    pthread_mutex_lock(&sess_pool->lock);
+    list_for_each(node, &sess_pool->session_list)
+        count++;
+    group = calloc(count ? count : 1, sizeof(struct session_obj *));
+    if (group) {
+        list_for_each(node, &sess_pool->session_list)
+            group[num++] = node_to_item(node, struct session_obj, node);
+    }
+    pthread_mutex_unlock(&sess_pool->lock);
+
+    live = calloc(count ? count : 1, sizeof(struct session_obj *));
+    recs = calloc(count ? count : 1, sizeof(struct session_recovery));
+    wave = calloc(count ? count : 1, sizeof(uint32_t));
+    threads = calloc(count ? count : 1, sizeof(pthread_t));
+    threaded = calloc(count ? count : 1, sizeof(bool));
+    if (!group || !live || !recs || !wave || !threads || !threaded) {
+        AGM_LOGE("No memory to recover %d sessions\n", count);
+        ret = -ENOMEM;
+        goto done;
+    }
+
+    /*
+     * Every session stays locked, in session id order as group start and
+     * stop do, from the snapshot of the live ones until the last of them
+     * is rebuilt, so no client call lands between the two phases below.
+     */
+    qsort(group, num, sizeof(struct session_obj *), session_cmp_by_id);
+    for (i = 0; i < num; i++)
+        pthread_mutex_lock(&group[i]->lock);
+
+    count = 0;
+    for (i = 0; i < num; i++) {
+        if (group[i]->state != SESSION_CLOSED) {
+            recs[count].sess_obj = group[i];
+            recs[count].state = group[i]->state;
+            live[count++] = group[i];
+        }
+    }
+    num_waves = session_group_waves(live, count, wave);
+    if (num_waves < 0) {
+        ret = num_waves;
+        goto unlock;
+    }
+
+    /* phase 1: tear down every live session, dependents first */
+    for (w = (uint32_t)num_waves; w > 0; w--) {
+        for (i = 0; i < count; i++) {
+            if (wave[i] != w - 1)
+                continue;
+            begin = session_time_us();
+            session_recover_teardown(live[i]);
+            recs[i].time_us = session_time_us() - begin;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        recs[i].status = session_recover_check_closed(live[i]);
+        if (recs[i].status && !ret)
+            ret = recs[i].status;
+    }
+    if (ret)
+        goto report;
+
+    /* phase 2: rebuild, the sessions of one wave in parallel */
+    for (w = 0; w < (uint32_t)num_waves; w++) {
+        for (i = 0; i < count; i++) {
+            if (wave[i] != w)
+                continue;
+            threaded[i] = !pthread_create(&threads[i],
+                                          (const pthread_attr_t *) NULL,
+                                          session_recover, &recs[i]);
+            if (!threaded[i])
+                session_recover(&recs[i]);
+        }
+        for (i = 0; i < count; i++) {
+            if (wave[i] == w && threaded[i])
+                pthread_join(threads[i], (void **) NULL);
+        }
+    }
+
+report:
+    for (i = 0; i < count; i++) {
+        if (recs[i].status && !ret)
+            ret = recs[i].status;
+        if (info && i < *num_sessions) {
+            info[i].session_id = recs[i].sess_obj->sess_id;
+            info[i].status = recs[i].status;
+            info[i].recovery_time_us = recs[i].time_us;
+        }
+    }
+    *num_sessions = count;
+
+unlock:
+    for (i = num; i > 0; i--)
+        pthread_mutex_unlock(&group[i - 1]->lock);
+done:
+    free(threaded);
+    free(threads);
+    free(wave);
+    free(recs);
+    free(live);
+    free(group);
+    return ret;
+}
 
 int session_obj_close(struct session_obj *sess_obj)
 {
@@ -2248,6 +3268,17 @@ int session_obj_close(struct session_obj *sess_obj)
     return ret;
 }
 
+int session_obj_close_async(struct session_obj *sess_obj)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&sess_obj->lock);
+    ret = session_close_async(sess_obj);
+    pthread_mutex_unlock(&sess_obj->lock);
+
+    return ret;
+}
+
 int session_obj_pause(struct session_obj *sess_obj)
 {
     int ret = 0;
@@ -2368,6 +3399,9 @@ int session_obj_read(struct session_obj *sess_obj, void *buff, size_t *count)
     ret = graph_read(sess_obj->graph, &buffer, count);
     if (ret) {
         AGM_LOGE("Error:%d reading from graph\n", ret);
+    } else {
+        sess_obj->stats.num_reads++;
+        sess_obj->stats.bytes_read += *count;
     }
 
 done:
@@ -2396,6 +3430,9 @@ int session_obj_write(struct session_obj *sess_obj, void *buff, size_t *count)
     ret = graph_write(sess_obj->graph, &buffer, count);
     if (ret) {
         AGM_LOGE("Error:%d writing to graph\n", ret);
+    } else {
+        sess_obj->stats.num_writes++;
+        sess_obj->stats.bytes_written += *count;
     }
 
 done:
@@ -2403,6 +3440,34 @@ done:
     return ret;
 }
 
+int session_obj_get_stats(struct session_obj *sess_obj,
+                          struct agm_session_stats *stats)
+{
+    pthread_mutex_lock(&sess_obj->lock);
+    *stats = sess_obj->stats;
+    pthread_mutex_unlock(&sess_obj->lock);
+
+    return 0;
+}
+
+int session_obj_update_stats(struct session_obj *sess_obj,
+                             const struct agm_session_stats *delta)
+{
+    struct agm_session_stats *stats = &sess_obj->stats;
+
+    pthread_mutex_lock(&sess_obj->lock);
+    stats->num_underruns += delta->num_underruns;
+    stats->num_overruns += delta->num_overruns;
+    stats->num_poll_timeouts += delta->num_poll_timeouts;
+    if (delta->max_pos_interval_us > stats->max_pos_interval_us)
+        stats->max_pos_interval_us = delta->max_pos_interval_us;
+    if (delta->latency_us)
+        stats->latency_us = delta->latency_us;
+    pthread_mutex_unlock(&sess_obj->lock);
+
+    return 0;
+}
+
 size_t session_obj_hw_processed_buff_cnt(struct session_obj *sess_obj,
                                                    enum direction dir)
 {
@@ -2651,6 +3716,9 @@ int session_obj_write_with_metadata(struct session_obj *sess_obj,
     ret = graph_write(sess_obj->graph, buffer, consumed_size);
     if (ret) {
         AGM_LOGE("Error:%d writing to graph\n", ret);
+    } else {
+        sess_obj->stats.num_writes++;
+        sess_obj->stats.bytes_written += *consumed_size;
     }
 
 done:
@@ -2675,6 +3743,9 @@ int session_obj_read_with_metadata(struct session_obj *sess_obj,
     ret = graph_read(sess_obj->graph, buffer, &read_size);
     if (ret) {
         AGM_LOGE("Error:%d reading from graph\n", ret);
+    } else {
+        sess_obj->stats.num_reads++;
+        sess_obj->stats.bytes_read += read_size;
     }
 
     *captured_size = (uint32_t)read_size;
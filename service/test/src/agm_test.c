@@ -460,6 +460,66 @@ done:
 	return ret;
 }
 
+int test_run_ops_rollback_on_failure(void) {
+	int ret = 0;
+	uint64_t hndl = 0;
+	struct agm_session_op ops[3] = {
+		{ .type = AGM_SESSION_OP_AIF_CONNECT, .aif_id = 1, .state = true },
+		{ .type = AGM_SESSION_OP_OPEN, .sess_mode = AGM_SESSION_DEFAULT },
+		/* no such aif, fails after the first two steps went through */
+		{ .type = AGM_SESSION_OP_AIF_CONNECT, .aif_id = 0xFFFF, .state = true },
+	};
+
+	ret = testcase_common_init(__func__);
+	if (ret) {
+		goto fail;
+	}
+
+	ret = setup_device_rx();
+	if (ret) {
+		goto fail;
+	}
+
+	ret = setup_playback_stream();
+	if (ret) {
+		goto fail;
+	}
+
+	ret = agm_session_run_ops(session_id_rx1, &hndl, ops, 3);
+	if (ret == 0 || ops[0].status || ops[1].status || !ops[2].status) {
+		printf("%s: Error:%d, last step did not fail alone\n", __func__, ret);
+		ret = -1;
+		goto fail;
+	}
+
+	if (hndl) {
+		printf("%s: Error, session left open\n", __func__);
+		ret = -1;
+		goto fail;
+	}
+
+	// the connect was rolled back, so an open has no aif to run on
+	ret = agm_session_open(session_id_rx1, AGM_SESSION_DEFAULT, &hndl);
+	if (ret == 0) {
+		printf("%s: Error, aif still connected\n", __func__);
+		agm_session_close(hndl);
+		ret = -1;
+		goto fail;
+	}
+	ret = 0;
+
+	printf("TEST PASS: %s()\n", __func__);
+	goto done;
+
+fail:
+	printf("TEST FAIL: %s()\n", __func__);
+	goto done;
+
+done:
+	testcase_common_deinit(__func__);
+	return ret;
+}
+
 int test_device_get_aif_list() {
 	int ret = 0;
 	size_t num_aif_info = 0;
@@ -985,6 +1045,106 @@ done:
 	return ret;
 }
 
+/*
+ * Two started sessions share one backend. agm_recover_all fails with -EBUSY
+ * if the backend is still open when the sessions are rebuilt, so a clean
+ * result means the pcm really was closed and reopened; the writes check
+ * that both sessions run again on the new handle.
+ */
+int test_recover_all_mssd(void) {
+	int ret = 0;
+	char buff[512] = {0};
+	size_t size = 512;
+	size_t num_sessions = 2;
+	size_t i = 0;
+	struct agm_session_recovery_info info[2];
+
+	ret = testcase_common_init(__func__);
+	if (ret) {
+		goto fail;
+	}
+
+	ret = setup_device_rx();
+	if (ret) {
+		goto fail;
+	}
+
+	ret = setup_playback_stream();
+	if (ret) {
+		goto fail;
+	}
+
+	ret = setup_playback_stream_open_prepare_start_with_device_rx();
+	if (ret) {
+		goto fail;
+	}
+
+	ret = setup_playback_stream_2();
+	if (ret) {
+		goto fail;
+	}
+
+	ret = setup_playback_stream_2_open_prepare_start_with_device_rx();
+	if (ret) {
+		goto fail;
+	}
+
+	ret = agm_recover_all(info, &num_sessions);
+	if (ret) {
+		printf("%s: Error:%d, recovery failed\n", __func__, ret);
+		goto fail;
+	}
+
+	if (num_sessions != 2) {
+		printf("%s: Error: recovered %zu sessions, expected 2\n",
+				__func__, num_sessions);
+		ret = -1;
+		goto fail;
+	}
+
+	for (i = 0; i < num_sessions; i++) {
+		if (info[i].status) {
+			printf("%s: Error:%d, session id:%d not recovered\n", __func__,
+					info[i].status, info[i].session_id);
+			ret = info[i].status;
+			goto fail;
+		}
+	}
+
+	ret = agm_session_write(sess_handle_rx1, buff, &size);
+	if (ret) {
+		printf("%s: Error:%d, session write failed\n", __func__, ret);
+		goto fail;
+	}
+
+	ret = agm_session_write(sess_handle_rx2, buff, &size);
+	if (ret) {
+		printf("%s: Error:%d, session 2 write failed\n", __func__, ret);
+		goto fail;
+	}
+
+	ret = setup_playback_stream_2_stop_close();
+	if (ret) {
+		goto fail;
+	}
+
+	ret = setup_playback_stream_stop_close();
+	if (ret) {
+		goto fail;
+	}
+
+	printf("TEST PASS: %s()\n", __func__);
+	goto done;
+
+fail:
+	printf("TEST FAIL: %s()\n", __func__);
+	goto done;
+
+done:
+	testcase_common_deinit(__func__);
+	return ret;
+}
+
 int test_capture_sess_loopback()
 {
 	int ret = 0;
@@ -1479,10 +1639,12 @@ int main() {
 				test_stream_set_ecref,
 				test_get_tagged_module_info,
 				test_event_registration_and_notification,
+				test_recover_all_mssd,
 				//adverserial test cases
 				test_stream_open_without_aif_connected,
 				test_stream_open_with_same_aif_twice,
 				test_stream_deint_with_mssd,
+				test_run_ops_rollback_on_failure,
 
 	};
 
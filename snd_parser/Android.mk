@@ -8,6 +8,7 @@ LOCAL_VENDOR_MODULE  := true
 
 LOCAL_CFLAGS         := -Wno-unused-parameter -Wall
 LOCAL_CFLAGS         += -DCARD_DEF_FILE=\"/vendor/etc/card-defs.xml\"
+LOCAL_CFLAGS         += -DCARD_DEF_BIN_FILE=\"/data/vendor/audio/card-defs.bin\"
 
 LOCAL_C_INCLUDES            := $(LOCAL_PATH)/inc
 LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)/inc
@@ -20,3 +21,34 @@ LOCAL_SHARED_LIBRARIES := \
     libcutils
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE         := card-defs-compile
+LOCAL_MODULE_OWNER   := qti
+LOCAL_MODULE_TAGS    := optional
+LOCAL_VENDOR_MODULE  := true
+
+LOCAL_CFLAGS         := -Wno-unused-parameter -Wall
+LOCAL_SRC_FILES      := src/card-defs-compile.c
+LOCAL_SHARED_LIBRARIES := libsndcardparser
+LOCAL_INIT_RC        := card-defs-compile.rc
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE         := snd_card_def_bench
+LOCAL_MODULE_OWNER   := qti
+LOCAL_MODULE_TAGS    := optional
+LOCAL_VENDOR_MODULE  := true
+
+LOCAL_CFLAGS         := -O2 -Wno-unused-parameter -Wall
+LOCAL_C_INCLUDES     := $(LOCAL_PATH)/inc
+LOCAL_SRC_FILES      := test/snd_card_def_bench.c
+LOCAL_HEADER_LIBRARIES := libagm_headers
+LOCAL_SHARED_LIBRARIES := \
+    libexpat \
+    libcutils
+
+include $(BUILD_EXECUTABLE)
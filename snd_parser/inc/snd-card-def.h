@@ -86,6 +86,11 @@ int snd_card_def_get_str(void *node, const char *prop,
 	return -EINVAL;
 }
 
+int snd_card_def_compile(const char *xml_file, const char *bin_file)
+{
+	return -EINVAL;
+}
+
 #else
 
 /*
@@ -194,5 +199,22 @@ int snd_card_def_get_int(void *node, const char *prop,
 int snd_card_def_get_str(void *node, const char *prop,
 						 char **val);
 
+/*
+ * snd_card_def_compile:
+ *	Compile every card of a sound card definition XML into a
+ *	binary image. snd_card_def_get_card maps such an image in
+ *	place of the XML as long as the XML it was built from is
+ *	unchanged, but never writes one: the image is produced by
+ *	card-defs-compile at install or boot time.
+ *
+ * @xml_file: sound card definition XML to read
+ * @bin_file: path of the image to write, replaced atomically
+ *
+ * Returns:
+ *	- zero on success
+ *	- negative error code on failure
+ */
+int snd_card_def_compile(const char *xml_file, const char *bin_file);
+
 #endif // end of SOME_COMPILE_TIME_FLAG_HERE
 #endif // end of __SND_CARD_DEF_H__
@@ -0,0 +1,32 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Precompile card-defs.xml into the image snd_parser maps at card lookup.
+ * Run at install time on native builds and from init at boot on Android;
+ * the parser itself only ever reads the image.
+ */
+
+#include <snd-card-def.h>
+#include <stdio.h>
+#include <string.h>
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    if (argc != 3) {
+        printf(" Usage: card-defs-compile <card-defs.xml> <card-defs.bin>\n");
+        return 1;
+    }
+
+    ret = snd_card_def_compile(argv[1], argv[2]);
+    if (ret) {
+        printf("compiling %s failed: %s\n", argv[1], strerror(-ret));
+        return 1;
+    }
+
+    return 0;
+}
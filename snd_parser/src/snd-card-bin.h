@@ -0,0 +1,136 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Precompiled card-defs image.
+ *
+ * snd_card_def_compile() flattens every card of card-defs.xml into one
+ * read-only image that snd_parser maps instead of parsing the XML. All
+ * offsets are in bytes from the start of the image except string
+ * references, which are offsets into the string table; string 0 is the
+ * empty string and stands for "not set". The image is in native byte
+ * order and records the size and hash of the XML it came from, so a
+ * stale image is ignored and the XML is parsed as before.
+ *
+ * A card with several comma separated names in the XML gets one card
+ * entry per name, all sharing the same node arrays. Per node type there
+ * is an array of nodes in XML order and an id map sorted by device id.
+ * Every node carries its props with the integer value already converted
+ * and a perfect hash table over the prop names: slot
+ * snd_bin_hash(seed, name) & mask holds the prop index + 1 of the only
+ * prop that can match, 0 if none.
+ */
+
+#ifndef __SND_CARD_BIN_H__
+#define __SND_CARD_BIN_H__
+
+#include <snd-card-def.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SND_BIN_MAGIC       0x42444353 /* "SCDB" */
+#define SND_BIN_VERSION     1
+
+struct snd_bin_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t image_size;
+    uint32_t xml_size;
+    uint64_t xml_hash;
+    uint32_t num_cards;
+    uint32_t cards_off;
+    uint32_t strtab_off;
+    uint32_t strtab_size;
+};
+
+struct snd_bin_card {
+    uint32_t card;
+    uint32_t name;
+    uint32_t nodes_off[SND_NODE_TYPE_MAX];
+    uint32_t id_map_off[SND_NODE_TYPE_MAX];
+    uint32_t num_nodes[SND_NODE_TYPE_MAX];
+    uint32_t num_ids[SND_NODE_TYPE_MAX];    /* first of duplicate ids only */
+};
+
+struct snd_bin_node {
+    uint32_t device;
+    int32_t type;
+    uint32_t name;
+    uint32_t so_name;
+    uint32_t props_off;
+    uint32_t num_props;
+    uint32_t hash_off;      /* uint16_t slots[hash_mask + 1] */
+    uint32_t hash_mask;
+    uint32_t hash_seed;
+};
+
+struct snd_bin_prop {
+    uint32_t name;
+    uint32_t val;
+    int32_t ival;           /* atoi(val) */
+};
+
+struct snd_bin_id {
+    uint32_t id;
+    uint32_t idx;
+};
+
+#define SND_BIN_PTR(base, off, type) \
+    ((type *)((uint8_t *)(base) + (off)))
+
+static inline uint32_t snd_bin_hash(uint32_t seed, const char *s)
+{
+    uint32_t h = 2166136261u ^ seed;
+
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+
+    return h ^ (h >> 15);
+}
+
+static inline const struct snd_bin_prop *snd_bin_find_prop(const void *img,
+        const struct snd_bin_hdr *hdr, const struct snd_bin_node *node,
+        const char *prop)
+{
+    const uint16_t *slots = SND_BIN_PTR(img, node->hash_off, const uint16_t);
+    const struct snd_bin_prop *p;
+    const char *strtab = SND_BIN_PTR(img, hdr->strtab_off, const char);
+    uint16_t idx;
+
+    if (!node->num_props)
+        return NULL;
+
+    idx = slots[snd_bin_hash(node->hash_seed, prop) & node->hash_mask];
+    if (!idx)
+        return NULL;
+
+    p = SND_BIN_PTR(img, node->props_off, const struct snd_bin_prop) + idx - 1;
+    if (strcmp(strtab + p->name, prop))
+        return NULL;
+
+    return p;
+}
+
+static inline const struct snd_bin_id *snd_bin_find_id(
+        const struct snd_bin_id *map, uint32_t num, uint32_t id)
+{
+    uint32_t lo = 0, hi = num, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (map[mid].id == id)
+            return &map[mid];
+        if (map[mid].id < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return NULL;
+}
+
+#endif /* __SND_CARD_BIN_H__ */
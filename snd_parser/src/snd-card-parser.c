@@ -33,19 +33,33 @@
 
 #include <errno.h>
 #include <expat.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <pthread.h>
 #include <snd-card-def.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <agm/agm_list.h>
 
+#include "snd-card-bin.h"
+
 #define MAX_PATH 256
 #define BUF_SIZE 1024
 
+#ifndef CARD_DEF_BIN_FILE
+#define CARD_DEF_BIN_FILE CARD_DEF_FILE ".bin"
+#endif
+
+/* longest perfect hash table tried for one node, in slots */
+#define SND_BIN_MAX_SLOTS 65536
+#define SND_BIN_MAX_SEEDS 256
+
 
 struct snd_prop_val_pair {
     char *prop;
@@ -68,6 +82,9 @@ struct snd_dev_def {
 
     /* List of custom properties */
     struct listnode prop_val_list;
+
+    /* set when the node comes from the precompiled image */
+    const struct snd_bin_node *bin;
 };
 
 struct snd_dev_def_card {
@@ -81,12 +98,30 @@ struct snd_dev_def_card {
     struct listnode pcm_devs_list;
     struct listnode mixer_devs_list;
     struct listnode compr_devs_list;
+
+    /* image backed cards keep their nodes in one array per type */
+    const struct snd_bin_card *bin;
+    struct snd_dev_def *bin_devs[SND_NODE_TYPE_MAX];
+};
+
+enum snd_bin_state {
+    SND_BIN_UNTRIED = 0,
+    SND_BIN_MAPPED,
+    SND_BIN_UNAVAILABLE,
 };
 
 static struct listnode snd_card_list;
 static bool snd_card_list_init = false;
 static pthread_rwlock_t snd_rwlock = PTHREAD_RWLOCK_INITIALIZER;
 
+/*
+ * Precompiled image, mapped on first use for the life of the process;
+ * staleness against the XML is only checked then.
+ */
+static enum snd_bin_state snd_bin_state = SND_BIN_UNTRIED;
+static void *snd_bin_addr;
+static size_t snd_bin_size;
+
 typedef enum {
     TAG_ROOT,
     TAG_CARD,
@@ -106,6 +141,10 @@ struct xml_userdata {
     bool card_found;
     bool card_parsed;
     snd_card_defs_xml_tags_t current_tag;
+
+    /* collect every card into cards instead of looking one up */
+    bool all_cards;
+    struct listnode *cards;
 };
 
 static void snd_process_data_buf(struct xml_userdata *data, const XML_Char *tag_name);
@@ -176,8 +215,14 @@ static void snd_end_tag(void *userdata, const XML_Char *tag_name)
         data->current_tag = TAG_DEVICE;
     else if(!strcmp(tag_name, "card")) {
         data->current_tag = TAG_ROOT;
-        if (data->card_found)
+        if (data->all_cards && data->cur_card_def) {
+            list_add_tail(data->cards, &data->cur_card_def->list_node);
+            data->cur_card_def = NULL;
+            data->cur_dev_def = NULL;
+            data->card_found = false;
+        } else if (data->card_found) {
             data->card_parsed = true;
+        }
     }
 }
 
@@ -258,13 +303,15 @@ static void snd_parse_card_properties(struct xml_userdata *data, const XML_Char
 
     if (!strcmp(tag_name, "id")) {
         card = atoi(data->data_buf);
-        if (card == data->card) {
+        if (card == data->card || data->all_cards) {
             card_def = snd_parse_initialize_card_def(data);
             if (card_def)
                 card_def->card = card;
         }
     } else if (!strcmp(tag_name, "name")) {
         card_def = data->cur_card_def;
+        if (!card_def && data->all_cards)
+            card_def = snd_parse_initialize_card_def(data);
         if (!card_def) {
             if (!data->card_name)
                 return;
@@ -419,10 +466,19 @@ static void snd_free_card_devs_def(struct listnode *dev_list)
 static void snd_free_card_def(struct snd_dev_def_card *card_def)
 {
     struct listnode *dev_list;
+    int type;
 
     if (!card_def)
         return;
 
+    /* names and props live in the image */
+    if (card_def->bin) {
+        for (type = SND_NODE_TYPE_MIN; type < SND_NODE_TYPE_MAX; type++)
+            free(card_def->bin_devs[type]);
+        free(card_def);
+        return;
+    }
+
     dev_list = &card_def->pcm_devs_list;
     snd_free_card_devs_def(dev_list);
 
@@ -437,12 +493,718 @@ static void snd_free_card_def(struct snd_dev_def_card *card_def)
     free(card_def);
 }
 
-void *snd_card_def_get_card(unsigned int card)
+static struct listnode *snd_card_devs_list(struct snd_dev_def_card *card_def,
+                                           int type)
+{
+    if (type == SND_NODE_TYPE_PCM)
+        return &card_def->pcm_devs_list;
+    else if (type == SND_NODE_TYPE_COMPR)
+        return &card_def->compr_devs_list;
+
+    return &card_def->mixer_devs_list;
+}
+
+static int snd_parse_xml(const char *filename, struct xml_userdata *data)
 {
     FILE *file;
     XML_Parser parser;
     void *buf;
-    int bytes_read, len = 0;
+    int bytes_read, ret = 0;
+
+    file = fopen(filename, "r");
+    if (!file)
+        return -errno;
+
+    parser = XML_ParserCreate(NULL);
+    if (!parser) {
+        ret = -ENOMEM;
+        goto close_file;
+    }
+
+    XML_SetUserData(parser, data);
+    XML_SetElementHandler(parser, snd_start_tag, snd_end_tag);
+    XML_SetCharacterDataHandler(parser, snd_data_handler);
+
+    for (;;) {
+        buf = XML_GetBuffer(parser, BUF_SIZE);
+        if (buf == NULL) {
+            ret = -ENOMEM;
+            break;
+        }
+        bytes_read = fread(buf, 1, BUF_SIZE, file);
+
+        if (bytes_read < 0) {
+            ret = -EIO;
+            break;
+        }
+
+        if (XML_ParseBuffer(parser, bytes_read,
+                            bytes_read == 0) == XML_STATUS_ERROR) {
+            ret = -EINVAL;
+            break;
+        }
+
+        if (bytes_read == 0)
+            break;
+    }
+
+    XML_ParserFree(parser);
+close_file:
+    fclose(file);
+    return ret;
+}
+
+/* size and FNV-1a hash of the XML, to tell a stale image apart */
+static int snd_xml_digest(const char *filename, uint32_t *size, uint64_t *hash)
+{
+    uint8_t buf[BUF_SIZE];
+    uint64_t h = 14695981039346656037ULL;
+    uint32_t total = 0;
+    size_t n, i;
+    FILE *file;
+
+    file = fopen(filename, "r");
+    if (!file)
+        return -errno;
+
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        for (i = 0; i < n; i++) {
+            h ^= buf[i];
+            h *= 1099511628211ULL;
+        }
+        total += n;
+    }
+    fclose(file);
+
+    *size = total;
+    *hash = h;
+    return 0;
+}
+
+struct snd_bin_buf {
+    uint8_t *data;
+    size_t size;
+    size_t cap;
+};
+
+/* append len zeroed bytes at the given alignment, returns their offset */
+static int snd_bin_reserve(struct snd_bin_buf *b, size_t len, size_t align,
+                           uint32_t *off)
+{
+    size_t start = (b->size + align - 1) & ~(align - 1);
+    size_t cap = b->cap ? b->cap : 4096;
+    uint8_t *data;
+
+    if (start + len > UINT32_MAX)
+        return -E2BIG;
+
+    while (cap < start + len)
+        cap *= 2;
+
+    if (cap != b->cap) {
+        data = realloc(b->data, cap);
+        if (!data)
+            return -ENOMEM;
+        memset(data + b->cap, 0, cap - b->cap);
+        b->data = data;
+        b->cap = cap;
+    }
+
+    *off = start;
+    b->size = start + len;
+    return 0;
+}
+
+static int snd_bin_add_str(struct snd_bin_buf *st, const char *s, uint32_t *off)
+{
+    size_t pos, len;
+    int ret;
+
+    if (!s || !*s) {
+        *off = 0;
+        return 0;
+    }
+
+    /* prop names repeat on every node, keep one copy */
+    len = strlen(s) + 1;
+    for (pos = 1; pos + len <= st->size;
+         pos += strlen((char *)st->data + pos) + 1) {
+        if (!memcmp(st->data + pos, s, len)) {
+            *off = pos;
+            return 0;
+        }
+    }
+
+    ret = snd_bin_reserve(st, len, 1, off);
+    if (!ret)
+        memcpy(st->data + *off, s, len);
+
+    return ret;
+}
+
+static int snd_bin_add_node(struct snd_bin_buf *b, struct snd_bin_buf *st,
+                            struct snd_dev_def *dev_def, uint32_t node_off)
+{
+    struct snd_prop_val_pair *pv_pair, **pvs = NULL;
+    struct snd_bin_node *node;
+    struct snd_bin_prop *props;
+    struct listnode *pv_pair_node, *temp;
+    uint32_t n = 0, i, j, size, seed = 0, slot, props_off, hash_off;
+    uint32_t name, str;
+    uint16_t *slots = NULL, *tmp;
+    int ret;
+
+    list_for_each_safe(pv_pair_node, temp, &dev_def->prop_val_list)
+        n++;
+
+    pvs = calloc(n ? n : 1, sizeof(*pvs));
+    if (!pvs)
+        return -ENOMEM;
+
+    /* lookups return the first of a repeated prop, drop the others */
+    i = 0;
+    list_for_each_safe(pv_pair_node, temp, &dev_def->prop_val_list) {
+        pv_pair = node_to_item(pv_pair_node, struct snd_prop_val_pair, list_node);
+        for (j = 0; j < i; j++)
+            if (!strcmp(pvs[j]->prop, pv_pair->prop))
+                break;
+        if (j == i)
+            pvs[i++] = pv_pair;
+    }
+    n = i;
+
+    for (size = 1; size < n; size <<= 1)
+        ;
+
+    for (; size <= SND_BIN_MAX_SLOTS && n; size <<= 1) {
+        tmp = realloc(slots, size * sizeof(*slots));
+        if (!tmp) {
+            ret = -ENOMEM;
+            goto done;
+        }
+        slots = tmp;
+
+        for (seed = 0; seed < SND_BIN_MAX_SEEDS; seed++) {
+            memset(slots, 0, size * sizeof(*slots));
+            for (i = 0; i < n; i++) {
+                slot = snd_bin_hash(seed, pvs[i]->prop) & (size - 1);
+                if (slots[slot])
+                    break;
+                slots[slot] = i + 1;
+            }
+            if (i == n)
+                goto found;
+        }
+    }
+
+    if (n) {
+        ret = -E2BIG;
+        goto done;
+    }
+
+found:
+    ret = snd_bin_reserve(b, n * sizeof(*props), 4, &props_off);
+    if (ret)
+        goto done;
+    ret = snd_bin_reserve(b, n ? size * sizeof(*slots) : 0, 4, &hash_off);
+    if (ret)
+        goto done;
+
+    for (i = 0; i < n; i++) {
+        ret = snd_bin_add_str(st, pvs[i]->prop, &name);
+        if (ret)
+            goto done;
+        ret = snd_bin_add_str(st, pvs[i]->val, &str);
+        if (ret)
+            goto done;
+        props = SND_BIN_PTR(b->data, props_off, struct snd_bin_prop) + i;
+        props->name = name;
+        props->val = str;
+        props->ival = atoi(pvs[i]->val);
+    }
+    if (n)
+        memcpy(b->data + hash_off, slots, size * sizeof(*slots));
+
+    ret = snd_bin_add_str(st, dev_def->name, &name);
+    if (ret)
+        goto done;
+    ret = snd_bin_add_str(st, dev_def->so_name, &str);
+    if (ret)
+        goto done;
+
+    node = SND_BIN_PTR(b->data, node_off, struct snd_bin_node);
+    node->device = dev_def->device;
+    node->type = dev_def->type;
+    node->name = name;
+    node->so_name = str;
+    node->props_off = props_off;
+    node->num_props = n;
+    node->hash_off = hash_off;
+    node->hash_mask = n ? size - 1 : 0;
+    node->hash_seed = seed;
+
+done:
+    free(slots);
+    free(pvs);
+    return ret;
+}
+
+static int snd_bin_id_cmp(const void *a, const void *b)
+{
+    const struct snd_bin_id *x = a, *y = b;
+
+    if (x->id != y->id)
+        return x->id < y->id ? -1 : 1;
+
+    return x->idx < y->idx ? -1 : (x->idx > y->idx);
+}
+
+static int snd_bin_add_card_nodes(struct snd_bin_buf *b, struct snd_bin_buf *st,
+                                  struct snd_dev_def_card *card_def,
+                                  struct snd_bin_card *bin_card)
+{
+    struct snd_dev_def *dev_def;
+    struct snd_bin_node *nodes;
+    struct snd_bin_id *ids;
+    struct listnode *dev_node, *temp, *devs_list;
+    uint32_t n, i, j, nodes_off, ids_off;
+    int type, ret;
+
+    for (type = SND_NODE_TYPE_MIN; type < SND_NODE_TYPE_MAX; type++) {
+        devs_list = snd_card_devs_list(card_def, type);
+        n = 0;
+        list_for_each_safe(dev_node, temp, devs_list)
+            n++;
+
+        ret = snd_bin_reserve(b, n * sizeof(*nodes), 4, &nodes_off);
+        if (ret)
+            return ret;
+        ret = snd_bin_reserve(b, n * sizeof(*ids), 4, &ids_off);
+        if (ret)
+            return ret;
+
+        i = 0;
+        list_for_each_safe(dev_node, temp, devs_list) {
+            dev_def = node_to_item(dev_node, struct snd_dev_def, list_node);
+            ret = snd_bin_add_node(b, st, dev_def,
+                                   nodes_off + i++ * sizeof(*nodes));
+            if (ret)
+                return ret;
+        }
+
+        nodes = SND_BIN_PTR(b->data, nodes_off, struct snd_bin_node);
+        ids = SND_BIN_PTR(b->data, ids_off, struct snd_bin_id);
+        for (i = 0; i < n; i++) {
+            ids[i].id = nodes[i].device;
+            ids[i].idx = i;
+        }
+        qsort(ids, n, sizeof(*ids), snd_bin_id_cmp);
+        /* get_node returns the first node with a given id */
+        for (i = 0, j = 0; i < n; i++) {
+            if (j && ids[j - 1].id == ids[i].id)
+                continue;
+            ids[j++] = ids[i];
+        }
+
+        bin_card->nodes_off[type] = nodes_off;
+        bin_card->id_map_off[type] = ids_off;
+        bin_card->num_nodes[type] = n;
+        bin_card->num_ids[type] = j;
+    }
+
+    return 0;
+}
+
+static int snd_bin_write(const char *bin_file, struct snd_bin_buf *b)
+{
+    char tmp[MAX_PATH];
+    FILE *file;
+    int ret = 0;
+
+    /* write aside and rename, readers only ever see a whole image */
+    snprintf(tmp, sizeof(tmp), "%s.%d", bin_file, getpid());
+    file = fopen(tmp, "w");
+    if (!file)
+        return -errno;
+
+    if (fwrite(b->data, 1, b->size, file) != b->size)
+        ret = -EIO;
+    if (fclose(file) && !ret)
+        ret = -EIO;
+    if (!ret && rename(tmp, bin_file))
+        ret = -errno;
+    if (ret)
+        unlink(tmp);
+
+    return ret;
+}
+
+int snd_card_def_compile(const char *xml_file, const char *bin_file)
+{
+    struct xml_userdata card_data;
+    struct listnode cards, *card_node, *temp;
+    struct snd_dev_def_card *card_def;
+    struct snd_bin_buf b, st, cb;
+    struct snd_bin_card bin_card;
+    struct snd_bin_hdr *hdr;
+    uint32_t xml_size, num_cards = 0, off, cards_off, strtab_off;
+    uint64_t xml_hash;
+    char *names = NULL, *token, *tok_ptr;
+    int ret;
+
+    memset(&b, 0, sizeof(b));
+    memset(&st, 0, sizeof(st));
+    memset(&cb, 0, sizeof(cb));
+    memset(&card_data, 0, sizeof(card_data));
+    list_init(&cards);
+    card_data.all_cards = true;
+    card_data.cards = &cards;
+
+    ret = snd_xml_digest(xml_file, &xml_size, &xml_hash);
+    if (ret)
+        return ret;
+
+    ret = snd_parse_xml(xml_file, &card_data);
+    if (ret)
+        goto done;
+
+    ret = snd_bin_reserve(&b, sizeof(*hdr), 8, &off);
+    if (ret)
+        goto done;
+    /* string 0 is the empty string */
+    ret = snd_bin_reserve(&st, 1, 1, &off);
+    if (ret)
+        goto done;
+
+    list_for_each_safe(card_node, temp, &cards) {
+        card_def = node_to_item(card_node, struct snd_dev_def_card, list_node);
+        memset(&bin_card, 0, sizeof(bin_card));
+        bin_card.card = card_def->card;
+        ret = snd_bin_add_card_nodes(&b, &st, card_def, &bin_card);
+        if (ret)
+            goto done;
+
+        /* one entry per name the card can be looked up by */
+        names = strdup(card_def->name ? card_def->name : "");
+        if (!names) {
+            ret = -ENOMEM;
+            goto done;
+        }
+        token = strtok_r(names, ", ", &tok_ptr);
+        do {
+            ret = snd_bin_add_str(&st, token, &bin_card.name);
+            if (ret)
+                goto done;
+            ret = snd_bin_reserve(&cb, sizeof(bin_card), 4, &off);
+            if (ret)
+                goto done;
+            memcpy(cb.data + off, &bin_card, sizeof(bin_card));
+            num_cards++;
+        } while (token && (token = strtok_r(NULL, ", ", &tok_ptr)));
+        free(names);
+        names = NULL;
+    }
+
+    ret = snd_bin_reserve(&b, cb.size, 4, &cards_off);
+    if (ret)
+        goto done;
+    if (cb.size)
+        memcpy(b.data + cards_off, cb.data, cb.size);
+    ret = snd_bin_reserve(&b, st.size, 4, &strtab_off);
+    if (ret)
+        goto done;
+    memcpy(b.data + strtab_off, st.data, st.size);
+
+    hdr = (struct snd_bin_hdr *)b.data;
+    hdr->magic = SND_BIN_MAGIC;
+    hdr->version = SND_BIN_VERSION;
+    hdr->image_size = b.size;
+    hdr->xml_size = xml_size;
+    hdr->xml_hash = xml_hash;
+    hdr->num_cards = num_cards;
+    hdr->cards_off = cards_off;
+    hdr->strtab_off = strtab_off;
+    hdr->strtab_size = st.size;
+
+    ret = snd_bin_write(bin_file, &b);
+
+done:
+    free(names);
+    free(b.data);
+    free(st.data);
+    free(cb.data);
+    list_for_each_safe(card_node, temp, &cards) {
+        card_def = node_to_item(card_node, struct snd_dev_def_card, list_node);
+        list_remove(card_node);
+        snd_free_card_def(card_def);
+    }
+    snd_free_card_def(card_data.cur_card_def);
+    return ret;
+}
+
+static bool snd_bin_in(size_t size, uint64_t off, uint64_t len, size_t align)
+{
+    return !(off % align) && off <= size && len <= size - off;
+}
+
+/* bounds check everything a lookup can touch, the image may be a cache */
+static bool snd_bin_valid(const void *img, size_t size)
+{
+    const struct snd_bin_hdr *hdr = img;
+    const struct snd_bin_card *cards;
+    const struct snd_bin_node *nodes, *node;
+    const struct snd_bin_prop *props;
+    const struct snd_bin_id *ids;
+    const uint16_t *slots;
+    const char *strtab;
+    uint32_t i, j, k, st_size;
+    int type;
+
+    if (size < sizeof(*hdr) || hdr->magic != SND_BIN_MAGIC ||
+        hdr->version != SND_BIN_VERSION || hdr->image_size != size)
+        return false;
+
+    st_size = hdr->strtab_size;
+    if (!snd_bin_in(size, hdr->strtab_off, st_size, 1) || !st_size)
+        return false;
+    strtab = SND_BIN_PTR(img, hdr->strtab_off, const char);
+    if (strtab[0] || strtab[st_size - 1])
+        return false;
+
+    if (!snd_bin_in(size, hdr->cards_off,
+                    (uint64_t)hdr->num_cards * sizeof(*cards), 4))
+        return false;
+    cards = SND_BIN_PTR(img, hdr->cards_off, const struct snd_bin_card);
+
+    for (i = 0; i < hdr->num_cards; i++) {
+        if (cards[i].name >= st_size)
+            return false;
+
+        for (type = SND_NODE_TYPE_MIN; type < SND_NODE_TYPE_MAX; type++) {
+            if (!snd_bin_in(size, cards[i].nodes_off[type],
+                            (uint64_t)cards[i].num_nodes[type] * sizeof(*node), 4) ||
+                !snd_bin_in(size, cards[i].id_map_off[type],
+                            (uint64_t)cards[i].num_ids[type] * sizeof(*ids), 4) ||
+                cards[i].num_ids[type] > cards[i].num_nodes[type])
+                return false;
+
+            ids = SND_BIN_PTR(img, cards[i].id_map_off[type], const struct snd_bin_id);
+            for (j = 0; j < cards[i].num_ids[type]; j++)
+                if (ids[j].idx >= cards[i].num_nodes[type])
+                    return false;
+
+            nodes = SND_BIN_PTR(img, cards[i].nodes_off[type], const struct snd_bin_node);
+            for (j = 0; j < cards[i].num_nodes[type]; j++) {
+                node = &nodes[j];
+                if (node->name >= st_size || node->so_name >= st_size ||
+                    !snd_bin_in(size, node->props_off,
+                                (uint64_t)node->num_props * sizeof(*props), 4) ||
+                    !snd_bin_in(size, node->hash_off,
+                                node->num_props ?
+                                ((uint64_t)node->hash_mask + 1) * sizeof(*slots) : 0, 4))
+                    return false;
+
+                props = SND_BIN_PTR(img, node->props_off, const struct snd_bin_prop);
+                for (k = 0; k < node->num_props; k++)
+                    if (props[k].name >= st_size || props[k].val >= st_size)
+                        return false;
+
+                slots = SND_BIN_PTR(img, node->hash_off, const uint16_t);
+                for (k = 0; node->num_props && k <= node->hash_mask; k++)
+                    if (slots[k] > node->num_props)
+                        return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/* called with snd_rwlock held for writing */
+static int snd_bin_map(void)
+{
+    const struct snd_bin_hdr *hdr;
+    struct stat st;
+    uint32_t xml_size;
+    uint64_t xml_hash;
+    void *addr;
+    int fd, ret = 0;
+
+    fd = open(CARD_DEF_BIN_FILE, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+
+    if (fstat(fd, &st) || st.st_size < (off_t)sizeof(*hdr)) {
+        close(fd);
+        return -EINVAL;
+    }
+
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return -errno;
+
+    hdr = addr;
+    if (!snd_bin_valid(addr, st.st_size)) {
+        ret = -EINVAL;
+    } else if (!snd_xml_digest(CARD_DEF_FILE, &xml_size, &xml_hash) &&
+               (xml_size != hdr->xml_size || xml_hash != hdr->xml_hash)) {
+        /* with no XML around the image is all there is */
+        ret = -ESTALE;
+    }
+
+    if (ret) {
+        munmap(addr, st.st_size);
+        return ret;
+    }
+
+    snd_bin_addr = addr;
+    snd_bin_size = st.st_size;
+    snd_bin_state = SND_BIN_MAPPED;
+    return 0;
+}
+
+/* called with snd_rwlock held for writing */
+static struct snd_dev_def_card *snd_bin_get_card(unsigned int card,
+                                                 const char *card_name)
+{
+    const struct snd_bin_hdr *hdr;
+    const struct snd_bin_card *cards, *bin_card = NULL;
+    const struct snd_bin_node *nodes;
+    const char *strtab;
+    struct snd_dev_def_card *card_def;
+    struct snd_dev_def *devs;
+    uint32_t i;
+    int type;
+
+    /*
+     * The image is written at install or boot by card-defs-compile, never
+     * here: clients may not be able to write it, and a failed attempt
+     * would cost every process a compile on top of the XML parse.
+     */
+    if (snd_bin_state == SND_BIN_UNTRIED && snd_bin_map())
+        snd_bin_state = SND_BIN_UNAVAILABLE;
+
+    if (snd_bin_state != SND_BIN_MAPPED)
+        return NULL;
+
+    hdr = snd_bin_addr;
+    strtab = SND_BIN_PTR(snd_bin_addr, hdr->strtab_off, const char);
+    cards = SND_BIN_PTR(snd_bin_addr, hdr->cards_off, const struct snd_bin_card);
+    for (i = 0; i < hdr->num_cards; i++) {
+        if (card_name) {
+            if (!strncmp(card_name, strtab + cards[i].name, strlen(card_name))) {
+                bin_card = &cards[i];
+                break;
+            }
+        } else if (cards[i].card == card) {
+            bin_card = &cards[i];
+            break;
+        }
+    }
+
+    if (!bin_card)
+        return NULL;
+
+    card_def = calloc(1, sizeof(struct snd_dev_def_card));
+    if (!card_def)
+        return NULL;
+
+    card_def->card = bin_card->card;
+    card_def->name = (char *)strtab + bin_card->name;
+    card_def->bin = bin_card;
+    list_init(&card_def->pcm_devs_list);
+    list_init(&card_def->mixer_devs_list);
+    list_init(&card_def->compr_devs_list);
+
+    for (type = SND_NODE_TYPE_MIN; type < SND_NODE_TYPE_MAX; type++) {
+        if (!bin_card->num_nodes[type])
+            continue;
+
+        devs = calloc(bin_card->num_nodes[type], sizeof(*devs));
+        if (!devs) {
+            snd_free_card_def(card_def);
+            return NULL;
+        }
+        card_def->bin_devs[type] = devs;
+
+        nodes = SND_BIN_PTR(snd_bin_addr, bin_card->nodes_off[type],
+                            const struct snd_bin_node);
+        for (i = 0; i < bin_card->num_nodes[type]; i++) {
+            devs[i].node_type = type;
+            devs[i].card = card_def;
+            devs[i].device = nodes[i].device;
+            devs[i].type = nodes[i].type;
+            devs[i].name = nodes[i].name ?
+                           (char *)strtab + nodes[i].name : NULL;
+            devs[i].so_name = nodes[i].so_name ?
+                              (char *)strtab + nodes[i].so_name : NULL;
+            devs[i].bin = &nodes[i];
+            list_init(&devs[i].prop_val_list);
+            list_add_tail(snd_card_devs_list(card_def, type),
+                          &devs[i].list_node);
+        }
+    }
+
+    return card_def;
+}
+
+/*
+ * Image backed nodes are read-only and live as long as the caller holds
+ * the card, so they are looked up without snd_rwlock.
+ */
+static int snd_bin_get_int(struct snd_dev_def *dev_def, const char *prop,
+                           int *val)
+{
+    const struct snd_bin_hdr *hdr = snd_bin_addr;
+    const struct snd_bin_prop *p;
+
+    if (!strcmp(prop, "type")) {
+        *val = dev_def->type;
+        return 0;
+    } else if (!strcmp(prop, "id")) {
+        *val = dev_def->device;
+        return 0;
+    }
+
+    p = snd_bin_find_prop(snd_bin_addr, hdr, dev_def->bin, prop);
+    if (!p)
+        return -EINVAL;
+
+    *val = p->ival;
+    return 0;
+}
+
+static int snd_bin_get_str(struct snd_dev_def *dev_def, const char *prop,
+                           char **val)
+{
+    const struct snd_bin_hdr *hdr = snd_bin_addr;
+    const struct snd_bin_prop *p;
+
+    if (!strcmp(prop, "so-name")) {
+        if (dev_def->so_name)
+            *val = dev_def->so_name;
+        return 0;
+    }
+
+    if (!strcmp(prop, "name")) {
+        if (dev_def->name)
+            *val = dev_def->name;
+        return 0;
+    }
+
+    p = snd_bin_find_prop(snd_bin_addr, hdr, dev_def->bin, prop);
+    if (!p)
+        return -EINVAL;
+
+    *val = SND_BIN_PTR(snd_bin_addr, hdr->strtab_off, char) + p->val;
+    return 0;
+}
+
+void *snd_card_def_get_card(unsigned int card)
+{
+    FILE *file;
+    int len = 0;
     char *snd_card_name = NULL;
     bool card_found = false;
     struct listnode *snd_card_node, *temp;
@@ -496,51 +1258,20 @@ void *snd_card_def_get_card(unsigned int card)
         }
     }
 
-    card_def = NULL;
-    /* read XML */
-    file = fopen(CARD_DEF_FILE, "r");
-    if (!file) {
-        pthread_rwlock_unlock(&snd_rwlock);
-        if (snd_card_name != NULL )
-           free(snd_card_name);
-        return NULL;
-    }
-
-    parser = XML_ParserCreate(NULL);
-    if (!parser) {
-        fclose(file);
-        pthread_rwlock_unlock(&snd_rwlock);
-        if (snd_card_name != NULL)
-           free(snd_card_name);
-        return NULL;
-    }
+    /* precompiled image first, card-defs.xml if it has no say */
+    card_def = snd_bin_get_card(card, snd_card_name);
+    if (card_def)
+        goto found;
 
     card_data.card = card;
     card_data.card_name = snd_card_name;
-    XML_SetUserData(parser, &card_data);
-    XML_SetElementHandler(parser, snd_start_tag, snd_end_tag);
-    XML_SetCharacterDataHandler(parser, snd_data_handler);
-
-    /* parse XML */
-    for (;;) {
-        buf = XML_GetBuffer(parser, BUF_SIZE);
-        if (buf == NULL)
-            goto ret;
-        bytes_read = fread(buf, 1, BUF_SIZE, file);
-
-        if (bytes_read < 0)
-            goto ret;
-
-        if (XML_ParseBuffer(parser, bytes_read,
-                            bytes_read == 0) == XML_STATUS_ERROR) {
-            goto ret;
-        }
-
-        if (bytes_read == 0)
-            break;
+    if (snd_parse_xml(CARD_DEF_FILE, &card_data)) {
+        snd_free_card_def(card_data.cur_card_def);
+        goto ret;
     }
-
     card_def = card_data.cur_card_def;
+
+found:
     if (card_def) {
         list_add_tail(&snd_card_list, &card_def->list_node);
         card_def->refcnt++;
@@ -549,8 +1280,6 @@ ret:
     if (snd_card_name != NULL)
        free(snd_card_name);
     card_data.card_name = NULL;
-    XML_ParserFree(parser);
-    fclose(file);
     pthread_rwlock_unlock(&snd_rwlock);
     return card_def;
 }
@@ -582,6 +1311,7 @@ void *snd_card_def_get_node(void *card_node, unsigned int id, int type)
 {
     struct snd_dev_def_card *card_def = (struct snd_dev_def_card *)card_node;
     struct snd_dev_def *dev_def = NULL;
+    const struct snd_bin_id *id_ent;
     struct listnode *dev_node, *temp, *devs_list;
 
     if (!card_def)
@@ -590,6 +1320,14 @@ void *snd_card_def_get_node(void *card_node, unsigned int id, int type)
     if (type >= SND_NODE_TYPE_MAX)
         return NULL;
 
+    if (card_def->bin) {
+        id_ent = snd_bin_find_id(SND_BIN_PTR(snd_bin_addr,
+                                     card_def->bin->id_map_off[type],
+                                     const struct snd_bin_id),
+                                 card_def->bin->num_ids[type], id);
+        return id_ent ? &card_def->bin_devs[type][id_ent->idx] : NULL;
+    }
+
     pthread_rwlock_rdlock(&snd_rwlock);
     if (type == SND_NODE_TYPE_PCM)
         devs_list = &card_def->pcm_devs_list;
@@ -688,6 +1426,9 @@ int snd_card_def_get_int(void *node, const char *prop, int *val)
     if (!dev_def)
         return ret;
 
+    if (dev_def->bin)
+        return snd_bin_get_int(dev_def, prop, val);
+
     pthread_rwlock_rdlock(&snd_rwlock);
     if (!strcmp(prop, "type")) {
         *val = dev_def->type;
@@ -722,6 +1463,9 @@ int snd_card_def_get_str(void *node, const char *prop, char **val)
     if (!dev_def)
         return ret;
 
+    if (dev_def->bin)
+        return snd_bin_get_str(dev_def, prop, val);
+
     pthread_rwlock_rdlock(&snd_rwlock);
     if (!strcmp(prop, "so-name")) {
         if (dev_def->so_name)
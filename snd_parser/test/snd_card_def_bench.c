@@ -0,0 +1,173 @@
+/*
+** Copyright (c) 2023 Qualcomm Innovation Center, Inc. All rights reserved.
+** SPDX-License-Identifier: BSD-3-Clause-Clear
+**/
+
+/*
+ * Card definition lookup cost of a plugin open, XML versus precompiled
+ * image.
+ *
+ * Every iteration does what the pcm, compress and mixer plugins do at
+ * open: get the card, walk its pcm and compress nodes and read the props
+ * the plugins read, then put the card. "cold" starts each iteration with
+ * nothing cached, the way every new process starts: the XML is parsed
+ * again, or the image mapped, validated and checked against the XML.
+ * "warm" keeps the card held and repeats only the node and prop lookups.
+ *
+ * The parser is built into the bench so it can be pointed at any XML;
+ * the image is written next to it.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+static const char *bench_xml_file;
+static char bench_bin_file[256];
+
+#undef CARD_DEF_FILE
+#undef CARD_DEF_BIN_FILE
+#define CARD_DEF_FILE bench_xml_file
+#define CARD_DEF_BIN_FILE bench_bin_file
+
+#include "../src/snd-card-parser.c"
+
+static const char *int_props[] = {
+    "id", "playback", "capture", "session_mode", "native_format",
+    "native_channels", "write_coalesce_ms",
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_reset(bool use_bin)
+{
+    if (snd_bin_addr)
+        munmap(snd_bin_addr, snd_bin_size);
+    snd_bin_addr = NULL;
+    snd_bin_size = 0;
+    snd_bin_state = use_bin ? SND_BIN_UNTRIED : SND_BIN_UNAVAILABLE;
+}
+
+static int bench_lookup(void *card, uint32_t *count)
+{
+    static const int types[] = { SND_NODE_TYPE_PCM, SND_NODE_TYPE_COMPR };
+    void **nodes;
+    char *name;
+    int t, i, j, num, val;
+
+    for (t = 0; t < 2; t++) {
+        num = snd_card_def_get_num_node(card, types[t]);
+        if (!num)
+            continue;
+
+        nodes = calloc(num, sizeof(*nodes));
+        if (!nodes ||
+            snd_card_def_get_nodes_for_type(card, types[t], nodes, num)) {
+            free(nodes);
+            return -1;
+        }
+
+        for (i = 0; i < num; i++) {
+            snd_card_def_get_int(nodes[i], "id", &val);
+            if (snd_card_def_get_node(card, val, types[t]) != nodes[i])
+                return -1;
+            snd_card_def_get_str(nodes[i], "name", &name);
+            for (j = 0; j < (int)(sizeof(int_props) / sizeof(int_props[0])); j++)
+                snd_card_def_get_int(nodes[i], int_props[j], &val);
+            *count += 1;
+        }
+        free(nodes);
+    }
+
+    return 0;
+}
+
+static int bench_run(const char *label, bool use_bin, unsigned int card_id,
+                     uint32_t iters)
+{
+    uint64_t start, cold_ns, warm_ns;
+    uint32_t i, num_nodes = 0;
+    void *card;
+
+    start = now_ns();
+    for (i = 0; i < iters; i++) {
+        bench_reset(use_bin);
+        card = snd_card_def_get_card(card_id);
+        if (!card || bench_lookup(card, &num_nodes)) {
+            printf("%s: card %u lookup failed\n", label, card_id);
+            return -1;
+        }
+        snd_card_def_put_card(card);
+    }
+    cold_ns = now_ns() - start;
+
+    card = snd_card_def_get_card(card_id);
+    if (!card)
+        return -1;
+    num_nodes = 0;
+    start = now_ns();
+    for (i = 0; i < iters; i++)
+        bench_lookup(card, &num_nodes);
+    warm_ns = now_ns() - start;
+    snd_card_def_put_card(card);
+
+    printf("%-6s cold %9.1f us per open, warm %7.2f us per open (%u nodes)\n",
+           label, cold_ns / 1000.0 / iters, warm_ns / 1000.0 / iters,
+           num_nodes / iters);
+
+    return 0;
+}
+
+static void usage(void)
+{
+    printf(" Usage: snd_card_def_bench <card-defs.xml> [-c card] [-n iterations]\n");
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int card_id = 100;
+    uint32_t iters = 200;
+    int opt, ret;
+
+    while ((opt = getopt(argc, argv, "c:n:h")) != -1) {
+        switch (opt) {
+        case 'c':
+            card_id = atoi(optarg);
+            break;
+        case 'n':
+            iters = atoi(optarg);
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (optind >= argc || !iters) {
+        usage();
+        return 1;
+    }
+
+    bench_xml_file = argv[optind];
+    snprintf(bench_bin_file, sizeof(bench_bin_file), "%s.bench.bin",
+             bench_xml_file);
+
+    ret = snd_card_def_compile(bench_xml_file, bench_bin_file);
+    if (ret) {
+        printf("compile failed: %d\n", ret);
+        return 1;
+    }
+
+    printf("%s, card %u, %u iterations\n", bench_xml_file, card_id, iters);
+    ret = bench_run("xml", false, card_id, iters) ||
+          bench_run("image", true, card_id, iters);
+
+    bench_reset(false);
+    unlink(bench_bin_file);
+    return ret ? 1 : 0;
+}